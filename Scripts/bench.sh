@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+# bench.sh <supermodel> <list> <results>
+#
+# Runs each benchmark in <list> headless and appends one line of JSON per run
+# to <results> (see the -bench-output option). Each line of the list is a ROM
+# set, the number of frames to run, and any further Supermodel options, e.g.:
+#
+#   ROMs/scud.zip 3600 -play-inputs=Bench/scud.inp
+#
+# Blank lines and lines starting with '#' are ignored. Exits with an error if
+# any run fails.
+#
+
+if [ $# -ne 3 ]; then
+  echo "usage: $0 <supermodel> <list> <results>" >&2
+  exit 2
+fi
+
+supermodel=$1
+list=$2
+results=$3
+
+if [ ! -f "$list" ]; then
+  echo "Benchmark list '$list' not found." >&2
+  exit 2
+fi
+
+status=0
+runs=0
+while read -r rom frames options; do
+  case "$rom" in
+    ''|\#*) continue ;;
+  esac
+  echo "Benchmarking $rom ($frames frames) $options"
+  # Options are split on whitespace on purpose
+  # shellcheck disable=SC2086
+  if ! "$supermodel" "$rom" -headless -bench="$frames" -bench-output="$results" $options < /dev/null; then
+    echo "Benchmark of $rom failed." >&2
+    status=1
+  fi
+  runs=$((runs + 1))
+done < "$list"
+
+echo "Ran $runs benchmarks; results appended to $results."
+exit $status
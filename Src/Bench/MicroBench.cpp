@@ -0,0 +1,577 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * MicroBench.cpp
+ *
+ * Micro-benchmarks of the emulator's hot kernels on synthetic data, for
+ * judging SIMD and cache work without the noise of a whole game. Linked with
+ * all of Supermodel except Main.cpp and built with 'make microbench'.
+ *
+ * Usage: microbench [name ...]
+ *
+ * Runs every kernel whose name contains one of the given strings (all of them
+ * by default), each twice: warm, with the working set left in cache by the
+ * previous run, and cold, with the caches flushed by sweeping a large buffer
+ * beforehand. Every run is timed on its own and the median is reported as
+ * ns/op, along with the bytes processed per second where that means
+ * something. What one op is is given in the kernel's name.
+ *
+ * Private kernels are reached through the public call that wraps them: the
+ * Real3D texture decoder (StoreTexture) through a texture FIFO flush, its
+ * snapshot copy (UpdateSnapshot) through CatchUpWorkingMemory and
+ * SCSP_DoMasterSamples through SCSP_Update. The cartridge cipher
+ * (block_decrypt) has an entry point of its own, CCrypto::DecryptBlock().
+ */
+
+#include "Supermodel.h"
+#include "CPU/Bus.h"
+#include "CPU/PowerPC/ppc.h"
+#include "Graphics/IRender3D.h"
+#include "Graphics/New3D/Mat4.h"
+#include "Model3/Crypto.h"
+#include "Model3/DSB.h"
+#include "Model3/IRQ.h"
+#include "Model3/Real3D.h"
+#include "Model3/TileGen.h"
+#include "OSD/Video.h"
+#include "Sound/SCSP.h"
+#include "Sound/SCSPDSP.h"
+#include "Util/ByteSwap.h"
+#include "Util/NewConfig.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Normally provided by Main.cpp. Only called by CModel3::RenderFrame(), which is never run here.
+bool BeginFrameVideo()
+{
+  return false;
+}
+
+void EndFrameVideo()
+{
+}
+
+
+/******************************************************************************
+ Harness
+******************************************************************************/
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t EVICT_SIZE = 64 * 0x100000;  // larger than any last level cache
+static const double TIME_BUDGET = 0.5;           // seconds per kernel and variant
+static const unsigned MIN_RUNS = 10;
+static const unsigned MAX_WARM_RUNS = 100000;
+static const unsigned MAX_COLD_RUNS = 50;
+
+struct Kernel
+{
+  std::string             name;
+  std::function<void()>   setup;  // untimed, before every run (optional)
+  std::function<size_t()> run;    // returns bytes processed, or 0 if not meaningful
+};
+
+struct Measurement
+{
+  double    nsPerOp = 0;
+  double    bytesPerOp = 0;
+  unsigned  runs = 0;
+};
+
+static std::vector<uint8_t> s_evictBuffer;
+
+static void EvictCaches()
+{
+  // Dirtying every line also forces the kernel's own dirty lines out to memory
+  for (size_t i = 0; i < s_evictBuffer.size(); i += 64)
+    s_evictBuffer[i]++;
+}
+
+static Measurement Measure(const Kernel &kernel, bool cold)
+{
+  if (!cold)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      if (kernel.setup)
+        kernel.setup();
+      kernel.run();
+    }
+  }
+
+  std::vector<double> times;
+  double totalBytes = 0;
+  unsigned maxRuns = cold ? MAX_COLD_RUNS : MAX_WARM_RUNS;
+  auto start = Clock::now();
+  while (times.size() < maxRuns && (times.size() < MIN_RUNS || std::chrono::duration<double>(Clock::now() - start).count() < TIME_BUDGET))
+  {
+    if (kernel.setup)
+      kernel.setup();
+    if (cold)
+      EvictCaches();
+    auto t0 = Clock::now();
+    size_t bytes = kernel.run();
+    auto t1 = Clock::now();
+    times.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+    totalBytes += double(bytes);
+  }
+
+  Measurement m;
+  m.runs = unsigned(times.size());
+  std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+  m.nsPerOp = times[times.size() / 2];
+  m.bytesPerOp = totalBytes / m.runs;
+  return m;
+}
+
+// Deterministic pseudo-random data, so runs are comparable between builds
+static uint32_t s_seed = 0x12345678;
+
+static uint32_t Random()
+{
+  s_seed ^= s_seed << 13;
+  s_seed ^= s_seed >> 17;
+  s_seed ^= s_seed << 5;
+  return s_seed;
+}
+
+static void FillRandom(void *buffer, size_t size)
+{
+  uint8_t *p = (uint8_t *) buffer;
+  for (size_t i = 0; i < size; i++)
+    p[i] = uint8_t(Random() >> 24);
+}
+
+
+/******************************************************************************
+ Kernels
+******************************************************************************/
+
+static const size_t SWAP_SIZE = 0x10000;
+static const int NUM_MATRICES = 1024;
+static const int CRYPTO_WORDS = 2048;
+static const int SAMPLES_PER_FRAME = 44100 / 60;
+static const int DSP_SAMPLES = 64;
+static const int PPC_CYCLES = 100000;
+
+static void AddByteSwapKernels(std::vector<Kernel> *kernels)
+{
+  auto buffer = std::make_shared<std::vector<uint8_t>>(SWAP_SIZE);
+  FillRandom(buffer->data(), buffer->size());
+  kernels->push_back({ "Util::FlipEndian16 (64 KB)", nullptr, [=]() { Util::FlipEndian16(buffer->data(), buffer->size()); return buffer->size(); } });
+  kernels->push_back({ "Util::FlipEndian16Scalar (64 KB)", nullptr, [=]() { Util::FlipEndian16Scalar(buffer->data(), buffer->size()); return buffer->size(); } });
+  kernels->push_back({ "Util::FlipEndian32 (64 KB)", nullptr, [=]() { Util::FlipEndian32(buffer->data(), buffer->size()); return buffer->size(); } });
+  kernels->push_back({ "Util::FlipEndian32Scalar (64 KB)", nullptr, [=]() { Util::FlipEndian32Scalar(buffer->data(), buffer->size()); return buffer->size(); } });
+}
+
+static void AddMatrixKernels(std::vector<Kernel> *kernels)
+{
+  // Like the scene walk: a stack of transforms applied to the current matrix
+  auto matrices = std::make_shared<std::vector<float>>(NUM_MATRICES * 16);
+  for (float &f : *matrices)
+    f = float(Random() % 2001) / 1000.0f - 1.0f;
+  auto mat = std::make_shared<New3D::Mat4>();
+  kernels->push_back({ "New3D::Mat4::MultMatrix (x1024)", nullptr, [=]()
+  {
+    for (int i = 0; i < NUM_MATRICES; i++)
+    {
+      if ((i & 15) == 0)
+        mat->LoadIdentity();
+      mat->MultMatrix(&(*matrices)[i * 16]);
+    }
+    return size_t(NUM_MATRICES * 16 * sizeof(float));
+  } });
+}
+
+static void AddCryptoKernels(std::vector<Kernel> *kernels)
+{
+  auto ram = std::make_shared<std::vector<uint16_t>>(0x8000);
+  FillRandom(ram->data(), ram->size() * 2);
+  auto crypto = std::make_shared<CCrypto>();
+  crypto->Init(0x29AE, [ram](uint32_t addr) { return (*ram)[addr & 0x7FFF]; });
+  crypto->Reset();
+  kernels->push_back({ "CCrypto::block_decrypt (2048 words)", [=]()
+  {
+    crypto->SetSubKey(uint16_t(Random()));
+  }, [=]()
+  {
+    uint16_t sum = 0;
+    for (int i = 0; i < CRYPTO_WORDS; i++)
+      sum += crypto->DecryptBlock(uint16_t(i), (*ram)[i]);
+    (*ram)[0] = sum;  // keeps the loop from being optimized away
+    return size_t(CRYPTO_WORDS * 2);
+  } });
+}
+
+struct ResamplerState
+{
+  Util::Config::Node  config{ "Global" };
+  std::unique_ptr<CDSBResampler> resampler;
+  INT16 inL[32000 / 60 + 2];
+  INT16 inR[32000 / 60 + 2];
+  float outL[SAMPLES_PER_FRAME];
+  float outR[SAMPLES_PER_FRAME];
+};
+
+static void AddResamplerKernels(std::vector<Kernel> *kernels)
+{
+  auto s = std::make_shared<ResamplerState>();
+  s->resampler = std::make_unique<CDSBResampler>(s->config);
+  kernels->push_back({ "CDSBResampler::UpSampleAndMix (1 frame)", [=]()
+  {
+    FillRandom(s->inL, sizeof(s->inL));
+    FillRandom(s->inR, sizeof(s->inR));
+    memset(s->outL, 0, sizeof(s->outL));
+    memset(s->outR, 0, sizeof(s->outR));
+  }, [=]()
+  {
+    s->resampler->UpSampleAndMix(s->outL, s->outR, s->inL, s->inR, 200, 200, SAMPLES_PER_FRAME, 32000 / 60 + 2, 44100, 32000);
+    return sizeof(s->outL) + sizeof(s->outR);
+  } });
+}
+
+static int Run68K(int cycles)
+{
+  return 0; // no sound CPU; the budget counts as used exactly
+}
+
+struct SCSPState
+{
+  Util::Config::Node    config{ "Global" };
+  std::vector<uint8_t>  ram = std::vector<uint8_t>(0x100000);
+  float fl[SAMPLES_PER_FRAME], fr[SAMPLES_PER_FRAME], rl[SAMPLES_PER_FRAME], rr[SAMPLES_PER_FRAME];
+};
+
+static void AddSCSPKernels(std::vector<Kernel> *kernels)
+{
+  // All 32 slots looping over random 16-bit samples at different pitches,
+  // panned about and sent to the DSP (which runs an empty program)
+  auto s = std::make_shared<SCSPState>();
+  s->config.Set("MultiThreaded", false);
+  s->config.Set("LegacySoundDSP", false);
+  if (SCSP_Init(s->config, 1) != Result::OKAY)
+    return;
+  FillRandom(s->ram.data(), s->ram.size());
+  SCSP_SetRAM(0, s->ram.data());
+  SCSP_SetBuffers(s->fl, s->fr, s->rl, s->rr, SAMPLES_PER_FRAME);
+  SCSP_SetCB(Run68K, [](int) {}, []() { return 0; }, []() {});
+  for (unsigned slot = 0; slot < 32; slot++)
+  {
+    unsigned base = slot * 0x20;
+    unsigned sa = slot * 0x4000;
+    SCSP_w16(base + 0x02, uint16_t(sa & 0xFFFF));
+    SCSP_w16(base + 0x04, 0x0000);                  // LSA
+    SCSP_w16(base + 0x06, 0x1FFF);                  // LEA
+    SCSP_w16(base + 0x08, 0x001F);                  // AR: fastest attack, no decay
+    SCSP_w16(base + 0x0A, 0x0000);
+    SCSP_w16(base + 0x0C, 0x0000);                  // TL: full volume
+    SCSP_w16(base + 0x10, uint16_t(slot * 0x1F));   // OCT 0, FNS
+    SCSP_w16(base + 0x14, uint16_t(((slot & 15) << 3) | 4)); // ISEL, IMXL
+    SCSP_w16(base + 0x16, uint16_t(0xE000 | ((slot & 31) << 8)));  // DISDL, DIPAN
+    SCSP_w16(base + 0x00, uint16_t(0x0800 | 0x0020 | (sa >> 16)));  // KYONB, normal loop, SA
+  }
+  SCSP_w16(0x00, uint16_t(0x1800 | 0x0020));        // KYONEX
+  kernels->push_back({ "SCSP_DoMasterSamples (1 frame)", nullptr, [s]()
+  {
+    SCSP_Update();
+    return size_t(SAMPLES_PER_FRAME * 4 * sizeof(float));
+  } });
+}
+
+struct DSPState
+{
+  _SCSPDSP              dsp;
+  std::vector<uint16_t> ram = std::vector<uint16_t>(0x80000);
+};
+
+static void AddSCSPDSPKernels(std::vector<Kernel> *kernels)
+{
+  // A full 128 step program of random instructions, short of the invalid
+  // input addresses that would end it early
+  auto s = std::make_shared<DSPState>();
+  SCSPDSP_Init(&s->dsp);
+  s->dsp.SCSPRAM = s->ram.data();
+  s->dsp.SCSPRAM_LENGTH = uint32_t(s->ram.size());
+  for (int step = 0; step < 128; step++)
+  {
+    uint16_t *op = &s->dsp.MPRO[step * 4];
+    op[0] = uint16_t(Random());
+    op[1] = uint16_t((Random() & 0xF03F) | ((Random() % 0x32) << 6));
+    op[2] = uint16_t(Random());
+    op[3] = uint16_t(Random());
+  }
+  for (auto &c : s->dsp.COEF)
+    c = INT16(Random());
+  for (auto &m : s->dsp.MADRS)
+    m = uint16_t(Random());
+  SCSPDSP_Start(&s->dsp);
+  kernels->push_back({ "SCSPDSP_Step (x64)", nullptr, [=]()
+  {
+    for (int i = 0; i < DSP_SAMPLES; i++)
+    {
+      for (int j = 0; j < 16; j++)
+        SCSPDSP_SetSample(&s->dsp, INT32(Random() >> 12) - 0x80000, j, 4);
+      SCSPDSP_Step(&s->dsp);
+    }
+    return size_t(0);
+  } });
+}
+
+struct TileGenState
+{
+  Util::Config::Node        config{ "Global" };
+  std::unique_ptr<CTileGen> tileGen;
+};
+
+static void AddTileGenKernels(std::vector<Kernel> *kernels)
+{
+  // All four layer pairs enabled over random tiles and name tables, half of
+  // them 4-bit and half 8-bit, with line scrolling on one layer
+  auto s = std::make_shared<TileGenState>();
+  s->config.Set("GPUMultiThreaded", false);
+  s->config.Set("MultiThreaded", false);
+  s->tileGen = std::make_unique<CTileGen>(s->config);
+  if (s->tileGen->Init(nullptr) != Result::OKAY)
+    return;
+  for (unsigned addr = 0; addr < 0x120000; addr += 4)
+    s->tileGen->WriteRAM32(addr, Random());
+  s->tileGen->WriteRegister(0x20, 0x0000A300);
+  s->tileGen->WriteRegister(0x60, 0x80000000 | (37 << 16) | 11);
+  s->tileGen->WriteRegister(0x64, 0x80000000 | (102 << 16) | 300);
+  s->tileGen->WriteRegister(0x68, 0x80008000 | (5 << 16));
+  s->tileGen->WriteRegister(0x6C, 0x80000000 | (250 << 16) | 123);
+  s->tileGen->SyncSnapshots();
+  kernels->push_back({ "CTileGen::DrawLine (384 lines)", nullptr, [=]()
+  {
+    for (int line = 0; line < 384; line++)
+      s->tileGen->DrawLine(line);
+    return size_t(496 * 384 * 2 * sizeof(UINT32));
+  } });
+}
+
+// Stands in for the GPU, which is not needed to exercise Real3D's own memory handling
+class CNullRender3D: public IRender3D
+{
+public:
+  void RenderFrame(void) override {}
+  void BeginFrame(void) override {}
+  void EndFrame(void) override {}
+  void UploadTextures(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height) override {}
+  void AttachMemory(const uint32_t *cullingRAMLoPtr, const uint32_t *cullingRAMHiPtr, const uint32_t *polyRAMPtr, const uint32_t *vromPtr, const uint16_t *textureRAMPtr) override {}
+  void SetStepping(int stepping) override {}
+  Result Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes, unsigned aaTarget) override { return Result::OKAY; }
+  void SetSunClamp(bool enable) override {}
+  float GetLosValue(int layer) override { return 0.0f; }
+};
+
+struct Real3DState
+{
+  Util::Config::Node        config{ "Global" };
+  CNullRender3D             render3D;
+  IBus                      bus;
+  std::vector<uint8_t>      vrom = std::vector<uint8_t>(0x100000);
+  std::unique_ptr<CReal3D>  real3D;
+  std::vector<uint32_t>     texture;
+  std::vector<uint32_t>     block = std::vector<uint32_t>(16);
+};
+
+static void AddReal3DKernels(std::vector<Kernel> *kernels)
+{
+  auto s = std::make_shared<Real3DState>();
+  s->config.Set("GPUMultiThreaded", true);
+  s->config.Set("MultiThreaded", false);
+  s->config.Set("FineDirtyTracking", true);
+  s->real3D = std::make_unique<CReal3D>(s->config);
+  if (s->real3D->Init(s->vrom.data(), &s->bus, nullptr, 0) != Result::OKAY)
+    return;
+  s->real3D->AttachRenderer(&s->render3D);
+  s->real3D->Reset();
+
+  // 256x256 16-bit texture without mipmaps, as it arrives in the texture FIFO
+  unsigned texWords = 256 * 256 * 2 / 4;
+  s->texture.resize(2 + texWords);
+  s->texture[0] = ((2 + texWords) * 4 - 2) * 2;
+  s->texture[1] = (0x01 << 24) | (1 << 23) | (3 << 17) | (3 << 14) | (4 << 7) | 8;
+  FillRandom(&s->texture[2], texWords * 4);
+  kernels->push_back({ "CReal3D::StoreTexture (256x256 16-bit)", [=]()
+  {
+    s->real3D->WriteTextureFIFOBlock(s->texture.data(), unsigned(s->texture.size()), false);
+  }, [=]()
+  {
+    s->real3D->Flush();
+    return size_t(texWords * 4);
+  } });
+
+  // A frame's worth of scattered display list updates: 512 runs of 16 words
+  // in polygon RAM, copied back into the working memory after the swap
+  kernels->push_back({ "CReal3D::UpdateSnapshot (512 scattered writes)", [=]()
+  {
+    for (int i = 0; i < 512; i++)
+    {
+      FillRandom(s->block.data(), s->block.size() * 4);
+      s->real3D->WritePolygonRAMBlock((Random() % (0x400000 / 64)) * 64, s->block.data(), unsigned(s->block.size()), false);
+    }
+    s->real3D->SyncSnapshots();
+  }, [=]()
+  {
+    return size_t(s->real3D->CatchUpWorkingMemory());
+  } });
+}
+
+// PowerPC instruction encodings
+static constexpr uint32_t OpD(uint32_t op, uint32_t d, uint32_t a, int32_t imm)         { return (op << 26) | (d << 21) | (a << 16) | (uint32_t(imm) & 0xFFFF); }
+static constexpr uint32_t OpX(uint32_t op, uint32_t s, uint32_t a, uint32_t b, uint32_t xo) { return (op << 26) | (s << 21) | (a << 16) | (b << 11) | (xo << 1); }
+static constexpr uint32_t OpRLWINM(uint32_t a, uint32_t s, uint32_t sh, uint32_t mb, uint32_t me) { return (21u << 26) | (s << 21) | (a << 16) | (sh << 11) | (mb << 6) | (me << 1); }
+static constexpr uint32_t OpFMULS(uint32_t d, uint32_t a, uint32_t c)                    { return (59u << 26) | (d << 21) | (a << 16) | (c << 6) | (25 << 1); }
+static constexpr uint32_t OpBNE(int32_t offset)                                            { return (16u << 26) | (4 << 21) | (2 << 16) | (uint32_t(offset) & 0xFFFC); }
+static constexpr uint32_t OpB(int32_t offset)                                              { return (18u << 26) | (uint32_t(offset) & 0x03FFFFFC); }
+
+// Loop of loads, stores, integer, rotate, multiply, single precision float and branches at the reset vector
+static const uint32_t s_ppcProgram[] =
+{
+  OpD(14, 0, 0, 0x2040),      // li      r0,0x2040  (FP available, exception prefix)
+  OpX(31, 0, 0, 0, 146),      // mtmsr   r0
+  OpD(14, 3, 0, 0x1000),      // li      r3,0x1000
+  OpD(14, 5, 0, 0),           // li      r5,0
+  // loop:
+  OpD(32, 6, 3, 0),           // lwz     r6,0(r3)
+  OpX(31, 6, 6, 5, 266),      // add     r6,r6,r5
+  OpD(36, 6, 3, 4),           // stw     r6,4(r3)
+  OpRLWINM(7, 6, 3, 0, 28),   // rlwinm  r7,r6,3,0,28
+  OpX(31, 6, 8, 7, 316),      // xor     r8,r6,r7
+  OpX(31, 9, 8, 5, 235),      // mullw   r9,r8,r5
+  OpD(48, 1, 3, 8),           // lfs     f1,8(r3)
+  OpFMULS(2, 1, 1),           // fmuls   f2,f1,f1
+  OpX(59, 3, 2, 1, 21),       // fadds   f3,f2,f1
+  OpD(52, 3, 3, 12),          // stfs    f3,12(r3)
+  OpD(14, 5, 5, 1),           // addi    r5,r5,1
+  OpD(28, 5, 10, 3),          // andi.   r10,r5,3
+  OpBNE(8),                   // bne     skip
+  OpD(36, 9, 3, 16),          // stw     r9,16(r3)
+  // skip:
+  OpB(-14 * 4)                // b       loop
+};
+
+struct PPCState
+{
+  IBus                  bus;
+  std::vector<uint8_t>  ram = std::vector<uint8_t>(0x100000);
+  std::vector<uint8_t>  ramStatePages = std::vector<uint8_t>((0x100000 >> CBlockFile::PageShift) + 1);
+  std::vector<uint32_t> rom = std::vector<uint32_t>(0x100000 / 4);
+  PPC_FETCH_REGION      fetch[2];
+};
+
+static void AddPPCKernels(std::vector<Kernel> *kernels)
+{
+  static PPCState s;  // the core is a singleton
+  std::copy(std::begin(s_ppcProgram), std::end(s_ppcProgram), &s.rom[0x100 / 4]);
+  PPC_CONFIG config;
+  config.pvr = PPC_MODEL_603R;
+  config.bus_frequency = BUS_FREQUENCY_66MHZ;
+  config.bus_frequency_multiplier = 0x25;
+  ppc_init(&config);
+  ppc_attach_bus(&s.bus);
+  s.fetch[0].start = 0xFFF00000;
+  s.fetch[0].end = 0xFFFFFFFF;
+  s.fetch[0].ptr = s.rom.data();
+  s.fetch[0].banked = false;
+  s.fetch[1].start = 0;
+  s.fetch[1].end = 0;
+  s.fetch[1].ptr = NULL;
+  s.fetch[1].banked = false;
+  ppc_set_fetch(s.fetch);
+  ppc_set_ram(s.ram.data(), uint32_t(s.ram.size()), s.ramStatePages.data());
+  ppc_set_idle_skip(false);
+  ppc_set_fast_fpu(true);
+
+  ppc_reset();
+
+  // Switching flushes the translated code, so only do it when changing over
+  static bool dynarec = false;
+  auto use = [](bool enable)
+  {
+    return [enable]()
+    {
+      if (dynarec != enable)
+        ppc_set_dynarec(enable);
+      dynarec = enable;
+    };
+  };
+  auto execute = []()
+  {
+    ppc_execute(PPC_CYCLES);
+    return size_t(0);
+  };
+  kernels->push_back({ "ppc_execute, interpreter (100K cycles)", use(false), execute });
+  if (ppc_set_dynarec(true))
+    kernels->push_back({ "ppc_execute, dynarec (100K cycles)", use(true), execute });
+  ppc_set_dynarec(false);
+}
+
+
+/******************************************************************************
+ Main
+******************************************************************************/
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> filters(argv + 1, argv + argc);
+  SetLogger(std::make_shared<CConsoleErrorLogger>());
+  s_evictBuffer.resize(EVICT_SIZE);
+
+  std::vector<Kernel> kernels;
+  AddByteSwapKernels(&kernels);
+  AddMatrixKernels(&kernels);
+  AddCryptoKernels(&kernels);
+  AddResamplerKernels(&kernels);
+  AddSCSPKernels(&kernels);
+  AddSCSPDSPKernels(&kernels);
+  AddTileGenKernels(&kernels);
+  AddReal3DKernels(&kernels);
+  AddPPCKernels(&kernels);
+
+  printf("%-48s %-5s %12s %12s %7s\n", "Kernel", "Cache", "ns/op", "MB/s", "Runs");
+  for (auto &kernel : kernels)
+  {
+    bool selected = filters.empty();
+    for (auto &filter : filters)
+      selected |= kernel.name.find(filter) != std::string::npos;
+    if (!selected)
+      continue;
+
+    for (bool cold : { false, true })
+    {
+      Measurement m = Measure(kernel, cold);
+      char rate[32] = "-";
+      if (m.bytesPerOp > 0)
+        sprintf(rate, "%12.1f", m.bytesPerOp / m.nsPerOp * 1e9 / 1e6);
+      printf("%-48s %-5s %12.0f %12s %7u\n", kernel.name.c_str(), cold ? "cold" : "warm", m.nsPerOp, rate, m.runs);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
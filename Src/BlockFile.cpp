@@ -32,23 +32,116 @@
 #include <cstring>
 #include <cstdint>
 #include "Supermodel.h"
+#include <algorithm>
+#include <zlib.h>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>  // MapViewOfFile()
+#else
+#include <fcntl.h>
+#include <sys/mman.h> // mmap()
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Compressed files begin with this, which is never a plausible length for
+// the first block of an uncompressed file
+static const char s_compressedSignature[4] = { 'S', 'M', 'B', 'Z' };
 
 
 /******************************************************************************
  Output Functions
 ******************************************************************************/
 
+bool CBlockFile::IsOpen(void) const
+{
+  return fp != NULL || image != NULL || memData != NULL;
+}
+
+long int CBlockFile::Tell(void)
+{
+  if (fp != NULL)
+    return ftell(fp);
+  return memPos;
+}
+
+void CBlockFile::Seek(long int pos)
+{
+  if (fp != NULL)
+    fseek(fp, pos, SEEK_SET);
+  else
+    memPos = pos;
+}
+
+size_t CBlockFile::RawRead(void *data, size_t numBytes)
+{
+  if (inflated)
+  {
+    numBytes = std::min(numBytes, blockData.size() - blockPos);
+    memcpy(data, &blockData[blockPos], numBytes);
+    blockPos += numBytes;
+    return numBytes;
+  }
+  if (fp != NULL)
+    return fread(data, sizeof(uint8_t), numBytes, fp);
+  if (NULL == memData || memPos >= fileSize)
+    return 0;
+  numBytes = std::min(numBytes, size_t(fileSize - memPos));
+  memcpy(data, &memData[memPos], numBytes);
+  memPos += numBytes;
+  return numBytes;
+}
+
+void CBlockFile::RawWrite(const void *data, size_t numBytes)
+{
+  if (fp != NULL)
+  {
+    fwrite(data, sizeof(uint8_t), numBytes, fp);
+    return;
+  }
+  if (NULL == image)
+    return;
+
+  size_t end = memPos + numBytes;
+  if (end > image->data.size())
+  {
+    image->data.resize(end);
+    image->touchedPages.resize((end + PageSize - 1) >> PageShift, 0);
+  }
+
+  // Copy page by page, skipping pieces that match the previous contents
+  const uint8_t *src = (const uint8_t *) data;
+  for (size_t offset = memPos; offset < end; )
+  {
+    size_t pieceEnd = std::min(end, (offset | (PageSize - 1)) + 1);
+    size_t pieceSize = pieceEnd - offset;
+    uint8_t *dest = &image->data[offset];
+    if (pieceEnd > reuseSize || memcmp(dest, src, pieceSize) != 0)
+    {
+      memcpy(dest, src, pieceSize);
+      image->touchedPages[offset >> PageShift] = 1;
+    }
+    src += pieceSize;
+    offset = pieceEnd;
+  }
+  memPos = end;
+  fileSize = std::max(fileSize, memPos);
+}
+
 void CBlockFile::ReadString(std::string *str, uint32_t length)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
   str->clear();
   //TODO: use fstream to get rid of this ugly hack
   bool keep_loading = true;
   for (uint32_t i = 0; i < length; i++)
   {
-    char c;
-    fread(&c, sizeof(char), 1, fp);
+    char c = 0;
+    RawRead(&c, sizeof(char));
     if (keep_loading)
     {
       if (!c)
@@ -61,16 +154,16 @@ void CBlockFile::ReadString(std::string *str, uint32_t length)
 
 unsigned CBlockFile::ReadBytes(void *data, uint32_t numBytes)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return 0;
-  return fread(data, sizeof(uint8_t), numBytes, fp);
+  return RawRead(data, numBytes);
 }
 
 unsigned CBlockFile::ReadDWord(uint32_t *data)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return 0;
-  fread(data, sizeof(uint32_t), 1, fp);
+  RawRead(data, sizeof(uint32_t));
   return 4;
 }
   
@@ -79,46 +172,46 @@ void CBlockFile::UpdateBlockSize(void)
   long int  curPos;
   unsigned  newBlockSize;
   
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  curPos = ftell(fp);       // save current file position
-  fseek(fp, blockStartPos, SEEK_SET);
+  curPos = Tell();        // save current file position
+  Seek(blockStartPos);
   newBlockSize = curPos - blockStartPos;
-  fwrite(&newBlockSize, sizeof(uint32_t), 1, fp);
-  fseek(fp, curPos, SEEK_SET);  // go back
+  RawWrite(&newBlockSize, sizeof(uint32_t));
+  Seek(curPos);           // go back
 }
 
 void CBlockFile::WriteByte(uint8_t data)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  fwrite(&data, sizeof(uint8_t), 1, fp);
+  RawWrite(&data, sizeof(uint8_t));
   UpdateBlockSize();
 }
 
 void CBlockFile::WriteDWord(uint32_t data)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  fwrite(&data, sizeof(uint32_t), 1, fp);
+  RawWrite(&data, sizeof(uint32_t));
   UpdateBlockSize();
 }
 
 void CBlockFile::WriteBytes(const void *data, uint32_t numBytes)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  fwrite(data, sizeof(uint8_t), numBytes, fp);
+  RawWrite(data, numBytes);
   UpdateBlockSize();
 }
 
 void CBlockFile::WriteBlockHeader(const std::string &name, const std::string &comment)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
   
   // Record current block starting position
-  blockStartPos = ftell(fp);
+  blockStartPos = Tell();
 
   // Write the total block length field
   WriteDWord(0);  // will be automatically updated as we write the file
@@ -130,7 +223,7 @@ void CBlockFile::WriteBlockHeader(const std::string &name, const std::string &co
   Write(comment);
   
   // Record the start of the current data section
-  dataStartPos = ftell(fp);
+  dataStartPos = Tell();
 } 
 
 
@@ -148,6 +241,9 @@ void CBlockFile::WriteBlockHeader(const std::string &name, const std::string &co
  name     ...     Name string (null-terminated, up to 1025 bytes).
  comment    ...     Comment string (same as above).
  data     ...     Raw data (blockLength - total header size).
+
+ Compressed files begin with a signature, and the data of each block is
+ replaced by its size (uint32_t) and its zlib compressed form.
 ******************************************************************************/
 
 unsigned CBlockFile::Read(void *data, uint32_t numBytes)
@@ -157,6 +253,40 @@ unsigned CBlockFile::Read(void *data, uint32_t numBytes)
   return 0;
 }
 
+const void *CBlockFile::ReadView(uint32_t numBytes)
+{
+  if (mode != 'r')
+    return NULL;
+  if (inflated)
+  {
+    if (blockData.size() - blockPos < numBytes)
+      return NULL;
+    const void *data = &blockData[blockPos];
+    blockPos += numBytes;
+    return data;
+  }
+  if (NULL == memData || memPos > fileSize || size_t(fileSize - memPos) < numBytes)
+    return NULL;
+  const void *data = &memData[memPos];
+  memPos += numBytes;
+  return data;
+}
+
+unsigned CBlockFile::Read(const StateRegions &regions)
+{
+  if (mode != 'r' || !IsOpen())
+    return 0;
+  unsigned numBytes = 0;
+  for (auto &region: regions.Regions())
+  {
+    size_t bytesRead = RawRead(region.data, region.numBytes);
+    numBytes += bytesRead;
+    if (bytesRead != region.numBytes)
+      break;
+  }
+  return numBytes;
+}
+
 unsigned CBlockFile::Read(bool *value)
 {
   uint8_t byte;
@@ -172,6 +302,54 @@ void CBlockFile::Write(const void *data, uint32_t numBytes)
     WriteBytes(data, numBytes);
 }
 
+void CBlockFile::Write(const void *data, uint32_t numBytes, uint8_t *changedPages)
+{
+  if (mode != 'w')
+    return;
+  if (NULL == image || !image->trackPages)
+  {
+    WriteBytes(data, numBytes);
+    return;
+  }
+
+  // Unflagged pages can only be skipped if the region was written to the same
+  // place last time
+  long int start = memPos;
+  bool sameLayout = trackedIndex < image->trackedOffsets.size() && image->trackedOffsets[trackedIndex] == uint32_t(start) && size_t(start) + numBytes <= reuseSize;
+  if (trackedIndex >= image->trackedOffsets.size())
+    image->trackedOffsets.resize(trackedIndex + 1);
+  image->trackedOffsets[trackedIndex++] = uint32_t(start);
+
+  const uint8_t *src = (const uint8_t *) data;
+  uint32_t numPages = (numBytes + PageSize - 1) >> PageShift;
+  if (!sameLayout)
+    RawWrite(src, numBytes);
+  else
+  {
+    for (uint32_t page = 0; page < numPages; page++)
+    {
+      if (changedPages[page])
+      {
+        uint32_t offset = page << PageShift;
+        memPos = start + offset;
+        RawWrite(&src[offset], std::min(PageSize, numBytes - offset));
+      }
+    }
+    memPos = start + numBytes;
+  }
+  memset(changedPages, 0, numPages);
+  UpdateBlockSize();
+}
+
+void CBlockFile::Write(const StateRegions &regions)
+{
+  if (mode != 'w' || !IsOpen())
+    return;
+  for (auto &region: regions.Regions())
+    RawWrite(region.data, region.numBytes);
+  UpdateBlockSize();
+}
+
 void CBlockFile::Write(bool value)
 {
   uint8_t byte = value ? 1 : 0;
@@ -190,14 +368,13 @@ void CBlockFile::NewBlock(const std::string &name, const std::string &comment)
     WriteBlockHeader(name, comment);
 }
 
-Result CBlockFile::FindBlock(const std::string &name)
+void CBlockFile::BuildIndex(void)
 {
-  if (mode != 'r')
-    return Result::FAIL;
-    
-  fseek(fp, 0, SEEK_SET);
+  indexed = true;
+  blockIndex.clear();
+  Seek(firstBlockPos);
   
-  long int  curPos = 0;
+  long int  curPos = firstBlockPos;
   while (curPos < fileSize)
   {
     blockStartPos = curPos;
@@ -212,20 +389,39 @@ Result CBlockFile::FindBlock(const std::string &name)
     std::string block_name;
     ReadString(&block_name, name_length);
     
-    // Is this the block we want?
-    if (block_name == name)
-    {
-      fseek(fp, blockStartPos + 12 + name_length + comment_length, SEEK_SET); // move to beginning of data
-      dataStartPos = ftell(fp);
-      return Result::OKAY;
-    }
+    uint32_t header_length = 12 + name_length + comment_length;
+    if (block_length >= header_length)
+      blockIndex.push_back({ block_name, blockStartPos + long(header_length), block_length - header_length });
     
     // Move to next block
-    fseek(fp, blockStartPos + block_length, SEEK_SET);
+    Seek(blockStartPos + block_length);
     curPos = blockStartPos + block_length;
     if (block_length == 0)  // this would never advance
       break;
   }
+}
+
+Result CBlockFile::FindBlock(const std::string &name)
+{
+  if (mode != 'r')
+    return Result::FAIL;
+    
+  inflated = false;
+  if (!indexed)
+    BuildIndex();
+  
+  for (auto &block: blockIndex)
+  {
+    // Is this the block we want?
+    if (block.name == name)
+    {
+      Seek(block.dataStart);  // move to beginning of data
+      dataStartPos = block.dataStart;
+      if (firstBlockPos != 0)
+        return InflateBlock(block.length);
+      return Result::OKAY;
+    }
+  }
   
   return Result::FAIL;
 }
@@ -239,21 +435,153 @@ Result CBlockFile::Create(const std::string &file, const std::string &headerName
   WriteBlockHeader(headerName, comment);
   return Result::OKAY;
 }
+
+void CBlockFile::CreateInMemory(MemoryImage *memoryImage, const std::string &headerName, const std::string &comment)
+{
+  image = memoryImage;
+  reuseSize = image->data.size();
+  image->touchedPages.assign((reuseSize + PageSize - 1) >> PageShift, 0);
+  if (0 == reuseSize)
+    image->trackedOffsets.clear();
+  trackedIndex = 0;
+  memPos = 0;
+  fileSize = 0;
+  mode = 'w';
+  WriteBlockHeader(headerName, comment);
+}
   
+bool CBlockFile::MapFile(const std::string &file)
+{
+#ifdef _WIN32
+  HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (INVALID_HANDLE_VALUE == handle)
+    return false;
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(handle, &size) && size.QuadPart > 0)
+    mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping != NULL)
+  {
+    mappedData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);   // view remains valid
+  }
+  CloseHandle(handle);
+  if (NULL == mappedData)
+    return false;
+  mappedSize = size_t(size.QuadPart);
+#else
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    void *ptr = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED)
+    {
+      mappedData = ptr;
+      mappedSize = size_t(st.st_size);
+    }
+  }
+  close(fd);  // mapping remains valid
+  if (NULL == mappedData)
+    return false;
+#endif
+  memData = (const uint8_t *) mappedData;
+  memPos = 0;
+  fileSize = long(mappedSize);
+  return true;
+}
+
 Result CBlockFile::Load(const std::string &file)
 {
-  fp = fopen(file.c_str(), "rb");
-  if (NULL == fp)
-    return Result::FAIL;
+  if (!MapFile(file))
+  {
+    fp = fopen(file.c_str(), "rb");
+    if (NULL == fp)
+      return Result::FAIL;
+
+    // Get the file size
+    fseek(fp, 0, SEEK_END);
+    fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+  }
   mode = 'r';
+  indexed = false;
   
   // TODO: is this a valid block file?
+
+  // Check whether it is compressed
+  char signature[sizeof(s_compressedSignature)];
+  if (RawRead(signature, sizeof(signature)) == sizeof(signature) && memcmp(signature, s_compressedSignature, sizeof(signature)) == 0)
+    firstBlockPos = sizeof(signature);
+  else
+    firstBlockPos = 0;
+  Seek(0);
   
-  // Get the file size
-  fseek(fp, 0, SEEK_END);
-  fileSize = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  
+  return Result::OKAY;
+}
+
+void CBlockFile::LoadFromMemory(const uint8_t *data, size_t size)
+{
+  memData = data;
+  memPos = 0;
+  fileSize = long(size);
+  firstBlockPos = 0;
+  indexed = false;
+  mode = 'r';
+}
+
+Result CBlockFile::WriteCompressed(const std::string &file, const uint8_t *data, size_t size)
+{
+  FILE *out = fopen(file.c_str(), "wb");
+  if (NULL == out)
+    return Result::FAIL;
+
+  bool error = fwrite(s_compressedSignature, sizeof(s_compressedSignature), 1, out) != 1;
+  std::vector<uint8_t> compressed;
+  size_t pos = 0;
+  while (!error && pos + 12 <= size)
+  {
+    uint32_t header[3];   // block, name and comment lengths
+    memcpy(header, &data[pos], sizeof(header));
+    uint32_t headerSize = 12 + header[1] + header[2];
+    if (header[0] < headerSize || pos + header[0] > size)
+      break;  // incomplete block
+
+    uint32_t dataSize = header[0] - headerSize;
+    uLongf compressedSize = compressBound(dataSize);
+    compressed.resize(compressedSize);
+    error = compress2(compressed.data(), &compressedSize, &data[pos + headerSize], dataSize, Z_BEST_SPEED) != Z_OK;
+    if (error)
+      break;
+
+    uint32_t blockLength = headerSize + sizeof(dataSize) + uint32_t(compressedSize);
+    error = error || fwrite(&blockLength, sizeof(blockLength), 1, out) != 1;
+    error = error || fwrite(&data[pos + 4], headerSize - 4, 1, out) != 1;
+    error = error || fwrite(&dataSize, sizeof(dataSize), 1, out) != 1;
+    error = error || (compressedSize > 0 && fwrite(compressed.data(), compressedSize, 1, out) != 1);
+    pos += header[0];
+  }
+  error = (fclose(out) != 0) || error;
+  return error ? Result::FAIL : Result::OKAY;
+}
+
+Result CBlockFile::InflateBlock(uint32_t length)
+{
+  uint32_t dataSize = 0;
+  if (length < sizeof(dataSize) || RawRead(&dataSize, sizeof(dataSize)) != sizeof(dataSize))
+    return Result::FAIL;
+  std::vector<uint8_t> compressed(length - sizeof(dataSize));
+  if (RawRead(compressed.data(), compressed.size()) != compressed.size())
+    return Result::FAIL;
+
+  blockData.resize(dataSize);
+  uLongf inflatedSize = dataSize;
+  if (uncompress(blockData.data(), &inflatedSize, compressed.data(), uLong(compressed.size())) != Z_OK || inflatedSize != dataSize)
+    return Result::FAIL;
+  blockPos = 0;
+  inflated = true;
   return Result::OKAY;
 }
   
@@ -261,20 +589,52 @@ void CBlockFile::Close(void)
 {
   if (fp != NULL)
     fclose(fp);
+  if (image != NULL)
+  {
+    // Drop whatever is left of the previous contents
+    image->data.resize(fileSize);
+    image->touchedPages.resize((fileSize + PageSize - 1) >> PageShift);
+    image->trackedOffsets.resize(trackedIndex);
+  }
+  if (mappedData != NULL)
+  {
+#ifdef _WIN32
+    UnmapViewOfFile(mappedData);
+#else
+    munmap(mappedData, mappedSize);
+#endif
+  }
   fp = NULL;
+  image = NULL;
+  memData = NULL;
+  mappedData = NULL;
+  mappedSize = 0;
+  inflated = false;
+  blockData.clear();
+  blockIndex.clear();
+  indexed = false;
   mode = 0;
 }
 
 CBlockFile::CBlockFile(void)
 {
   fp = NULL;
+  image = NULL;
+  memData = NULL;
+  memPos = 0;
+  fileSize = 0;
+  reuseSize = 0;
+  trackedIndex = 0;
+  firstBlockPos = 0;
+  inflated = false;
+  blockPos = 0;
+  indexed = false;
+  mappedData = NULL;
+  mappedSize = 0;
   mode = 0;   // neither reading nor writing (do nothing)
 }
 
 CBlockFile::~CBlockFile(void)
 {
-  if (fp != NULL) // in case user forgot
-    fclose(fp);
-  fp = NULL;
-  mode = 0;
+  Close();  // in case user forgot
 }
@@ -29,7 +29,9 @@
 #define INCLUDED_BLOCKFILE_H
 
 #include <cstdint>
+#include <cstdio>
 #include <string>
+#include <vector>
 #include "Types.h"
 
 /*
@@ -42,10 +44,91 @@
  * including the null terminator.
  *
  * Members do not generate any output messages.
+ *
+ * Block files may also be created in and loaded from memory (see
+ * CreateInMemory() and LoadFromMemory()), which is used to capture save
+ * states quickly, and written with the data of each block compressed (see
+ * WriteCompressed()). Load() reads both kinds of file.
  */
 class CBlockFile
 {
 public:
+  // Granularity of the page tracking used by memory images
+  static constexpr unsigned PageShift = 12;
+  static constexpr unsigned PageSize = 1 << PageShift;
+
+  /*
+   * MemoryImage:
+   *
+   * Contents of a block file created in memory. An image may be written over
+   * again: only bytes that differ from its previous contents are copied, and
+   * the pages of data that were modified are flagged in touchedPages.
+   * Clearing data discards the previous contents.
+   *
+   * The page flags passed to Write(data, numBytes, changedPages) are only
+   * used and cleared by images with trackPages set, of which there should be
+   * just one.
+   */
+  struct MemoryImage
+  {
+    bool                  trackPages = false;
+    std::vector<uint8_t>  data;
+    std::vector<uint8_t>  touchedPages;   // one byte per PageSize bytes of data, non-zero if modified by the last write
+    std::vector<uint32_t> trackedOffsets; // offset of each tracked write (see Write(data, numBytes, changedPages))
+  };
+
+  /*
+   * StateRegions:
+   *
+   * The plain memory regions (pointer and size) that make up a device's
+   * state, in the order they are stored in its block. A device declares them
+   * once and then saves and restores them with Write(regions) and
+   * Read(regions), which is the same as writing or reading each region in
+   * turn but copies regions that are adjacent in memory in one go and only
+   * updates the block header once. Regions must stay valid (and in place) as
+   * long as they are used.
+   */
+  class StateRegions
+  {
+  public:
+    struct Region
+    {
+      uint8_t   *data;
+      uint32_t  numBytes;
+    };
+
+    // Appends a region, merging it with the previous one if it directly follows it
+    StateRegions &Add(void *data, uint32_t numBytes)
+    {
+      if (!regions.empty() && regions.back().data + regions.back().numBytes == (uint8_t *) data)
+        regions.back().numBytes += numBytes;
+      else
+        regions.push_back({ (uint8_t *) data, numBytes });
+      totalBytes += numBytes;
+      return *this;
+    }
+
+    template <typename T>
+    StateRegions &Add(T *value)
+    {
+      return Add(value, sizeof(T));
+    }
+
+    const std::vector<Region> &Regions(void) const
+    {
+      return regions;
+    }
+
+    uint32_t TotalBytes(void) const
+    {
+      return totalBytes;
+    }
+
+  private:
+    std::vector<Region> regions;
+    uint32_t            totalBytes = 0;
+  };
+
   /*
    * Read(data, numBytes):
    *
@@ -73,12 +156,44 @@ public:
    *    Number of bytes read. If not 1, an error occurred.
    */
   unsigned Read(bool *value);
+
+  /*
+   * Read(regions):
+   *
+   * Reads each of the given state regions from the current file position.
+   *
+   * Parameters:
+   *    regions   State regions to read to.
+   *
+   * Returns:
+   *    Number of bytes read. If not the same as regions.TotalBytes(), an
+   *    error occurred.
+   */
+  unsigned Read(const StateRegions &regions);
+
+  /*
+   * ReadView(numBytes):
+   *
+   * Like Read(data, numBytes) but returns a pointer to the data instead of
+   * copying it, for files loaded into memory (mapped files, memory images,
+   * and decompressed blocks). The pointer remains valid until the next call
+   * to FindBlock() or Close().
+   *
+   * Parameters:
+   *    numBytes  Number of bytes to read.
+   *
+   * Returns:
+   *    Pointer to the data, or NULL if fewer bytes are left or the file is
+   *    not in memory (nothing is read in that case).
+   */
+  const void *ReadView(uint32_t numBytes);
   
   /*
    * FindBlock(name):
    *
-   * Scans the file for a block with the given name string. When it is found,
-   * the file pointer is set to the beginning of the data region.
+   * Looks up the block with the given name string. The first call scans the
+   * file and indexes all blocks. When it is found, the file pointer is set to
+   * the beginning of the data region.
    *
    * Parameters:
    *    name  Name of block to locate.
@@ -111,6 +226,33 @@ public:
    */
   void Write(const void *data, uint32_t numBytes);
 
+  /*
+   * Write(data, numBytes, changedPages):
+   *
+   * Like Write(data, numBytes) but for large regions whose writers flag each
+   * page (PageSize bytes) that they modify. When a memory image that tracks
+   * pages is written over again with the same layout, only the flagged pages
+   * are examined. Flags are then cleared, and are otherwise left as they are.
+   *
+   * Parameters:
+   *    data          Data to write.
+   *    numBytes      Number of bytes to write.
+   *    changedPages  One flag per page of data (non-zero if modified since
+   *                  the last write to the memory image that tracks pages).
+   */
+  void Write(const void *data, uint32_t numBytes, uint8_t *changedPages);
+
+  /*
+   * Write(regions):
+   *
+   * Outputs each of the given state regions at the current file pointer
+   * position. Updates the block header appropriately.
+   *
+   * Parameters:
+   *    regions   State regions to write.
+   */
+  void Write(const StateRegions &regions);
+
   /*
    * Write(str):
    *
@@ -152,10 +294,24 @@ public:
    */
   Result Create(const std::string &file, const std::string &headerName, const std::string &comment);
 
+  /*
+   * CreateInMemory(image, headerName, comment):
+   *
+   * Like Create() but writes to a memory image, which must remain valid until
+   * Close() is called. Any previous contents of the image are written over.
+   *
+   * Parameters:
+   *    image       Memory image to write to.
+   *    headerName  Block name for header. Must be unique and not NULL.
+   *    comment     Comment string that will be embedded into file header.
+   */
+  void CreateInMemory(MemoryImage *image, const std::string &headerName, const std::string &comment);
+
   /*
    * Load(file):
    *
-   * Open a block file file for reading.
+   * Open a block file file for reading. The file is mapped into memory
+   * where possible.
    *
    * Parameters:
    *    file  File path.
@@ -168,6 +324,36 @@ public:
    */
   Result Load(const std::string &file);
 
+  /*
+   * LoadFromMemory(data, size):
+   *
+   * Like Load() but reads a block file held in memory, which must remain
+   * valid until Close() is called.
+   *
+   * Parameters:
+   *    data  Block file contents (e.g., MemoryImage::data).
+   *    size  Size in bytes.
+   */
+  void LoadFromMemory(const uint8_t *data, size_t size);
+
+  /*
+   * WriteCompressed(file, data, size):
+   *
+   * Writes a block file held in memory to a file, compressing the data
+   * section of each block separately so that Load() and FindBlock() only
+   * have to decompress the blocks that are read. Does not use any CBlockFile
+   * object, so it may be called from any thread.
+   *
+   * Parameters:
+   *    file  File path.
+   *    data  Block file contents (e.g., MemoryImage::data).
+   *    size  Size in bytes.
+   *
+   * Returns:
+   *    OKAY if the file was written, otherwise FAIL.
+   */
+  static Result WriteCompressed(const std::string &file, const uint8_t *data, size_t size);
+
   /*
    * Close(void):
    *
@@ -186,6 +372,14 @@ public:
 
 private:
   // Helper functions
+  bool      IsOpen(void) const;
+  long int  Tell(void);
+  void      Seek(long int pos);
+  size_t    RawRead(void *data, size_t numBytes);
+  void      RawWrite(const void *data, size_t numBytes);
+  Result    InflateBlock(uint32_t length);
+  bool      MapFile(const std::string &file);
+  void      BuildIndex(void);
   void      ReadString(std::string *str, uint32_t length);
   unsigned  ReadBytes(void *data, uint32_t numBytes);
   unsigned  ReadDWord(uint32_t *data);
@@ -201,6 +395,33 @@ private:
   long int  fileSize;       // size of file in bytes
   long int  blockStartPos;  // points to beginning of current block (or file) header
   long int  dataStartPos;   // points to beginning of current block's data section 
+
+  // Memory state data (when fp is NULL)
+  MemoryImage   *image;       // image being written
+  const uint8_t *memData;     // data being read
+  long int      memPos;       // current position
+  size_t        reuseSize;    // size of the previous contents of image
+  size_t        trackedIndex; // number of tracked writes so far
+
+  // Compressed file state data
+  long int              firstBlockPos;  // 0, or past the signature of compressed files
+  bool                  inflated;       // reading the decompressed data of the current block
+  std::vector<uint8_t>  blockData;      // decompressed data of the current block
+  size_t                blockPos;       // current position in blockData
+
+  // Block index (built by the first FindBlock())
+  struct BlockEntry
+  {
+    std::string name;
+    long int    dataStart;  // position of the data section
+    uint32_t    length;     // length of the data section
+  };
+  std::vector<BlockEntry> blockIndex;
+  bool                    indexed;
+
+  // Mapped file (memData points to it)
+  void                    *mappedData;
+  size_t                  mappedSize;
 };
 
 
@@ -22,9 +22,13 @@
 /*
  * 68K.cpp
  *
- * 68K CPU interface. This is presently just a wrapper for the Musashi 68K core
- * and therefore, only a single CPU is supported. In the future, we may want to
- * add in another 68K core (eg., Turbo68K, A68K, or a recompiler).
+ * 68K CPU interface. This is presently just a wrapper for the Musashi 68K core.
+ * Each 68K owns an M68KCtx and Musashi executes on whichever one the calling
+ * thread has mapped, so 68Ks on different threads can run concurrently. Code
+ * is fetched directly from the pages of memory a board supplies in a fetch
+ * map, rather than through its bus handlers. In the
+ * future, we may want to add in another 68K core (eg., Turbo68K, A68K, or a
+ * recompiler).
  *
  * To-Do List
  * ----------
@@ -43,24 +47,27 @@
  Internal Context
 
  An active context must be mapped before calling M68K interface functions. Only
- the bus and IRQ handlers are copied here; the CPU context is passed directly
- to Musashi.
+ the bus and IRQ handlers are copied here; Musashi runs directly on the CPU
+ context inside the mapped M68KCtx, so switching between 68Ks doesn't copy the
+ register file. All of this state is per thread, so each thread must map its
+ own context.
 ******************************************************************************/
 
 // Bus
-static IBus	*s_Bus = NULL;
+static thread_local IBus	*s_Bus = NULL;
+static thread_local const UINT8 *const *s_FetchMap = NULL;
 
 #ifdef SUPERMODEL_DEBUGGER
 // Debugger
-static Debugger::CMusashi68KDebug *s_Debug = NULL;
+static thread_local Debugger::CMusashi68KDebug *s_Debug = NULL;
 #endif
 
 // IRQ callback
-static int	(*IRQAck)(int nIRQ) = NULL;
+static thread_local int	(*IRQAck)(int nIRQ) = NULL;
 
 #ifdef SUPERMODEL_DEBUGGER
 // Cycles remaining in timeslice
-static int s_lastCycles;
+static thread_local int s_lastCycles;
 #endif
 
 
@@ -239,6 +246,8 @@ int M68KRun(int numCycles)
 		s_Debug->CPUActive();
 		s_lastCycles += numCycles;
 	}
+	// Musashi only runs its instruction hook loop while a debugger is attached
+	m68k_set_instr_hook_callback(s_Debug != NULL ? M68KDebugCallback : NULL);
 #endif // SUPERMODEL_DEBUGGER
 	int doneCycles = m68k_execute(numCycles);
 #ifdef SUPERMODEL_DEBUGGER
@@ -251,6 +260,16 @@ int M68KRun(int numCycles)
 	return doneCycles;
 }
 
+int M68KGetCyclesRun(void)
+{
+	return m68k_cycles_run();
+}
+
+void M68KEndTimeslice(void)
+{
+	m68k_end_timeslice();
+}
+
 void M68KReset(void)
 {
 	m68k_pulse_reset();
@@ -273,12 +292,18 @@ void M68KAttachBus(IBus *BusPtr)
 	DebugLog("Attached bus to 68K\n");
 }
 
+void M68KAttachFetchMap(const UINT8 *const *map)
+{
+	s_FetchMap = map;
+}
+
 // Context switching
 
 void M68KGetContext(M68KCtx *Dest)
 {
 	Dest->IRQAck = IRQAck;
 	Dest->Bus = s_Bus;
+	Dest->FetchMap = s_FetchMap;
 #ifdef SUPERMODEL_DEBUGGER
 	Dest->Debug = s_Debug;
 #endif // SUPERMODEL_DEBUGGER
@@ -289,10 +314,11 @@ void M68KSetContext(M68KCtx *Src)
 {
 	IRQAck = Src->IRQAck;
 	s_Bus = Src->Bus;
+	s_FetchMap = Src->FetchMap;
 #ifdef SUPERMODEL_DEBUGGER
 	s_Debug = Src->Debug;
 #endif // SUPERMODEL_DEBUGGER
-	m68k_set_context(&(Src->musashiCtx));
+	m68k_map_context(&(Src->musashiCtx));
 }
 
 // One-time initialization
@@ -303,9 +329,9 @@ Result M68KInit(void)
 	m68k_set_cpu_type(M68K_CPU_TYPE_68000);
 	m68k_set_int_ack_callback(M68KIRQCallback);
 	s_Bus = NULL;
+	s_FetchMap = NULL;
 #ifdef SUPERMODEL_DEBUGGER
 	s_Debug = NULL;
-	m68k_set_instr_hook_callback(M68KDebugCallback);
 #endif // SUPERMODEL_DEBUGGER
 	DebugLog("Initialized 68K\n");
 	return Result::OKAY;
@@ -406,18 +432,37 @@ int M68KIRQCallback(int nIRQ)
 		return IRQAck(nIRQ);
 }
 
+// Fetches come from the fetch map when it covers the address (see M68KAttachFetchMap())
+static inline const UINT8 *M68KFetchPage(unsigned int a)
+{
+	return s_FetchMap != NULL ? s_FetchMap[(a>>16)&0xFF] : NULL;
+}
+
 unsigned int FASTCALL M68KFetch8(unsigned int a)
 {
+	const UINT8 *page = M68KFetchPage(a);
+	if (page != NULL)
+		return page[(a&0xFFFF)^1];
 	return s_Bus->Read8(a);
 }
 
 unsigned int FASTCALL M68KFetch16(unsigned int a)
 {
+	const UINT8 *page = M68KFetchPage(a);
+	if (page != NULL)
+		return *(const UINT16 *) &page[a&0xFFFF];
 	return s_Bus->Read16(a);
 }
 
 unsigned int FASTCALL M68KFetch32(unsigned int a)
 {
+	const UINT8 *page = M68KFetchPage(a);
+	if (page != NULL && (a&0xFFFF) <= 0xFFFC)
+	{
+		UINT32 hi = *(const UINT16 *) &page[a&0xFFFF];
+		UINT32 lo = *(const UINT16 *) &page[(a+2)&0xFFFF];
+		return (hi<<16)|lo;
+	}
 	return s_Bus->Read32(a);
 }
 
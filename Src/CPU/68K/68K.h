@@ -22,7 +22,9 @@
 /*
  * 68K.h
  * 
- * Header file for 68K CPU interface. Caution: 68K emulator is not thread-safe.
+ * Header file for 68K CPU interface. The active context is per thread: 68Ks
+ * with their own contexts may run concurrently on different threads, but a
+ * single context must only be mapped on one thread at a time.
  *
  * TO-DO List:
  * -----------
@@ -76,6 +78,7 @@ typedef struct SM68KCtx
 public:
 	m68ki_cpu_core	musashiCtx;		// CPU context
 	IBus			*Bus;			// memory handlers
+	const UINT8		*const *FetchMap;	// 64 KB pages that code is fetched from directly (optional)
 	int				(*IRQAck)(int);	// IRQ acknowledge callback
 #ifdef SUPERMODEL_DEBUGGER
 	Debugger::CMusashi68KDebug *Debug;        // holds debugger (if attached)
@@ -84,6 +87,7 @@ public:
 	SM68KCtx(void)
 	{
 		Bus = NULL;
+		FetchMap = NULL;
 		IRQAck = NULL;
 		memset(&musashiCtx, 0, sizeof(musashiCtx));	// very important! garbage in context at reset can cause very strange bugs
 #ifdef SUPERMODEL_DEBUGGER
@@ -199,6 +203,23 @@ extern void M68KSetIRQ(int irqLevel);
  */
 extern int M68KRun(int numCycles);
 
+/*
+ * M68KGetCyclesRun():
+ *
+ * Returns:
+ *		Number of cycles executed so far by the current M68KRun() call, not
+ *		including the instruction in progress.
+ */
+extern int M68KGetCyclesRun(void);
+
+/*
+ * M68KEndTimeslice():
+ *
+ * Ends the current M68KRun() call once the instruction in progress has
+ * completed. M68KRun() then returns the cycles actually executed.
+ */
+extern void M68KEndTimeslice(void);
+
 /*
  * M68KReset():
  *
@@ -230,6 +251,23 @@ extern void M68KSetIRQCallback(int (*F)(int));
  */
 extern void M68KAttachBus(IBus *BusPtr);
 
+/*
+ * M68KAttachFetchMap(map):
+ *
+ * Lets the 68K fetch opcodes and immediate operands straight from memory
+ * rather than through the bus handlers, which otherwise cost a virtual call
+ * per instruction word. The map describes the 24-bit address space as 256
+ * pages of 64 KB, each either null (fetched through the bus) or pointing to
+ * memory holding 16-bit words in host order, as the bus handlers keep it. The
+ * map is read on every fetch, so entries may be switched (e.g., by ROM
+ * banking) without attaching it again. Pages must not hold anything with side
+ * effects on read. Data accesses always go through the bus.
+ *
+ * Parameters:
+ *		map		Array of 256 page pointers, or NULL to fetch through the bus.
+ */
+extern void M68KAttachFetchMap(const UINT8 *const *map);
+
 /*
  * M68KInit():
  *
@@ -245,7 +283,9 @@ extern Result M68KInit(void);
 /*
  * M68KGetContext(M68KCtx *Dest):
  *
- * Copies the internal (active) 68K context back to the destination.
+ * Copies the internal (active) 68K context back to the destination. The CPU
+ * state is only copied if Dest is not the context currently mapped, since the
+ * mapped context is updated in place.
  *
  * Parameters:
  *		Dest	Location to which to copy 68K context.
@@ -255,7 +295,9 @@ extern void M68KGetContext(M68KCtx *Dest);
 /*
  * M68KSetContext(M68KCtx *Src):
  *
- * Sets the specified 68K context by copying it to the internal context.
+ * Maps the specified 68K context as the active one for the calling thread.
+ * The CPU state is not copied: the 68K runs directly on Src, which must
+ * remain valid while it is mapped.
  *
  * Parameters:
  *		Src		Location from which to copy 68K context.
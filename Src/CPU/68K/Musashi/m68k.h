@@ -354,6 +354,11 @@ unsigned int m68k_get_context(void* dst);
 /* set the current cpu context */
 void m68k_set_context(void* dst);
 
+/* Run the CPU directly on the given context (NULL unmaps it) instead of
+ * copying it in and out. It must stay valid while mapped.
+ */
+void m68k_map_context(void* ctx);
+
 /* Register the CPU state information */
 void m68k_state_register(const char *type);
 
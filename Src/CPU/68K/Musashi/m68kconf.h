@@ -203,6 +203,18 @@
 #define INLINE static __inline__	// defined for GCC; if using MSVC, pass INLINE as "static __inline" from Makefile
 #endif /* INLINE */
 
+/* CPU state is per thread so that boards with their own 68K (sound board, net
+ * board) can run on separate threads. Each thread maps its context with
+ * m68k_map_context() before running.
+ */
+#ifndef M68K_THREAD_LOCAL
+#ifdef _MSC_VER
+#define M68K_THREAD_LOCAL __declspec(thread)
+#else
+#define M68K_THREAD_LOCAL __thread
+#endif
+#endif /* M68K_THREAD_LOCAL */
+
 /******************************************************************************
  Supermodel Interface
 ******************************************************************************/
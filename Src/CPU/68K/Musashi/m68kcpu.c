@@ -73,10 +73,10 @@ static const char* copyright_notice =
 /* ================================= DATA ================================= */
 /* ======================================================================== */
 
-int  m68ki_initial_cycles;
-int  m68ki_remaining_cycles = 0;                     /* Number of clocks remaining */
-uint m68ki_tracing = 0;
-uint m68ki_address_space;
+M68K_THREAD_LOCAL int  m68ki_initial_cycles;
+M68K_THREAD_LOCAL int  m68ki_remaining_cycles = 0;   /* Number of clocks remaining */
+M68K_THREAD_LOCAL uint m68ki_tracing = 0;
+M68K_THREAD_LOCAL uint m68ki_address_space;
 
 #ifdef M68K_LOG_ENABLE
 const char* m68ki_cpu_names[] =
@@ -101,16 +101,25 @@ const char* m68ki_cpu_names[] =
 };
 #endif /* M68K_LOG_ENABLE */
 
-/* The CPU core */
-m68ki_cpu_core m68ki_cpu = {0};
+/* The CPU core: points at the context mapped by m68k_map_context(), or at a
+ * per-thread scratch context until one is mapped
+ */
+static M68K_THREAD_LOCAL m68ki_cpu_core m68ki_cpu_scratch;
+M68K_THREAD_LOCAL m68ki_cpu_core* m68ki_cpu_active = NULL;
+
+INLINE void m68ki_ensure_context(void)
+{
+	if(m68ki_cpu_active == NULL)
+		m68ki_cpu_active = &m68ki_cpu_scratch;
+}
 
 #if M68K_EMULATE_ADDRESS_ERROR
-jmp_buf m68ki_aerr_trap;
+M68K_THREAD_LOCAL jmp_buf m68ki_aerr_trap;
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
-uint    m68ki_aerr_address;
-uint    m68ki_aerr_write_mode;
-uint    m68ki_aerr_fc;
+M68K_THREAD_LOCAL uint    m68ki_aerr_address;
+M68K_THREAD_LOCAL uint    m68ki_aerr_write_mode;
+M68K_THREAD_LOCAL uint    m68ki_aerr_fc;
 
 /* Used by shift & rotate instructions */
 const uint8 m68ki_shift_8_table[65] =
@@ -458,7 +467,7 @@ static void default_instr_hook_callback(void)
 
 #if M68K_EMULATE_ADDRESS_ERROR
 	#include <setjmp.h>
-	jmp_buf m68ki_aerr_trap;
+	M68K_THREAD_LOCAL jmp_buf m68ki_aerr_trap;
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
 
@@ -709,6 +718,31 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 	}
 }
 
+/* The main loop, expanded with and without the instruction hook */
+#define m68ki_execute_loop(HOOK)                                              \
+	do                                                                        \
+	{                                                                         \
+		/* Set tracing accodring to T1. (T0 is done inside instruction) */   \
+		m68ki_trace_t1(); /* auto-disable (see m68kcpu.h) */                  \
+                                                                              \
+		/* Set the address space for reads */                                \
+		m68ki_use_data_space(); /* auto-disable (see m68kcpu.h) */            \
+                                                                              \
+		/* Call external hook to peek at CPU */                              \
+		HOOK;                                                                 \
+                                                                              \
+		/* Record previous program counter */                                \
+		REG_PPC = REG_PC;                                                     \
+                                                                              \
+		/* Read an instruction and call its handler */                       \
+		REG_IR = m68ki_read_imm_16();                                         \
+		m68ki_instruction_jump_table[REG_IR]();                               \
+		USE_CYCLES(CYC_INSTRUCTION[REG_IR]);                                  \
+                                                                              \
+		/* Trace m68k_exception, if necessary */                             \
+		m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */        \
+	} while(GET_CYCLES() > 0)
+
 /* Execute some instructions until we use up num_cycles clock cycles */
 /* ASG: removed per-instruction interrupt checks */
 int m68k_execute(int num_cycles)
@@ -728,28 +762,15 @@ int m68k_execute(int num_cycles)
 		m68ki_set_address_error_trap(); /* auto-disable (see m68kcpu.h) */
 
 		/* Main loop.  Keep going until we run out of clock cycles */
-		do
-		{
-			/* Set tracing accodring to T1. (T0 is done inside instruction) */
-			m68ki_trace_t1(); /* auto-disable (see m68kcpu.h) */
-
-			/* Set the address space for reads */
-			m68ki_use_data_space(); /* auto-disable (see m68kcpu.h) */
-
-			/* Call external hook to peek at CPU */
-			m68ki_instr_hook(); /* auto-disable (see m68kcpu.h) */
-
-			/* Record previous program counter */
-			REG_PPC = REG_PC;
-
-			/* Read an instruction and call its handler */
-			REG_IR = m68ki_read_imm_16();
-			m68ki_instruction_jump_table[REG_IR]();
-			USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
-
-			/* Trace m68k_exception, if necessary */
-			m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
-		} while(GET_CYCLES() > 0);
+#if M68K_INSTRUCTION_HOOK == OPT_ON
+		/* Only take the per-instruction hook when one is installed */
+		if(CALLBACK_INSTR_HOOK != default_instr_hook_callback)
+			m68ki_execute_loop(m68ki_instr_hook());
+		else
+			m68ki_execute_loop((void)0);
+#else
+		m68ki_execute_loop(m68ki_instr_hook()); /* auto-disable (see m68kcpu.h) */
+#endif /* M68K_INSTRUCTION_HOOK */
 
 		/* set previous PC to current PC for the next entry into the loop */
 		REG_PPC = REG_PC;
@@ -883,13 +904,20 @@ unsigned int m68k_context_size()
 
 unsigned int m68k_get_context(void* dst)
 {
-	if(dst) *(m68ki_cpu_core*)dst = m68ki_cpu;
+	m68ki_ensure_context();
+	if(dst && dst != m68ki_cpu_active) *(m68ki_cpu_core*)dst = m68ki_cpu;
 	return sizeof(m68ki_cpu_core);
 }
 
 void m68k_set_context(void* src)
 {
-	if(src) m68ki_cpu = *(m68ki_cpu_core*)src;
+	m68ki_ensure_context();
+	if(src && src != m68ki_cpu_active) m68ki_cpu = *(m68ki_cpu_core*)src;
+}
+
+void m68k_map_context(void* ctx)
+{
+	m68ki_cpu_active = ctx != NULL ? (m68ki_cpu_core*)ctx : &m68ki_cpu_scratch;
 }
 
 
@@ -79,6 +79,27 @@ public:
 	virtual void	Write16(UINT32 addr, UINT16 data)	{}
 	virtual void	Write32(UINT32 addr, UINT32 data)	{}
 	virtual void	Write64(UINT32 addr, UINT64 data)	{}
+
+	/*
+	 * MoveBlock32(dest, src, numWords, reverseBytes):
+	 *
+	 * Optional block transfer for DMA devices. Equivalent to reading each
+	 * 32-bit word from src with Read32() and writing it to dest with
+	 * Write32(), byte reversed first if reverseBytes is set. Buses that can
+	 * resolve both ranges to memory may do this in bulk. Nothing is
+	 * transferred unless the whole block can be.
+	 *
+	 * Parameters:
+	 *		dest			Destination address (word aligned).
+	 *		src				Source address (word aligned).
+	 *		numWords		Number of 32-bit words to move.
+	 *		reverseBytes	Whether to byte reverse each word.
+	 *
+	 * Returns:
+	 *		True if the block was moved, false if the caller must move it
+	 *		word by word.
+	 */
+	virtual bool	MoveBlock32(UINT32 dest, UINT32 src, unsigned numWords, bool reverseBytes)	{ return false; }
 	
 	/*
 	 * IORead8(addr):
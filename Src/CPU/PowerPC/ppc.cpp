@@ -31,8 +31,19 @@
 #include "ppc.h"
 
 #include <cstring>	// memset()
+#include <cstddef>	// offsetof()
+#include <new>		// std::nothrow
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>	// VirtualAlloc()
+#else
+#include <sys/mman.h>	// mmap()
+#endif
 #include "Supermodel.h"
 #include "CPU/Bus.h"
+#include "PPCDisasm.h"
 
 // Typedefs that Supermodel no longer provides
 typedef unsigned int	UINT;
@@ -40,14 +51,63 @@ typedef unsigned int	UINT;
 // Model 3 context provides read/write handlers
 static class IBus	*Bus = NULL;	// pointer to Model 3 bus object (for access handlers)
 
+// Optional directly accessible RAM (see ppc_set_ram())
+static UINT8	*ramBase = NULL;
+static UINT32	ramSize = 0;		// size set by ppc_set_ram()
+static UINT8	*ramStatePages = NULL;	// pages written since the last in-memory save state
+
+// Optional directly writable memory outside of RAM (see ppc_set_write_window())
+static PPC_WRITE_WINDOW	writeWindows[256];	// indexed by address bits 31-24
+
 #ifdef SUPERMODEL_DEBUGGER
 // Pointer to current PPC debugger (if any)
 static class Debugger::CPPCDebug *PPCDebug = NULL;
+
+// Pages with a mapped I/O or memory watch, which must bypass the direct paths
+static const UINT8	noWatchPages[WATCH_PAGES] = { 0 };
+static const UINT8	*watchPages = noWatchPages;
+#define WATCHED(address)	(watchPages[(address) >> WATCH_PAGE_SHIFT] != 0)
+#else
+#define WATCHED(address)	false
 #endif
 
+// Optional ring of recently executed instructions (see ppc_set_trace())
+#define PPC_TRACE_SIZE	65536	// entries, must be a power of 2
+
+typedef struct {
+	UINT32	pc;
+	UINT32	opcode;
+	UINT32	ea;		// effective address of loads and stores
+} PPC_TRACE_ENTRY;
+
+static PPC_TRACE_ENTRY	*traceRing = NULL;
+static UINT32	traceCount = 0;		// total instructions recorded
+
 void ppc603_exception(int exception);
 static void ppc603_check_interrupts(void);
 
+typedef void (*PPC_HANDLER)(UINT32);
+
+// Dynamic recompiler (ppc_jit.c)
+static bool ppc_jit_active(void);
+static void ppc_jit_execute(void);
+static void ppc_jit_reset(void);
+static void ppc_jit_shutdown(void);
+static void ppc_jit_invalidate_page(unsigned page);
+
+// Code page flags (ppc_code_pages[])
+#define PPC_CODE_PAGE_JIT		0x01	// page contains translated blocks
+#define PPC_CODE_PAGE_DECODED	0x02	// page contains pre-decoded instructions
+#define PPC_CODE_PAGE_IDLE		0x04	// page contains analyzed idle loop candidates
+
+// Pre-decoded instruction cache: one handler per word of each fetch region
+#define PPC_MAX_FETCH_REGIONS	8
+static PPC_HANDLER	*decode_tables[PPC_MAX_FETCH_REGIONS];
+
+// Fetch region lookup: region index + 1 for each 8 MB of address space (0 if none)
+#define PPC_FETCH_MAP_SHIFT	23
+static UINT8	fetch_map[1 << (32 - PPC_FETCH_MAP_SHIFT)];
+
 #define RD				((op >> 21) & 0x1F)
 #define RT				((op >> 21) & 0x1f)
 #define RS				((op >> 21) & 0x1f)
@@ -77,7 +137,7 @@ static void ppc603_check_interrupts(void);
 #define LR				(ppc.lr)
 #define CTR				(ppc.ctr)
 #define XER				(ppc.xer)
-#define CR(x)			(ppc.cr[x])
+#define CR(x)			(*ppc_cr_field(x))	// brings CR0 up to date first (see SET_CR0())
 #define MSR				(ppc.msr)
 #define SRR0			(ppc.srr0)
 #define SRR1			(ppc.srr1)
@@ -118,7 +178,7 @@ static UINT32		ppc_field_xlat[256];
 
 
 #define BITMASK_0(n)	(UINT32)(((UINT64)1 << (n)) - 1)
-#define CRBIT(x)		((ppc.cr[(x) / 4] & (1 << (3 - ((x) % 4)))) ? 1 : 0)
+#define CRBIT(x)		((CR((x) / 4) & (1 << (3 - ((x) % 4)))) ? 1 : 0)
 #define _BIT(n)			(1 << (n))
 #define GET_ROTATE_MASK(mb,me)		(ppc_rotate_mask[mb][me])
 #define ADD_CA(r,a,b)		((UINT32)(r) < (UINT32)(a))
@@ -175,6 +235,7 @@ typedef struct {
 
 typedef struct {
 	bool	fatalError;	// if true, halt PowerPC until hard reset
+	UINT8	jit_exit;	// set when translated code must return to the dispatcher (see ppc_jit.c)
 	
 	UINT32 r[32];
 	UINT32 pc;
@@ -244,10 +305,22 @@ typedef struct {
 
 	PPC_FETCH_REGION	cur_fetch;
 	PPC_FETCH_REGION	* fetch;
+	PPC_HANDLER			* cur_decode;	// pre-decoded handlers for cur_fetch (NULL if unavailable)
+
+	// Idle loop skipping
+	bool idle_skip;
+	UINT64 next_event;	// total cycle count at which a device next changes state visibly
 
 	// STUFF added for the 6xx series
 	UINT32 dec;
 	UINT32 fpscr;
+	bool fast_fpu;		// FPSCR status bits are only maintained once the game reads FPSCR
+	bool fpscr_status;	// FPSCR exception and result bits are being maintained
+
+	// CR0 of record-form instructions, only worked out when CR is accessed
+	bool cr0_pending;	// cr[0] is to be set from cr0_result and cr0_so
+	INT32 cr0_result;
+	UINT8 cr0_so;
 
 	FPR	fpr[32];
 	UINT32 sr[16];
@@ -258,6 +331,8 @@ typedef struct {
 	int tb_base_icount;
 	int dec_base_icount;
 	int dec_trigger_cycle;
+	int stop_icount;	// icount at which the run loop returns to ppc_execute() for the next event
+	bool end_slice;		// set by ppc_end_slice() to return from ppc_execute() early
 	
 	// Cycle related
 	UINT64 total_cycles;
@@ -287,6 +362,22 @@ typedef struct {
 static PPC_REGS ppc;
 static UINT32 ppc_rotate_mask[32][32];
 
+static inline void ppc_flush_cr0(void)
+{
+	if (ppc.cr0_pending)
+	{
+		INT32 rd = ppc.cr0_result;
+		ppc.cr[0] = (rd < 0 ? 0x8 : (rd > 0 ? 0x4 : 0x2)) | ppc.cr0_so;
+		ppc.cr0_pending = false;
+	}
+}
+
+static inline UINT8 *ppc_cr_field(unsigned x)
+{
+	ppc_flush_cr0();
+	return &ppc.cr[x];
+}
+
 static void ppc_change_pc(UINT32 newpc)
 {
 	if (ppc.cur_fetch.start <= newpc && newpc <= ppc.cur_fetch.end)
@@ -296,6 +387,19 @@ static void ppc_change_pc(UINT32 newpc)
 		return;
 	}
 
+	// Regions are normally 8 MB aligned and resolve in a single lookup
+	unsigned m = fetch_map[newpc >> PPC_FETCH_MAP_SHIFT];
+	if (m != 0 && ppc.fetch[m - 1].start <= newpc && newpc <= ppc.fetch[m - 1].end)
+	{
+		unsigned i = m - 1;
+		ppc.cur_fetch.start = ppc.fetch[i].start;
+		ppc.cur_fetch.end = ppc.fetch[i].end;
+		ppc.cur_fetch.ptr = ppc.fetch[i].ptr;
+		ppc.cur_decode = decode_tables[i];
+		ppc.op = &ppc.cur_fetch.ptr[(newpc-ppc.cur_fetch.start)/4];
+		return;
+	}
+
 	for(UINT i = 0; ppc.fetch[i].ptr != NULL; i++)
 	{
 		if (ppc.fetch[i].start <= newpc && newpc <= ppc.fetch[i].end)
@@ -303,6 +407,7 @@ static void ppc_change_pc(UINT32 newpc)
 			ppc.cur_fetch.start = ppc.fetch[i].start;
 			ppc.cur_fetch.end = ppc.fetch[i].end;
 			ppc.cur_fetch.ptr = ppc.fetch[i].ptr;
+			ppc.cur_decode = (i < PPC_MAX_FETCH_REGIONS) ? decode_tables[i] : NULL;
 
 //			ppc.op = (UINT32 *)((UINT32)ppc.cur_fetch.ptr + (UINT32)(newpc - ppc.cur_fetch.start));
 			ppc.op = &ppc.cur_fetch.ptr[(newpc-ppc.cur_fetch.start)/4];			
@@ -315,43 +420,102 @@ static void ppc_change_pc(UINT32 newpc)
 	ppc.fatalError = true;
 }
 
+/*
+ * Memory access handlers. Aligned accesses to RAM registered with
+ * ppc_set_ram() are performed directly; everything else goes to the bus.
+ * While the debugger is attached, pages it is watching go to the bus too.
+ * RAM is stored the same way as the fetch regions (each aligned word byte
+ * reversed). Direct writes flag the page in ramStatePages.
+ */
+
 static inline UINT8 READ8(UINT32 address)
 {
+	if (address < ramSize && !WATCHED(address))
+		return ramBase[address^3];
 	return Bus->Read8(address);
 }
 
 static inline UINT16 READ16(UINT32 address)
 {
+	if (address < ramSize && !(address&1) && !WATCHED(address))
+		return *(UINT16 *) &ramBase[address^2];
 	return Bus->Read16(address);
 }
 
 static inline UINT32 READ32(UINT32 address)
 {
+	if (address < ramSize && !(address&3) && !WATCHED(address))
+		return *(UINT32 *) &ramBase[address];
 	return Bus->Read32(address);
 }
 
 static inline UINT64 READ64(UINT32 address)
 {
+	if (address < ramSize && (address+4) < ramSize && !(address&3) && !WATCHED(address))
+		return ((UINT64) *(UINT32 *) &ramBase[address] << 32) | *(UINT32 *) &ramBase[address+4];
 	return Bus->Read64(address);
 }
 
 static inline void WRITE8(UINT32 address, UINT8 data)
 {
+	if (address < ramSize && !WATCHED(address))
+	{
+		ramBase[address^3] = data;
+		ramStatePages[address >> CBlockFile::PageShift] = 1;
+		ppc_invalidate_code(address);
+		return;
+	}
 	Bus->Write8(address,data);
 }
 
 static inline void WRITE16(UINT32 address, UINT16 data)
 {
+	if (address < ramSize && !(address&1) && !WATCHED(address))
+	{
+		*(UINT16 *) &ramBase[address^2] = data;
+		ramStatePages[address >> CBlockFile::PageShift] = 1;
+		ppc_invalidate_code(address);
+		return;
+	}
 	Bus->Write16(address,data);
 }
 
 static inline void WRITE32(UINT32 address, UINT32 data)
 {
+	if (address < ramSize && !(address&3) && !WATCHED(address))
+	{
+		*(UINT32 *) &ramBase[address] = data;
+		ramStatePages[address >> CBlockFile::PageShift] = 1;
+		ppc_invalidate_code(address);
+		return;
+	}
+	const PPC_WRITE_WINDOW &window = writeWindows[address >> 24];
+	if (window.ptr != NULL && !(address&3) && !WATCHED(address))
+	{
+		UINT32 offset = address & window.mask;
+		window.ptr[offset/4] = BYTE_REVERSE32(data);
+		if (window.dirtyPages != NULL)
+			window.dirtyPages[offset >> 15] |= 1 << ((offset >> 12) & 7);
+		if (window.dirtyLines != NULL)
+			window.dirtyLines[offset >> 12] |= uint64_t(1) << ((offset >> 6) & 63);
+		window.statePages[offset >> CBlockFile::PageShift] = 1;
+		return;
+	}
 	Bus->Write32(address,data);
 }
 
 static inline void WRITE64(UINT32 address, UINT64 data)
 {
+	if (address < ramSize && (address+4) < ramSize && !(address&3) && !WATCHED(address))
+	{
+		*(UINT32 *) &ramBase[address] = (UINT32) (data >> 32);
+		*(UINT32 *) &ramBase[address+4] = (UINT32) data;
+		ramStatePages[address >> CBlockFile::PageShift] = 1;
+		ramStatePages[(address+4) >> CBlockFile::PageShift] = 1;
+		ppc_invalidate_code(address);
+		ppc_invalidate_code(address+4);
+		return;
+	}
 	Bus->Write64(address,data);
 }
 
@@ -359,55 +523,47 @@ static inline void WRITE64(UINT32 address, UINT64 data)
 /*********************************************************************/
 
 
+/*
+ * Record-form instructions are mostly followed by others that set CR0 again
+ * before anything reads it, so only the result and XER[SO] are kept, and CR0
+ * is worked out from them by the first access to CR (see CR() and
+ * ppc_flush_cr0()).
+ */
 static inline void SET_CR0(INT32 rd)
 {
-	if( rd < 0 ) {
-		CR(0) = 0x8;
-	} else if( rd > 0 ) {
-		CR(0) = 0x4;
-	} else {
-		CR(0) = 0x2;
-	}
-
-	if( XER & XER_SO )
-		CR(0) |= 0x1;
+	ppc.cr0_result = rd;
+	ppc.cr0_so = UINT8(XER >> 31);
+	ppc.cr0_pending = true;
 }
 
 static inline void SET_CR1(void)
 {
+	ppc.fpscr_status = true;
 	CR(1) = (ppc.fpscr >> 28) & 0xf;
 }
 
+// XER is updated without branching, since carries and overflows are
+// unpredictable
 static inline void SET_ADD_OV(UINT32 rd, UINT32 ra, UINT32 rb)
 {
-	if( ADD_OV(rd, ra, rb) )
-		XER |= XER_SO | XER_OV;
-	else
-		XER &= ~XER_OV;
+	UINT32 ov = ADD_OV(rd, ra, rb) >> 31;
+	XER = (XER & ~XER_OV) | ((XER_SO | XER_OV) * ov);
 }
 
 static inline void SET_SUB_OV(UINT32 rd, UINT32 ra, UINT32 rb)
 {
-	if( SUB_OV(rd, ra, rb) )
-		XER |= XER_SO | XER_OV;
-	else
-		XER &= ~XER_OV;
+	UINT32 ov = SUB_OV(rd, ra, rb) >> 31;
+	XER = (XER & ~XER_OV) | ((XER_SO | XER_OV) * ov);
 }
 
 static inline void SET_ADD_CA(UINT32 rd, UINT32 ra, UINT32 rb)
 {
-	if( ADD_CA(rd, ra, rb) )
-		XER |= XER_CA;
-	else
-		XER &= ~XER_CA;
+	XER = (XER & ~XER_CA) | (XER_CA * UINT32(ADD_CA(rd, ra, rb)));
 }
 
 static inline void SET_SUB_CA(UINT32 rd, UINT32 ra, UINT32 rb)
 {
-	if( SUB_CA(rd, ra, rb) )
-		XER |= XER_CA;
-	else
-		XER &= ~XER_CA;
+	XER = (XER & ~XER_CA) | (XER_CA * UINT32(SUB_CA(rd, ra, rb)));
 }
 
 static inline UINT32 check_condition_code(UINT32 bo, UINT32 bi)
@@ -460,6 +616,21 @@ static inline UINT32 read_decrementer(void)
 	return DEC - (cycles / ppc.timer_ratio);
 }
 
+/*
+ * The run loops only test icount against stop_icount, which is the next
+ * decrementer trigger within the current ppc_execute() call (or 0). Must be
+ * updated whenever the trigger moves.
+ */
+static inline void ppc_update_stop(void)
+{
+	if (ppc.end_slice)
+		return;
+	if (ppc.dec_trigger_cycle > 0 && ppc.dec_trigger_cycle < ppc.icount)
+		ppc.stop_icount = ppc.dec_trigger_cycle;
+	else
+		ppc.stop_icount = 0;
+}
+
 static inline void write_decrementer(UINT32 value)
 {
 	if (((value&0x80000000) && !(read_decrementer()&0x80000000)))
@@ -479,6 +650,7 @@ static inline void write_decrementer(UINT32 value)
 		ppc.dec_trigger_cycle = ppc.dec_base_icount - ((1 + DEC) * ppc.timer_ratio);
 	else
 		ppc.dec_trigger_cycle = 0x7fffffff;
+	ppc_update_stop();
 }
 
 /*********************************************************************/
@@ -663,6 +835,262 @@ static void (* optable59[1024])(UINT32);
 static void (* optable63[1024])(UINT32);
 static void (* optable[64])(UINT32);
 
+static inline PPC_HANDLER ppc_get_handler(UINT32 op)
+{
+	switch (op >> 26)
+	{
+		case 19:	return optable19[(op >> 1) & 0x3ff];
+		case 31:	return optable31[(op >> 1) & 0x3ff];
+		case 59:	return optable59[(op >> 1) & 0x3ff];
+		case 63:	return optable63[(op >> 1) & 0x3ff];
+		default:	return optable[op >> 26];
+	}
+}
+
+/*
+ * Pre-decoded instruction cache. Each word of the fetch regions has a slot
+ * holding its handler, filled in the first time the instruction executes, so
+ * the interpreter skips the two-level opcode table lookup thereafter. Pages in
+ * the low 16 MB with decoded slots are flagged in ppc_code_pages[] and cleared
+ * by ppc_invalidate_code() when written.
+ */
+
+static PPC_HANDLER ppc_decode(UINT32 *op)
+{
+	PPC_HANDLER handler = ppc_get_handler(*op);
+	ppc.cur_decode[op - ppc.cur_fetch.ptr] = handler;
+
+	unsigned page = ppc.pc >> PPC_CODE_PAGE_SHIFT;
+	if (page < PPC_NUM_CODE_PAGES)
+		ppc_code_pages[page] |= PPC_CODE_PAGE_DECODED;
+
+	return handler;
+}
+
+static inline PPC_HANDLER ppc_get_decoded_handler(UINT32 *op)
+{
+	if (ppc.cur_decode == NULL)
+		return ppc_get_handler(*op);
+	PPC_HANDLER handler = ppc.cur_decode[op - ppc.cur_fetch.ptr];
+	return (handler != NULL) ? handler : ppc_decode(op);
+}
+
+static void ppc_decode_invalidate_page(unsigned page)
+{
+	UINT32 page_start = page << PPC_CODE_PAGE_SHIFT;
+	UINT32 page_end = page_start + (1 << PPC_CODE_PAGE_SHIFT) - 1;
+
+	for (unsigned i = 0; i < PPC_MAX_FETCH_REGIONS && ppc.fetch[i].ptr != NULL; i++)
+	{
+		if (decode_tables[i] == NULL || page_end < ppc.fetch[i].start || page_start > ppc.fetch[i].end)
+			continue;
+		UINT32 start = (page_start > ppc.fetch[i].start) ? page_start : ppc.fetch[i].start;
+		UINT32 end = (page_end < ppc.fetch[i].end) ? page_end : ppc.fetch[i].end;
+		memset(&decode_tables[i][(start - ppc.fetch[i].start) / 4], 0, ((end - start) / 4 + 1) * sizeof(PPC_HANDLER));
+	}
+}
+
+static void ppc_decode_flush(void)
+{
+	if (ppc.fetch == NULL)
+		return;
+	for (unsigned i = 0; i < PPC_MAX_FETCH_REGIONS && ppc.fetch[i].ptr != NULL; i++)
+	{
+		if (decode_tables[i] != NULL)
+			memset(decode_tables[i], 0, ((ppc.fetch[i].end - ppc.fetch[i].start) / 4 + 1) * sizeof(PPC_HANDLER));
+	}
+	for (unsigned page = 0; page < PPC_NUM_CODE_PAGES; page++)
+		ppc_code_pages[page] &= ~PPC_CODE_PAGE_DECODED;
+}
+
+static void ppc_decode_free(void)
+{
+	for (unsigned i = 0; i < PPC_MAX_FETCH_REGIONS; i++)
+	{
+		delete [] decode_tables[i];
+		decode_tables[i] = NULL;
+	}
+	ppc.cur_decode = NULL;
+}
+
+/*
+ * Idle loop detection. Games commonly spin in short loops polling a status
+ * register or a RAM flag set by an interrupt handler. A taken backward branch
+ * of at most PPC_IDLE_MAX_LOOP instructions is analyzed once: if the loop body
+ * consists only of loads, compares and simple ALU operations, does not
+ * decrement CTR, and writes no register (or CR field) that it reads before
+ * writing, repeating it cannot produce a different result until something
+ * outside the CPU changes. The remaining cycles are then consumed up to the
+ * next point at which that can happen: the end of the time slice (when the
+ * system may raise an IRQ), the decrementer exception, or the next device
+ * event registered with ppc_set_next_event().
+ */
+
+#define PPC_IDLE_MAX_LOOP	8
+#define PPC_IDLE_CACHE_SIZE	256
+
+typedef struct
+{
+	UINT32	pc;		// address of branch instruction
+	UINT32	target;	// loop start
+	bool	valid;
+	bool	idle;
+} PPC_IDLE_LOOP;
+
+static PPC_IDLE_LOOP idle_loops[PPC_IDLE_CACHE_SIZE];
+
+#define IDLE_GPR(n)		((UINT64)1 << (n))
+#define IDLE_CR(n)		((UINT64)1 << (32 + (n)))
+
+static bool ppc_idle_analyze(const UINT32 *ops, unsigned count)
+{
+	UINT64 live_in = 0;	// registers read before being written
+	UINT64 written = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		UINT32 op = ops[i];
+		UINT64 src = 0, dst = 0;
+		bool last = (i == count - 1);
+
+		switch (op >> 26)
+		{
+			case 32: case 34: case 40: case 42:	// lwz, lbz, lhz, lha
+			case 14: case 15:					// addi, addis
+				src = RA ? IDLE_GPR(RA) : 0;
+				dst = IDLE_GPR(RT);
+				break;
+			case 10: case 11:					// cmpli, cmpi
+				src = IDLE_GPR(RA);
+				dst = IDLE_CR(CRFD);
+				break;
+			case 24: case 25: case 26: case 27:	// ori, oris, xori, xoris
+				src = IDLE_GPR(RS);
+				dst = IDLE_GPR(RA);
+				break;
+			case 28: case 29:					// andi., andis.
+				src = IDLE_GPR(RS);
+				dst = IDLE_GPR(RA) | IDLE_CR(0);
+				break;
+			case 21:							// rlwinm
+				src = IDLE_GPR(RS);
+				dst = IDLE_GPR(RA) | (RCBIT ? IDLE_CR(0) : 0);
+				break;
+			case 31:
+				switch ((op >> 1) & 0x3ff)
+				{
+					case 23: case 87: case 279:	// lwzx, lbzx, lhzx
+						src = (RA ? IDLE_GPR(RA) : 0) | IDLE_GPR(RB);
+						dst = IDLE_GPR(RT);
+						break;
+					case 0: case 32:			// cmp, cmpl
+						src = IDLE_GPR(RA) | IDLE_GPR(RB);
+						dst = IDLE_CR(CRFD);
+						break;
+					case 28: case 60: case 124: case 316: case 444:	// and, andc, nor, xor, or
+						src = IDLE_GPR(RS) | IDLE_GPR(RB);
+						dst = IDLE_GPR(RA) | (RCBIT ? IDLE_CR(0) : 0);
+						break;
+					default:
+						return false;
+				}
+				break;
+			case 16:							// bc (must not touch CTR or LR)
+				if (!last || !(BO & 0x04) || LKBIT)
+					return false;
+				src = (BO & 0x10) ? 0 : IDLE_CR(BI >> 2);
+				break;
+			case 18:							// b
+				if (!last || LKBIT)
+					return false;
+				break;
+			default:
+				return false;
+		}
+
+		live_in |= src & ~written;
+		written |= dst;
+	}
+
+	return (live_in & written) == 0;
+}
+
+/*
+ * ppc_idle_check():
+ *
+ * Called after a backward branch from ppc.pc to ppc.npc has been taken (and
+ * ppc.op updated to point at the target). If the loop is idle, consumes
+ * cycles up to the next event. The caller's normal cycle accounting follows.
+ */
+static void ppc_idle_check(void)
+{
+	UINT32 loop_size = ppc.pc - ppc.npc;
+	if (!ppc.idle_skip || loop_size >= PPC_IDLE_MAX_LOOP * 4)
+		return;
+#ifdef SUPERMODEL_DEBUGGER
+	if (PPCDebug != NULL)
+		return;
+#endif
+
+	PPC_IDLE_LOOP *loop = &idle_loops[(ppc.pc >> 2) & (PPC_IDLE_CACHE_SIZE - 1)];
+	if (!loop->valid || loop->pc != ppc.pc || loop->target != ppc.npc)
+	{
+		loop->pc = ppc.pc;
+		loop->target = ppc.npc;
+		loop->valid = true;
+		loop->idle = ppc_idle_analyze(ppc.op, loop_size / 4 + 1);
+
+		unsigned page = ppc.pc >> PPC_CODE_PAGE_SHIFT;
+		if (page < PPC_NUM_CODE_PAGES)
+			ppc_code_pages[page] |= PPC_CODE_PAGE_IDLE;
+	}
+
+	if (!loop->idle)
+		return;
+
+	// Leave 1 cycle for this branch so that the caller lands on the event
+	int target_icount = ppc.stop_icount + 1;
+	UINT64 now = ppc.total_cycles + (UINT64)(ppc.cur_cycles - ppc.icount);
+	if (ppc.next_event > now && ppc.next_event - now < (UINT64) ppc.icount)
+	{
+		int event_icount = ppc.icount - (int)(ppc.next_event - now) + 1;
+		if (event_icount > target_icount)
+			target_icount = event_icount;
+	}
+
+	if (target_icount < ppc.icount)
+		ppc.icount = target_icount;
+}
+
+static void ppc_idle_invalidate_page(unsigned page)
+{
+	for (unsigned i = 0; i < PPC_IDLE_CACHE_SIZE; i++)
+	{
+		if ((idle_loops[i].pc >> PPC_CODE_PAGE_SHIFT) == page)
+			idle_loops[i].valid = false;
+	}
+}
+
+static void ppc_idle_flush(void)
+{
+	memset(idle_loops, 0, sizeof(idle_loops));
+	for (unsigned page = 0; page < PPC_NUM_CODE_PAGES; page++)
+		ppc_code_pages[page] &= ~PPC_CODE_PAGE_IDLE;
+}
+
+UINT8 ppc_code_pages[PPC_NUM_CODE_PAGES];
+
+void ppc_invalidate_code_page(unsigned page)
+{
+	if (ppc_code_pages[page] & PPC_CODE_PAGE_DECODED)
+		ppc_decode_invalidate_page(page);
+	if (ppc_code_pages[page] & PPC_CODE_PAGE_IDLE)
+		ppc_idle_invalidate_page(page);
+	if (ppc_code_pages[page] & PPC_CODE_PAGE_JIT)
+		ppc_jit_invalidate_page(page);
+	ppc_code_pages[page] = 0;
+}
+
 #include "ppc603.c"
 
 /********************************************************************/
@@ -670,6 +1098,10 @@ static void (* optable[64])(UINT32);
 #include "ppc_ops.c"
 #include "ppc_ops.h"
 
+/********************************************************************/
+
+#include "ppc_jit.c"
+
 /* Initialization and shutdown */
 
 void ppc_base_init(void)
@@ -858,7 +1290,9 @@ void ppc_init(const PPC_CONFIG *config)
 
 void ppc_shutdown(void)
 {
-
+	ppc_jit_shutdown();
+	ppc_decode_free();
+	ppc_set_trace(false);
 }
 
 void ppc_set_irq_line(int irqline)
@@ -879,9 +1313,138 @@ UINT32 ppc_get_pc(void)
 	return ppc.pc;
 }
 
+void ppc_set_idle_skip(bool enable)
+{
+	ppc.idle_skip = enable;
+}
+
+void ppc_set_fast_fpu(bool enable)
+{
+	ppc.fast_fpu = enable;
+	ppc.fpscr_status = !enable;
+}
+
+bool ppc_set_trace(bool enable)
+{
+	if (enable && traceRing == NULL)
+	{
+		traceRing = new(std::nothrow) PPC_TRACE_ENTRY[PPC_TRACE_SIZE];
+		if (traceRing == NULL)
+		{
+			ErrorLog("Insufficient memory for PowerPC instruction trace.");
+			ppc_select_execute_loop();
+			return false;
+		}
+	}
+	else if (!enable)
+	{
+		delete [] traceRing;
+		traceRing = NULL;
+	}
+	traceCount = 0;
+	ppc_select_execute_loop();
+	return true;
+}
+
+bool ppc_save_trace(const char *file)
+{
+	if (traceRing == NULL)
+		return false;
+	FILE *fp = fopen(file, "w");
+	if (fp == NULL)
+		return false;
+
+	UINT32 count = traceCount;
+	UINT32 num = (count > PPC_TRACE_SIZE) ? PPC_TRACE_SIZE : count;
+	fprintf(fp, "PowerPC trace: last %u instructions, oldest first%s\n\n", num, ppc.fatalError ? " (halted on fatal error)" : "");
+	for (UINT32 i = count - num; i != count; i++)
+	{
+		const PPC_TRACE_ENTRY &entry = traceRing[i & (PPC_TRACE_SIZE - 1)];
+		char mnem[32];
+		char oprs[255];
+		if (DisassemblePowerPC(entry.opcode, entry.pc, mnem, oprs, true) != Result::OKAY && mnem[0] == '\0')
+		{
+			strcpy(mnem, "???");
+			oprs[0] = '\0';
+		}
+		if (ppc_trace_has_ea(entry.opcode))
+			fprintf(fp, "%08X: %08X  %-8s%-28s EA=%08X\n", entry.pc, entry.opcode, mnem, oprs, entry.ea);
+		else
+			fprintf(fp, "%08X: %08X  %-8s%s\n", entry.pc, entry.opcode, mnem, oprs);
+	}
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+}
+
+bool ppc_halted(void)
+{
+	return ppc.fatalError;
+}
+
+void ppc_set_next_event(UINT64 cycle)
+{
+	ppc.next_event = cycle;
+}
+
 void ppc_set_fetch(PPC_FETCH_REGION * fetch)
 {
+	ppc_decode_free();
+	memset(ppc_code_pages, 0, sizeof(ppc_code_pages));
 	ppc.fetch = fetch;
+	ppc.cur_fetch.start = 1;	// force ppc_change_pc() to look up the new regions
+	ppc.cur_fetch.end = 0;
+
+	memset(fetch_map, 0, sizeof(fetch_map));
+	for (unsigned i = 0; i < PPC_MAX_FETCH_REGIONS && fetch[i].ptr != NULL; i++)
+	{
+		for (UINT32 slot = fetch[i].start >> PPC_FETCH_MAP_SHIFT; slot <= (fetch[i].end >> PPC_FETCH_MAP_SHIFT); slot++)
+		{
+			if (fetch_map[slot] == 0)
+				fetch_map[slot] = i + 1;
+		}
+
+		// Banked regions change contents under the CPU and are decoded on the fly
+		if (fetch[i].banked)
+			continue;
+		decode_tables[i] = new(std::nothrow) PPC_HANDLER[(fetch[i].end - fetch[i].start) / 4 + 1]();
+		if (decode_tables[i] == NULL)
+			ErrorLog("Insufficient memory for PowerPC instruction cache. Emulation will be slower.");
+	}
+}
+
+void ppc_set_fetch_bank(unsigned region, UINT32 *ptr)
+{
+	if (ppc.fetch == NULL || region >= PPC_MAX_FETCH_REGIONS)
+		return;
+	PPC_FETCH_REGION *fetch = &ppc.fetch[region];
+	if (fetch->ptr == NULL || fetch->ptr == ptr)
+		return;
+
+	// Keep executing at the same address if the CPU is inside the region
+	if (ppc.cur_fetch.ptr == fetch->ptr && ppc.cur_fetch.start == fetch->start)
+	{
+		ppc.op = ptr + (ppc.op - ppc.cur_fetch.ptr);
+		ppc.cur_fetch.ptr = ptr;
+	}
+	fetch->ptr = ptr;
+
+	// Idle loops and translated blocks found in the old bank no longer apply
+	for (unsigned i = 0; i < PPC_IDLE_CACHE_SIZE; i++)
+	{
+		if (idle_loops[i].pc >= fetch->start && idle_loops[i].pc <= fetch->end)
+			idle_loops[i].valid = false;
+	}
+	if (jit.enabled)
+		ppc_jit_flush();
+}
+
+void ppc_end_slice(void)
+{
+	ppc.end_slice = true;
+	ppc.stop_icount = ppc.icount;
+	ppc.jit_exit = 1;
 }
 
 UINT64 ppc_total_cycles(void)
@@ -918,6 +1481,21 @@ void ppc_attach_bus(IBus *BusPtr)
 	Bus = BusPtr;
 }
 
+void ppc_set_ram(UINT8 *ram, UINT32 size, UINT8 *statePages)
+{
+	ramBase = ram;
+	ramSize = (ram != NULL) ? size : 0;
+	ramStatePages = statePages;
+}
+
+void ppc_set_write_window(unsigned block, const PPC_WRITE_WINDOW *window)
+{
+	if (window != NULL)
+		writeWindows[block & 0xFF] = *window;
+	else
+		memset(&writeWindows[block & 0xFF], 0, sizeof(PPC_WRITE_WINDOW));
+}
+
 void ppc_save_state(CBlockFile *SaveState)
 {
 	SaveState->NewBlock("PowerPC", __FILE__);
@@ -935,6 +1513,7 @@ void ppc_save_state(CBlockFile *SaveState)
 	SaveState->Write(&ppc.ctr, sizeof(ppc.ctr));
 	SaveState->Write(&ppc.xer, sizeof(ppc.xer));
 	SaveState->Write(&ppc.msr, sizeof(ppc.msr));
+	ppc_flush_cr0();
 	SaveState->Write(ppc.cr, sizeof(ppc.cr));
 	SaveState->Write(&ppc.pvr, sizeof(ppc.pvr));
 	SaveState->Write(&ppc.srr0, sizeof(ppc.srr0));
@@ -1011,11 +1590,15 @@ void ppc_load_state(CBlockFile *SaveState)
 	SaveState->Read(&ppc.pc, sizeof(ppc.pc));
 	SaveState->Read(&ppc.npc, sizeof(ppc.npc));
 	ppc_change_pc(ppc.npc);
+	ppc_decode_flush();
+	ppc_idle_flush();
+	ppc_jit_reset();
 	SaveState->Read(&ppc.lr, sizeof(ppc.lr));
 	SaveState->Read(&ppc.ctr, sizeof(ppc.ctr));
 	SaveState->Read(&ppc.xer, sizeof(ppc.xer));
 	SaveState->Read(&ppc.msr, sizeof(ppc.msr));
 	SaveState->Read(ppc.cr, sizeof(ppc.cr));
+	ppc.cr0_pending = false;
 	SaveState->Read(&ppc.pvr, sizeof(ppc.pvr));
 	SaveState->Read(&ppc.srr0, sizeof(ppc.srr0));
 	SaveState->Read(&ppc.srr1, sizeof(ppc.srr1));
@@ -1108,6 +1691,8 @@ void ppc_attach_debugger(Debugger::CPPCDebug *PPCDebugPtr)
 		ppc_detach_debugger();
 	PPCDebug = PPCDebugPtr;
 	Bus = PPCDebug->AttachBus(Bus);
+	watchPages = PPCDebug->GetWatchPages();
+	ppc_select_execute_loop();
 }
 
 void ppc_detach_debugger()
@@ -1116,6 +1701,8 @@ void ppc_detach_debugger()
 		return;
 	Bus = PPCDebug->DetachBus(); 
 	PPCDebug = NULL;
+	watchPages = noWatchPages;
+	ppc_select_execute_loop();
 }
 
 void ppc_break()
@@ -1139,12 +1726,12 @@ void ppc_set_pc(UINT32 pc)
 
 UINT8 ppc_get_cr(unsigned num)
 {
-	return ppc.cr[num&7];
+	return CR(num&7);
 }
 
 void ppc_set_cr(unsigned num, UINT8 val)
 {
-	ppc.cr[num&7] = val;
+	CR(num&7) = val;
 }
 
 void ppc_set_gpr(unsigned num, UINT32 val)
@@ -340,9 +340,25 @@ typedef struct
 	UINT32	start;
 	UINT32	end;
 	UINT32	* ptr;
+	bool	banked;	// contents switched with ppc_set_fetch_bank()
 
 } PPC_FETCH_REGION;
 
+/*
+ * Memory outside of RAM that aligned 32-bit stores write directly (see
+ * ppc_set_write_window()). Words are stored byte reversed from the PowerPC's
+ * view, and each store marks what it wrote in the tracking arrays.
+ */
+typedef struct
+{
+	UINT32	*ptr;			// memory (NULL if not mapped)
+	UINT32	mask;			// offset within the memory from the address (size - 1, mirrored beyond)
+	UINT8	*dirtyPages;	// one bit per 4 KB page, 8 pages to a byte (NULL if not tracked)
+	uint64_t *dirtyLines;	// one bit per 64-byte line, 64 lines to a page (NULL if not tracked)
+	UINT8	*statePages;	// one flag per CBlockFile::PageSize bytes
+
+} PPC_WRITE_WINDOW;
+
 
 /******************************************************************************
  Functions
@@ -363,6 +379,49 @@ extern void ppc_set_timer_ratio(int ratio);
 
 // These have been added to support the new Supermodel
 extern void ppc_attach_bus(class IBus *BusPtr);		// must be called first!
+
+/*
+ * ppc_set_ram(ram, size, statePages):
+ *
+ * Registers RAM mapped at address 0 that the PowerPC may access directly,
+ * without calling the bus. Must be stored like the fetch regions (each
+ * aligned 32-bit word byte reversed). Unaligned accesses always go to the bus.
+ *
+ * Parameters:
+ *		ram			RAM buffer (NULL to route all accesses to the bus).
+ *		size		Size of RAM in bytes.
+ *		statePages	One flag per CBlockFile::PageSize bytes of RAM, set
+ *					whenever the page is written directly (see
+ *					CBlockFile::Write(data, numBytes, changedPages)).
+ */
+extern void ppc_set_ram(UINT8 *ram, UINT32 size, UINT8 *statePages);
+
+/*
+ * ppc_set_write_window(block, window):
+ *
+ * Maps memory that aligned 32-bit stores to a 16 MB block of the address
+ * space write directly, without calling the bus. All other accesses to the
+ * block, including reads, still go to the bus. Must be called again whenever
+ * the memory or its tracking arrays move.
+ *
+ * Parameters:
+ *		block	Address bits 31-24 of the block.
+ *		window	Memory and tracking arrays, copied. NULL unmaps the block.
+ */
+extern void ppc_set_write_window(unsigned block, const PPC_WRITE_WINDOW *window);
+
+/*
+ * ppc_set_fetch_bank(region, ptr):
+ *
+ * Points a banked fetch region (see ppc_set_fetch()) at new memory. Code
+ * executing inside the region continues at the same address in the new bank.
+ * Does nothing until the fetch regions have been set.
+ *
+ * Parameters:
+ *		region	Index of the region in the array passed to ppc_set_fetch().
+ *		ptr		New contents, stored like the other fetch regions.
+ */
+extern void ppc_set_fetch_bank(unsigned region, UINT32 *ptr);
 extern void ppc_save_state(class CBlockFile *SaveState);
 extern void ppc_load_state(class CBlockFile *SaveState);
 extern UINT32 ppc_get_gpr(unsigned num);
@@ -385,4 +444,88 @@ extern void ppc_set_fpr(unsigned num, double val);
 extern void ppc_write_spr(unsigned spr, UINT32 val);
 extern void ppc_write_sr(unsigned num, UINT32 val);
 extern UINT32 ppc_read_msr();
+
+// Dynamic recompiler
+#define PPC_CODE_PAGE_SHIFT	12
+#define PPC_NUM_CODE_PAGES	(0x01000000 >> PPC_CODE_PAGE_SHIFT)	// pages tracked for self-modifying code (low 16 MB)
+extern UINT8 ppc_code_pages[PPC_NUM_CODE_PAGES];
+extern void ppc_invalidate_code_page(unsigned page);
+extern bool ppc_set_dynarec(bool enable);
+
+// Idle loop skipping
+extern void ppc_set_idle_skip(bool enable);
+
+/*
+ * ppc_set_fast_fpu(enable):
+ *
+ * When enabled, floating point instructions skip updating the FPSCR
+ * exception and result class bits until the game first reads FPSCR (mffs,
+ * mcrfs or a record form setting CR1). From then on until reset they are
+ * maintained as usual. The first read may therefore see stale bits.
+ */
+extern void ppc_set_fast_fpu(bool enable);
+
+/*
+ * ppc_set_trace(enable):
+ *
+ * Keeps a ring of the most recently executed instructions (address, opcode
+ * and, for loads and stores, effective address) for post-mortem debugging.
+ * Traced instructions run in a separate variant of the interpreter loop, so
+ * nothing is recorded, or paid for, while it is disabled. The dynamic
+ * recompiler is bypassed while tracing. Returns false if the ring could not
+ * be allocated.
+ */
+extern bool ppc_set_trace(bool enable);
+
+/*
+ * ppc_save_trace(file):
+ *
+ * Writes the traced instructions, oldest first, disassembled to a text file.
+ * Returns false if tracing is disabled or the file could not be written.
+ */
+extern bool ppc_save_trace(const char *file);
+
+/*
+ * ppc_halted():
+ *
+ * Returns true if the PowerPC has stopped on a fatal error and will not run
+ * again until it is reset.
+ */
+extern bool ppc_halted(void);
+
+/*
+ * ppc_set_next_event(cycle):
+ *
+ * Informs the idle loop detector that a device register polled by the
+ * PowerPC changes value at the given cycle count (as returned by
+ * ppc_total_cycles()), so that idle loops are not skipped past it.
+ */
+extern void ppc_set_next_event(UINT64 cycle);
+
+/*
+ * ppc_end_slice():
+ *
+ * Called by devices while the PowerPC is running to make ppc_execute()
+ * return once the current instruction completes, so that the caller can
+ * handle an event whose time isn't known in advance (e.g., an interrupt
+ * being acknowledged). ppc_execute() returns the cycles actually run.
+ */
+extern void ppc_end_slice(void);
+
+/*
+ * ppc_invalidate_code(addr):
+ *
+ * Must be called whenever memory that may contain PowerPC code is written
+ * (including by DMA) so that stale translations are discarded. Cheap when
+ * the page holds no translated code.
+ *
+ * Parameters:
+ *		addr	Address written.
+ */
+static inline void ppc_invalidate_code(UINT32 addr)
+{
+	unsigned page = addr >> PPC_CODE_PAGE_SHIFT;
+	if (page < PPC_NUM_CODE_PAGES && ppc_code_pages[page])
+		ppc_invalidate_code_page(page);
+}
 #endif	// INCLUDED_PPC_H
@@ -240,6 +240,7 @@ void ppc_reset(void)
 	ppc.hid0 = 1;
 
 	ppc.interrupt_pending = 0;
+	ppc.fpscr_status = !ppc.fast_fpu;
 
 	ppc.tb = 0;
 	ppc.timer_frac = 0;
@@ -247,12 +248,116 @@ void ppc_reset(void)
 	ppc.total_cycles = 0;
 	ppc.cur_cycles = 0;
 	ppc.icount = 0;
+
+	ppc_decode_flush();
+	ppc_idle_flush();
+	ppc_jit_reset();
 }
 
-int ppc_execute(int cycles)
+/*
+ * Instruction trace. Loads, stores and cache block operations also record
+ * their effective address, worked out from the registers before the
+ * instruction executes.
+ */
+static bool ppc_trace_has_ea(UINT32 op)
+{
+	if ((op >> 26) != 31)
+		return (op >> 26) >= 32 && (op >> 26) <= 55;	// D-form loads and stores
+
+	switch ((op >> 1) & 0x3FF)
+	{
+	case 20:  case 23:  case 54:  case 55:  case 86:  case 87:  case 119: case 150:
+	case 151: case 183: case 215: case 246: case 247: case 278: case 279: case 310:
+	case 311: case 343: case 375: case 407: case 438: case 439: case 470: case 533:
+	case 534: case 535: case 567: case 597: case 599: case 631: case 661: case 662:
+	case 663: case 695: case 725: case 727: case 759: case 790: case 918: case 982:
+	case 983: case 1014:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline UINT32 ppc_trace_ea(UINT32 op)
+{
+	UINT32 base = RA ? REG(RA) : 0;
+	if ((op >> 26) != 31)
+		return base + SIMM16;
+	UINT32 xo = (op >> 1) & 0x3FF;
+	return (xo == 597 || xo == 725) ? base : base + REG(RB);	// lswi and stswi have no index register
+}
+
+/*
+ * Interpreter loop. Runs until the next event (see ppc_update_stop()).
+ * Built with and without the debugger hook and the instruction trace so that
+ * the usual build doesn't test for either on every instruction;
+ * ppc_select_execute_loop() picks the variant.
+ */
+template <bool Debugging, bool Tracing>
+static void ppc_execute_loop(void)
 {
 	UINT32 opcode;
+	UINT32 *op;
+
+	while( ppc.icount > ppc.stop_icount && !ppc.fatalError)
+	{
+		ppc.pc = ppc.npc;
+		
+		// Debug breakpoints
+		/*
+		if (ppc.pc == 0x9d40)
+		{
+			printf("%X R3=%08X R4=%08X\n", ppc.pc, REG(3), REG(4));			
+			
+		}
+		*/
+			
+		op = ppc.op++;
+		opcode = *op;	// Supermodel byte reverses each aligned word (converting them to little endian) so they can be fetched directly
+		ppc.npc = ppc.pc + 4;
+
+		if (Tracing)
+		{
+			PPC_TRACE_ENTRY &entry = traceRing[traceCount++ & (PPC_TRACE_SIZE - 1)];
+			entry.pc = ppc.pc;
+			entry.opcode = opcode;
+			entry.ea = ppc_trace_has_ea(opcode) ? ppc_trace_ea(opcode) : 0;
+		}
+
+#ifdef SUPERMODEL_DEBUGGER
+		if (Debugging && PPCDebug != NULL)	// debugger may detach mid-run
+		{
+			// Debugger may substitute the opcode, so bypass the instruction cache
+			while (PPCDebug->CPUExecute(ppc.pc, opcode, (PPCDebug->instrCount > 0 ? 1 : 0)))
+				opcode = *ppc.op++;
+			ppc_get_handler(opcode)(opcode);
+		}
+		else
+#endif // SUPERMODEL_DEBUGGER
+			ppc_get_decoded_handler(op)(opcode);
+
+		ppc.icount--;
 
+		//ppc603_check_interrupts();
+	}
+}
+
+static void (*ppc_execute_loop_fn)(void) = ppc_execute_loop<false, false>;
+
+static void ppc_select_execute_loop(void)
+{
+#ifdef SUPERMODEL_DEBUGGER
+	if (PPCDebug != NULL)
+	{
+		ppc_execute_loop_fn = ppc_execute_loop<true, false>;
+		return;
+	}
+#endif // SUPERMODEL_DEBUGGER
+	ppc_execute_loop_fn = (traceRing != NULL) ? ppc_execute_loop<false, true> : ppc_execute_loop<false, false>;
+}
+
+int ppc_execute(int cycles)
+{
 	ppc.cur_cycles = cycles;
 	ppc.icount = cycles;
 	ppc.tb_base_icount = cycles + ppc.timer_frac;
@@ -264,6 +369,7 @@ int ppc_execute(int cycles)
 		ppc.dec_trigger_cycle = ppc.dec_base_icount - ((1 + DEC) * ppc.timer_ratio);
 	else
 		ppc.dec_trigger_cycle = 0x7fffffff;
+	ppc.end_slice = false;
 
 	ppc_change_pc(ppc.npc);
 
@@ -282,48 +388,22 @@ int ppc_execute(int cycles)
 		PPCDebug->CPUActive();
 #endif // SUPERMODEL_DEBUGGER
 
-	while( ppc.icount > 0 && !ppc.fatalError)
+	// Run straight to each decrementer exception instead of testing for it after every instruction
+	while (ppc.icount > 0 && !ppc.fatalError && !ppc.end_slice)
 	{
-		ppc.pc = ppc.npc;
-		
-		// Debug breakpoints
-		/*
-		if (ppc.pc == 0x9d40)
-		{
-			printf("%X R3=%08X R4=%08X\n", ppc.pc, REG(3), REG(4));			
-			
-		}
-		*/
-			
-		opcode = *ppc.op++;	// Supermodel byte reverses each aligned word (converting them to little endian) so they can be fetched directly
-		ppc.npc = ppc.pc + 4;
+		ppc_update_stop();
 
-#ifdef SUPERMODEL_DEBUGGER
-		if (PPCDebug != NULL)
-		{
-			while (PPCDebug->CPUExecute(ppc.pc, opcode, (PPCDebug->instrCount > 0 ? 1 : 0)))
-				opcode = *ppc.op++;
-		}
-#endif // SUPERMODEL_DEBUGGER
+		if (ppc_jit_active())
+			ppc_jit_execute();
 
-		switch(opcode >> 26)
-		{
-			case 19:	optable19[(opcode >> 1) & 0x3ff](opcode); break;
-			case 31:	optable31[(opcode >> 1) & 0x3ff](opcode); break;
-			case 59:	optable59[(opcode >> 1) & 0x3ff](opcode); break;
-			case 63:	optable63[(opcode >> 1) & 0x3ff](opcode); break;
-			default:	optable[opcode >> 26](opcode); break;
-		}
+		ppc_execute_loop_fn();
 
-		ppc.icount--;
-		
+		// Exception occurs when the last instruction lands exactly on the trigger cycle
 		if (ppc.icount == ppc.dec_trigger_cycle)
 		{
 			ppc.interrupt_pending |= 0x2;
 			ppc603_check_interrupts();
 		}
-
-		//ppc603_check_interrupts();
 	}
 
 #ifdef SUPERMODEL_DEBUGGER
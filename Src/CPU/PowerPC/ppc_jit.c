@@ -0,0 +1,475 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ppc_jit.c
+ *
+ * PowerPC dynamic recompiler. Included from ppc.cpp; do not compile
+ * separately.
+ *
+ * Translation Scheme
+ * ------------------
+ * Basic blocks are translated out of the fetch regions into host code that
+ * calls the opcode handlers in ppc_ops.c directly, with the opcode passed as
+ * an immediate. This removes instruction fetch, the double table dispatch and
+ * its mispredicted indirect branches from the inner loop while reusing the
+ * interpreter's handlers, so there is exactly one implementation of every
+ * instruction. ppc.icount is decremented after each instruction and blocks
+ * exit as soon as it reaches ppc.stop_icount, exactly like the interpreter
+ * loop, so timebase, decrementer and interrupt timing are identical to the
+ * interpreter.
+ *
+ * Blocks end at branches, rfi, sc and traps, at the end of a 4 KB page, or
+ * after PPC_JIT_MAX_BLOCK_INSTRUCTIONS. Every handler that may redirect
+ * execution (anything touching memory, SPRs, the MSR, etc.) is followed by a
+ * check of ppc.npc, so interrupts raised by bus accesses are taken at the
+ * same instruction boundary as in the interpreter. Handlers known to only
+ * touch GPRs, CR and XER skip that check.
+ *
+ * Invalidation
+ * ------------
+ * Pages in the low 16 MB that contain translated code are flagged in
+ * ppc_code_pages[]. Writes to those pages, whether from the PowerPC or from
+ * DMA, must be reported with ppc_invalidate_code(), which discards all blocks
+ * on the page. If the block currently executing is affected, it is exited
+ * after the store completes. Code above 16 MB (i.e., CROM) is assumed to be
+ * read-only. Reset and state loading flush the entire cache.
+ *
+ * Host Support
+ * ------------
+ * Only an x86-64 emitter (System V and Windows calling conventions) exists
+ * at present. Elsewhere, ppc_set_dynarec() fails and the interpreter is
+ * used. The debugger always runs on the interpreter.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PPC_JIT_X64	1
+#else
+#define PPC_JIT_X64	0
+#endif
+
+#define PPC_JIT_CACHE_SIZE				(32*1024*1024)	// bytes of host code
+#define PPC_JIT_MAX_BLOCKS				(256*1024)
+#define PPC_JIT_HASH_SIZE				65536
+#define PPC_JIT_MAX_BLOCK_INSTRUCTIONS	64
+#define PPC_JIT_MAX_BLOCK_CODE			(64 + PPC_JIT_MAX_BLOCK_INSTRUCTIONS*128)	// worst-case host code per block
+
+typedef struct PPC_JIT_BLOCK
+{
+	UINT32					start;		// guest address of first instruction
+	void					(*code)(void);
+	struct PPC_JIT_BLOCK	*next_hash;	// next block in hash bucket
+	struct PPC_JIT_BLOCK	*next_page;	// next block on same code page
+} PPC_JIT_BLOCK;
+
+static struct
+{
+	bool			enabled;
+	UINT8			*cache;
+	UINT32			cache_used;
+	UINT8			*emit;		// current emit pointer (valid during translation)
+	PPC_JIT_BLOCK	*blocks;
+	UINT32			num_blocks;
+	PPC_JIT_BLOCK	*hash[PPC_JIT_HASH_SIZE];
+	PPC_JIT_BLOCK	*page_blocks[PPC_NUM_CODE_PAGES];
+} jit;
+
+static inline unsigned ppc_jit_hash(UINT32 pc)
+{
+	return (pc >> 2) & (PPC_JIT_HASH_SIZE - 1);
+}
+
+static bool ppc_jit_active(void)
+{
+#ifdef SUPERMODEL_DEBUGGER
+	if (PPCDebug != NULL)
+		return false;
+#endif
+	if (traceRing != NULL)
+		return false;
+	return jit.enabled;
+}
+
+static void ppc_jit_flush(void)
+{
+	jit.cache_used = 0;
+	jit.num_blocks = 0;
+	memset(jit.hash, 0, sizeof(jit.hash));
+	memset(jit.page_blocks, 0, sizeof(jit.page_blocks));
+	for (unsigned page = 0; page < PPC_NUM_CODE_PAGES; page++)
+		ppc_code_pages[page] &= ~PPC_CODE_PAGE_JIT;
+	ppc.jit_exit = 1;
+}
+
+static void ppc_jit_invalidate_page(unsigned page)
+{
+	for (PPC_JIT_BLOCK *block = jit.page_blocks[page]; block != NULL; block = block->next_page)
+	{
+		// Unlink from hash bucket
+		PPC_JIT_BLOCK **link = &jit.hash[ppc_jit_hash(block->start)];
+		while (*link != NULL && *link != block)
+			link = &(*link)->next_hash;
+		if (*link != NULL)
+			*link = block->next_hash;
+	}
+
+	jit.page_blocks[page] = NULL;
+	ppc.jit_exit = 1;	// current block may have been overwritten
+}
+
+// Handlers that only modify GPRs, CR and XER and can never redirect execution
+static const PPC_HANDLER ppc_jit_pure_handlers[] =
+{
+	ppc_addx, ppc_addcx, ppc_addex, ppc_addi, ppc_addic, ppc_addic_rc, ppc_addis,
+	ppc_addmex, ppc_addzex, ppc_andx, ppc_andcx, ppc_andi_rc, ppc_andis_rc,
+	ppc_cmp, ppc_cmpi, ppc_cmpl, ppc_cmpli, ppc_cntlzw,
+	ppc_crand, ppc_crandc, ppc_creqv, ppc_crnand, ppc_crnor, ppc_cror, ppc_crorc, ppc_crxor,
+	ppc_eqvx, ppc_extsbx, ppc_extshx, ppc_mcrf, ppc_mcrxr, ppc_mfcr, ppc_mtcrf,
+	ppc_mulhwx, ppc_mulhwux, ppc_mulli, ppc_mullwx, ppc_nandx, ppc_negx, ppc_norx,
+	ppc_orx, ppc_orcx, ppc_ori, ppc_oris, ppc_rlwimix, ppc_rlwinmx, ppc_rlwnmx,
+	ppc_slwx, ppc_srawx, ppc_srawix, ppc_srwx,
+	ppc_subfx, ppc_subfcx, ppc_subfex, ppc_subfic, ppc_subfmex, ppc_subfzex,
+	ppc_xorx, ppc_xori, ppc_xoris
+};
+
+// Handlers that always end a block
+static const PPC_HANDLER ppc_jit_branch_handlers[] =
+{
+	ppc_bx, ppc_bcx, ppc_bcctrx, ppc_bclrx, ppc_rfi, ppc_sc, ppc_tw, ppc_twi,
+	ppc_invalid
+};
+
+static bool ppc_jit_is_in(PPC_HANDLER handler, const PPC_HANDLER *list, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (list[i] == handler)
+			return true;
+	}
+	return false;
+}
+
+
+/******************************************************************************
+ x86-64 Emitter
+******************************************************************************/
+
+#if PPC_JIT_X64
+
+#define OFFS(field)	((UINT32)offsetof(PPC_REGS, field))
+
+static inline void emit8(UINT8 x)		{ *jit.emit++ = x; }
+static inline void emit32(UINT32 x)		{ memcpy(jit.emit, &x, 4); jit.emit += 4; }
+static inline void emit64(UINT64 x)		{ memcpy(jit.emit, &x, 8); jit.emit += 8; }
+
+// mov dword [rbx+field], imm32
+static void emit_store_imm32(UINT32 field, UINT32 imm)
+{
+	emit8(0xC7); emit8(0x83); emit32(field); emit32(imm);
+}
+
+// mov rax, imm64; call rax (with first argument in edi/ecx if has_arg)
+static void emit_call(const void *fn, bool has_arg, UINT32 arg)
+{
+	if (has_arg)
+	{
+#ifdef _WIN32
+		emit8(0xB9); emit32(arg);	// mov ecx, imm32
+#else
+		emit8(0xBF); emit32(arg);	// mov edi, imm32
+#endif
+	}
+	emit8(0x48); emit8(0xB8); emit64((UINT64)(uintptr_t)fn);
+	emit8(0xFF); emit8(0xD0);
+}
+
+// jcc rel32 (opcode2 = 0x84 je, 0x85 jne, 0x8E jle); returns location of displacement
+static UINT8 *emit_jcc(UINT8 opcode2)
+{
+	emit8(0x0F); emit8(opcode2);
+	UINT8 *disp = jit.emit;
+	emit32(0);
+	return disp;
+}
+
+static UINT8 *emit_jmp(void)
+{
+	emit8(0xE9);
+	UINT8 *disp = jit.emit;
+	emit32(0);
+	return disp;
+}
+
+static void patch_rel32(UINT8 *disp, const UINT8 *target)
+{
+	INT32 rel = (INT32)(target - (disp + 4));
+	memcpy(disp, &rel, 4);
+}
+
+/*
+ * Emits icount decrement and the check for the next event (see
+ * ppc_update_stop()) common to all instructions. The branch to the exit is
+ * recorded in the fixup array: the pure exit stub (which must first store
+ * pc/npc) or the block tail.
+ */
+static void emit_cycle_check(UINT8 **fixups, int *num_fixups)
+{
+	emit8(0x83); emit8(0xAB); emit32(OFFS(icount)); emit8(0x01);	// sub dword [rbx+icount], 1
+	emit8(0x8B); emit8(0x83); emit32(OFFS(icount));					// mov eax, [rbx+icount]
+	emit8(0x3B); emit8(0x83); emit32(OFFS(stop_icount));			// cmp eax, [rbx+stop_icount]
+	fixups[(*num_fixups)++] = emit_jcc(0x8E);						// jle exit
+}
+
+static void (*ppc_jit_emit_block(const UINT32 *op_ptr, UINT32 pc, UINT32 region_end, UINT32 *block_end))(void)
+{
+	UINT8	*code = &jit.cache[jit.cache_used];
+	UINT8	*tail_fixups[PPC_JIT_MAX_BLOCK_INSTRUCTIONS * 3];
+	int		num_tail_fixups = 0;
+	struct
+	{
+		UINT32	pc;
+		UINT8	*fixups[1];
+	} stubs[PPC_JIT_MAX_BLOCK_INSTRUCTIONS];
+	int		num_stubs = 0;
+	bool	last_pure = false;
+
+	jit.emit = code;
+
+	// Prologue: rbx = &ppc
+	emit8(0x53);	// push rbx
+#ifdef _WIN32
+	emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x20);	// sub rsp, 32 (shadow space)
+#endif
+	emit8(0x48); emit8(0xBB); emit64((UINT64)(uintptr_t)&ppc);	// mov rbx, imm64
+
+	for (int i = 0; i < PPC_JIT_MAX_BLOCK_INSTRUCTIONS; i++)
+	{
+		UINT32		op = op_ptr[i];
+		PPC_HANDLER	handler = ppc_get_handler(op);
+		bool		pure = ppc_jit_is_in(handler, ppc_jit_pure_handlers, sizeof(ppc_jit_pure_handlers) / sizeof(ppc_jit_pure_handlers[0]));
+		bool		branch = ppc_jit_is_in(handler, ppc_jit_branch_handlers, sizeof(ppc_jit_branch_handlers) / sizeof(ppc_jit_branch_handlers[0]));
+
+		if (pure)
+		{
+			// pc/npc are only stored on exit
+			emit_call((const void *) handler, true, op);
+			int n = 0;
+			emit_cycle_check(stubs[num_stubs].fixups, &n);
+			stubs[num_stubs++].pc = pc;
+		}
+		else
+		{
+			emit_store_imm32(OFFS(pc), pc);
+			emit_store_imm32(OFFS(npc), pc + 4);
+			emit_call((const void *) handler, true, op);
+			emit_cycle_check(tail_fixups, &num_tail_fixups);
+			emit8(0x81); emit8(0xBB); emit32(OFFS(npc)); emit32(pc + 4);	// cmp dword [rbx+npc], pc+4
+			tail_fixups[num_tail_fixups++] = emit_jcc(0x85);				// jne tail
+			emit8(0x0F); emit8(0xB6); emit8(0x83); emit32(OFFS(fatalError));	// movzx eax, byte [rbx+fatalError]
+			emit8(0x0A); emit8(0x83); emit32(OFFS(jit_exit));					// or al, [rbx+jit_exit]
+			tail_fixups[num_tail_fixups++] = emit_jcc(0x85);					// jnz tail
+		}
+
+		last_pure = pure;
+		*block_end = pc;
+		pc += 4;
+
+		if (branch || pc == 0 || pc > region_end || (pc & 0xFFF) == 0)
+			break;
+	}
+
+	// Fell through the end of the block
+	if (last_pure)
+	{
+		emit_store_imm32(OFFS(pc), *block_end);
+		emit_store_imm32(OFFS(npc), *block_end + 4);
+	}
+
+	// Tail: exit back to dispatcher
+	UINT8 *tail = jit.emit;
+#ifdef _WIN32
+	emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x20);	// add rsp, 32
+#endif
+	emit8(0x5B);	// pop rbx
+	emit8(0xC3);	// ret
+
+	for (int i = 0; i < num_tail_fixups; i++)
+		patch_rel32(tail_fixups[i], tail);
+
+	// Out-of-line exit stubs for pure instructions
+	for (int i = 0; i < num_stubs; i++)
+	{
+		patch_rel32(stubs[i].fixups[0], jit.emit);
+		emit_store_imm32(OFFS(pc), stubs[i].pc);
+		emit_store_imm32(OFFS(npc), stubs[i].pc + 4);
+		patch_rel32(emit_jmp(), tail);
+	}
+
+	jit.cache_used += (UINT32)(jit.emit - code);
+	return (void (*)(void)) code;
+}
+
+static UINT8 *ppc_jit_alloc_cache(void)
+{
+#ifdef _WIN32
+	return (UINT8 *) VirtualAlloc(NULL, PPC_JIT_CACHE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void *ptr = mmap(NULL, PPC_JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON, -1, 0);
+	return (ptr == MAP_FAILED) ? NULL : (UINT8 *) ptr;
+#endif
+}
+
+static void ppc_jit_free_cache(UINT8 *cache)
+{
+#ifdef _WIN32
+	VirtualFree(cache, 0, MEM_RELEASE);
+#else
+	munmap(cache, PPC_JIT_CACHE_SIZE);
+#endif
+}
+
+#endif	// PPC_JIT_X64
+
+
+/******************************************************************************
+ Block Cache and Dispatcher
+******************************************************************************/
+
+#if PPC_JIT_X64
+
+static PPC_JIT_BLOCK *ppc_jit_translate(UINT32 pc)
+{
+	if (jit.num_blocks >= PPC_JIT_MAX_BLOCKS || jit.cache_used + PPC_JIT_MAX_BLOCK_CODE > PPC_JIT_CACHE_SIZE)
+		ppc_jit_flush();
+
+	// Locate instructions in the fetch regions
+	ppc_change_pc(pc);
+	if (ppc.fatalError)
+		return NULL;
+
+	PPC_JIT_BLOCK *block = &jit.blocks[jit.num_blocks++];
+	UINT32 block_end = pc;
+	block->start = pc;
+	block->code = ppc_jit_emit_block(ppc.op, pc, ppc.cur_fetch.end, &block_end);
+
+	unsigned h = ppc_jit_hash(pc);
+	block->next_hash = jit.hash[h];
+	jit.hash[h] = block;
+
+	// Blocks never cross a page, so registering the first is sufficient
+	unsigned page = pc >> PPC_CODE_PAGE_SHIFT;
+	if (page < PPC_NUM_CODE_PAGES)
+	{
+		block->next_page = jit.page_blocks[page];
+		jit.page_blocks[page] = block;
+		ppc_code_pages[page] |= PPC_CODE_PAGE_JIT;
+	}
+	else
+		block->next_page = NULL;
+
+	return block;
+}
+
+static void ppc_jit_execute(void)
+{
+	while (ppc.icount > ppc.stop_icount && !ppc.fatalError)
+	{
+		UINT32 pc = ppc.npc;
+		PPC_JIT_BLOCK *block = jit.hash[ppc_jit_hash(pc)];
+		while (block != NULL && block->start != pc)
+			block = block->next_hash;
+
+		if (block == NULL)
+		{
+			block = ppc_jit_translate(pc);
+			if (block == NULL)
+				break;
+		}
+
+		ppc.jit_exit = 0;
+		block->code();
+	}
+}
+
+#else
+
+static void ppc_jit_execute(void)
+{
+}
+
+#endif	// PPC_JIT_X64
+
+
+/******************************************************************************
+ Interface
+******************************************************************************/
+
+bool ppc_set_dynarec(bool enable)
+{
+#if PPC_JIT_X64
+	if (enable)
+	{
+		if (jit.cache == NULL)
+		{
+			jit.cache = ppc_jit_alloc_cache();
+			jit.blocks = new(std::nothrow) PPC_JIT_BLOCK[PPC_JIT_MAX_BLOCKS];
+			if (jit.cache == NULL || jit.blocks == NULL)
+			{
+				ErrorLog("Insufficient memory for PowerPC dynamic recompiler. Using the interpreter.");
+				ppc_jit_shutdown();
+				return false;
+			}
+		}
+		InfoLog("PowerPC dynamic recompiler enabled.");
+	}
+
+	ppc_jit_flush();
+	jit.enabled = enable;
+	return true;
+#else
+	if (enable)
+	{
+		ErrorLog("PowerPC dynamic recompiler is not supported on this platform. Using the interpreter.");
+		return false;
+	}
+	return true;
+#endif
+}
+
+static void ppc_jit_reset(void)
+{
+	if (jit.enabled)
+		ppc_jit_flush();
+}
+
+static void ppc_jit_shutdown(void)
+{
+#if PPC_JIT_X64
+	if (jit.cache != NULL)
+		ppc_jit_free_cache(jit.cache);
+	delete [] jit.blocks;
+#endif
+	jit.cache = NULL;
+	jit.blocks = NULL;
+	jit.enabled = false;
+	for (unsigned page = 0; page < PPC_NUM_CODE_PAGES; page++)
+		ppc_code_pages[page] &= ~PPC_CODE_PAGE_JIT;
+}
@@ -242,6 +242,9 @@ static void ppc_bx(UINT32 op)
 	}
 
 	ppc_change_pc(ppc.npc);
+
+	if( ppc.npc <= ppc.pc && !LKBIT )
+		ppc_idle_check();
 }
 
 static void ppc_bcx(UINT32 op)
@@ -254,6 +257,9 @@ static void ppc_bcx(UINT32 op)
 			ppc.npc += ppc.pc;
 
 		ppc_change_pc(ppc.npc);
+
+		if( ppc.npc <= ppc.pc && !LKBIT )
+			ppc_idle_check();
 	}
 
 	if( LKBIT ) {
@@ -709,6 +715,14 @@ static void ppc_lmw(UINT32 op)
 	if( RA != 0 )
 		ea += REG(RA);
 
+	// Registers are stored the same way as RAM, so they can be copied as a block
+	UINT32 size = (32 - r) * 4;
+	if (!(ea & 3) && ea < ramSize && size <= ramSize - ea && !WATCHED(ea) && !WATCHED(ea + size - 1))
+	{
+		memcpy(&REG(r), &ramBase[ea], size);
+		return;
+	}
+
 	while( r <= 31 )
 	{
 		REG(r) = READ32(ea);
@@ -727,6 +741,16 @@ static void ppc_lswi(UINT32 op)
 	r = RT - 1;
 	i = 0;
 
+	// Whole words from RAM are loaded directly
+	if (!(ea & 3) && ea < ramSize && (UINT32)n <= ramSize - ea && !WATCHED(ea) && !WATCHED(ea + n - 1))
+	{
+		for (; n >= 4; n -= 4, ea += 4)
+		{
+			r = (r + 1) % 32;
+			REG(r) = *(UINT32 *) &ramBase[ea];
+		}
+	}
+
 	while(n > 0)
 	{
 		if (i == 0) {
@@ -1222,6 +1246,18 @@ static void ppc_stmw(UINT32 op)
 	if( RA != 0 )
 		ea += REG(RA);
 
+	// At most 128 bytes, so no more than two pages are touched
+	UINT32 size = (32 - r) * 4;
+	if (!(ea & 3) && ea < ramSize && size <= ramSize - ea && !WATCHED(ea) && !WATCHED(ea + size - 1))
+	{
+		memcpy(&ramBase[ea], &REG(r), size);
+		ramStatePages[ea >> CBlockFile::PageShift] = 1;
+		ramStatePages[(ea + size - 1) >> CBlockFile::PageShift] = 1;
+		ppc_invalidate_code(ea);
+		ppc_invalidate_code(ea + size - 1);
+		return;
+	}
+
 	while( r <= 31 )
 	{
 		WRITE32(ea, REG(r));
@@ -1240,6 +1276,23 @@ static void ppc_stswi(UINT32 op)
 	r = RT - 1;
 	i = 0;
 
+	// Whole words to RAM are stored directly
+	if (!(ea & 3) && ea < ramSize && (UINT32)n <= ramSize - ea && !WATCHED(ea) && !WATCHED(ea + n - 1))
+	{
+		if (n >= 4)
+		{
+			ramStatePages[ea >> CBlockFile::PageShift] = 1;
+			ramStatePages[(ea + n - 1) >> CBlockFile::PageShift] = 1;
+			ppc_invalidate_code(ea);
+			ppc_invalidate_code(ea + n - 1);
+		}
+		for (; n >= 4; n -= 4, ea += 4)
+		{
+			r = (r + 1) % 32;
+			*(UINT32 *) &ramBase[ea] = REG(r);
+		}
+	}
+
 	while(n > 0)
 	{
 		if (i == 0) {
@@ -1707,13 +1760,16 @@ inline INT64 round_toward_negative_infinity(FPR f)
 }
 */
 
-#define SET_VXSNAN(a, b)    if (is_snan_double(a) || is_snan_double(b)) ppc.fpscr |= 0x80000000
-#define SET_VXSNAN_1(c)     if (is_snan_double(c)) ppc.fpscr |= 0x80000000
+#define SET_VXSNAN(a, b)    if (ppc.fpscr_status && (is_snan_double(a) || is_snan_double(b))) ppc.fpscr |= 0x80000000
+#define SET_VXSNAN_1(c)     if (ppc.fpscr_status && is_snan_double(c)) ppc.fpscr |= 0x80000000
 
 inline void set_fprf(FPR f)
 {
 	UINT32 fprf;
 
+	if (!ppc.fpscr_status)	// see ppc_set_fast_fpu()
+		return;
+
 	// see page 3-30, 3-31
 
 	if (is_qnan_double(f))
@@ -2401,6 +2457,7 @@ static void ppc_fsubx(UINT32 op)
 
 static void ppc_mffsx(UINT32 op)
 {
+	ppc.fpscr_status = true;
 	FPR(RT).id = (UINT32)ppc.fpscr;
 
 	if( RCBIT ) {
@@ -2496,6 +2553,7 @@ static void ppc_mcrfs(UINT32 op)
 	UINT32 crfs, f;
 	crfs = CRFA;
 
+	ppc.fpscr_status = true;
 	f = ppc.fpscr >> ((7 - crfs) * 4);	// get crfS field from FPSCR
 	f &= 0xf;
 
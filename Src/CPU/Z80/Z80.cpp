@@ -36,6 +36,26 @@
 
 #include "Debugger/CPU/Z80Debug.h"
 
+/*
+ * Build Options
+ *
+ * Z80_THREADED_DISPATCH: Each instruction handler jumps straight to the next
+ * one through a table of label addresses (a GCC/Clang extension) rather than
+ * returning to the top of the loop and the switch statement.
+ *
+ * Z80_IDLE_FASTFORWARD: Loops that spin without side effects while waiting
+ * for an interrupt or for a polled I/O port are skipped ahead (see Run()).
+ *
+ * Neither is used when the debugger is enabled, because it must see every
+ * instruction.
+ */
+#ifndef SUPERMODEL_DEBUGGER
+#if defined(__GNUC__)
+#define Z80_THREADED_DISPATCH
+#endif
+#define Z80_IDLE_FASTFORWARD
+#endif
+
 /******************************************************************************
  Internal Helper Macros
 ******************************************************************************/
@@ -46,10 +66,10 @@
 #define GetBYTE_mm(a) ( Bus->Read8(((a)--)&0xFFFF) )
 #define mm_GetBYTE(a) ( Bus->Read8((--(a))&0xFFFF) )
 
-#define PutBYTE(a,v)  Bus->Write8((a)&0xFFFF,v)
-#define PutBYTE_pp(a,v) Bus->Write8(((a)++)&0xFFFF,v)
-#define PutBYTE_mm(a,v) Bus->Write8(((a)--)&0xFFFF,v)
-#define mm_PutBYTE(a,v) Bus->Write8((--(a))&0xFFFF,v)
+#define PutBYTE(a,v)  ( IDLE_DIRTY(), Bus->Write8((a)&0xFFFF,v) )
+#define PutBYTE_pp(a,v) ( IDLE_DIRTY(), Bus->Write8(((a)++)&0xFFFF,v) )
+#define PutBYTE_mm(a,v) ( IDLE_DIRTY(), Bus->Write8(((a)--)&0xFFFF,v) )
+#define mm_PutBYTE(a,v) ( IDLE_DIRTY(), Bus->Write8((--(a))&0xFFFF,v) )
 
 #define GetWORD(a)    (Bus->Read8((a)&0xFFFF) | (Bus->Read8(((a)+1)&0xFFFF)<<8))
 
@@ -60,8 +80,17 @@
     PutBYTE((a)+1,((v)>>8));  \
   } while (0)
 
-#define OUTPUT(a,v)   Bus->IOWrite8((a)&0xFF,v)
-#define INPUT(a)    ( Bus->IORead8((a)&0xFF) )
+#define OUTPUT(a,v)   ( IDLE_DIRTY(), Bus->IOWrite8((a)&0xFF,v) )
+#define INPUT(a)    ( port = (a)&0xFF, IDLE_POLL(port), Bus->IORead8(port) )
+
+// Idle loop bookkeeping: anything that may have a side effect marks the current loop iteration dirty
+#ifdef Z80_IDLE_FASTFORWARD
+#define IDLE_DIRTY()  ( idleDirty = true )
+#define IDLE_POLL(p)  ( idleDirty |= ((pollPorts[(p)>>5] >> ((p)&31)) & 1) == 0 )
+#else
+#define IDLE_DIRTY()  ( (void) 0 )
+#define IDLE_POLL(p)  ( (void) 0 )
+#endif
 
 // Flags
 #define FLAG_C  1
@@ -200,6 +229,41 @@ static const unsigned char cycleTables[5][256] = {
 
 #define parity(x) partab[(x)&0xff]
 
+/*
+ * Flag tables, indexed by an 8-bit result:
+ *
+ *  sz:   S, Z, and the undocumented bits 5 and 3
+ *  szp:  As above, plus P (parity)
+ *  inc:  S, Z, 5, 3, H, and V (overflow) after an 8-bit increment
+ *  dec:  S, Z, 5, 3, H, V, and N after an 8-bit decrement
+ */
+struct FlagTables
+{
+  unsigned char sz[256];
+  unsigned char szp[256];
+  unsigned char inc[256];
+  unsigned char dec[256];
+
+  constexpr FlagTables()
+    : sz(), szp(), inc(), dec()
+  {
+    for (int v = 0; v < 256; v++)
+    {
+      sz[v] = (v & 0xa8) | ((v == 0) << 6);
+      szp[v] = sz[v] | partab[v];
+      inc[v] = sz[v] | (((v & 0xf) == 0) << 4) | ((v == 0x80) << 2);
+      dec[v] = sz[v] | (((v & 0xf) == 0xf) << 4) | ((v == 0x7f) << 2) | 2;
+    }
+  }
+};
+
+static constexpr FlagTables flagTables;
+
+#define szTable   flagTables.sz
+#define szpTable  flagTables.szp
+#define incTable  flagTables.inc
+#define decTable  flagTables.dec
+
 // Stack
 #define POP(x)                        \
   do                                  \
@@ -215,8 +279,86 @@ static const unsigned char cycleTables[5][256] = {
     mm_PutBYTE(SP,(x)&0xFF);  \
   } while (0)
 
+/*
+ * Idle loop detection
+ *
+ * Each backward branch records the loop head it lands on together with the
+ * register state. If the next arrival at the same head finds identical state
+ * and nothing with a side effect happened in between (memory or I/O writes,
+ * reads of ports not registered with AddPollPort(), register bank exchanges),
+ * every further iteration would do exactly the same thing until an interrupt
+ * arrives. In that case, whole iterations that fit in the remaining cycles
+ * are skipped. The last, partial iteration is still executed normally so
+ * that the Z80 stops at the same instruction it would have otherwise.
+ */
+#ifdef Z80_IDLE_FASTFORWARD
+#define IDLE_LOOP_CHECK()                                                       \
+  do                                                                            \
+  {                                                                             \
+    unsigned int misc = (ir << 16) | (im << 8) | iff;                           \
+    if (pc == idleHead && !idleDirty &&                                         \
+        AF == idleRegs[0] && BC == idleRegs[1] && DE == idleRegs[2] &&          \
+        HL == idleRegs[3] && IX == idleRegs[4] && IY == idleRegs[5] &&          \
+        SP == idleRegs[6] && misc == idleRegs[7] &&                             \
+        !nmiTrigger && !(intLine && (iff & 1)))                                 \
+    {                                                                           \
+      int period = idleCycles - cycles;                                         \
+      if (cycles > period)                                                      \
+        cycles -= ((cycles - 1) / period) * period;                             \
+    }                                                                           \
+    idleHead = pc;                                                              \
+    idleCycles = cycles;                                                        \
+    idleDirty = false;                                                          \
+    idleRegs[0] = AF; idleRegs[1] = BC; idleRegs[2] = DE; idleRegs[3] = HL;     \
+    idleRegs[4] = IX; idleRegs[5] = IY; idleRegs[6] = SP; idleRegs[7] = misc;   \
+  } while (0)
+#else
+#define IDLE_LOOP_CHECK() do {} while (0)
+#endif
+
+// Instruction dispatch
+#ifdef Z80_THREADED_DISPATCH
+#define OPCODE(n) case n: op_##n:
+#define NEXT_OPCODE                                       \
+  if (cycles > 0 && !nmiTrigger && !(intLine && (iff & 1))) \
+  {                                                       \
+    op = GetBYTE_pp(pc);                                  \
+    goto *opcodeTable[op];                                \
+  }                                                       \
+  break
+#else
+#define OPCODE(n) case n:
+#define NEXT_OPCODE break
+#endif
+
 // Branching
-#define Jpc(cond) pc = cond ? GetWORD(pc) : pc+2
+#define Jpc(cond)               \
+  do                            \
+  {                             \
+    if (cond)                   \
+    {                           \
+      temp = pc;                \
+      pc = GetWORD(pc);         \
+      if (pc < temp)            \
+        IDLE_LOOP_CHECK();      \
+    }                           \
+    else                        \
+      pc += 2;                  \
+  } while (0)
+
+#define JRc(cond)                       \
+  do                                    \
+  {                                     \
+    if (cond)                           \
+    {                                   \
+      temp = GetBYTE(pc);               \
+      pc += (signed char) temp + 1;     \
+      if (temp & 0x80)                  \
+        IDLE_LOOP_CHECK();              \
+    }                                   \
+    else                                \
+      ++pc;                             \
+  } while (0)
 
 #define CALLC(cond)                     \
   {                                     \
@@ -235,7 +377,9 @@ static const unsigned char cycleTables[5][256] = {
  Functions
 *******************************************************************************/
 
-int CZ80::Run(int numCycles)
+// Built with and without the per-instruction debugger hook (see Run())
+template <bool Debugging>
+int CZ80::RunCPU(int numCycles)
 {
 #ifdef SUPERMODEL_DEBUGGER
   // If debugging enabled, don't optimize access to registers as they need to be accesible to debugger during execution
@@ -262,6 +406,51 @@ int CZ80::Run(int numCycles)
   unsigned int cbits = 0;
   unsigned int op = 0;
   unsigned int adr = 0;
+  unsigned int port = 0;
+
+#ifdef Z80_IDLE_FASTFORWARD
+  unsigned int idleHead = ~0u;  // loop head reached by the last backward branch
+  int idleCycles = 0;           // cycles remaining when it was reached
+  bool idleDirty = true;        // side effects since then
+  unsigned int idleRegs[8] = {};  // register state at the loop head
+#endif
+
+#ifdef Z80_THREADED_DISPATCH
+  static const void * const opcodeTable[256] = {
+    &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+    &&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+    &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+    &&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+    &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+    &&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+    &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+    &&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+    &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+    &&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+    &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+    &&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+    &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+    &&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+    &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+    &&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+    &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+    &&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+    &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+    &&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+    &&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7,
+    &&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+    &&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7,
+    &&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+    &&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7,
+    &&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+    &&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7,
+    &&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_0xDD, &&op_0xDE, &&op_0xDF,
+    &&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7,
+    &&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_0xED, &&op_0xEE, &&op_0xEF,
+    &&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7,
+    &&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_0xFD, &&op_0xFE, &&op_0xFF
+  };
+#endif
 
   int cycles = numCycles;
 #ifdef SUPERMODEL_DEBUGGER
@@ -276,7 +465,7 @@ int CZ80::Run(int numCycles)
   {
   op = GetBYTE_pp(pc);
 #ifdef SUPERMODEL_DEBUGGER
-  if (Debug != NULL)
+  if (Debugging && Debug != NULL)
   {
     while (Debug->CPUExecute(pc - 1, op, lastCycles - cycles))
       op = GetBYTE_pp(pc);
@@ -284,56 +473,51 @@ int CZ80::Run(int numCycles)
   }
 #endif // SUPERMODEL_DEBUGGER
   switch(op) {
-  case 0x00:      /* NOP */
+  OPCODE(0x00)      /* NOP */
     cycles -= cycleTables[0][0x00];
-    break;
-  case 0x01:      /* LD BC,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0x01)      /* LD BC,nnnn */
     cycles -= cycleTables[0][0x01];
     BC = GetWORD(pc);
     pc += 2;
-    break;
-  case 0x02:      /* LD (BC),A */
+    NEXT_OPCODE;
+  OPCODE(0x02)      /* LD (BC),A */
     cycles -= cycleTables[0][0x02];
     PutBYTE(BC, hreg(AF));
-    break;
-  case 0x03:      /* INC BC */
+    NEXT_OPCODE;
+  OPCODE(0x03)      /* INC BC */
     cycles -= cycleTables[0][0x03];
     ++BC;
-    break;
-  case 0x04:      /* INC B */
+    NEXT_OPCODE;
+  OPCODE(0x04)      /* INC B */
     cycles -= cycleTables[0][0x04];
     BC += 0x100;
     temp = hreg(BC);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x05:      /* DEC B */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x05)      /* DEC B */
     cycles -= cycleTables[0][0x05];
     BC -= 0x100;
     temp = hreg(BC);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x06:      /* LD B,nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x06)      /* LD B,nn */
     cycles -= cycleTables[0][0x06];
     Sethreg(BC, GetBYTE_pp(pc));
-    break;
-  case 0x07:      /* RLCA */
+    NEXT_OPCODE;
+  OPCODE(0x07)      /* RLCA */
     cycles -= cycleTables[0][0x07];
     AF = ((AF >> 7) & 0x0128) | ((AF << 1) & ~0x1ff) |
       (AF & 0xc4) | ((AF >> 15) & 1);
-    break;
-  case 0x08:      /* EX AF,AF' */
+    NEXT_OPCODE;
+  OPCODE(0x08)      /* EX AF,AF' */
     cycles -= cycleTables[0][0x08];
+    IDLE_DIRTY();
     af[af_sel] = AF;
     af_sel = 1 - af_sel;
     AF = af[af_sel];
-    break;
-  case 0x09:      /* ADD HL,BC */
+    NEXT_OPCODE;
+  OPCODE(0x09)      /* ADD HL,BC */
     cycles -= cycleTables[0][0x09];
     HL &= 0xffff;
     BC &= 0xffff;
@@ -342,93 +526,81 @@ int CZ80::Run(int numCycles)
     HL = sum;
     AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0x0A:      /* LD A,(BC) */
+    NEXT_OPCODE;
+  OPCODE(0x0A)      /* LD A,(BC) */
     cycles -= cycleTables[0][0x0A];
     Sethreg(AF, GetBYTE(BC));
-    break;
-  case 0x0B:      /* DEC BC */
+    NEXT_OPCODE;
+  OPCODE(0x0B)      /* DEC BC */
     cycles -= cycleTables[0][0x0B];
     --BC;
-    break;
-  case 0x0C:      /* INC C */
+    NEXT_OPCODE;
+  OPCODE(0x0C)      /* INC C */
     cycles -= cycleTables[0][0x0C];
     temp = lreg(BC)+1;
     Setlreg(BC, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x0D:      /* DEC C */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x0D)      /* DEC C */
     cycles -= cycleTables[0][0x0D];
     temp = lreg(BC)-1;
     Setlreg(BC, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x0E:      /* LD C,nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x0E)      /* LD C,nn */
     cycles -= cycleTables[0][0x0E];
     Setlreg(BC, GetBYTE_pp(pc));
-    break;
-  case 0x0F:      /* RRCA */
+    NEXT_OPCODE;
+  OPCODE(0x0F)      /* RRCA */
     cycles -= cycleTables[0][0x0F];
     temp = hreg(AF);
     sum = temp >> 1;
     AF = ((temp & 1) << 15) | (sum << 8) |
       (sum & 0x28) | (AF & 0xc4) | (temp & 1);
-    break;
-  case 0x10:      /* DJNZ dd */
+    NEXT_OPCODE;
+  OPCODE(0x10)      /* DJNZ dd */
     cycles -= cycleTables[0][0x10];
     pc += ((BC -= 0x100) & 0xff00) ? (signed char) GetBYTE(pc) + 1 : 1;
-    break;
-  case 0x11:      /* LD DE,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0x11)      /* LD DE,nnnn */
     cycles -= cycleTables[0][0x11];
     DE = GetWORD(pc);
     pc += 2;
-    break;
-  case 0x12:      /* LD (DE),A */
+    NEXT_OPCODE;
+  OPCODE(0x12)      /* LD (DE),A */
     cycles -= cycleTables[0][0x12];
     PutBYTE(DE, hreg(AF));
-    break;
-  case 0x13:      /* INC DE */
+    NEXT_OPCODE;
+  OPCODE(0x13)      /* INC DE */
     cycles -= cycleTables[0][0x13];
     ++DE;
-    break;
-  case 0x14:      /* INC D */
+    NEXT_OPCODE;
+  OPCODE(0x14)      /* INC D */
     cycles -= cycleTables[0][0x14];
     DE += 0x100;
     temp = hreg(DE);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x15:      /* DEC D */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x15)      /* DEC D */
     cycles -= cycleTables[0][0x15];
     DE -= 0x100;
     temp = hreg(DE);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x16:      /* LD D,nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x16)      /* LD D,nn */
     cycles -= cycleTables[0][0x16];
     Sethreg(DE, GetBYTE_pp(pc));
-    break;
-  case 0x17:      /* RLA */
+    NEXT_OPCODE;
+  OPCODE(0x17)      /* RLA */
     cycles -= cycleTables[0][0x17];
     AF = ((AF << 8) & 0x0100) | ((AF >> 7) & 0x28) | ((AF << 1) & ~0x01ff) |
       (AF & 0xc4) | ((AF >> 15) & 1);
-    break;
-  case 0x18:      /* JR dd */
+    NEXT_OPCODE;
+  OPCODE(0x18)      /* JR dd */
     cycles -= cycleTables[0][0x18];
-    pc += (1) ? (signed char) GetBYTE(pc) + 1 : 1;
-    break;
-  case 0x19:      /* ADD HL,DE */
+    JRc(1);
+    NEXT_OPCODE;
+  OPCODE(0x19)      /* ADD HL,DE */
     cycles -= cycleTables[0][0x19];
     HL &= 0xffff;
     DE &= 0xffff;
@@ -437,86 +609,74 @@ int CZ80::Run(int numCycles)
     HL = sum;
     AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0x1A:      /* LD A,(DE) */
+    NEXT_OPCODE;
+  OPCODE(0x1A)      /* LD A,(DE) */
     cycles -= cycleTables[0][0x1A];
     Sethreg(AF, GetBYTE(DE));
-    break;
-  case 0x1B:      /* DEC DE */
+    NEXT_OPCODE;
+  OPCODE(0x1B)      /* DEC DE */
     cycles -= cycleTables[0][0x1B];
     --DE;
-    break;
-  case 0x1C:      /* INC E */
+    NEXT_OPCODE;
+  OPCODE(0x1C)      /* INC E */
     cycles -= cycleTables[0][0x1C];
     temp = lreg(DE)+1;
     Setlreg(DE, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x1D:      /* DEC E */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x1D)      /* DEC E */
     cycles -= cycleTables[0][0x1D];
     temp = lreg(DE)-1;
     Setlreg(DE, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x1E:      /* LD E,nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x1E)      /* LD E,nn */
     cycles -= cycleTables[0][0x1E];
     Setlreg(DE, GetBYTE_pp(pc));
-    break;
-  case 0x1F:      /* RRA */
+    NEXT_OPCODE;
+  OPCODE(0x1F)      /* RRA */
     cycles -= cycleTables[0][0x1F];
     temp = hreg(AF);
     sum = temp >> 1;
     AF = ((AF & 1) << 15) | (sum << 8) |
       (sum & 0x28) | (AF & 0xc4) | (temp & 1);
-    break;
-  case 0x20:      /* JR NZ,dd */
+    NEXT_OPCODE;
+  OPCODE(0x20)      /* JR NZ,dd */
     cycles -= cycleTables[0][0x20];
-    pc += (!TSTFLAG(Z)) ? (signed char) GetBYTE(pc) + 1 : 1;
-    break;
-  case 0x21:      /* LD HL,nnnn */
+    JRc(!TSTFLAG(Z));
+    NEXT_OPCODE;
+  OPCODE(0x21)      /* LD HL,nnnn */
     cycles -= cycleTables[0][0x21];
     HL = GetWORD(pc);
     pc += 2;
-    break;
-  case 0x22:      /* LD (nnnn),HL */
+    NEXT_OPCODE;
+  OPCODE(0x22)      /* LD (nnnn),HL */
     cycles -= cycleTables[0][0x22];
     temp = GetWORD(pc);
     PutWORD(temp, HL);
     pc += 2;
-    break;
-  case 0x23:      /* INC HL */
+    NEXT_OPCODE;
+  OPCODE(0x23)      /* INC HL */
     cycles -= cycleTables[0][0x23];
     ++HL;
-    break;
-  case 0x24:      /* INC H */
+    NEXT_OPCODE;
+  OPCODE(0x24)      /* INC H */
     cycles -= cycleTables[0][0x24];
     HL += 0x100;
     temp = hreg(HL);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x25:      /* DEC H */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x25)      /* DEC H */
     cycles -= cycleTables[0][0x25];
     HL -= 0x100;
     temp = hreg(HL);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x26:      /* LD H,nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x26)      /* LD H,nn */
     cycles -= cycleTables[0][0x26];
     Sethreg(HL, GetBYTE_pp(pc));
-    break;
-  case 0x27:      /* DAA */
+    NEXT_OPCODE;
+  OPCODE(0x27)      /* DAA */
     cycles -= cycleTables[0][0x27];
     acu = hreg(AF);
     temp = ldig(acu);
@@ -544,12 +704,12 @@ int CZ80::Run(int numCycles)
     acu &= 0xff;
     AF = (acu << 8) | (acu & 0xa8) | ((acu == 0) << 6) |
       (AF & 0x12) | partab[acu] | cbits;
-    break;
-  case 0x28:      /* JR Z,dd */
+    NEXT_OPCODE;
+  OPCODE(0x28)      /* JR Z,dd */
     cycles -= cycleTables[0][0x28];
-    pc += (TSTFLAG(Z)) ? (signed char) GetBYTE(pc) + 1 : 1;
-    break;
-  case 0x29:      /* ADD HL,HL */
+    JRc(TSTFLAG(Z));
+    NEXT_OPCODE;
+  OPCODE(0x29)      /* ADD HL,HL */
     cycles -= cycleTables[0][0x29];
     HL &= 0xffff;
     sum = HL + HL;
@@ -557,93 +717,81 @@ int CZ80::Run(int numCycles)
     HL = sum;
     AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0x2A:      /* LD HL,(nnnn) */
+    NEXT_OPCODE;
+  OPCODE(0x2A)      /* LD HL,(nnnn) */
     cycles -= cycleTables[0][0x2A];
     temp = GetWORD(pc);
     HL = GetWORD(temp);
     pc += 2;
-    break;
-  case 0x2B:      /* DEC HL */
+    NEXT_OPCODE;
+  OPCODE(0x2B)      /* DEC HL */
     cycles -= cycleTables[0][0x2B];
     --HL;
-    break;
-  case 0x2C:      /* INC L */
+    NEXT_OPCODE;
+  OPCODE(0x2C)      /* INC L */
     cycles -= cycleTables[0][0x2C];
     temp = lreg(HL)+1;
     Setlreg(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x2D:      /* DEC L */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x2D)      /* DEC L */
     cycles -= cycleTables[0][0x2D];
     temp = lreg(HL)-1;
     Setlreg(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x2E:      /* LD L,nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x2E)      /* LD L,nn */
     cycles -= cycleTables[0][0x2E];
     Setlreg(HL, GetBYTE_pp(pc));
-    break;
-  case 0x2F:      /* CPL */
+    NEXT_OPCODE;
+  OPCODE(0x2F)      /* CPL */
     cycles -= cycleTables[0][0x2F];
     AF = (~AF & ~0xff) | (AF & 0xc5) | ((~AF >> 8) & 0x28) | 0x12;
-    break;
-  case 0x30:      /* JR NC,dd */
+    NEXT_OPCODE;
+  OPCODE(0x30)      /* JR NC,dd */
     cycles -= cycleTables[0][0x30];
-    pc += (!TSTFLAG(C)) ? (signed char) GetBYTE(pc) + 1 : 1;
-    break;
-  case 0x31:      /* LD SP,nnnn */
+    JRc(!TSTFLAG(C));
+    NEXT_OPCODE;
+  OPCODE(0x31)      /* LD SP,nnnn */
     cycles -= cycleTables[0][0x31];
     SP = GetWORD(pc);
     pc += 2;
-    break;
-  case 0x32:      /* LD (nnnn),A */
+    NEXT_OPCODE;
+  OPCODE(0x32)      /* LD (nnnn),A */
     cycles -= cycleTables[0][0x32];
     temp = GetWORD(pc);
     PutBYTE(temp, hreg(AF));
     pc += 2;
-    break;
-  case 0x33:      /* INC SP */
+    NEXT_OPCODE;
+  OPCODE(0x33)      /* INC SP */
     cycles -= cycleTables[0][0x33];
     ++SP;
-    break;
-  case 0x34:      /* INC (HL) */
+    NEXT_OPCODE;
+  OPCODE(0x34)      /* INC (HL) */
     cycles -= cycleTables[0][0x34];
     temp = GetBYTE(HL)+1;
     PutBYTE(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x35:      /* DEC (HL) */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x35)      /* DEC (HL) */
     cycles -= cycleTables[0][0x35];
     temp = GetBYTE(HL)-1;
     PutBYTE(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x36:      /* LD (HL),nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x36)      /* LD (HL),nn */
     cycles -= cycleTables[0][0x36];
     PutBYTE(HL, GetBYTE_pp(pc));
-    break;
-  case 0x37:      /* SCF */
+    NEXT_OPCODE;
+  OPCODE(0x37)      /* SCF */
     cycles -= cycleTables[0][0x37];
     AF = (AF&~0x3b)|((AF>>8)&0x28)|1;
-    break;
-  case 0x38:      /* JR C,dd */
+    NEXT_OPCODE;
+  OPCODE(0x38)      /* JR C,dd */
     cycles -= cycleTables[0][0x38];
-    pc += (TSTFLAG(C)) ? (signed char) GetBYTE(pc) + 1 : 1;
-    break;
-  case 0x39:      /* ADD HL,SP */
+    JRc(TSTFLAG(C));
+    NEXT_OPCODE;
+  OPCODE(0x39)      /* ADD HL,SP */
     cycles -= cycleTables[0][0x39];
     HL &= 0xffff;
     SP &= 0xffff;
@@ -652,780 +800,734 @@ int CZ80::Run(int numCycles)
     HL = sum;
     AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0x3A:      /* LD A,(nnnn) */
+    NEXT_OPCODE;
+  OPCODE(0x3A)      /* LD A,(nnnn) */
     cycles -= cycleTables[0][0x3A];
     temp = GetWORD(pc);
     Sethreg(AF, GetBYTE(temp));
     pc += 2;
-    break;
-  case 0x3B:      /* DEC SP */
+    NEXT_OPCODE;
+  OPCODE(0x3B)      /* DEC SP */
     cycles -= cycleTables[0][0x3B];
     --SP;
-    break;
-  case 0x3C:      /* INC A */
+    NEXT_OPCODE;
+  OPCODE(0x3C)      /* INC A */
     cycles -= cycleTables[0][0x3C];
     AF += 0x100;
     temp = hreg(AF);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
-    break;
-  case 0x3D:      /* DEC A */
+    AF = (AF & ~0xfe) | incTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x3D)      /* DEC A */
     cycles -= cycleTables[0][0x3D];
     AF -= 0x100;
     temp = hreg(AF);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
-    break;
-  case 0x3E:      /* LD A,nn */
+    AF = (AF & ~0xfe) | decTable[temp & 0xff];
+    NEXT_OPCODE;
+  OPCODE(0x3E)      /* LD A,nn */
     cycles -= cycleTables[0][0x3E];
     Sethreg(AF, GetBYTE_pp(pc));
-    break;
-  case 0x3F:      /* CCF */
+    NEXT_OPCODE;
+  OPCODE(0x3F)      /* CCF */
     cycles -= cycleTables[0][0x3F];
     AF = (AF&~0x3b)|((AF>>8)&0x28)|((AF&1)<<4)|(~AF&1);
-    break;
-  case 0x40:      /* LD B,B */
+    NEXT_OPCODE;
+  OPCODE(0x40)      /* LD B,B */
     cycles -= cycleTables[0][0x40];
     /* nop */
-    break;
-  case 0x41:      /* LD B,C */
+    NEXT_OPCODE;
+  OPCODE(0x41)      /* LD B,C */
     cycles -= cycleTables[0][0x41];
     BC = (BC & 255) | ((BC & 255) << 8);
-    break;
-  case 0x42:      /* LD B,D */
+    NEXT_OPCODE;
+  OPCODE(0x42)      /* LD B,D */
     cycles -= cycleTables[0][0x42];
     BC = (BC & 255) | (DE & ~255);
-    break;
-  case 0x43:      /* LD B,E */
+    NEXT_OPCODE;
+  OPCODE(0x43)      /* LD B,E */
     cycles -= cycleTables[0][0x43];
     BC = (BC & 255) | ((DE & 255) << 8);
-    break;
-  case 0x44:      /* LD B,H */
+    NEXT_OPCODE;
+  OPCODE(0x44)      /* LD B,H */
     cycles -= cycleTables[0][0x44];
     BC = (BC & 255) | (HL & ~255);
-    break;
-  case 0x45:      /* LD B,L */
+    NEXT_OPCODE;
+  OPCODE(0x45)      /* LD B,L */
     cycles -= cycleTables[0][0x45];
     BC = (BC & 255) | ((HL & 255) << 8);
-    break;
-  case 0x46:      /* LD B,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x46)      /* LD B,(HL) */
     cycles -= cycleTables[0][0x46];
     Sethreg(BC, GetBYTE(HL));
-    break;
-  case 0x47:      /* LD B,A */
+    NEXT_OPCODE;
+  OPCODE(0x47)      /* LD B,A */
     cycles -= cycleTables[0][0x47];
     BC = (BC & 255) | (AF & ~255);
-    break;
-  case 0x48:      /* LD C,B */
+    NEXT_OPCODE;
+  OPCODE(0x48)      /* LD C,B */
     cycles -= cycleTables[0][0x48];
     BC = (BC & ~255) | ((BC >> 8) & 255);
-    break;
-  case 0x49:      /* LD C,C */
+    NEXT_OPCODE;
+  OPCODE(0x49)      /* LD C,C */
     cycles -= cycleTables[0][0x49];
     /* nop */
-    break;
-  case 0x4A:      /* LD C,D */
+    NEXT_OPCODE;
+  OPCODE(0x4A)      /* LD C,D */
     cycles -= cycleTables[0][0x4A];
     BC = (BC & ~255) | ((DE >> 8) & 255);
-    break;
-  case 0x4B:      /* LD C,E */
+    NEXT_OPCODE;
+  OPCODE(0x4B)      /* LD C,E */
     cycles -= cycleTables[0][0x4B];
     BC = (BC & ~255) | (DE & 255);
-    break;
-  case 0x4C:      /* LD C,H */
+    NEXT_OPCODE;
+  OPCODE(0x4C)      /* LD C,H */
     cycles -= cycleTables[0][0x4C];
     BC = (BC & ~255) | ((HL >> 8) & 255);
-    break;
-  case 0x4D:      /* LD C,L */
+    NEXT_OPCODE;
+  OPCODE(0x4D)      /* LD C,L */
     cycles -= cycleTables[0][0x4D];
     BC = (BC & ~255) | (HL & 255);
-    break;
-  case 0x4E:      /* LD C,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x4E)      /* LD C,(HL) */
     cycles -= cycleTables[0][0x4E];
     Setlreg(BC, GetBYTE(HL));
-    break;
-  case 0x4F:      /* LD C,A */
+    NEXT_OPCODE;
+  OPCODE(0x4F)      /* LD C,A */
     cycles -= cycleTables[0][0x4F];
     BC = (BC & ~255) | ((AF >> 8) & 255);
-    break;
-  case 0x50:      /* LD D,B */
+    NEXT_OPCODE;
+  OPCODE(0x50)      /* LD D,B */
     cycles -= cycleTables[0][0x50];
     DE = (DE & 255) | (BC & ~255);
-    break;
-  case 0x51:      /* LD D,C */
+    NEXT_OPCODE;
+  OPCODE(0x51)      /* LD D,C */
     cycles -= cycleTables[0][0x51];
     DE = (DE & 255) | ((BC & 255) << 8);
-    break;
-  case 0x52:      /* LD D,D */
+    NEXT_OPCODE;
+  OPCODE(0x52)      /* LD D,D */
     cycles -= cycleTables[0][0x52];
     /* nop */
-    break;
-  case 0x53:      /* LD D,E */
+    NEXT_OPCODE;
+  OPCODE(0x53)      /* LD D,E */
     cycles -= cycleTables[0][0x53];
     DE = (DE & 255) | ((DE & 255) << 8);
-    break;
-  case 0x54:      /* LD D,H */
+    NEXT_OPCODE;
+  OPCODE(0x54)      /* LD D,H */
     cycles -= cycleTables[0][0x54];
     DE = (DE & 255) | (HL & ~255);
-    break;
-  case 0x55:      /* LD D,L */
+    NEXT_OPCODE;
+  OPCODE(0x55)      /* LD D,L */
     cycles -= cycleTables[0][0x55];
     DE = (DE & 255) | ((HL & 255) << 8);
-    break;
-  case 0x56:      /* LD D,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x56)      /* LD D,(HL) */
     cycles -= cycleTables[0][0x56];
     Sethreg(DE, GetBYTE(HL));
-    break;
-  case 0x57:      /* LD D,A */
+    NEXT_OPCODE;
+  OPCODE(0x57)      /* LD D,A */
     cycles -= cycleTables[0][0x57];
     DE = (DE & 255) | (AF & ~255);
-    break;
-  case 0x58:      /* LD E,B */
+    NEXT_OPCODE;
+  OPCODE(0x58)      /* LD E,B */
     cycles -= cycleTables[0][0x58];
     DE = (DE & ~255) | ((BC >> 8) & 255);
-    break;
-  case 0x59:      /* LD E,C */
+    NEXT_OPCODE;
+  OPCODE(0x59)      /* LD E,C */
     cycles -= cycleTables[0][0x59];
     DE = (DE & ~255) | (BC & 255);
-    break;
-  case 0x5A:      /* LD E,D */
+    NEXT_OPCODE;
+  OPCODE(0x5A)      /* LD E,D */
     cycles -= cycleTables[0][0x5A];
     DE = (DE & ~255) | ((DE >> 8) & 255);
-    break;
-  case 0x5B:      /* LD E,E */
+    NEXT_OPCODE;
+  OPCODE(0x5B)      /* LD E,E */
     cycles -= cycleTables[0][0x5B];
     /* nop */
-    break;
-  case 0x5C:      /* LD E,H */
+    NEXT_OPCODE;
+  OPCODE(0x5C)      /* LD E,H */
     cycles -= cycleTables[0][0x5C];
     DE = (DE & ~255) | ((HL >> 8) & 255);
-    break;
-  case 0x5D:      /* LD E,L */
+    NEXT_OPCODE;
+  OPCODE(0x5D)      /* LD E,L */
     cycles -= cycleTables[0][0x5D];
     DE = (DE & ~255) | (HL & 255);
-    break;
-  case 0x5E:      /* LD E,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x5E)      /* LD E,(HL) */
     cycles -= cycleTables[0][0x5E];
     Setlreg(DE, GetBYTE(HL));
-    break;
-  case 0x5F:      /* LD E,A */
+    NEXT_OPCODE;
+  OPCODE(0x5F)      /* LD E,A */
     cycles -= cycleTables[0][0x5F];
     DE = (DE & ~255) | ((AF >> 8) & 255);
-    break;
-  case 0x60:      /* LD H,B */
+    NEXT_OPCODE;
+  OPCODE(0x60)      /* LD H,B */
     cycles -= cycleTables[0][0x60];
     HL = (HL & 255) | (BC & ~255);
-    break;
-  case 0x61:      /* LD H,C */
+    NEXT_OPCODE;
+  OPCODE(0x61)      /* LD H,C */
     cycles -= cycleTables[0][0x61];
     HL = (HL & 255) | ((BC & 255) << 8);
-    break;
-  case 0x62:      /* LD H,D */
+    NEXT_OPCODE;
+  OPCODE(0x62)      /* LD H,D */
     cycles -= cycleTables[0][0x62];
     HL = (HL & 255) | (DE & ~255);
-    break;
-  case 0x63:      /* LD H,E */
+    NEXT_OPCODE;
+  OPCODE(0x63)      /* LD H,E */
     cycles -= cycleTables[0][0x63];
     HL = (HL & 255) | ((DE & 255) << 8);
-    break;
-  case 0x64:      /* LD H,H */
+    NEXT_OPCODE;
+  OPCODE(0x64)      /* LD H,H */
     cycles -= cycleTables[0][0x64];
     /* nop */
-    break;
-  case 0x65:      /* LD H,L */
+    NEXT_OPCODE;
+  OPCODE(0x65)      /* LD H,L */
     cycles -= cycleTables[0][0x65];
     HL = (HL & 255) | ((HL & 255) << 8);
-    break;
-  case 0x66:      /* LD H,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x66)      /* LD H,(HL) */
     cycles -= cycleTables[0][0x66];
     Sethreg(HL, GetBYTE(HL));
-    break;
-  case 0x67:      /* LD H,A */
+    NEXT_OPCODE;
+  OPCODE(0x67)      /* LD H,A */
     cycles -= cycleTables[0][0x67];
     HL = (HL & 255) | (AF & ~255);
-    break;
-  case 0x68:      /* LD L,B */
+    NEXT_OPCODE;
+  OPCODE(0x68)      /* LD L,B */
     cycles -= cycleTables[0][0x68];
     HL = (HL & ~255) | ((BC >> 8) & 255);
-    break;
-  case 0x69:      /* LD L,C */
+    NEXT_OPCODE;
+  OPCODE(0x69)      /* LD L,C */
     cycles -= cycleTables[0][0x69];
     HL = (HL & ~255) | (BC & 255);
-    break;
-  case 0x6A:      /* LD L,D */
+    NEXT_OPCODE;
+  OPCODE(0x6A)      /* LD L,D */
     cycles -= cycleTables[0][0x6A];
     HL = (HL & ~255) | ((DE >> 8) & 255);
-    break;
-  case 0x6B:      /* LD L,E */
+    NEXT_OPCODE;
+  OPCODE(0x6B)      /* LD L,E */
     cycles -= cycleTables[0][0x6B];
     HL = (HL & ~255) | (DE & 255);
-    break;
-  case 0x6C:      /* LD L,H */
+    NEXT_OPCODE;
+  OPCODE(0x6C)      /* LD L,H */
     cycles -= cycleTables[0][0x6C];
     HL = (HL & ~255) | ((HL >> 8) & 255);
-    break;
-  case 0x6D:      /* LD L,L */
+    NEXT_OPCODE;
+  OPCODE(0x6D)      /* LD L,L */
     cycles -= cycleTables[0][0x6D];
     /* nop */
-    break;
-  case 0x6E:      /* LD L,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x6E)      /* LD L,(HL) */
     cycles -= cycleTables[0][0x6E];
     Setlreg(HL, GetBYTE(HL));
-    break;
-  case 0x6F:      /* LD L,A */
+    NEXT_OPCODE;
+  OPCODE(0x6F)      /* LD L,A */
     cycles -= cycleTables[0][0x6F];
     HL = (HL & ~255) | ((AF >> 8) & 255);
-    break;
-  case 0x70:      /* LD (HL),B */
+    NEXT_OPCODE;
+  OPCODE(0x70)      /* LD (HL),B */
     cycles -= cycleTables[0][0x70];
     PutBYTE(HL, hreg(BC));
-    break;
-  case 0x71:      /* LD (HL),C */
+    NEXT_OPCODE;
+  OPCODE(0x71)      /* LD (HL),C */
     cycles -= cycleTables[0][0x71];
     PutBYTE(HL, lreg(BC));
-    break;
-  case 0x72:      /* LD (HL),D */
+    NEXT_OPCODE;
+  OPCODE(0x72)      /* LD (HL),D */
     cycles -= cycleTables[0][0x72];
     PutBYTE(HL, hreg(DE));
-    break;
-  case 0x73:      /* LD (HL),E */
+    NEXT_OPCODE;
+  OPCODE(0x73)      /* LD (HL),E */
     cycles -= cycleTables[0][0x73];
     PutBYTE(HL, lreg(DE));
-    break;
-  case 0x74:      /* LD (HL),H */
+    NEXT_OPCODE;
+  OPCODE(0x74)      /* LD (HL),H */
     cycles -= cycleTables[0][0x74];
     PutBYTE(HL, hreg(HL));
-    break;
-  case 0x75:      /* LD (HL),L */
+    NEXT_OPCODE;
+  OPCODE(0x75)      /* LD (HL),L */
     cycles -= cycleTables[0][0x75];
     PutBYTE(HL, lreg(HL));
-    break;
-  case 0x76:      /* HALT */
+    NEXT_OPCODE;
+  OPCODE(0x76)      /* HALT */
     cycles -= cycleTables[0][0x76];
 //    ErrorLog("Z80 encountered an unemulated instruction at 0x%04X", (pc-1)&0xFFFF);
     goto HALTExit;
-  case 0x77:      /* LD (HL),A */
+  OPCODE(0x77)      /* LD (HL),A */
     cycles -= cycleTables[0][0x77];
     PutBYTE(HL, hreg(AF));
-    break;
-  case 0x78:      /* LD A,B */
+    NEXT_OPCODE;
+  OPCODE(0x78)      /* LD A,B */
     cycles -= cycleTables[0][0x78];
     AF = (AF & 255) | (BC & ~255);
-    break;
-  case 0x79:      /* LD A,C */
+    NEXT_OPCODE;
+  OPCODE(0x79)      /* LD A,C */
     cycles -= cycleTables[0][0x79];
     AF = (AF & 255) | ((BC & 255) << 8);
-    break;
-  case 0x7A:      /* LD A,D */
+    NEXT_OPCODE;
+  OPCODE(0x7A)      /* LD A,D */
     cycles -= cycleTables[0][0x7A];
     AF = (AF & 255) | (DE & ~255);
-    break;
-  case 0x7B:      /* LD A,E */
+    NEXT_OPCODE;
+  OPCODE(0x7B)      /* LD A,E */
     cycles -= cycleTables[0][0x7B];
     AF = (AF & 255) | ((DE & 255) << 8);
-    break;
-  case 0x7C:      /* LD A,H */
+    NEXT_OPCODE;
+  OPCODE(0x7C)      /* LD A,H */
     cycles -= cycleTables[0][0x7C];
     AF = (AF & 255) | (HL & ~255);
-    break;
-  case 0x7D:      /* LD A,L */
+    NEXT_OPCODE;
+  OPCODE(0x7D)      /* LD A,L */
     cycles -= cycleTables[0][0x7D];
     AF = (AF & 255) | ((HL & 255) << 8);
-    break;
-  case 0x7E:      /* LD A,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x7E)      /* LD A,(HL) */
     cycles -= cycleTables[0][0x7E];
     Sethreg(AF, GetBYTE(HL));
-    break;
-  case 0x7F:      /* LD A,A */
+    NEXT_OPCODE;
+  OPCODE(0x7F)      /* LD A,A */
     cycles -= cycleTables[0][0x7F];
     /* nop */
-    break;
-  case 0x80:      /* ADD A,B */
+    NEXT_OPCODE;
+  OPCODE(0x80)      /* ADD A,B */
     cycles -= cycleTables[0][0x80];
     temp = hreg(BC);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x81:      /* ADD A,C */
+    NEXT_OPCODE;
+  OPCODE(0x81)      /* ADD A,C */
     cycles -= cycleTables[0][0x81];
     temp = lreg(BC);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x82:      /* ADD A,D */
+    NEXT_OPCODE;
+  OPCODE(0x82)      /* ADD A,D */
     cycles -= cycleTables[0][0x82];
     temp = hreg(DE);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x83:      /* ADD A,E */
+    NEXT_OPCODE;
+  OPCODE(0x83)      /* ADD A,E */
     cycles -= cycleTables[0][0x83];
     temp = lreg(DE);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x84:      /* ADD A,H */
+    NEXT_OPCODE;
+  OPCODE(0x84)      /* ADD A,H */
     cycles -= cycleTables[0][0x84];
     temp = hreg(HL);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x85:      /* ADD A,L */
+    NEXT_OPCODE;
+  OPCODE(0x85)      /* ADD A,L */
     cycles -= cycleTables[0][0x85];
     temp = lreg(HL);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x86:      /* ADD A,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x86)      /* ADD A,(HL) */
     cycles -= cycleTables[0][0x86];
     temp = GetBYTE(HL);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x87:      /* ADD A,A */
+    NEXT_OPCODE;
+  OPCODE(0x87)      /* ADD A,A */
     cycles -= cycleTables[0][0x87];
     temp = hreg(AF);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x88:      /* ADC A,B */
+    NEXT_OPCODE;
+  OPCODE(0x88)      /* ADC A,B */
     cycles -= cycleTables[0][0x88];
     temp = hreg(BC);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x89:      /* ADC A,C */
+    NEXT_OPCODE;
+  OPCODE(0x89)      /* ADC A,C */
     cycles -= cycleTables[0][0x89];
     temp = lreg(BC);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x8A:      /* ADC A,D */
+    NEXT_OPCODE;
+  OPCODE(0x8A)      /* ADC A,D */
     cycles -= cycleTables[0][0x8A];
     temp = hreg(DE);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x8B:      /* ADC A,E */
+    NEXT_OPCODE;
+  OPCODE(0x8B)      /* ADC A,E */
     cycles -= cycleTables[0][0x8B];
     temp = lreg(DE);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x8C:      /* ADC A,H */
+    NEXT_OPCODE;
+  OPCODE(0x8C)      /* ADC A,H */
     cycles -= cycleTables[0][0x8C];
     temp = hreg(HL);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x8D:      /* ADC A,L */
+    NEXT_OPCODE;
+  OPCODE(0x8D)      /* ADC A,L */
     cycles -= cycleTables[0][0x8D];
     temp = lreg(HL);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x8E:      /* ADC A,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x8E)      /* ADC A,(HL) */
     cycles -= cycleTables[0][0x8E];
     temp = GetBYTE(HL);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x8F:      /* ADC A,A */
+    NEXT_OPCODE;
+  OPCODE(0x8F)      /* ADC A,A */
     cycles -= cycleTables[0][0x8F];
     temp = hreg(AF);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0x90:      /* SUB B */
+    NEXT_OPCODE;
+  OPCODE(0x90)      /* SUB B */
     cycles -= cycleTables[0][0x90];
     temp = hreg(BC);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x91:      /* SUB C */
+    NEXT_OPCODE;
+  OPCODE(0x91)      /* SUB C */
     cycles -= cycleTables[0][0x91];
     temp = lreg(BC);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x92:      /* SUB D */
+    NEXT_OPCODE;
+  OPCODE(0x92)      /* SUB D */
     cycles -= cycleTables[0][0x92];
     temp = hreg(DE);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x93:      /* SUB E */
+    NEXT_OPCODE;
+  OPCODE(0x93)      /* SUB E */
     cycles -= cycleTables[0][0x93];
     temp = lreg(DE);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x94:      /* SUB H */
+    NEXT_OPCODE;
+  OPCODE(0x94)      /* SUB H */
     cycles -= cycleTables[0][0x94];
     temp = hreg(HL);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x95:      /* SUB L */
+    NEXT_OPCODE;
+  OPCODE(0x95)      /* SUB L */
     cycles -= cycleTables[0][0x95];
     temp = lreg(HL);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x96:      /* SUB (HL) */
+    NEXT_OPCODE;
+  OPCODE(0x96)      /* SUB (HL) */
     cycles -= cycleTables[0][0x96];
     temp = GetBYTE(HL);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x97:      /* SUB A */
+    NEXT_OPCODE;
+  OPCODE(0x97)      /* SUB A */
     cycles -= cycleTables[0][0x97];
     temp = hreg(AF);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x98:      /* SBC A,B */
+    NEXT_OPCODE;
+  OPCODE(0x98)      /* SBC A,B */
     cycles -= cycleTables[0][0x98];
     temp = hreg(BC);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x99:      /* SBC A,C */
+    NEXT_OPCODE;
+  OPCODE(0x99)      /* SBC A,C */
     cycles -= cycleTables[0][0x99];
     temp = lreg(BC);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x9A:      /* SBC A,D */
+    NEXT_OPCODE;
+  OPCODE(0x9A)      /* SBC A,D */
     cycles -= cycleTables[0][0x9A];
     temp = hreg(DE);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x9B:      /* SBC A,E */
+    NEXT_OPCODE;
+  OPCODE(0x9B)      /* SBC A,E */
     cycles -= cycleTables[0][0x9B];
     temp = lreg(DE);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x9C:      /* SBC A,H */
+    NEXT_OPCODE;
+  OPCODE(0x9C)      /* SBC A,H */
     cycles -= cycleTables[0][0x9C];
     temp = hreg(HL);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x9D:      /* SBC A,L */
+    NEXT_OPCODE;
+  OPCODE(0x9D)      /* SBC A,L */
     cycles -= cycleTables[0][0x9D];
     temp = lreg(HL);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x9E:      /* SBC A,(HL) */
+    NEXT_OPCODE;
+  OPCODE(0x9E)      /* SBC A,(HL) */
     cycles -= cycleTables[0][0x9E];
     temp = GetBYTE(HL);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0x9F:      /* SBC A,A */
+    NEXT_OPCODE;
+  OPCODE(0x9F)      /* SBC A,A */
     cycles -= cycleTables[0][0x9F];
     temp = hreg(AF);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0xA0:      /* AND B */
+    NEXT_OPCODE;
+  OPCODE(0xA0)      /* AND B */
     cycles -= cycleTables[0][0xA0];
     sum = ((AF & (BC)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
-    break;
-  case 0xA1:      /* AND C */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA1)      /* AND C */
     cycles -= cycleTables[0][0xA1];
     sum = ((AF >> 8) & BC) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xA2:      /* AND D */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA2)      /* AND D */
     cycles -= cycleTables[0][0xA2];
     sum = ((AF & (DE)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
-    break;
-  case 0xA3:      /* AND E */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA3)      /* AND E */
     cycles -= cycleTables[0][0xA3];
     sum = ((AF >> 8) & DE) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xA4:      /* AND H */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA4)      /* AND H */
     cycles -= cycleTables[0][0xA4];
     sum = ((AF & (HL)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
-    break;
-  case 0xA5:      /* AND L */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA5)      /* AND L */
     cycles -= cycleTables[0][0xA5];
     sum = ((AF >> 8) & HL) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xA6:      /* AND (HL) */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA6)      /* AND (HL) */
     cycles -= cycleTables[0][0xA6];
     sum = ((AF >> 8) & GetBYTE(HL)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xA7:      /* AND A */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA7)      /* AND A */
     cycles -= cycleTables[0][0xA7];
     sum = ((AF & (AF)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
-    break;
-  case 0xA8:      /* XOR B */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xA8)      /* XOR B */
     cycles -= cycleTables[0][0xA8];
     sum = ((AF ^ (BC)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xA9:      /* XOR C */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xA9)      /* XOR C */
     cycles -= cycleTables[0][0xA9];
     sum = ((AF >> 8) ^ BC) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xAA:      /* XOR D */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xAA)      /* XOR D */
     cycles -= cycleTables[0][0xAA];
     sum = ((AF ^ (DE)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xAB:      /* XOR E */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xAB)      /* XOR E */
     cycles -= cycleTables[0][0xAB];
     sum = ((AF >> 8) ^ DE) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xAC:      /* XOR H */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xAC)      /* XOR H */
     cycles -= cycleTables[0][0xAC];
     sum = ((AF ^ (HL)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xAD:      /* XOR L */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xAD)      /* XOR L */
     cycles -= cycleTables[0][0xAD];
     sum = ((AF >> 8) ^ HL) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xAE:      /* XOR (HL) */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xAE)      /* XOR (HL) */
     cycles -= cycleTables[0][0xAE];
     sum = ((AF >> 8) ^ GetBYTE(HL)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xAF:      /* XOR A */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xAF)      /* XOR A */
     cycles -= cycleTables[0][0xAF];
     sum = ((AF ^ (AF)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB0:      /* OR B */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB0)      /* OR B */
     cycles -= cycleTables[0][0xB0];
     sum = ((AF | (BC)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB1:      /* OR C */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB1)      /* OR C */
     cycles -= cycleTables[0][0xB1];
     sum = ((AF >> 8) | BC) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB2:      /* OR D */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB2)      /* OR D */
     cycles -= cycleTables[0][0xB2];
     sum = ((AF | (DE)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB3:      /* OR E */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB3)      /* OR E */
     cycles -= cycleTables[0][0xB3];
     sum = ((AF >> 8) | DE) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB4:      /* OR H */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB4)      /* OR H */
     cycles -= cycleTables[0][0xB4];
     sum = ((AF | (HL)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB5:      /* OR L */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB5)      /* OR L */
     cycles -= cycleTables[0][0xB5];
     sum = ((AF >> 8) | HL) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB6:      /* OR (HL) */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB6)      /* OR (HL) */
     cycles -= cycleTables[0][0xB6];
     sum = ((AF >> 8) | GetBYTE(HL)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB7:      /* OR A */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB7)      /* OR A */
     cycles -= cycleTables[0][0xB7];
     sum = ((AF | (AF)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xB8:      /* CP B */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xB8)      /* CP B */
     cycles -= cycleTables[0][0xB8];
     temp = hreg(BC);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1436,8 +1538,8 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xB9:      /* CP C */
+    NEXT_OPCODE;
+  OPCODE(0xB9)      /* CP C */
     cycles -= cycleTables[0][0xB9];
     temp = lreg(BC);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1448,8 +1550,8 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xBA:      /* CP D */
+    NEXT_OPCODE;
+  OPCODE(0xBA)      /* CP D */
     cycles -= cycleTables[0][0xBA];
     temp = hreg(DE);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1460,8 +1562,8 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xBB:      /* CP E */
+    NEXT_OPCODE;
+  OPCODE(0xBB)      /* CP E */
     cycles -= cycleTables[0][0xBB];
     temp = lreg(DE);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1472,8 +1574,8 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xBC:      /* CP H */
+    NEXT_OPCODE;
+  OPCODE(0xBC)      /* CP H */
     cycles -= cycleTables[0][0xBC];
     temp = hreg(HL);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1484,8 +1586,8 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xBD:      /* CP L */
+    NEXT_OPCODE;
+  OPCODE(0xBD)      /* CP L */
     cycles -= cycleTables[0][0xBD];
     temp = lreg(HL);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1496,8 +1598,8 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xBE:      /* CP (HL) */
+    NEXT_OPCODE;
+  OPCODE(0xBE)      /* CP (HL) */
     cycles -= cycleTables[0][0xBE];
     temp = GetBYTE(HL);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1508,8 +1610,8 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xBF:      /* CP A */
+    NEXT_OPCODE;
+  OPCODE(0xBF)      /* CP A */
     cycles -= cycleTables[0][0xBF];
     temp = hreg(AF);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -1520,59 +1622,58 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xC0:      /* RET NZ */
+    NEXT_OPCODE;
+  OPCODE(0xC0)      /* RET NZ */
     cycles -= cycleTables[0][0xC0];
     if (!TSTFLAG(Z)) POP(pc);
-    break;
-  case 0xC1:      /* POP BC */
+    NEXT_OPCODE;
+  OPCODE(0xC1)      /* POP BC */
     cycles -= cycleTables[0][0xC1];
     POP(BC);
-    break;
-  case 0xC2:      /* JP NZ,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xC2)      /* JP NZ,nnnn */
     cycles -= cycleTables[0][0xC2];
     Jpc(!TSTFLAG(Z));
-    break;
-  case 0xC3:      /* JP nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xC3)      /* JP nnnn */
     cycles -= cycleTables[0][0xC3];
     Jpc(1);
-    break;
-  case 0xC4:      /* CALL NZ,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xC4)      /* CALL NZ,nnnn */
     cycles -= cycleTables[0][0xC4];
     CALLC(!TSTFLAG(Z));
-    break;
-  case 0xC5:      /* PUSH BC */
+    NEXT_OPCODE;
+  OPCODE(0xC5)      /* PUSH BC */
     cycles -= cycleTables[0][0xC5];
     PUSH(BC);
-    break;
-  case 0xC6:      /* ADD A,nn */
+    NEXT_OPCODE;
+  OPCODE(0xC6)      /* ADD A,nn */
     cycles -= cycleTables[0][0xC6];
     temp = GetBYTE_pp(pc);
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0xC7:      /* RST 0 */
+    NEXT_OPCODE;
+  OPCODE(0xC7)      /* RST 0 */
     cycles -= cycleTables[0][0xC7];
     PUSH(pc); pc = 0;
-    break;
-  case 0xC8:      /* RET Z */
+    NEXT_OPCODE;
+  OPCODE(0xC8)      /* RET Z */
     cycles -= cycleTables[0][0xC8];
     if (TSTFLAG(Z)) POP(pc);
-    break;
-  case 0xC9:      /* RET */
+    NEXT_OPCODE;
+  OPCODE(0xC9)      /* RET */
     cycles -= cycleTables[0][0xC9];
     POP(pc);
-    break;
-  case 0xCA:      /* JP Z,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xCA)      /* JP Z,nnnn */
     cycles -= cycleTables[0][0xCA];
     Jpc(TSTFLAG(Z));
-    break;
-  case 0xCB:      /* CB prefix */
+    NEXT_OPCODE;
+  OPCODE(0xCB)      /* CB prefix */
     adr = HL;
     op = GetBYTE(pc);
     cycles -= cycleTables[1][op];
@@ -1653,75 +1754,74 @@ int CZ80::Run(int numCycles)
     case 6: PutBYTE(adr, temp);  break;
     case 7: Sethreg(AF, temp); break;
     }
-    break;
-  case 0xCC:      /* CALL Z,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xCC)      /* CALL Z,nnnn */
     cycles -= cycleTables[0][0xCC];
     CALLC(TSTFLAG(Z));
-    break;
-  case 0xCD:      /* CALL nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xCD)      /* CALL nnnn */
     cycles -= cycleTables[0][0xCD];
     CALLC(1);
-    break;
-  case 0xCE:      /* ADC A,nn */
+    NEXT_OPCODE;
+  OPCODE(0xCE)      /* ADC A,nn */
     cycles -= cycleTables[0][0xCE];
     temp = GetBYTE_pp(pc);
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) |
       ((cbits >> 8) & 1);
-    break;
-  case 0xCF:      /* RST 8 */
+    NEXT_OPCODE;
+  OPCODE(0xCF)      /* RST 8 */
     cycles -= cycleTables[0][0xCF];
     PUSH(pc); pc = 8;
-    break;
-  case 0xD0:      /* RET NC */
+    NEXT_OPCODE;
+  OPCODE(0xD0)      /* RET NC */
     cycles -= cycleTables[0][0xD0];
     if (!TSTFLAG(C)) POP(pc);
-    break;
-  case 0xD1:      /* POP DE */
+    NEXT_OPCODE;
+  OPCODE(0xD1)      /* POP DE */
     cycles -= cycleTables[0][0xD1];
     POP(DE);
-    break;
-  case 0xD2:      /* JP NC,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xD2)      /* JP NC,nnnn */
     cycles -= cycleTables[0][0xD2];
     Jpc(!TSTFLAG(C));
-    break;
-  case 0xD3:      /* OUT (nn),A */
+    NEXT_OPCODE;
+  OPCODE(0xD3)      /* OUT (nn),A */
     cycles -= cycleTables[0][0xD3];
     OUTPUT(GetBYTE_pp(pc), hreg(AF));
-    break;
-  case 0xD4:      /* CALL NC,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xD4)      /* CALL NC,nnnn */
     cycles -= cycleTables[0][0xD4];
     CALLC(!TSTFLAG(C));
-    break;
-  case 0xD5:      /* PUSH DE */
+    NEXT_OPCODE;
+  OPCODE(0xD5)      /* PUSH DE */
     cycles -= cycleTables[0][0xD5];
     PUSH(DE);
-    break;
-  case 0xD6:      /* SUB nn */
+    NEXT_OPCODE;
+  OPCODE(0xD6)      /* SUB nn */
     cycles -= cycleTables[0][0xD6];
     temp = GetBYTE_pp(pc);
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0xD7:      /* RST 10H */
+    NEXT_OPCODE;
+  OPCODE(0xD7)      /* RST 10H */
     cycles -= cycleTables[0][0xD7];
     PUSH(pc); pc = 0x10;
-    break;
-  case 0xD8:      /* RET C */
+    NEXT_OPCODE;
+  OPCODE(0xD8)      /* RET C */
     cycles -= cycleTables[0][0xD8];
     if (TSTFLAG(C)) POP(pc);
-    break;
-  case 0xD9:      /* EXX */
+    NEXT_OPCODE;
+  OPCODE(0xD9)      /* EXX */
     cycles -= cycleTables[0][0xD9];
+    IDLE_DIRTY();
     regs[regs_sel].bc = BC;
     regs[regs_sel].de = DE;
     regs[regs_sel].hl = HL;
@@ -1729,20 +1829,20 @@ int CZ80::Run(int numCycles)
     BC = regs[regs_sel].bc;
     DE = regs[regs_sel].de;
     HL = regs[regs_sel].hl;
-    break;
-  case 0xDA:      /* JP C,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xDA)      /* JP C,nnnn */
     cycles -= cycleTables[0][0xDA];
     Jpc(TSTFLAG(C));
-    break;
-  case 0xDB:      /* IN A,(nn) */
+    NEXT_OPCODE;
+  OPCODE(0xDB)      /* IN A,(nn) */
     cycles -= cycleTables[0][0xDB];
     Sethreg(AF, INPUT(GetBYTE_pp(pc)));
-    break;
-  case 0xDC:      /* CALL C,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xDC)      /* CALL C,nnnn */
     cycles -= cycleTables[0][0xDC];
     CALLC(TSTFLAG(C));
-    break;
-  case 0xDD:      /* DD prefix */
+    NEXT_OPCODE;
+  OPCODE(0xDD)      /* DD prefix */
     op = GetBYTE_pp(pc);
     switch (op) {
     case 0x09:      /* ADD IX,BC */
@@ -1784,19 +1884,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x24];
       IX += 0x100;
       temp = hreg(IX);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | incTable[temp & 0xff];
       break;
     case 0x25:      /* DEC IXH */
       cycles -= cycleTables[3][0x25];
       IX -= 0x100;
       temp = hreg(IX);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | decTable[temp & 0xff];
       break;
     case 0x26:      /* LD IXH,nn */
       cycles -= cycleTables[3][0x26];
@@ -1825,19 +1919,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x2C];
       temp = lreg(IX)+1;
       Setlreg(IX, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | incTable[temp & 0xff];
       break;
     case 0x2D:      /* DEC IXL */
       cycles -= cycleTables[3][0x2D];
       temp = lreg(IX)-1;
       Setlreg(IX, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | decTable[temp & 0xff];
       break;
     case 0x2E:      /* LD IXL,nn */
       cycles -= cycleTables[3][0x2E];
@@ -1848,20 +1936,14 @@ int CZ80::Run(int numCycles)
       adr = IX + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)+1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | incTable[temp & 0xff];
       break;
     case 0x35:      /* DEC (IX+dd) */
       cycles -= cycleTables[3][0x35];
       adr = IX + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)-1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | decTable[temp & 0xff];
       break;
     case 0x36:      /* LD (IX+dd),nn */
       cycles -= cycleTables[3][0x36];
@@ -2050,8 +2132,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -2061,8 +2142,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -2073,8 +2153,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -2084,8 +2163,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -2095,8 +2173,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -2107,8 +2184,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -2118,8 +2194,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -2129,8 +2204,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -2141,8 +2215,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -2152,8 +2225,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -2163,8 +2235,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -2175,61 +2246,57 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
     case 0xA4:      /* AND IXH */
       cycles -= cycleTables[3][0xA4];
       sum = ((AF & (IX)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) |
-        ((sum == 0) << 6) | 0x10 | partab[sum];
+      AF = (sum << 8) | szpTable[sum] | 0x10;
       break;
     case 0xA5:      /* AND IXL */
       cycles -= cycleTables[3][0xA5];
       sum = ((AF >> 8) & IX) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum] | 0x10;
       break;
     case 0xA6:      /* AND (IX+dd) */
       cycles -= cycleTables[3][0xA6];
       adr = IX + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) & GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum] | 0x10;
       break;
     case 0xAC:      /* XOR IXH */
       cycles -= cycleTables[3][0xAC];
       sum = ((AF ^ (IX)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xAD:      /* XOR IXL */
       cycles -= cycleTables[3][0xAD];
       sum = ((AF >> 8) ^ IX) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xAE:      /* XOR (IX+dd) */
       cycles -= cycleTables[3][0xAE];
       adr = IX + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) ^ GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xB4:      /* OR IXH */
       cycles -= cycleTables[3][0xB4];
       sum = ((AF | (IX)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xB5:      /* OR IXL */
       cycles -= cycleTables[3][0xB5];
       sum = ((AF >> 8) | IX) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xB6:      /* OR (IX+dd) */
       cycles -= cycleTables[3][0xB6];
       adr = IX + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) | GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xBC:      /* CP IXH */
       cycles -= cycleTables[3][0xBC];
@@ -2373,77 +2440,75 @@ int CZ80::Run(int numCycles)
       break;
     default: pc--;    /* ignore DD */
     }
-    break;
-  case 0xDE:      /* SBC A,nn */
+    NEXT_OPCODE;
+  OPCODE(0xDE)      /* SBC A,nn */
     cycles -= cycleTables[0][0xDE];
     temp = GetBYTE_pp(pc);
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+    AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       ((cbits >> 8) & 1);
-    break;
-  case 0xDF:      /* RST 18H */
+    NEXT_OPCODE;
+  OPCODE(0xDF)      /* RST 18H */
     cycles -= cycleTables[0][0xDF];
     PUSH(pc); pc = 0x18;
-    break;
-  case 0xE0:      /* RET PO */
+    NEXT_OPCODE;
+  OPCODE(0xE0)      /* RET PO */
     cycles -= cycleTables[0][0xE0];
     if (!TSTFLAG(P)) POP(pc);
-    break;
-  case 0xE1:      /* POP HL */
+    NEXT_OPCODE;
+  OPCODE(0xE1)      /* POP HL */
     cycles -= cycleTables[0][0xE1];
     POP(HL);
-    break;
-  case 0xE2:      /* JP PO,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xE2)      /* JP PO,nnnn */
     cycles -= cycleTables[0][0xE2];
     Jpc(!TSTFLAG(P));
-    break;
-  case 0xE3:      /* EX (SP),HL */
+    NEXT_OPCODE;
+  OPCODE(0xE3)      /* EX (SP),HL */
     cycles -= cycleTables[0][0xE3];
     temp = HL; POP(HL); PUSH(temp);
-    break;
-  case 0xE4:      /* CALL PO,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xE4)      /* CALL PO,nnnn */
     cycles -= cycleTables[0][0xE4];
     CALLC(!TSTFLAG(P));
-    break;
-  case 0xE5:      /* PUSH HL */
+    NEXT_OPCODE;
+  OPCODE(0xE5)      /* PUSH HL */
     cycles -= cycleTables[0][0xE5];
     PUSH(HL);
-    break;
-  case 0xE6:      /* AND nn */
+    NEXT_OPCODE;
+  OPCODE(0xE6)      /* AND nn */
     cycles -= cycleTables[0][0xE6];
     sum = ((AF >> 8) & GetBYTE_pp(pc)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xE7:      /* RST 20H */
+    AF = (sum << 8) | szpTable[sum] | 0x10;
+    NEXT_OPCODE;
+  OPCODE(0xE7)      /* RST 20H */
     cycles -= cycleTables[0][0xE7];
     PUSH(pc); pc = 0x20;
-    break;
-  case 0xE8:      /* RET PE */
+    NEXT_OPCODE;
+  OPCODE(0xE8)      /* RET PE */
     cycles -= cycleTables[0][0xE8];
     if (TSTFLAG(P)) POP(pc);
-    break;
-  case 0xE9:      /* JP (HL) */
+    NEXT_OPCODE;
+  OPCODE(0xE9)      /* JP (HL) */
     cycles -= cycleTables[0][0xE9];
     pc = HL;
-    break;
-  case 0xEA:      /* JP PE,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xEA)      /* JP PE,nnnn */
     cycles -= cycleTables[0][0xEA];
     Jpc(TSTFLAG(P));
-    break;
-  case 0xEB:      /* EX DE,HL */
+    NEXT_OPCODE;
+  OPCODE(0xEB)      /* EX DE,HL */
     cycles -= cycleTables[0][0xEB];
     temp = HL; HL = DE; DE = temp;
-    break;
-  case 0xEC:      /* CALL PE,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xEC)      /* CALL PE,nnnn */
     cycles -= cycleTables[0][0xEC];
     CALLC(TSTFLAG(P));
-    break;
-  case 0xED:      /* ED prefix */
+    NEXT_OPCODE;
+  OPCODE(0xED)      /* ED prefix */
     op = GetBYTE_pp(pc);
     switch (op) {
     case 0x40:      /* IN B,(C) */
@@ -2914,70 +2979,70 @@ int CZ80::Run(int numCycles)
       break;
     default: if (0x40 <= op && op <= 0x7f) pc--;    /* ignore ED */
     }
-    break;
-  case 0xEE:      /* XOR nn */
+    NEXT_OPCODE;
+  OPCODE(0xEE)      /* XOR nn */
     cycles -= cycleTables[0][0xEE];
     sum = ((AF >> 8) ^ GetBYTE_pp(pc)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xEF:      /* RST 28H */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xEF)      /* RST 28H */
     cycles -= cycleTables[0][0xEF];
     PUSH(pc); pc = 0x28;
-    break;
-  case 0xF0:      /* RET P */
+    NEXT_OPCODE;
+  OPCODE(0xF0)      /* RET P */
     cycles -= cycleTables[0][0xF0];
     if (!TSTFLAG(S)) POP(pc);
-    break;
-  case 0xF1:      /* POP AF */
+    NEXT_OPCODE;
+  OPCODE(0xF1)      /* POP AF */
     cycles -= cycleTables[0][0xF1];
     POP(AF);
-    break;
-  case 0xF2:      /* JP P,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xF2)      /* JP P,nnnn */
     cycles -= cycleTables[0][0xF2];
     Jpc(!TSTFLAG(S));
-    break;
-  case 0xF3:      /* DI */
+    NEXT_OPCODE;
+  OPCODE(0xF3)      /* DI */
     cycles -= cycleTables[0][0xF3];
     iff = 0;
-    break;
-  case 0xF4:      /* CALL P,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xF4)      /* CALL P,nnnn */
     cycles -= cycleTables[0][0xF4];
     CALLC(!TSTFLAG(S));
-    break;
-  case 0xF5:      /* PUSH AF */
+    NEXT_OPCODE;
+  OPCODE(0xF5)      /* PUSH AF */
     cycles -= cycleTables[0][0xF5];
     PUSH(AF);
-    break;
-  case 0xF6:      /* OR nn */
+    NEXT_OPCODE;
+  OPCODE(0xF6)      /* OR nn */
     cycles -= cycleTables[0][0xF6];
     sum = ((AF >> 8) | GetBYTE_pp(pc)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-    break;
-  case 0xF7:      /* RST 30H */
+    AF = (sum << 8) | szpTable[sum];
+    NEXT_OPCODE;
+  OPCODE(0xF7)      /* RST 30H */
     cycles -= cycleTables[0][0xF7];
     PUSH(pc); pc = 0x30;
-    break;
-  case 0xF8:      /* RET M */
+    NEXT_OPCODE;
+  OPCODE(0xF8)      /* RET M */
     cycles -= cycleTables[0][0xF8];
     if (TSTFLAG(S)) POP(pc);
-    break;
-  case 0xF9:      /* LD SP,HL */
+    NEXT_OPCODE;
+  OPCODE(0xF9)      /* LD SP,HL */
     cycles -= cycleTables[0][0xF9];
     SP = HL;
-    break;
-  case 0xFA:      /* JP M,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xFA)      /* JP M,nnnn */
     cycles -= cycleTables[0][0xFA];
     Jpc(TSTFLAG(S));
-    break;
-  case 0xFB:      /* EI */
+    NEXT_OPCODE;
+  OPCODE(0xFB)      /* EI */
     cycles -= cycleTables[0][0xFB];
     iff = 3;
-    break;
-  case 0xFC:      /* CALL M,nnnn */
+    NEXT_OPCODE;
+  OPCODE(0xFC)      /* CALL M,nnnn */
     cycles -= cycleTables[0][0xFC];
     CALLC(TSTFLAG(S));
-    break;
-  case 0xFD:      /* FD prefix */
+    NEXT_OPCODE;
+  OPCODE(0xFD)      /* FD prefix */
     op = GetBYTE_pp(pc);
     switch (op) {
     case 0x09:      /* ADD IY,BC */
@@ -3019,19 +3084,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x24];
       IY += 0x100;
       temp = hreg(IY);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | incTable[temp & 0xff];
       break;
     case 0x25:      /* DEC IYH */
       cycles -= cycleTables[3][0x25];
       IY -= 0x100;
       temp = hreg(IY);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | decTable[temp & 0xff];
       break;
     case 0x26:      /* LD IYH,nn */
       cycles -= cycleTables[3][0x26];
@@ -3060,19 +3119,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x2C];
       temp = lreg(IY)+1;
       Setlreg(IY, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | incTable[temp & 0xff];
       break;
     case 0x2D:      /* DEC IYL */
       cycles -= cycleTables[3][0x2D];
       temp = lreg(IY)-1;
       Setlreg(IY, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | decTable[temp & 0xff];
       break;
     case 0x2E:      /* LD IYL,nn */
       cycles -= cycleTables[3][0x2E];
@@ -3083,20 +3136,14 @@ int CZ80::Run(int numCycles)
       adr = IY + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)+1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | incTable[temp & 0xff];
       break;
     case 0x35:      /* DEC (IY+dd) */
       cycles -= cycleTables[3][0x35];
       adr = IY + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)-1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | decTable[temp & 0xff];
       break;
     case 0x36:      /* LD (IY+dd),nn */
       cycles -= cycleTables[3][0x36];
@@ -3285,8 +3332,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -3296,8 +3342,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -3308,8 +3353,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -3319,8 +3363,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -3330,8 +3373,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -3342,8 +3384,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) |
         ((cbits >> 8) & 1);
       break;
@@ -3353,8 +3394,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -3364,8 +3404,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -3376,8 +3415,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -3387,8 +3425,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -3398,8 +3435,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
@@ -3410,61 +3446,57 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
+      AF = ((sum & 0xff) << 8) | szTable[sum & 0xff] | (cbits & 0x10) |
         (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
         ((cbits >> 8) & 1);
       break;
     case 0xA4:      /* AND IYH */
       cycles -= cycleTables[3][0xA4];
       sum = ((AF & (IY)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) |
-        ((sum == 0) << 6) | 0x10 | partab[sum];
+      AF = (sum << 8) | szpTable[sum] | 0x10;
       break;
     case 0xA5:      /* AND IYL */
       cycles -= cycleTables[3][0xA5];
       sum = ((AF >> 8) & IY) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum] | 0x10;
       break;
     case 0xA6:      /* AND (IY+dd) */
       cycles -= cycleTables[3][0xA6];
       adr = IY + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) & GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum] | 0x10;
       break;
     case 0xAC:      /* XOR IYH */
       cycles -= cycleTables[3][0xAC];
       sum = ((AF ^ (IY)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xAD:      /* XOR IYL */
       cycles -= cycleTables[3][0xAD];
       sum = ((AF >> 8) ^ IY) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xAE:      /* XOR (IY+dd) */
       cycles -= cycleTables[3][0xAE];
       adr = IY + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) ^ GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xB4:      /* OR IYH */
       cycles -= cycleTables[3][0xB4];
       sum = ((AF | (IY)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xB5:      /* OR IYL */
       cycles -= cycleTables[3][0xB5];
       sum = ((AF >> 8) | IY) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xB6:      /* OR (IY+dd) */
       cycles -= cycleTables[3][0xB6];
       adr = IY + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) | GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | szpTable[sum];
       break;
     case 0xBC:      /* CP IYH */
       cycles -= cycleTables[3][0xBC];
@@ -3608,8 +3640,8 @@ int CZ80::Run(int numCycles)
       break;
     default: pc--;    /* ignore DD */
     }
-    break;
-  case 0xFE:      /* CP nn */
+    NEXT_OPCODE;
+  OPCODE(0xFE)      /* CP nn */
     cycles -= cycleTables[0][0xFE];
     temp = GetBYTE_pp(pc);
     AF = (AF & ~0x28) | (temp & 0x28);
@@ -3620,11 +3652,11 @@ int CZ80::Run(int numCycles)
       (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
       (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
       (cbits & 0x10) | ((cbits >> 8) & 1);
-    break;
-  case 0xFF:      /* RST 38H */
+    NEXT_OPCODE;
+  OPCODE(0xFF)      /* RST 38H */
     cycles -= cycleTables[0][0xFF];
     PUSH(pc); pc = 0x38;
-    break;
+    NEXT_OPCODE;
     }
     
   // Interrupts
@@ -3793,6 +3825,15 @@ HALTExit:
     return numCycles - cycles;
 }
 
+int CZ80::Run(int numCycles)
+{
+#ifdef SUPERMODEL_DEBUGGER
+  return (this->*m_run)(numCycles);
+#else
+  return RunCPU<false>(numCycles);
+#endif // SUPERMODEL_DEBUGGER
+}
+
 void CZ80::TriggerNMI(void)
 {
   nmiTrigger = true;
@@ -3808,6 +3849,12 @@ UINT16 CZ80::GetPC(void) const
   return pc;
 }
 
+void CZ80::AddPollPort(unsigned portNum)
+{
+  portNum &= 0xFF;
+  pollPorts[portNum>>5] |= 1 << (portNum&31);
+}
+
 #ifdef SUPERMODEL_DEBUGGER
 UINT8 CZ80::GetReg8(unsigned reg8)
 {
@@ -3987,6 +4034,7 @@ void CZ80::AttachDebugger(Debugger::CZ80Debug *DebugPtr)
     DetachDebugger();
   Debug = DebugPtr;
   Bus = Debug->AttachBus(Bus);
+  m_run = &CZ80::RunCPU<true>;
 }
 
 void CZ80::DetachDebugger()
@@ -3995,6 +4043,7 @@ void CZ80::DetachDebugger()
     return;
   Bus = Debug->DetachBus();
   Debug = NULL;
+  m_run = &CZ80::RunCPU<false>;
 }
 #endif //SUPERMODEL_DEBUGGER
 
@@ -4002,8 +4051,11 @@ CZ80::CZ80(void)
 {
   INTCallback = NULL; // so we can later check to see if one has been installed
   Bus = NULL;
+  for (int i = 0; i < 256/32; i++)
+    pollPorts[i] = 0;
 #ifdef SUPERMODEL_DEBUGGER
   Debug = NULL;
+  m_run = &CZ80::RunCPU<false>;
 #endif //SUPERMODEL_DEBUGGER
 }
 
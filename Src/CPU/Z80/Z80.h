@@ -36,6 +36,8 @@
  *    an improperly timed interrupt may occur right after an EI instruction
  *    but before the service routine has a chance to return.
  *  - HALT instruction is not implemented (it just exits).
+ *  - Idle loop fast-forwarding (see AddPollPort()) assumes that memory reads
+ *    have no side effects.
  *  - 16-bit words are read as two bytes but these reads may not occur in
  *    the exact same order as the real device. Needs to be checked.
  */
@@ -159,6 +161,20 @@ public:
    */
   UINT16 GetPC(void) const;
 
+  /*
+   * AddPollPort(portNum):
+   *
+   * Declares that reading the given I/O port has no side effects, so that
+   * a loop polling it (a status or command latch, for example) can be
+   * recognized as idle. Run() skips over idle loops until the end of the
+   * time slice or an interrupt. Reads of any other port are assumed to have
+   * side effects and prevent this.
+   *
+   * Parameters:
+   *    portNum Port number (0-255).
+   */
+  void AddPollPort(unsigned portNum);
+
 #ifdef SUPERMODEL_DEBUGGER
   /*
    * GetReg8(reg8):
@@ -330,9 +346,16 @@ private:
   bool  intLine;
   int   (*INTCallback)(CZ80 *Z80);
 
+  // Ports without read side effects (bit mask)
+  UINT32  pollPorts[256/32];
+
+  template <bool Debugging>
+  int RunCPU(int numCycles);
+
 #ifdef SUPERMODEL_DEBUGGER
   int   lastCycles;
   Debugger::CZ80Debug *Debug;
+  int   (CZ80::*m_run)(int numCycles);  // RunCPU() variant, with the debugger hook only while one is attached
 #endif // SUPERMODEL_DEBUGGER
 };
 
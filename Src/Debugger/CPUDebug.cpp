@@ -46,12 +46,14 @@ namespace Debugger
 		m_enabled(true), m_break(false), m_breakUser(false), m_halted(false), m_step(false), m_steppingOver(false), m_steppingOut(false), 
 		m_count(0), m_until(false), m_untilAddr(0),
 		m_mappedIOTable(NULL), m_memWatchTable(NULL), m_bpTable(NULL), m_numRegMons(0), m_regMonArray(NULL),
+		m_profiling(false), m_profileInterval(0), m_profileCountdown(0), m_profileTotal(0),
 		m_analyser(NULL), m_stateUpdated(false), m_exRaised(NULL), m_exTrapped(NULL), m_intRaised(NULL), m_intTrapped(NULL), m_bpReached(NULL), 
 		m_memWatchTriggered(NULL), m_ioWatchTriggered(NULL), m_regMonTriggered(NULL), m_prevTotalCycles(0)
 	{ 
 		memset(m_exArray, NULL, sizeof(m_exArray));
 		memset(m_intArray, NULL, sizeof(m_intArray));
 		memset(m_portArray, NULL, sizeof(m_portArray));
+		memset(m_watchPages, 0, sizeof(m_watchPages));
 
 #ifdef DEBUGGER_HASTHREAD
 		m_breakWait = false;
@@ -947,12 +949,14 @@ namespace Debugger
 		UINT32 or16Mask = 0;
 		UINT32 or32Mask = 0;
 		UINT32 or64Mask = 0;
+		memset(m_watchPages, 0, sizeof(m_watchPages));
 		for (vector<CIO*>::iterator it = ios.begin(), end = ios.end(); it != end; it++)
 		{
 			CMappedIO *mapped = dynamic_cast<CMappedIO*>(*it);
 			if (!mapped)
 				continue;
 			UINT32 addr = mapped->addr;
+			MarkWatchPages(addr, mapped->size);
 			CRegion *region = GetRegion(addr);
 			int intSize = (int)mapped->size;
 			for (int offset = -7; offset < intSize; offset++)
@@ -993,6 +997,7 @@ namespace Debugger
 		for (vector<CWatch*>::iterator it = memWatches.begin(), end = memWatches.end(); it != end; it++)
 		{
 			UINT32 addr = (*it)->addr;
+			MarkWatchPages(addr, (*it)->size);
 			CRegion *region = GetRegion(addr);
 			int intSize = (int)(*it)->size;
 			for (int offset = -7; offset < intSize; offset++)
@@ -1040,6 +1045,15 @@ namespace Debugger
 		m_mem64OrMask = ~or64Mask;
 	}
 
+	void CCPUDebug::MarkWatchPages(UINT32 addr, unsigned size)
+	{
+		// Accesses of up to 8 bytes starting before the address can overlap it
+		UINT32 first = addr < 7 ? 0 : addr - 7;
+		UINT32 last = (size == 0 || addr > 0xFFFFFFFF - (size - 1)) ? 0xFFFFFFFF : addr + (size - 1);
+		for (UINT32 page = first >> WATCH_PAGE_SHIFT; page <= (last >> WATCH_PAGE_SHIFT); page++)
+			m_watchPages[page] = 1;
+	}
+
 	CSimpleBreakpoint *CCPUDebug::AddSimpleBreakpoint(UINT32 addr)
 	{
 		CSimpleBreakpoint *bp = new CSimpleBreakpoint(this, addr);
@@ -1200,6 +1214,51 @@ namespace Debugger
 			m_regMonArray = NULL;
 	}
 
+	void CCPUDebug::SampleProfile(UINT32 addr)
+	{
+		m_profileSamples[addr]++;
+		m_profileTotal++;
+		m_profileCountdown = m_profileInterval;
+	}
+
+	void CCPUDebug::StartProfile(unsigned interval)
+	{
+		m_profileInterval = max<unsigned>(interval, 1);
+		m_profileCountdown = m_profileInterval;
+		m_profiling = true;
+	}
+
+	void CCPUDebug::StopProfile()
+	{
+		m_profiling = false;
+	}
+
+	void CCPUDebug::ClearProfile()
+	{
+		m_profileSamples.clear();
+		m_profileTotal = 0;
+	}
+
+	bool CCPUDebug::IsProfiling()
+	{
+		return m_profiling;
+	}
+
+	unsigned CCPUDebug::GetProfileInterval()
+	{
+		return m_profileInterval;
+	}
+
+	UINT64 CCPUDebug::GetProfileTotal()
+	{
+		return m_profileTotal;
+	}
+
+	const std::map<UINT32, UINT64> &CCPUDebug::GetProfileSamples()
+	{
+		return m_profileSamples;
+	}
+
 	CCodeAnalyser *CCPUDebug::GetCodeAnalyser()
 	{
 		if (m_analyser == NULL)
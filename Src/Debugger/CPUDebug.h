@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <vector>
+#include <map>
 #include <algorithm>
 
 #include "Types.h"
@@ -54,6 +55,10 @@
 #define MAX_INTERRUPTS 255
 #define MAX_IOPORTS 255
 
+// Size of the pages used to tell which parts of the address space have mapped I/O or memory watches
+#define WATCH_PAGE_SHIFT 16
+#define WATCH_PAGES (1 << (32 - WATCH_PAGE_SHIFT))
+
 namespace Debugger
 {
 	class CRegion;
@@ -119,6 +124,7 @@ namespace Debugger
 		UINT32 m_mem32OrMask;
 		UINT32 m_mem64AndMask;
 		UINT32 m_mem64OrMask;
+		UINT8 m_watchPages[WATCH_PAGES];
 
 #ifdef DEBUGGER_HASTHREAD
 		CMutex *m_mutex;
@@ -136,6 +142,12 @@ namespace Debugger
 		int m_numRegMons;
 		CRegMonitor **m_regMonArray;
 
+		bool m_profiling;
+		unsigned m_profileInterval;
+		unsigned m_profileCountdown;
+		UINT64 m_profileTotal;
+		std::map<UINT32, UINT64> m_profileSamples;
+
 		bool ShiftAddress(UINT32 &addr, unsigned &dataSize, UINT64 &data, CAddressRef *ref);
 
 		void CheckRead(UINT32 addr, unsigned dataSize, UINT64 data);
@@ -160,7 +172,11 @@ namespace Debugger
 
 		void UpdateMemMasks();
 
+		void MarkWatchPages(UINT32 addr, unsigned size);
+
 		bool CheckExecute(UINT32 newPC, UINT32 newOpcode, UINT32 lastCycles);
+
+		void SampleProfile(UINT32 addr);
 		
 	protected:
 		CCodeAnalyser *m_analyser;
@@ -296,6 +312,14 @@ namespace Debugger
 		// Checking methods that hook into CPU emulation code
 		//
 
+		/*
+		 * Returns one entry per page of the address space (WATCH_PAGE_SHIFT), non-zero where an access
+		 * starting in that page may hit a mapped I/O or memory watch. The table is updated in place as
+		 * watches change. CPU cores with a direct path to memory only need to send accesses to these
+		 * pages through the checking methods below.
+		 */
+		const UINT8 *GetWatchPages() const;
+
 		/*
 		 * Should be called after every 8-bit read.
 		 */
@@ -543,6 +567,27 @@ namespace Debugger
 
 		bool RemoveAllRegMonitors();
 
+		//
+		// Profiling
+		//
+
+		/*
+		 * Samples the PC every interval instructions into a histogram of addresses.  Samples already taken are kept.
+		 */
+		void StartProfile(unsigned interval);
+
+		void StopProfile();
+
+		void ClearProfile();
+
+		bool IsProfiling();
+
+		unsigned GetProfileInterval();
+
+		UINT64 GetProfileTotal();
+
+		const std::map<UINT32, UINT64> &GetProfileSamples();
+
 		//
 		// Code analyser
 		//
@@ -754,8 +799,15 @@ namespace Debugger
 		UpdateExecMasks();
 	}
 
+	inline const UINT8 *CCPUDebug::GetWatchPages() const
+	{
+		return m_watchPages;
+	}
+
 	inline void CCPUDebug::CheckRead8(UINT32 addr, UINT8 data)
 	{
+		if (!m_watchPages[addr >> WATCH_PAGE_SHIFT])
+			return;
 		if ((addr&m_mem8AndMask) != m_mem8AndMask || (addr&m_mem8OrMask) != 0)
 			return;
 
@@ -781,24 +833,26 @@ namespace Debugger
 
 	inline void CCPUDebug::CheckRead16(UINT32 addr, UINT16 data)
 	{
-		if ((addr&m_mem16AndMask) == m_mem16AndMask && (addr&m_mem16OrMask) == 0)
+		if (m_watchPages[addr >> WATCH_PAGE_SHIFT] && (addr&m_mem16AndMask) == m_mem16AndMask && (addr&m_mem16OrMask) == 0)
 			CheckRead(addr, 2, data);
 	}
 
 	inline void CCPUDebug::CheckRead32(UINT32 addr, UINT32 data)
 	{
-		if ((addr&m_mem32AndMask) == m_mem32AndMask && (addr&m_mem32OrMask) == 0)
+		if (m_watchPages[addr >> WATCH_PAGE_SHIFT] && (addr&m_mem32AndMask) == m_mem32AndMask && (addr&m_mem32OrMask) == 0)
 			CheckRead(addr, 4, data);
 	}
 
 	inline void CCPUDebug::CheckRead64(UINT32 addr, UINT64 data)
 	{
-		if ((addr&m_mem64AndMask) == m_mem64AndMask && (addr&m_mem64OrMask) == 0)
+		if (m_watchPages[addr >> WATCH_PAGE_SHIFT] && (addr&m_mem64AndMask) == m_mem64AndMask && (addr&m_mem64OrMask) == 0)
 			CheckRead(addr, 8, data);
 	}
 
 	inline void CCPUDebug::CheckWrite8(UINT32 addr, UINT8 data)
 	{
+		if (!m_watchPages[addr >> WATCH_PAGE_SHIFT])
+			return;
 		if ((addr&m_mem8AndMask) != m_mem8AndMask || (addr&m_mem8OrMask) != 0)
 			return;
 
@@ -824,19 +878,19 @@ namespace Debugger
 
 	inline void CCPUDebug::CheckWrite16(UINT32 addr, UINT16 data)
 	{
-		if ((addr&m_mem16AndMask) == m_mem16AndMask && (addr&m_mem16OrMask) == 0)
+		if (m_watchPages[addr >> WATCH_PAGE_SHIFT] && (addr&m_mem16AndMask) == m_mem16AndMask && (addr&m_mem16OrMask) == 0)
 			CheckWrite(addr, 2, data);
 	}
 
 	inline void CCPUDebug::CheckWrite32(UINT32 addr, UINT32 data)
 	{
-		if ((addr&m_mem32AndMask) == m_mem32AndMask && (addr&m_mem32OrMask) == 0)
+		if (m_watchPages[addr >> WATCH_PAGE_SHIFT] && (addr&m_mem32AndMask) == m_mem32AndMask && (addr&m_mem32OrMask) == 0)
 			CheckWrite(addr, 4, data);
 	}
 
 	inline void CCPUDebug::CheckWrite64(UINT32 addr, UINT64 data)
 	{
-		if ((addr&m_mem64AndMask) == m_mem64AndMask && (addr&m_mem64OrMask) == 0)
+		if (m_watchPages[addr >> WATCH_PAGE_SHIFT] && (addr&m_mem64AndMask) == m_mem64AndMask && (addr&m_mem64OrMask) == 0)
 			CheckWrite(addr, 8, data);
 	}
 
@@ -860,6 +914,9 @@ namespace Debugger
 
 	inline bool CCPUDebug::CPUExecute(UINT32 newPC, UINT32 newOpcode, UINT32 lastCycles)
 	{
+		if (m_profiling && --m_profileCountdown == 0)
+			SampleProfile(newPC);
+
 		// Check if should check execution flow
 		if ((newPC&m_execAndMask) == m_execAndMask && (newPC&m_execOrMask) == 0)
 			return CheckExecute(newPC, newOpcode, lastCycles);
@@ -31,6 +31,7 @@
 #include "Label.h"
 
 #include <cctype>
+#include <functional>
 #include <string>
 
 using namespace std;
@@ -1368,6 +1369,69 @@ namespace Debugger
 			Print("All port watches removed.\n");
 		}
 		//
+		// Profiling
+		//
+		else if (CheckToken(token, "pf", "profile"))				// profile [(s)tart [<interval>=100]|s(t)op|(c)lear|(l)ist [<count>=10]]
+		{
+			// Parse arguments
+			token = strtok(NULL, " ");
+			if (token == NULL)
+			{
+				ListProfileStatus();
+				return false;
+			}
+
+			if (CheckToken(token, "s", "start"))
+			{
+				unsigned interval = 100;
+				token = strtok(NULL, " ");
+				if (token != NULL)
+				{
+					if (!ParseInt(token, &number) || number <= 0)
+					{
+						Error("Enter a valid sampling interval.\n");
+						return false;
+					}
+					interval = (unsigned)number;
+				}
+				for (vector<CCPUDebug*>::iterator it = cpus.begin(); it != cpus.end(); it++)
+					(*it)->StartProfile(interval);
+				Print("Profiling started, sampling every %u instructions.\n", interval);
+			}
+			else if (CheckToken(token, "t", "stop"))
+			{
+				for (vector<CCPUDebug*>::iterator it = cpus.begin(); it != cpus.end(); it++)
+					(*it)->StopProfile();
+				Print("Profiling stopped.\n");
+			}
+			else if (CheckToken(token, "c", "clear"))
+			{
+				for (vector<CCPUDebug*>::iterator it = cpus.begin(); it != cpus.end(); it++)
+					(*it)->ClearProfile();
+				Print("Profile samples cleared.\n");
+			}
+			else if (CheckToken(token, "l", "list"))
+			{
+				unsigned count = 10;
+				token = strtok(NULL, " ");
+				if (token != NULL)
+				{
+					if (!ParseInt(token, &number) || number <= 0)
+					{
+						Error("Enter a valid number of ranges.\n");
+						return false;
+					}
+					count = (unsigned)number;
+				}
+				ListProfile(count);
+			}
+			else
+			{
+				Error("Enter a valid option (s)tart, s(t)op, (c)lear or (l)ist.\n");
+				return false;
+			}
+		}
+		//
 		// General
 		//		
 		else if (CheckToken(token, "p", "print", mod, 9, ""))		// print[.<size>=v] <expr> [(h)ex|hexdo(l)lar|hex(p)osth|(d)ecimal|(b)inary]
@@ -1603,6 +1667,9 @@ namespace Debugger
 			Print(fmt, "pw/apw", "addportwatch",           "<port> [((n)one|(i)nput|(o)utput|(io)nputoutput) [(s)imple|(c)ount <count>|(m)atch <sequence>|captu(r)e <maxlen>|(p)rint]]");
 			Print(fmt, "rpw",    "removeportwatch",        "(#<num>|<port>)");
 			Print(fmt, "rapw",   "removeallportwatches",   "");
+
+			Print(" Profiling:\n");
+			Print(fmt, "pf",     "profile",                "[(s)tart [<interval>=100]|s(t)op|(c)lear|(l)ist [<count>=10]]");
 			
 			Print("General:\n");
 			Print(fmt, "p",      "print[.<size>=v]",       "<expr> [(h)ex|hexdo(l)lar|hex(p)osth|(d)ecimal|(b)inary]");
@@ -2416,6 +2483,117 @@ namespace Debugger
 		}
 	}
 
+	void CConsoleDebugger::ListProfileStatus()
+	{
+		Print("Profiling:\n");
+		for (vector<CCPUDebug*>::iterator it = cpus.begin(); it != cpus.end(); it++)
+		{
+			CCPUDebug *cpu = *it;
+			if (cpu->IsProfiling())
+				Print(" %-12s On (every %u instructions), %llu samples\n", cpu->name, cpu->GetProfileInterval(), (unsigned long long)cpu->GetProfileTotal());
+			else
+				Print(" %-12s Off, %llu samples\n", cpu->name, (unsigned long long)cpu->GetProfileTotal());
+		}
+	}
+
+	void CConsoleDebugger::ListProfile(unsigned count)
+	{
+		Print("%s Profile:\n", m_cpu->name);
+
+		UINT64 total = m_cpu->GetProfileTotal();
+		if (total == 0)
+		{
+			Print(" No samples\n");
+			return;
+		}
+
+		// Samples are grouped into ranges that start at a label (custom labels, plus entry points, handlers and subroutines found by
+		// the code analyser).  Samples below the first label are grouped by 256-byte block instead.
+		vector<UINT32> starts;
+		for (vector<CLabel*>::iterator it = m_cpu->labels.begin(); it != m_cpu->labels.end(); it++)
+			starts.push_back((*it)->addr);
+		if (m_analyseCode)
+		{
+			CCodeAnalyser *analyser = m_cpu->GetCodeAnalyser();
+			for (ELabelFlags flag : { LFEntryPoint, LFExcepHandler, LFInterHandler, LFSubroutine })
+			{
+				vector<CAutoLabel*> withFlag = analyser->analysis->GetAutoLabels(flag);
+				for (vector<CAutoLabel*>::iterator it = withFlag.begin(); it != withFlag.end(); it++)
+					starts.push_back((*it)->addr);
+			}
+		}
+		sort(starts.begin(), starts.end());
+
+		struct ProfileRange
+		{
+			UINT32 start;
+			bool labelled;
+			UINT32 first;
+			UINT32 last;
+			UINT64 samples;
+			vector<pair<UINT64, UINT32> > hottest;
+		};
+		map<UINT32, ProfileRange> ranges;
+		const map<UINT32, UINT64> &samples = m_cpu->GetProfileSamples();
+		for (map<UINT32, UINT64>::const_iterator it = samples.begin(); it != samples.end(); it++)
+		{
+			vector<UINT32>::iterator next = upper_bound(starts.begin(), starts.end(), it->first);
+			bool labelled = (next != starts.begin());
+			UINT32 start = (labelled ? *(next - 1) : it->first & ~0xFF);
+			ProfileRange &range = ranges[start];
+			if (range.samples == 0)
+			{
+				range.start = start;
+				range.labelled = labelled;
+				range.first = it->first;
+			}
+			range.last = it->first;
+			range.samples += it->second;
+			range.hottest.push_back(make_pair(it->second, it->first));
+		}
+
+		vector<ProfileRange*> sorted;
+		for (map<UINT32, ProfileRange>::iterator it = ranges.begin(); it != ranges.end(); it++)
+			sorted.push_back(&it->second);
+		sort(sorted.begin(), sorted.end(), [](const ProfileRange *a, const ProfileRange *b) { return a->samples > b->samples; });
+
+		Print(" %llu samples, every %u instructions\n", (unsigned long long)total, m_cpu->GetProfileInterval());
+		Print(" %-7s %-12s %-12s %-12s %s\n", "Time", "Samples", "Start", "End", "Label");
+
+		char firstStr[20];
+		char lastStr[20];
+		char addrStr[20];
+		char labelStr[255];
+		char mnemonic[100];
+		char operands[155];
+		for (unsigned i = 0; i < sorted.size() && i < count; i++)
+		{
+			ProfileRange *range = sorted[i];
+			m_cpu->FormatAddress(firstStr, range->first);
+			m_cpu->FormatAddress(lastStr, range->last);
+			if (!range->labelled || !GetLabelText(labelStr, 254, range->start))
+			{
+				labelStr[0] = '-';
+				labelStr[1] = '\0';
+			}
+			Print(" %6.2f%% %-12llu %-12s %-12s %s\n", 100.0 * range->samples / total, (unsigned long long)range->samples, firstStr, lastStr, labelStr);
+
+			// Show hottest instructions within range
+			sort(range->hottest.begin(), range->hottest.end(), greater<pair<UINT64, UINT32> >());
+			for (unsigned j = 0; j < range->hottest.size() && j < 3; j++)
+			{
+				UINT32 addr = range->hottest[j].second;
+				m_cpu->FormatAddress(addrStr, addr);
+				int codesLen = m_cpu->Disassemble(addr, mnemonic, operands);
+				Print("  %6.2f%% %s  ", 100.0 * range->hottest[j].first / total, addrStr);
+				if (codesLen > 0)
+					Print("%-*s %s\n", (int)m_cpu->maxMnemLen, mnemonic, operands);
+				else
+					Print("???\n");
+			}
+		}
+	}
+
 	UINT32 CConsoleDebugger::ListDisassembly(UINT32 start, UINT32 end, unsigned numInstrs)
 	{
 		UINT32 addr;
@@ -146,6 +146,10 @@ namespace Debugger
 
 		void ListMonitors();
 
+		void ListProfileStatus();
+
+		void ListProfile(unsigned count);
+
 		UINT32 ListDisassembly(UINT32 start, UINT32 end, unsigned numInstrs);
 
 		UINT32 ListMemory(UINT32 start, UINT32 end, unsigned bytesPerRow);
@@ -31,6 +31,7 @@ struct Game
   float real3d_status_bit_set_percent_of_frame = 0; // overrides default status bit timing (0 for default)
   uint32_t encryption_key = 0;
   bool netboard_present = false;
+  bool ppc_idle_skip = true;            // false to disable PowerPC idle loop skipping for this game
 
   enum Inputs
   {
@@ -1,16 +1,198 @@
 #include "GameLoader.h"
+#include "OSD/FileSystemPath.h"
 #include "OSD/Logger.h"
 #include "Util/NewConfig.h"
 #include "Util/ConfigBuilders.h"
 #include "Util/ByteSwap.h"
+#include "Util/CRC32.h"
 #include "Util/Format.h"
+#include "Util/JobSystem.h"
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <type_traits>
+#include <zlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Read-only view of part of a file. Memory-mapped where possible so that
+ * loose and stored files are copied straight out of the page cache, and
+ * read into a buffer otherwise.
+ */
+class MappedFile
+{
+public:
+  bool Open(const std::string &path, uint64_t offset, size_t size)
+  {
+    if (size == 0)
+      return true;
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && uint64_t(st.st_size) >= offset + size)
+    {
+      // Mappings must start on a page boundary
+      uint64_t start = offset - offset % uint64_t(sysconf(_SC_PAGESIZE));
+      size_t map_size = size_t(offset - start) + size;
+      void *map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, off_t(start));
+      if (map != MAP_FAILED)
+      {
+        madvise(map, map_size, MADV_SEQUENTIAL);
+        m_map = map;
+        m_map_size = map_size;
+        m_data = reinterpret_cast<const uint8_t *>(map) + (offset - start);
+      }
+    }
+    close(fd);
+    if (m_map)
+      return true;
+#endif
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+      return false;
+    m_buffer.resize(size);
+    bool ok = fseek(fp, long(offset), SEEK_SET) == 0 && fread(m_buffer.data(), size, 1, fp) == 1;
+    fclose(fp);
+    m_data = m_buffer.data();
+    return ok;
+  }
+
+  const uint8_t *Data() const
+  {
+    return m_data;
+  }
+
+  ~MappedFile()
+  {
+#ifndef _WIN32
+    if (m_map)
+      munmap(m_map, m_map_size);
+#endif
+  }
+
+private:
+  void *m_map = nullptr;
+  size_t m_map_size = 0;
+  const uint8_t *m_data = nullptr;
+  std::vector<uint8_t> m_buffer;
+};
+
+/*
+ * CRC32s of loose ROM files, kept in the cache directory so that identifying
+ * the files of an unpacked ROM set only reads them up front after they
+ * change. Each line holds a file's size and modification time, its CRC32,
+ * and its path.
+ */
+static std::mutex s_crc_cache_mutex;
+static std::map<std::string, std::pair<std::string, uint32_t>> s_crc_cache;
+static bool s_crc_cache_loaded = false;
+static bool s_crc_cache_dirty = false;
+
+static std::string CRCCachePath()
+{
+  return Util::Format() << FileSystemPath::GetPath(FileSystemPath::Cache) << "ROMCRCs.txt";
+}
+
+// Sets *hashed if the file had to be read, rather than found in the cache
+static bool GetFileCRC32(uint32_t *crc, bool *hashed, const std::string &path, size_t size)
+{
+  *hashed = false;
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return false;
+  std::string stamp = Util::Format() << size << ':' << int64_t(mtime.time_since_epoch().count());
+
+  {
+    std::lock_guard<std::mutex> lock(s_crc_cache_mutex);
+    if (!s_crc_cache_loaded)
+    {
+      s_crc_cache_loaded = true;
+      std::ifstream file(CRCCachePath());
+      std::string line;
+      while (std::getline(file, line))
+      {
+        size_t sep1 = line.find(' ');
+        size_t sep2 = sep1 == std::string::npos ? sep1 : line.find(' ', sep1 + 1);
+        if (sep2 == std::string::npos)
+          continue;
+        s_crc_cache[line.substr(sep2 + 1)] = std::make_pair(line.substr(0, sep1), uint32_t(strtoul(line.substr(sep1 + 1, sep2 - sep1 - 1).c_str(), nullptr, 16)));
+      }
+    }
+    auto it = s_crc_cache.find(path);
+    if (it != s_crc_cache.end() && it->second.first == stamp)
+    {
+      *crc = it->second.second;
+      return true;
+    }
+  }
+
+  MappedFile mapped;
+  if (!mapped.Open(path, 0, size))
+    return false;
+  *crc = Util::CRC32(0, mapped.Data(), size);
+  *hashed = true;
+
+  std::lock_guard<std::mutex> lock(s_crc_cache_mutex);
+  s_crc_cache[path] = std::make_pair(stamp, *crc);
+  s_crc_cache_dirty = true;
+  return true;
+}
+
+// Drops a file whose contents no longer match its cached CRC32, so that it is
+// identified afresh next time
+static void ForgetFileCRC32(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(s_crc_cache_mutex);
+  s_crc_cache_dirty |= s_crc_cache.erase(path) != 0;
+}
+
+static void StoreCRCCache()
+{
+  std::lock_guard<std::mutex> lock(s_crc_cache_mutex);
+  if (!s_crc_cache_dirty)
+    return;
+  s_crc_cache_dirty = false;
+  std::string path = CRCCachePath();
+  std::string tmp_path = FileSystemPath::GetTempFilePath(path);
+  FILE *fp = fopen(tmp_path.c_str(), "w");
+  if (!fp)
+    return;
+  for (auto &v: s_crc_cache)
+    fprintf(fp, "%s %08x %s\n", v.second.first.c_str(), v.second.second, v.first.c_str());
+  bool error = fclose(fp) != 0;
+  if (!error)
+  {
+    std::remove(path.c_str());
+    error = std::rename(tmp_path.c_str(), path.c_str()) != 0;
+  }
+  if (error)
+  {
+    std::remove(tmp_path.c_str());
+    ErrorLog("Unable to write ROM CRC cache '%s'.", path.c_str());
+  }
+}
 
 bool GameLoader::LoadZipArchive(ZipArchive *zip, const std::string &zipfilename) const
 {
+  std::error_code ec;
+  if (std::filesystem::is_directory(zipfilename, ec))
+    return LoadROMDirectory(zip, zipfilename);
+
   unzFile zf = unzOpen(zipfilename.c_str());
   if (NULL == zf)
   {
@@ -28,11 +210,22 @@ bool GameLoader::LoadZipArchive(ZipArchive *zip, const std::string &zipfilename)
     char filename_buffer[256];
     if (UNZ_OK != unzGetCurrentFileInfo(zf, &file_info, filename_buffer, sizeof(filename_buffer), NULL, 0, NULL, 0))
       continue;
-    zip->files_by_crc[file_info.crc].zf = zf;
-    zip->files_by_crc[file_info.crc].zipfilename = filename_buffer;
-    zip->files_by_crc[file_info.crc].filename = filename_buffer;
-    zip->files_by_crc[file_info.crc].uncompressed_size = file_info.uncompressed_size;
-    zip->files_by_crc[file_info.crc].crc32 = file_info.crc;
+    ZippedFile &zipped_file = zip->files_by_crc[file_info.crc];
+    zipped_file.zf = zf;
+    zipped_file.zipfilename = zipfilename;
+    zipped_file.filename = filename_buffer;
+    zipped_file.uncompressed_size = file_info.uncompressed_size;
+    zipped_file.crc32 = file_info.crc;
+    unzGetFilePos(zf, &zipped_file.pos);
+
+    // Files stored without compression (or encryption) are mapped and copied
+    // rather than inflated
+    if (file_info.compression_method == 0 && (file_info.flag & 1) == 0 && UNZ_OK == unzOpenCurrentFile(zf))
+    {
+      zipped_file.stored = true;
+      zipped_file.data_offset = unzGetCurrentFileZStreamPos64(zf);
+      unzCloseCurrentFile(zf);
+    }
   }
 
   if (err != UNZ_END_OF_LIST_OF_FILE)
@@ -44,6 +237,90 @@ bool GameLoader::LoadZipArchive(ZipArchive *zip, const std::string &zipfilename)
   return false;
 }
 
+bool GameLoader::LoadROMDirectory(ZipArchive *zip, const std::string &directory) const
+{
+  zip->zipfilenames.push_back(directory);
+
+  struct LooseFile
+  {
+    std::string filename;
+    std::string path;
+    size_t size;
+    uint32_t crc;
+    bool hashed;
+    bool error;
+  };
+  std::vector<LooseFile> files;
+  std::error_code ec;
+  for (auto it = std::filesystem::directory_iterator(directory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+  {
+    std::error_code file_ec;
+    if (!it->is_regular_file(file_ec))
+      continue;
+    size_t size = size_t(it->file_size(file_ec));
+    if (!file_ec)
+      files.push_back({ it->path().filename().string(), it->path().string(), size, 0, false, false });
+  }
+
+  // Files not in the CRC cache are read in parallel
+  if (m_verify_crcs)
+  {
+    std::atomic<size_t> next_file(0);
+    auto worker = [&]()
+    {
+      for (size_t i = next_file++; i < files.size(); i = next_file++)
+        files[i].error = !GetFileCRC32(&files[i].crc, &files[i].hashed, files[i].path, files[i].size);
+    };
+    size_t num_workers = std::min<size_t>(files.size(), Util::Jobs::NumWorkers() + 1);
+    Util::JobGroup group;
+    for (size_t i = 1; i < num_workers; i++)
+      group.Run(worker);
+    worker();
+    group.Wait();
+    StoreCRCCache();
+  }
+
+  // Without verification, a loose file stands for every file of that name in
+  // the game definitions, and it is up to the game to pick the right one
+  for (auto &file: files)
+  {
+    std::vector<uint32_t> crcs;
+    if (m_verify_crcs)
+    {
+      if (file.error)
+      {
+        ErrorLog("Unable to read '%s'.", file.path.c_str());
+        continue;
+      }
+      crcs.push_back(file.crc);
+    }
+    else
+    {
+      auto crcs_it = m_crcs_by_filename.find(Util::ToLower(file.filename));
+      if (crcs_it != m_crcs_by_filename.end())
+        crcs = crcs_it->second;
+    }
+    for (uint32_t crc: crcs)
+    {
+      ZippedFile &zipped_file = zip->files_by_crc[crc];
+      zipped_file.zipfilename = directory;
+      zipped_file.filename = file.filename;
+      zipped_file.path = file.path;
+      zipped_file.uncompressed_size = file.size;
+      zipped_file.crc32 = crc;
+      zipped_file.verified = file.hashed;
+    }
+  }
+
+  if (ec)
+  {
+    ErrorLog("Unable to read the contents of '%s'.", directory.c_str());
+    return true;
+  }
+  InfoLog("Opened %s.", directory.c_str());
+  return false;
+}
+
 bool GameLoader::FileExistsInZipArchive(const File::ptr_t &file, const ZipArchive &zip) const
 {
   if (file->has_crc32)
@@ -68,7 +345,7 @@ const GameLoader::ZippedFile *GameLoader::LookupFile(const File::ptr_t &file, co
     auto it = zip.files_by_crc.find(file->crc32);
     if (it == zip.files_by_crc.end())
     {
-      if (zip.zfs.size() == 1)
+      if (zip.zipfilenames.size() == 1)
         ErrorLog("'%s' with CRC32 0x%08x not found in '%s'.", file->filename.c_str(), file->crc32, zip.zipfilenames[0].c_str());
       else
         ErrorLog("'%s' with CRC32 0x%08x not found in '%s'.", file->filename.c_str(), file->crc32, Util::Format("', '").Join(zip.zipfilenames).str().c_str());
@@ -83,47 +360,179 @@ const GameLoader::ZippedFile *GameLoader::LookupFile(const File::ptr_t &file, co
     if (Util::ToLower(v.second.filename) == file->filename)
       return &v.second;
   }
-  if (zip.zfs.size() == 1)
+  if (zip.zipfilenames.size() == 1)
     ErrorLog("'%s' not found in '%s'.", file->filename.c_str(), zip.zipfilenames[0].c_str());
   else
     ErrorLog("'%s' not found in '%s'.", file->filename.c_str(), Util::Format("', '").Join(zip.zipfilenames).str().c_str());
   return nullptr;
 }
 
-bool GameLoader::LoadZippedFile(std::shared_ptr<uint8_t> *buffer, size_t *file_size, const GameLoader::File::ptr_t &file, const ZipArchive &zip) const
+void GameLoader::CopyToRegion(ROM *rom, const Region &region, const std::vector<size_t> &lane_map, const File &file, const uint8_t *src, size_t pos_in_file, size_t len)
 {
-  // Locate file
-  const ZippedFile *zipped_file = LookupFile(file, zip);
-  if (!zipped_file)
-    return true;
-  if (UNZ_OK != unzLocateFile(zipped_file->zf, zipped_file->filename.c_str(), 2))
+  // Scatter the chunks (and bytes, if a layout is given) to their final
+  // positions
+  uint8_t *dest = rom->data.get();
+  const size_t chunk_size = region.chunk_size;
+  const size_t stride = region.stride;
+  const size_t full_strides_end = rom->size - rom->size % stride;  // layout only applies to complete strides
+
+  // Whole chunks can go through the interleave kernel when there is no
+  // layout, or when the layout is a plain 16-bit byte swap (byte_swap="true")
+  bool swap16 = !lane_map.empty() && chunk_size % 2 == 0 && file.offset % 2 == 0 && full_strides_end == rom->size;
+  for (size_t i = 0; i < lane_map.size() && swap16; i++)
+    swap16 = lane_map[i] == (i ^ 1);
+  const bool use_kernel = lane_map.empty() || swap16;
+  size_t remaining = len;
+  while (remaining > 0)
   {
-    ErrorLog("Unable to locate '%s' in '%s'. Is zip file corrupt?", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
+    size_t pos_in_chunk = pos_in_file % chunk_size;
+    size_t dest_offset = file.offset + (pos_in_file / chunk_size) * stride + pos_in_chunk;
+    size_t n = std::min(chunk_size - pos_in_chunk, remaining);
+    if (use_kernel && pos_in_chunk == 0 && remaining >= chunk_size)
+    {
+      n = remaining - remaining % chunk_size;
+      Util::Interleave(dest + dest_offset, stride, src, n, chunk_size, swap16);
+    }
+    else if (lane_map.empty())
+      memcpy(dest + dest_offset, src, n);
+    else
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        size_t addr = dest_offset + i;
+        size_t lane = addr % stride;
+        dest[addr < full_strides_end ? addr - lane + lane_map[lane] : addr] = src[i];
+      }
+    }
+    src += n;
+    pos_in_file += n;
+    remaining -= n;
+  }
+}
+
+bool GameLoader::LoadMappedFile(ROM *rom, const Region &region, const std::vector<size_t> &lane_map, const File &file, const ZippedFile &zipped_file) const
+{
+  const std::string &path = zipped_file.path.empty() ? zipped_file.zipfilename : zipped_file.path;
+  MappedFile mapped;
+  if (!mapped.Open(path, zipped_file.data_offset, zipped_file.uncompressed_size))
+  {
+    ErrorLog("Unable to read '%s' from '%s'.", zipped_file.filename.c_str(), zipped_file.zipfilename.c_str());
     return true;
   }
 
-  // Read it in
-  if (UNZ_OK != unzOpenCurrentFile(zipped_file->zf))
+  // Loose files identified by their cached CRC32 are checked here, on the
+  // loader workers, so that every load catches files that have gone bad
+  if (m_verify_crcs && !zipped_file.verified && Util::CRC32(0, mapped.Data(), zipped_file.uncompressed_size) != zipped_file.crc32)
+  {
+    ErrorLog("CRC error reading '%s' from '%s'. File may be corrupt.", zipped_file.filename.c_str(), zipped_file.zipfilename.c_str());
+    if (!zipped_file.path.empty())
+      ForgetFileCRC32(zipped_file.path);
+  }
+
+  if (region.chunk_size == region.stride && lane_map.empty())
+    memcpy(rom->data.get() + file.offset, mapped.Data(), zipped_file.uncompressed_size);
+  else
+    CopyToRegion(rom, region, lane_map, file, mapped.Data(), 0, zipped_file.uncompressed_size);
+  return false;
+}
+
+bool GameLoader::LoadZippedFile(ROM *rom, const Region &region, const std::vector<size_t> &lane_map, const File &file, const ZippedFile &zipped_file, unzFile zf, std::vector<uint8_t> *block) const
+{
+  // Seek directly to the file using the position recorded when the archive was opened
+  unz_file_pos pos = zipped_file.pos;
+  if (UNZ_OK != unzGoToFilePos(zf, &pos))
   {
-    ErrorLog("Unable to read '%s' from '%s'. Is zip file corrupt?", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
+    ErrorLog("Unable to locate '%s' in '%s'. Is zip file corrupt?", zipped_file.filename.c_str(), zipped_file.zipfilename.c_str());
     return true;
   }
-  *file_size = zipped_file->uncompressed_size;
-  buffer->reset(new uint8_t[*file_size], std::default_delete<uint8_t[]>());
-  size_t bytes_read = (size_t) unzReadCurrentFile(zipped_file->zf, buffer->get(), *file_size);
-  if (bytes_read != *file_size)
+  if (UNZ_OK != unzOpenCurrentFile(zf))
   {
-    ErrorLog("Unable to read '%s' from '%s'. Is zip file corrupt?", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
-    unzCloseCurrentFile(zipped_file->zf);
+    ErrorLog("Unable to read '%s' from '%s'. Is zip file corrupt?", zipped_file.filename.c_str(), zipped_file.zipfilename.c_str());
     return true;
   }
 
+  // Inflate straight into the region when the file is stored contiguously.
+  // Otherwise, inflate a block at a time and scatter it.
+  uint8_t *dest = rom->data.get();
+  const size_t file_size = zipped_file.uncompressed_size;
+  const bool direct = region.chunk_size == region.stride && lane_map.empty();
+  size_t src_offset = 0;
+  while (src_offset < file_size)
+  {
+    size_t len = direct ? file_size - src_offset : std::min(block->size(), file_size - src_offset);
+    uint8_t *out = direct ? dest + file.offset + src_offset : block->data();
+    int bytes_read = unzReadCurrentFile(zf, out, (unsigned) len);
+    if (bytes_read <= 0)
+    {
+      ErrorLog("Unable to read '%s' from '%s'. Is zip file corrupt?", zipped_file.filename.c_str(), zipped_file.zipfilename.c_str());
+      unzCloseCurrentFile(zf);
+      return true;
+    }
+
+    if (!direct)
+      CopyToRegion(rom, region, lane_map, file, block->data(), src_offset, (size_t) bytes_read);
+    src_offset += (size_t) bytes_read;
+  }
+
   // And close it
-  if (UNZ_CRCERROR == unzCloseCurrentFile(zipped_file->zf))
-    ErrorLog("CRC error reading '%s' from '%s'. File may be corrupt.", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
+  if (UNZ_CRCERROR == unzCloseCurrentFile(zf))
+    ErrorLog("CRC error reading '%s' from '%s'. File may be corrupt.", zipped_file.filename.c_str(), zipped_file.zipfilename.c_str());
   return false;
 }
 
+void GameLoader::RunLoadJobs(std::vector<LoadJob> *jobs) const
+{
+  // Largest jobs first so that the pool finishes together
+  std::vector<LoadJob *> queue;
+  for (auto &job: *jobs)
+    queue.push_back(&job);
+  std::sort(queue.begin(), queue.end(), [](const LoadJob *a, const LoadJob *b) { return a->total_size > b->total_size; });
+
+  // Each worker opens its own handle to each archive because a minizip
+  // handle can only have one file open at a time. Loose and stored files
+  // are mapped instead.
+  std::atomic<size_t> next_job(0);
+  auto worker = [&]()
+  {
+    std::map<std::string, unzFile> zfs;
+    std::vector<uint8_t> block(256 * 1024);
+    for (size_t i = next_job++; i < queue.size(); i = next_job++)
+    {
+      LoadJob *job = queue[i];
+      for (auto &v: job->files)
+      {
+        const ZippedFile *zipped_file = v.second;
+        if (!zipped_file->path.empty() || zipped_file->stored)
+        {
+          job->error |= LoadMappedFile(job->rom, *job->region, *job->lane_map, *v.first, *zipped_file);
+          continue;
+        }
+        unzFile &zf = zfs[zipped_file->zipfilename];
+        if (!zf && (zf = unzOpen(zipped_file->zipfilename.c_str())) == NULL)
+        {
+          ErrorLog("Could not open '%s'.", zipped_file->zipfilename.c_str());
+          job->error = true;
+          continue;
+        }
+        job->error |= LoadZippedFile(job->rom, *job->region, *job->lane_map, *v.first, *zipped_file, zf, &block);
+      }
+    }
+    for (auto &v: zfs)
+    {
+      if (v.second)
+        unzClose(v.second);
+    }
+  };
+
+  size_t num_workers = std::min<size_t>(queue.size(), Util::Jobs::NumWorkers() + 1);
+  Util::JobGroup group;
+  for (size_t i = 1; i < num_workers; i++)
+    group.Run(worker);
+  worker();
+  group.Wait();
+  StoreCRCCache();
+}
+
 bool GameLoader::MissingAttrib(const GameLoader &loader, const Util::Config::Node &node, const std::string &attribute)
 {
   if (node[attribute].Empty())
@@ -268,6 +677,7 @@ static void PopulateGameInfo(Game *game, const Util::Config::Node &game_node)
   game->real3d_status_bit_set_percent_of_frame = game_node["hardware/real3d_status_bit_set_percent_of_frame"].ValueAsDefault<float>(0);
   game->encryption_key = game_node["hardware/encryption_key"].ValueAsDefault<uint32_t>(0);
   game->netboard_present = game_node["hardware/netboard"].ValueAsDefault<bool>(false);
+  game->ppc_idle_skip = game_node["hardware/ppc_idle_skip"].ValueAsDefault<bool>(true);
 
   std::map<std::string, uint32_t> input_flags
   {
@@ -540,16 +950,440 @@ bool GameLoader::ParseXML(const Util::Config::Node &xml)
   return error;
 }
 
+/*
+ * Compiled game database
+ *
+ * Parsing the XML and merging the child sets is by far the slowest part of
+ * starting up, so the result is saved to the cache directory and read back
+ * directly whenever the XML is unchanged. Layout: magic, version, and the
+ * key (see LoadDefinitionXML()), followed by a table of every File, a table
+ * of every Region (listing its files by index), the games, their patches,
+ * and the two region maps (listing regions by index). The tables preserve
+ * which files and regions are shared between games, which ROM
+ * identification relies on. Values are stored in native byte order since
+ * the cache never leaves the machine that wrote it.
+ */
+
+namespace
+{
+  const char      s_db_magic[4] = { 'S', 'M', 'G', 'D' };
+  const uint32_t  s_db_version  = 1;
+
+  class DatabaseWriter
+  {
+  public:
+    std::vector<uint8_t> bytes;
+
+    template <typename T>
+    void Put(T value)
+    {
+      static_assert(std::is_arithmetic<T>::value, "only plain values may be written directly");
+      bytes.insert(bytes.end(), (const uint8_t *) &value, (const uint8_t *) &value + sizeof(value));
+    }
+
+    void PutString(const std::string &str)
+    {
+      Put(uint32_t(str.size()));
+      bytes.insert(bytes.end(), str.begin(), str.end());
+    }
+  };
+
+  class DatabaseReader
+  {
+  public:
+    DatabaseReader(const std::vector<uint8_t> &bytes)
+      : m_ptr(bytes.data()),
+        m_end(bytes.data() + bytes.size())
+    {
+    }
+
+    // Set once anything is read past the end; later reads return zeros
+    bool error = false;
+
+    template <typename T>
+    T Get()
+    {
+      T value = T();
+      if (Have(sizeof(value)))
+      {
+        memcpy(&value, m_ptr, sizeof(value));
+        m_ptr += sizeof(value);
+      }
+      return value;
+    }
+
+    std::string GetString()
+    {
+      size_t size = Get<uint32_t>();
+      if (!Have(size))
+        return std::string();
+      std::string str((const char *) m_ptr, size);
+      m_ptr += size;
+      return str;
+    }
+
+    // Reads a count of items that each take at least min_item_size bytes, so
+    // a corrupt count cannot cause a huge allocation
+    size_t GetCount(size_t min_item_size)
+    {
+      size_t count = Get<uint32_t>();
+      if (count > size_t(m_end - m_ptr) / min_item_size)
+      {
+        error = true;
+        return 0;
+      }
+      return count;
+    }
+
+    bool AtEnd() const
+    {
+      return m_ptr == m_end;
+    }
+
+  private:
+    const uint8_t *m_ptr;
+    const uint8_t *m_end;
+
+    bool Have(size_t size)
+    {
+      if (error || size > size_t(m_end - m_ptr))
+        error = true;
+      return !error;
+    }
+  };
+
+  // Returns true on success
+  bool ReadWholeFile(std::vector<uint8_t> *bytes, const std::string &path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+    bytes->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+  }
+}
+
+bool GameLoader::LoadDefinitionCache(const std::string &path, const std::string &key)
+{
+  std::vector<uint8_t> bytes;
+  if (!ReadWholeFile(&bytes, path))
+    return false;
+  DatabaseReader in(bytes);
+  char magic[4];
+  for (auto &c: magic)
+    c = in.Get<char>();
+  if (memcmp(magic, s_db_magic, sizeof(magic)) != 0 || in.Get<uint32_t>() != s_db_version || in.GetString() != key || in.error)
+    return false;
+
+  std::vector<File::ptr_t> files(in.GetCount(13));
+  for (auto &file: files)
+  {
+    file = std::make_shared<File>();
+    file->offset = in.Get<uint32_t>();
+    file->filename = in.GetString();
+    file->crc32 = in.Get<uint32_t>();
+    file->has_crc32 = in.Get<uint8_t>() != 0;
+  }
+
+  std::vector<Region::ptr_t> regions(in.GetCount(29));
+  for (auto &region: regions)
+  {
+    region = std::make_shared<Region>();
+    region->region_name = in.GetString();
+    region->stride = size_t(in.Get<uint64_t>());
+    region->chunk_size = size_t(in.Get<uint64_t>());
+    region->byte_layout = in.GetString();
+    region->required = in.Get<uint8_t>() != 0;
+    region->files.resize(in.GetCount(4));
+    for (auto &file: region->files)
+    {
+      uint32_t idx = in.Get<uint32_t>();
+      in.error = in.error || idx >= files.size();
+      file = in.error ? File::ptr_t() : files[idx];
+    }
+  }
+
+  for (size_t i = in.GetCount(4); i > 0; i--)
+  {
+    std::string name = in.GetString();
+    Game &game = m_game_info_by_game[name];
+    game.name = name;
+    game.parent = in.GetString();
+    game.title = in.GetString();
+    game.version = in.GetString();
+    game.manufacturer = in.GetString();
+    game.year = in.Get<uint32_t>();
+    game.stepping = in.GetString();
+    game.mpeg_board = in.GetString();
+    game.audio = Game::AudioTypes(in.Get<uint32_t>());
+    game.pci_bridge = in.GetString();
+    game.real3d_pci_id = in.Get<uint32_t>();
+    game.real3d_status_bit_set_percent_of_frame = in.Get<float>();
+    game.encryption_key = in.Get<uint32_t>();
+    game.netboard_present = in.Get<uint8_t>() != 0;
+    game.ppc_idle_skip = in.Get<uint8_t>() != 0;
+    game.inputs = in.Get<uint32_t>();
+    game.driveboard_type = Game::DriveBoardType(in.Get<uint32_t>());
+  }
+
+  for (size_t i = in.GetCount(8); i > 0; i--)
+  {
+    PatchesByRegion_t &patches_by_region = m_patches_by_game[in.GetString()];
+    for (size_t j = in.GetCount(8); j > 0; j--)
+    {
+      std::vector<ROM::BigEndianPatch> &patches = patches_by_region[in.GetString()];
+      for (size_t k = in.GetCount(16); k > 0; k--)
+      {
+        uint32_t offset = in.Get<uint32_t>();
+        uint64_t value = in.Get<uint64_t>();
+        unsigned bits = in.Get<uint32_t>();
+        patches.push_back(ROM::BigEndianPatch(offset, value, bits));
+      }
+    }
+  }
+
+  for (auto *regions_by_game: { &m_regions_by_game, &m_regions_by_merged_game })
+  {
+    for (size_t i = in.GetCount(8); i > 0; i--)
+    {
+      RegionsByName_t &regions_by_name = (*regions_by_game)[in.GetString()];
+      for (size_t j = in.GetCount(8); j > 0; j--)
+      {
+        std::string region_name = in.GetString();
+        uint32_t idx = in.Get<uint32_t>();
+        in.error = in.error || idx >= regions.size();
+        if (!in.error)
+          regions_by_name[region_name] = regions[idx];
+      }
+    }
+  }
+
+  if (in.error || !in.AtEnd())
+  {
+    m_game_info_by_game.clear();
+    m_patches_by_game.clear();
+    m_regions_by_game.clear();
+    m_regions_by_merged_game.clear();
+    return false;
+  }
+  return true;
+}
+
+void GameLoader::StoreDefinitionCache(const std::string &path, const std::string &key) const
+{
+  // Number every distinct file and region
+  std::map<File::ptr_t, uint32_t> file_index;
+  std::map<Region::ptr_t, uint32_t> region_index;
+  std::vector<File::ptr_t> files;
+  std::vector<Region::ptr_t> regions;
+  for (auto *regions_by_game: { &m_regions_by_game, &m_regions_by_merged_game })
+  {
+    for (auto &v1: *regions_by_game)
+    {
+      for (auto &v2: v1.second)
+      {
+        if (!region_index.emplace(v2.second, uint32_t(regions.size())).second)
+          continue;
+        regions.push_back(v2.second);
+        for (auto &file: v2.second->files)
+        {
+          if (file_index.emplace(file, uint32_t(files.size())).second)
+            files.push_back(file);
+        }
+      }
+    }
+  }
+
+  DatabaseWriter out;
+  for (char c: s_db_magic)
+    out.Put(c);
+  out.Put(s_db_version);
+  out.PutString(key);
+
+  out.Put(uint32_t(files.size()));
+  for (auto &file: files)
+  {
+    out.Put(file->offset);
+    out.PutString(file->filename);
+    out.Put(file->crc32);
+    out.Put(uint8_t(file->has_crc32));
+  }
+
+  out.Put(uint32_t(regions.size()));
+  for (auto &region: regions)
+  {
+    out.PutString(region->region_name);
+    out.Put(uint64_t(region->stride));
+    out.Put(uint64_t(region->chunk_size));
+    out.PutString(region->byte_layout);
+    out.Put(uint8_t(region->required));
+    out.Put(uint32_t(region->files.size()));
+    for (auto &file: region->files)
+      out.Put(file_index[file]);
+  }
+
+  out.Put(uint32_t(m_game_info_by_game.size()));
+  for (auto &v: m_game_info_by_game)
+  {
+    const Game &game = v.second;
+    out.PutString(v.first);
+    out.PutString(game.parent);
+    out.PutString(game.title);
+    out.PutString(game.version);
+    out.PutString(game.manufacturer);
+    out.Put(uint32_t(game.year));
+    out.PutString(game.stepping);
+    out.PutString(game.mpeg_board);
+    out.Put(uint32_t(game.audio));
+    out.PutString(game.pci_bridge);
+    out.Put(game.real3d_pci_id);
+    out.Put(game.real3d_status_bit_set_percent_of_frame);
+    out.Put(game.encryption_key);
+    out.Put(uint8_t(game.netboard_present));
+    out.Put(uint8_t(game.ppc_idle_skip));
+    out.Put(game.inputs);
+    out.Put(uint32_t(game.driveboard_type));
+  }
+
+  out.Put(uint32_t(m_patches_by_game.size()));
+  for (auto &v1: m_patches_by_game)
+  {
+    out.PutString(v1.first);
+    out.Put(uint32_t(v1.second.size()));
+    for (auto &v2: v1.second)
+    {
+      out.PutString(v2.first);
+      out.Put(uint32_t(v2.second.size()));
+      for (auto &patch: v2.second)
+      {
+        out.Put(patch.offset);
+        out.Put(patch.value);
+        out.Put(uint32_t(patch.bits));
+      }
+    }
+  }
+
+  for (auto *regions_by_game: { &m_regions_by_game, &m_regions_by_merged_game })
+  {
+    out.Put(uint32_t(regions_by_game->size()));
+    for (auto &v1: *regions_by_game)
+    {
+      out.PutString(v1.first);
+      out.Put(uint32_t(v1.second.size()));
+      for (auto &v2: v1.second)
+      {
+        out.PutString(v2.first);
+        out.Put(region_index[v2.second]);
+      }
+    }
+  }
+
+  // Write to a temporary file first so that other instances never read a
+  // partial database (or write to the same temporary file)
+  std::string tmp_path = FileSystemPath::GetTempFilePath(path);
+  FILE *fp = fopen(tmp_path.c_str(), "wb");
+  bool error = NULL == fp;
+  if (fp)
+  {
+    error = fwrite(out.bytes.data(), 1, out.bytes.size(), fp) != out.bytes.size();
+    error = (fclose(fp) != 0) || error;
+  }
+  if (!error)
+  {
+    std::remove(path.c_str());
+    error = std::rename(tmp_path.c_str(), path.c_str()) != 0;
+  }
+  if (error)
+  {
+    // The database is only a shortcut, so this is not worth failing over
+    std::remove(tmp_path.c_str());
+    InfoLog("Unable to write compiled game database '%s'.", path.c_str());
+  }
+}
+
 bool GameLoader::LoadDefinitionXML(const std::string &filename)
 {
   m_xml_filename = filename;
+
+  // The compiled database is keyed on the XML's size, modification time, and
+  // contents, which are cheap to check compared to parsing them
+  std::vector<uint8_t> xml_bytes;
+  std::string cache_path;
+  std::string cache_key;
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(filename, ec);
+  if (!ec && ReadWholeFile(&xml_bytes, filename))
+  {
+    uint32_t crc = uint32_t(crc32(0, xml_bytes.data(), uInt(xml_bytes.size())));
+    cache_path = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Cache) << std::filesystem::path(filename).stem().string() << ".gdb";
+    cache_key = Util::Format() << xml_bytes.size() << ':' << int64_t(mtime.time_since_epoch().count()) << ':' << Util::Hex(crc);
+    if (LoadDefinitionCache(cache_path, cache_key))
+    {
+      InfoLog("Loaded compiled game database '%s'.", cache_path.c_str());
+      return false;
+    }
+  }
+
   Util::Config::Node xml("xml");
   if (Util::Config::FromXMLFile(&xml, filename))
   {
     ErrorLog("Game and ROM set definitions could not be loaded! ROMs will not be detected.");
     return true;
   }
-  return ParseXML(xml);
+  bool error = ParseXML(xml);
+
+  // Only a clean parse is saved, so that any problems keep being reported
+  if (!error && !cache_key.empty())
+    StoreDefinitionCache(cache_path, cache_key);
+  return error;
+}
+
+void GameLoader::BuildFileIndex()
+{
+  for (auto &v1: m_game_info_by_game)
+  {
+    const std::string &game_name = v1.first;
+    auto &regions_by_game = IsChildSet(v1.second) ? m_regions_by_merged_game : m_regions_by_game;
+    auto it = regions_by_game.find(game_name);
+    if (it == regions_by_game.end())
+      continue;
+
+    // As in IdentifyGamesInZipArchive(), optional regions don't count
+    std::set<File::ptr_t> files;
+    for (auto &v2: it->second)
+    {
+      const Region::ptr_t &region = v2.second;
+      if (!region->required)
+        continue;
+      for (auto &file: region->files)
+      {
+        if (!files.insert(file).second)
+          continue;
+        FileRef ref{ game_name, region, file };
+        if (file->has_crc32)
+          m_required_files_by_crc[file->crc32].push_back(ref);
+        else
+          m_required_files_by_name[file->filename].push_back(ref);
+      }
+    }
+    m_num_required_files_by_game[game_name] = files.size();
+  }
+
+  // Names of every file, required or not, for identifying loose files
+  for (auto &v1: m_regions_by_game)
+  {
+    for (auto &v2: v1.second)
+    {
+      for (auto &file: v2.second->files)
+      {
+        if (!file->has_crc32)
+          continue;
+        std::vector<uint32_t> &crcs = m_crcs_by_filename[file->filename];
+        if (std::find(crcs.begin(), crcs.end(), file->crc32) == crcs.end())
+          crcs.push_back(file->crc32);
+      }
+    }
+  }
 }
 
 void GameLoader::FindEquivalentFiles(std::set<File::ptr_t> *equivalent_files, const std::set<File::ptr_t> &a, const std::set<File::ptr_t> &b)
@@ -778,9 +1612,10 @@ bool GameLoader::ComputeRegionSize(uint32_t *region_size, const GameLoader::Regi
   return error;
 }
 
-static bool ApplyLayout(ROM *rom, const std::string &byte_layout, size_t stride, const std::string &region_name)
+static bool ParseLayout(std::vector<size_t> *lane_map, const std::string &byte_layout, size_t stride, const std::string &region_name)
 {
   // Empty layout means do nothing
+  lane_map->clear();
   if (byte_layout.empty())
     return false;
 
@@ -827,68 +1662,70 @@ static bool ApplyLayout(ROM *rom, const std::string &byte_layout, size_t stride,
     expected_offset += 1;
   }
 
-  // Okay, all good. Now we can reshuffle the region memory according to layout.
-  uint8_t *buffer = new uint8_t[stride];
-  uint8_t *dest = rom->data.get();
-  for (size_t dest_offset = 0; (dest_offset + stride) <= rom->size; dest_offset += stride)
+  // Okay, all good. Byte i of each stride is taken from byte_offsets[i] of
+  // the original layout, so invert this to find where each loaded byte goes.
+  lane_map->resize(stride);
+  for (size_t i = 0; i < stride; i++)
   {
-    // Copy current region bytes to temporary buffer. The layout offsets refer to this original layout.
-    memcpy(buffer, dest + dest_offset, stride);
-
-    // Place the bytes back into the ROM region in the layout order specified.
-    for (size_t i = 0; i < stride; i++)
-    {
-      dest[dest_offset + i] = buffer[byte_offsets[i]];
-    }
+    (*lane_map)[byte_offsets[i]] = i;
   }
-  delete [] buffer;
 
   return false; // no error
 }
 
-bool GameLoader::LoadRegion(ROM *rom, const GameLoader::Region::ptr_t &region, const ZipArchive &zip) const
+static bool FilesOverlap(uint32_t offset_a, size_t size_a, uint32_t offset_b, size_t size_b, size_t chunk_size, size_t stride)
 {
-  bool error = false;
+  // Interleaved files overlap only if their address ranges intersect and
+  // their chunks fall on the same bytes within a stride
+  size_t end_a = offset_a + (size_a / chunk_size - 1) * stride + chunk_size;
+  size_t end_b = offset_b + (size_b / chunk_size - 1) * stride + chunk_size;
+  if (end_a <= offset_b || end_b <= offset_a)
+    return false;
+  size_t d = (offset_b + stride - offset_a % stride) % stride;
+  return d < chunk_size || (stride - d) < chunk_size;
+}
 
+bool GameLoader::QueueRegion(std::vector<LoadJob> *jobs, ROM *rom, const GameLoader::Region::ptr_t &region, const std::vector<size_t> &lane_map, const ZipArchive &zip) const
+{
+  std::vector<std::pair<File::ptr_t, const ZippedFile *>> files;
   for (auto &file: region->files)
   {
-    std::shared_ptr<uint8_t> tmp;
-    size_t file_size;
-    error |= LoadZippedFile(&tmp, &file_size, file, zip);
-    if (!error)
-    {
-      uint8_t *dest = rom->data.get();
-      uint8_t *src = tmp.get();
-      if (region->chunk_size == region->stride)
-      {
-        memcpy(dest + file->offset, src, file_size);
-      }
-      else
-      {
-        uint32_t num_chunks = (uint32_t)(file_size / region->chunk_size);
-        uint32_t dest_offset = file->offset;
-        uint32_t src_offset = 0;
-        uint32_t chunk_size = (uint32_t)region->chunk_size;		// cache these as pointer dereferencing cripples performance in a tight loop
-        uint32_t stride = (uint32_t)region->stride;
-        for (uint32_t i = 0; i < num_chunks; i++)
-        {
-          memcpy(dest + dest_offset, src + src_offset, chunk_size);
-          dest_offset += stride;
-          src_offset += chunk_size;
-        }
-      }
-    }
+    const ZippedFile *zipped_file = LookupFile(file, zip);
+    if (!zipped_file)
+      return true;
+    files.emplace_back(file, zipped_file);
   }
 
-  if (!error)
+  // Files normally fill disjoint bytes of the region and can be inflated
+  // concurrently. If any overlap, load them together in their listed order
+  // so that later files still take precedence.
+  bool overlap = false;
+  for (size_t i = 0; i < files.size() && !overlap; i++)
   {
-    error = ApplyLayout(rom, region->byte_layout, region->stride, region->region_name);
+    for (size_t j = i + 1; j < files.size() && !overlap; j++)
+      overlap = FilesOverlap(files[i].first->offset, files[i].second->uncompressed_size, files[j].first->offset, files[j].second->uncompressed_size, region->chunk_size, region->stride);
   }
 
-  return error;
+  for (auto &v: files)
+  {
+    if (overlap && !jobs->empty() && jobs->back().rom == rom)
+    {
+      jobs->back().files.push_back(v);
+      jobs->back().total_size += v.second->uncompressed_size;
+      continue;
+    }
+    LoadJob job;
+    job.rom = rom;
+    job.region = region;
+    job.lane_map = &lane_map;
+    job.files.push_back(v);
+    job.total_size = v.second->uncompressed_size;
+    jobs->push_back(job);
+  }
+  return false;
 }
 
-bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const ZipArchive &zip) const
+bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const ZipArchive &zip, bool load_data) const
 {
   auto it = m_game_info_by_game.find(game_name);
   if (it == m_game_info_by_game.end())
@@ -901,24 +1738,42 @@ bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const Z
   auto &regions_by_name = IsChildSet(it->second) ? m_regions_by_merged_game.find(game_name)->second : m_regions_by_game.find(game_name)->second;
   LogROMDefinition(game_name, regions_by_name);
   bool error = false;
+
+  // Size and allocate each region and queue up its files. Nothing is
+  // inflated yet.
+  std::map<std::string, bool> error_by_region;
+  std::map<std::string, std::vector<size_t>> lane_map_by_region;
+  std::vector<LoadJob> jobs;
   for (auto &v: regions_by_name)
   {
     auto &region = v.second;
     uint32_t region_size = 0;
-    bool error_loading_region = false;
+    bool &error_loading_region = error_by_region[region->region_name];
+    auto &lane_map = lane_map_by_region[region->region_name];
 
-    // Attempt to load the region
-    if (ComputeRegionSize(&region_size, region, zip))
+    if (ComputeRegionSize(&region_size, region, zip) || ParseLayout(&lane_map, region->byte_layout, region->stride, region->region_name))
       error_loading_region = true;
     else
     {
-      // Load up the ROM region
       auto &rom = rom_set->rom_by_region[region->region_name];
-      rom.data.reset(new uint8_t[region_size], std::default_delete<uint8_t[]>());
       rom.size = region_size;
-      error_loading_region = LoadRegion(&rom, region, zip);
+      if (load_data)
+      {
+        rom.data.reset(new uint8_t[region_size], std::default_delete<uint8_t[]>());
+        error_loading_region = QueueRegion(&jobs, &rom, region, lane_map, zip);
+      }
     }
+  }
+
+  // Inflate everything in parallel, directly into the regions
+  RunLoadJobs(&jobs);
+  for (auto &job: jobs)
+    error_by_region[job.region->region_name] |= job.error;
 
+  for (auto &v: regions_by_name)
+  {
+    auto &region = v.second;
+    bool error_loading_region = error_by_region[region->region_name];
     if (error_loading_region && !region->required)
     {
       // Failed to load the region but it wasn't required anyway, so remove it
@@ -944,6 +1799,26 @@ bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const Z
     else if (rom_set->rom_by_region.find(region_name) != rom_set->rom_by_region.end())
       rom_set->rom_by_region[region_name].patches = patches;
   }
+
+  // Describe exactly what was loaded so that processed images can be cached
+  Util::Format key;
+  key << game_name;
+  for (auto &v: regions_by_name)
+  {
+    auto &region = v.second;
+    auto it = rom_set->rom_by_region.find(region->region_name);
+    if (it == rom_set->rom_by_region.end())
+      continue;
+    key << ";" << region->region_name << ":" << region->stride << ":" << region->chunk_size << ":" << region->byte_layout << ":" << it->second.size;
+    for (auto &file: region->files)
+    {
+      const ZippedFile *zipped_file = LookupFile(file, zip);
+      key << "," << Util::Hex(zipped_file ? zipped_file->crc32 : 0) << "@" << Util::Hex(file->offset);
+    }
+    for (auto &patch: it->second.patches)
+      key << "," << Util::Hex(patch.offset) << "=" << Util::Hex(patch.value) << "/" << patch.bits;
+  }
+  rom_set->cache_key = key.str();
   return error;
 }
 
@@ -968,29 +1843,36 @@ std::string StripFilename(const std::string &filepath)
   return std::string(filepath, 0, last_slash + 1);
 }
 
-bool GameLoader::Load(Game *game, ROMSet *rom_set, const std::string &zipfilename) const
+bool GameLoader::Load(Game *game, ROMSet *rom_set, const std::string &zipfilename, bool load_data) const
 {
   *game = Game();
 
-  // Read the zip contents
+  // Read the zip contents (a directory may be given with a trailing slash)
+  std::string path = zipfilename;
+  while (path.size() > 1 && (path.back() == '/' || path.back() == '\\'))
+    path.pop_back();
   ZipArchive zip;
-  if (LoadZipArchive(&zip, zipfilename))
+  if (LoadZipArchive(&zip, path))
     return true;
 
   // Pick the game to load (there could be multiple ROM sets in a zip file)
   std::string chosen_game;
   bool missing_parent_roms = false;
-  ChooseGameInZipArchive(&chosen_game, &missing_parent_roms, zip, zipfilename);
+  ChooseGameInZipArchive(&chosen_game, &missing_parent_roms, zip, path);
   if (chosen_game.empty())
     return true;
 
   // Return game information to caller
   *game = m_game_info_by_game.find(chosen_game)->second;
 
-  // Bring in additional parent ROM set if needed
+  // Bring in additional parent ROM set if needed, from a zip archive or,
+  // failing that, a directory alongside this one
   if (missing_parent_roms)
   {
-    std::string parent_zipfilename = StripFilename(zipfilename) + game->parent + ".zip";
+    std::string parent_zipfilename = StripFilename(path) + game->parent + ".zip";
+    std::error_code ec;
+    if (!std::filesystem::exists(parent_zipfilename, ec) && std::filesystem::is_directory(StripFilename(path) + game->parent, ec))
+      parent_zipfilename = StripFilename(path) + game->parent;
     if (LoadZipArchive(&zip, parent_zipfilename))
     {
       ErrorLog("Expected to find parent ROM set of '%s' at '%s'.", game->name.c_str(), parent_zipfilename.c_str());
@@ -999,13 +1881,133 @@ bool GameLoader::Load(Game *game, ROMSet *rom_set, const std::string &zipfilenam
   }
 
   // Load
-  bool error = LoadROMs(rom_set, game->name, zip);
+  bool error = LoadROMs(rom_set, game->name, zip, load_data);
   if (error)
     *game = Game();
   return error;
 }
 
-GameLoader::GameLoader(const std::string &xml_file)
+// Central directory of one archive found by ScanROMDirectory()
+struct ScannedZip
+{
+  std::string zipfilename;
+  std::vector<uint32_t> crcs;
+  std::vector<std::string> filenames; // lower case
+  bool error = false;
+};
+
+static void ReadZipDirectory(ScannedZip *zip)
+{
+  unzFile zf = unzOpen(zip->zipfilename.c_str());
+  if (NULL == zf)
+  {
+    zip->error = true;
+    return;
+  }
+  int err;
+  for (err = unzGoToFirstFile(zf); err == UNZ_OK; err = unzGoToNextFile(zf))
+  {
+    unz_file_info file_info;
+    char filename_buffer[256];
+    if (UNZ_OK != unzGetCurrentFileInfo(zf, &file_info, filename_buffer, sizeof(filename_buffer), NULL, 0, NULL, 0))
+      continue;
+    zip->crcs.push_back(uint32_t(file_info.crc));
+    zip->filenames.push_back(Util::ToLower(filename_buffer));
+  }
+  zip->error = err != UNZ_END_OF_LIST_OF_FILE;
+  unzClose(zf);
+}
+
+std::map<std::string, std::string> GameLoader::ScanROMDirectory(const std::string &directory) const
+{
+  std::vector<ScannedZip> zips;
+  std::error_code ec;
+  for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+  {
+    if (it->is_regular_file(ec) && Util::ToLower(it->path().extension().string()) == ".zip")
+    {
+      zips.emplace_back();
+      zips.back().zipfilename = it->path().string();
+    }
+  }
+  if (ec)
+    ErrorLog("Unable to read the contents of '%s'.", directory.c_str());
+  std::sort(zips.begin(), zips.end(), [](const ScannedZip &a, const ScannedZip &b) { return a.zipfilename < b.zipfilename; });
+
+  // Read each archive and look up its files in the index, all in parallel
+  typedef std::map<std::string, std::set<File::ptr_t>> FilesByGame_t;
+  std::vector<FilesByGame_t> files_found_by_game(zips.size());
+  Util::ParallelFor(0, zips.size(), zips.size(), [&](size_t first, size_t last)
+  {
+    for (size_t i = first; i < last; i++)
+    {
+      ReadZipDirectory(&zips[i]);
+      for (uint32_t crc: zips[i].crcs)
+      {
+        auto it = m_required_files_by_crc.find(crc);
+        if (it == m_required_files_by_crc.end())
+          continue;
+        for (auto &ref: it->second)
+          files_found_by_game[i][ref.game].insert(ref.file);
+      }
+      for (auto &filename: zips[i].filenames)
+      {
+        auto it = m_required_files_by_name.find(filename);
+        if (it == m_required_files_by_name.end())
+          continue;
+        for (auto &ref: it->second)
+          files_found_by_game[i][ref.game].insert(ref.file);
+      }
+    }
+  });
+
+  std::map<std::string, size_t> zip_by_filename;
+  for (size_t i = 0; i < zips.size(); i++)
+  {
+    if (zips[i].error)
+      ErrorLog("Unable to read the contents of '%s'.", zips[i].zipfilename.c_str());
+    zip_by_filename[std::filesystem::path(zips[i].zipfilename).filename().string()] = i;
+  }
+
+  std::map<std::string, std::string> playable_games;
+  for (size_t i = 0; i < zips.size(); i++)
+  {
+    for (auto &v: files_found_by_game[i])
+    {
+      const std::string &game_name = v.first;
+      const Game &game = m_game_info_by_game.find(game_name)->second;
+      size_t num_required = m_num_required_files_by_game.find(game_name)->second;
+      size_t num_found = v.second.size();
+
+      // Load() looks for the rest of a child set next to it, in <parent>.zip
+      if (num_found < num_required && IsChildSet(game))
+      {
+        auto parent = zip_by_filename.find(game.parent + ".zip");
+        if (parent != zip_by_filename.end() && parent->second != i)
+        {
+          auto parent_files = files_found_by_game[parent->second].find(game_name);
+          if (parent_files != files_found_by_game[parent->second].end())
+          {
+            std::set<File::ptr_t> files(v.second);
+            files.insert(parent_files->second.begin(), parent_files->second.end());
+            num_found = files.size();
+          }
+        }
+      }
+      if (num_found != num_required)
+        continue;
+
+      bool named_after_game = std::filesystem::path(zips[i].zipfilename).stem().string() == game_name;
+      if (named_after_game || playable_games.find(game_name) == playable_games.end())
+        playable_games[game_name] = zips[i].zipfilename;
+    }
+  }
+  return playable_games;
+}
+
+GameLoader::GameLoader(const std::string &xml_file, bool verify_crcs)
+  : m_verify_crcs(verify_crcs)
 {
   LoadDefinitionXML(xml_file);
+  BuildFileIndex();
 }
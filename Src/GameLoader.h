@@ -7,6 +7,8 @@
 #include "ROMSet.h"
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 class GameLoader
 {
@@ -53,17 +55,43 @@ private:
   std::map<std::string, RegionsByName_t> m_regions_by_merged_game;  // only child sets merged w/ parents
   std::string m_xml_filename;
 
-  // Single compressed file inside of a zip archive
+  // Index of the files every game needs (child sets merged with their
+  // parents), for identifying many archives at once without comparing each
+  // one against every game
+  struct FileRef
+  {
+    std::string game;
+    Region::ptr_t region;
+    File::ptr_t file;
+  };
+  std::unordered_map<uint32_t, std::vector<FileRef>> m_required_files_by_crc;
+  std::map<std::string, std::vector<FileRef>> m_required_files_by_name;  // files without a CRC32
+  std::map<std::string, size_t> m_num_required_files_by_game;
+
+  // Every CRC32 that each file name (lower case) stands for, so that loose
+  // files can be identified by name without reading them
+  std::map<std::string, std::vector<uint32_t>> m_crcs_by_filename;
+
+  // Whether to check the CRC32s of files that are copied rather than inflated
+  // (minizip checks inflated ones itself)
+  bool m_verify_crcs;
+
+  // Single file of a ROM set, inside of a zip archive or loose in a directory
   struct ZippedFile
   {
     unzFile zf = nullptr;
-    std::string zipfilename;  // zip archive
-    std::string filename;     // file inside the zip archive
+    std::string zipfilename;  // zip archive or directory
+    std::string filename;     // file inside the zip archive or directory
+    std::string path;         // path of a loose file (empty if in a zip archive)
     size_t uncompressed_size = 0;
     uint32_t crc32 = 0;
+    unz_file_pos pos = {};    // position in the central directory, for seeking without a name search
+    bool stored = false;      // stored in the zip archive without compression, so it can be mapped
+    uint64_t data_offset = 0; // where a stored file's data starts in the zip archive
+    bool verified = false;    // loose file already read to compute crc32 (rather than found in the cache)
   };
 
-  // Multiple zip archives
+  // Multiple zip archives and directories
   struct ZipArchive
   {
     std::vector<std::string> zipfilenames;
@@ -80,15 +108,34 @@ private:
   };
 
   bool LoadZipArchive(ZipArchive *zip, const std::string &zipfilename) const;
+  bool LoadROMDirectory(ZipArchive *zip, const std::string &directory) const;
   const ZippedFile *LookupFile(const File::ptr_t &file, const ZipArchive &zip) const;
   bool FileExistsInZipArchive(const File::ptr_t &file, const ZipArchive &zip) const;
-  bool LoadZippedFile(std::shared_ptr<uint8_t> *buffer, size_t *file_size, const GameLoader::File::ptr_t &file, const ZipArchive &zip) const;
+  // One unit of work for the ROM loading thread pool: files inflated or
+  // copied, in order, directly into their ROM region
+  struct LoadJob
+  {
+    ROM *rom = nullptr;
+    Region::ptr_t region;
+    const std::vector<size_t> *lane_map = nullptr;  // final position of each byte within a stride (empty if no byte layout)
+    std::vector<std::pair<File::ptr_t, const ZippedFile *>> files;
+    size_t total_size = 0;
+    bool error = false;
+  };
+
+  static void CopyToRegion(ROM *rom, const Region &region, const std::vector<size_t> &lane_map, const File &file, const uint8_t *src, size_t pos_in_file, size_t len);
+  bool LoadZippedFile(ROM *rom, const Region &region, const std::vector<size_t> &lane_map, const File &file, const ZippedFile &zipped_file, unzFile zf, std::vector<uint8_t> *block) const;
+  bool LoadMappedFile(ROM *rom, const Region &region, const std::vector<size_t> &lane_map, const File &file, const ZippedFile &zipped_file) const;
+  void RunLoadJobs(std::vector<LoadJob> *jobs) const;
   static bool MissingAttrib(const GameLoader &loader, const Util::Config::Node &node, const std::string &attribute);
   bool LoadGamesFromXML(const Util::Config::Node &xml);
   bool MergeChildrenWithParents();
   void LogROMDefinition(const std::string &game_name, const RegionsByName_t &regions_by_name) const;
   bool ParseXML(const Util::Config::Node &xml);
+  bool LoadDefinitionCache(const std::string &path, const std::string &key);
+  void StoreDefinitionCache(const std::string &path, const std::string &key) const;
   bool LoadDefinitionXML(const std::string &filename);
+  void BuildFileIndex();
   static void FindEquivalentFiles(std::set<File::ptr_t> *equivalent_files, const std::set<File::ptr_t> &a, const std::set<File::ptr_t> &b);
   void IdentifyGamesInZipArchive(
     std::set<std::string> *complete_games,
@@ -97,16 +144,47 @@ private:
     const std::map<std::string, RegionsByName_t> &regions_by_game) const;
   bool ComputeRegionSize(uint32_t *region_size, const Region::ptr_t &region, const ZipArchive &zip) const;
   void ChooseGameInZipArchive(std::string *chosen_game, bool *missing_parent_roms, const ZipArchive &zip, const std::string &zipfilename) const;
-  bool LoadRegion(ROM *buffer, const GameLoader::Region::ptr_t &region, const ZipArchive &zip) const;
-  bool LoadROMs(ROMSet *rom_set, const std::string &game_name, const ZipArchive &zip) const;
+  bool QueueRegion(std::vector<LoadJob> *jobs, ROM *rom, const Region::ptr_t &region, const std::vector<size_t> &lane_map, const ZipArchive &zip) const;
+  bool LoadROMs(ROMSet *rom_set, const std::string &game_name, const ZipArchive &zip, bool load_data) const;
 
 public:
-  GameLoader(const std::string &xml_file);
-  bool Load(Game *game, ROMSet *rom_set, const std::string &zipfilename) const;
+  /*
+   * GameLoader(xml_file, verify_crcs):
+   *
+   * Parameters:
+   *    xml_file      Game definition file.
+   *    verify_crcs   Whether to check the CRC32 of every file that is mapped
+   *                  rather than inflated (loose files in a directory and
+   *                  files stored uncompressed in a zip archive) on the
+   *                  loader workers as it is loaded. Loose files are
+   *                  identified by CRC32, cached by file size and
+   *                  modification time, and are still checked on every
+   *                  load. Without it, loose files are identified by name.
+   */
+  GameLoader(const std::string &xml_file, bool verify_crcs = false);
+
+  // Loads from a zip archive or a directory holding the unpacked ROM set.
+  // If load_data is false, the ROM set is only sized, patched, and keyed
+  // (see ROMSet::cache_key) without inflating anything.
+  bool Load(Game *game, ROMSet *rom_set, const std::string &zipfilename, bool load_data = true) const;
   const std::map<std::string, Game> &GetGames() const
   {
     return m_game_info_by_game;
   }
+
+  /*
+   * ScanROMDirectory(directory):
+   *
+   * Finds the games that can be loaded from the zip archives in a directory.
+   * Only the central directory of each archive is read, and archives are
+   * read in parallel. A child set also counts if its parent's archive,
+   * <parent>.zip, supplies the rest of its files, as it would for Load().
+   *
+   * Returns:
+   *    Map of each playable game to the archive to load it from. If several
+   *    archives hold a game, the one named after it is preferred.
+   */
+  std::map<std::string, std::string> ScanROMDirectory(const std::string &directory) const;
 };
 
 #endif  // INCLUDED_GAMELOADER_H
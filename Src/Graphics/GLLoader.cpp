@@ -0,0 +1,97 @@
+#include "GLLoader.h"
+#include <GL/glew.h>
+
+GLLoader::GLLoader(std::function<bool()> makeCurrent, std::function<void()> release) :
+	m_makeCurrent(std::move(makeCurrent)),
+	m_release(std::move(release)),
+	m_running(false),
+	m_stop(false),
+	m_started(false),
+	m_startDone(false)
+{
+}
+
+GLLoader::~GLLoader()
+{
+	if (m_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+	}
+}
+
+bool GLLoader::Start()
+{
+	m_thread = std::thread(&GLLoader::Run, this);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_startDone; });
+
+	if (!m_started) {
+		lock.unlock();
+		m_thread.join();
+	}
+
+	return m_started;
+}
+
+void GLLoader::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(job));
+	}
+	m_wake.notify_one();
+}
+
+void GLLoader::Finish()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_jobs.empty() && !m_running; });
+}
+
+void GLLoader::Run()
+{
+	bool started = m_makeCurrent();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_started = started;
+		m_startDone = true;
+	}
+	m_idle.notify_all();
+
+	if (!started) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true) {
+		m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+
+		if (m_jobs.empty()) {
+			break;							// only stops once everything queued has run
+		}
+
+		std::function<void()> job = std::move(m_jobs.front());
+		m_jobs.pop_front();
+		m_running = true;
+		lock.unlock();
+
+		job();
+		glFinish();							// objects must be complete before the render context uses them
+
+		lock.lock();
+		m_running = false;
+		if (m_jobs.empty()) {
+			m_idle.notify_all();
+		}
+	}
+
+	lock.unlock();
+	m_release();
+}
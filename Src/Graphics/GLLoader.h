@@ -0,0 +1,45 @@
+#ifndef _GLLOADER_H_
+#define _GLLOADER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs GL work such as shader compiles and links on a thread of its own, with
+// a context that shares objects with the render context, so that the render
+// thread doesn't stall on it. The OSD layer creates the context and supplies
+// the functions that make it current on the loader thread and release it.
+// Jobs run in the order they were submitted, each followed by glFinish(), so
+// their results are visible to the render context once a job has returned.
+class GLLoader
+{
+public:
+
+	GLLoader(std::function<bool()> makeCurrent, std::function<void()> release);
+	~GLLoader();
+
+	bool	Start();								// false if the context can't be made current
+	void	Submit(std::function<void()> job);
+	void	Finish();								// waits until all submitted jobs have run
+
+private:
+
+	void	Run();
+
+	std::function<bool()>	m_makeCurrent;
+	std::function<void()>	m_release;
+
+	std::thread				m_thread;
+	std::mutex				m_mutex;
+	std::condition_variable	m_wake;				// a job was queued or the thread should stop
+	std::condition_variable	m_idle;				// the queue ran empty
+	std::deque<std::function<void()>> m_jobs;
+	bool					m_running;			// a job has been taken off the queue but hasn't finished
+	bool					m_stop;
+	bool					m_started;			// result of making the context current
+	bool					m_startDone;
+};
+
+#endif
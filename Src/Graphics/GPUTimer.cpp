@@ -0,0 +1,62 @@
+#include "GPUTimer.h"
+
+GPUTimer::GPUTimer() :
+	m_index(0),
+	m_micros(0)
+{
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		m_queries[i] = 0;
+		m_issued[i] = false;
+	}
+}
+
+GPUTimer::~GPUTimer()
+{
+	if (m_queries[0]) {
+		glDeleteQueries(NUM_QUERIES, m_queries);
+	}
+}
+
+bool GPUTimer::IsSupported()
+{
+	return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+void GPUTimer::Begin()
+{
+	if (!IsSupported()) {
+		return;
+	}
+
+	if (!m_queries[0]) {
+		glGenQueries(NUM_QUERIES, m_queries);	// created on first use, when the context is current
+	}
+
+	m_index = (m_index + 1) % NUM_QUERIES;
+
+	// the query about to be reused was issued two frames ago and has almost always completed
+	if (m_issued[m_index]) {
+		GLint available = 0;
+		glGetQueryObjectiv(m_queries[m_index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(m_queries[m_index], GL_QUERY_RESULT, &nanoseconds);
+			m_micros = (UINT32)(nanoseconds / 1000);
+		}
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, m_queries[m_index]);
+	m_issued[m_index] = true;
+}
+
+void GPUTimer::End()
+{
+	if (IsSupported()) {
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+}
+
+UINT32 GPUTimer::GetMicros() const
+{
+	return m_micros;
+}
@@ -0,0 +1,34 @@
+#ifndef _GPUTIMER_H_
+#define _GPUTIMER_H_
+
+#include <GL/glew.h>
+#include "Types.h"
+
+// Measures the GPU time of a render pass with GL_TIME_ELAPSED queries. Results
+// are read back without stalling from the query issued two frames earlier, so
+// GetMicros() lags the current frame. Begin()/End() pairs of different timers
+// must not overlap. Without timer queries (OpenGL ES), every time reads 0.
+class GPUTimer
+{
+public:
+
+	GPUTimer();
+	~GPUTimer();
+
+	static bool IsSupported();
+
+	void	Begin();
+	void	End();
+	UINT32	GetMicros() const;
+
+private:
+
+	static const int NUM_QUERIES = 3;
+
+	GLuint	m_queries[NUM_QUERIES];
+	bool	m_issued[NUM_QUERIES];
+	int		m_index;
+	UINT32	m_micros;
+};
+
+#endif
@@ -4,6 +4,40 @@
 #include <cstdint>
 #include "Types.h"
 
+/*
+ * GPUPassTimings:
+ *
+ * GPU time of each render pass in a recent frame, in microseconds. Renderers
+ * that are not instrumented report zeros.
+ */
+struct GPUPassTimings
+{
+  UINT32 fogMicros;         // ambient and scroll fog
+  UINT32 layerMicros[4];    // scene, by priority layer
+  UINT32 compositeMicros;   // compositing the layers into the frame
+  UINT32 drawCalls;         // draw calls issued for the scene (this frame, not lagged)
+};
+
+/*
+ * RenderStats:
+ *
+ * What the renderer did to draw the last frame, for tuning settings. Counts
+ * a renderer doesn't keep are reported as zero.
+ */
+struct RenderStats
+{
+  UINT32 viewports;
+  UINT32 nodes;             // culling nodes traversed, zero for a reused scene
+  UINT32 models;            // models drawn
+  UINT32 modelCacheHits;    // models looked up that were already decoded
+  UINT32 modelCacheMisses;  // models looked up that had to be decoded
+  UINT32 meshes;            // meshes of the models drawn
+  UINT32 drawCalls;
+  UINT32 uniformUpdates;    // uniform and uniform buffer writes
+  UINT32 vertsUploaded;     // vertices written to vertex buffers
+  UINT32 texelsUploaded;
+};
+
 /*
  * IRender3D:
  *
@@ -22,6 +56,51 @@ public:
   virtual void SetSunClamp(bool enable) = 0;
   virtual float GetLosValue(int layer) = 0;
 
+  virtual void GetGPUTimings(GPUPassTimings *timings)
+  {
+    *timings = GPUPassTimings();
+  }
+
+  virtual void GetRenderStats(RenderStats *stats)
+  {
+    *stats = RenderStats();
+  }
+
+  // Called before BeginFrame() with whether culling and polygon RAM are known
+  // to be unchanged since the previous frame, in which case a renderer may
+  // draw the scene it built then instead of traversing it again
+  virtual void SetSceneUnchanged(bool unchanged)
+  {
+  }
+
+  // Called before BeginFrame() with the 4 KB pages of polygon RAM written
+  // since the previous frame, one bit per page, or NULL if writes aren't
+  // tracked. Lets a renderer keep models decoded from pages left alone.
+  virtual void SetPolygonRAMChanges(const uint8_t *dirtyPages)
+  {
+  }
+
+  // Likewise for the 4 KB pages of low (4 MB) and high (1 MB) culling RAM,
+  // with loPages NULL if writes aren't tracked. Lets a renderer keep the
+  // parts of the scene built from pages left alone.
+  virtual void SetCullingRAMChanges(const uint8_t *loPages, const uint8_t *hiPages)
+  {
+  }
+
+  // Asks the renderer to leave its finished layers in textures rather than
+  // compositing them into the frame, so that the caller can composite them
+  // together with the 2D layers. Returns false if it can't.
+  virtual bool SetExternalComposite(bool enable)
+  {
+    return false;
+  }
+
+  // Opaque and the two translucent layer textures of the last frame rendered,
+  // and whether anything was drawn to the translucent ones
+  virtual void GetCompositeLayers(unsigned textures[3], bool *alphaLayers)
+  {
+  }
+
   virtual ~IRender3D()
   {
   }
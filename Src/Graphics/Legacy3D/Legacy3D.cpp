@@ -166,6 +166,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
@@ -366,11 +367,42 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
   glActiveTexture(GL_TEXTURE0 + texSheet->mapNum);           // activate correct texture unit
   glBindTexture(GL_TEXTURE_2D, texMapIDs[texSheet->mapNum]); // bind correct texture map
   glTexSubImage2D(GL_TEXTURE_2D, 0, texSheet->xOffset + x, texSheet->yOffset + y, width, height, GL_RGBA, GL_FLOAT, textureBuffer);
+  m_stats.texelsUploaded += width * height;
   
   // Mark texture as decoded
   texSheet->texFormat[y/32][x/32] = format;
   texSheet->texWidth[y/32][x/32] = width;
   texSheet->texHeight[y/32][x/32] = height;
+  textureGeneration++;
+
+  // Record it in every tile it covers
+  UINT16 corner = UINT16(texSheet->sheetNum<<12 | (y/32)<<6 | (x/32));
+  for (int yi = y/32; yi < (y+height+31)/32; yi++)
+  {
+    for (int xi = x/32; xi < (x+width+31)/32; xi++)
+    {
+      std::vector<UINT16> &textures = tileTextures[yi][xi];
+      if (std::find(textures.begin(), textures.end(), corner) == textures.end())
+        textures.push_back(corner);
+    }
+  }
+}
+
+// Hashes a 32x32 texel tile of texture RAM 8 bytes at a time. Never returns 0, which marks an unknown tile.
+static UINT64 HashTextureTile(const UINT16 *tile)
+{
+  UINT64 hash = 0xCBF29CE484222325ULL;
+  for (int yi = 0; yi < 32; yi++, tile += 2048)
+  {
+    UINT64 words[8];
+    memcpy(words, tile, sizeof(words));
+    for (int i = 0; i < 8; i++)
+    {
+      hash = (hash ^ words[i]) * 0x100000001B3ULL;
+      hash ^= hash >> 29;
+    }
+  }
+  return hash | 1;
 }
 
 // Signals that new textures have been uploaded. Flushes model caches. Be careful not to exceed bounds!
@@ -387,17 +419,35 @@ void CLegacy3D::UploadTextures(unsigned level, unsigned x, unsigned y, unsigned
   }
 #endif
 
-  // Update all texture sheets
-  for (size_t texSheet = 0; texSheet < numTexSheets; texSheet++)
+  // Update all texture sheets, skipping tiles that were rewritten with the same data
+  for (size_t xi = x/32; xi < (x+width)/32; xi++)
   {
-    for (size_t xi = x/32; xi < (x+width)/32; xi++)
+    for (size_t yi = y/32; yi < (y+height)/32; yi++)
     {
-      for (size_t yi = y/32; yi < (y+height)/32; yi++)
+      if (textureRAM != NULL)
+      {
+        UINT64 hash = HashTextureTile(&textureRAM[yi*32*2048 + xi*32]);
+        if (hash == tileHash[yi][xi])
+          continue;
+        tileHash[yi][xi] = hash;
+      }
+      for (size_t texSheet = 0; texSheet < numTexSheets; texSheet++)
       {
         texSheets[texSheet].texFormat[yi][xi] = -1;
         texSheets[texSheet].texWidth[yi][xi] = -1;
         texSheets[texSheet].texHeight[yi][xi] = -1;
       }
+      // Textures that start in another tile but cover this one. They are re-recorded here when decoded again, entries
+      // left in their other tiles only cause an unneeded invalidation.
+      for (UINT16 corner : tileTextures[yi][xi])
+      {
+        TexSheet &sheet = texSheets[corner>>12];
+        sheet.texFormat[(corner>>6)&63][corner&63] = -1;
+        sheet.texWidth[(corner>>6)&63][corner&63] = -1;
+        sheet.texHeight[(corner>>6)&63][corner&63] = -1;
+      }
+      tileTextures[yi][xi].clear();
+      textureGeneration++;
     }
   }
 }
@@ -602,8 +652,11 @@ Result CLegacy3D::DrawModel(UINT32 modelAddr)
       Cache = &PolyCache;
   }
     
-  if (NULL == ModelRef)
+  if (NULL != ModelRef)
+    m_stats.modelCacheHits++;
+  else
   {
+    m_stats.modelCacheMisses++;
     // Attempt to cache the model, and perform a final check to determine 
     // whether VROM model is in fact dynamic (this should be fixed -- models
     // should be decoded to a common buffer and the cache determined
@@ -634,6 +687,7 @@ Result CLegacy3D::DrawModel(UINT32 modelAddr)
     ModelRef->texRefs.DecodeAllTextures(this);
 
   // Add to display list
+  m_stats.models++;
   return AppendDisplayList(Cache, false, ModelRef);
 }
 
@@ -654,6 +708,7 @@ void CLegacy3D::DescendCullingNode(UINT32 addr)
     --stackDepth;
     return;
   }
+  m_stats.nodes++;
   
   // Set color table address, if one is specified
   if ((node[0x00] & 0x04))
@@ -834,6 +889,7 @@ void CLegacy3D::RenderViewport(UINT32 addr, int pri, bool wideScreen)
   int curPri = (vpnode[0x00] >> 3) & 3; // viewport priority
   if (curPri != pri)
     return;
+  m_stats.viewports++;
   
   // Fetch viewport parameters (TO-DO: would rounding make a difference?)
   int vpX       = (vpnode[0x1A]&0xFFFF)>>4;   // viewport X (12.4 fixed point)
@@ -1053,9 +1109,15 @@ void CLegacy3D::EndFrame(void)
 {
 }
 
+void CLegacy3D::GetRenderStats(RenderStats *stats)
+{
+  *stats = m_stats;
+}
+
 void CLegacy3D::BeginFrame(void)
 {
   //printf("--- BEGIN FRAME ---\n");
+  m_stats = RenderStats();
 }
 
 
@@ -1300,6 +1362,7 @@ Result CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsign
   glLoadIdentity();
 
   // Mark all textures as dirty
+  memset(tileHash, 0, sizeof(tileHash));
   UploadTextures(0, 0, 0, 2048, 2048);
 
   DebugLog("Legacy3D initialized\n");
@@ -1326,6 +1389,7 @@ CLegacy3D::CLegacy3D(const Util::Config::Node &config)
   textureRAM = NULL;
   textureBuffer = NULL;
   texSheets = NULL;
+  textureGeneration = 1;  // CTextureRefs use 0 for never decoded
   
   // Clear model cache pointers so we can safely destroy them if init fails
   for (int i = 0; i < 2; i++)
@@ -1338,6 +1402,8 @@ CLegacy3D::CLegacy3D(const Util::Config::Node &config)
     PolyCache.lut = NULL;
     VROMCache.List = NULL;
     PolyCache.List = NULL;
+    VROMCache.stream = NULL;
+    PolyCache.stream = NULL;
     VROMCache.ListHead[i] = NULL;
     PolyCache.ListHead[i] = NULL;
     VROMCache.ListTail[i] = NULL;
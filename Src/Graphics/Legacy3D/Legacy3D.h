@@ -34,6 +34,7 @@
 #include <GL/glew.h>
 #include "Util/NewConfig.h"
 #include "Types.h"
+#include <vector>
 
 namespace Legacy3D {
 
@@ -172,6 +173,10 @@ struct ModelCache
 	unsigned	vboCurOffset;	// current offset in VBO (in bytes)
 	GLuint		vboID;			// OpenGL VBO handle
 	
+	// Dynamic caches stream models through a copy of the whole VBO that is uploaded in one go before drawing
+	GLfloat		*stream;		// local copy of VBO contents (dynamic caches only)
+	unsigned	streamedOffset;	// bytes of the local copy already uploaded to the VBO (in bytes)
+	
 	// Local vertex buffers (enough for a single model)
 	unsigned	maxVertIdx;		// size of each local vertex buffer (in vertices)
 	unsigned	curVertIdx[2];	// current vertex index (in vertices)
@@ -260,6 +265,17 @@ public:
 	 * the frame.
 	 */
 	void EndFrame(void);
+
+	/*
+	 * GetRenderStats(stats):
+	 *
+	 * Gets what was traversed, drawn and uploaded for the last frame. Models
+	 * are drawn as a whole, so no meshes are counted.
+	 *
+	 * Parameters:
+	 *		stats	Filled with the counts.
+	 */
+	void GetRenderStats(RenderStats *stats);
 	
 	/*
 	 * UploadTextures(x, y, width, height):
@@ -373,6 +389,7 @@ private:
 	
 	// Model caching and display list management
 	void 			DrawDisplayList(ModelCache *Cache, POLY_STATE state);
+	void			FlushModelCache(ModelCache *Cache);
 	Result 			AppendDisplayList(ModelCache *Cache, bool isViewport, const struct VBORef *Model);
 	void 			ClearDisplayList(ModelCache *Cache);
 	int				GetTextureBaseX(const Poly *P) const;
@@ -452,6 +469,7 @@ private:
 	// Scene graph processing
 	int		listDepth;	        // how many lists have we recursed into
 	int		stackDepth;	        // for debugging and error handling purposes
+	RenderStats	m_stats;	        // counted over the frame, reset by BeginFrame()
 	struct TextureOffset
 	{
 	  int x;          // x offset
@@ -486,6 +504,29 @@ private:
 	TexSheet   *texSheets;                   // texture sheet objects
 	TexSheet   *fmtToTexSheet[8];            // final mapping from Model3 texture format to texture sheet
 	
+	/*
+	 * Texture Tile Hashes
+	 *
+	 * Content hash of each 32x32 texel tile of texture RAM as of the last
+	 * time its decoded textures were invalidated (0 if unknown). Uploads that
+	 * rewrite a tile with identical data leave its decoded textures in place.
+	 */
+	UINT64		tileHash[2048/32][2048/32];
+
+	/*
+	 * Texture Tile Index
+	 *
+	 * For each 32x32 texel tile, the decoded textures that cover it, as the
+	 * texture sheet and tile of their upper-left corner (sheet<<12|y<<6|x),
+	 * which is where TexSheet records them. Lets UploadTextures() invalidate
+	 * textures that overlap the uploaded area without starting inside it.
+	 */
+	std::vector<UINT16> tileTextures[2048/32][2048/32];
+
+	// Advanced whenever a decoded texture is invalidated or replaced. Models skip decoding their texture references when it
+	// has not changed since they last did (see CTextureRefs::DecodeAllTextures()).
+	unsigned	textureGeneration;
+	
 	// Shader programs and input data locations
 	GLuint	shaderProgram;			// shader program object
 	GLuint	vertexShader;			// vertex shader handle
@@ -230,6 +230,7 @@ void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
 {
   // Bind and activate VBO (pointers activate currently bound VBO)
   glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
+  FlushModelCache(Cache);
   glVertexPointer(3, GL_FLOAT, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_X*sizeof(GLfloat))); 
   glNormalPointer(GL_FLOAT, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_NX*sizeof(GLfloat))); 
   glTexCoordPointer(2, GL_FLOAT, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_U*sizeof(GLfloat)));
@@ -257,6 +258,10 @@ void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
   bool stencilEnabled = false;
   glDisable(GL_STENCIL_TEST);
   
+  // Track winding locally rather than querying it for every model
+  GLint frontFace;
+  glGetIntegerv(GL_FRONT_FACE, &frontFace);
+  
   // Draw if there are items in the list
   const DisplayList *D = Cache->ListHead[state];
   while (D != NULL)
@@ -267,6 +272,7 @@ void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
       {
         if (!D->next->isViewport)
         {
+          m_stats.uniformUpdates += (lightingLoc != -1) + (projectionMatrixLoc != -1) + (spotEllipseLoc != -1) + (spotRangeLoc != -1) + (spotColorLoc != -1);
           if (lightingLoc != -1)         glUniform3fv(lightingLoc, 2, D->Data.Viewport.lightingParams);
           if (projectionMatrixLoc != -1) glUniformMatrix4fv(projectionMatrixLoc, 1, GL_FALSE, D->Data.Viewport.projectionMatrix);
           glFogf(GL_FOG_DENSITY, D->Data.Viewport.fogParams[3]);
@@ -298,14 +304,19 @@ void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
       else
       {
         // Use appropriate winding convention
-        GLint frontFace;
-        glGetIntegerv(GL_FRONT_FACE, &frontFace);
         if (frontFace != Model.frontFace)
+        {
           glFrontFace(Model.frontFace);
+          frontFace = Model.frontFace;
+        }
       }
       if (modelViewMatrixLoc != -1)
+      {
         glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, Model.modelViewMatrix);
+        m_stats.uniformUpdates++;
+      }
       glDrawArrays(GL_TRIANGLES, Model.index, Model.numVerts);
+      m_stats.drawCalls++;
       if (Model.frontFace == -GL_CW)
         glEnable(GL_CULL_FACE);
     }
@@ -313,6 +324,20 @@ void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
   }
 }
 
+// Uploads the models streamed into a dynamic cache since the last flush (VBO must be bound)
+void CLegacy3D::FlushModelCache(ModelCache *Cache)
+{
+  if (!Cache->dynamic || Cache->vboCurOffset <= Cache->streamedOffset)
+    return;
+  
+  // Starting over, so orphan the old storage rather than waiting for draws still using it
+  if (Cache->streamedOffset == 0)
+    glBufferData(GL_ARRAY_BUFFER, Cache->vboMaxOffset, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, Cache->streamedOffset, Cache->vboCurOffset - Cache->streamedOffset, (const GLubyte *) Cache->stream + Cache->streamedOffset);
+  m_stats.vertsUploaded += (Cache->vboCurOffset - Cache->streamedOffset) / (VBO_VERTEX_SIZE * sizeof(GLfloat));
+  Cache->streamedOffset = Cache->vboCurOffset;
+}
+
 // Appends an instance of a model or viewport to the display list, copying over the required state information
 Result CLegacy3D::AppendDisplayList(ModelCache *Cache, bool isViewport, const struct VBORef *Model)
 {
@@ -953,12 +978,21 @@ void CLegacy3D::EndModel(ModelCache *Cache, struct VBORef *Model, int lutIdx, UI
   // First alpha polygon immediately follows the normal polygons
   Model->index[POLY_STATE_ALPHA] = Model->index[POLY_STATE_NORMAL] + Model->numVerts[POLY_STATE_NORMAL];
 
-  // Upload from local vertex buffer to real VBO
-  glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
-  if (Model->numVerts[POLY_STATE_NORMAL] > 0)
-    glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_NORMAL]);
-  if (Model->numVerts[POLY_STATE_ALPHA] > 0)
-    glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_ALPHA]);
+  // Upload from local vertex buffer to real VBO (dynamic models are collected and uploaded together by FlushModelCache())
+  if (Cache->dynamic)
+  {
+    for (size_t i = 0; i < 2; i++)
+      memcpy(&Cache->stream[Model->index[i]*VBO_VERTEX_SIZE], Cache->verts[i], Model->numVerts[i]*VBO_VERTEX_SIZE*sizeof(GLfloat));
+  }
+  else
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
+    if (Model->numVerts[POLY_STATE_NORMAL] > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_NORMAL]);
+    if (Model->numVerts[POLY_STATE_ALPHA] > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_ALPHA]);
+    m_stats.vertsUploaded += Model->numVerts[POLY_STATE_NORMAL] + Model->numVerts[POLY_STATE_ALPHA];
+  }
     
   // Record LUT index in the model VBORef
   Model->lutIdx = lutIdx;
@@ -1175,6 +1209,7 @@ struct VBORef *CLegacy3D::LookUpModel(ModelCache *Cache, int lutIdx, UINT16 text
 void CLegacy3D::ClearModelCache(ModelCache *Cache)
 {
   Cache->vboCurOffset = 0;
+  Cache->streamedOffset = 0;
   for (size_t i = 0; i < 2; i++)
     Cache->curVertIdx[i] = 0;
   for (size_t i = 0; i < Cache->numModels; i++)
@@ -1234,6 +1269,10 @@ Result CLegacy3D::CreateModelCache(ModelCache *Cache, unsigned vboMaxVerts,
   // Set the VBO to the size we obtained
   Cache->vboMaxOffset = vboBytes;
   Cache->vboCurOffset = 0;
+  Cache->streamedOffset = 0;
+  
+  // ... local copy of the VBO to stream dynamic models through
+  Cache->stream = isDynamic ? new(std::nothrow) GLfloat[vboBytes/sizeof(GLfloat)] : nullptr;
   
   // Attempt to allocate space for local VBO
   for (size_t i = 0; i < 2; i++)
@@ -1258,7 +1297,7 @@ Result CLegacy3D::CreateModelCache(ModelCache *Cache, unsigned vboMaxVerts,
   Cache->maxListSize = displayListSize;
   
   // Check if memory allocation succeeded
-  if ((Cache->verts[0]==NULL) || (Cache->verts[1]==NULL) || (Cache->Models==NULL) || (Cache->lut==NULL) || (Cache->List==NULL))
+  if ((Cache->verts[0]==NULL) || (Cache->verts[1]==NULL) || (Cache->Models==NULL) || (Cache->lut==NULL) || (Cache->List==NULL) || (isDynamic && Cache->stream==NULL))
   {
     DestroyModelCache(Cache);
     return ErrorLog("Insufficient memory for model cache.");
@@ -1283,6 +1322,7 @@ void CLegacy3D::DestroyModelCache(ModelCache *Cache)
   delete [] Cache->Models;
   delete [] Cache->lut;
   delete [] Cache->List;
+  delete [] Cache->stream;
 
   memset(Cache, 0, sizeof(ModelCache));
 }
@@ -24,10 +24,12 @@
  *
  * Class that tracks unique texture references, eg in a cached model.
  *
- * Texture references are stored internally as a 27-bit field (3 bits for format, 6 bits each for x, y, width & height) to save space.
- * 
- * A pre-allocated array is used for storing up to TEXREFS_ARRAY_SIZE texture references.  When that limit is exceeded, it switches
- * to using a hashset to store the texture references, but this requires extra memory allocation.
+ * Texture references are stored internally as a 27-bit field (3 bits for format, 6 bits each for x, y, width & height) to save space,
+ * with bit 31 set to tell them apart from empty slots.
+ *
+ * They are held in an open addressing hashset with linear probing. Small sets fit in TEXREFS_INLINE_SLOTS slots inside the
+ * object itself, larger ones move to a heap array that doubles as needed and is kept when cleared, so that cached models can
+ * be rebuilt without allocating. Removal shifts later entries of the probe sequence back instead of leaving tombstones.
  */
 
 #include "TextureRefs.h"
@@ -37,14 +39,15 @@
 
 namespace Legacy3D {
 
-CTextureRefs::CTextureRefs() : m_size(0), m_hashCapacity(0), m_hashEntries(NULL)
+CTextureRefs::CTextureRefs() : m_size(0), m_mask(TEXREFS_INLINE_SLOTS - 1), m_slots(m_inline), m_generation(0)
 {
-	memset(m_array, 0, sizeof(m_array));
+	memset(m_inline, 0, sizeof(m_inline));
 }
 
 CTextureRefs::~CTextureRefs()
 {
-	DeleteAllHashEntries();
+	if (m_slots != m_inline)
+		delete[] m_slots;
 }
 
 unsigned CTextureRefs::GetSize() const
@@ -54,282 +57,121 @@ unsigned CTextureRefs::GetSize() const
 
 void CTextureRefs::Clear()
 {
-	// Delete all hash entries
-	DeleteAllHashEntries();
+	// Keep the capacity, only empty the slots
+	if (m_size > 0)
+		memset(m_slots, 0, (m_mask + 1) * sizeof(unsigned));
 	m_size = 0;
-	m_hashCapacity = 0;
-	m_hashEntries = NULL;
+	m_generation = 0;
 }
 
 bool CTextureRefs::ContainsRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
 {
-	// Pack texture reference into bitfield
-	unsigned texRef = (fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
-	
-	// Check if using array or hashset
-	if (m_size <= TEXREFS_ARRAY_SIZE)
-	{
-		// See if texture reference held in array
-		for (unsigned i = 0; i < m_size; i++)
-		{
-			if (texRef == m_array[i])
-				return true;
-		}
-		return false;
-	}
-	else
-		// See if texture reference held in hashset
-		return HashContains(texRef);
+	return m_slots[FindSlot(PackRef(fmt, x, y, width, height))] != 0;
 }
 
 bool CTextureRefs::AddRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
 {
-	// Pack texture reference into bitfield
-	unsigned texRef = (fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
-
-	// Check if using array or hashset
-	if (m_size <= TEXREFS_ARRAY_SIZE)
-	{
-		// See if already held in array, if so nothing to do
-		for (unsigned i = 0; i < m_size; i++)
-		{
-			if (texRef == m_array[i])
-				return true;
-		}
-		// If not, check if array is full
-		if (m_size == TEXREFS_ARRAY_SIZE)
-		{
-			// If so, set initial hashset capacity to 47 to initialize it
-			UpdateHashCapacity(47);
-			// Copy array into hashset
-			for (unsigned i = 0; i < TEXREFS_ARRAY_SIZE; i++)
-				AddToHash(m_array[i]);
-			// Add texture reference to hashset
-			AddToHash(texRef);
-		}
-		else
-		{
-			// Add texture reference to array
-			m_array[m_size] = texRef;
-			m_size++;
-		}
+	unsigned texRef = PackRef(fmt, x, y, width, height);
+	unsigned slot = FindSlot(texRef);
+	// If already held, nothing to do
+	if (m_slots[slot])
 		return true;
+	// Keep the load factor at most 3/4 so that probe sequences stay short
+	if (4 * (m_size + 1) > 3 * (m_mask + 1))
+	{
+		if (!Grow())
+			return false;
+		slot = FindSlot(texRef);
 	}
-	else
-		// Add texture reference to hashset
-		return AddToHash(texRef);
+	m_slots[slot] = texRef;
+	m_size++;
+	m_generation = 0;	// not decoded yet
+	return true;
 }
 
 bool CTextureRefs::RemoveRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
 {
-	// Pack texture reference into bitfield
-	unsigned texRef = (fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
-
-	// Check if using array or hashset
-	if (m_size <= TEXREFS_ARRAY_SIZE)
-	{
-		for (unsigned i = 0; i < m_size; i++)
-		{
-			if (texRef == m_array[i])
-			{
-				for (unsigned j = i + 1; j < m_size; j++)
-					m_array[j - 1] = m_array[j];
-				m_size--;
-				return true;
-			}
-		}
+	unsigned hole = FindSlot(PackRef(fmt, x, y, width, height));
+	if (!m_slots[hole])
 		return false;
-	}
-	else 
+	// Move back any later entries that can no longer be reached past the hole. An entry can move if its home slot is not
+	// between the hole and its current slot (cyclically).
+	for (unsigned i = (hole + 1) & m_mask; m_slots[i]; i = (i + 1) & m_mask)
 	{
-		// Remove texture reference from hashset
-		bool removed = RemoveFromHash(texRef);
-
-		// See if should switch back to array
-		if (m_size == TEXREFS_ARRAY_SIZE)
+		unsigned home = HomeSlot(m_slots[i]);
+		if (((i - home) & m_mask) >= ((i - hole) & m_mask))
 		{
-			// Loop through all hash entries and copy texture references into array
-			unsigned j = 0;
-			for (unsigned i = 0; i < m_hashCapacity; i++)
-			{
-				for (HashEntry *entry = m_hashEntries[i]; entry; entry = entry->nextEntry)
-					m_array[j++] = entry->texRef;
-			}
-			// Delete all hash entries
-			DeleteAllHashEntries();
+			m_slots[hole] = m_slots[i];
+			hole = i;
 		}
-		return removed;
 	}
+	m_slots[hole] = 0;
+	m_size--;
+	return true;
 }
 
 void CTextureRefs::DecodeAllTextures(CLegacy3D *Render3D)
 {
-	// Check if using array or hashset
-	if (m_size <= TEXREFS_ARRAY_SIZE)
-	{
-		// Loop through elements in array and call CLegacy3D::DecodeTexture
-		for (unsigned i = 0; i < m_size; i++)
-		{
-			// Unpack texture reference from bitfield 
-			unsigned texRef = m_array[i];
-			unsigned fmt = texRef>>24;
-			unsigned x = (texRef>>13)&0x7E0;
-			unsigned y = (texRef>>7)&0x7E0;
-			unsigned width = (texRef>>1)&0x7E0;
-			unsigned height = (texRef<<5)&0x7E0;
-			Render3D->DecodeTexture(fmt, x, y, width, height);
-		}
-	}
-	else
-	{
-		// Loop through all hash entriesa and call CLegacy3D::DecodeTexture
-		for (unsigned i = 0; i < m_hashCapacity; i++)
-		{
-			for (HashEntry *entry = m_hashEntries[i]; entry; entry = entry->nextEntry)
-			{
-				// Unpack texture reference from bitfield 
-				unsigned texRef = entry->texRef;
-				unsigned fmt = texRef>>24;
-				unsigned x = (texRef>>13)&0x7E0;
-				unsigned y = (texRef>>7)&0x7E0;
-				unsigned width = (texRef>>1)&0x7E0;
-				unsigned height = (texRef<<5)&0x7E0;
-				Render3D->DecodeTexture(fmt, x, y, width, height);
-			}
-		}
-	}
-}
-
-bool CTextureRefs::UpdateHashCapacity(unsigned capacity)
-{
-	unsigned oldCapacity = m_hashCapacity;
-	HashEntry **oldEntries = m_hashEntries;
-	// Update capacity and create new empty entries array
-	m_hashCapacity = capacity;
-	m_hashEntries = new(std::nothrow) HashEntry*[capacity];
-	if (!m_hashEntries)
-		return false;
-	memset(m_hashEntries, 0, capacity * sizeof(HashEntry*));
-	if (oldEntries)
+	// Decoded textures stay valid until texture RAM is uploaded to or another texture is decoded over them
+	if (m_generation == Render3D->textureGeneration)
+		return;
+	// Loop through all slots and call CLegacy3D::DecodeTexture
+	for (unsigned i = 0; i <= m_mask; i++)
 	{
-		// Redistribute entries into new entries array
-		for (unsigned i = 0; i < oldCapacity; i++)
-		{
-			HashEntry *entry = oldEntries[i];
-			while (entry)
-			{
-				HashEntry *nextEntry = entry->nextEntry;
-				unsigned hash = entry->texRef % capacity;
-				entry->nextEntry = m_hashEntries[hash];
-				m_hashEntries[hash] = entry;
-				entry = nextEntry;
-			}
-		}
-		// Delete old entries array
-		delete[] oldEntries;
+		// Unpack texture reference from bitfield
+		unsigned texRef = m_slots[i];
+		if (!texRef)
+			continue;
+		unsigned fmt = (texRef>>24)&7;
+		unsigned x = (texRef>>13)&0x7E0;
+		unsigned y = (texRef>>7)&0x7E0;
+		unsigned width = (texRef>>1)&0x7E0;
+		unsigned height = (texRef<<5)&0x7E0;
+		Render3D->DecodeTexture(fmt, x, y, width, height);
 	}
-	return true;
+	// Taken after decoding, which may itself have advanced the generation
+	m_generation = Render3D->textureGeneration;
 }
 
-HashEntry *CTextureRefs::CreateHashEntry(unsigned texRef, bool &hashCapacityUpdated)
+unsigned CTextureRefs::PackRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
 {
-	// Update size and increase hash capacity if required
-	m_size++;
-	hashCapacityUpdated = m_size >= m_hashCapacity;
-	if (hashCapacityUpdated)
-	{
-		if (m_hashCapacity < 89)
-			UpdateHashCapacity(89); // Capacity of 89 gives good sequence of mostly prime capacities (89, 179, 359, 719, 1439, 2879 etc)
-		else
-			UpdateHashCapacity(2 * m_hashCapacity + 1);
-	}
-	return new(std::nothrow) HashEntry(texRef);
+	return 0x80000000|(fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
 }
 
-void CTextureRefs::DeleteHashEntry(HashEntry *entry)
+unsigned CTextureRefs::HomeSlot(unsigned texRef) const
 {
-	// Update size and delete hash entry
-	m_size--;
-	delete entry;
+	// Fibonacci hashing, the low bits of texture references vary little
+	unsigned hash = texRef * 0x9E3779B1u;
+	return (hash ^ (hash >> 16)) & m_mask;
 }
 
-void CTextureRefs::DeleteAllHashEntries()
+unsigned CTextureRefs::FindSlot(unsigned texRef) const
 {
-	if (!m_hashEntries)
-		return;
-	// Delete all hash entries and their storage
-	for (unsigned i = 0; i < m_hashCapacity; i++)
-	{
-		HashEntry *entry = m_hashEntries[i];
-		delete entry;
-	}
-	delete[] m_hashEntries;
+	unsigned i = HomeSlot(texRef);
+	while (m_slots[i] && m_slots[i] != texRef)
+		i = (i + 1) & m_mask;
+	return i;
 }
 
-bool CTextureRefs::AddToHash(unsigned texRef)
+bool CTextureRefs::Grow()
 {
-	// Convert texture reference to hash value
-	unsigned hash = texRef % m_hashCapacity;
-	// Loop through linked list for hash value and see if have texture reference already
-	HashEntry *headEntry = m_hashEntries[hash];
-	HashEntry *entry = headEntry;
-	while (entry && texRef != entry->texRef)
-		entry = entry->nextEntry;
-	// If found, nothing to do
-	if (entry)
-		return true;
-	// Otherwise, create new hash entry for texture reference
-	bool hashCapacityUpdated;
-	entry = CreateHashEntry(texRef, hashCapacityUpdated);
-	// If couldn't create entry (ie out of memory), let caller know
-	if (!entry)
+	unsigned oldCapacity = m_mask + 1;
+	unsigned *oldSlots = m_slots;
+	unsigned *slots = new(std::nothrow) unsigned[2 * oldCapacity];
+	if (!slots)
 		return false;
-	if (hashCapacityUpdated)
+	memset(slots, 0, 2 * oldCapacity * sizeof(unsigned));
+	m_slots = slots;
+	m_mask = 2 * oldCapacity - 1;
+	// Redistribute entries into the new slots
+	for (unsigned i = 0; i < oldCapacity; i++)
 	{
-		// If hash capacity was increased recalculate hash value
-		hash = texRef % m_hashCapacity;
-		headEntry = m_hashEntries[hash];
+		if (oldSlots[i])
+			m_slots[FindSlot(oldSlots[i])] = oldSlots[i];
 	}
-	// Store hash entry in linked list for hash value
-	entry->nextEntry = headEntry;
-	m_hashEntries[hash] = entry;
-	return true;
-}
-
-bool CTextureRefs::RemoveFromHash(unsigned texRef)
-{
-	// Convert texture reference to hash value
-	unsigned hash = texRef % m_hashCapacity;
-	// Loop through linked list for hash value and see if have texture reference
-	HashEntry *entry = m_hashEntries[hash];
-	HashEntry *prevEntry = NULL;
-	while (entry && texRef != entry->texRef)
-	{
-		prevEntry = entry;
-		entry = entry->nextEntry;
-    }
-	// If not found, nothing to do
-	if (!entry)
-		return false;
-	// Otherwise, remove entry from linked list for hash value
-	if (prevEntry)	
-		prevEntry->nextEntry = entry->nextEntry;
-	else
-		m_hashEntries[hash] = entry->nextEntry;
-	// Delete hash entry storage
-	DeleteHashEntry(entry);
+	if (oldSlots != m_inline)
+		delete[] oldSlots;
 	return true;
 }
 
-bool CTextureRefs::HashContains(unsigned texRef) const
-{
-	// Convert texture reference to hash value
-	unsigned hash = texRef % m_hashCapacity;
-	// Loop through linked list for hash value and see if have texture reference
-	HashEntry *entry = m_hashEntries[hash];
-	while (entry && texRef != entry->texRef)
-		entry = entry->nextEntry;
-	return !!entry;
-}
-
 } // Legacy3D
@@ -32,16 +32,7 @@
 
 namespace Legacy3D {
 
-#define TEXREFS_ARRAY_SIZE 12
-
-// Hash entry that holds a texture reference in the hashset
-struct HashEntry
-{
-	const unsigned texRef;	// Texture reference as a bitfield
-	HashEntry *nextEntry;   // Next entry with the same hash
-  
-	HashEntry(unsigned theTexRef) : texRef(theTexRef), nextEntry(nullptr) { }
-};
+#define TEXREFS_INLINE_SLOTS 16	// power of 2
 
 class CLegacy3D;
 
@@ -54,6 +45,9 @@ public:
 	 * Constructor.
 	 */
     CTextureRefs();
+
+	CTextureRefs(const CTextureRefs &) = delete;
+	CTextureRefs &operator=(const CTextureRefs &) = delete;
     
 	/*
 	 * ~CTextureRefs():
@@ -98,9 +92,10 @@ public:
 	bool RemoveRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height);
 
 	/*
-	 * RemoveRef(fmt, x, y, width, height):
+	 * DecodeAllTextures(Render3D):
 	 *
-	 * Decodes all texture references held, calling CLegacy3D::DecodeTexture for each one.
+	 * Decodes all texture references held, calling CLegacy3D::DecodeTexture for each one. Does nothing if no texture has
+	 * been invalidated or decoded since the last call.
 	 */
 	void DecodeAllTextures(CLegacy3D *Render3D);
 
@@ -108,61 +103,42 @@ private:
 	// Number of texture references held.
 	unsigned m_size;
 
-	// Pre-allocated array used to hold first TEXREFS_ARRAY_SIZE texture references.
-	unsigned m_array[TEXREFS_ARRAY_SIZE];
+	// Open addressing hashset (linear probing) of texture references as bitfields with bit 31 set, 0 marks an empty slot.
+	// Starts out in m_inline and only moves to the heap when that would be more than 3/4 full.
+	unsigned m_mask;		// capacity - 1
+	unsigned *m_slots;
+	unsigned m_inline[TEXREFS_INLINE_SLOTS];
 
-	// Dynamically allocated hashset used to hold texture references when there are more than TEXREFS_ARRAY_SIZE.
-	unsigned m_hashCapacity;
-	HashEntry **m_hashEntries;
-    
-	/*
-	 * UpdateHashCapacity(hashCapacity)
-	 *
-	 * Increases capacity of the hashset to given size.
-	 */
-	bool UpdateHashCapacity(unsigned hashCapacity);
+	// CLegacy3D::textureGeneration when all references were last decoded (0 if never).
+	unsigned m_generation;
 
 	/*
-	 * CreateHashEntry(texRef, hashCapacityUpdated)
+	 * PackRef(fmt, x, y, width, height)
 	 *
-	 * Creates and returns a new hash entry, updating the capacity if required (hashCapacityUpdated is set to true).
+	 * Returns the texture reference as a bitfield, with bit 31 set so that it can never be 0.
 	 */
-	HashEntry *CreateHashEntry(unsigned texRef, bool &hashCapacityUpdated);
+	static unsigned PackRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height);
 
 	/*
-	 * DeleteHashEntry(entry)
-	 *
-	 * Deletes the given hash entry and its storage.
-	 */
-	void DeleteHashEntry(HashEntry *entry);
-	
-	/*
-	 * DeleteAllHashEntries()
-	 *
-	 * Deletes all hash entries and their storage.
-	 */
-    void DeleteAllHashEntries();
-	
-	/*
-	 * AddToHash(texRef)
+	 * HomeSlot(texRef)
 	 *
-	 * Adds the given texture reference (as a bitfield) to the hashset.
+	 * Returns the index of the slot where the probe sequence for the given texture reference starts.
 	 */
-	bool AddToHash(unsigned texRef);
+	unsigned HomeSlot(unsigned texRef) const;
 
 	/*
-	 * RemoveFromHash(texRef)
+	 * FindSlot(texRef)
 	 *
-	 * Removes the given texture reference (as a bitfield) from the hashset.
+	 * Returns the index of the slot holding the given texture reference, or of the empty slot where it would go.
 	 */
-	bool RemoveFromHash(unsigned texRef);
+	unsigned FindSlot(unsigned texRef) const;
 
 	/*
-	 * HashContains(texRef)
+	 * Grow()
 	 *
-	 * Returns true if given texture reference (as a bitfield) is held in the hashset.
+	 * Doubles the capacity of the hashset. Returns false if out of memory.
 	 */
-    bool HashContains(unsigned texRef) const;
+	bool Grow();
 };
 
 } // Legacy3D
@@ -1,4 +1,5 @@
 #include "GLSLShader.h"
+#include "Graphics/Shader.h"
 #include <cstdio>
 
 GLSLShader::GLSLShader() 
@@ -34,9 +35,19 @@ GLSLShader& GLSLShader::operator=(GLSLShader&& other) noexcept
 	return *this;
 }
 
-bool GLSLShader::LoadShaders(const char* vertexShader, const char* fragmentShader) 
+bool GLSLShader::LoadShaders(const char* vertexShaderSource, const char* fragmentShaderSource) 
 {
+	std::string vertexSource	= TranslateShaderSource(vertexShaderSource);
+	std::string fragmentSource	= TranslateShaderSource(fragmentShaderSource);
+	const char* vertexShader	= vertexSource.c_str();
+	const char* fragmentShader	= fragmentSource.c_str();
+
 	m_program = glCreateProgram();
+
+	if (LoadCachedProgram(m_program, { vertexShader, fragmentShader })) {
+		return true;
+	}
+
 	m_vShader = glCreateShader(GL_VERTEX_SHADER);
 	m_fShader = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -55,9 +66,39 @@ bool GLSLShader::LoadShaders(const char* vertexShader, const char* fragmentShade
 	PrintShaderInfoLog(m_fShader);
 	PrintProgramInfoLog(m_program);
 
+	SaveCachedProgram(m_program, { vertexShader, fragmentShader });
+
 	return true;
 }
 
+bool GLSLShader::LoadComputeShader(const char* computeShaderSource)
+{
+	std::string computeSource	= TranslateShaderSource(computeShaderSource);
+	const char* computeShader	= computeSource.c_str();
+
+	m_program = glCreateProgram();
+
+	if (LoadCachedProgram(m_program, { computeShader })) {
+		return true;
+	}
+
+	m_vShader = glCreateShader(GL_COMPUTE_SHADER);		// only stage, so it takes the vertex shader's slot
+
+	glShaderSource(m_vShader, 1, &computeShader, NULL);
+	glCompileShader(m_vShader);
+	glAttachShader(m_program, m_vShader);
+	glLinkProgram(m_program);
+
+	PrintShaderInfoLog(m_vShader);
+	PrintProgramInfoLog(m_program);
+
+	SaveCachedProgram(m_program, { computeShader });
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(m_program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
 void GLSLShader::UnloadShaders()
 {
 	if (m_program) {
@@ -17,6 +17,7 @@ public:
 	GLSLShader& operator=(GLSLShader&& other) noexcept;
 
 	bool LoadShaders(const char* vertexShader, const char* fragmentShader);
+	bool LoadComputeShader(const char* computeShader);		// returns false if the program fails to link
 	void UnloadShaders();
 
 	void EnableShader();
@@ -2,6 +2,14 @@
 #include <cmath>
 #include <utility>
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAT4_X86_SIMD
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define MAT4_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
 #endif
@@ -25,6 +33,35 @@ void Mat4::LoadIdentity()
 
 void Mat4::MultiMatrices(const float a[16], const float b[16], float r[16]) 
 {
+	// each column of r is a sum over the columns of a, added up in the same order as the scalar version so both give
+	// identical results. All of a and b are read before r is written, as r may be either of them.
+#if defined(MAT4_X86_SIMD)
+	const __m128 a0 = _mm_loadu_ps(a + 0), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+	__m128 p[4];
+	for (int j = 0; j < 4; j++) {
+		const float* bj = b + (j << 2);
+		__m128 s = _mm_mul_ps(a0, _mm_set1_ps(bj[0]));
+		s = _mm_add_ps(s, _mm_mul_ps(a1, _mm_set1_ps(bj[1])));
+		s = _mm_add_ps(s, _mm_mul_ps(a2, _mm_set1_ps(bj[2])));
+		p[j] = _mm_add_ps(s, _mm_mul_ps(a3, _mm_set1_ps(bj[3])));
+	}
+	for (int j = 0; j < 4; j++) {
+		_mm_storeu_ps(r + (j << 2), p[j]);
+	}
+#elif defined(MAT4_NEON_SIMD)
+	const float32x4_t a0 = vld1q_f32(a + 0), a1 = vld1q_f32(a + 4), a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+	float32x4_t p[4];
+	for (int j = 0; j < 4; j++) {
+		const float* bj = b + (j << 2);
+		float32x4_t s = vmulq_n_f32(a0, bj[0]);				// separate multiplies and adds, a fused multiply-add would round differently
+		s = vaddq_f32(s, vmulq_n_f32(a1, bj[1]));
+		s = vaddq_f32(s, vmulq_n_f32(a2, bj[2]));
+		p[j] = vaddq_f32(s, vmulq_n_f32(a3, bj[3]));
+	}
+	for (int j = 0; j < 4; j++) {
+		vst1q_f32(r + (j << 2), p[j]);
+	}
+#else
 #define A(row,col)  a[(col<<2)+row]
 #define B(row,col)  b[(col<<2)+row]
 #define P(row,col)  r[(col<<2)+row]
@@ -40,6 +77,7 @@ void Mat4::MultiMatrices(const float a[16], const float b[16], float r[16])
 #undef A
 #undef B
 #undef p
+#endif
 }
 
 void Mat4::Copy(const float in[16], float out[16])
@@ -270,6 +308,47 @@ void Mat4::MultMatrix(const float *m)
 	Mat4::MultiMatrices(currentMatrix, m, currentMatrix);
 }
 
+// multiplies by a matrix made of a row major 3x3 rotation and a translation, with a bottom row of 0,0,0,1 that's left out
+// of the sums. Results match MultMatrix() with the equivalent 4x4 matrix.
+void Mat4::MultAffineMatrix(const float *rotation, const float *translation)
+{
+	float* r = currentMatrix;
+
+#if defined(MAT4_X86_SIMD)
+	const __m128 a0 = _mm_loadu_ps(r + 0), a1 = _mm_loadu_ps(r + 4), a2 = _mm_loadu_ps(r + 8), a3 = _mm_loadu_ps(r + 12);
+	for (int j = 0; j < 3; j++) {
+		__m128 s = _mm_mul_ps(a0, _mm_set1_ps(rotation[j]));
+		s = _mm_add_ps(s, _mm_mul_ps(a1, _mm_set1_ps(rotation[3 + j])));
+		s = _mm_add_ps(s, _mm_mul_ps(a2, _mm_set1_ps(rotation[6 + j])));
+		_mm_storeu_ps(r + (j << 2), s);
+	}
+	__m128 s = _mm_mul_ps(a0, _mm_set1_ps(translation[0]));
+	s = _mm_add_ps(s, _mm_mul_ps(a1, _mm_set1_ps(translation[1])));
+	s = _mm_add_ps(s, _mm_mul_ps(a2, _mm_set1_ps(translation[2])));
+	_mm_storeu_ps(r + 12, _mm_add_ps(s, a3));
+#elif defined(MAT4_NEON_SIMD)
+	const float32x4_t a0 = vld1q_f32(r + 0), a1 = vld1q_f32(r + 4), a2 = vld1q_f32(r + 8), a3 = vld1q_f32(r + 12);
+	for (int j = 0; j < 3; j++) {
+		float32x4_t s = vmulq_n_f32(a0, rotation[j]);
+		s = vaddq_f32(s, vmulq_n_f32(a1, rotation[3 + j]));
+		s = vaddq_f32(s, vmulq_n_f32(a2, rotation[6 + j]));
+		vst1q_f32(r + (j << 2), s);
+	}
+	float32x4_t s = vmulq_n_f32(a0, translation[0]);
+	s = vaddq_f32(s, vmulq_n_f32(a1, translation[1]));
+	s = vaddq_f32(s, vmulq_n_f32(a2, translation[2]));
+	vst1q_f32(r + 12, vaddq_f32(s, a3));
+#else
+	for (int i = 0; i < 4; i++) {
+		const float ai0 = r[i], ai1 = r[4 + i], ai2 = r[8 + i], ai3 = r[12 + i];
+		r[i]		= ai0 * rotation[0] + ai1 * rotation[3] + ai2 * rotation[6];
+		r[4 + i]	= ai0 * rotation[1] + ai1 * rotation[4] + ai2 * rotation[7];
+		r[8 + i]	= ai0 * rotation[2] + ai1 * rotation[5] + ai2 * rotation[8];
+		r[12 + i]	= ai0 * translation[0] + ai1 * translation[1] + ai2 * translation[2] + ai3;
+	}
+#endif
+}
+
 void Mat4::LoadMatrix(const float *m)
 {
 	if (!m) {
@@ -304,36 +383,28 @@ void Mat4::MultTransposeMatrix(const float *m)
 	Mat4::MultMatrix(copy);
 }
 
-void Mat4::PushMatrix()
+void MatrixStack::PushMatrix()
 {
-	//==============
-	Mat4Container m;
-	//==============
-
-	if (m_vMat4.size() > 128) {
+	if (m_depth >= MaxDepth) {
 		return;	// check for overflow
 	}
 
-	Mat4::Copy(currentMatrix, m.mat);
-
-	m_vMat4.push_back(m);
+	Mat4::Copy(currentMatrix, m_stack[m_depth++]);
 }
 
-void Mat4::PopMatrix()
+void MatrixStack::PopMatrix()
 {
-	if (m_vMat4.empty()) {
+	if (m_depth == 0) {
 		return;	// check for underflow
 	}
 
-	Mat4::Copy(m_vMat4.back().mat, currentMatrix);
-
-	m_vMat4.pop_back();
+	Mat4::Copy(m_stack[--m_depth], currentMatrix);
 }
 
 // flush the matrix stack
-void Mat4::Release()
+void MatrixStack::Release()
 {
-	m_vMat4.clear();
+	m_depth = 0;
 }
 
 }// New3D
@@ -1,8 +1,6 @@
 #ifndef _MAT4_H_
 #define _MAT4_H_
 
-#include <vector>
-
 namespace New3D {
 
 class Mat4
@@ -20,29 +18,39 @@ public:
 	void Perspective			(float fovy, float aspect, float zNear, float zFar);
 	void Ortho					(float left, float right, float bottom, float top, float nearVal, float farVal);
 	void MultMatrix				(const float *m);
+	void MultAffineMatrix		(const float *rotation, const float *translation);
 	void LoadMatrix				(const float *m);
 	void LoadTransposeMatrix	(const float *m);
 	void MultTransposeMatrix	(const float *m);
-	void PushMatrix				();
-	void PopMatrix				();
-	void Release				();
 
 	operator float*				()       { return currentMatrix; }
 	operator const float*		() const { return currentMatrix; }
 	
 	float currentMatrix[16];
 
-private:
+protected:
 
 	void MultiMatrices			(const float a[16], const float b[16], float r[16]);
 	void Copy					(const float in[16], float out[16]);
 	void Transpose				(float m[16]);
+};
+
+// matrix with a push/pop stack, kept in place so the scene walk never allocates
+class MatrixStack : public Mat4
+{
+public:
+
+	void PushMatrix				();
+	void PopMatrix				();
+	void Release				();
+	int  Depth					() const { return m_depth; }
+
+private:
 
-	struct Mat4Container {
-		float mat[16];	// we must wrap the matrix inside a struct otherwise vector doesn't work
-	};
+	static const int MaxDepth = 129;
 
-	std::vector<Mat4Container> m_vMat4;
+	float	m_stack[MaxDepth][16];
+	int		m_depth = 0;
 };
 
 } // New3D
@@ -83,6 +83,21 @@ struct FVertex : Vertex			// full vertex including face attributes
 	}
 };
 
+struct PackedVertex			// compact vertex, face attributes are stored once per poly in a PackedPoly
+{
+	float	pos[3];				// w is always 1
+	UINT32	normal;				// 10:10:10 signed normalized
+	float	texcoords[2];
+	float	fixedShade;
+};
+
+struct PackedPoly
+{
+	UINT32	faceNormal[2];		// 16 bit signed normalized x,y then z
+	float	textureNP;
+	UINT8	faceColour[4];
+};
+
 enum class Layer { colour, trans1, trans2, trans12 /*both 1&2*/, all, none };
 
 struct Mesh
@@ -116,6 +131,18 @@ struct Mesh
 		return true;
 	}
 
+	// true if both meshes set the same shader and stencil state, ie they can be drawn in one call
+	bool SameState(const Mesh& other) const
+	{
+		return	format == other.format && x == other.x && y == other.y && width == other.width && height == other.height &&
+				page == other.page && inverted == other.inverted && wrapModeU == other.wrapModeU && wrapModeV == other.wrapModeV &&
+				microTexture == other.microTexture && microTextureID == other.microTextureID && microTextureMinLOD == other.microTextureMinLOD &&
+				textured == other.textured && polyAlpha == other.polyAlpha && textureAlpha == other.textureAlpha && alphaTest == other.alphaTest &&
+				layered == other.layered && translatorMap == other.translatorMap && noLosReturn == other.noLosReturn &&
+				fixedShading == other.fixedShading && smoothShading == other.smoothShading && lighting == other.lighting && specular == other.specular &&
+				shininess == other.shininess && specularValue == other.specularValue && fogIntensity == other.fogIntensity;
+	}
+
 	enum TexWrapMode : int { repeat = 0, repeatClamp, mirror, mirrorClamp };
 
 	// texture
@@ -162,14 +189,28 @@ struct Mesh
 	int vertexCount		= 0;			// /3 for triangles /4 for quads
 };
 
+struct PrevVertices				// last poly's vertices, which the next poly can share
+{
+	Vertex	v[4];
+	UINT16	texCoords[4][2];		// un-normalised
+};
+
 struct SortingMesh : public Mesh		// This struct temporarily holds the model data, before it gets copied to the main buffer
 {
+	UINT64 hash = 0;					// poly attributes shared by every poly in the mesh
 	std::vector<FVertex> verts;
+
+	void Reset(UINT64 newHash)			// for reuse by the next model, keeps the vertex storage
+	{
+		static_cast<Mesh&>(*this) = Mesh();
+		hash = newHash;
+		verts.clear();
+	}
 };
 
 struct Model
 {
-	std::shared_ptr<std::vector<Mesh>> meshes;	// this reason why this is a shared ptr to an array, is that multiple models might use the same meshes
+	std::vector<Mesh>* meshes = nullptr;	// not owned. ROM meshes belong to the ROM model store and are shared by every model drawing them, dynamic ones to the frame
 
 	//which memory are we in
 	bool dynamic = true;
@@ -187,6 +228,13 @@ struct Model
 
 	//node transparency
 	float alpha = 1.0f;
+
+	// true if both models set the same shader state
+	bool SameState(const Model& other) const
+	{
+		return	textureOffsetX == other.textureOffsetX && textureOffsetY == other.textureOffsetY && page == other.page &&
+				scale == other.scale && alpha == other.alpha && std::memcmp(modelMat, other.modelMat, sizeof(modelMat)) == 0;
+	}
 };
 
 struct Viewport
@@ -235,6 +283,7 @@ public:
 	bool Pop();
 	bool StackLimit() const;
 	void Reset();
+	int Depth() const { return (int)m_vecAttribs.size(); }
 
 	int currentTexOffsetX;
 	int currentTexOffsetY;
@@ -0,0 +1,183 @@
+#include "ModelCache.h"
+#include "Supermodel.h"
+#include <cstdio>
+#include <cstring>
+
+namespace New3D {
+
+static const char	s_magic[4]	= { 'N', '3', 'D', 'C' };
+static const UINT32	s_version	= 1;
+
+ModelCache::ModelCache()
+{
+	memset(&m_header, 0, sizeof(m_header));
+	m_open	= false;
+	m_dirty	= false;
+}
+
+void ModelCache::Open(const std::string& path, UINT32 vromCRC, int polyVerts, int step)
+{
+	m_path	= path;
+	m_open	= true;
+	m_dirty	= false;
+	m_index.clear();
+	m_data.clear();
+
+	memcpy(m_header.magic, s_magic, sizeof(s_magic));
+	m_header.version	= s_version;
+	m_header.vromCRC	= vromCRC;
+	m_header.polyVerts	= (UINT32)polyVerts;
+	m_header.step		= (UINT32)step;
+	m_header.meshSize	= sizeof(Mesh);
+	m_header.vertexSize	= sizeof(FVertex);
+
+	FILE* fp = fopen(path.c_str(), "rb");
+	if (fp) {
+		fseek(fp, 0, SEEK_END);
+		long size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+
+		if (size > (long)sizeof(Header)) {
+			m_data.resize(size);
+			if (fread(m_data.data(), 1, size, fp) != (size_t)size) {
+				m_data.clear();
+			}
+		}
+
+		fclose(fp);
+	}
+
+	// a cache for different data or a different build is simply replaced
+	if (m_data.size() < sizeof(Header) || memcmp(m_data.data(), &m_header, sizeof(Header)) != 0) {
+		m_data.assign((const UINT8*)&m_header, (const UINT8*)&m_header + sizeof(Header));
+		return;
+	}
+
+	size_t offset = sizeof(Header);
+	while (offset < m_data.size()) {
+		size_t size = ParseEntry(offset);
+		if (size == 0) {
+			break;
+		}
+
+		Entry entry;
+		memcpy(&entry, &m_data[offset], sizeof(Entry));
+		m_index[entry.modelAddr] = offset;
+		offset += size;
+	}
+
+	m_data.resize(offset);		// drop anything truncated
+
+	DebugLog("Loaded %u cached models from %s\n", (unsigned)m_index.size(), path.c_str());
+}
+
+bool ModelCache::IsOpen() const
+{
+	return m_open;
+}
+
+size_t ModelCache::ParseEntry(size_t offset) const
+{
+	size_t end = offset + sizeof(Entry);
+	if (end > m_data.size()) {
+		return 0;
+	}
+
+	Entry entry;
+	memcpy(&entry, &m_data[offset], sizeof(Entry));
+
+	for (UINT32 i = 0; i < entry.numMeshes; i++) {
+		if (end + sizeof(Mesh) > m_data.size()) {
+			return 0;
+		}
+
+		Mesh mesh;
+		memcpy(&mesh, &m_data[end], sizeof(Mesh));
+		end += sizeof(Mesh);
+
+		if (mesh.vertexCount < 0 || end + (size_t)mesh.vertexCount * sizeof(FVertex) > m_data.size()) {
+			return 0;
+		}
+
+		end += (size_t)mesh.vertexCount * sizeof(FVertex);
+	}
+
+	return end - offset;
+}
+
+bool ModelCache::Load(UINT32 modelAddr, std::vector<SortingMesh>& meshes) const
+{
+	auto it = m_index.find(modelAddr);
+	if (it == m_index.end()) {
+		return false;
+	}
+
+	size_t offset = it->second;
+
+	Entry entry;
+	memcpy(&entry, &m_data[offset], sizeof(Entry));
+	offset += sizeof(Entry);
+
+	meshes.reserve(entry.numMeshes);
+
+	for (UINT32 i = 0; i < entry.numMeshes; i++) {
+		meshes.emplace_back();
+		SortingMesh& mesh = meshes.back();
+
+		memcpy((Mesh*)&mesh, &m_data[offset], sizeof(Mesh));
+		offset += sizeof(Mesh);
+
+		const FVertex* verts = (const FVertex*)&m_data[offset];
+		offset += mesh.vertexCount * sizeof(FVertex);
+
+		mesh.verts.assign(verts, verts + mesh.vertexCount);
+	}
+
+	return true;
+}
+
+void ModelCache::Store(UINT32 modelAddr, const std::vector<Mesh>& meshes, const std::vector<FVertex>& romBuffer)
+{
+	if (!m_open || m_index.count(modelAddr)) {
+		return;
+	}
+
+	Entry entry = { modelAddr, (UINT32)meshes.size() };
+
+	size_t offset = m_data.size();
+	const UINT8* p = (const UINT8*)&entry;
+	m_data.insert(m_data.end(), p, p + sizeof(Entry));
+
+	for (const auto& mesh : meshes) {
+		p = (const UINT8*)&mesh;
+		m_data.insert(m_data.end(), p, p + sizeof(Mesh));
+
+		if (mesh.vertexCount) {
+			p = (const UINT8*)&romBuffer[mesh.vboOffset];
+			m_data.insert(m_data.end(), p, p + mesh.vertexCount * sizeof(FVertex));
+		}
+	}
+
+	m_index[modelAddr] = offset;
+	m_dirty = true;
+}
+
+void ModelCache::Flush()
+{
+	if (!m_open || !m_dirty) {
+		return;
+	}
+
+	FILE* fp = fopen(m_path.c_str(), "wb");
+	if (fp == nullptr) {
+		ErrorLog("Unable to write model cache to %s.\n", m_path.c_str());
+		return;
+	}
+
+	fwrite(m_data.data(), 1, m_data.size(), fp);
+	fclose(fp);
+
+	m_dirty = false;
+}
+
+} // New3D
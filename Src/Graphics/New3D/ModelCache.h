@@ -0,0 +1,68 @@
+#ifndef _MODELCACHE_H_
+#define _MODELCACHE_H_
+
+#include "Types.h"
+#include "Model.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace New3D {
+
+/*
+ * ModelCache:
+ *
+ * On-disk cache of decoded VROM models. The file is read once when opened,
+ * new models are collected during the session and the whole file is
+ * rewritten by Flush(). Entries are only valid for the VROM contents, vertex
+ * layout and hardware step they were decoded with, all of which are checked
+ * against the file header.
+ */
+class ModelCache
+{
+public:
+	ModelCache();
+
+	void Open		(const std::string& path, UINT32 vromCRC, int polyVerts, int step);
+	bool IsOpen		() const;
+
+	// fills in the meshes and their vertices as if just decoded, returns false if not cached
+	bool Load		(UINT32 modelAddr, std::vector<SortingMesh>& meshes) const;
+
+	// records a freshly decoded model, the vertices are read from romBuffer at each mesh's vbo offset
+	void Store		(UINT32 modelAddr, const std::vector<Mesh>& meshes, const std::vector<FVertex>& romBuffer);
+
+	void Flush		();		// writes the file if anything new was stored
+
+private:
+	struct Header
+	{
+		char	magic[4];
+		UINT32	version;
+		UINT32	vromCRC;
+		UINT32	polyVerts;
+		UINT32	step;
+		UINT32	meshSize;
+		UINT32	vertexSize;
+	};
+
+	struct Entry
+	{
+		UINT32	modelAddr;
+		UINT32	numMeshes;
+	};
+
+	size_t ParseEntry(size_t offset) const;		// returns entry size, 0 if invalid
+
+	std::string					m_path;
+	Header						m_header;
+	std::vector<UINT8>			m_data;			// header and entries, loaded then appended to
+	std::unordered_map<UINT32, size_t> m_index;	// model address to entry offset in m_data
+	bool						m_open;
+	bool						m_dirty;
+};
+
+} // New3D
+
+#endif
@@ -1,4 +1,5 @@
 #include "New3D.h"
+#include "Supermodel.h"
 #include "Vec.h"
 #include <cmath>
 #include <algorithm>
@@ -7,9 +8,17 @@
 #include <unordered_map>
 #include "R3DFloat.h"
 #include "Util/BitCast.h"
+#include "Util/Format.h"
+#include "Util/JobSystem.h"
+#include "Util/Trace.h"
+#include "OSD/FileSystemPath.h"
+#include "Graphics/Shader.h"
+#include <zlib.h>
 
 #define MAX_RAM_VERTS 300000
 #define MAX_ROM_VERTS 1500000
+#define ROM_PAGE_VERTS 30000		// multiple of 3 and 4 so polys never straddle pages
+#define MAX_INSTANCES 16384			// matrices of instanced models per frame, at 4 texels each the minimum texture buffer size
 
 #define BYTE_TO_FLOAT(B)	((2.0f * (B) + 1.0f) * (float)(1.0/255.0))
 
@@ -17,15 +26,50 @@
 
 namespace New3D {
 
+// the quad pulling shader reads vertices as words at fixed offsets (see vertexShaderR3DQuadsPull)
+static_assert(sizeof(FVertex) == 15 * 4 && sizeof(PackedVertex) == 7 * 4, "vertex layout no longer matches the quad pulling shader");
+
+static UINT32 PackSnorm(float value, int bits)
+{
+	int max = (1 << (bits - 1)) - 1;
+	int i	= (int)std::lround(std::min(std::max(value, -1.0f), 1.0f) * max);
+
+	return (UINT32)i & ((1u << bits) - 1);
+}
+
+// verts must start on a poly boundary, face attributes are taken from the first vertex of each poly
+static void PackVertices(const FVertex* verts, int count, int polyVerts, PackedVertex* packedVerts, PackedPoly* packedPolys)
+{
+	for (int i = 0; i < count; i++) {
+
+		const FVertex& v = verts[i];
+		PackedVertex& p = packedVerts[i];
+
+		for (int j = 0; j < 3; j++) { p.pos[j] = v.pos[j]; }
+		p.normal		= PackSnorm(v.normal[0], 10) | (PackSnorm(v.normal[1], 10) << 10) | (PackSnorm(v.normal[2], 10) << 20);
+		p.texcoords[0]	= v.texcoords[0];
+		p.texcoords[1]	= v.texcoords[1];
+		p.fixedShade	= v.fixedShade;
+
+		if (i % polyVerts == 0) {
+			PackedPoly& poly = packedPolys[i / polyVerts];
+
+			poly.faceNormal[0]	= PackSnorm(v.faceNormal[0], 16) | (PackSnorm(v.faceNormal[1], 16) << 16);
+			poly.faceNormal[1]	= PackSnorm(v.faceNormal[2], 16);
+			poly.textureNP		= v.textureNP;
+			for (int j = 0; j < 4; j++) { poly.faceColour[j] = v.faceColour[j]; }
+		}
+	}
+}
+
 CNew3D::CNew3D(const Util::Config::Node &config, const std::string& gameName) : 
 	m_r3dShader(config),
 	m_r3dScrollFog(config),
 	m_gameName(gameName),
+	m_descendNodePtr(&CNew3D::DescendNodePtr<2>),
 	m_vao(0),
 	m_aaTarget(0),
-	m_LODBlendTable(nullptr),
 	m_currentPriority(0),
-	m_matrixBasePtr(nullptr),
 	m_xRatio(0),
 	m_yRatio(0),
 	m_xOffs(0),
@@ -40,8 +84,41 @@ CNew3D::CNew3D(const Util::Config::Node &config, const std::string& gameName) :
 	m_polyRAM(nullptr),
 	m_vrom(nullptr),
 	m_textureRAM(nullptr),
-	m_prev{ 0 },
-	m_prevTexCoords{ 0 }
+	m_sceneThread(nullptr),
+	m_sceneStart(nullptr),
+	m_sceneDone(nullptr),
+	m_stopSceneThread(false),
+	m_sceneBuilding(false),
+	m_sceneReuseEnabled(false),
+	m_sceneUnchanged(false),
+	m_sceneValid(false),
+	m_sceneSunClamp(true),
+	m_sceneReused(false),
+	m_prev{},
+	m_decodeCount(0),
+	m_decodeJobs(1),
+	m_dynamicMeshCount(0),
+	m_ramVerts(nullptr),
+	m_ramPolys(nullptr),
+	m_ramVertCount(0),
+	m_ramVertBase(MAX_ROM_VERTS),
+	m_polyRAMChanges{},
+	m_polyRAMTracked(false),
+	m_polyRAMUnknown(false),
+	m_subtreeRecording(false),
+	m_subtreePrevValid(false),
+	m_cullingRAMChanges{},
+	m_cullingRAMTracked(false),
+	m_cullingRAMUnknown(false),
+	m_romPages(MAX_ROM_VERTS / ROM_PAGE_VERTS),
+	m_romOpenPage(-1),
+	m_romFrame(0),
+	m_modelCacheEnabled(false),
+	m_polyTex(0),
+	m_packedVertices(false),
+	m_quadPulling(false),
+	m_instancedModels(false),
+	m_instanceTex(0)
 {
 	m_sunClamp		= true;
 	m_numPolyVerts	= 3;
@@ -53,17 +130,132 @@ CNew3D::CNew3D(const Util::Config::Node &config, const std::string& gameName) :
 	}
 
 	m_wideScreen = config["WideScreen"].ValueAs<bool>();
+	m_modelCacheEnabled = config["New3DModelCache"].ValueAsDefault<bool>(false);
+	m_sceneReuseEnabled = config["ReuseScene"].ValueAsDefault<bool>(false);
+
+	// the scene walk only reads Real3D memory, so it can run alongside the GL work for 2D layers
+	if (config["MultiThreaded"].ValueAsDefault<bool>(false) && !StartSceneThread()) {
+		ErrorLog("Unable to create New3D scene thread: %s\nTraversing the scene on the render thread.\n", CThread::GetLastError());
+		StopSceneThread();
+	}
+
+	// models are independent once the scene walk has found them, so their decode can be spread over several jobs
+	if (config["MultiThreaded"].ValueAsDefault<bool>(false)) {
+		m_decodeJobs = std::min(std::max(config["New3DThreads"].ValueAsDefault<unsigned>(1), 1u), 16u);
+	}
+
+	// packed vertices fetch their face attributes from a texture buffer, which must be able to address every poly
+	if (config["PackedVertices"].ValueAs<bool>()) {
+		GLint maxTexels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		m_packedVertices = maxTexels >= (MAX_ROM_VERTS + MAX_RAM_VERTS * 3) / m_numPolyVerts;
+	}
+
+	m_r3dShader.SetPackedVertices(m_packedVertices);
+
+	// the vertex shader reads the whole vertex buffer, ring included, as a storage buffer
+	if (m_numPolyVerts == 4 && config["QuadVertexPulling"].ValueAsDefault<bool>(false) && GLEW_ARB_shader_storage_buffer_object) {
+		GLint vertexBlocks = 0;
+		GLint64 maxBlockSize = 0;
+		glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexBlocks);
+		glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+
+		GLint64 vertexSize = m_packedVertices ? sizeof(PackedVertex) : sizeof(FVertex);
+		m_quadPulling = vertexBlocks > 0 && maxBlockSize >= vertexSize * (MAX_ROM_VERTS + MAX_RAM_VERTS * VBO::NumSegments);
+
+		if (m_quadPulling) {
+			m_primType = GL_TRIANGLES;
+		}
+		else {
+			InfoLog("Quad vertex pulling is not supported by the graphics driver. Using a geometry shader instead.");
+		}
+	}
+
+	m_r3dShader.SetQuadPulling(m_quadPulling);
 
+	m_instancedModels = config["InstancedModels"].ValueAsDefault<bool>(false);
+	m_samples = std::max(1, config["MultiSampling"].ValueAsDefault<int>(1));
+
+	m_textureBank[0].SetRegenerateMips(config["RegenerateMips"].ValueAsDefault<bool>(false));
+	m_textureBank[1].SetRegenerateMips(config["RegenerateMips"].ValueAsDefault<bool>(false));
 	m_r3dShader.LoadShader();
 	glUseProgram(0);
 
+	// line of sight pixels are read into buffers and only looked at when the next frame starts
+	for (auto& read : m_losReads) {
+		glGenBuffers(1, &read.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float) * 2, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
 	// setup up our vertex buffer memory
 
 	glGenVertexArrays(1, &m_vao);
 	glBindVertexArray(m_vao);
-	m_vbo.Create(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, sizeof(FVertex) * (MAX_RAM_VERTS + MAX_ROM_VERTS));
+	// dynamic polys go in a triple buffered, persistently mapped ring after the rom polys if possible
+	GLsizeiptr vertexSize = m_packedVertices ? sizeof(PackedVertex) : sizeof(FVertex);
+	bool ring = m_vbo.CreateRing(GL_ARRAY_BUFFER, vertexSize * MAX_ROM_VERTS, vertexSize * MAX_RAM_VERTS);
+	if (!ring) {
+		m_vbo.Create(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, vertexSize * (MAX_RAM_VERTS + MAX_ROM_VERTS));
+	}
+
+	if (m_packedVertices) {
+		GLsizeiptr romPolys = MAX_ROM_VERTS / m_numPolyVerts;
+		GLsizeiptr ramPolys = MAX_RAM_VERTS / m_numPolyVerts;
+
+		if (!ring || !m_polyVbo.CreateRing(GL_TEXTURE_BUFFER, sizeof(PackedPoly) * romPolys, sizeof(PackedPoly) * ramPolys)) {
+			m_polyVbo.Create(GL_TEXTURE_BUFFER, GL_DYNAMIC_DRAW, sizeof(PackedPoly) * (romPolys + ramPolys));
+
+			// a mesh's vertices and polys are written together, so both are rings or neither is
+			if (ring) {
+				m_vbo.Destroy();
+				m_vbo.Create(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, vertexSize * (MAX_RAM_VERTS + MAX_ROM_VERTS));
+			}
+		}
+
+		glGenTextures(1, &m_polyTex);
+		glBindTexture(GL_TEXTURE_BUFFER, m_polyTex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, m_polyVbo.GetID());
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// instanced draws fetch their model matrices from a texture buffer, indexed by the instance
+	if (m_instancedModels) {
+		m_instanceVbo.Create(GL_TEXTURE_BUFFER, GL_STREAM_DRAW, sizeof(GLfloat) * 16 * MAX_INSTANCES);
+
+		glGenTextures(1, &m_instanceTex);
+		glBindTexture(GL_TEXTURE_BUFFER, m_instanceTex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_instanceVbo.GetID());
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	m_bufferMemory.SetGPU(m_vbo.GetStorageSize() + m_polyVbo.GetStorageSize() + m_instanceVbo.GetStorageSize());
+
+	// no vertex attributes, the shader fetches the vertices itself
+	if (m_quadPulling) {
+		glBindVertexArray(0);
+		return;
+	}
+
 	m_vbo.Bind(true);
 
+	if (m_packedVertices) {
+		glEnableVertexAttribArray(m_r3dShader.GetVertexAttribPos("inVertex"));
+		glEnableVertexAttribArray(m_r3dShader.GetVertexAttribPos("inNormal"));
+		glEnableVertexAttribArray(m_r3dShader.GetVertexAttribPos("inTexCoord"));
+		glEnableVertexAttribArray(m_r3dShader.GetVertexAttribPos("inFixedShade"));
+
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inVertex"), 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), 0);
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inNormal"), 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inTexCoord"), 2, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texcoords));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inFixedShade"), 1, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, fixedShade));
+
+		glBindVertexArray(0);
+		m_vbo.Bind(false);
+		return;
+	}
+
 	glEnableVertexAttribArray(m_r3dShader.GetVertexAttribPos("inVertex"));
 	glEnableVertexAttribArray(m_r3dShader.GetVertexAttribPos("inNormal"));
 	glEnableVertexAttribArray(m_r3dShader.GetVertexAttribPos("inTexCoord"));
@@ -87,11 +279,32 @@ CNew3D::CNew3D(const Util::Config::Node &config, const std::string& gameName) :
 
 CNew3D::~CNew3D()
 {
+	StopSceneThread();
+	m_modelCache.Flush();
+
 	m_vbo.Destroy();
+	m_polyVbo.Destroy();
+	if (m_polyTex) {
+		glDeleteTextures(1, &m_polyTex);
+		m_polyTex = 0;
+	}
+	m_instanceVbo.Destroy();
+	if (m_instanceTex) {
+		glDeleteTextures(1, &m_instanceTex);
+		m_instanceTex = 0;
+	}
 	if (m_vao) {
 		glDeleteVertexArrays(1, &m_vao);
 		m_vao = 0;
 	}
+	if (m_losFence) {
+		glDeleteSync(m_losFence);
+		m_losFence = nullptr;
+	}
+	for (auto& read : m_losReads) {
+		glDeleteBuffers(1, &read.pbo);
+		read.pbo = 0;
+	}
 
 	m_r3dShader.UnloadShader();
 }
@@ -111,18 +324,20 @@ void CNew3D::AttachMemory(const UINT32 *cullingRAMLoPtr, const UINT32 *cullingRA
 void CNew3D::SetStepping(int stepping)
 {
 	m_step = stepping;
+	m_sceneValid = false;
+	m_cullingRAMUnknown = true;		// the subtrees were walked with the other node layout
 
 	if ((m_step != 0x10) && (m_step != 0x15) && (m_step != 0x20) && (m_step != 0x21)) {
 		m_step = 0x10;
 	}
 
 	if (m_step > 0x10) {
-		m_offset = 0;							// culling nodes are 10 words
+		m_descendNodePtr = &CNew3D::DescendNodePtr<0>;	// culling nodes are 10 words
 		m_vertexFactor = (1.0f / 2048.0f);		// vertices are in 13.11 format
 		m_textureNPFactor = (1.0f / 16384.0f);	// texture NP values are in 10.14 format
 	}
 	else {
-		m_offset = 2;							// 8 words
+		m_descendNodePtr = &CNew3D::DescendNodePtr<2>;	// 8 words
 		m_vertexFactor = (1.0f / 128.0f);		// 17.7
 		m_textureNPFactor = (1.0f / 4096.0f);	// 12.12
 	}
@@ -141,9 +356,15 @@ Result CNew3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
 	m_totalYRes = totalYResParam;
 	m_aaTarget	= aaTarget;
 
+	// optional multisampling of the layers, limited to what both the colour textures and the depth buffer support
+	GLint maxSamples = 1, maxTextureSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &maxTextureSamples);
+	m_samples = std::min(m_samples, std::max(1, std::min(maxSamples, maxTextureSamples)));
+
 	m_r3dFrameBuffers.DestroyFBO();		// remove any old ones if created
 
-	return m_r3dFrameBuffers.CreateFBO(totalXResParam, totalYResParam);
+	return m_r3dFrameBuffers.CreateFBO(totalXResParam, totalYResParam, m_samples);
 }
 
 void CNew3D::UploadTextures(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height)
@@ -231,8 +452,7 @@ void CNew3D::DrawScrollFog()
 					rgba[1] = vp.fogParams[1];
 					rgba[2] = vp.fogParams[2];
 					rgba[3] = vp.scrollFog;
-					glViewport(vp.x, vp.y, vp.width, vp.height);
-					m_r3dScrollFog.DrawScrollFog(rgba, n.viewport.scrollAtt, n.viewport.fogParams[6], n.viewport.spotFogColor, n.viewport.spotEllipse);
+					m_r3dScrollFog.DrawScrollFog(vp.x, vp.y, vp.width, vp.height, rgba, n.viewport.scrollAtt, n.viewport.fogParams[6], n.viewport.spotFogColor, n.viewport.spotEllipse);
 					break;
 				}
 			}
@@ -293,61 +513,146 @@ void CNew3D::DrawAmbientFog()
 	if (nodePtr) {
 		auto& vp = nodePtr->viewport;
 		float rgba[] = { 0.0f, 0.0f, 0.0f, 1.0f - fogAmbient };
-		glViewport(vp.x, vp.y, vp.width, vp.height);
-		m_r3dScrollFog.DrawScrollFog(rgba, 0.0f, 1.0f, vp.spotFogColor, vp.spotEllipse); // we assume spot light is not used
+		m_r3dScrollFog.DrawScrollFog(vp.x, vp.y, vp.width, vp.height, rgba, 0.0f, 1.0f, vp.spotFogColor, vp.spotEllipse); // we assume spot light is not used
 	}
 }
 
-bool CNew3D::RenderScene(int priority, bool renderOverlay, Layer layer)
+bool CNew3D::RenderScene(int priority, bool renderOverlay, Layer layer, bool* transLayers)
 {
 	glActiveTexture(GL_TEXTURE0);
 	m_textureBank[0].Bind();
 	glActiveTexture(GL_TEXTURE1);
 	m_textureBank[1].Bind();
+	if (m_packedVertices) {
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_BUFFER, m_polyTex);
+	}
+	if (m_instancedModels) {
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_BUFFER, m_instanceTex);
+	}
 	glActiveTexture(GL_TEXTURE0);
 
 	bool hasOverlay = false;		// (high priority polys)
 
-	for (auto &n : m_nodes) {
+	for (size_t i = 0; i < m_nodes.size(); i++) {
+
+		Node& n = m_nodes[i];
+		const NodeDraws& d = m_nodeDraws[i];
 
 		if (n.viewport.priority != priority || n.models.empty()) {
 			continue;
 		}
 
+		hasOverlay |= d.hasOverlay;
+
+		if (transLayers) {
+			transLayers[0] |= !d.lists[renderOverlay][(int)Layer::trans1].empty();
+			transLayers[1] |= !d.lists[renderOverlay][(int)Layer::trans2].empty();
+		}
+
 		CalcViewport(&n.viewport);
+
+		const std::vector<DrawCmd>& list = d.lists[renderOverlay][(int)layer];
+
+		if (list.empty()) {
+			continue;
+		}
+
 		glViewport(n.viewport.x, n.viewport.y, n.viewport.width, n.viewport.height);
 
 		m_r3dShader.SetViewportUniforms(&n.viewport);
 
-		for (auto &m : n.models) {
+		for (const auto& cmd : list) {
+
+			if (cmd.mesh) {
+				FlushDraws();
 
-			bool matrixLoaded = false;
+				if (cmd.model) {
+					m_r3dShader.SetModelStates(cmd.model);		// do this here to stop loading matrices we don't need. Ie when rendering non transparent etc
+				}
+
+				m_r3dShader.SetMeshUniforms(cmd.mesh);
+			}
 
-			if (m.meshes->empty()) {
+			if (cmd.instances) {
+				DrawInstances(d, cmd);
 				continue;
 			}
 
-			for (auto &mesh : *m.meshes) {
+			AddDraw(cmd.first, cmd.count);
+		}
 
-				if (mesh.highPriority) {
-					hasOverlay = true;
-				}
+		FlushDraws();
+	}
+
+	return hasOverlay;
+}
 
-				if (!mesh.Render(layer, m.alpha)) continue;
-				if (mesh.highPriority != renderOverlay) continue;
+void CNew3D::AddDraw(int first, int count)
+{
+	// each quad is drawn as 6 vertices
+	if (m_quadPulling) {
+		first = (first / 4) * 6;
+		count = (count / 4) * 6;
+	}
 
-				if (!matrixLoaded) {
-					m_r3dShader.SetModelStates(&m);
-					matrixLoaded = true;		// do this here to stop loading matrices we don't need. Ie when rendering non transparent etc
-				}
-				
-				m_r3dShader.SetMeshUniforms(&mesh);
-				glDrawArrays(m_primType, mesh.vboOffset, mesh.vertexCount);
-			}
+	// meshes are usually laid out back to back in the vbo, so join them where possible
+	if (!m_drawFirst.empty() && m_drawFirst.back() + m_drawCount.back() == first) {
+		m_drawCount.back() += count;
+		return;
+	}
+
+	m_drawFirst.emplace_back(first);
+	m_drawCount.emplace_back(count);
+}
+
+void CNew3D::FlushDraws()
+{
+	if (m_drawFirst.size() == 1) {
+		glDrawArrays(m_primType, m_drawFirst[0], m_drawCount[0]);
+		m_drawCalls++;
+	}
+	else if (!m_drawFirst.empty() && IsGLES()) {
+		for (size_t i = 0; i < m_drawFirst.size(); i++) {	// ES has no multi-draw
+			glDrawArrays(m_primType, m_drawFirst[i], m_drawCount[i]);
 		}
+		m_drawCalls += (UINT32)m_drawFirst.size();
+	}
+	else if (!m_drawFirst.empty()) {
+		glMultiDrawArrays(m_primType, m_drawFirst.data(), m_drawCount.data(), (GLsizei)m_drawFirst.size());
+		m_drawCalls++;
 	}
 
-	return hasOverlay;
+	m_drawFirst.clear();
+	m_drawCount.clear();
+}
+
+void CNew3D::DrawInstances(const NodeDraws& d, const DrawCmd& cmd)
+{
+	GLint first = cmd.first;
+	GLsizei count = cmd.count;
+
+	if (m_quadPulling) {
+		first = (first / 4) * 6;
+		count = (count / 4) * 6;
+	}
+
+	// instances are drawn one after another, so this is the same as drawing each model in turn
+	if (d.instanceBase >= 0) {
+		m_r3dShader.SetInstanceBase(d.instanceBase + cmd.instanceFirst);
+		glDrawArraysInstanced(m_primType, first, count, cmd.instances);
+		m_r3dShader.SetInstanceBase(-1);
+		m_drawCalls++;
+		return;
+	}
+
+	// the matrices didn't fit in this frame's buffer
+	for (GLsizei i = 0; i < cmd.instances; i++) {
+		m_r3dShader.SetModelStates(d.instances[cmd.instanceFirst + i]);
+		glDrawArrays(m_primType, first, count);
+		m_drawCalls++;
+	}
 }
 
 bool CNew3D::SkipLayer(int layer)
@@ -370,6 +675,10 @@ void CNew3D::SetRenderStates()
 
 	m_r3dShader.SetShader(true);
 
+	if (m_quadPulling) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_vbo.GetID());
+	}
+
 	glDepthFunc		(GL_GEQUAL);
 	glEnable		(GL_DEPTH_TEST);
 	glDepthMask		(GL_TRUE);
@@ -395,6 +704,12 @@ void CNew3D::DisableRenderStates()
 
 void CNew3D::RenderFrame(void)
 {
+	TRACE_ZONE("New3D render");
+
+	ResolveLos();									// last frame's line of sight values, made visible by the swap below
+
+	m_drawCalls = 0;
+
 	{
 		std::lock_guard<std::mutex> guard(m_losMutex);
 		std::swap(m_losBack, m_losFront);
@@ -403,47 +718,70 @@ void CNew3D::RenderFrame(void)
 		}
 	}
 
-	// release any resources from last frame
-	m_polyBufferRam.clear();		// clear dynamic model memory buffer
-	m_nodes.clear();				// memory will grow during the object life time, that's fine, no need to shrink to fit
-	m_modelMat.Release();			// would hope we wouldn't need this but no harm in checking
-	m_nodeAttribs.Reset();
+	if (m_sceneBuilding) {
+		m_sceneDone->Wait();						// model structure built by the scene thread
+		m_sceneBuilding = false;
+	}
+	else if (!m_sceneReused) {
+		BuildScene();								// build model structure
+	}
 
-	RenderViewport(0x800000);						// build model structure
+	m_sceneValid = true;
+
+	int vertexSize = m_packedVertices ? sizeof(PackedVertex) : sizeof(FVertex);
+
+	m_textureBank[0].FlushUploads();				// texture writes since the last frame, coalesced
+	m_textureBank[1].FlushUploads();
+	m_stats.texelsUploaded = m_textureBank[0].TakeTexelsUploaded() + m_textureBank[1].TakeTexelsUploaded();
+
+	m_r3dShader.UpdateVariants();					// specialised programs for mesh states drawn in earlier frames
 	
 	m_vbo.Bind(true);
-	m_vbo.BufferSubData(MAX_ROM_VERTS*sizeof(FVertex), m_polyBufferRam.size()*sizeof(FVertex), m_polyBufferRam.data());	// upload all the dynamic data to GPU in one go
-
-	if (!m_polyBufferRom.empty()) {
-
-		// sync rom memory with vbo
-		int romBytes	= (int)(m_polyBufferRom.size() * sizeof(FVertex));
-		int vboBytes	= m_vbo.GetSize();
-		int size		= romBytes - vboBytes;
-
-		if (size) {
-			//check we haven't blown up the memory buffers
-			//we will lose rom models for 1 frame if this happens, not the end of the world, as probably won't ever happen anyway
-			if (m_polyBufferRom.size() >= MAX_ROM_VERTS) {
-				m_polyBufferRom.clear();
-				m_romMap.clear();
-				m_vbo.Reset();
-			}
-			else {
-				m_vbo.AppendData(size, &m_polyBufferRom[vboBytes / sizeof(FVertex)]);
-			}
+	if (m_packedVertices) {
+		m_polyVbo.Bind(true);
+	}
+
+	if (!m_ramVerts && !m_sceneReused) {
+		// upload all the dynamic data to GPU in one go
+		if (m_packedVertices) {
+			PackVertexData(m_polyBufferRam.data(), (int)m_polyBufferRam.size());
+			m_vbo.BufferSubData(MAX_ROM_VERTS*sizeof(PackedVertex), m_packedVerts.size()*sizeof(PackedVertex), m_packedVerts.data());
+			m_polyVbo.BufferSubData((MAX_ROM_VERTS / m_numPolyVerts)*sizeof(PackedPoly), m_packedPolys.size()*sizeof(PackedPoly), m_packedPolys.data());
 		}
+		else {
+			m_vbo.BufferSubData(MAX_ROM_VERTS*sizeof(FVertex), m_polyBufferRam.size()*sizeof(FVertex), m_polyBufferRam.data());
+		}
+		m_stats.vertsUploaded = (UINT32)m_polyBufferRam.size();
+	}
+	else if (!m_sceneReused) {
+		m_stats.vertsUploaded = (UINT32)m_ramVertCount;		// written straight into the mapped segment by the scene build
+	}
+
+	UploadRomPages(vertexSize);						// sync rom memory with vbo
+	UploadInstances();								// matrices of the models drawn instanced
+
+	if (m_packedVertices) {
+		m_polyVbo.Bind(false);
 	}
 
 	m_r3dFrameBuffers.SetFBO(Layer::colour);		// colour will draw to all 3 buffers. For regular opaque pixels the transparent layers will be essentially masked
 	glClear(GL_COLOR_BUFFER_BIT);
 
+	m_fogTimer.Begin();
 	DrawAmbientFog();
 	DrawScrollFog();								// fog layer if applicable must be drawn here
+	m_fogTimer.End();
+
+	bool transDrawn = false;						// the transparent layers are still blank if this stays false
 
 	for (int pri = 0; pri <= 3; pri++) {
 
-		if (SkipLayer(pri)) continue;
+		m_layerTimers[pri].Begin();					// skipped layers are timed too, so they read as zero
+
+		if (SkipLayer(pri)) {
+			m_layerTimers[pri].End();
+			continue;
+		}
 
 		for (int i = 0; i < 2; i++) {
 
@@ -453,12 +791,13 @@ void CNew3D::RenderFrame(void)
 
 			m_r3dFrameBuffers.SetFBO(Layer::colour);
 
-			glClearDepth(0.0);
+			glClearDepthf(0.0f);		// core since 4.1, and the only form in ES
 			glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
 			m_r3dShader.DiscardAlpha(true);
 			m_r3dShader.SetLayer(Layer::colour);
-			bool hasOverlay = RenderScene(pri, renderOverlay, Layer::colour);
+			bool transLayers[2] = { false, false };
+			bool hasOverlay = RenderScene(pri, renderOverlay, Layer::colour, transLayers);
 
 			if (!renderOverlay) {
 				ProcessLos(pri);
@@ -468,29 +807,71 @@ void CNew3D::RenderFrame(void)
 
 			m_r3dShader.DiscardAlpha(false);
 
-			m_r3dFrameBuffers.StoreDepth();
-			m_r3dShader.SetLayer(Layer::trans1);
-			m_r3dFrameBuffers.SetFBO(Layer::trans1);
-			RenderScene(pri, renderOverlay, Layer::trans1);
+			// the translucent passes discard by texel alpha, shading them per sample antialiases those edges as well
+			if (m_samples > 1 && (transLayers[0] || transLayers[1])) {
+				glEnable(GL_SAMPLE_SHADING);
+				glMinSampleShading(1.0f);
+			}
+
+			// the opaque depth only needs saving if both transparent layers are going to test against it
+			bool bothTrans = transLayers[0] && transLayers[1];
+
+			if (transLayers[0]) {
+				if (bothTrans) {
+					m_r3dFrameBuffers.StoreDepth();
+				}
+				m_r3dShader.SetLayer(Layer::trans1);
+				m_r3dFrameBuffers.SetFBO(Layer::trans1);
+				RenderScene(pri, renderOverlay, Layer::trans1);
+			}
+
+			if (transLayers[1]) {
+				if (bothTrans) {
+					m_r3dFrameBuffers.RestoreDepth();
+				}
+				m_r3dShader.SetLayer(Layer::trans2);
+				m_r3dFrameBuffers.SetFBO(Layer::trans2);
+				RenderScene(pri, renderOverlay, Layer::trans2);
+			}
 
-			m_r3dFrameBuffers.RestoreDepth();
-			m_r3dShader.SetLayer(Layer::trans2);
-			m_r3dFrameBuffers.SetFBO(Layer::trans2);
-			RenderScene(pri, renderOverlay, Layer::trans2);
-						
+			transDrawn |= transLayers[0] || transLayers[1];
+
+			glDisable(GL_SAMPLE_SHADING);
 			DisableRenderStates();
 
 			if (!hasOverlay) break;								// no high priority polys						
 		}
+
+		m_layerTimers[pri].End();
+	}
+
+	m_vbo.FenceSegment();							// all draws from this frame's dynamic polys have been issued
+	m_polyVbo.FenceSegment();
+
+	for (const auto& read : m_losReads) {
+		if (read.pending) {
+			m_losFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			break;
+		}
 	}
 
 	m_r3dFrameBuffers.SetFBO(Layer::none);
 
+	m_stats.drawCalls		= m_drawCalls;
+	m_stats.uniformUpdates	= m_r3dShader.TakeUniformUpdates();
+
+	m_transDrawn = transDrawn;
+	if (m_externalComposite) {
+		return;
+	}
+
 	if (m_aaTarget) {
 		glBindFramebuffer(GL_FRAMEBUFFER, m_aaTarget);			// if we have an AA target draw to it instead of the default back buffer
 	}
 
-	m_r3dFrameBuffers.Draw();
+	m_compositeTimer.Begin();
+	m_r3dFrameBuffers.Draw(transDrawn);
+	m_compositeTimer.End();
 
 	if (m_aaTarget) {
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -499,6 +880,342 @@ void CNew3D::RenderFrame(void)
 
 void CNew3D::BeginFrame(void)
 {
+	m_romFrame++;
+	m_stats = RenderStats();
+
+	// the model cache only changes by a few models a frame, so it is counted now and then
+	if (m_romFrame % 60 == 0) {
+		size_t meshes = 0;
+		for (const auto& entry : m_romMap) {
+			meshes += entry.second.meshes.capacity();
+		}
+		m_modelMemory.SetCPU(m_romMap.size() * sizeof(decltype(m_romMap)::value_type) + meshes * sizeof(Mesh) + m_polyBufferRom.capacity() * sizeof(FVertex));
+	}
+
+	if (m_modelCacheEnabled && !m_modelCache.IsOpen() && m_vrom) {
+		OpenModelCache();
+	}
+
+	// nothing the scene is built from has changed, so last frame's nodes, draw lists and dynamic polys are kept as they are
+	m_sceneReused = m_sceneReuseEnabled && m_sceneUnchanged && m_sceneValid && m_sceneSunClamp == m_sunClamp;
+
+	if (m_sceneReused) {
+		return;
+	}
+
+	InvalidateRamModels();			// nodes of the last scene are about to be dropped, so their meshes can go
+
+	m_sceneSunClamp = m_sunClamp;		// goes into the viewports
+
+	// release any resources from last frame
+	m_polyBufferRam.clear();		// clear dynamic model memory buffer
+	m_dynamicMeshCount = 0;
+
+	// memory will grow during the object life time, that's fine, no need to shrink to fit. The model lists are kept for the next nodes
+	for (auto& n : m_nodes) {
+		n.models.clear();
+		m_spareModels.push_back(std::move(n.models));
+	}
+
+	m_nodes.clear();
+
+	// mapping waits on a GL fence so has to happen here, the scene thread only writes through the pointers
+	int vertexSize	= m_packedVertices ? sizeof(PackedVertex) : sizeof(FVertex);
+	m_ramVerts		= m_vbo.MapSegment();
+	m_ramPolys		= m_packedVertices ? (PackedPoly*)m_polyVbo.MapSegment() : nullptr;
+	m_ramVertCount	= 0;
+	m_ramVertBase	= m_ramVerts ? (int)(m_vbo.GetSegmentOffset() / vertexSize) : MAX_ROM_VERTS;
+
+	if (m_sceneThread) {
+		m_sceneBuilding = true;
+		m_sceneStart->Post();
+	}
+}
+
+bool CNew3D::StartSceneThread()
+{
+	m_stopSceneThread	= false;
+	m_sceneStart		= CThread::CreateSemaphore(0);
+	m_sceneDone			= CThread::CreateSemaphore(0);
+	if (m_sceneStart == nullptr || m_sceneDone == nullptr) {
+		return false;
+	}
+
+	m_sceneThread = CThread::CreateThread("New3D", StartSceneWorker, this);
+
+	return m_sceneThread != nullptr;
+}
+
+void CNew3D::StopSceneThread()
+{
+	if (m_sceneBuilding) {
+		m_sceneDone->Wait();
+		m_sceneBuilding = false;
+	}
+
+	m_stopSceneThread = true;
+
+	if (m_sceneThread != nullptr) {
+		m_sceneStart->Post();
+		m_sceneThread->Wait();
+		delete m_sceneThread;
+		m_sceneThread = nullptr;
+	}
+
+	delete m_sceneStart;
+	delete m_sceneDone;
+	m_sceneStart	= nullptr;
+	m_sceneDone		= nullptr;
+}
+
+int CNew3D::StartSceneWorker(void *data)
+{
+	return ((CNew3D *)data)->RunSceneWorker();
+}
+
+int CNew3D::RunSceneWorker()
+{
+	while (m_sceneStart->Wait() && !m_stopSceneThread) {
+		BuildScene();	// build model structure
+		m_sceneDone->Post();
+	}
+
+	return 0;
+}
+
+void CNew3D::OpenModelCache()
+{
+	// the VROM is always a 64MB region, smaller ones are mirrored
+	UINT32 vromCRC	= (UINT32)crc32(0, (const Bytef*)m_vrom, 0x4000000);
+	std::string path = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Cache) << m_gameName << ".n3d";
+
+	m_modelCache.Open(path, vromCRC, m_numPolyVerts, m_step);
+}
+
+void CNew3D::BuildScene()
+{
+	BeginSubtrees();
+	RenderViewport(0x800000);
+	EndSubtrees();
+	DecodeQueuedModels();
+	RecordDrawLists();
+}
+
+void CNew3D::DecodeModels(size_t first, size_t last, PrevVertices& prev)
+{
+	for (size_t i = first; i < last; i++) {
+		QueuedModel& q = m_decodeQueue[i];
+		DecodeModel(q.data, q.colorTableAddr, prev, q.sorted);
+	}
+}
+
+void CNew3D::DecodeQueuedModels()
+{
+	const size_t count = m_decodeCount;
+
+	if (count == 0) {
+		return;
+	}
+
+	// split the queue into a range per job. Ranges must start on an independent model, the ones
+	// following it may share vertices with the model before them so are decoded in order by the same job
+	size_t jobs		= (count >= 16) ? m_decodeJobs : 1;
+	size_t split	= 0;
+
+	auto nextSplit = [&](size_t t) {
+		split = std::max(split, (t * count) / jobs);
+		while (split < count && !m_decodeQueue[split].independent) {
+			split++;
+		}
+		return split;
+	};
+
+	m_decodeRanges.resize(jobs);
+
+	for (size_t i = 0; i < jobs; i++) {
+		DecodeRange& r = m_decodeRanges[i];
+		r.first = split;
+		r.last	= nextSplit(i + 1);
+		r.prev	= m_prev;
+	}
+
+	// the calling thread decodes the first range
+	Util::JobGroup group;
+
+	for (size_t i = 1; i < jobs; i++) {
+		group.Run([this, i]() {
+			DecodeRange& r = m_decodeRanges[i];
+			DecodeModels(r.first, r.last, r.prev);
+		});
+	}
+
+	DecodeModels(m_decodeRanges[0].first, m_decodeRanges[0].last, m_decodeRanges[0].prev);
+	group.Wait();
+
+	const PrevVertices* lastPrev = &m_decodeRanges[0].prev;
+
+	for (size_t i = 1; i < jobs; i++) {
+		if (m_decodeRanges[i].last > m_decodeRanges[i].first) {
+			lastPrev = &m_decodeRanges[i].prev;
+		}
+	}
+
+	m_prev = *lastPrev;		// carry on to the next frame like a serial decode would
+
+	// merge in scene order
+	for (size_t i = 0; i < count; i++) {
+		QueuedModel& q = m_decodeQueue[i];
+		StoreModel(*q.meshes, q.modelAddr, q.dynamic, q.sorted);
+	}
+
+	m_decodeCount = 0;
+}
+
+void CNew3D::RecordDrawLists()
+{
+	const size_t count = m_nodes.size();
+
+	if (m_nodeDraws.size() < count) {
+		m_nodeDraws.resize(count);				// kept between frames so the lists keep their capacity
+	}
+
+	// nodes record into their own lists, so any split works and submission order stays the scene order
+	Util::ParallelFor(0, count, (count >= 8) ? m_decodeJobs : 1, [this](size_t first, size_t last) {
+		RecordDraws(first, last);
+	});
+}
+
+void CNew3D::RecordDraws(size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++) {
+
+		const Node& n = m_nodes[i];
+		NodeDraws& d = m_nodeDraws[i];
+
+		const Model* batchModel[2][3] = {};
+		const Mesh* batchMesh[2][3] = {};
+
+		d.hasOverlay = false;
+		d.instances.clear();
+		for (auto& overlay : d.lists) {
+			for (auto& list : overlay) {
+				list.clear();
+			}
+		}
+
+		// consecutive meshes with the same model and mesh state are batched into a single draw call
+		for (auto& m : n.models) {
+			for (auto& mesh : *m.meshes) {
+
+				int o = mesh.highPriority ? 1 : 0;
+				d.hasOverlay |= mesh.highPriority;
+
+				for (int l = 0; l < 3; l++) {
+
+					if (!mesh.Render((Layer)l, m.alpha)) continue;
+
+					std::vector<DrawCmd>& list = d.lists[o][l];
+					bool sameModel = batchModel[o][l] && (batchModel[o][l] == &m || batchModel[o][l]->SameState(m));
+
+					if (!sameModel || !batchMesh[o][l]->SameState(mesh)) {
+						list.push_back({ sameModel ? nullptr : &m, &mesh, mesh.vboOffset, mesh.vertexCount });
+						batchModel[o][l] = &m;
+						batchMesh[o][l] = &mesh;
+					}
+					else if (list.back().first + list.back().count == mesh.vboOffset) {
+						list.back().count += mesh.vertexCount;		// meshes are usually laid out back to back in the vbo
+					}
+					else {
+						list.push_back({ nullptr, nullptr, mesh.vboOffset, mesh.vertexCount });
+					}
+				}
+			}
+		}
+
+		if (m_instancedModels) {
+			RecordInstances(d);
+		}
+	}
+}
+
+void CNew3D::RecordInstances(NodeDraws& d)
+{
+	for (auto& overlay : d.lists) {
+		for (auto& list : overlay) {
+
+			size_t count = 0;
+			bool joinable = false;		// list[count - 1] draws whole models with a single command
+
+			for (size_t i = 0; i < list.size(); i++) {
+
+				const DrawCmd cmd = list[i];
+
+				// a model drawn by one command, the next command switches model again
+				bool whole = cmd.model && (i + 1 == list.size() || list[i + 1].model);
+
+				if (whole && joinable) {
+
+					DrawCmd& run = list[count - 1];
+					const Model& a = *run.model;
+					const Model& b = *cmd.model;
+
+					// same mesh state and vertices, only the matrix differs
+					if (run.mesh == cmd.mesh && run.first == cmd.first && run.count == cmd.count &&
+						a.textureOffsetX == b.textureOffsetX && a.textureOffsetY == b.textureOffsetY && a.page == b.page &&
+						a.scale == b.scale && a.alpha == b.alpha) {
+
+						if (!run.instances) {
+							run.instances		= 1;
+							run.instanceFirst	= (GLint)d.instances.size();
+							d.instances.emplace_back(run.model);
+						}
+
+						run.instances++;
+						d.instances.emplace_back(cmd.model);
+						continue;
+					}
+				}
+
+				list[count++] = cmd;
+				joinable = whole;
+			}
+
+			list.resize(count);
+		}
+	}
+}
+
+void CNew3D::UploadInstances()
+{
+	if (!m_instancedModels) {
+		return;
+	}
+
+	m_instanceMats.clear();
+
+	for (size_t i = 0; i < m_nodes.size(); i++) {
+
+		NodeDraws& d = m_nodeDraws[i];
+		d.instanceBase = -1;
+
+		size_t base = m_instanceMats.size() / 16;
+
+		if (d.instances.empty() || base + d.instances.size() > MAX_INSTANCES) {
+			continue;
+		}
+
+		d.instanceBase = (int)base;
+
+		for (const Model* m : d.instances) {
+			m_instanceMats.insert(m_instanceMats.end(), m->modelMat, m->modelMat + 16);
+		}
+	}
+
+	if (!m_instanceMats.empty()) {
+		m_instanceVbo.Bind(true);
+		m_instanceVbo.BufferSubData(0, m_instanceMats.size() * sizeof(GLfloat), m_instanceMats.data());
+		m_instanceVbo.Bind(false);
+	}
 }
 
 void CNew3D::EndFrame(void)
@@ -539,10 +1256,24 @@ const UINT32* CNew3D::TranslateModelAddress(UINT32 modelAddr)
 	}
 }
 
-bool CNew3D::DrawModel(UINT32 modelAddr)
+void CNew3D::EmitModel(SceneWalk& w, UINT32 modelAddr)
+{
+	SubtreeModel& r		= w.cur->models.emplace_back();
+	r.addr				= modelAddr;
+	r.colorTableAddr	= w.colorTableAddr;
+	r.texOffsetX		= w.nodeAttribs.currentTexOffsetX;
+	r.texOffsetY		= w.nodeAttribs.currentTexOffsetY;
+	r.page				= w.nodeAttribs.currentPage;
+	r.scale				= w.nodeAttribs.currentModelScale;
+	r.alpha				= w.nodeAttribs.currentModelAlpha;
+	memcpy(r.matrix, w.modelMat.currentMatrix, sizeof(r.matrix));
+}
+
+void CNew3D::DrawModel(const SubtreeModel& r)
 {
 	bool			cached = false;
 
+	const UINT32	modelAddr = r.addr;
 	const UINT32* const modelAddress = TranslateModelAddress(modelAddr);
 
 	// create a new model to push onto the vector
@@ -551,43 +1282,81 @@ bool CNew3D::DrawModel(UINT32 modelAddr)
 	// get the last model in the array
 	Model* const m = &m_nodes.back().models.back();
 
-	if (IsVROMModel(modelAddr) && !IsDynamicModel((UINT32*)modelAddress)) {
+	// RAM models are cached too while writes to polygon RAM are reported, those that are written are dropped again
+	if ((IsVROMModel(modelAddr) || (m_polyRAMTracked && modelAddress != nullptr)) && !IsDynamicModel((UINT32*)modelAddress)) {
 
 		// try to find meshes in the rom cache
 
-		m->meshes = m_romMap[modelAddr];	// will create an entry with a null pointer if empty
+		RomModel& romModel = m_romMap[modelAddr];	// will create an empty entry if not found
+		m->meshes = &romModel.meshes;
 
-		if (m->meshes) {
+		if (romModel.present) {
 			cached = true;
+
+			// pages used this frame can't be evicted
+			for (int i = 0; i < romModel.numPages; i++) {
+				m_romPages[romModel.firstPage + i].lastUsed = m_romFrame;
+			}
+		}
+		else {
+			romModel.present = true;		// later references this frame share the meshes decoded for this one
+			romModel.meshes.clear();
+
+			if (!IsVROMModel(modelAddr)) {
+				// find the extent of the polys so that writes to any of them drop the model
+				PolyHeader ph((UINT32*)modelAddress);
+				while (ph.header[6] != 0 && (UINT32)(ph.header - m_polyRAM) < 0xFFF00 && ph.NextPoly()) {
+				}
+
+				UINT32 end = std::min<UINT32>((UINT32)(ph.header - m_polyRAM) + 7 + (ph.NumVerts() - ph.NumSharedVerts()) * 4, 0x100000);
+
+				romModel.ramFirst	= modelAddr >> 10;					// 4 KB pages
+				romModel.ramLast	= (end - 1) >> 10;
+				m_ramModels.insert(modelAddr);
+			}
+			else {
+				// decoded in a previous session?
+				std::vector<SortingMesh> meshes;
+				if (m_modelCache.Load(modelAddr, meshes)) {
+					StoreModel(*m->meshes, modelAddr, false, meshes);
+					cached = true;
+				}
+			}
+		}
+
+		if (cached) {
+			m_stats.modelCacheHits++;
 		}
 		else {
-			m->meshes = std::make_shared<std::vector<Mesh>>();
-			m_romMap[modelAddr] = m->meshes;		// store meshes in our rom map here
+			m_stats.modelCacheMisses++;
 		}
 
 		m->dynamic = false;
 	}
 	else {
-		m->meshes = std::make_shared<std::vector<Mesh>>();
+		if (m_dynamicMeshCount == m_dynamicMeshes.size()) {
+			m_dynamicMeshes.emplace_back();
+		}
+
+		m->meshes = &m_dynamicMeshes[m_dynamicMeshCount++];
+		m->meshes->clear();
 	}
 
 	// copy current model matrix
 	for (int i = 0; i < 16; i++) {
-		m->modelMat[i] = m_modelMat.currentMatrix[i];
+		m->modelMat[i] = r.matrix[i];
 	}
 
 	// update texture offsets
-	m->textureOffsetX	= m_nodeAttribs.currentTexOffsetX;
-	m->textureOffsetY	= m_nodeAttribs.currentTexOffsetY;
-	m->page				= m_nodeAttribs.currentPage;
-	m->scale			= m_nodeAttribs.currentModelScale;
-	m->alpha			= m_nodeAttribs.currentModelAlpha;
+	m->textureOffsetX	= r.texOffsetX;
+	m->textureOffsetY	= r.texOffsetY;
+	m->page				= r.page;
+	m->scale			= r.scale;
+	m->alpha			= r.alpha;
 
 	if (!cached) {
-		CacheModel(m, modelAddress);
+		CacheModel(m, modelAddr, modelAddress);
 	}
-
-	return true;
 }
 
 /*
@@ -645,7 +1414,57 @@ bool CNew3D::DrawModel(UINT32 modelAddr)
 			-------- -------- xxxxxxxx xxxxxxxx Culling radius
 */
 
-void CNew3D::DescendCullingNode(UINT32 addr)
+template <int NodeOffset>
+void CNew3D::DescendCullingNode(SceneWalk& w, UINT32 addr)
+{
+	if (!m_subtreeRecording) {
+		TraverseCullingNode<NodeOffset>(w, addr);
+		return;
+	}
+
+	SubtreeInput input;
+	memset(&input, 0, sizeof(input));	// compared bytewise
+	input.addr				= addr;
+	input.colorTableAddr	= w.colorTableAddr;
+	input.lodTableAddr		= w.lodTableAddr;
+	input.matrixBaseAddr	= w.matrixBaseAddr;
+	input.attribDepth		= w.nodeAttribs.Depth();
+	input.matrixDepth		= w.modelMat.Depth();
+	input.texOffsetX		= w.nodeAttribs.currentTexOffsetX;
+	input.texOffsetY		= w.nodeAttribs.currentTexOffsetY;
+	input.page				= w.nodeAttribs.currentPage;
+	input.modelScale		= w.nodeAttribs.currentModelScale;
+	input.modelAlpha		= w.nodeAttribs.currentModelAlpha;
+	input.disableCulling	= w.nodeAttribs.currentDisableCulling;
+	static_assert(sizeof(w.planes) == sizeof(input.planes), "viewport planes are compared as they are");
+	memcpy(input.planes, &w.planes, sizeof(input.planes));
+	memcpy(input.matrix, w.modelMat.currentMatrix, sizeof(input.matrix));
+
+	if (w.replay && ReplaySubtree(w, input)) {
+		return;
+	}
+
+	SubtreeScene& cur	= *w.cur;
+	UINT32 firstNested	= (UINT32)cur.subtrees.size();
+	UINT32 firstModel	= (UINT32)cur.models.size();
+	UINT32 firstPage	= (UINT32)cur.pages.size();
+	w.pageFloor			= firstPage;
+
+	TraverseCullingNode<NodeOffset>(w, addr);
+
+	Subtree& s			= cur.subtrees.emplace_back();
+	s.input				= input;
+	s.colorTableAddrOut	= w.colorTableAddr;
+	s.firstNested		= firstNested;
+	s.firstModel		= firstModel;
+	s.lastModel			= (UINT32)cur.models.size();
+	s.firstPage			= firstPage;
+	s.lastPage			= (UINT32)cur.pages.size();
+	AddSubtree(w, (UINT32)cur.subtrees.size() - 1);
+}
+
+template <int NodeOffset>
+void CNew3D::TraverseCullingNode(SceneWalk& w, UINT32 addr)
 {
 	enum class NodeType { undefined = -1, viewport = 0, rootNode = 1, cullingNode = 2 };
 
@@ -659,7 +1478,7 @@ void CNew3D::DescendCullingNode(UINT32 addr)
 	NodeType		nodeType;
 	bool			resetMatrix;
 
-	if (m_nodeAttribs.StackLimit()) {
+	if (w.nodeAttribs.StackLimit()) {
 		return;
 	}
 
@@ -669,13 +1488,16 @@ void CNew3D::DescendCullingNode(UINT32 addr)
 		return;
 	}
 
+	w.nodes++;
+	LogCullingRead(w, addr, 10 - NodeOffset);
+
 	// Extract known fields
 	nodeType		= (NodeType)(node[0x00] & 3);
-	child1Ptr		= node[0x07 - m_offset] & 0x7FFFFFF;	// mask colour table bits
-	sibling2Ptr		= node[0x08 - m_offset] & 0x1FFFFFF;	// mask colour table bits
-	matrixOffset	= node[0x03 - m_offset] & 0xFFF;
+	child1Ptr		= node[0x07 - NodeOffset] & 0x7FFFFFF;	// mask colour table bits
+	sibling2Ptr		= node[0x08 - NodeOffset] & 0x1FFFFFF;	// mask colour table bits
+	matrixOffset	= node[0x03 - NodeOffset] & 0xFFF;
 	resetMatrix		= (node[0x0] & 0x80) > 0;
-	lodTablePointer = (node[0x03 - m_offset] >> 12) & 0x7F;
+	lodTablePointer = (node[0x03 - NodeOffset] >> 12) & 0x7F;
 
 	// check our node type
 	if (nodeType == NodeType::viewport) {
@@ -690,142 +1512,162 @@ void CNew3D::DescendCullingNode(UINT32 addr)
 	// parse siblings 
 	if ((node[0x00] & 0x07) != 0x06) {						// colour table seems to indicate no siblings
 		if (!(sibling2Ptr & 0x1000000) && sibling2Ptr) {
-			DescendCullingNode(sibling2Ptr);				// no need to mask bit, would already be zero
+			DescendCullingNode<NodeOffset>(w, sibling2Ptr);		// no need to mask bit, would already be zero
 		}
 	}
 
 	if ((node[0x00] & 0x04)) {
-		m_colorTableAddr = ((node[0x03 - m_offset] >> 19) << 0) | ((node[0x07 - m_offset] >> 28) << 13) | ((node[0x08 - m_offset] >> 25) << 17);
-		m_colorTableAddr &= 0x000FFFFF; // clamp to 4MB (in words) range
+		w.colorTableAddr = ((node[0x03 - NodeOffset] >> 19) << 0) | ((node[0x07 - NodeOffset] >> 28) << 13) | ((node[0x08 - NodeOffset] >> 25) << 17);
+		w.colorTableAddr &= 0x000FFFFF; // clamp to 4MB (in words) range
 	}
 
-	m_nodeAttribs.Push();	// save current attribs
+	w.nodeAttribs.Push();	// save current attribs
 
-	if (!m_offset) {		// Step 1.5+
+	if (NodeOffset == 0) {		// Step 1.5+
 
 		if (node[0x01] & 1)
-			m_nodeAttribs.currentModelScale = Util::Uint32AsFloat(node[0x01] & ~3);	// mask out control bits
+			w.nodeAttribs.currentModelScale = Util::Uint32AsFloat(node[0x01] & ~3);	// mask out control bits
 
 		if (node[0x01] & 2)
-			m_nodeAttribs.currentDisableCulling = true;
+			w.nodeAttribs.currentDisableCulling = true;
 
 		// apply texture offsets, else retain current ones
 		if ((node[0x02] & 0x8000))	{
 			int tx = 32 * ((node[0x02] >> 7) & 0x3F);
 			int ty = 32 * (node[0x02] & 0x1F);
-			m_nodeAttribs.currentTexOffsetX	= tx;
-			m_nodeAttribs.currentTexOffsetY = ty;
-			m_nodeAttribs.currentPage = (node[0x02] & 0x4000) >> 14;
+			w.nodeAttribs.currentTexOffsetX	= tx;
+			w.nodeAttribs.currentTexOffsetY = ty;
+			w.nodeAttribs.currentPage = (node[0x02] & 0x4000) >> 14;
+		}
+	}
+
+	// The node's origin is all the culling tests need, and it comes out the same as the translation of the full matrix
+	// (a reset only takes out rotation and scale). Most culled nodes can then be dropped without building their matrix.
+	float x, y, z;
+	if (node[0x00] & 0x10) {
+		TransformOrigin(w.modelMat, Util::Uint32AsFloat(node[0x04 - NodeOffset]), Util::Uint32AsFloat(node[0x05 - NodeOffset]), Util::Uint32AsFloat(node[0x06 - NodeOffset]), x, y, z);
+	}
+	else if (matrixOffset && w.matrixBasePtr) {
+		const float* src = &w.matrixBasePtr[matrixOffset * 12];
+		LogCullingRead(w, w.matrixBaseAddr + matrixOffset * 12, 12);
+		TransformOrigin(w.modelMat, src[0], src[1], src[2], x, y, z);
+	}
+	else {
+		x = w.modelMat.currentMatrix[12];
+		y = w.modelMat.currentMatrix[13];
+		z = w.modelMat.currentMatrix[14];
+	}
+
+	uCullRadius = node[9 - NodeOffset] & 0xFFFF;
+	fCullRadius = R3DFloat::GetFloat16(uCullRadius) * w.nodeAttribs.currentModelScale;;
+
+	uBlendRadius = node[9 - NodeOffset] >> 16;
+	fBlendRadius = R3DFloat::GetFloat16(uBlendRadius) * w.nodeAttribs.currentModelScale;;
+
+	const LOD * const lod = w.lodBlendTable->table[lodTablePointer].lod;
+	float LODscale = std::numeric_limits<float>::max();
+
+	if (!w.nodeAttribs.currentDisableCulling) {
+
+		if ((z * w.planes.bnlu - x * w.planes.bnlv * w.planes.correction) > fCullRadius ||
+			(z * w.planes.bntu + y * w.planes.bntw) > fCullRadius ||
+			(z * w.planes.bnru - x * w.planes.bnrv * w.planes.correction) > fCullRadius ||
+			(z * w.planes.bnbu + y * w.planes.bnbw) > fCullRadius)
+		{
+			w.nodeAttribs.Pop();							// outside the frustum
+			return;
+		}
+
+		LODscale = std::clamp(fBlendRadius / std::sqrt(x * x + y * y + z * z), 0.0f, std::numeric_limits<float>::max());
+
+		if (!(LODscale >= lod[3].deleteSize)) {
+			w.nodeAttribs.Pop();							// too small to see
+			return;
 		}
 	}
 
 	// Apply matrix and translation
-	m_modelMat.PushMatrix();
+	w.modelMat.PushMatrix();
 
 	// apply translation vector
 	if (node[0x00] & 0x10) {
-		float centroid_x = Util::Uint32AsFloat(node[0x04 - m_offset]);
-		float centroid_y = Util::Uint32AsFloat(node[0x05 - m_offset]);
-		float centroid_z = Util::Uint32AsFloat(node[0x06 - m_offset]);
-		m_modelMat.Translate(centroid_x, centroid_y, centroid_z);
+		float centroid_x = Util::Uint32AsFloat(node[0x04 - NodeOffset]);
+		float centroid_y = Util::Uint32AsFloat(node[0x05 - NodeOffset]);
+		float centroid_z = Util::Uint32AsFloat(node[0x06 - NodeOffset]);
+		w.modelMat.Translate(centroid_x, centroid_y, centroid_z);
 	}
 	// multiply matrix, if specified
 	else if (matrixOffset) {
-		MultMatrix(matrixOffset,m_modelMat);
+		MultMatrix(w, matrixOffset);
 	}
 
 	if (resetMatrix) {
-		ResetMatrix(m_modelMat);
+		ResetMatrix(w.modelMat);
 	}
 
-	float& x = m_modelMat.currentMatrix[12];
-	float& y = m_modelMat.currentMatrix[13];
-	float& z = m_modelMat.currentMatrix[14];
-
-	uCullRadius = node[9 - m_offset] & 0xFFFF;
-	fCullRadius = R3DFloat::GetFloat16(uCullRadius) * m_nodeAttribs.currentModelScale;;
-
-	uBlendRadius = node[9 - m_offset] >> 16;
-	fBlendRadius = R3DFloat::GetFloat16(uBlendRadius) * m_nodeAttribs.currentModelScale;;
-
-	bool outsideFrustum = false;
-	if ((z * m_planes.bnlu - x * m_planes.bnlv * m_planes.correction) > fCullRadius ||
-		(z * m_planes.bntu + y * m_planes.bntw) > fCullRadius ||
-		(z * m_planes.bnru - x * m_planes.bnrv * m_planes.correction) > fCullRadius ||
-		(z * m_planes.bnbu + y * m_planes.bnbw) > fCullRadius)
+	// Descend down first link
+	if ((node[0x00] & 0x08))	// 4-element LOD table
 	{
-		outsideFrustum = true;
-	}
-
-	float LODscale = m_nodeAttribs.currentDisableCulling ? std::numeric_limits<float>::max() : (fBlendRadius / std::hypot(x, y, z));
-	const LOD * const lod = m_LODBlendTable->table[lodTablePointer].lod;
-
-	LODscale = std::clamp(LODscale, 0.0f, std::numeric_limits<float>::max());
-
-	if (m_nodeAttribs.currentDisableCulling || (!outsideFrustum && LODscale >= lod[3].deleteSize)) {
+		lodPtr = TranslateCullingAddress(child1Ptr);
 
-		// Descend down first link
-		if ((node[0x00] & 0x08))	// 4-element LOD table
+		if (nullptr != lodPtr)
 		{
-			lodPtr = TranslateCullingAddress(child1Ptr);
+			LogCullingRead(w, child1Ptr, 4);
 
-			if (nullptr != lodPtr)
+			int modelLOD;
+			for (modelLOD = 0; modelLOD < 3; modelLOD++)
 			{
-				int modelLOD;
-				for (modelLOD = 0; modelLOD < 3; modelLOD++)
-				{
-					if (LODscale >= lod[modelLOD].deleteSize && lodPtr[modelLOD] & 0x1000000)
-						break;
-				}
-
-				float tempAlpha = m_nodeAttribs.currentModelAlpha;
+				if (LODscale >= lod[modelLOD].deleteSize && lodPtr[modelLOD] & 0x1000000)
+					break;
+			}
 
-				float nodeAlpha = lod[modelLOD].blendFactor * (LODscale - lod[modelLOD].deleteSize);
-				nodeAlpha = std::clamp(nodeAlpha, 0.0f, 1.0f);
-				if (nodeAlpha > (float)(31.0 / 32.0))		// shader discards pixels below 1/32 alpha
-					nodeAlpha = 1.0f;
-				else if (nodeAlpha < (float)(1.0 / 32.0))
-					nodeAlpha = 0.0f;
-				m_nodeAttribs.currentModelAlpha *= nodeAlpha;	// alpha of each node multiples by the alpha of its parent
-				
-				if ((node[0x03 - m_offset] & 0x20000000)) {
-					DescendCullingNode(lodPtr[modelLOD] & 0xFFFFFF);
+			float tempAlpha = w.nodeAttribs.currentModelAlpha;
 
-					if (nodeAlpha < 1.0f && modelLOD != 3)
-					{
-						m_nodeAttribs.currentModelAlpha = (1.0f - nodeAlpha) * tempAlpha;
-						DescendCullingNode(lodPtr[modelLOD+1] & 0xFFFFFF);
-					}
+			float nodeAlpha = lod[modelLOD].blendFactor * (LODscale - lod[modelLOD].deleteSize);
+			nodeAlpha = std::clamp(nodeAlpha, 0.0f, 1.0f);
+			if (nodeAlpha > (float)(31.0 / 32.0))		// shader discards pixels below 1/32 alpha
+				nodeAlpha = 1.0f;
+			else if (nodeAlpha < (float)(1.0 / 32.0))
+				nodeAlpha = 0.0f;
+			w.nodeAttribs.currentModelAlpha *= nodeAlpha;	// alpha of each node multiples by the alpha of its parent
+			
+			if ((node[0x03 - NodeOffset] & 0x20000000)) {
+				DescendCullingNode<NodeOffset>(w, lodPtr[modelLOD] & 0xFFFFFF);
+
+				if (nodeAlpha < 1.0f && modelLOD != 3)
+				{
+					w.nodeAttribs.currentModelAlpha = (1.0f - nodeAlpha) * tempAlpha;
+					DescendCullingNode<NodeOffset>(w, lodPtr[modelLOD+1] & 0xFFFFFF);
 				}
-				else {
-					DrawModel(lodPtr[modelLOD] & 0xFFFFFF);
+			}
+			else {
+				EmitModel(w, lodPtr[modelLOD] & 0xFFFFFF);
 
-					if (nodeAlpha < 1.0f && modelLOD != 3)
-					{
-						m_nodeAttribs.currentModelAlpha = (1.0f - nodeAlpha) * tempAlpha;
-						DrawModel(lodPtr[modelLOD + 1] & 0xFFFFFF);
-					}
+				if (nodeAlpha < 1.0f && modelLOD != 3)
+				{
+					w.nodeAttribs.currentModelAlpha = (1.0f - nodeAlpha) * tempAlpha;
+					EmitModel(w, lodPtr[modelLOD + 1] & 0xFFFFFF);
 				}
 			}
 		}
-		else {
-
-			float nodeAlpha = lod[3].blendFactor * (LODscale - lod[3].deleteSize);
-			nodeAlpha = std::clamp(nodeAlpha, 0.0f, 1.0f);
-			m_nodeAttribs.currentModelAlpha *= nodeAlpha;	// alpha of each node multiples by the alpha of its parent
+	}
+	else {
 
-			DescendNodePtr(child1Ptr);
-		}
+		float nodeAlpha = lod[3].blendFactor * (LODscale - lod[3].deleteSize);
+		nodeAlpha = std::clamp(nodeAlpha, 0.0f, 1.0f);
+		w.nodeAttribs.currentModelAlpha *= nodeAlpha;	// alpha of each node multiples by the alpha of its parent
 
+		DescendNodePtr<NodeOffset>(w, child1Ptr);
 	}
 
-	m_modelMat.PopMatrix();
+	w.modelMat.PopMatrix();
 
 	// Restore old texture offsets
-	m_nodeAttribs.Pop();
+	w.nodeAttribs.Pop();
 }
 
-void CNew3D::DescendNodePtr(UINT32 nodeAddr)
+template <int NodeOffset>
+void CNew3D::DescendNodePtr(SceneWalk& w, UINT32 nodeAddr)
 {
 	// Ignore null links
 	if ((nodeAddr & 0x00FFFFFF) == 0) {
@@ -835,20 +1677,21 @@ void CNew3D::DescendNodePtr(UINT32 nodeAddr)
 	switch ((nodeAddr >> 24) & 0x5)		// pointer type encoded in upper 8 bits
 	{
 	case 0x00:
-		DescendCullingNode(nodeAddr & 0xFFFFFF);
+		DescendCullingNode<NodeOffset>(w, nodeAddr & 0xFFFFFF);
 		break;
 	case 0x01:
-		DrawModel(nodeAddr & 0xFFFFFF);
+		EmitModel(w, nodeAddr & 0xFFFFFF);
 		break;
 	case 0x04:
-		DescendPointerList(nodeAddr & 0xFFFFFF);
+		DescendPointerList<NodeOffset>(w, nodeAddr & 0xFFFFFF);
 		break;
 	default:
 		break;
 	}
 }
 
-void CNew3D::DescendPointerList(UINT32 addr)
+template <int NodeOffset>
+void CNew3D::DescendPointerList(SceneWalk& w, UINT32 addr)
 {
 	const UINT32* const list = TranslateCullingAddress(addr);
 
@@ -860,19 +1703,185 @@ void CNew3D::DescendPointerList(UINT32 addr)
 
 	while (true) {
 
-		if (list[index] & 0x01000000) {
-			break;	// empty list
-		}
+		LogCullingRead(w, addr + index, 1);
+
+		if (list[index] & 0x01000000) {
+			break;	// empty list
+		}
+
+		UINT32 nodeAddr = list[index] & 0x00FFFFFF;	// clear upper 8 bits to ensure this is processed as a culling node
+
+		DescendCullingNode<NodeOffset>(w, nodeAddr);
+
+		if (list[index] & 0x02000000) {
+			break;	// list end
+		}
+
+		index++;
+	}
+}
+
+
+/******************************************************************************
+Subtrees
+******************************************************************************/
+
+// 4 KB page of culling RAM holding a word address, pages of low RAM first then high RAM, or -1 if unmapped
+static int CullingPage(UINT32 addr)
+{
+	addr &= 0x00FFFFFF;
+
+	if ((addr >= 0x800000) && (addr < 0x840000)) {
+		return 1024 + ((addr & 0x3FFFF) >> 10);
+	}
+	else if (addr < 0x100000) {
+		return addr >> 10;
+	}
+
+	return -1;
+}
+
+void CNew3D::BeginSubtrees()
+{
+	bool recorded	= m_subtreeRecording;
+	bool record		= m_sceneReuseEnabled && m_cullingRAMTracked;
+
+	// spare walks are cleared too, so a viewport that comes back later doesn't find the scene from before it went
+	for (auto& w : m_walks) {
+		std::swap(w.cur, w.prev);
+		w.cur->subtrees.clear();
+		w.cur->models.clear();
+		w.cur->pages.clear();
+		w.cur->byAddr.clear();
+	}
+
+	m_subtreeRecording	= record;
+	m_subtreePrevValid	= record && recorded && !m_cullingRAMUnknown;
+	m_cullingRAMUnknown	= false;
+}
+
+void CNew3D::EndSubtrees()
+{
+	memset(m_cullingRAMChanges, 0, sizeof(m_cullingRAMChanges));
+}
+
+void CNew3D::LogCullingRead(SceneWalk& w, UINT32 addr, UINT32 numWords)
+{
+	if (!m_subtreeRecording) {
+		return;
+	}
+
+	int first	= CullingPage(addr);
+	int last	= CullingPage(addr + numWords - 1);
+
+	if (first < 0 || last < 0) {
+		return;		// nothing is read from outside culling RAM
+	}
+
+	// consecutive reads mostly stay in one page, but a page logged before the current call began doesn't count for it
+	std::vector<UINT16>& pages = w.cur->pages;
+
+	for (int page = first; page <= last; page++) {
+		if (pages.size() <= w.pageFloor || pages.back() != page) {
+			pages.push_back((UINT16)page);
+		}
+	}
+}
+
+bool CNew3D::CullingRangeChanged(UINT32 addr, UINT32 numWords) const
+{
+	int first	= CullingPage(addr);
+	int last	= CullingPage(addr + numWords - 1);
+
+	for (int page = first; page >= 0 && page <= last; page++) {
+		if (m_cullingRAMChanges[page >> 3] & (1 << (page & 7))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool CNew3D::ReplaySubtree(SceneWalk& w, const SubtreeInput& input)
+{
+	const SubtreeScene& prev = *w.prev;
+
+	auto it = prev.byAddr.find(input.addr);
+	if (it == prev.byAddr.end()) {
+		return false;
+	}
+
+	UINT32 index = it->second;
+	while (index != ~0u && memcmp(&prev.subtrees[index].input, &input, sizeof(input)) != 0) {
+		index = prev.subtrees[index].nextSameAddr;
+	}
+
+	if (index == ~0u) {
+		return false;
+	}
+
+	const Subtree& s = prev.subtrees[index];
+
+	for (UINT32 i = s.firstPage; i < s.lastPage; i++) {
+		UINT16 page = prev.pages[i];
+		if (m_cullingRAMChanges[page >> 3] & (1 << (page & 7))) {
+			return false;
+		}
+	}
+
+	// the calls made within this one are kept as well, so they can still be replayed once something around them changes
+	SubtreeScene& cur	= *w.cur;
+	UINT32 nestedBase	= (UINT32)cur.subtrees.size();
+	UINT32 modelBase	= (UINT32)cur.models.size();
+	UINT32 pageBase		= (UINT32)cur.pages.size();
+
+	for (UINT32 i = s.firstNested; i <= index; i++) {
+		Subtree t		= prev.subtrees[i];
+		t.firstNested	= t.firstNested - s.firstNested + nestedBase;
+		t.firstModel	= t.firstModel - s.firstModel + modelBase;
+		t.lastModel		= t.lastModel - s.firstModel + modelBase;
+		t.firstPage		= t.firstPage - s.firstPage + pageBase;
+		t.lastPage		= t.lastPage - s.firstPage + pageBase;
+		cur.subtrees.push_back(t);
+		AddSubtree(w, (UINT32)cur.subtrees.size() - 1);
+	}
+
+	cur.pages.insert(cur.pages.end(), prev.pages.begin() + s.firstPage, prev.pages.begin() + s.lastPage);
+
+	// the models are merged like any others, so that caching and decoding work as usual
+	cur.models.insert(cur.models.end(), prev.models.begin() + s.firstModel, prev.models.begin() + s.lastModel);
+	w.colorTableAddr = s.colorTableAddrOut;
+
+	return true;
+}
+
+void CNew3D::AddSubtree(SceneWalk& w, UINT32 index)
+{
+	SubtreeScene& cur = *w.cur;
+	Subtree& s = cur.subtrees[index];
+
+	// newest first, a subtree is looked up by its address and then by the state it is reached in
+	auto result = cur.byAddr.emplace(s.input.addr, index);
+	s.nextSameAddr = result.second ? ~0u : result.first->second;
+	result.first->second = index;
+}
 
-		UINT32 nodeAddr = list[index] & 0x00FFFFFF;	// clear upper 8 bits to ensure this is processed as a culling node
+void CNew3D::SetCullingRAMChanges(const uint8_t *loPages, const uint8_t *hiPages)
+{
+	// accumulated until a scene is built, like the polygon RAM changes
+	m_cullingRAMTracked = loPages != nullptr;
 
-		DescendCullingNode(nodeAddr);
+	if (loPages == nullptr) {
+		m_cullingRAMUnknown = true;
+		return;
+	}
 
-		if (list[index] & 0x02000000) {
-			break;	// list end
-		}
+	for (size_t i = 0; i < 128; i++) {
+		m_cullingRAMChanges[i] |= loPages[i];
+	}
 
-		index++;
+	for (size_t i = 0; i < 32; i++) {
+		m_cullingRAMChanges[128 + i] |= hiPages[i];
 	}
 }
 
@@ -891,32 +1900,15 @@ Matrix Stack
 * index is a 12-bit number specifying a matrix number relative to the base.
 * The base matrix MUST be set up before calling this function.
 */
-void CNew3D::MultMatrix(UINT32 matrixOffset, Mat4& mat)
+void CNew3D::MultMatrix(SceneWalk& w, UINT32 matrixOffset)
 {
-	GLfloat		m[4*4];
-	const float	*src = &m_matrixBasePtr[matrixOffset * 12];
-
-	if (m_matrixBasePtr == NULL)	// LA Machineguns
+	if (w.matrixBasePtr == NULL)	// LA Machineguns
 		return;
 
-	m[CMINDEX(0, 0)] = src[3];
-	m[CMINDEX(0, 1)] = src[4];
-	m[CMINDEX(0, 2)] = src[5];
-	m[CMINDEX(0, 3)] = src[0];
-	m[CMINDEX(1, 0)] = src[6];
-	m[CMINDEX(1, 1)] = src[7];
-	m[CMINDEX(1, 2)] = src[8];
-	m[CMINDEX(1, 3)] = src[1];
-	m[CMINDEX(2, 0)] = src[9];
-	m[CMINDEX(2, 1)] = src[10];
-	m[CMINDEX(2, 2)] = src[11];
-	m[CMINDEX(2, 3)] = src[2];
-	m[CMINDEX(3, 0)] = 0.0;
-	m[CMINDEX(3, 1)] = 0.0;
-	m[CMINDEX(3, 2)] = 0.0;
-	m[CMINDEX(3, 3)] = 1.0;
-
-	mat.MultMatrix(m);
+	// matrices are stored as the translation followed by the rows of the rotation, which is used as is
+	const float	*src = &w.matrixBasePtr[matrixOffset * 12];
+	LogCullingRead(w, w.matrixBaseAddr + matrixOffset * 12, 12);
+	w.modelMat.MultAffineMatrix(&src[3], &src[0]);
 }
 
 /*
@@ -948,7 +1940,7 @@ void CNew3D::MultMatrix(UINT32 matrixOffset, Mat4& mat)
 * NOTE: This function assumes we are in GL_MODELVIEW matrix mode.
 */
 
-void CNew3D::InitMatrixStack(UINT32 matrixBaseAddr, Mat4& mat)
+void CNew3D::InitMatrixStack(SceneWalk& w, UINT32 matrixBaseAddr)
 {
 	GLfloat m[4 * 4];
 
@@ -959,14 +1951,23 @@ void CNew3D::InitMatrixStack(UINT32 matrixBaseAddr, Mat4& mat)
 	m[CMINDEX(2, 0)] =-1.0; m[CMINDEX(2, 1)] = 0.0;	m[CMINDEX(2, 2)] = 0.0;	m[CMINDEX(2, 3)] = 0.0;
 	m[CMINDEX(3, 0)] = 0.0;	m[CMINDEX(3, 1)] = 0.0;	m[CMINDEX(3, 2)] = 0.0;	m[CMINDEX(3, 3)] = 1.0;
 
-	mat.LoadMatrix(m);
+	w.modelMat.LoadMatrix(m);
 
 	// Set matrix base address and apply matrix #0 (coordinate system matrix)
-	m_matrixBasePtr = (float *)TranslateCullingAddress(matrixBaseAddr);
-	MultMatrix(0, mat);
+	w.matrixBasePtr = (float *)TranslateCullingAddress(matrixBaseAddr);
+	w.matrixBaseAddr = matrixBaseAddr;
+	MultMatrix(w, 0);
 }
 
 // what this does is to set the rotation back to zero, whilst keeping the position and scale of the current matrix
+void CNew3D::TransformOrigin(const float* mat, float tx, float ty, float tz, float& x, float& y, float& z) const
+{
+	// same sums in the same order as the translation column of Mat4::MultMatrix, so the results match it exactly
+	x = mat[0] * tx + mat[4] * ty + mat[8] * tz + mat[12] * 1.0f;
+	y = mat[1] * tx + mat[5] * ty + mat[9] * tz + mat[13] * 1.0f;
+	z = mat[2] * tx + mat[6] * ty + mat[10] * tz + mat[14] * 1.0f;
+}
+
 void CNew3D::ResetMatrix(Mat4& mat) const
 {
 	float m[16];
@@ -995,8 +1996,54 @@ void CNew3D::ResetMatrix(Mat4& mat) const
 	mat.MultMatrix(m);
 }
 
-// Draws viewports of the given priority
+// Draws the viewport and the ones linked after it. Each viewport's tree is walked as a job of its own, their models are then
+// added to the scene in viewport order, as if the viewports had been traversed one after another
 void CNew3D::RenderViewport(UINT32 addr)
+{
+	size_t count = 0;
+
+	while ((addr & 0x00FFFFFF) != 0) {
+
+		const UINT32* const vpnode = TranslateCullingAddress(addr);
+
+		if (nullptr == vpnode) {
+			break;
+		}
+
+		if (count == m_walks.size()) {
+			m_walks.emplace_back();
+		}
+
+		m_walks[count++].addr = addr;
+
+		if (vpnode[0x01] == 0x01000000) {
+			break;
+		}
+
+		addr = vpnode[0x01];
+	}
+
+	if (count > 1 && m_decodeJobs > 1) {
+		Util::JobGroup group;
+		for (size_t i = 1; i < count; i++) {
+			group.Run([this, i]() { WalkViewport(m_walks[i]); });
+		}
+		WalkViewport(m_walks[0]);
+		group.Wait();
+	}
+	else {
+		for (size_t i = 0; i < count; i++) {
+			WalkViewport(m_walks[i]);
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		MergeViewport(m_walks[i]);
+	}
+}
+
+// Traverses one viewport's tree into its walk. Runs on any thread, so nothing outside the walk is written
+void CNew3D::WalkViewport(SceneWalk& w)
 {
 	static const GLfloat	color[8][3] =
 	{											// RGB1 color translation
@@ -1010,31 +2057,20 @@ void CNew3D::RenderViewport(UINT32 addr)
 		{ 1.0f, 1.0f, 1.0f }	// white
 	};
 
-	if ((addr & 0x00FFFFFF) == 0) {
-		return;
-	}
-
 	// Translate address and obtain pointer
-	const uint32_t * const vpnode = TranslateCullingAddress(addr);
+	const uint32_t * const vpnode = TranslateCullingAddress(w.addr);
 
-	if (nullptr == vpnode) {
-		return;
-	}
+	w.nodes = 0;
 
 	bool vpDisabled = vpnode[0] & 0x20;						// only if viewport enabled
 
 	{
-		// create node object 
-		m_nodes.emplace_back(Node());
-		m_nodes.back().models.reserve(2048);				// create space for models
-
 		// get pointer to its viewport
-		Viewport* vp = &m_nodes.back().viewport;
+		Viewport* vp = &w.viewport;
 
 		vp->priority = (vpnode[0] >> 3) & 0x3;
 		vp->select = (vpnode[0] >> 8) & 0x3;
 		vp->number = (vpnode[0] >> 10);
-		m_currentPriority = vp->priority;
 
 		// Fetch viewport parameters (TO-DO: would rounding make a difference?)
 		vp->vpX			= (int)(((vpnode[0x1A] & 0xFFFF) * (float)(1.0 / 16.0)) + 0.5f);		// viewport X (12.4 fixed point)
@@ -1044,7 +2080,11 @@ void CNew3D::RenderViewport(UINT32 addr)
 
 		uint32_t matrixBase = vpnode[0x16] & 0xFFFFFF;							// matrix base address
 
-		m_LODBlendTable = (LODBlendTable*)TranslateCullingAddress(vpnode[0x17] & 0xFFFFFF);
+		w.lodBlendTable = (LODBlendTable*)TranslateCullingAddress(vpnode[0x17] & 0xFFFFFF);
+		w.lodTableAddr = vpnode[0x17] & 0xFFFFFF;
+
+		// every node reads the LOD table, so rather than recording it for each, nothing is replayed once it is written
+		w.replay = m_subtreePrevValid && !CullingRangeChanged(w.lodTableAddr, sizeof(LODBlendTable) / 4);
 
 		float cv = Util::Uint32AsFloat(vpnode[0x8]);	// 1/(left-right)
 		float cw = Util::Uint32AsFloat(vpnode[0x9]);	// 1/(top-bottom)
@@ -1052,15 +2092,14 @@ void CNew3D::RenderViewport(UINT32 addr)
 		float jo = Util::Uint32AsFloat(vpnode[0xb]);	// left / right (ratio)
 
 		// clipping plane normals
-		m_planes.bnlu = Util::Uint32AsFloat(vpnode[0xc]);
-		m_planes.bnlv = Util::Uint32AsFloat(vpnode[0xd]);
-		m_planes.bntu = Util::Uint32AsFloat(vpnode[0xe]);
-		m_planes.bntw = Util::Uint32AsFloat(vpnode[0xf]);
-		m_planes.bnru = Util::Uint32AsFloat(vpnode[0x10]);
-		m_planes.bnrv = Util::Uint32AsFloat(vpnode[0x11]);
-		m_planes.bnbu = Util::Uint32AsFloat(vpnode[0x12]);
-		m_planes.bnbw = Util::Uint32AsFloat(vpnode[0x13]);
-		m_planes.correction = 1.0f;		// might get changed by the calc viewport method
+		w.planes.bnlu = Util::Uint32AsFloat(vpnode[0xc]);
+		w.planes.bnlv = Util::Uint32AsFloat(vpnode[0xd]);
+		w.planes.bntu = Util::Uint32AsFloat(vpnode[0xe]);
+		w.planes.bntw = Util::Uint32AsFloat(vpnode[0xf]);
+		w.planes.bnru = Util::Uint32AsFloat(vpnode[0x10]);
+		w.planes.bnrv = Util::Uint32AsFloat(vpnode[0x11]);
+		w.planes.bnbu = Util::Uint32AsFloat(vpnode[0x12]);
+		w.planes.bnbw = Util::Uint32AsFloat(vpnode[0x13]);
 
 		vp->angle_left		= (0.0f - jo) / cv;
 		vp->angle_right		= (1.0f - jo) / cv;
@@ -1069,7 +2108,7 @@ void CNew3D::RenderViewport(UINT32 addr)
 
 		vp->cota = Util::Uint32AsFloat(vpnode[0x3]);
 
-		CalcViewport(vp);
+		w.planes.correction = CalcViewport(vp);
 
 		// Lighting (note that sun vector points toward sun -- away from vertex)
 		vp->lightingParams[0] = Util::Uint32AsFloat(vpnode[0x05]);							// sun X
@@ -1141,24 +2180,50 @@ void CNew3D::RenderViewport(UINT32 addr)
 		vp->scrollAtt = (float)(vpnode[0x24] & 0xFF) * (float)(1.0 / 255.0);				// scroll attenuation
 
 		// Clear texture offsets before proceeding
-		m_nodeAttribs.Reset();
+		w.nodeAttribs.Reset();
+		w.modelMat.Release();			// would hope we wouldn't need this but no harm in checking
 
 		// Set up coordinate system and base matrix
-		InitMatrixStack(matrixBase, m_modelMat);
+		InitMatrixStack(w, matrixBase);
+
+		// the color table is carried on from the viewports before, which are walked at the same time
+		w.colorTableAddr = InheritedColorTable;
 
 		// Descend down the node link. Need to start with a culling node because that defines our culling radius.
 		if (!vpDisabled) {
 			auto childptr = vpnode[0x02];
 			if (((childptr >> 24) & 0x5) == 0) {
-				DescendNodePtr(vpnode[0x02]);
+				(this->*m_descendNodePtr)(w, vpnode[0x02]);
 			}
 		}
 	}
-	
-	// render next viewport
-	if (vpnode[0x01] != 0x01000000) {
-		RenderViewport(vpnode[0x01]);
+}
+
+void CNew3D::MergeViewport(SceneWalk& w)
+{
+	// create node object 
+	m_nodes.emplace_back(Node());
+
+	if (m_spareModels.empty()) {
+		m_nodes.back().models.reserve(2048);			// create space for models
 	}
+	else {
+		m_nodes.back().models = std::move(m_spareModels.back());
+		m_spareModels.pop_back();
+	}
+
+	m_nodes.back().viewport = w.viewport;
+	m_currentPriority = w.viewport.priority;
+	m_stats.nodes += w.nodes;
+
+	const UINT32 inherited = m_colorTableAddr;
+
+	for (const SubtreeModel& r : w.cur->models) {
+		m_colorTableAddr = (r.colorTableAddr == InheritedColorTable) ? inherited : r.colorTableAddr;
+		DrawModel(r);
+	}
+
+	m_colorTableAddr = (w.colorTableAddr == InheritedColorTable) ? inherited : w.colorTableAddr;
 }
 
 void CNew3D::CopyVertexData(const R3DPoly& r3dPoly, std::vector<FVertex>& vertexArray)
@@ -1308,17 +2373,52 @@ void CNew3D::SetMeshValues(SortingMesh *currentMesh, PolyHeader &ph)
 	}
 }
 
-void CNew3D::CacheModel(Model *m, const UINT32 *data)
+void CNew3D::CacheModel(Model *m, UINT32 modelAddr, const UINT32 *data)
 {
+	TRACE_ZONE("Cache model");
 	if (data == nullptr)
 		return;
 
+	if (m_decodeJobs > 1) {
+		PolyHeader ph;
+		ph = data;
+
+		bool independent = ph.header[6] != 0;
+		for (int i = 0; i < 4; i++) {
+			independent = independent && !ph.SharedVertex(i);
+		}
+
+		if (m_decodeCount == m_decodeQueue.size()) {
+			m_decodeQueue.emplace_back();
+		}
+
+		QueuedModel& q		= m_decodeQueue[m_decodeCount++];
+		q.meshes			= m->meshes;
+		q.modelAddr			= modelAddr;
+		q.dynamic			= m->dynamic;
+		q.data				= data;
+		q.colorTableAddr	= m_colorTableAddr;
+		q.independent		= independent;
+		return;
+	}
+
+	DecodeModel(data, m_colorTableAddr, m_prev, m_sortingMeshes);
+	StoreModel(*m->meshes, modelAddr, m->dynamic, m_sortingMeshes);
+}
+
+void CNew3D::DecodeModel(const UINT32 *data, UINT32 colorTableAddr, PrevVertices& prev, std::vector<SortingMesh>& meshes)
+{
+	size_t numMeshes = 0;				// meshes already in the vector are reused, which keeps their vertex storage
+
+	if (data == nullptr) {
+		meshes.clear();
+		return;
+	}
+
 	UINT16			texCoords[4][2];
 	PolyHeader		ph;
 	UINT64			lastHash	= -1;
 	SortingMesh*	currentMesh = nullptr;
-	
-	std::unordered_map<UINT64, SortingMesh> sMap;
 
 	ph = data; 
 	int numTriangles = ph.NumTrianglesTotal();
@@ -1338,9 +2438,20 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 
 		if (hash != lastHash) {
 
-			if (sMap.count(hash) == 0) {
+			// models only have a handful of meshes, so a linear search beats a hash table
+			size_t i = 0;
+			while (i < numMeshes && meshes[i].hash != hash) {
+				i++;
+			}
+
+			if (i == numMeshes) {
+
+				if (numMeshes == meshes.size()) {
+					meshes.emplace_back();
+				}
 
-				currentMesh = &sMap.insert({hash, SortingMesh()}).first->second;
+				currentMesh = &meshes[numMeshes++];
+				currentMesh->Reset(hash);
 
 				//make space for our vertices
 				currentMesh->verts.reserve(numTriangles * 3);
@@ -1349,7 +2460,9 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 				SetMeshValues(currentMesh, ph);
 			}
 			else
-				currentMesh = &sMap[hash];
+				currentMesh = &meshes[i];
+
+			lastHash = hash;
 		}
 
 		// Obtain basic polygon parameters
@@ -1364,10 +2477,10 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 		{
 			if (ph.SharedVertex(i))
 			{
-				p.v[j] = m_prev[i];
+				p.v[j] = prev.v[i];
 
-				texCoords[j][0] = m_prevTexCoords[i][0];
-				texCoords[j][1] = m_prevTexCoords[i][1];
+				texCoords[j][0] = prev.texCoords[i][0];
+				texCoords[j][1] = prev.texCoords[i][1];
 
 				//check if we need to recalc tex coords - will only happen if tex tiles are different + sharing vertices
 				if (hash != lastHash) {
@@ -1386,9 +2499,9 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 
 		if (!ph.PolyColor()) {
 			int colorIdx = ph.ColorIndex();
-			p.faceColour[2] = (m_polyRAM[m_colorTableAddr + colorIdx] & 0xFF);
-			p.faceColour[1] = ((m_polyRAM[m_colorTableAddr + colorIdx] >> 8) & 0xFF);
-			p.faceColour[0] = ((m_polyRAM[m_colorTableAddr + colorIdx] >> 16) & 0xFF);
+			p.faceColour[2] = (m_polyRAM[colorTableAddr + colorIdx] & 0xFF);
+			p.faceColour[1] = ((m_polyRAM[colorTableAddr + colorIdx] >> 8) & 0xFF);
+			p.faceColour[0] = ((m_polyRAM[colorTableAddr + colorIdx] >> 16) & 0xFF);
 		}
 		else {
 			p.faceColour[0] = ((ph.header[4] >> 24));
@@ -1492,42 +2605,271 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 		
 		// Copy current vertices into previous vertex array
 		for (int i = 0; i < 4; i++) {
-			m_prev[i] = p.v[i];
-			m_prevTexCoords[i][0] = texCoords[i][0];
-			m_prevTexCoords[i][1] = texCoords[i][1];
+			prev.v[i] = p.v[i];
+			prev.texCoords[i][0] = texCoords[i][0];
+			prev.texCoords[i][1] = texCoords[i][1];
 		}
 
 	} while (ph.NextPoly());
 
-	//sorted the data, now copy to main data structures
+	// the polys are sorted, drop what's left from the previous model
+	meshes.erase(meshes.begin() + numMeshes, meshes.end());
+}
+
+void CNew3D::StoreModel(std::vector<Mesh>& modelMeshes, UINT32 modelAddr, bool dynamic, std::vector<SortingMesh>& meshes)
+{
+	int romOffset = 0, firstPage = 0, numPages = 0;
+
+	if (!dynamic) {
+		int count = 0;
+		for (const auto& mesh : meshes) {
+			count += (int)mesh.verts.size();
+		}
+
+		romOffset = AllocRomVerts(modelAddr, count, firstPage, numPages);
+
+		// every page is referenced by this frame, drop the model and decode it again next time. The entry stays
+		// because models of this frame point at its meshes
+		if (romOffset < 0) {
+			RomModel& romModel	= m_romMap[modelAddr];
+			romModel.present	= false;
+			romModel.meshes.clear();
+			return;
+		}
+	}
 
 	// we know how many meshes we have to reserve appropriate space
-	m->meshes->reserve(sMap.size());
+	modelMeshes.reserve(meshes.size());
 
-	for (auto& it : sMap) {
+	for (auto& mesh : meshes) {
 
-		if (m->dynamic) {
+		if (dynamic) {
 
-			// calculate VBO values for current mesh
-			it.second.vboOffset		= (int)m_polyBufferRam.size() + MAX_ROM_VERTS;
-			it.second.vertexCount	= (int)it.second.verts.size();
+			if (m_ramVerts) {
+				// copy poly data straight into the mapped vbo, drop meshes that don't fit
+				int count = (int)mesh.verts.size();
+				if (m_ramVertCount + count > MAX_RAM_VERTS) {
+					count = 0;
+				}
 
-			// copy poly data to main buffer
-			m_polyBufferRam.insert(m_polyBufferRam.end(), it.second.verts.begin(), it.second.verts.end());
+				mesh.vboOffset		= m_ramVertBase + m_ramVertCount;
+				mesh.vertexCount	= count;
+
+				if (m_packedVertices) {
+					PackVertices(mesh.verts.data(), count, m_numPolyVerts, (PackedVertex*)m_ramVerts + m_ramVertCount, m_ramPolys + (m_ramVertCount / m_numPolyVerts));
+				}
+				else {
+					std::copy(mesh.verts.begin(), mesh.verts.begin() + count, (FVertex*)m_ramVerts + m_ramVertCount);
+				}
+				m_ramVertCount += count;
+			}
+			else {
+				// calculate VBO values for current mesh
+				mesh.vboOffset		= (int)m_polyBufferRam.size() + MAX_ROM_VERTS;
+				mesh.vertexCount	= (int)mesh.verts.size();
+
+				// copy poly data to main buffer
+				m_polyBufferRam.insert(m_polyBufferRam.end(), mesh.verts.begin(), mesh.verts.end());
+			}
 		}
 		else {
 			// calculate VBO values for current mesh
-			it.second.vboOffset		= (int)m_polyBufferRom.size();
-			it.second.vertexCount	= (int)it.second.verts.size();
+			mesh.vboOffset		= romOffset;
+			mesh.vertexCount	= (int)mesh.verts.size();
 
 			// copy poly data to main buffer
-			m_polyBufferRom.insert(m_polyBufferRom.end(), it.second.verts.begin(), it.second.verts.end());
+			std::copy(mesh.verts.begin(), mesh.verts.end(), m_polyBufferRom.begin() + romOffset);
+			romOffset += mesh.vertexCount;
 		}
 
 		//copy the temp mesh into the model structure
 		//this will lose the associated vertex data, which is now copied to the main buffer anyway
-		m->meshes->push_back(it.second);
+		modelMeshes.push_back(mesh);
+	}
+
+	if (!dynamic) {
+		RomModel& romModel	= m_romMap[modelAddr];
+		romModel.firstPage	= firstPage;
+		romModel.numPages	= numPages;
+
+		if (IsVROMModel(modelAddr)) {
+			m_modelCache.Store(modelAddr, modelMeshes, m_polyBufferRom);
+		}
+	}
+}
+
+int CNew3D::AllocRomVerts(UINT32 modelAddr, int count, int& firstPage, int& numPages)
+{
+	numPages = std::max(1, (count + ROM_PAGE_VERTS - 1) / ROM_PAGE_VERTS);
+
+	if (numPages == 1 && m_romOpenPage >= 0 && m_romPages[m_romOpenPage].used + count <= ROM_PAGE_VERTS) {
+		firstPage = m_romOpenPage;
+	}
+	else {
+		firstPage = FindRomPages(numPages);
+		if (firstPage < 0) {
+			return -1;
+		}
+
+		for (int i = firstPage; i < firstPage + numPages; i++) {
+			EvictRomPage(i);
+		}
+
+		if (numPages == 1) {
+			m_romOpenPage = firstPage;
+		}
+	}
+
+	int offset = (firstPage * ROM_PAGE_VERTS) + m_romPages[firstPage].used;
+
+	for (int i = firstPage; i < firstPage + numPages; i++) {
+		RomPage& page = m_romPages[i];
+		page.lastUsed	= m_romFrame;
+		page.used		= (numPages == 1) ? page.used + count : ROM_PAGE_VERTS;	// large models own their pages
+		page.models.push_back(modelAddr);
+	}
+
+	RomPage& page = m_romPages[firstPage];
+	page.dirtyFirst	= (page.dirtyFirst < 0) ? offset : std::min(page.dirtyFirst, offset);
+	page.dirtyLast	= std::max(page.dirtyLast, offset + count);
+
+	if ((int)m_polyBufferRom.size() < offset + count) {
+		m_polyBufferRom.resize(offset + count);
 	}
+
+	return offset;
+}
+
+int CNew3D::FindRomPages(int numPages) const
+{
+	// prefer empty pages, then the least recently used run. Pages used this frame are still referenced by m_nodes
+	int best		= -1;
+	INT64 bestAge	= std::numeric_limits<INT64>::max();
+
+	for (int i = 0; i + numPages <= (int)m_romPages.size(); i++) {
+
+		INT64 age = -1;
+
+		for (int j = i; j < i + numPages && age < (INT64)m_romFrame; j++) {
+			const RomPage& page = m_romPages[j];
+			if (!page.models.empty()) {
+				age = std::max(age, (INT64)page.lastUsed);
+			}
+		}
+
+		if (age < (INT64)m_romFrame && age < bestAge) {
+			best	= i;
+			bestAge	= age;
+		}
+	}
+
+	return best;
+}
+
+void CNew3D::EvictRomPage(int page)
+{
+	std::vector<UINT32> models = std::move(m_romPages[page].models);
+
+	m_romPages[page].models.clear();
+	m_romPages[page].used		= 0;
+	m_romPages[page].dirtyFirst	= -1;
+	m_romPages[page].dirtyLast	= -1;
+
+	for (auto addr : models) {
+		auto it = m_romMap.find(addr);
+		if (it == m_romMap.end()) {
+			continue;
+		}
+
+		int first	= it->second.firstPage;
+		int num		= it->second.numPages;
+
+		m_romMap.erase(it);
+
+		// large models own all their pages
+		for (int i = first; i < first + num; i++) {
+			if (i != page && i >= 0) {
+				EvictRomPage(i);
+			}
+		}
+	}
+}
+
+void CNew3D::InvalidateRamModels()
+{
+	bool all = m_polyRAMUnknown || !m_polyRAMTracked;
+
+	m_polyRAMUnknown = false;
+
+	for (auto it = m_ramModels.begin(); it != m_ramModels.end(); ) {
+
+		auto model = m_romMap.find(*it);
+		if (model == m_romMap.end()) {
+			it = m_ramModels.erase(it);		// already evicted with its vbo pages
+			continue;
+		}
+
+		bool written = all;
+		for (UINT32 i = model->second.ramFirst; i <= model->second.ramLast && !written; i++) {
+			written = (m_polyRAMChanges[i >> 3] & (1 << (i & 7))) != 0;
+		}
+
+		if (!written) {
+			++it;
+			continue;
+		}
+
+		// give back the vbo space, pages left empty are free again
+		for (int i = model->second.firstPage; i >= 0 && i < model->second.firstPage + model->second.numPages; i++) {
+			RomPage& page = m_romPages[i];
+			page.models.erase(std::remove(page.models.begin(), page.models.end(), *it), page.models.end());
+			if (page.models.empty()) {
+				page.used		= 0;
+				page.dirtyFirst	= -1;
+				page.dirtyLast	= -1;
+			}
+		}
+
+		m_romMap.erase(model);
+		it = m_ramModels.erase(it);
+	}
+
+	memset(m_polyRAMChanges, 0, sizeof(m_polyRAMChanges));
+}
+
+void CNew3D::UploadRomPages(int vertexSize)
+{
+	for (auto& page : m_romPages) {
+
+		int first = page.dirtyFirst;
+		int count = page.dirtyLast - page.dirtyFirst;
+
+		page.dirtyFirst	= -1;
+		page.dirtyLast	= -1;
+
+		if (first < 0 || count == 0) {
+			continue;
+		}
+
+		if (m_packedVertices) {
+			PackVertexData(&m_polyBufferRom[first], count);
+			m_vbo.BufferSubData(first * vertexSize, m_packedVerts.size() * sizeof(PackedVertex), m_packedVerts.data());
+			m_polyVbo.BufferSubData((first / m_numPolyVerts) * sizeof(PackedPoly), m_packedPolys.size() * sizeof(PackedPoly), m_packedPolys.data());
+		}
+		else {
+			m_vbo.BufferSubData(first * vertexSize, count * sizeof(FVertex), &m_polyBufferRom[first]);
+		}
+
+		m_stats.vertsUploaded += count;
+	}
+}
+
+void CNew3D::PackVertexData(const FVertex* verts, int count)
+{
+	m_packedVerts.resize(count);
+	m_packedPolys.resize((count + m_numPolyVerts - 1) / m_numPolyVerts);
+
+	PackVertices(verts, count, m_numPolyVerts, m_packedVerts.data(), m_packedPolys.data());
 }
 
 bool CNew3D::IsDynamicModel(UINT32 *data) const
@@ -1558,7 +2900,7 @@ bool CNew3D::IsVROMModel(UINT32 modelAddr) const
 	return modelAddr >= 0x100000;
 }
 
-void CNew3D::CalcViewport(Viewport* vp)
+float CNew3D::CalcViewport(Viewport* vp) const
 {
 	float l = vp->angle_left;	// we need to calc the shape of the projection frustum for culling
 	float r = vp->angle_right;
@@ -1595,7 +2937,6 @@ void CNew3D::CalcViewport(Viewport* vp)
 		// screen and non-wide-screen modes have identical resolution parameters
 		// and only their scissor box differs)
 		float correction = windowAR / viewableAreaAR;
-		m_planes.correction = 1.0f / correction;
 
 		vp->x		= 0;
 		vp->y		= m_yOffs + (int)((float)(384 - (vp->vpY + vp->vpHeight))*m_yRatio);
@@ -1603,6 +2944,8 @@ void CNew3D::CalcViewport(Viewport* vp)
 		vp->height = (int)((float)vp->vpHeight*m_yRatio);
 
 		vp->projectionMatrix.FrustumRZ(l*correction, r*correction, b, t, NEAR_PLANE);
+
+		return 1.0f / correction;
 	}
 	else {
 
@@ -1613,6 +2956,8 @@ void CNew3D::CalcViewport(Viewport* vp)
 
 		vp->projectionMatrix.FrustumRZ(l, r, b, t, NEAR_PLANE);
 	}
+
+	return 1.0f;
 }
 
 void CNew3D::TranslateTexture(unsigned& x, unsigned& y, int width, int height, int& page) const
@@ -1628,6 +2973,49 @@ void CNew3D::SetSunClamp(bool enable)
 	m_sunClamp = enable;
 }
 
+void CNew3D::SetSceneUnchanged(bool unchanged)
+{
+	m_sceneUnchanged = unchanged;
+}
+
+void CNew3D::SetPolygonRAMChanges(const uint8_t *dirtyPages)
+{
+	// accumulated until a scene is built, reused scenes don't look at the models
+	m_polyRAMTracked = dirtyPages != nullptr;
+
+	if (dirtyPages == nullptr) {
+		m_polyRAMUnknown = true;
+		return;
+	}
+
+	for (size_t i = 0; i < sizeof(m_polyRAMChanges); i++) {
+		m_polyRAMChanges[i] |= dirtyPages[i];
+	}
+}
+
+void CNew3D::SetLoader(GLLoader *loader)
+{
+	m_r3dShader.SetLoader(loader);
+}
+
+bool CNew3D::SetExternalComposite(bool enable)
+{
+	if (m_samples > 1) {
+		return false;								// the composite would have to resolve the samples
+	}
+
+	m_externalComposite = enable;
+	return true;
+}
+
+void CNew3D::GetCompositeLayers(unsigned textures[3], bool *alphaLayers)
+{
+	textures[0] = m_r3dFrameBuffers.GetTextureID(Layer::colour);
+	textures[1] = m_r3dFrameBuffers.GetTextureID(Layer::trans1);
+	textures[2] = m_r3dFrameBuffers.GetTextureID(Layer::trans2);
+	*alphaLayers = m_transDrawn;
+}
+
 float CNew3D::GetLosValue(int layer)
 {
 	// we always write to the 'back' buffer, and the software reads from the front
@@ -1636,6 +3024,29 @@ float CNew3D::GetLosValue(int layer)
 	return m_losFront->value[layer];
 }
 
+void CNew3D::GetGPUTimings(GPUPassTimings *timings)
+{
+	timings->fogMicros = m_fogTimer.GetMicros();
+	for (int i = 0; i < 4; i++) {
+		timings->layerMicros[i] = m_layerTimers[i].GetMicros();
+	}
+	timings->compositeMicros = m_compositeTimer.GetMicros();
+	timings->drawCalls = m_drawCalls;
+}
+
+void CNew3D::GetRenderStats(RenderStats *stats)
+{
+	*stats = m_stats;
+	stats->viewports = (UINT32)m_nodes.size();
+
+	for (const auto& n : m_nodes) {
+		stats->models += (UINT32)n.models.size();
+		for (const auto& m : n.models) {
+			stats->meshes += (UINT32)m.meshes->size();
+		}
+	}
+}
+
 void CNew3D::TranslateLosPosition(int inX, int inY, int& outX, int& outY) const
 {
 	// remap real3d 496x384 to our new viewport
@@ -1654,35 +3065,69 @@ bool CNew3D::ProcessLos(int priority)
 				int losX, losY;
 				TranslateLosPosition(n.viewport.losPosX, n.viewport.losPosY, losX, losY);
 
-				float range[2];
-				glReadPixels(losX, losY, 1, 1, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, range);
-				GLubyte stencilVal = Util::FloatAsInt32(range[1]);
+				// reading into a buffer queues the copy instead of stalling until the GPU has drawn everything so far
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, m_losReads[priority].pbo);
+				m_losReads[priority].pending = m_r3dFrameBuffers.ReadDepth(losX, losY);	// if it can't be read, the last result stands
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+				return true;
+			}
+		}
+	}
 
-				float zVal = range[0] / NEAR_PLANE;
+	return false;
+}
 
-				// apply our mask to stencil, because layered poly attributes use the lower bits
-				stencilVal &= 0x80;
+void CNew3D::ResolveLos()
+{
+	if (!m_losFence) {
+		return;
+	}
 
-				// if the stencil val is zero that means we've hit sky or whatever, if it hits a 1 we've hit geometry
-				// the real3d returns 1 in the top bit of the float if the line of sight test passes (ie doesn't hit geometry)
+	// a frame later the reads are normally long done
+	while (glClientWaitSync(m_losFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}	// 1 ms
+	glDeleteSync(m_losFence);
+	m_losFence = nullptr;
 
-				auto zValP = reinterpret_cast<unsigned char*>(&zVal);	// this is legal in c++, casting to int technically isn't
+	for (int priority = 0; priority < 4; priority++) {
 
-				if (stencilVal == 0) {
-					zValP[0] |= 1;		// set first bit to 1
-				}
-				else {
-					zValP[0] &= 0xFE;	// set first bit to zero
-				}
+		auto& read = m_losReads[priority];
+		if (!read.pending) {
+			continue;
+		}
+		read.pending = false;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+		auto range = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(float) * 2, GL_MAP_READ_BIT);
+		if (!range) {
+			continue;
+		}
 
-				m_losBack->value[priority] = zVal;
+		GLubyte stencilVal = Util::FloatAsInt32(range[1]);
 
-				return true;
-			}
+		float zVal = range[0] / NEAR_PLANE;
+
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+		// apply our mask to stencil, because layered poly attributes use the lower bits
+		stencilVal &= 0x80;
+
+		// if the stencil val is zero that means we've hit sky or whatever, if it hits a 1 we've hit geometry
+		// the real3d returns 1 in the top bit of the float if the line of sight test passes (ie doesn't hit geometry)
+
+		auto zValP = reinterpret_cast<unsigned char*>(&zVal);	// this is legal in c++, casting to int technically isn't
+
+		if (stencilVal == 0) {
+			zValP[0] |= 1;		// set first bit to 1
 		}
+		else {
+			zValP[0] &= 0xFE;	// set first bit to zero
+		}
+
+		m_losBack->value[priority] = zVal;
 	}
 
-	return false;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
 } // New3D
@@ -28,7 +28,9 @@
 #ifndef INCLUDED_NEW3D_H
 #define INCLUDED_NEW3D_H
 
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <GL/glew.h>
 #include "Types.h"
 #include "Graphics/IRender3D.h"
@@ -36,14 +38,18 @@
 #include "Mat4.h"
 #include "R3DShader.h"
 #include "VBO.h"
+#include "ModelCache.h"
 #include "R3DData.h"
 #include "Plane.h"
 #include "Vec.h"
 #include "R3DScrollFog.h"
 #include "PolyHeader.h"
 #include "R3DFrameBuffers.h"
+#include "Graphics/GPUTimer.h"
 #include <mutex>
 #include "TextureBank.h"
+#include "OSD/Thread.h"
+#include "Util/MemoryUsage.h"
 
 namespace New3D {
 
@@ -54,8 +60,8 @@ public:
 	* RenderFrame(void):
 	*
 	* Renders the complete scene database. Must be called between BeginFrame() and
-	* EndFrame(). This function traverses the scene database and builds up display
-	* lists.
+	* EndFrame(). Waits for the scene database traversal started by BeginFrame()
+	* and draws the resulting display lists.
 	*/
 	void RenderFrame(void);
 
@@ -63,7 +69,8 @@ public:
 	* BeginFrame(void):
 	*
 	* Prepare to render a new frame. Must be called once per frame prior to
-	* drawing anything.
+	* drawing anything. When multi-threaded, the scene database traversal is
+	* started on a worker thread so it overlaps the 2D layer rendering.
 	*/
 	void BeginFrame(void);
 
@@ -164,6 +171,105 @@ public:
 	*/
 	float GetLosValue(int layer);
 
+	/*
+	* GetGPUTimings(GPUPassTimings *timings);
+	*
+	* Gets the GPU time of the fog, layer and compositing passes of a recent
+	* frame
+	*
+	* Parameters:
+	*		timings	Filled with the pass timings
+	*/
+	void GetGPUTimings(GPUPassTimings *timings);
+
+	/*
+	* GetRenderStats(RenderStats *stats);
+	*
+	* Gets what was traversed, drawn and uploaded for the last frame
+	*
+	* Parameters:
+	*		stats	Filled with the counts
+	*/
+	void GetRenderStats(RenderStats *stats);
+
+	/*
+	* SetSceneUnchanged(bool unchanged);
+	*
+	* Tells the renderer whether culling and polygon RAM are unchanged since
+	* the previous frame. Must be called before BeginFrame(). If scene reuse is
+	* enabled, the scene built last is then drawn again without traversing it.
+	*
+	* Parameters:
+	*		unchanged	True if nothing the scene is built from was written
+	*/
+	void SetSceneUnchanged(bool unchanged);
+
+	/*
+	* SetPolygonRAMChanges(const uint8_t *dirtyPages);
+	*
+	* Reports the 4 KB pages of polygon RAM written since the previous frame,
+	* one bit per page. Must be called before BeginFrame(). Models decoded from
+	* polygon RAM are cached while their pages are left alone.
+	*
+	* Parameters:
+	*		dirtyPages	Bitmap of written pages, or NULL if writes aren't
+	*					tracked, in which case RAM models aren't cached
+	*/
+	void SetPolygonRAMChanges(const uint8_t *dirtyPages);
+
+	/*
+	* SetCullingRAMChanges(const uint8_t *loPages, const uint8_t *hiPages);
+	*
+	* Reports the 4 KB pages of low and high culling RAM written since the
+	* previous frame, one bit per page. Must be called before BeginFrame(). If
+	* scene reuse is enabled, culling node subtrees whose memory wasn't written
+	* and that are reached in the same state as before are not traversed
+	* again, their models are taken from the previous scene instead.
+	*
+	* Parameters:
+	*		loPages		Bitmap of written low culling RAM pages, or NULL if
+	*					writes aren't tracked, in which case every subtree is
+	*					traversed
+	*		hiPages		Bitmap of written high culling RAM pages
+	*/
+	void SetCullingRAMChanges(const uint8_t *loPages, const uint8_t *hiPages);
+
+	/*
+	* SetExternalComposite(bool enable);
+	*
+	* When enabled, RenderFrame() leaves the opaque and translucent layers in
+	* the frame buffer textures instead of compositing them into the frame.
+	*
+	* Parameters:
+	*		enable	True if the caller composites the layers itself
+	*
+	* Returns:
+	*		True, unless the layers are multisampled.
+	*/
+	bool SetExternalComposite(bool enable);
+
+	/*
+	* SetLoader(GLLoader *loader);
+	*
+	* Gives the renderer a loader thread with a shared context to link shader
+	* programs on, instead of stalling the render thread on them.
+	*
+	* Parameters:
+	*		loader	Loader to use, or null
+	*/
+	void SetLoader(GLLoader *loader);
+
+	/*
+	* GetCompositeLayers(unsigned textures[3], bool *alphaLayers);
+	*
+	* Gets the layers of the last frame rendered for an external composite.
+	*
+	* Parameters:
+	*		textures	Filled with the opaque and both translucent layer textures
+	*		alphaLayers	Set to whether anything was drawn to the translucent layers
+	*/
+	void GetCompositeLayers(unsigned textures[3], bool *alphaLayers);
+
 	/*
 	* CRender3D(config):
 	* ~CRender3D(void):
@@ -186,25 +292,72 @@ private:
 	const UINT32 *TranslateModelAddress(UINT32 addr);
 
 	// Matrix stack
-	void MultMatrix(UINT32 matrixOffset, Mat4& mat);
-	void InitMatrixStack(UINT32 matrixBaseAddr, Mat4& mat);
+	struct SceneWalk;
+	void MultMatrix(SceneWalk& w, UINT32 matrixOffset);
+	void InitMatrixStack(SceneWalk& w, UINT32 matrixBaseAddr);
 	void ResetMatrix(Mat4& mat) const;
+	void TransformOrigin(const float* mat, float tx, float ty, float tz, float& x, float& y, float& z) const;
 
 	// Scene database traversal
-	bool DrawModel(UINT32 modelAddr);
-	void DescendCullingNode(UINT32 addr);
-	void DescendPointerList(UINT32 addr);
-	void DescendNodePtr(UINT32 nodeAddr);
+	void EmitModel(SceneWalk& w, UINT32 modelAddr);
+	// Traversal is instantiated for each culling node layout (NodeOffset words
+	// missing in front of word 3: 2 on Step 1.0, 0 on Step 1.5 and later)
+	template <int NodeOffset> void DescendCullingNode(SceneWalk& w, UINT32 addr);
+	template <int NodeOffset> void TraverseCullingNode(SceneWalk& w, UINT32 addr);
+	template <int NodeOffset> void DescendPointerList(SceneWalk& w, UINT32 addr);
+	template <int NodeOffset> void DescendNodePtr(SceneWalk& w, UINT32 nodeAddr);
 	void RenderViewport(UINT32 addr);
+	void WalkViewport(SceneWalk& w);					// runs on any thread, only touches w
+	void MergeViewport(SceneWalk& w);					// adds the walk's node and models to m_nodes
+	struct SubtreeModel;
+	void DrawModel(const SubtreeModel& r);
+
+	// subtrees kept from the previous scene
+	struct SubtreeInput;
+	void BeginSubtrees();
+	void EndSubtrees();
+	void LogCullingRead(SceneWalk& w, UINT32 addr, UINT32 numWords);
+	bool CullingRangeChanged(UINT32 addr, UINT32 numWords) const;
+	bool ReplaySubtree(SceneWalk& w, const SubtreeInput& input);
+	void AddSubtree(SceneWalk& w, UINT32 index);
+
+	// scene traversal thread
+	bool StartSceneThread();
+	void StopSceneThread();
+	static int StartSceneWorker(void *data);
+	int RunSceneWorker();
 
 	// building the scene
 	int	GetTexFormat(int originalFormat, bool contour) const;
 	void SetMeshValues(SortingMesh *currentMesh, PolyHeader &ph);
-	void CacheModel(Model *m, const UINT32 *data);
+	void CacheModel(Model *m, UINT32 modelAddr, const UINT32 *data);
+	void DecodeModel(const UINT32 *data, UINT32 colorTableAddr, PrevVertices& prev, std::vector<SortingMesh>& meshes);
+	void StoreModel(std::vector<Mesh>& modelMeshes, UINT32 modelAddr, bool dynamic, std::vector<SortingMesh>& meshes);
+	void OpenModelCache();
+
+	// rom region of the vbo, split into pages that are evicted least recently used first
+	int  AllocRomVerts(UINT32 modelAddr, int count, int& firstPage, int& numPages);	// returns vertex offset, -1 if every page is in use this frame
+	int  FindRomPages(int numPages) const;
+	void EvictRomPage(int page);
+	void InvalidateRamModels();							// drops the cached polygon RAM models whose pages were written
+	void UploadRomPages(int vertexSize);
+	void BuildScene();									// traverses the scene and decodes the models, no GL calls
+	void DecodeQueuedModels();
+	void DecodeModels(size_t first, size_t last, PrevVertices& prev);
+	struct DrawCmd;
+	struct NodeDraws;
+	void RecordDrawLists();
+	void RecordDraws(size_t first, size_t last);
+	void RecordInstances(NodeDraws& d);					// joins runs of models drawing the same mesh into instanced draws
+	void UploadInstances();
 	void CopyVertexData(const R3DPoly& r3dPoly, std::vector<FVertex>& vertexArray);
+	void PackVertexData(const FVertex* verts, int count);		// converts to packed format in m_packedVerts/m_packedPolys
 	void GetCoordinates(int width, int height, UINT16 uIn, UINT16 vIn, float uvScale, float& uOut, float& vOut) const;
 
-	bool RenderScene(int priority, bool renderOverlay, Layer layer);		// returns if has overlay plane
+	bool RenderScene(int priority, bool renderOverlay, Layer layer, bool* transLayers = nullptr);		// returns if has overlay plane, optionally flags which transparent layers have polys
+	void AddDraw(int first, int count);
+	void FlushDraws();
+	void DrawInstances(const NodeDraws& d, const DrawCmd& cmd);
 	bool IsDynamicModel(UINT32 *data) const;				// check if the model has a colour palette
 	bool IsVROMModel(UINT32 modelAddr) const;
 	void DrawScrollFog();
@@ -214,7 +367,8 @@ private:
 	void DisableRenderStates();
 	void TranslateLosPosition(int inX, int inY, int& outX, int& outY) const;
 	bool ProcessLos(int priority);
-	void CalcViewport(Viewport* vp);
+	void ResolveLos();
+	float CalcViewport(Viewport* vp) const;				// returns the correction of the horizontal clipping planes
 	void TranslateTexture(unsigned& x, unsigned& y, int width, int height, int& page) const;
 
 	/*
@@ -231,7 +385,7 @@ private:
 
 	// Stepping
 	int		m_step;
-	int		m_offset;			// offset to subtract for words 3 and higher of culling nodes
+	void	(CNew3D::*m_descendNodePtr)(SceneWalk& w, UINT32 nodeAddr);	// DescendNodePtr() for this stepping's culling node layout
 	float	m_vertexFactor;		// fixed-point conversion factor for vertices
 	float	m_textureNPFactor;	// fixed-point conversion factor for texture NP values
 
@@ -249,13 +403,7 @@ private:
 	unsigned 	m_totalXRes, m_totalYRes; // total OpenGL window resolution
 	bool		m_wideScreen;
 
-	// Real3D Base Matrix Pointer
-	const float	*m_matrixBasePtr;
-	UINT32 m_colorTableAddr = 0x400;		// address of color table in polygon RAM
-	LODBlendTable* m_LODBlendTable;
-
-	NodeAttributes	m_nodeAttribs;
-	Mat4			m_modelMat;				// current modelview matrix
+	UINT32 m_colorTableAddr = 0x400;		// address of color table in polygon RAM, carried from viewport to viewport as the walks are merged
 
 	struct LOS
 	{
@@ -266,25 +414,161 @@ private:
 	LOS* m_losBack = &m_los[1];
 	std::mutex m_losMutex;
 
-	Vertex			m_prev[4];				// these are class variables because sega bass fishing starts meshes with shared vertices from the previous one
-	UINT16			m_prevTexCoords[4][2];	// basically relying on undefined behavour
+	struct LosRead
+	{
+		GLuint	pbo = 0;					// depth and stencil of the line of sight pixel, read without waiting on the GPU
+		bool	pending = false;
+	} m_losReads[4];
 
-	std::vector<Node>	 m_nodes;				// this represents the entire render frame
-	std::vector<FVertex> m_polyBufferRam;		// dynamic polys
-	std::vector<FVertex> m_polyBufferRom;		// rom polys
-	std::unordered_map<UINT32, std::shared_ptr<std::vector<Mesh>>> m_romMap;	// a hash table for all the ROM models. The meshes don't have model matrices or tex offsets yet
-	TextureBank			m_textureBank[2];
+	GLsync		m_losFence = nullptr;		// set after the frame's line of sight reads, waited on when the next frame starts
 
-	GLuint m_vao;
-	VBO m_vbo;								// large VBO to hold our poly data, start of VBO is ROM data, ram polys follow
-	R3DShader m_r3dShader;
-	R3DScrollFog m_r3dScrollFog;
-	R3DFrameBuffers m_r3dFrameBuffers;
-	GLuint m_aaTarget;						// optional, maybe zero
+	CThread*	m_sceneThread;				// optional, builds m_nodes and the dynamic poly data between BeginFrame and RenderFrame
+	CSemaphore*	m_sceneStart;
+	CSemaphore*	m_sceneDone;
+	bool		m_stopSceneThread;
+	bool		m_sceneBuilding;			// traversal for this frame has been handed to the scene thread
 
-	int m_currentPriority;
+	bool		m_sceneReuseEnabled;
+	bool		m_sceneUnchanged;			// memory the scene is built from hasn't been written since the last frame
+	bool		m_sceneValid;				// a scene has been built since the stepping was set
+	bool		m_sceneSunClamp;			// sun clamp mode the last scene was built with
+	bool		m_sceneReused;				// this frame draws the last built scene again
+
+	PrevVertices	m_prev;					// this is a class variable because sega bass fishing starts meshes with shared vertices from the previous one
+											// basically relying on undefined behavour
 
-	struct
+	struct QueuedModel						// models are decoded after the scene walk when decoding in parallel
+	{
+		std::vector<Mesh>* meshes;
+		UINT32			modelAddr;
+		bool			dynamic;
+		const UINT32*	data;
+		UINT32			colorTableAddr;
+		bool			independent;		// first poly shares no vertices with the previous model
+		std::vector<SortingMesh> sorted;	// kept with the entry between frames, so its vertex storage is reused
+	};
+
+	struct DecodeRange						// range of m_decodeQueue decoded by one job
+	{
+		size_t			first, last;
+		PrevVertices	prev;
+	};
+
+	std::vector<QueuedModel>	m_decodeQueue;		// entries past m_decodeCount are spare
+	size_t						m_decodeCount;
+	std::vector<DecodeRange>	m_decodeRanges;
+	int							m_decodeJobs;		// number of jobs decoding and recording is split into, viewports are walked in parallel if more than 1
+
+	struct DrawCmd							// model and mesh are only set where the state changes from the previous command
+	{
+		const Model*	model;
+		const Mesh*		mesh;
+		GLint			first;
+		GLsizei			count;
+		GLsizei			instances;			// non zero if the draw is repeated for that many models, from instanceFirst in the node's instance list
+		GLint			instanceFirst;
+	};
+
+	struct NodeDraws
+	{
+		std::vector<DrawCmd> lists[2][3];	// [overlay][layer], in the order RenderScene submits them
+		std::vector<const Model*> instances;	// models of the instanced draws, one per instance
+		int instanceBase = -1;				// first matrix of the node in m_instanceVbo, or -1 if it didn't fit
+		bool hasOverlay;
+	};
+
+	std::vector<Node>	 m_nodes;				// this represents the entire render frame
+	std::vector<NodeDraws> m_nodeDraws;			// per node, recorded with the scene so drawing is just submission
+	std::vector<std::vector<Model>> m_spareModels;	// model lists of last frame's nodes, handed to new nodes so they keep their capacity
+	std::deque<std::vector<Mesh>> m_dynamicMeshes;	// meshes of this frame's dynamic models. A deque so models can point into it, entries past m_dynamicMeshCount are spare
+	size_t				 m_dynamicMeshCount;
+	std::vector<SortingMesh> m_sortingMeshes;	// decode scratch when decoding serially
+	std::vector<GLint>	 m_drawFirst;			// pending draws sharing the same state, submitted in one call
+	std::vector<GLsizei> m_drawCount;
+	std::vector<FVertex> m_polyBufferRam;		// dynamic polys, when the vbo can't be persistently mapped
+	void*				 m_ramVerts;			// dynamic polys are written straight to this vbo ring segment if mapped
+	PackedPoly*			 m_ramPolys;			// and their face attributes to this one with packed vertices
+	int					 m_ramVertCount;
+	int					 m_ramVertBase;			// vbo offset of the dynamic polys
+	std::vector<FVertex> m_polyBufferRom;		// rom polys
+	std::vector<PackedVertex> m_packedVerts;	// conversion buffers for uploads that aren't mapped
+	std::vector<PackedPoly>	  m_packedPolys;
+	struct RomModel
+	{
+		std::vector<Mesh> meshes;			// models point straight at these, so entries are only erased once no node of the frame uses them
+		bool present	= false;			// meshes are decoded, or queued to be this frame
+		int firstPage	= -1;				// not stored yet
+		int numPages	= 0;
+		UINT32 ramFirst	= 0;				// polygon RAM pages a RAM model is decoded from
+		UINT32 ramLast	= 0;
+	};
+
+	struct RomPage
+	{
+		UINT32				lastUsed	= 0;	// frame count
+		int					used		= 0;	// vertices
+		int					dirtyFirst	= -1;	// vertex range to upload
+		int					dirtyLast	= -1;
+		std::vector<UINT32>	models;
+	};
+
+	std::unordered_map<UINT32, RomModel> m_romMap;	// a hash table for all the ROM models, and RAM models while their data is unchanged. The meshes don't have model matrices or tex offsets yet. Element addresses are stable
+	std::unordered_set<UINT32> m_ramModels;		// RAM models that may be in m_romMap
+	UINT8					m_polyRAMChanges[128];	// polygon RAM pages written since the RAM models were last checked
+	bool					m_polyRAMTracked;		// writes are reported, so RAM models can be cached
+	bool					m_polyRAMUnknown;		// writes went unreported for some frame, every RAM model is stale
+
+	// Culling node calls of the last scene, replayed by emitting their models again when they are reached in the same state and
+	// none of the culling RAM they read (nodes, pointer lists and matrices) has been written since. Each viewport's walk records its own.
+	struct SubtreeInput						// everything a call depends on besides culling RAM, compared bytewise
+	{
+		UINT32	addr;
+		UINT32	colorTableAddr;
+		UINT32	lodTableAddr;
+		UINT32	matrixBaseAddr;
+		int		attribDepth;
+		int		matrixDepth;
+		int		texOffsetX;
+		int		texOffsetY;
+		int		page;
+		float	modelScale;
+		float	modelAlpha;
+		UINT32	disableCulling;
+		float	planes[9];
+		float	matrix[16];
+	};
+
+	struct Subtree
+	{
+		SubtreeInput	input;
+		UINT32			colorTableAddrOut;	// a node's color table carries on to the nodes after it
+		UINT32			firstNested;		// calls made within this one come just before it, calls are recorded as they return
+		UINT32			firstModel, lastModel;
+		UINT32			firstPage, lastPage;
+		UINT32			nextSameAddr;		// calls at the same address reached in another state, or ~0
+	};
+
+	struct SubtreeModel						// a model reached by a walk and the state it was reached in, drawn with DrawModel() on merging
+	{
+		UINT32	addr;
+		UINT32	colorTableAddr;
+		int		texOffsetX;
+		int		texOffsetY;
+		int		page;
+		float	scale;
+		float	alpha;
+		float	matrix[16];
+	};
+
+	struct SubtreeScene
+	{
+		std::vector<Subtree>		subtrees;
+		std::vector<SubtreeModel>	models;
+		std::vector<UINT16>			pages;		// culling RAM pages read, low RAM first then high RAM
+		std::unordered_map<UINT32, UINT32> byAddr;
+	};
+
+	struct ClipPlanes
 	{
 		float bnlu;
 		float bnlv;
@@ -295,7 +579,73 @@ private:
 		float bnbu;
 		float bnbw;
 		float correction;
-	} m_planes;	
+	};
+
+	// The traversal of one viewport's tree. Viewports are walked as separate jobs, each only touching its own walk, and the
+	// models they reach are added to m_nodes in viewport order afterwards, so caching and decoding stay on one thread.
+	struct SceneWalk
+	{
+		SceneWalk() : cur(&scenes[0]), prev(&scenes[1]) {}
+
+		UINT32					addr;				// viewport node
+		Viewport				viewport;
+		const float*			matrixBasePtr;
+		UINT32					matrixBaseAddr;		// culling RAM addresses of the above and below, for the subtrees
+		UINT32					lodTableAddr;
+		const LODBlendTable*	lodBlendTable;
+		UINT32					colorTableAddr;		// InheritedColorTable until a node of the viewport sets one
+		NodeAttributes			nodeAttribs;
+		MatrixStack				modelMat;			// current modelview matrix
+		ClipPlanes				planes;
+		bool					replay;				// the previous scene can be replayed from
+		UINT32					nodes;				// culling nodes traversed
+		UINT32					pageFloor;			// pages read before this are outside the current call
+		SubtreeScene			scenes[2];			// current and previous. The models are listed even if the rest isn't recorded
+		SubtreeScene*			cur;
+		SubtreeScene*			prev;
+	};
+
+	static const UINT32		InheritedColorTable = ~0u;	// the color table of the viewports before, only known on merging
+
+	std::deque<SceneWalk>	m_walks;				// one per viewport of the last scenes, entries past this scene's viewports are spare
+	bool					m_subtreeRecording;		// the scene being built is recorded, the previous one was if it is valid
+	bool					m_subtreePrevValid;		// the previous scene was recorded and every write since is known
+	UINT8					m_cullingRAMChanges[160];	// culling RAM pages written since the last scene was built, low then high
+	bool					m_cullingRAMTracked;
+	bool					m_cullingRAMUnknown;
+	std::vector<RomPage>	m_romPages;
+	int						m_romOpenPage;		// page small models are currently packed into
+	UINT32					m_romFrame;
+	Util::MemoryAccount		m_modelMemory{"New3D model cache"};		// decoded models and their vertices, CPU side
+	Util::MemoryAccount		m_bufferMemory{"New3D vertex buffers"};
+	ModelCache			m_modelCache;			// optional on-disk copy of the decoded ROM models, kept across sessions
+	bool				m_modelCacheEnabled;
+	TextureBank			m_textureBank[2];
+
+	GLuint m_vao;
+	VBO m_vbo;								// large VBO to hold our poly data, start of VBO is ROM data, ram polys follow
+	VBO m_polyVbo;							// face attributes with packed vertices, one per poly in the same layout as m_vbo
+	GLuint m_polyTex;						// texture buffer view of m_polyVbo
+	bool m_packedVertices;
+	bool m_quadPulling;						// quads drawn as 2 triangles that read their corners from m_vbo, instead of through a geometry shader
+	bool m_instancedModels;					// consecutive models drawing the same mesh are drawn with one instanced call
+	VBO m_instanceVbo;						// model matrices of this frame's instanced draws
+	GLuint m_instanceTex;					// texture buffer view of m_instanceVbo
+	std::vector<GLfloat> m_instanceMats;	// upload buffer for m_instanceVbo
+	R3DShader m_r3dShader;
+	R3DScrollFog m_r3dScrollFog;
+	R3DFrameBuffers m_r3dFrameBuffers;
+	GPUTimer m_fogTimer;
+	GPUTimer m_layerTimers[4];
+	GPUTimer m_compositeTimer;
+	bool m_externalComposite = false;		// layers are left in m_r3dFrameBuffers for the 2D renderer to composite
+	int m_samples = 1;						// MSAA samples per pixel of the layers
+	bool m_transDrawn = false;				// the last frame drew to the translucent layers
+	UINT32 m_drawCalls = 0;					// issued by FlushDraws() this frame
+	RenderStats m_stats;					// counted while building and drawing the frame, models and meshes are counted on request
+	GLuint m_aaTarget;						// optional, maybe zero
+
+	int m_currentPriority;
 };
 
 } // New3D
@@ -1,17 +1,48 @@
 #ifndef _R3DFLOAT_H_
 #define _R3DFLOAT_H_
 
+#include "Types.h"
+#include "Util/BitCast.h"
+
+/*
+ * Real3D "pro" floats: sign bit, 6-bit two's complement exponent and 25-bit
+ * mantissa. The 16-bit format is the top half of a positive one, without the
+ * sign bit. These are decoded while the scene is traversed, so are inline.
+ */
 namespace R3DFloat
 {
 	constexpr UINT16	Pro16BitMax = 0x7fff;
 	constexpr float	Pro16BitFltMin = 1e-7f;			// float min in IEEE 
 
-	float	GetFloat16(UINT16 f);
-	float	GetFloat32(UINT32 f);
+	// return float in hex or integer format
+	inline UINT32 ConvertProFloat(UINT32 a1)
+	{
+		UINT32 exponent = UINT32((INT32(a1 << 1) >> 26) + 127);	// sign extended, then rebiased
+		UINT32 mantissa = (a1 & 0x1FFFFFF) >> 2;
+
+		return (a1 & 0x80000000) | (exponent << 23) | mantissa;
+	}
+
+	inline UINT32 Convert16BitProFloat(UINT32 a1)
+	{
+		return ConvertProFloat(a1 << 15);
+	}
+
+	// integer float to actual IEEE 754 float
+	inline float ToFloat(UINT32 a1)
+	{
+		return Util::Uint32AsFloat(a1);
+	}
+
+	inline float GetFloat16(UINT16 f)
+	{
+		return ToFloat(Convert16BitProFloat(f));
+	}
 
-	UINT32	ConvertProFloat(UINT32 a1);				// return float in hex or integer format
-	UINT32	Convert16BitProFloat(UINT32 a1);
-	float	ToFloat(UINT32 a1);						// integer float to actual IEEE 754 float	
+	inline float GetFloat32(UINT32 f)
+	{
+		return ToFloat(ConvertProFloat(f));
+	}
 }
 
 #endif
@@ -1,4 +1,5 @@
 #include "R3DFrameBuffers.h"
+#include "Graphics/Shader.h"
 
 namespace New3D {
 
@@ -8,8 +9,12 @@ R3DFrameBuffers::R3DFrameBuffers()
 	m_renderBufferID = 0;
 	m_frameBufferIDCopy = 0;
 	m_renderBufferIDCopy = 0;
+	m_frameBufferIDResolve = 0;
+	m_renderBufferIDResolve = 0;
 	m_width = 0;
 	m_height = 0;
+	m_samples = 1;
+	m_texTarget = GL_TEXTURE_2D;
 	m_vao = 0;
 
 	for (auto &i : m_texIDs) {
@@ -18,9 +23,6 @@ R3DFrameBuffers::R3DFrameBuffers()
 
 	m_lastLayer = Layer::none;
 
-	AllocShaderTrans();
-	AllocShaderBase();
-
 	glGenVertexArrays(1, &m_vao);
 	glBindVertexArray(m_vao);
 	// no states needed since we do it in the shader
@@ -39,10 +41,21 @@ R3DFrameBuffers::~R3DFrameBuffers()
 	}
 }
 
-Result R3DFrameBuffers::CreateFBO(int width, int height)
+Result R3DFrameBuffers::CreateFBO(int width, int height, int samples)
 {
 	m_width = width;
 	m_height = height;
+	m_samples = samples;
+	m_texTarget = (samples > 1) ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+
+	// the composite shaders resolve the samples, so they depend on the count
+	m_shaderTrans.UnloadShaders();
+	m_shaderBase.UnloadShaders();
+	AllocShaderTrans();
+	AllocShaderBase();
+
+	// three colour layers, and the depth/stencil buffer and its copy
+	m_memoryAccount.SetGPU((size_t)width * height * samples * (3 * 4 + 2 * 8));
 
 	m_texIDs[0] = CreateTexture(width, height);		// colour buffer
 	m_texIDs[1] = CreateTexture(width, height);		// trans layer1
@@ -52,14 +65,14 @@ Result R3DFrameBuffers::CreateFBO(int width, int height)
 	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBufferID);
 
 	// colour attachments
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texIDs[0], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_texIDs[1], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_texIDs[2], 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_texTarget, m_texIDs[0], 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, m_texTarget, m_texIDs[1], 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, m_texTarget, m_texIDs[2], 0);
 
 	// depth/stencil attachment
 	glGenRenderbuffers(1, &m_renderBufferID);
 	glBindRenderbuffer(GL_RENDERBUFFER, m_renderBufferID);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH32F_STENCIL8, width, height);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples > 1 ? m_samples : 0, GL_DEPTH32F_STENCIL8, width, height);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferID);
 
 	// check setup was successful
@@ -67,6 +80,10 @@ Result R3DFrameBuffers::CreateFBO(int width, int height)
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);	//created R3DFrameBuffers now disable it
 
+	if (m_samples > 1 && CreateFBODepthResolve() != Result::OKAY) {
+		return Result::FAIL;
+	}
+
 	return ((CreateFBODepthCopy(width, height) == Result::OKAY) && (fboStatus == GL_FRAMEBUFFER_COMPLETE)) ? Result::OKAY : Result::FAIL;
 }
 
@@ -77,7 +94,7 @@ Result R3DFrameBuffers::CreateFBODepthCopy(int width, int height)
 
 	glGenRenderbuffers(1, &m_renderBufferIDCopy);
 	glBindRenderbuffer(GL_RENDERBUFFER, m_renderBufferIDCopy);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH32F_STENCIL8, width, height);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples > 1 ? m_samples : 0, GL_DEPTH32F_STENCIL8, width, height);	// blits between the two need matching sample counts
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferIDCopy);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -88,6 +105,23 @@ Result R3DFrameBuffers::CreateFBODepthCopy(int width, int height)
 	return (fboStatus == GL_FRAMEBUFFER_COMPLETE) ? Result::OKAY : Result::FAIL;
 }
 
+Result R3DFrameBuffers::CreateFBODepthResolve()
+{
+	glGenFramebuffers(1, &m_frameBufferIDResolve);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBufferIDResolve);
+
+	glGenRenderbuffers(1, &m_renderBufferIDResolve);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_renderBufferIDResolve);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH32F_STENCIL8, 1, 1);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferIDResolve);
+
+	auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return (fboStatus == GL_FRAMEBUFFER_COMPLETE) ? Result::OKAY : Result::FAIL;
+}
+
 void R3DFrameBuffers::StoreDepth()
 {
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferID);
@@ -102,8 +136,32 @@ void R3DFrameBuffers::RestoreDepth()
 	glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
 }
 
+bool R3DFrameBuffers::ReadDepth(int x, int y)
+{
+	// ES can't read back depth or stencil
+	if (IsGLES()) {
+		return false;
+	}
+
+	if (m_samples == 1) {
+		glReadPixels(x, y, 1, 1, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, nullptr);
+		return true;
+	}
+
+	// multisampled buffers can't be read directly, resolve the pixel first
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferID);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_frameBufferIDResolve);
+	glBlitFramebuffer(x, y, x + 1, y + 1, 0, 0, 1, 1, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferIDResolve);
+	glReadPixels(0, 0, 1, 1, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, nullptr);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBufferID);	// SetFBO() assumes the layer it set last is still bound
+	return true;
+}
+
 void R3DFrameBuffers::DestroyFBO()
 {
+	m_memoryAccount.SetGPU(0);
+
 	if (m_frameBufferID) {
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glDeleteRenderbuffers(1, &m_renderBufferID);
@@ -115,6 +173,11 @@ void R3DFrameBuffers::DestroyFBO()
 		glDeleteFramebuffers(1, &m_frameBufferIDCopy);
 	}
 
+	if (m_frameBufferIDResolve) {
+		glDeleteRenderbuffers(1, &m_renderBufferIDResolve);
+		glDeleteFramebuffers(1, &m_frameBufferIDResolve);
+	}
+
 	for (auto &i : m_texIDs) {
 		if (i) {
 			glDeleteTextures(1, &i);
@@ -126,6 +189,8 @@ void R3DFrameBuffers::DestroyFBO()
 	m_renderBufferID = 0;
 	m_frameBufferIDCopy = 0;
 	m_renderBufferIDCopy = 0;
+	m_frameBufferIDResolve = 0;
+	m_renderBufferIDResolve = 0;
 	m_width = 0;
 	m_height = 0;
 }
@@ -134,6 +199,19 @@ GLuint R3DFrameBuffers::CreateTexture(int width, int height)
 {
 	GLuint texId;
 	glGenTextures(1, &texId);
+
+	if (m_samples > 1) {
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texId);
+		if (IsGLES()) {
+			glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, m_samples, GL_RGBA8, width, height, GL_TRUE);	// ES only has immutable multisample textures
+		}
+		else {
+			glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, m_samples, GL_RGBA8, width, height, GL_TRUE);	// fixed locations, so all 3 layers and the depth buffer agree
+		}
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+		return texId;
+	}
+
 	glBindTexture(GL_TEXTURE_2D, texId);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -145,7 +223,12 @@ GLuint R3DFrameBuffers::CreateTexture(int width, int height)
 
 void R3DFrameBuffers::BindTexture(Layer layer)
 {
-	glBindTexture(GL_TEXTURE_2D, m_texIDs[(int)layer]);
+	glBindTexture(m_texTarget, m_texIDs[(int)layer]);
+}
+
+GLuint R3DFrameBuffers::GetTextureID(Layer layer) const
+{
+	return m_texIDs[(int)layer];
 }
 
 void R3DFrameBuffers::SetFBO(Layer layer)
@@ -180,7 +263,13 @@ void R3DFrameBuffers::SetFBO(Layer layer)
 	case Layer::none:
 	{
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glDrawBuffer(GL_BACK);
+		if (IsGLES()) {
+			GLenum back = GL_BACK;		// ES has no glDrawBuffer(), but takes GL_BACK here
+			glDrawBuffers(1, &back);
+		}
+		else {
+			glDrawBuffer(GL_BACK);
+		}
 		break;
 	}
 	}
@@ -188,6 +277,33 @@ void R3DFrameBuffers::SetFBO(Layer layer)
 	m_lastLayer = layer;
 }
 
+std::string R3DFrameBuffers::GetFragmentShaderHeader() const
+{
+	static const char *resolveFunctions = R"glsl(
+
+	#if (SAMPLES > 1)
+	#define LAYER_SAMPLER sampler2DMS
+	#else
+	#define LAYER_SAMPLER sampler2D
+	#endif
+
+	// the layers are blended with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, so the
+	// samples are averaged weighted by their alpha to blend like their average
+	vec4 Premultiply(vec4 colour)
+	{
+		return vec4(colour.rgb * colour.a, colour.a);
+	}
+
+	vec4 Resolve(vec4 sum)
+	{
+		return vec4(sum.rgb / max(sum.a, 1.0/4096.0), sum.a / float(SAMPLES));
+	}
+
+	)glsl";
+
+	return "#version 410 core\n#define SAMPLES " + std::to_string(m_samples) + "\n" + resolveFunctions;
+}
+
 void R3DFrameBuffers::AllocShaderBase()
 {
 	static const char *vertexShader = R"glsl(
@@ -208,10 +324,8 @@ void R3DFrameBuffers::AllocShaderBase()
 
 	static const char *fragmentShader = R"glsl(
 
-	#version 410 core
-
 	// inputs
-	uniform sampler2D tex1;			// base tex
+	uniform LAYER_SAMPLER tex1;		// base tex
 
 	// outputs
 	out vec4 fragColor;
@@ -219,12 +333,21 @@ void R3DFrameBuffers::AllocShaderBase()
 	void main()
 	{
 		ivec2 tc = ivec2(gl_FragCoord.xy /*-vec2(0.5)*/);
+
+		#if (SAMPLES > 1)
+		vec4 sum = vec4(0.0);
+		for (int i = 0; i < SAMPLES; i++) {
+			sum += Premultiply(texelFetch(tex1, tc, i));
+		}
+		fragColor = Resolve(sum);
+		#else
 		fragColor = texelFetch(tex1, tc, 0);
+		#endif
 	}
 
 	)glsl";
 
-	m_shaderBase.LoadShaders(vertexShader, fragmentShader);
+	m_shaderBase.LoadShaders(vertexShader, (GetFragmentShaderHeader() + fragmentShader).c_str());
 	m_shaderBase.uniformLoc[0] = m_shaderBase.GetUniformLocation("tex1");
 }
 
@@ -248,42 +371,51 @@ void R3DFrameBuffers::AllocShaderTrans()
 
 	static const char *fragmentShader = R"glsl(
 
-	#version 410 core
-
-	uniform sampler2D tex1;			// trans layer 1
-	uniform sampler2D tex2;			// trans layer 2
+	uniform LAYER_SAMPLER tex1;		// trans layer 1
+	uniform LAYER_SAMPLER tex2;		// trans layer 2
 
 	// outputs
 	out vec4 fragColor;
 
-	void main()
+	vec4 Combine(vec4 colTrans1, vec4 colTrans2)
 	{
-		ivec2 tc = ivec2(gl_FragCoord.xy /*-vec2(0.5)*/);
-		vec4 colTrans1 = texelFetch(tex1, tc, 0);
-		vec4 colTrans2 = texelFetch(tex2, tc, 0);
-
 		// if both transparency layers overlap, the result is opaque
 		if (colTrans1.a * colTrans2.a > 0.0) {
 			vec3 mixCol = mix(colTrans1.rgb, colTrans2.rgb, (colTrans2.a + (1.0 - colTrans1.a)) / 2.0);
-			fragColor = vec4(mixCol, 1.0);
+			return vec4(mixCol, 1.0);
 		}
 		else if (colTrans1.a > 0.0) {
-			fragColor = colTrans1;
+			return colTrans1;
 		}
 		else {
-			fragColor = colTrans2;		// if alpha is zero it will have no effect anyway
+			return colTrans2;		// if alpha is zero it will have no effect anyway
 		}
 	}
 
+	void main()
+	{
+		ivec2 tc = ivec2(gl_FragCoord.xy /*-vec2(0.5)*/);
+
+		#if (SAMPLES > 1)
+		vec4 sum = vec4(0.0);
+		for (int i = 0; i < SAMPLES; i++) {
+			sum += Premultiply(Combine(texelFetch(tex1, tc, i), texelFetch(tex2, tc, i)));
+		}
+		fragColor = Resolve(sum);
+		#else
+		fragColor = Combine(texelFetch(tex1, tc, 0), texelFetch(tex2, tc, 0));
+		#endif
+	}
+
 	)glsl";
 
-	m_shaderTrans.LoadShaders(vertexShader, fragmentShader);
+	m_shaderTrans.LoadShaders(vertexShader, (GetFragmentShaderHeader() + fragmentShader).c_str());
 
 	m_shaderTrans.uniformLoc[0] = m_shaderTrans.GetUniformLocation("tex1");
 	m_shaderTrans.uniformLoc[1] = m_shaderTrans.GetUniformLocation("tex2");
 }
 
-void R3DFrameBuffers::Draw()
+void R3DFrameBuffers::Draw(bool alphaLayers)
 {
 	glViewport	(0, 0, m_width, m_height);			// cover the entire screen
 	glDisable	(GL_DEPTH_TEST);					// disable depth testing / writing
@@ -293,14 +425,17 @@ void R3DFrameBuffers::Draw()
 
 	for (int i = 0; i < (int)std::size(m_texIDs); i++) {	// bind our textures to correct texture units
 		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_texIDs[i]);
+		glBindTexture(m_texTarget, m_texIDs[i]);
 	}
 
 	glActiveTexture		(GL_TEXTURE0);
 	glBindVertexArray	(m_vao);
 
 	DrawBaseLayer		();
-	DrawAlphaLayer		();
+
+	if (alphaLayers) {
+		DrawAlphaLayer	();
+	}
 
 	glDisable			(GL_BLEND);
 	glBindVertexArray	(0);
@@ -2,8 +2,10 @@
 #define FBO_H
 
 #include <GL/glew.h>
+#include <string>
 #include "GLSLShader.h"
 #include "Model.h"
+#include "Util/MemoryUsage.h"
 
 namespace New3D {
 
@@ -13,20 +15,24 @@ public:
 	R3DFrameBuffers();
 	~R3DFrameBuffers();
 
-	void	Draw();					// draw and composite the transparent layers
+	void	Draw(bool alphaLayers);	// draw and composite the transparent layers, if anything was drawn to them
 	
-	Result	CreateFBO(int width, int height);
+	Result	CreateFBO(int width, int height, int samples);	// samples > 1 makes the layers multisampled, resolved by Draw()
 	void	DestroyFBO();
 
 	void	BindTexture(Layer layer);
+	GLuint	GetTextureID(Layer layer) const;
 	void	SetFBO(Layer layer);
 	void	StoreDepth();
 	void	RestoreDepth();
+	bool	ReadDepth(int x, int y);	// one pixel of depth/stencil into the bound pixel pack buffer, false if unsupported (GLES)
 
 private:
 
 	Result	CreateFBODepthCopy(int width, int height);
+	Result	CreateFBODepthResolve();
 	GLuint	CreateTexture(int width, int height);
+	std::string GetFragmentShaderHeader() const;
 	void	AllocShaderTrans();
 	void	AllocShaderBase();
 
@@ -38,9 +44,13 @@ private:
 	GLuint m_texIDs[3];
 	GLuint m_frameBufferIDCopy;
 	GLuint m_renderBufferIDCopy;
+	GLuint m_frameBufferIDResolve;	// single sampled pixel to read multisampled depth from
+	GLuint m_renderBufferIDResolve;
 	Layer m_lastLayer;
 	int m_width;
 	int m_height;
+	int m_samples;
+	GLenum m_texTarget;				// GL_TEXTURE_2D, or GL_TEXTURE_2D_MULTISAMPLE
 
 	// shaders
 	GLSLShader m_shaderBase;
@@ -48,6 +58,7 @@ private:
 
 	// vao
 	GLuint m_vao;	// this really needed if we don't actually use vertex attribs?
+	Util::MemoryAccount m_memoryAccount{"New3D frame buffers"};
 };
 
 }
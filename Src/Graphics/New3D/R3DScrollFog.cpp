@@ -1,5 +1,6 @@
 #include "R3DScrollFog.h"
 #include "Graphics/Shader.h"
+#include <algorithm>
 
 namespace New3D {
 
@@ -105,8 +106,22 @@ void main()
 		}
 	}
 
-	void R3DScrollFog::DrawScrollFog(float rgba[4], float attenuation, float ambient, float spotRGB[3], float spotEllipse[4])
+	void R3DScrollFog::DrawScrollFog(int x, int y, int width, int height, float rgba[4], float attenuation, float ambient, float spotRGB[3], float spotEllipse[4])
 	{
+		// without the spotlight the fog is one colour, and the transparent layers are already blank, so clearing the opaque layer
+		// gives the same pixels as the full screen pass without shading them
+		bool spotFog =	attenuation != 0.0f &&
+						(spotRGB[0] != 0.0f || spotRGB[1] != 0.0f || spotRGB[2] != 0.0f) &&
+						(rgba[0] != 0.0f || rgba[1] != 0.0f || rgba[2] != 0.0f);
+
+		if (!spotFog) {
+			float colour[4] = { rgba[0] * ambient, rgba[1] * ambient, rgba[2] * ambient, rgba[3] };
+			ClearViewport(x, y, width, height, colour);
+			return;
+		}
+
+		glViewport			(x, y, width, height);
+
 		// some ogl states
 		glDepthMask			(GL_FALSE);			// disable z writes
 		glDisable			(GL_DEPTH_TEST);	// disable depth testing
@@ -128,6 +143,34 @@ void main()
 		glDepthMask			(GL_TRUE);
 	}
 
+	void R3DScrollFog::ClearViewport(int x, int y, int width, int height, const float rgba[4])
+	{
+		// clears ignore the viewport, so scissor to it, within any scissor box already set
+		GLint box[4];
+		GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+		glGetIntegerv(GL_SCISSOR_BOX, box);
+
+		int x0 = x, y0 = y, x1 = x + width, y1 = y + height;
+
+		if (scissor) {
+			x0 = std::max(x0, box[0]);
+			y0 = std::max(y0, box[1]);
+			x1 = std::min(x1, box[0] + box[2]);
+			y1 = std::min(y1, box[1] + box[3]);
+		}
+
+		if (x1 > x0 && y1 > y0) {
+			glEnable		(GL_SCISSOR_TEST);
+			glScissor		(x0, y0, x1 - x0, y1 - y0);
+			glClearBufferfv	(GL_COLOR, 0, rgba);		// opaque layer
+			glScissor		(box[0], box[1], box[2], box[3]);
+		}
+
+		if (!scissor) {
+			glDisable(GL_SCISSOR_TEST);
+		}
+	}
+
 	void R3DScrollFog::AllocResources()
 	{
 		/*bool success = */LoadShaderProgram(&m_shaderProgram, &m_vertexShader, &m_fragmentShader, m_config["VertexShaderFog"].ValueAs<std::string>(), m_config["FragmentShaderFog"].ValueAs<std::string>(), vertexShaderFog, fragmentShaderFog);
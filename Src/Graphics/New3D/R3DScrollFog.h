@@ -13,12 +13,13 @@ namespace New3D {
 		R3DScrollFog(const Util::Config::Node& config);
 		~R3DScrollFog();
 
-		void DrawScrollFog(float rbga[4], float attenuation, float ambient, float spotRGB[3], float spotEllipse[4]);
+		void DrawScrollFog(int x, int y, int width, int height, float rbga[4], float attenuation, float ambient, float spotRGB[3], float spotEllipse[4]);	// fills the viewport of the opaque layer
 
 	private:
 
 		void AllocResources();
 		void DeallocResources();
+		void ClearViewport(int x, int y, int width, int height, const float rgba[4]);
 
 		const Util::Config::Node& m_config;
 
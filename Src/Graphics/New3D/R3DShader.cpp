@@ -2,6 +2,10 @@
 #include "R3DShaderQuads.h"
 #include "R3DShaderTriangles.h"
 #include "R3DShaderCommon.h"
+#include "Graphics/Shader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 // having 2 sets of shaders to maintain is really less than ideal
 // but hopefully not too many breaking changes at this point
@@ -11,52 +15,55 @@ namespace New3D {
 R3DShader::R3DShader(const Util::Config::Node &config)
 	: m_config(config)
 {
-	m_shaderProgram		= 0;
 	m_vertexShader		= 0;
 	m_geoShader			= 0;
 	m_fragmentShader	= 0;
+	m_program			= nullptr;
+	m_packedVertices	= false;
+	m_quadPulling		= false;
+	m_useVariants		= false;
+	m_parallelCompile	= false;
+	m_loader			= nullptr;
+	m_variantCount		= 0;
+	m_viewportUbo		= 0;
+	m_meshUbo			= 0;
+	m_meshSlotSize		= 0;
+	m_meshSlotCount		= 0;
+	m_meshSlot			= -1;
+	m_viewportSlotSize	= 0;
+	m_viewportSlotCount	= 0;
+	m_viewportSlot		= -1;
+	m_modelSerial		= 0;
+	m_uniformUpdates	= 0;
+	m_discardAlpha		= false;
+	m_layer				= 0;
+	m_instanceBase		= -1;
+
+	for (auto& f : m_modelMat) {
+		f = 0.0f;
+	}
 
 	Start();	// reset attributes
 }
 
 void R3DShader::Start()
 {
-	m_textured1			= false;
-	m_textured2			= false;
-	m_textureAlpha		= false;		// use alpha in texture
-	m_alphaTest			= false;		// discard fragment based on alpha (ogl does this with fixed function)
-	m_lightEnabled		= false;
-	m_specularEnabled	= false;
 	m_layered			= false;
 	m_noLosReturn		= false;
-	m_textureInverted	= false;
-	m_fixedShading		= false;
-	m_smoothShading		= false;
-	m_translatorMap		= false;
-	m_modelScale		= 1.0f;
-	m_nodeAlpha			= 1.0f;
-	m_shininess			= 0;
-	m_specularValue		= 0;
-	m_microTexMinLOD	= 0;
-	m_microTexID		= -1;
-	m_texturePage		= -1;
-
-	m_baseTexInfo[0]	= -1;
-	m_baseTexInfo[1]	= -1;
-	m_baseTexInfo[2]	= -1;
-	m_baseTexInfo[3]	= -1;
-
-	m_baseTexType		= -1;
 
 	m_transX			= -1;
 	m_transY			= -1;
 	m_transPage			= -1;
 
-	m_texWrapMode[0]	= 0;
-	m_texWrapMode[1]	= 0;
+	m_meshSlot			= -1;			// something else may have used the binding since
+	m_viewportSlot		= -1;
 
 	m_dirtyMesh			= true;			// dirty means all the above are dirty, ie first run
-	m_dirtyModel		= true;
+
+	m_uberProgram.dirty	= true;
+	for (auto& v : m_variants) {
+		v.second.program.dirty = true;
+	}
 }
 
 bool R3DShader::LoadShader(const char* vertexShader, const char* fragmentShader)
@@ -73,92 +80,132 @@ bool R3DShader::LoadShader(const char* vertexShader, const char* fragmentShader)
 		fShader = fragmentShaderR3DQuads;
 	}
 
-	m_shaderProgram		= glCreateProgram();
-	m_vertexShader		= glCreateShader(GL_VERTEX_SHADER);
-	m_fragmentShader	= glCreateShader(GL_FRAGMENT_SHADER);
+	if (quads && m_quadPulling) {
+		vShader = vertexShaderR3DQuadsPull;
+		gShader = "";
+	}
 
-	const char* shaderArray[] = { fShader, fragmentShaderR3DCommon };
+	// translated for GLES first, so that the define still follows the version directive
+	m_vertexSource		= TranslateShaderSource(vShader);
+	m_geometrySource	= TranslateShaderSource(gShader);
+	m_fragmentSource	= TranslateShaderSource(fShader);
+	if (m_packedVertices) {
+		size_t pos = m_vertexSource.find('\n', m_vertexSource.find("#version"));
+		m_vertexSource.insert(pos + 1, "#define PACKED_VERTICES\n");
+	}
+	vShader = m_vertexSource.c_str();
+	gShader = m_geometrySource.c_str();
+	fShader = m_fragmentSource.c_str();
 
-	glShaderSource(m_vertexShader, 1, (const GLchar **)&vShader, nullptr);
-	glShaderSource(m_fragmentShader, (GLsizei)std::size(shaderArray), shaderArray, nullptr);
+	GLuint program = glCreateProgram();
+	m_uberProgram.id = program;
 
-	glCompileShader(m_vertexShader);
-	glCompileShader(m_fragmentShader);
+	// the quad shaders in particular can take a long time to compile, so the linked program is kept between runs
+	if (!LoadCachedProgram(program, { vShader, gShader, fShader, fragmentShaderR3DCommon })) {
 
-	if (quads) {
-		m_geoShader = glCreateShader(GL_GEOMETRY_SHADER);
-		glShaderSource(m_geoShader, 1, (const GLchar **)&gShader, nullptr);
-		glCompileShader(m_geoShader);
-		glAttachShader(m_shaderProgram, m_geoShader);
-		PrintShaderResult(m_geoShader);
-	}
-
-	PrintShaderResult(m_vertexShader);
-	PrintShaderResult(m_fragmentShader);
-
-	glAttachShader(m_shaderProgram, m_vertexShader);
-	glAttachShader(m_shaderProgram, m_fragmentShader);
-	glLinkProgram(m_shaderProgram);
-
-	PrintProgramResult(m_shaderProgram);
-
-	m_locTextureBank[0]		= glGetUniformLocation(m_shaderProgram, "textureBank[0]");
-	m_locTextureBank[1]		= glGetUniformLocation(m_shaderProgram, "textureBank[1]");
-	m_locTexturePage		= glGetUniformLocation(m_shaderProgram, "texturePage");
-	m_locTexture1Enabled	= glGetUniformLocation(m_shaderProgram, "textureEnabled");
-	m_locTexture2Enabled	= glGetUniformLocation(m_shaderProgram, "microTexture");
-	m_locTextureAlpha		= glGetUniformLocation(m_shaderProgram, "textureAlpha");
-	m_locAlphaTest			= glGetUniformLocation(m_shaderProgram, "alphaTest");
-	m_locMicroTexMinLOD		= glGetUniformLocation(m_shaderProgram, "microTextureMinLOD");
-	m_locMicroTexID			= glGetUniformLocation(m_shaderProgram, "microTextureID");
-	m_locBaseTexInfo		= glGetUniformLocation(m_shaderProgram, "baseTexInfo");
-	m_locBaseTexType		= glGetUniformLocation(m_shaderProgram, "baseTexType");
-	m_locTextureInverted	= glGetUniformLocation(m_shaderProgram, "textureInverted");
-	m_locTexWrapMode		= glGetUniformLocation(m_shaderProgram, "textureWrapMode");
-	m_locColourLayer		= glGetUniformLocation(m_shaderProgram, "colourLayer");
-	m_locPolyAlpha			= glGetUniformLocation(m_shaderProgram, "polyAlpha");
-
-	m_locFogIntensity		= glGetUniformLocation(m_shaderProgram, "fogIntensity");
-	m_locFogDensity			= glGetUniformLocation(m_shaderProgram, "fogDensity");
-	m_locFogStart			= glGetUniformLocation(m_shaderProgram, "fogStart");
-	m_locFogColour			= glGetUniformLocation(m_shaderProgram, "fogColour");
-	m_locFogAttenuation		= glGetUniformLocation(m_shaderProgram, "fogAttenuation");
-	m_locFogAmbient			= glGetUniformLocation(m_shaderProgram, "fogAmbient");
-
-	m_locLighting			= glGetUniformLocation(m_shaderProgram, "lighting");
-	m_locLightEnabled		= glGetUniformLocation(m_shaderProgram, "lightEnabled");
-	m_locSunClamp			= glGetUniformLocation(m_shaderProgram, "sunClamp");
-	m_locIntensityClamp		= glGetUniformLocation(m_shaderProgram, "intensityClamp");
-	m_locShininess			= glGetUniformLocation(m_shaderProgram, "shininess");
-	m_locSpecularValue		= glGetUniformLocation(m_shaderProgram, "specularValue");
-	m_locSpecularEnabled	= glGetUniformLocation(m_shaderProgram, "specularEnabled");
-	m_locFixedShading		= glGetUniformLocation(m_shaderProgram, "fixedShading");
-	m_locSmoothShading		= glGetUniformLocation(m_shaderProgram, "smoothShading");
-	m_locTranslatorMap		= glGetUniformLocation(m_shaderProgram, "translatorMap");
-
-	m_locSpotEllipse		= glGetUniformLocation(m_shaderProgram, "spotEllipse");
-	m_locSpotRange			= glGetUniformLocation(m_shaderProgram, "spotRange");
-	m_locSpotColor			= glGetUniformLocation(m_shaderProgram, "spotColor");
-	m_locSpotFogColor		= glGetUniformLocation(m_shaderProgram, "spotFogColor");
-	m_locModelScale			= glGetUniformLocation(m_shaderProgram, "modelScale");
-	m_locNodeAlpha			= glGetUniformLocation(m_shaderProgram, "nodeAlpha");
-
-	m_locProjMat			= glGetUniformLocation(m_shaderProgram, "projMat");
-	m_locModelMat			= glGetUniformLocation(m_shaderProgram, "modelMat");
-
-	m_locHardwareStep		= glGetUniformLocation(m_shaderProgram, "hardwareStep");
-	m_locDiscardAlpha		= glGetUniformLocation(m_shaderProgram, "discardAlpha");
-
-	m_locCota				= glGetUniformLocation(m_shaderProgram, "cota");
+		m_vertexShader		= glCreateShader(GL_VERTEX_SHADER);
+		m_fragmentShader	= glCreateShader(GL_FRAGMENT_SHADER);
+
+		const char* shaderArray[] = { fShader, fragmentShaderR3DCommon };
+
+		glShaderSource(m_vertexShader, 1, (const GLchar **)&vShader, nullptr);
+		glShaderSource(m_fragmentShader, (GLsizei)std::size(shaderArray), shaderArray, nullptr);
+
+		glCompileShader(m_vertexShader);
+		glCompileShader(m_fragmentShader);
+
+		if (*gShader) {
+			m_geoShader = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(m_geoShader, 1, (const GLchar **)&gShader, nullptr);
+			glCompileShader(m_geoShader);
+			glAttachShader(program, m_geoShader);
+			PrintShaderResult(m_geoShader);
+		}
+
+		PrintShaderResult(m_vertexShader);
+		PrintShaderResult(m_fragmentShader);
+
+		glAttachShader(program, m_vertexShader);
+		glAttachShader(program, m_fragmentShader);
+		glLinkProgram(program);
+
+		PrintProgramResult(program);
+
+		SaveCachedProgram(program, { vShader, gShader, fShader, fragmentShaderR3DCommon });
+	}
+
+	InitProgram(m_uberProgram);
+
+	// variants share the vertex array, so they have to use the same attribute locations
+	m_attribBindings.clear();
+
+	GLint numAttribs = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &numAttribs);
+
+	for (GLint i = 0; i < numAttribs; i++) {
+		GLchar name[64];
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(program, i, sizeof(name), nullptr, &size, &type, name);
+		m_attribBindings += std::string(name) + "=" + std::to_string(glGetAttribLocation(program, name)) + ";";
+	}
+
+	m_useVariants		= m_config["ShaderVariants"].ValueAsDefault<bool>(true);
+	m_parallelCompile	= GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+
+	CreateUniformBuffers();
 
 	return true;
 }
 
+void R3DShader::InitProgram(Program& program)
+{
+	program.locModelScale	= glGetUniformLocation(program.id, "modelScale");
+	program.locNodeAlpha	= glGetUniformLocation(program.id, "nodeAlpha");
+	program.locModelMat		= glGetUniformLocation(program.id, "modelMat");
+	program.locDiscardAlpha	= glGetUniformLocation(program.id, "discardAlpha");
+	program.locColourLayer	= glGetUniformLocation(program.id, "colourLayer");
+	program.locInstanceBase	= glGetUniformLocation(program.id, "instanceBase");
+	program.dirty			= true;
+
+	// viewport and mesh state live in uniform buffers
+	glUniformBlockBinding(program.id, glGetUniformBlockIndex(program.id, "ViewportState"), 0);
+	glUniformBlockBinding(program.id, glGetUniformBlockIndex(program.id, "MeshState"), 1);
+
+	glUseProgram(program.id);
+	glUniform1i(glGetUniformLocation(program.id, "textureBank[0]"), 0);
+	glUniform1i(glGetUniformLocation(program.id, "textureBank[1]"), 1);
+	glUniform1i(glGetUniformLocation(program.id, "instanceMats"), 3);
+
+	if (m_packedVertices) {
+		glUniform1i(glGetUniformLocation(program.id, "polyData"), 2);
+		glUniform1i(glGetUniformLocation(program.id, "polyVerts"), m_config["QuadRendering"].ValueAs<bool>() ? 4 : 3);
+	}
+}
+
+void R3DShader::SetLoader(GLLoader* loader)
+{
+	m_loader = loader;
+}
+
+void R3DShader::SetPackedVertices(bool packed)
+{
+	m_packedVertices = packed;
+}
+
+void R3DShader::SetQuadPulling(bool pull)
+{
+	m_quadPulling = pull;
+}
+
 void R3DShader::UnloadShader()
 {
 	// make sure no shader is bound
 	glUseProgram(0);
 
+	DeleteUniformBuffers();
+	DeleteVariants();
+
 	if (m_vertexShader) {
 		glDeleteShader(m_vertexShader);
 		m_vertexShader = 0;
@@ -174,149 +221,485 @@ void R3DShader::UnloadShader()
 		m_fragmentShader = 0;
 	}
 
-	if (m_shaderProgram) {
-		glDeleteProgram(m_shaderProgram);
-		m_shaderProgram = 0;
+	if (m_uberProgram.id) {
+		glDeleteProgram(m_uberProgram.id);
+		m_uberProgram.id = 0;
 	}
+
+	m_program = nullptr;
 }
 
 GLint R3DShader::GetVertexAttribPos(const std::string& attrib)
 {
 	if (m_vertexLocCache.count(attrib)==0) {
-		auto pos = glGetAttribLocation(m_shaderProgram, attrib.c_str());
+		auto pos = glGetAttribLocation(m_uberProgram.id, attrib.c_str());
 		m_vertexLocCache[attrib] = pos;
 	}
 
 	return m_vertexLocCache[attrib];
 }
 
+void R3DShader::CreateUniformBuffers()
+{
+	// each mesh slot must start on the offset alignment for glBindBufferRange
+	GLint align = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	align = std::max(align, 1);
+
+	m_meshSlotSize = (((GLint)sizeof(MeshState) + align - 1) / align) * align;
+	m_viewportSlotSize = (((GLint)sizeof(ViewportState) + align - 1) / align) * align;
+
+	glGenBuffers(1, &m_viewportUbo);
+	ResetViewportSlots();
+
+	glGenBuffers(1, &m_meshUbo);
+	ResetMeshSlots();
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void R3DShader::DeleteUniformBuffers()
+{
+	if (m_viewportUbo) {
+		glDeleteBuffers(1, &m_viewportUbo);
+		m_viewportUbo = 0;
+	}
+
+	if (m_meshUbo) {
+		glDeleteBuffers(1, &m_meshUbo);
+		m_meshUbo = 0;
+	}
+
+	m_meshSlots.clear();
+	m_meshSlotCount = 0;
+	m_meshSlot = -1;
+
+	m_viewportSlots.clear();
+	m_viewportSlotCount = 0;
+	m_viewportSlot = -1;
+}
+
+void R3DShader::ResetMeshSlots()
+{
+	// orphan the old storage, draws already issued keep reading from it
+	glBindBuffer(GL_UNIFORM_BUFFER, m_meshUbo);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)m_meshSlotSize * MAX_MESH_SLOTS, nullptr, GL_DYNAMIC_DRAW);
+
+	m_meshSlots.clear();
+	m_meshSlotCount = 0;
+	m_meshSlot = -1;
+}
+
+int R3DShader::FindMeshSlot(const MeshState& state)
+{
+	auto it = m_meshSlots.find(state);
+	if (it != m_meshSlots.end()) {
+		return it->second;
+	}
+
+	if (m_meshSlotCount == MAX_MESH_SLOTS) {
+		ResetMeshSlots();
+	}
+
+	// slots are only ever written once between orphans, so the driver never has to wait on the gpu for them
+	int slot = m_meshSlotCount++;
+	glBindBuffer(GL_UNIFORM_BUFFER, m_meshUbo);
+	glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)slot * m_meshSlotSize, sizeof(MeshState), &state);
+	m_uniformUpdates++;
+
+	m_meshSlots[state] = slot;
+
+	return slot;
+}
+
+void R3DShader::ResetViewportSlots()
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, m_viewportUbo);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)m_viewportSlotSize * MAX_VIEWPORT_SLOTS, nullptr, GL_DYNAMIC_DRAW);
+
+	m_viewportSlots.clear();
+	m_viewportSlotCount = 0;
+	m_viewportSlot = -1;
+}
+
+int R3DShader::FindViewportSlot(const ViewportState& state)
+{
+	auto it = m_viewportSlots.find(state);
+	if (it != m_viewportSlots.end()) {
+		return it->second;
+	}
+
+	if (m_viewportSlotCount == MAX_VIEWPORT_SLOTS) {
+		ResetViewportSlots();
+	}
+
+	int slot = m_viewportSlotCount++;
+	glBindBuffer(GL_UNIFORM_BUFFER, m_viewportUbo);
+	glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)slot * m_viewportSlotSize, sizeof(ViewportState), &state);
+	m_uniformUpdates++;
+
+	m_viewportSlots[state] = slot;
+
+	return slot;
+}
+
+// FNV-1a over the words of a state
+static size_t HashStateWords(const void* state, size_t size)
+{
+	const UINT32* words = (const UINT32*)state;
+	UINT32 hash = 2166136261u;
+
+	for (size_t i = 0; i < size / sizeof(UINT32); i++) {
+		hash = (hash ^ words[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+bool R3DShader::MeshState::operator==(const MeshState& other) const
+{
+	return std::memcmp(this, &other, sizeof(MeshState)) == 0;
+}
+
+size_t R3DShader::MeshStateHash::operator()(const MeshState& state) const
+{
+	return HashStateWords(&state, sizeof(MeshState));
+}
+
+bool R3DShader::ViewportState::operator==(const ViewportState& other) const
+{
+	return std::memcmp(this, &other, sizeof(ViewportState)) == 0;
+}
+
+size_t R3DShader::ViewportStateHash::operator()(const ViewportState& state) const
+{
+	return HashStateWords(&state, sizeof(ViewportState));
+}
+
 void R3DShader::SetShader(bool enable)
 {
 	if (enable) {
-		glUseProgram(m_shaderProgram);
+		glUseProgram(m_uberProgram.id);
+		m_program = &m_uberProgram;
 		Start();
 		DiscardAlpha(false);	// need some default
 	}
 	else {
 		glUseProgram(0);
+		m_program = nullptr;
 	}
 }
 
-void R3DShader::SetMeshUniforms(const Mesh* m)
+UINT32 R3DShader::VariantKey(const Mesh* m)
 {
-	if (m == nullptr) {
-		return;			// sanity check
-	}
+	// only the state the fragment shader branches on, and only where the branch is reached
+	UINT32 key = 0;
 
-	if (m_dirtyMesh) {
-		glUniform1i(m_locTextureBank[0], 0);
-		glUniform1i(m_locTextureBank[1], 1);
+	if (m->textured) {
+		key |= 1 | ((m->format & 15) << 1) | (m->microTexture << 5) | (m->inverted << 6) | (m->textureAlpha << 7) | (m->alphaTest << 8);
 	}
 
-	if (m_dirtyMesh || m->textured != m_textured1) {
-		glUniform1i(m_locTexture1Enabled, m->textured);
-		m_textured1 = m->textured;
+	if (m->lighting) {
+		key |= (1 << 9) | (m->specular << 10);
 	}
 
-	if (m_dirtyMesh || m->microTexture != m_textured2) {
-		glUniform1i(m_locTexture2Enabled, m->microTexture);
-		m_textured2 = m->microTexture;
-	}
+	key |= (m->fixedShading << 11) | ((m->fogIntensity == 0.0f) << 12);
 
-	if (m_dirtyMesh || (m->page ^ m_transPage) != m_texturePage) {
-		glUniform1i(m_locTexturePage, m->page ^ m_transPage);
-		m_texturePage = (m->page ^ m_transPage);
+	return key;
+}
+
+void R3DShader::BindProgram(Program& program)
+{
+	if (m_program != &program) {
+		glUseProgram(program.id);
+		m_program = &program;
 	}
 
-	if (m_dirtyMesh || m->microTextureMinLOD != m_microTexMinLOD) {
-		glUniform1f(m_locMicroTexMinLOD, m->microTextureMinLOD);
-		m_microTexMinLOD = m->microTextureMinLOD;
+	if (program.dirty || program.discardAlpha != m_discardAlpha) {
+		glUniform1i(program.locDiscardAlpha, m_discardAlpha);
+		program.discardAlpha = m_discardAlpha;
+		m_uniformUpdates++;
 	}
 
-	if (m_dirtyMesh || m->microTextureID != m_microTexID) {
-		glUniform1i(m_locMicroTexID, m->microTextureID);
-		m_microTexID = m->microTextureID;
+	if (program.dirty || program.layer != m_layer) {
+		glUniform1i(program.locColourLayer, m_layer);
+		program.layer = m_layer;
+		m_uniformUpdates++;
 	}
 
-	if (m_dirtyMesh || (m_baseTexInfo[0] != m->x || m_baseTexInfo[1] != m->y) || m_baseTexInfo[2] != m->width || m_baseTexInfo[3] != m->height) {
+	if (program.dirty || program.instanceBase != m_instanceBase) {
+		glUniform1i(program.locInstanceBase, m_instanceBase);
+		program.instanceBase = m_instanceBase;
+		m_uniformUpdates++;
+	}
 
-		m_baseTexInfo[0] = m->x;
-		m_baseTexInfo[1] = m->y;
-		m_baseTexInfo[2] = m->width;
-		m_baseTexInfo[3] = m->height;
+	ApplyModelStates(program);
+}
 
-		glUniform4i(m_locBaseTexInfo, (m->x + m_transX), (m->y + m_transY), m->width, m->height);
+void R3DShader::ApplyModelStates(Program& program)
+{
+	if (program.modelSerial == m_modelSerial && !program.dirty) {
+		return;
 	}
 
-	if (m_dirtyMesh || m_baseTexType != m->format) {
-		m_baseTexType = m->format;
-		glUniform1i(m_locBaseTexType,  m_baseTexType);
+	if (program.dirty || program.modelScale != m_modelScale) {
+		glUniform1f(program.locModelScale, m_modelScale);
+		program.modelScale = m_modelScale;
+		m_uniformUpdates++;
 	}
 
-	if (m_dirtyMesh || m->inverted != m_textureInverted) {
-		glUniform1i(m_locTextureInverted, m->inverted);
-		m_textureInverted = m->inverted;
+	if (program.dirty || program.nodeAlpha != m_nodeAlpha) {
+		glUniform1f(program.locNodeAlpha, m_nodeAlpha);
+		program.nodeAlpha = m_nodeAlpha;
+		m_uniformUpdates++;
 	}
 
-	if (m_dirtyMesh || m->alphaTest != m_alphaTest) {
-		glUniform1i(m_locAlphaTest, m->alphaTest);
-		m_alphaTest = m->alphaTest;
+	glUniformMatrix4fv(program.locModelMat, 1, GL_FALSE, m_modelMat);
+	m_uniformUpdates++;
+
+	program.modelSerial = m_modelSerial;
+	program.dirty = false;
+}
+
+UINT32 R3DShader::TakeUniformUpdates()
+{
+	UINT32 count = m_uniformUpdates;
+	m_uniformUpdates = 0;
+	return count;
+}
+
+void R3DShader::UpdateVariants()
+{
+	if (!m_useVariants) {
+		return;
+	}
+
+	Program* bound = m_program;
+	bool background = m_parallelCompile || m_loader;
+
+	// links started on earlier frames
+	for (auto& v : m_variants) {
+		if (v.second.pending) {
+			GLint done = GL_TRUE;
+			if (v.second.loaded) {
+				done = v.second.loaded->load() ? GL_TRUE : GL_FALSE;
+			}
+			else if (m_parallelCompile) {
+				glGetProgramiv(v.second.program.id, GL_COMPLETION_STATUS_KHR, &done);
+			}
+			if (done) {
+				FinishVariant(v.second);
+			}
+		}
 	}
 
-	if (m_dirtyMesh || m->textureAlpha != m_textureAlpha) {
-		glUniform1i(m_locTextureAlpha, m->textureAlpha);
-		m_textureAlpha = m->textureAlpha;
+	// then the states drawn most often without one. Without background links each build stalls, so only one a frame
+	for (int builds = background ? 4 : 1; builds > 0 && m_variantCount < MAX_VARIANTS; builds--) {
+
+		auto best = m_variants.end();
+		for (auto it = m_variants.begin(); it != m_variants.end(); ++it) {
+			const Variant& v = it->second;
+			if (!v.ready && !v.pending && !v.failed && v.uses && (best == m_variants.end() || v.uses > best->second.uses)) {
+				best = it;
+			}
+		}
+
+		if (best == m_variants.end()) {
+			break;
+		}
+
+		StartVariant(best->first, best->second);
+
+		if (!background && best->second.pending) {
+			FinishVariant(best->second);
+		}
 	}
 
-	if (m_dirtyMesh || m->fogIntensity != m_fogIntensity) {
-		glUniform1f(m_locFogIntensity, m->fogIntensity);
-		m_fogIntensity = m->fogIntensity;
+	glUseProgram(bound ? bound->id : 0);
+}
+
+void R3DShader::StartVariant(UINT32 key, Variant& variant)
+{
+	m_variantCount++;
+
+	// the defines have to follow the version directive
+	char defines[512];
+	snprintf(defines, sizeof(defines),
+		"#define STATIC_MESH_STATE\n"
+		"#define STATIC_TEXTURE_ENABLED %s\n"
+		"#define STATIC_BASE_TEX_TYPE %u\n"
+		"#define STATIC_MICRO_TEXTURE %s\n"
+		"#define STATIC_TEXTURE_INVERTED %s\n"
+		"#define STATIC_TEXTURE_ALPHA %s\n"
+		"#define STATIC_ALPHA_TEST %s\n"
+		"#define STATIC_LIGHT_ENABLED %s\n"
+		"#define STATIC_SPECULAR_ENABLED %s\n"
+		"#define STATIC_FIXED_SHADING %s\n"
+		"#define STATIC_NO_FOG %u\n",
+		(key & 1) ? "true" : "false", (key >> 1) & 15, (key & (1 << 5)) ? "true" : "false", (key & (1 << 6)) ? "true" : "false",
+		(key & (1 << 7)) ? "true" : "false", (key & (1 << 8)) ? "true" : "false", (key & (1 << 9)) ? "true" : "false",
+		(key & (1 << 10)) ? "true" : "false", (key & (1 << 11)) ? "true" : "false", (key >> 12) & 1);
+
+	variant.fragmentShader = m_fragmentSource;
+	size_t pos = variant.fragmentShader.find('\n', variant.fragmentShader.find("#version"));
+	variant.fragmentShader.insert(pos + 1, defines);
+
+	GLuint program = glCreateProgram();
+	variant.program.id = program;
+
+	const char* vShader = m_vertexSource.c_str();
+	const char* gShader = m_geometrySource.c_str();
+	const char* fShader = variant.fragmentShader.c_str();
+
+	if (LoadCachedProgram(program, { vShader, gShader, fShader, fragmentShaderR3DCommon, m_attribBindings.c_str() })) {
+		variant.fragmentShader.clear();
+		variant.pending = true;		// finished straight away
+		FinishVariant(variant);
+		return;
+	}
+
+	variant.pending = true;
+
+	if (m_loader && !m_parallelCompile) {
+		// the loader gets its own copies, the variant's source is cleared once it's finished
+		auto loaded = std::make_shared<std::atomic<bool>>(false);
+		variant.loaded = loaded;
+		m_loader->Submit([program, loaded, bindings = m_attribBindings, vs = m_vertexSource, gs = m_geometrySource, fs = variant.fragmentShader]() {
+			LinkVariant(program, bindings, vs.c_str(), gs.c_str(), fs.c_str());
+			loaded->store(true);
+		});
+		return;
+	}
+
+	LinkVariant(program, m_attribBindings, vShader, gShader, fShader);
+}
+
+void R3DShader::LinkVariant(GLuint program, const std::string& attribBindings, const char* vShader, const char* gShader, const char* fShader)
+{
+	// bindings can be changed freely until the link
+	for (size_t start = 0; start < attribBindings.size(); ) {
+		size_t eq = attribBindings.find('=', start);
+		size_t end = attribBindings.find(';', eq);
+		std::string name = attribBindings.substr(start, eq - start);
+		glBindAttribLocation(program, (GLuint)std::stoi(attribBindings.substr(eq + 1, end - eq - 1)), name.c_str());
+		start = end + 1;
 	}
 
-	if (m_dirtyMesh || m->lighting != m_lightEnabled) {
-		glUniform1i(m_locLightEnabled, m->lighting);
-		m_lightEnabled = m->lighting;
+	GLuint shaders[3] = { glCreateShader(GL_VERTEX_SHADER), glCreateShader(GL_FRAGMENT_SHADER), 0 };
+	const char* shaderArray[] = { fShader, fragmentShaderR3DCommon };
+
+	glShaderSource(shaders[0], 1, (const GLchar **)&vShader, nullptr);
+	glShaderSource(shaders[1], (GLsizei)std::size(shaderArray), shaderArray, nullptr);
+
+	if (*gShader) {
+		shaders[2] = glCreateShader(GL_GEOMETRY_SHADER);
+		glShaderSource(shaders[2], 1, (const GLchar **)&gShader, nullptr);
 	}
 
-	if (m_dirtyMesh || m->shininess != m_shininess) {
-		glUniform1f(m_locShininess, m->shininess);
-		m_shininess = m->shininess;
+	// compile errors show up as link errors, so nothing is queried here that would make the driver wait
+	for (GLuint shader : shaders) {
+		if (shader) {
+			glCompileShader(shader);
+			glAttachShader(program, shader);
+			glDeleteShader(shader);			// freed with the program
+		}
 	}
 
-	if (m_dirtyMesh || m->specular != m_specularEnabled) {
-		glUniform1i(m_locSpecularEnabled, m->specular);
-		m_specularEnabled = m->specular;
+	glLinkProgram(program);
+}
+
+void R3DShader::FinishVariant(Variant& variant)
+{
+	GLint linked = GL_FALSE;
+	glGetProgramiv(variant.program.id, GL_LINK_STATUS, &linked);
+
+	variant.pending = false;
+	variant.loaded.reset();
+
+	if (!linked) {
+		PrintProgramResult(variant.program.id);
+		glDeleteProgram(variant.program.id);
+		variant.program.id = 0;
+		variant.failed = true;				// the uber program carries on drawing these
+		variant.fragmentShader.clear();
+		return;
 	}
 
-	if (m_dirtyMesh || m->specularValue != m_specularValue) {
-		glUniform1f(m_locSpecularValue, m->specularValue);
-		m_specularValue = m->specularValue;
+	if (!variant.fragmentShader.empty()) {
+		SaveCachedProgram(variant.program.id, { m_vertexSource.c_str(), m_geometrySource.c_str(), variant.fragmentShader.c_str(), fragmentShaderR3DCommon, m_attribBindings.c_str() });
+		variant.fragmentShader.clear();
 	}
 
-	if (m_dirtyMesh || m->fixedShading != m_fixedShading) {
-		glUniform1i(m_locFixedShading, m->fixedShading);
-		m_fixedShading = m->fixedShading;
+	InitProgram(variant.program);
+	variant.ready = true;
+}
+
+void R3DShader::DeleteVariants()
+{
+	if (m_loader) {
+		m_loader->Finish();					// nothing may still be linking the programs
 	}
 
-	if (m_dirtyMesh || m->smoothShading != m_smoothShading) {
-		glUniform1i(m_locSmoothShading, m->smoothShading);
-		m_smoothShading = m->smoothShading;
+	for (auto& v : m_variants) {
+		if (v.second.program.id) {
+			glDeleteProgram(v.second.program.id);
+		}
 	}
 
-	if (m_dirtyMesh || m->translatorMap != m_translatorMap) {
-		glUniform1i(m_locTranslatorMap, m->translatorMap);
-		m_translatorMap = m->translatorMap;
+	m_variants.clear();
+	m_variantCount = 0;
+}
+
+void R3DShader::SetMeshUniforms(const Mesh* m)
+{
+	if (m == nullptr) {
+		return;			// sanity check
 	}
 
-	if (m_dirtyMesh || m->polyAlpha != m_polyAlpha) {
-		glUniform1i(m_locPolyAlpha, m->polyAlpha);
-		m_polyAlpha = m->polyAlpha;
+	// the state includes the model's texture offsets, so meshes shared between models get their own slots
+	MeshState state;
+	state.baseTexInfo[0]		= m->x + m_transX;
+	state.baseTexInfo[1]		= m->y + m_transY;
+	state.baseTexInfo[2]		= m->width;
+	state.baseTexInfo[3]		= m->height;
+	state.textureWrapMode[0]	= m->wrapModeU;
+	state.textureWrapMode[1]	= m->wrapModeV;
+	state.texturePage			= m->page ^ m_transPage;
+	state.microTextureID		= m->microTextureID;
+	state.baseTexType			= m->format;
+	state.microTextureMinLOD	= m->microTextureMinLOD;
+	state.fogIntensity			= m->fogIntensity;
+	state.shininess				= m->shininess;
+	state.specularValue			= m->specularValue;
+	state.textureEnabled		= m->textured;
+	state.microTexture			= m->microTexture;
+	state.textureInverted		= m->inverted;
+	state.textureAlpha			= m->textureAlpha;
+	state.alphaTest				= m->alphaTest;
+	state.lightEnabled			= m->lighting;
+	state.specularEnabled		= m->specular;
+	state.fixedShading			= m->fixedShading;
+	state.smoothShading			= m->smoothShading;
+	state.translatorMap			= m->translatorMap;
+	state.polyAlpha				= m->polyAlpha;
+
+	// specialised programs are swapped in without reordering the draws, depth ties and the layered stencil depend on the order
+	if (m_useVariants && m_program) {
+		Variant& variant = m_variants[VariantKey(m)];
+		if (variant.ready) {
+			BindProgram(variant.program);
+		}
+		else {
+			variant.uses++;
+			BindProgram(m_uberProgram);
+		}
 	}
 
-	if (m_dirtyMesh || m->wrapModeU != m_texWrapMode[0] || m->wrapModeV != m_texWrapMode[1]) {
-		m_texWrapMode[0] = m->wrapModeU;
-		m_texWrapMode[1] = m->wrapModeV;
-		glUniform2iv(m_locTexWrapMode, 1, m_texWrapMode);
+	int slot = FindMeshSlot(state);
+
+	if (slot != m_meshSlot) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, 1, m_meshUbo, (GLintptr)slot * m_meshSlotSize, sizeof(MeshState));
+		m_meshSlot = slot;
 	}
 
 	if (m_dirtyMesh || m->noLosReturn != m_noLosReturn) {
@@ -346,60 +729,83 @@ void R3DShader::SetMeshUniforms(const Mesh* m)
 
 void R3DShader::SetViewportUniforms(const Viewport *vp)
 {
-	//didn't bother caching these, they don't get frequently called anyway
-	glUniform1f(m_locFogDensity, vp->fogParams[3]);
-	glUniform1f(m_locFogStart, vp->fogParams[4]);
-	glUniform3fv(m_locFogColour, 1, vp->fogParams);
-	glUniform1f(m_locFogAttenuation, vp->fogParams[5]);
-	glUniform1f(m_locFogAmbient, vp->fogParams[6]);
-
-	glUniform3fv(m_locLighting, 2, vp->lightingParams);
-	glUniform1i(m_locSunClamp, vp->sunClamp);
-	glUniform1i(m_locIntensityClamp, vp->intensityClamp);
-	glUniform4fv(m_locSpotEllipse, 1, vp->spotEllipse);
-	glUniform2fv(m_locSpotRange, 1, vp->spotRange);
-	glUniform3fv(m_locSpotColor, 1, vp->spotColor);
-	glUniform3fv(m_locSpotFogColor, 1, vp->spotFogColor);
-
-	glUniformMatrix4fv(m_locProjMat, 1, GL_FALSE, vp->projectionMatrix);
-
-	glUniform1i(m_locHardwareStep, vp->hardwareStep);
-
-	glUniform1f(m_locCota, vp->cota);
+	ViewportState state;
+	std::memcpy(state.projMat, (const float*)vp->projectionMatrix, sizeof(state.projMat));
+	std::memcpy(state.spotEllipse, vp->spotEllipse, sizeof(state.spotEllipse));
+
+	for (int i = 0; i < 2; i++) {
+		state.lighting[i][0] = vp->lightingParams[i * 3 + 0];
+		state.lighting[i][1] = vp->lightingParams[i * 3 + 1];
+		state.lighting[i][2] = vp->lightingParams[i * 3 + 2];
+		state.lighting[i][3] = 0;
+	}
+
+	std::memcpy(state.fogColour, vp->fogParams, sizeof(state.fogColour));
+	std::memcpy(state.spotColor, vp->spotColor, sizeof(state.spotColor));
+	std::memcpy(state.spotFogColor, vp->spotFogColor, sizeof(state.spotFogColor));
+	std::memcpy(state.spotRange, vp->spotRange, sizeof(state.spotRange));
+
+	state.fogDensity		= vp->fogParams[3];
+	state.fogStart			= vp->fogParams[4];
+	state.fogAttenuation	= vp->fogParams[5];
+	state.fogAmbient		= vp->fogParams[6];
+	state.cota				= vp->cota;
+	state.sunClamp			= vp->sunClamp;
+	state.intensityClamp	= vp->intensityClamp;
+	state.hardwareStep		= vp->hardwareStep;
+	state.pad				= 0;
+
+	// viewports keep their slot across passes and frames, so a static scene uploads nothing here
+	int slot = FindViewportSlot(state);
+
+	if (slot != m_viewportSlot) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, m_viewportUbo, (GLintptr)slot * m_viewportSlotSize, sizeof(ViewportState));
+		m_viewportSlot = slot;
+	}
 }
 
 void R3DShader::SetModelStates(const Model* model)
 {
-	if (m_dirtyModel || model->scale != m_modelScale) {
-		glUniform1f(m_locModelScale, model->scale);
-		m_modelScale = model->scale;
-	}
-
-	if (m_dirtyModel || model->alpha != m_nodeAlpha) {
-		glUniform1f(m_locNodeAlpha, model->alpha);
-		m_nodeAlpha = model->alpha;
-	}
+	m_modelScale = model->scale;
+	m_nodeAlpha = model->alpha;
+	std::memcpy(m_modelMat, model->modelMat, sizeof(m_modelMat));
+	m_modelSerial++;
 
 	m_transX = model->textureOffsetX;
 	m_transY = model->textureOffsetY;
 	m_transPage = model->page;
 
-	// reset texture values
-	for (auto& i : m_baseTexInfo) { i = -1; }
-
-	glUniformMatrix4fv(m_locModelMat, 1, GL_FALSE, model->modelMat);
-
-	m_dirtyModel = false;
+	// other programs pick these up when they are next bound
+	if (m_program) {
+		ApplyModelStates(*m_program);
+	}
 }
 
 void R3DShader::DiscardAlpha(bool discard)
 {
-	glUniform1i(m_locDiscardAlpha, discard);
+	m_discardAlpha = discard;
+
+	if (m_program) {
+		BindProgram(*m_program);
+	}
 }
 
 void R3DShader::SetLayer(Layer layer)
 {
-	glUniform1i(m_locColourLayer, (GLint)layer);
+	m_layer = (GLint)layer;
+
+	if (m_program) {
+		BindProgram(*m_program);
+	}
+}
+
+void R3DShader::SetInstanceBase(GLint base)
+{
+	m_instanceBase = base;
+
+	if (m_program) {
+		BindProgram(*m_program);
+	}
 }
 
 void R3DShader::PrintShaderResult(GLuint shader)
@@ -4,8 +4,12 @@
 #include <GL/glew.h>
 #include "Util/NewConfig.h"
 #include "Model.h"
+#include "Graphics/GLLoader.h"
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 
 namespace New3D {
 
@@ -24,9 +28,126 @@ public:
 	GLint	GetVertexAttribPos	(const std::string& attrib);
 	void	DiscardAlpha		(bool discard);				// use to remove alpha from texture alpha only polys for 1st pass
 	void	SetLayer			(Layer layer);
+	void	SetInstanceBase		(GLint base);				// models of instanced draws take their matrices from the texture buffer on unit 3, starting at matrix base. -1 uses the model state's matrix
+	void	SetPackedVertices	(bool packed);				// call before LoadShader, face attributes come from a texture buffer on unit 2
+	void	SetQuadPulling		(bool pull);				// call before LoadShader, quads are drawn as triangles reading the vertex buffer from storage buffer 0
+	void	UpdateVariants		();							// call once a frame outside of drawing, builds specialised programs for the most drawn mesh states
+	void	SetLoader			(GLLoader* loader);			// optional, links variants on the loader thread when the driver can't do so in the background itself
+	UINT32	TakeUniformUpdates	();							// uniform and uniform buffer writes since the last call
 
 private:
 
+	// a linked program, its uniform locations and the values they were last given
+	struct Program
+	{
+		GLuint	id				= 0;
+		GLint	locModelScale	= -1;
+		GLint	locNodeAlpha	= -1;
+		GLint	locModelMat		= -1;
+		GLint	locDiscardAlpha	= -1;
+		GLint	locColourLayer	= -1;
+		GLint	locInstanceBase	= -1;
+		bool	dirty			= true;		// values below are unknown
+		UINT32	modelSerial		= 0;		// m_modelSerial when the model uniforms were last set
+		float	modelScale		= 1.0f;
+		float	nodeAlpha		= 1.0f;
+		bool	discardAlpha	= false;
+		GLint	layer			= 0;
+		GLint	instanceBase	= -1;
+	};
+
+	// uber program with the mesh state that selects fragment shader paths compiled in as constants
+	struct Variant
+	{
+		Program		program;
+		std::string	fragmentShader;			// kept until linked, for the program cache
+		bool		pending	= false;		// linking in the background
+		std::shared_ptr<std::atomic<bool>> loaded;	// set by the loader thread once linked, if it links this one
+		bool		ready	= false;
+		bool		failed	= false;
+		UINT32		uses	= 0;			// meshes drawn with the uber program while there was no variant
+	};
+
+	static const int MAX_VARIANTS = 64;
+
+	// std140 mirrors of the uniform blocks in the shaders, every member is 4 bytes so there is no hidden padding
+	struct MeshState
+	{
+		GLint	baseTexInfo[4];
+		GLint	textureWrapMode[2];
+		GLint	texturePage;
+		GLint	microTextureID;
+		GLint	baseTexType;
+		GLfloat	microTextureMinLOD;
+		GLfloat	fogIntensity;
+		GLfloat	shininess;
+		GLfloat	specularValue;
+		GLint	textureEnabled;
+		GLint	microTexture;
+		GLint	textureInverted;
+		GLint	textureAlpha;
+		GLint	alphaTest;
+		GLint	lightEnabled;
+		GLint	specularEnabled;
+		GLint	fixedShading;
+		GLint	smoothShading;
+		GLint	translatorMap;
+		GLint	polyAlpha;
+
+		bool operator==(const MeshState& other) const;
+	};
+
+	struct MeshStateHash
+	{
+		size_t operator()(const MeshState& state) const;
+	};
+
+	struct ViewportState
+	{
+		GLfloat	projMat[16];
+		GLfloat	spotEllipse[4];
+		GLfloat	lighting[2][4];		// vec3 array elements are padded to vec4
+		GLfloat	fogColour[3];
+		GLfloat	fogDensity;
+		GLfloat	spotColor[3];
+		GLfloat	fogStart;
+		GLfloat	spotFogColor[3];
+		GLfloat	fogAttenuation;
+		GLfloat	spotRange[2];
+		GLfloat	fogAmbient;
+		GLfloat	cota;
+		GLint	sunClamp;
+		GLint	intensityClamp;
+		GLint	hardwareStep;
+		GLint	pad;
+
+		bool operator==(const ViewportState& other) const;
+	};
+
+	struct ViewportStateHash
+	{
+		size_t operator()(const ViewportState& state) const;
+	};
+
+	static const int MAX_MESH_SLOTS = 4096;
+	static const int MAX_VIEWPORT_SLOTS = 256;
+
+	void CreateUniformBuffers();
+	void DeleteUniformBuffers();
+	void ResetMeshSlots();
+	int  FindMeshSlot(const MeshState& state);
+	void ResetViewportSlots();
+	int  FindViewportSlot(const ViewportState& state);
+
+	static UINT32 VariantKey(const Mesh* m);
+	void InitProgram(Program& program);
+	void BindProgram(Program& program);
+	void ApplyModelStates(Program& program);
+	void StartVariant(UINT32 key, Variant& variant);
+	void FinishVariant(Variant& variant);
+	static void LinkVariant(GLuint program, const std::string& attribBindings, const char* vShader, const char* gShader, const char* fShader);
+	void DeleteVariants();
+
 	void PrintShaderResult(GLuint shader);
 	void PrintProgramResult(GLuint program);
 
@@ -34,98 +155,64 @@ private:
 	const Util::Config::Node &m_config;
 
 	// shader IDs
-	GLuint m_shaderProgram;
+	Program	m_uberProgram;
 	GLuint m_vertexShader;
 	GLuint m_geoShader;
 	GLuint m_fragmentShader;
 
-	// mesh uniform locations
-	GLint m_locTextureBank[2];		// 2 banks
-	GLint m_locTexture1Enabled;		// base texture
-	GLint m_locTexture2Enabled;		// micro texture
-	GLint m_locTexturePage;
-	GLint m_locTextureAlpha;
-	GLint m_locAlphaTest;
-	GLint m_locMicroTexMinLOD;
-	GLint m_locMicroTexID;
-	GLint m_locBaseTexInfo;
-	GLint m_locBaseTexType;
-	GLint m_locTextureInverted;
-	GLint m_locTexWrapMode;
-	GLint m_locTranslatorMap;
-	GLint m_locColourLayer;
-	GLint m_locPolyAlpha;
+	Program* m_program;				// bound, or null if another program may be
+
+	bool	m_packedVertices;
+	bool	m_quadPulling;
+
+	// specialised programs by VariantKey(), built from the same sources with the attribute locations of the uber program
+	bool		m_useVariants;
+	bool		m_parallelCompile;		// driver links in the background
+	GLLoader*	m_loader;				// optional
+	int			m_variantCount;			// built or being built
+	std::string	m_vertexSource;
+	std::string	m_geometrySource;
+	std::string	m_fragmentSource;
+	std::string	m_attribBindings;		// "name=location;" for each attribute, part of the program cache key
+	std::unordered_map<UINT32, Variant> m_variants;
+
+	// uniform buffers
+	GLuint	m_viewportUbo;
+	GLuint	m_meshUbo;
+	GLint	m_meshSlotSize;			// sizeof(MeshState) rounded up to the uniform buffer offset alignment
+	int		m_meshSlotCount;		// slots written since the buffer was last orphaned
+	int		m_meshSlot;				// slot currently bound
+	GLint	m_viewportSlotSize;		// sizeof(ViewportState) rounded up to the uniform buffer offset alignment
+	int		m_viewportSlotCount;
+	int		m_viewportSlot;
+
+	// mesh states already in the buffer, so repeated states are only uploaded once
+	std::unordered_map<MeshState, int, MeshStateHash> m_meshSlots;
+
+	// same for viewports, each is drawn up to six times a frame (3 layers, with and without overlay)
+	std::unordered_map<ViewportState, int, ViewportStateHash> m_viewportSlots;
 
 	// cached mesh values
-	bool	m_textured1;
-	bool	m_textured2;
-	bool	m_textureAlpha;		// use alpha in texture
-	bool	m_alphaTest;		// discard fragment based on alpha (ogl does this with fixed function)
-	float	m_fogIntensity;
-	bool	m_lightEnabled;
-	float	m_shininess;
-	float	m_specularValue;
-	bool	m_specularEnabled;
-	bool	m_fixedShading;
-	bool	m_smoothShading;
-	bool	m_translatorMap;
-	bool	m_polyAlpha;
-	int		m_texturePage;
-
 	bool	m_layered;
 	bool	m_noLosReturn;
-	float	m_microTexMinLOD;
-	int		m_microTexID;
-	int		m_baseTexInfo[4];
-	int		m_baseTexType;
-	int		m_texWrapMode[2];
-	bool	m_textureInverted;
-
-	// cached model values
+
+	// current model values, programs catch up with them when bound
 	float	m_modelScale;
 	float	m_nodeAlpha;
+	GLfloat	m_modelMat[16];
+	UINT32	m_modelSerial;			// bumped for every model
+	UINT32	m_uniformUpdates;
 	int		m_transX;
 	int		m_transY;
 	int		m_transPage;
 
+	// current pass values
+	bool	m_discardAlpha;
+	GLint	m_layer;
+	GLint	m_instanceBase;
+
 	// are our cache values dirty
 	bool	m_dirtyMesh;
-	bool	m_dirtyModel;
-
-	// viewport uniform locations
-	GLint m_locFogIntensity;
-	GLint m_locFogDensity;
-	GLint m_locFogStart;
-	GLint m_locFogColour;
-	GLint m_locFogAttenuation;
-	GLint m_locFogAmbient;
-	GLint m_locProjMat;
-	GLint m_locCota;
-
-	// lighting / other
-	GLint m_locLighting;
-	GLint m_locLightEnabled;
-	GLint m_locSunClamp;
-	GLint m_locIntensityClamp;
-	GLint m_locShininess;
-	GLint m_locSpecularValue;
-	GLint m_locSpecularEnabled;
-	GLint m_locFixedShading;
-	GLint m_locSmoothShading;
-
-	GLint m_locSpotEllipse;
-	GLint m_locSpotRange;
-	GLint m_locSpotColor;
-	GLint m_locSpotFogColor;
-
-	// model uniforms
-	GLint m_locModelScale;
-	GLint m_locNodeAlpha;
-	GLint m_locModelMat;
-
-	// global uniforms
-	GLint m_locHardwareStep;
-	GLint m_locDiscardAlpha;
 
 	// vertex attribute position cache
 	std::map<std::string, GLint> m_vertexLocCache;
@@ -1,6 +1,7 @@
 #pragma once
 
 // I altered this code a bit to make sure it always compiles with gl 4.1. Version 4.5 allows you to specify arrays differently.
+// It is also compiled as GLSL ES 3.2 (see TranslateShaderSource), which has no implicit conversions, so ints and floats mustn't be mixed.
 // Ripped out most of the common code, people have been pushing changes to the shaders but we are ending up with diverging implementations
 // between triangle / quad version which is less than ideal.
 
@@ -172,10 +173,10 @@ vec4 texBiLinear(usampler2D texSampler, ivec2 wrapMode, vec2 texSize, ivec2 texP
 	float a = LinearTexLocations(wrapMode.s, texSize.x, texCoord.x, tx[0], tx[1]);
 	float b = LinearTexLocations(wrapMode.t, texSize.y, texCoord.y, ty[0], ty[1]);
 
-	vec4 p0q0 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[0],ty[0]) * texSize + texPos),level), level).r);
-    vec4 p1q0 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[1],ty[0]) * texSize + texPos),level), level).r);
-    vec4 p0q1 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[0],ty[1]) * texSize + texPos),level), level).r);
-    vec4 p1q1 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[1],ty[1]) * texSize + texPos),level), level).r);
+	vec4 p0q0 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[0],ty[0]) * texSize + vec2(texPos)),level), level).r);
+    vec4 p1q0 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[1],ty[0]) * texSize + vec2(texPos)),level), level).r);
+    vec4 p0q1 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[0],ty[1]) * texSize + vec2(texPos)),level), level).r);
+    vec4 p1q1 = ExtractColour(baseTexType,texelFetch(texSampler, WrapTexCoords(texPos,ivec2(vec2(tx[1],ty[1]) * texSize + vec2(texPos)),level), level).r);
 
 	if(alphaTest) {
 		if(p0q0.a > p1q0.a)		{ p1q0.rgb = p0q0.rgb; }
@@ -216,7 +217,8 @@ vec4 GetTextureValue()
 	float blendFactor = 0.0;
 
 	// if LOD < 0, no need to blend with next mipmap level; slight performance boost
-	if (lod > 0.0)
+	// same once the lod is clamped to the last level or lands on a whole level, the blend weight is zero so the 4 extra fetches and decodes would be thrown away
+	if (lod > 0.0 && fract(fLevel) > 0.0)
 	{
 		ivec2 tex2Pos = GetTexturePosition(iLevel+1, ivec2(baseTexInfo.xy));
 		ivec2 tex2Size = GetTextureSize(iLevel+1, ivec2(baseTexInfo.zw));
@@ -231,7 +233,7 @@ vec4 GetTextureValue()
 
 		// microtextures are always 128x128 and only use LOD 0 mipmap
 		ivec2 tex2Pos = GetMicroTexturePos(microTextureID);
-		tex2Data = texBiLinear(textureBank[(texturePage+1)&1], ivec2(0), ivec2(128), tex2Pos, fsTexCoord * scale, 0);
+		tex2Data = texBiLinear(textureBank[(texturePage+1)&1], ivec2(0), vec2(128.0), tex2Pos, fsTexCoord * scale, 0);
 
 		blendFactor = -(lod + microTextureMinLOD) * 0.5;
 		blendFactor = clamp(blendFactor, 0.0, 0.5);
@@ -8,19 +8,71 @@ static const char *vertexShaderR3DQuads = R"glsl(
 // uniforms
 uniform float	modelScale;
 uniform float	nodeAlpha;
-uniform float	cota;
 uniform mat4	modelMat;
-uniform mat4	projMat;
-uniform bool	translatorMap;
+uniform samplerBuffer	instanceMats;	// model matrices of instanced draws, one per instance
+uniform int		instanceBase;		// first matrix of this draw in instanceMats, or -1 to use modelMat
+
+// per viewport state (layout must match R3DShader::ViewportState)
+layout(std140) uniform ViewportState
+{
+	mat4	projMat;
+	vec4	spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
+	vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
+	vec3	fogColour;
+	float	fogDensity;
+	vec3	spotColor;			// spotlight RGB color
+	float	fogStart;
+	vec3	spotFogColor;		// spotlight RGB color on fog
+	float	fogAttenuation;
+	vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
+	float	fogAmbient;
+	float	cota;
+	bool	sunClamp;			// not used by daytona and la machine guns
+	bool	intensityClamp;		// some games such as daytona and 
+	int		hardwareStep;
+};
+
+// per mesh state, one uniform buffer slot per unique state (layout must match R3DShader::MeshState)
+layout(std140) uniform MeshState
+{
+	ivec4	baseTexInfo;		// x/y are x,y positions in the texture sheet. z/w are with and height
+	ivec2	textureWrapMode;
+	int		texturePage;
+	int		microTextureID;
+	int		baseTexType;
+	float	microTextureMinLOD;
+	float	fogIntensity;
+	float	shininess;			// specular shininess
+	float	specularValue;		// specular coefficient
+	bool	textureEnabled;
+	bool	microTexture;
+	bool	textureInverted;
+	bool	textureAlpha;
+	bool	alphaTest;
+	bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
+	bool	specularEnabled;	// specular enabled
+	bool	fixedShading;
+	bool	smoothShading;
+	bool	translatorMap;
+	bool	polyAlpha;
+};
 
 // attributes
 in vec4		inVertex;
 in vec3		inNormal;
 in vec2		inTexCoord;
-in vec3		inFaceNormal;		// used to emulate r3d culling 
 in float	inFixedShade;
+#ifdef PACKED_VERTICES
+uniform usamplerBuffer	polyData;	// face attributes, one texel per poly
+uniform int				polyVerts;
+vec3		inFaceNormal;			// used to emulate r3d culling 
+vec4		inColour;
+float		inTextureNP;
+#else
+in vec3		inFaceNormal;		// used to emulate r3d culling 
 in vec4		inColour;
 in float	inTextureNP;
+#endif
 
 // outputs to geometry shader
 
@@ -35,6 +87,18 @@ out VS_OUT
 	float	LODBase;
 } vs_out;
 
+mat4 modelMatrix;			// modelMat, or this instance's matrix
+
+mat4 GetModelMatrix()
+{
+	if (instanceBase < 0) {
+		return modelMat;
+	}
+
+	int i = (instanceBase + gl_InstanceID) * 4;
+	return mat4(texelFetch(instanceMats, i), texelFetch(instanceMats, i + 1), texelFetch(instanceMats, i + 2), texelFetch(instanceMats, i + 3));
+}
+
 vec4 GetColour(vec4 colour)
 {
 	vec4 c = colour;
@@ -51,22 +115,37 @@ vec4 GetColour(vec4 colour)
 float CalcBackFace(in vec3 viewVertex)
 {
 	vec3 vt = viewVertex; // - vec3(0.0);
-	vec3 vn = mat3(modelMat) * inFaceNormal;
+	vec3 vn = mat3(modelMatrix) * inFaceNormal;
 
 	// dot product of face normal with view direction
 	return dot(vt, vn);
 }
 
+#ifdef PACKED_VERTICES
+void FetchPolyData()
+{
+	uvec4 poly		= texelFetch(polyData, gl_VertexID / polyVerts);
+	inFaceNormal	= vec3(ivec3(int(poly.x << 16), int(poly.x), int(poly.y << 16)) >> 16) / 32767.0;
+	inTextureNP		= uintBitsToFloat(poly.z);
+	inColour		= vec4((uvec4(poly.w) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu) / 255.0;
+}
+#endif
+
 void main(void)
 {
-	vs_out.viewVertex	= vec3(modelMat * inVertex);
-	vs_out.viewNormal	= (mat3(modelMat) * inNormal) / modelScale;
+	modelMatrix = GetModelMatrix();
+
+#ifdef PACKED_VERTICES
+	FetchPolyData();
+#endif
+	vs_out.viewVertex	= vec3(modelMatrix * inVertex);
+	vs_out.viewNormal	= (mat3(modelMatrix) * inNormal) / modelScale;
 	vs_out.discardPoly	= CalcBackFace(vs_out.viewVertex);
 	vs_out.color    	= GetColour(inColour);
 	vs_out.texCoord		= inTexCoord;
 	vs_out.fixedShade	= inFixedShade;
 	vs_out.LODBase		= -vs_out.discardPoly * cota * inTextureNP;
-	gl_Position			= projMat * modelMat * inVertex;
+	gl_Position			= projMat * modelMatrix * inVertex;
 }
 )glsl";
 
@@ -178,52 +257,318 @@ void main(void)
 
 )glsl";
 
+// Alternative to the geometry shader, which is slow on many GPUs. Each quad is drawn as 2 triangles (6 vertices) and every
+// vertex fetches all 4 corners from the vertex buffer, doing the same setup as the geometry shader for the corner it stands in for.
+static const char *vertexShaderR3DQuadsPull = R"glsl(
+
+#version 450 core
+
+// uniforms
+uniform float	modelScale;
+uniform float	nodeAlpha;
+uniform mat4	modelMat;
+uniform samplerBuffer	instanceMats;	// model matrices of instanced draws, one per instance
+uniform int		instanceBase;		// first matrix of this draw in instanceMats, or -1 to use modelMat
+
+// per viewport state (layout must match R3DShader::ViewportState)
+layout(std140) uniform ViewportState
+{
+	mat4	projMat;
+	vec4	spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
+	vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
+	vec3	fogColour;
+	float	fogDensity;
+	vec3	spotColor;			// spotlight RGB color
+	float	fogStart;
+	vec3	spotFogColor;		// spotlight RGB color on fog
+	float	fogAttenuation;
+	vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
+	float	fogAmbient;
+	float	cota;
+	bool	sunClamp;			// not used by daytona and la machine guns
+	bool	intensityClamp;		// some games such as daytona and 
+	int		hardwareStep;
+};
+
+// per mesh state, one uniform buffer slot per unique state (layout must match R3DShader::MeshState)
+layout(std140) uniform MeshState
+{
+	ivec4	baseTexInfo;		// x/y are x,y positions in the texture sheet. z/w are with and height
+	ivec2	textureWrapMode;
+	int		texturePage;
+	int		microTextureID;
+	int		baseTexType;
+	float	microTextureMinLOD;
+	float	fogIntensity;
+	float	shininess;			// specular shininess
+	float	specularValue;		// specular coefficient
+	bool	textureEnabled;
+	bool	microTexture;
+	bool	textureInverted;
+	bool	textureAlpha;
+	bool	alphaTest;
+	bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
+	bool	specularEnabled;	// specular enabled
+	bool	fixedShading;
+	bool	smoothShading;
+	bool	translatorMap;
+	bool	polyAlpha;
+};
+
+// the vertex buffer itself, words of a PackedVertex or FVertex
+layout(std430, binding = 0) readonly buffer VertexData
+{
+	uint vertexData[];
+};
+
+#ifdef PACKED_VERTICES
+uniform usamplerBuffer	polyData;	// face attributes, one texel per poly
+const int VERTEX_WORDS = 7;
+#else
+const int VERTEX_WORDS = 15;
+#endif
+
+// outputs straight to the fragment shader, same as the geometry shader's
+
+out GS_OUT
+{
+	noperspective vec2 v[4];
+	noperspective float area[4];
+	flat float oneOverW[4];
+
+	//our regular attributes
+	flat vec3	viewVertex[4];
+	flat vec3	viewNormal[4];		// per vertex normal vector
+	flat vec2	texCoord[4];
+	flat vec4	color;
+	flat float	fixedShade[4];
+	flat float	LODBase;
+} gs_out;
+
+vec3	inFaceNormal;
+vec4	inColour;
+float	inTextureNP;
+
+float Word(int index)
+{
+	return uintBitsToFloat(vertexData[index]);
+}
+
+void FetchPolyData(int quad)
+{
+#ifdef PACKED_VERTICES
+	uvec4 poly		= texelFetch(polyData, quad);
+	inFaceNormal	= vec3(ivec3(int(poly.x << 16), int(poly.x), int(poly.y << 16)) >> 16) / 32767.0;
+	inTextureNP		= uintBitsToFloat(poly.z);
+	inColour		= vec4((uvec4(poly.w) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu) / 255.0;
+#else
+	int base		= quad * 4 * VERTEX_WORDS;		// face attributes are repeated in every vertex, the first one's are used
+	inFaceNormal	= vec3(Word(base + 10), Word(base + 11), Word(base + 12));
+	inColour		= unpackUnorm4x8(vertexData[base + 13]);
+	inTextureNP		= Word(base + 14);
+#endif
+}
+
+void FetchVertex(int index, out vec4 position, out vec3 normal, out vec2 texCoord, out float fixedShade)
+{
+	int base = index * VERTEX_WORDS;
+#ifdef PACKED_VERTICES
+	uint n		= vertexData[base + 3];
+	position	= vec4(Word(base), Word(base + 1), Word(base + 2), 1.0);
+	normal		= max(vec3(ivec3(int(n << 22), int(n << 12), int(n << 2)) >> 22) / 511.0, -1.0);
+	texCoord	= vec2(Word(base + 4), Word(base + 5));
+	fixedShade	= Word(base + 6);
+#else
+	position	= vec4(Word(base), Word(base + 1), Word(base + 2), Word(base + 3));
+	normal		= vec3(Word(base + 4), Word(base + 5), Word(base + 6));
+	texCoord	= vec2(Word(base + 7), Word(base + 8));
+	fixedShade	= Word(base + 9);
+#endif
+}
+
+mat4 modelMatrix;			// modelMat, or this instance's matrix
+
+mat4 GetModelMatrix()
+{
+	if (instanceBase < 0) {
+		return modelMat;
+	}
+
+	int i = (instanceBase + gl_InstanceID) * 4;
+	return mat4(texelFetch(instanceMats, i), texelFetch(instanceMats, i + 1), texelFetch(instanceMats, i + 2), texelFetch(instanceMats, i + 3));
+}
+
+vec4 GetColour(vec4 colour)
+{
+	vec4 c = colour;
+
+	if(translatorMap) {
+		c.rgb *= 16.0;
+	}
+
+	c.a *= nodeAlpha;
+
+	return c;
+}
+
+//a*b - c*d, computed in a stable fashion (Kahan)
+float DifferenceOfProducts(float a, float b, float c, float d)
+{
+    precise float cd = c * d;
+    precise float err = fma(-c, d, cd);
+    precise float dop = fma(a, b, -cd);
+    return dop + err;
+}
+
+void main(void)
+{
+	modelMatrix = GetModelMatrix();
+
+	// the triangle strip order of the geometry shader, split into 2 triangles
+	//
+	//        1----2                 1----3
+	//        |    |      ===>       | \  |
+	//        |    |                 |  \ |
+	//        0----3                 0----2
+	//
+	int corners[6] = int[]( 1, 0, 2, 2, 0, 3 );
+	int quad = gl_VertexID / 6;
+	int ii = corners[gl_VertexID % 6];
+
+	FetchPolyData(quad);
+
+	vec4 position[4];
+
+	for (int i=0; i<4; i++) {
+		vec4 vertex;
+		vec3 normal;
+		vec2 texCoord;
+		float fixedShade;
+		FetchVertex(quad * 4 + i, vertex, normal, texCoord, fixedShade);
+
+		vec3 viewVertex	= vec3(modelMatrix * vertex);
+		position[i]		= projMat * modelMatrix * vertex;
+
+		float oneOverW			= 1.0 / position[i].w;
+		gs_out.oneOverW[i]		= oneOverW;
+		gs_out.viewVertex[i]	= viewVertex * oneOverW;
+		gs_out.viewNormal[i]	= ((mat3(modelMatrix) * normal) / modelScale) * oneOverW;
+		gs_out.texCoord[i]		= texCoord * oneOverW;
+		gs_out.fixedShade[i]	= fixedShade * oneOverW;
+
+		// flat attributes and back face culling come from the first vertex (all vertices in poly have same value)
+		if (i == 0) {
+			float discardPoly	= dot(viewVertex, mat3(modelMatrix) * inFaceNormal);
+			gs_out.color		= GetColour(inColour);
+			gs_out.LODBase		= -discardPoly * cota * inTextureNP;
+
+			if (discardPoly > 0) {
+				gl_Position = vec4(0.0, 0.0, 0.0, 1.0);		// same point for every vertex of the quad, so nothing is drawn
+				return;
+			}
+		}
+	}
+
+	vec2 v[4];
+	for (int i=0; i<4; i++) {
+		v[i] = position[i].xy * gs_out.oneOverW[i];
+	}
+
+	// precompute crossproducts for all vertex combinations to be looked up in loop below for area computation
+	precise float cross[4][4];
+	for (int i=0; i<4; i++)
+	{
+		cross[i][i] = 0.0;
+		for (int j=i+1; j<4; j++)
+			cross[i][j] = DifferenceOfProducts(position[i].x, position[j].y, position[j].x, position[i].y) / (position[i].w * position[j].w);
+	}
+	for (int i=1; i<4; i++)
+		for (int j=0; j<i; j++)
+			cross[i][j] = -cross[j][i];
+
+	for (int j=0; j<4; j++) {
+		gs_out.v[j] = v[j] - v[ii];
+		int j_next = (j+1) % 4;
+		// compute area via shoelace algorithm BUT divided by w afterwards to improve precision!
+		// in addition also use Kahans algorithm to further improve precision of the 2D crossproducts
+		gs_out.area[j] = cross[j][j_next] + cross[j_next][ii] + cross[ii][j];
+	}
+
+	gl_Position = position[ii];
+}
+
+)glsl";
+
 static const char *fragmentShaderR3DQuads = R"glsl(
 
 #version 450 core
 
 uniform usampler2D textureBank[2];			// entire texture sheet
 
-// texturing
-uniform bool	textureEnabled;
-uniform bool	microTexture;
-uniform float	microTextureMinLOD;
-uniform int		microTextureID;
-uniform ivec4	baseTexInfo;		// x/y are x,y positions in the texture sheet. z/w are with and height
-uniform int		baseTexType;
-uniform bool	textureInverted;
-uniform bool	textureAlpha;
-uniform bool	alphaTest;
-uniform bool	discardAlpha;
-uniform ivec2	textureWrapMode;
-uniform int		texturePage;
-
 // general
-uniform vec3	fogColour;
-uniform vec4	spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
-uniform vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
-uniform vec3	spotColor;			// spotlight RGB color
-uniform vec3	spotFogColor;		// spotlight RGB color on fog
-uniform vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
-uniform bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
-uniform bool	sunClamp;			// not used by daytona and la machine guns
-uniform bool	intensityClamp;		// some games such as daytona and 
-uniform bool	specularEnabled;	// specular enabled
-uniform float	specularValue;		// specular coefficient
-uniform float	shininess;			// specular shininess
-uniform float	fogIntensity;
-uniform float	fogDensity;
-uniform float	fogStart;
-uniform float	fogAttenuation;
-uniform float	fogAmbient;
-uniform bool	fixedShading;
-uniform bool	smoothShading;
-uniform int		hardwareStep;
+uniform bool	discardAlpha;
 uniform int		colourLayer;
-uniform bool	polyAlpha;
 
-// matrices (shared with vertex shader)
-uniform mat4	projMat;
+// per viewport state (layout must match R3DShader::ViewportState)
+layout(std140) uniform ViewportState
+{
+	mat4	projMat;
+	vec4	spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
+	vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
+	vec3	fogColour;
+	float	fogDensity;
+	vec3	spotColor;			// spotlight RGB color
+	float	fogStart;
+	vec3	spotFogColor;		// spotlight RGB color on fog
+	float	fogAttenuation;
+	vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
+	float	fogAmbient;
+	float	cota;
+	bool	sunClamp;			// not used by daytona and la machine guns
+	bool	intensityClamp;		// some games such as daytona and 
+	int		hardwareStep;
+};
+
+// per mesh state, one uniform buffer slot per unique state (layout must match R3DShader::MeshState)
+layout(std140) uniform MeshState
+{
+	ivec4	baseTexInfo;		// x/y are x,y positions in the texture sheet. z/w are with and height
+	ivec2	textureWrapMode;
+	int		texturePage;
+	int		microTextureID;
+	int		baseTexType;
+	float	microTextureMinLOD;
+	float	fogIntensity;
+	float	shininess;			// specular shininess
+	float	specularValue;		// specular coefficient
+	bool	textureEnabled;
+	bool	microTexture;
+	bool	textureInverted;
+	bool	textureAlpha;
+	bool	alphaTest;
+	bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
+	bool	specularEnabled;	// specular enabled
+	bool	fixedShading;
+	bool	smoothShading;
+	bool	translatorMap;
+	bool	polyAlpha;
+};
+
+// specialised programs replace the state that selects code paths with constants (see R3DShader::BuildVariant)
+#ifdef STATIC_MESH_STATE
+#define textureEnabled	STATIC_TEXTURE_ENABLED
+#define baseTexType		STATIC_BASE_TEX_TYPE
+#define microTexture	STATIC_MICRO_TEXTURE
+#define textureInverted	STATIC_TEXTURE_INVERTED
+#define textureAlpha	STATIC_TEXTURE_ALPHA
+#define alphaTest		STATIC_ALPHA_TEST
+#define lightEnabled	STATIC_LIGHT_ENABLED
+#define specularEnabled	STATIC_SPECULAR_ENABLED
+#define fixedShading	STATIC_FIXED_SHADING
+#if STATIC_NO_FOG
+#define fogIntensity	0.0
+#endif
+#endif
 
 //interpolated inputs from geometry shader
 
@@ -8,19 +8,71 @@ static const char *vertexShaderR3D = R"glsl(
 // uniforms
 uniform float	modelScale;
 uniform float	nodeAlpha;
-uniform float	cota;
 uniform mat4	modelMat;
-uniform mat4	projMat;
-uniform bool	translatorMap;
+uniform samplerBuffer	instanceMats;	// model matrices of instanced draws, one per instance
+uniform int		instanceBase;		// first matrix of this draw in instanceMats, or -1 to use modelMat
+
+// per viewport state (layout must match R3DShader::ViewportState)
+layout(std140) uniform ViewportState
+{
+	mat4	projMat;
+	vec4	spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
+	vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
+	vec3	fogColour;
+	float	fogDensity;
+	vec3	spotColor;			// spotlight RGB color
+	float	fogStart;
+	vec3	spotFogColor;		// spotlight RGB color on fog
+	float	fogAttenuation;
+	vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
+	float	fogAmbient;
+	float	cota;
+	bool	sunClamp;			// not used by daytona and la machine guns
+	bool	intensityClamp;		// some games such as daytona and 
+	int		hardwareStep;
+};
+
+// per mesh state, one uniform buffer slot per unique state (layout must match R3DShader::MeshState)
+layout(std140) uniform MeshState
+{
+	ivec4	baseTexInfo;		// x/y are x,y positions in the texture sheet. z/w are with and height
+	ivec2	textureWrapMode;
+	int		texturePage;
+	int		microTextureID;
+	int		baseTexType;
+	float	microTextureMinLOD;
+	float	fogIntensity;
+	float	shininess;			// specular shininess
+	float	specularValue;		// specular coefficient
+	bool	textureEnabled;
+	bool	microTexture;
+	bool	textureInverted;
+	bool	textureAlpha;
+	bool	alphaTest;
+	bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
+	bool	specularEnabled;	// specular enabled
+	bool	fixedShading;
+	bool	smoothShading;
+	bool	translatorMap;
+	bool	polyAlpha;
+};
 
 // attributes
 in	vec4	inVertex;
 in  vec3	inNormal;
 in  vec2	inTexCoord;
+in  float	inFixedShade;
+#ifdef PACKED_VERTICES
+uniform usamplerBuffer	polyData;	// face attributes, one texel per poly
+uniform int				polyVerts;
+vec4	inColour;
+vec3	inFaceNormal;				// used to emulate r3d culling 
+float	inTextureNP;
+#else
 in  vec4	inColour;
 in  vec3	inFaceNormal;		// used to emulate r3d culling 
-in  float	inFixedShade;
 in  float	inTextureNP;
+#endif
 
 // outputs to fragment shader
 out vec3	fsViewVertex;
@@ -31,6 +83,18 @@ out float	fsDiscard;			// can't have varying bool (glsl spec)
 out float	fsFixedShade;
 out float	fsLODBase;
 
+mat4 modelMatrix;			// modelMat, or this instance's matrix
+
+mat4 GetModelMatrix()
+{
+	if (instanceBase < 0) {
+		return modelMat;
+	}
+
+	int i = (instanceBase + gl_InstanceID) * 4;
+	return mat4(texelFetch(instanceMats, i), texelFetch(instanceMats, i + 1), texelFetch(instanceMats, i + 2), texelFetch(instanceMats, i + 3));
+}
+
 vec4 GetColour(vec4 colour)
 {
 	vec4 c = colour;
@@ -47,22 +111,37 @@ vec4 GetColour(vec4 colour)
 float CalcBackFace(in vec3 viewVertex)
 {
 	vec3 vt = viewVertex - vec3(0.0);
-	vec3 vn = (mat3(modelMat) * inFaceNormal);
+	vec3 vn = (mat3(modelMatrix) * inFaceNormal);
 
 	// dot product of face normal with view direction
 	return dot(vt, vn);
 }
 
+#ifdef PACKED_VERTICES
+void FetchPolyData()
+{
+	uvec4 poly		= texelFetch(polyData, gl_VertexID / polyVerts);
+	inFaceNormal	= vec3(ivec3(int(poly.x << 16), int(poly.x), int(poly.y << 16)) >> 16) / 32767.0;
+	inTextureNP		= uintBitsToFloat(poly.z);
+	inColour		= vec4((uvec4(poly.w) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu) / 255.0;
+}
+#endif
+
 void main(void)
 {
-	fsViewVertex	= vec3(modelMat * inVertex);
-	fsViewNormal	= (mat3(modelMat) * inNormal) / modelScale;
+	modelMatrix = GetModelMatrix();
+
+#ifdef PACKED_VERTICES
+	FetchPolyData();
+#endif
+	fsViewVertex	= vec3(modelMatrix * inVertex);
+	fsViewNormal	= (mat3(modelMatrix) * inNormal) / modelScale;
 	fsDiscard		= CalcBackFace(fsViewVertex);
 	fsColor    		= GetColour(inColour);
 	fsTexCoord		= inTexCoord;
 	fsFixedShade	= inFixedShade;
 	fsLODBase		= -fsDiscard * cota * inTextureNP;
-	gl_Position		= projMat * modelMat * inVertex;
+	gl_Position		= projMat * modelMatrix * inVertex;
 }
 )glsl";
 
@@ -72,46 +151,70 @@ static const char *fragmentShaderR3D = R"glsl(
 
 uniform usampler2D textureBank[2];			// entire texture sheet
 
-// texturing
-uniform bool	textureEnabled;
-uniform bool	microTexture;
-uniform float	microTextureMinLOD;
-uniform int		microTextureID;
-uniform ivec4	baseTexInfo;		// x/y are x,y positions in the texture sheet. z/w are with and height
-uniform int		baseTexType;
-uniform bool	textureInverted;
-uniform bool	textureAlpha;
-uniform bool	alphaTest;
-uniform bool	discardAlpha;
-uniform ivec2	textureWrapMode;
-uniform int		texturePage;
-
 // general
-uniform vec3	fogColour;
-uniform vec4	spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
-uniform vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
-uniform vec3	spotColor;			// spotlight RGB color
-uniform vec3	spotFogColor;		// spotlight RGB color on fog
-uniform vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
-uniform bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
-uniform bool	sunClamp;			// not used by daytona and la machine guns
-uniform bool	intensityClamp;		// some games such as daytona and 
-uniform bool	specularEnabled;	// specular enabled
-uniform float	specularValue;		// specular coefficient
-uniform float	shininess;			// specular shininess
-uniform float	fogIntensity;
-uniform float	fogDensity;
-uniform float	fogStart;
-uniform float	fogAttenuation;
-uniform float	fogAmbient;
-uniform bool	fixedShading;
-uniform bool	smoothShading;
-uniform int		hardwareStep;
+uniform bool	discardAlpha;
 uniform int		colourLayer;
-uniform bool	polyAlpha;
 
-// matrices (shared with vertex shader)
-uniform mat4	projMat;
+// per viewport state (layout must match R3DShader::ViewportState)
+layout(std140) uniform ViewportState
+{
+	mat4	projMat;
+	vec4	spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
+	vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
+	vec3	fogColour;
+	float	fogDensity;
+	vec3	spotColor;			// spotlight RGB color
+	float	fogStart;
+	vec3	spotFogColor;		// spotlight RGB color on fog
+	float	fogAttenuation;
+	vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
+	float	fogAmbient;
+	float	cota;
+	bool	sunClamp;			// not used by daytona and la machine guns
+	bool	intensityClamp;		// some games such as daytona and 
+	int		hardwareStep;
+};
+
+// per mesh state, one uniform buffer slot per unique state (layout must match R3DShader::MeshState)
+layout(std140) uniform MeshState
+{
+	ivec4	baseTexInfo;		// x/y are x,y positions in the texture sheet. z/w are with and height
+	ivec2	textureWrapMode;
+	int		texturePage;
+	int		microTextureID;
+	int		baseTexType;
+	float	microTextureMinLOD;
+	float	fogIntensity;
+	float	shininess;			// specular shininess
+	float	specularValue;		// specular coefficient
+	bool	textureEnabled;
+	bool	microTexture;
+	bool	textureInverted;
+	bool	textureAlpha;
+	bool	alphaTest;
+	bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
+	bool	specularEnabled;	// specular enabled
+	bool	fixedShading;
+	bool	smoothShading;
+	bool	translatorMap;
+	bool	polyAlpha;
+};
+
+// specialised programs replace the state that selects code paths with constants (see R3DShader::BuildVariant)
+#ifdef STATIC_MESH_STATE
+#define textureEnabled	STATIC_TEXTURE_ENABLED
+#define baseTexType		STATIC_BASE_TEX_TYPE
+#define microTexture	STATIC_MICRO_TEXTURE
+#define textureInverted	STATIC_TEXTURE_INVERTED
+#define textureAlpha	STATIC_TEXTURE_ALPHA
+#define alphaTest		STATIC_ALPHA_TEST
+#define lightEnabled	STATIC_LIGHT_ENABLED
+#define specularEnabled	STATIC_SPECULAR_ENABLED
+#define fixedShading	STATIC_FIXED_SHADING
+#if STATIC_NO_FOG
+#define fogIntensity	0.0
+#endif
+#endif
 
 //interpolated inputs from vertex shader
 in	vec3	fsViewVertex;
@@ -143,7 +246,7 @@ void main()
 	vec4 finalData;
 	vec4 fogData;
 
-	if(fsDiscard > 0) {
+	if(fsDiscard > 0.0) {
 		discard;		//emulate back face culling here
 	}
 	
@@ -1,4 +1,10 @@
 #include "TextureBank.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+static constexpr int mipXBase[] = { 0, 1024, 1536, 1792, 1920, 1984, 2016, 2032, 2040, 2044, 2046, 2047 };
+static constexpr int mipYBase[] = { 0, 512, 768, 896, 960, 992, 1008, 1016, 1020, 1022, 1023 };
 
 New3D::TextureBank::TextureBank()
 {
@@ -12,10 +18,12 @@ New3D::TextureBank::TextureBank()
 	int width = 2048;
 	int height = 1024;
 	int level = 0;
+	size_t size = 2048 * 1024 * sizeof(UINT16);		// the staging buffer
 
 	while (width>=1 && height>=1) {
 
 		glTexImage2D(GL_TEXTURE_2D, level, GL_R16UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);	// allocate storage
+		size += width * height * sizeof(UINT16);
 
 		width	= (width > 1) ? width / 2 : 1;
 		height	= (height > 1) ? height / 2 : 1;
@@ -29,6 +37,9 @@ New3D::TextureBank::TextureBank()
 	}
 
 	m_numLevels = level;
+	m_memoryAccount.SetGPU(size + sizeof(UINT16));		// and the 1x1 level
+
+	glGenBuffers(1, &m_pbo);
 }
 
 New3D::TextureBank::~TextureBank()
@@ -37,6 +48,16 @@ New3D::TextureBank::~TextureBank()
 		glDeleteTextures(1, &m_texID);
 		m_texID = 0;
 	}
+
+	if (m_pbo) {
+		glDeleteBuffers(1, &m_pbo);
+		m_pbo = 0;
+	}
+
+	if (m_mipFbo) {
+		glDeleteFramebuffers(1, &m_mipFbo);
+		m_mipFbo = 0;
+	}
 }
 
 void New3D::TextureBank::AttachMemory(const UINT16* textureRam)
@@ -51,17 +72,185 @@ void New3D::TextureBank::Bind()
 
 void New3D::TextureBank::UploadTextures(int level, int x, int y, int width, int height)
 {
+	Rect rect = { x, y, x + width, y + height };
+
+	auto& rects = m_dirtyRects[level];
+
+	// absorb any queued rectangle that the union covers without sending texels twice or adding empty space
+	for (size_t i = 0; i < rects.size();) {
+
+		Rect u = { std::min(rect.x0, rects[i].x0), std::min(rect.y0, rects[i].y0), std::max(rect.x1, rects[i].x1), std::max(rect.y1, rects[i].y1) };
+
+		if (u.Area() <= rect.Area() + rects[i].Area()) {
+			rect = u;
+			rects[i] = rects.back();
+			rects.pop_back();
+			i = 0;				// the bigger rectangle may now touch ones we have already passed
+		}
+		else {
+			i++;
+		}
+	}
+
+	rects.push_back(rect);
+
+	if (rects.size() > MAX_RECTS) {
+		for (const auto& r : rects) {
+			rect = { std::min(rect.x0, r.x0), std::min(rect.y0, r.y0), std::max(rect.x1, r.x1), std::max(rect.y1, r.y1) };
+		}
+
+		rects.clear();
+		rects.push_back(rect);
+	}
+}
+
+void New3D::TextureBank::FlushUploads()
+{
+	int firstRow = 1024;
+	int lastRow = 0;
+	INT64 queuedArea = 0;
+
+	for (const auto& rects : m_dirtyRects) {
+		for (const auto& r : rects) {
+			firstRow = std::min(firstRow, r.y0);
+			lastRow = std::max(lastRow, r.y1);
+			queuedArea += r.Area();
+		}
+	}
+
+	if (firstRow >= lastRow) {
+		return;				// nothing queued
+	}
+
 	glBindTexture(GL_TEXTURE_2D, m_texID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 2048);		// source rows keep the sheet pitch so every rectangle is one call
+
+	// orphan the staging buffer, last frame's uploads may still be reading from it
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, 2048 * 1024 * sizeof(UINT16), nullptr, GL_STREAM_DRAW);
+
+	GLintptr offset = (GLintptr)firstRow * 2048 * sizeof(UINT16);
+	GLsizeiptr size = (GLsizeiptr)(lastRow - firstRow) * 2048 * sizeof(UINT16);
+
+	auto dst = (UINT16*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+	if (dst) {
+		if (queuedArea >= (INT64)size / (INT64)sizeof(UINT16)) {
+			// covers at least the whole span, as a full resync after loading a state does with every mip level
+			// nested inside level 0, so stage the span in one go rather than rectangle by rectangle
+			memcpy(dst, m_textureRam + (firstRow * 2048), size);
+		}
+		else {
+			dst -= firstRow * 2048;					// so we can index with sheet coordinates
+
+			for (const auto& rects : m_dirtyRects) {
+				for (const auto& r : rects) {
+					for (int i = r.y0; i < r.y1; i++) {
+						memcpy(dst + (i * 2048) + r.x0, m_textureRam + (i * 2048) + r.x0, (r.x1 - r.x0) * sizeof(UINT16));
+					}
+				}
+			}
+		}
+
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		SendRects(nullptr);							// offsets into the bound buffer
+	}
+	else {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		SendRects(m_textureRam);
+	}
+
+	// other renderers upload from client memory with the default unpack state
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	if (m_regenerateMips) {
+		RegenerateMips();
+	}
+
+	for (auto& rects : m_dirtyRects) {
+		rects.clear();
+	}
+}
+
+void New3D::TextureBank::SendRects(const UINT16* src)
+{
+	for (int level = 0; level < MAX_LEVELS; level++) {
+		for (const auto& r : m_dirtyRects[level]) {
+			const GLvoid* pixels = (const GLvoid*)((uintptr_t)src + (((r.y0 * 2048) + r.x0) * sizeof(UINT16)));
+			glTexSubImage2D(GL_TEXTURE_2D, level, r.x0 - mipXBase[level], r.y0 - mipYBase[level], r.x1 - r.x0, r.y1 - r.y0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, pixels);
+			m_texelsUploaded += r.Area();
+		}
+	}
+}
+
+UINT32 New3D::TextureBank::TakeTexelsUploaded()
+{
+	UINT32 texels = m_texelsUploaded;
+	m_texelsUploaded = 0;
+	return texels;
+}
+
+void New3D::TextureBank::RegenerateMips()
+{
+	GLint readFbo = 0, drawFbo = 0;
+	bool scissor = false;
+	bool bound = false;
 
-	static constexpr int mipXBase[] = { 0, 1024, 1536, 1792, 1920, 1984, 2016, 2032, 2040, 2044, 2046, 2047 };
-	static constexpr int mipYBase[] = { 0, 512, 768, 896, 960, 992, 1008, 1016, 1020, 1022, 1023 };
+	for (const auto& r : m_dirtyRects[0]) {
 
-	int subX = x - mipXBase[level];
-	int subY = y - mipYBase[level];
+		// games that send their own mips upload them in the same batch, so only fill in where level 1 is untouched
+		Rect mip = { mipXBase[1] + r.x0 / 2, mipYBase[1] + r.y0 / 2, mipXBase[1] + r.x1 / 2, mipYBase[1] + r.y1 / 2 };
+		bool hasMips = false;
 
-	for (int i = 0; i < height; i++) {
-		glTexSubImage2D(GL_TEXTURE_2D, level, subX, subY + i, width, 1, GL_RED_INTEGER, GL_UNSIGNED_SHORT, m_textureRam + ((y + i) * 2048) + x);
+		for (const auto& m : m_dirtyRects[1]) {
+			if (m.x0 < mip.x1 && mip.x0 < m.x1 && m.y0 < mip.y1 && mip.y0 < m.y1) {
+				hasMips = true;
+				break;
+			}
+		}
+
+		if (hasMips) {
+			continue;
+		}
+
+		if (!bound) {
+			glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFbo);
+			glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFbo);
+			scissor = glIsEnabled(GL_SCISSOR_TEST);
+			glDisable(GL_SCISSOR_TEST);
+
+			if (!m_mipFbo) {
+				glGenFramebuffers(1, &m_mipFbo);
+			}
+
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, m_mipFbo);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_mipFbo);
+			bound = true;
+		}
+
+		// each level is a point sample of the one above, the texel format isn't known here so nothing can be averaged.
+		// stops at a smallest side of 2 like the real3d's own mip chain
+		int x0 = r.x0, y0 = r.y0, x1 = r.x1, y1 = r.y1;
+
+		for (int level = 1; level < m_numLevels && (x1 - x0) >= 4 && (y1 - y0) >= 4; level++) {
+
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texID, level - 1);
+			glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texID, level);
+			glBlitFramebuffer(x0, y0, x1, y1, x0 / 2, y0 / 2, x1 / 2, y1 / 2, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+			x0 /= 2; y0 /= 2; x1 /= 2; y1 /= 2;
+		}
+	}
+
+	if (bound) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+		if (scissor) {
+			glEnable(GL_SCISSOR_TEST);
+		}
 	}
 }
 
@@ -69,3 +258,8 @@ int New3D::TextureBank::GetNumberOfLevels() const
 {
 	return m_numLevels;
 }
+
+void New3D::TextureBank::SetRegenerateMips(bool regenerate)
+{
+	m_regenerateMips = regenerate;
+}
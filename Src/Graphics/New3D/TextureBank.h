@@ -5,6 +5,8 @@
 
 #include "Types.h"
 #include <GL/glew.h>
+#include "Util/MemoryUsage.h"
+#include <vector>
 
 // texture banks are a fixed size
 // 2048x1024 pixels, each pixel is 16bits in size
@@ -19,13 +21,35 @@ namespace New3D {
 
 		void AttachMemory(const UINT16* textureRam);
 		void Bind();
-		void UploadTextures(int level, int x, int y, int width, int height);
+		void UploadTextures(int level, int x, int y, int width, int height);	// queues the area, nothing is sent until FlushUploads()
+		void FlushUploads();
+		UINT32 TakeTexelsUploaded();					// sent by FlushUploads() since the last call
 		int GetNumberOfLevels() const;
+		void SetRegenerateMips(bool regenerate);		// fill in the mips of level 0 uploads that came without any
 
 	private:
+		static constexpr int MAX_LEVELS	= 12;
+		static constexpr int MAX_RECTS	= 256;		// per level, past this the level is sent as one bounding rectangle
+
+		struct Rect
+		{
+			int x0, y0, x1, y1;						// sheet coordinates, x1/y1 exclusive
+
+			int Area() const { return (x1 - x0) * (y1 - y0); }
+		};
+
+		void SendRects(const UINT16* src);
+		void RegenerateMips();
+
 		const UINT16* m_textureRam = nullptr;
 		GLuint m_texID = 0;
+		GLuint m_pbo = 0;							// staging buffer laid out like the 2048x1024 sheet
+		Util::MemoryAccount m_memoryAccount{"New3D textures"};
+		GLuint m_mipFbo = 0;						// only created if mips are regenerated
+		bool m_regenerateMips = false;
 		int m_numLevels = 0;
+		UINT32 m_texelsUploaded = 0;
+		std::vector<Rect> m_dirtyRects[MAX_LEVELS];
 	};
 
 }
@@ -6,6 +6,13 @@ VBO::VBO()
 	m_target	= 0;
 	m_capacity	= 0;
 	m_size		= 0;
+	m_ringPtr	= nullptr;
+	m_segmentSize = 0;
+	m_segment	= 0;
+
+	for (auto& f : m_fences) {
+		f = nullptr;
+	}
 }
 
 void VBO::Create(GLenum target, GLenum usage, GLsizeiptr size, const void* data)
@@ -21,6 +28,70 @@ void VBO::Create(GLenum target, GLenum usage, GLsizeiptr size, const void* data)
 	Bind(false);		// unbind
 }
 
+bool VBO::CreateRing(GLenum target, GLsizeiptr size, GLsizeiptr segmentSize)
+{
+	if (!GLEW_ARB_buffer_storage) {
+		return false;
+	}
+
+	const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &m_id);
+	glBindBuffer(target, m_id);
+	glBufferStorage(target, size + (segmentSize * NumSegments), nullptr, mapFlags | GL_DYNAMIC_STORAGE_BIT);	// dynamic storage so the regular data can still be updated with BufferSubData
+
+	m_ringPtr = (GLubyte*)glMapBufferRange(target, size, segmentSize * NumSegments, mapFlags);
+
+	m_target		= target;
+	m_capacity		= (int)size;
+	m_size			= 0;
+	m_segmentSize	= segmentSize;
+	m_segment		= NumSegments - 1;
+
+	Bind(false);
+
+	if (!m_ringPtr) {
+		Destroy();
+		return false;
+	}
+
+	return true;
+}
+
+void* VBO::MapSegment()
+{
+	if (!m_ringPtr) {
+		return nullptr;
+	}
+
+	m_segment = (m_segment + 1) % NumSegments;
+
+	GLsync& fence = m_fences[m_segment];
+	if (fence) {
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}	// 1 ms
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	return m_ringPtr + (m_segmentSize * m_segment);
+}
+
+GLintptr VBO::GetSegmentOffset() const
+{
+	return m_capacity + (m_segmentSize * m_segment);
+}
+
+void VBO::FenceSegment()
+{
+	if (m_ringPtr) {
+		// the segment can be drawn from again without being mapped in between, replacing the earlier fence
+		if (m_fences[m_segment]) {
+			glDeleteSync(m_fences[m_segment]);
+		}
+		m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
 void VBO::BufferSubData(GLintptr offset, GLsizeiptr size, const GLvoid* data)
 {
 	glBufferSubData(m_target, offset, size, data);
@@ -50,7 +121,20 @@ void VBO::Reset()
 
 void VBO::Destroy()
 {
+	for (auto& f : m_fences) {
+		if (f) {
+			glDeleteSync(f);
+			f = nullptr;
+		}
+	}
+
 	if (m_id) {
+		if (m_ringPtr) {
+			glBindBuffer(m_target, m_id);
+			glUnmapBuffer(m_target);
+			glBindBuffer(m_target, 0);
+			m_ringPtr = nullptr;
+		}
 		glDeleteBuffers(1, &m_id);
 		m_id		= 0;
 		m_target	= 0;
@@ -78,3 +162,13 @@ int VBO::GetCapacity() const
 {
 	return m_capacity;
 }
+
+GLsizeiptr VBO::GetStorageSize() const
+{
+	return m_capacity + (m_ringPtr ? m_segmentSize * NumSegments : 0);
+}
+
+GLuint VBO::GetID() const
+{
+	return m_id;
+}
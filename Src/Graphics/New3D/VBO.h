@@ -6,9 +6,15 @@
 class VBO
 {
 public:
+	static const int NumSegments = 3;		// ring segments after the regular data
+
 	VBO();
 
 	void Create			(GLenum target, GLenum usage, GLsizeiptr size, const void* data=nullptr);
+	bool CreateRing		(GLenum target, GLsizeiptr size, GLsizeiptr segmentSize);	// returns false if persistent mapping isn't supported
+	void* MapSegment	();		// next ring segment, waits until the GPU has finished with it. Returns nullptr if not a ring
+	GLintptr GetSegmentOffset() const;
+	void FenceSegment	();		// call once all draws using the current segment have been issued
 	void BufferSubData	(GLintptr offset, GLsizeiptr size, const GLvoid* data);
 	bool AppendData		(GLsizeiptr size, const GLvoid* data);
 	void Reset			();		// don't delete data, just go back to start
@@ -16,12 +22,20 @@ public:
 	void Bind			(bool enable);
 	int  GetSize		() const;
 	int  GetCapacity	() const;
+	GLsizeiptr GetStorageSize() const;		// capacity plus the ring segments
+	GLuint GetID		() const;
 
 private:
 	GLuint		m_id;
 	GLenum		m_target;
 	int			m_capacity;
 	int			m_size;
+
+	// persistently mapped ring of segments following the regular data
+	GLubyte*	m_ringPtr;
+	GLsizeiptr	m_segmentSize;
+	int			m_segment;
+	GLsync		m_fences[NumSegments];
 };
 
 #endif
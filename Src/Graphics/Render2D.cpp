@@ -290,6 +290,7 @@
 #include "Supermodel.h"
 #include "Shader.h"
 #include "Shaders2D.h" // fragment and vertex shaders
+#include "IRender3D.h"
 
 /******************************************************************************
  Frame Display Functions
@@ -352,38 +353,191 @@ void CRender2D::DrawSurface(GLuint textureID)
 	}
 }
 
+// Blend both surfaces and the 3D layers into the target in one pass
+void CRender2D::DrawComposite(void)
+{
+	GLuint layers3D[3];
+	bool alphaLayers = false;
+	m_render3D->GetCompositeLayers(layers3D, &alphaLayers);
+
+	if (m_aaTarget) {
+		glBindFramebuffer(GL_FRAMEBUFFER, m_aaTarget);	// set target if needed
+	}
+
+	glDisable	(GL_DEPTH_TEST);
+	glDisable	(GL_BLEND);								// the shader blends the layers, and the target was cleared by the bottom pass
+	glViewport	(0, 0, m_totalXPixels, m_totalYPixels);	// the scissor box still limits it to the display area
+
+	const GLuint textures[] = { m_textureIDs[0], m_textureIDs[1], layers3D[0], layers3D[1], layers3D[2] };
+	for (int i = 0; i < (int)std::size(textures); i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	// viewports the surfaces would have been drawn to by Setup2D()
+	float x = (float)m_xOffset - (float)m_correction;
+	float y = (float)(m_yOffset + m_correction);
+	bool stretchBottom = m_config["WideBackground"].ValueAs<bool>();
+
+	m_compositeShader.EnableShader();
+	glUniform1i(m_compositeShader.uniformLocMap["alphaLayers"], alphaLayers ? 1 : 0);
+	if (stretchBottom) {
+		glUniform4f(m_compositeShader.uniformLocMap["bottomRect"], 0.0f, 0.0f, (float)m_totalXPixels, (float)m_totalYPixels);
+	}
+	else {
+		glUniform4f(m_compositeShader.uniformLocMap["bottomRect"], x, y, (float)m_xPixels, (float)m_yPixels);
+	}
+	glUniform4f(m_compositeShader.uniformLocMap["topRect"], x, y, (float)m_xPixels, (float)m_yPixels);
+
+	glBindVertexArray	(m_vao);
+	glDrawArrays		(GL_TRIANGLE_STRIP, 0, 4);
+	glBindVertexArray	(0);
+
+	m_compositeShader.DisableShader();
+
+	if (m_aaTarget) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);			// restore target if needed
+	}
+}
+
 void CRender2D::BeginFrame(void)
 {
 }
 
+// Upload the VRAM and palette pages that changed since they were last uploaded
+void CRender2D::UploadTileRAM(void)
+{
+	for (int page = 0; page < TileGenRAM::NumPages; ) {
+		if (m_tileRAM->pageVersion[page] == m_uploadedPageVersion[page]) {
+			page++;
+			continue;
+		}
+
+		// runs must not cross from VRAM into the palettes
+		int first = page;
+		int last = page < TileGenRAM::VRAMPages ? TileGenRAM::VRAMPages : TileGenRAM::NumPages;
+		for (; page < last && m_tileRAM->pageVersion[page] != m_uploadedPageVersion[page]; page++) {
+			m_uploadedPageVersion[page] = m_tileRAM->pageVersion[page];
+		}
+
+		if (first < TileGenRAM::VRAMPages) {
+			glBindTexture(GL_TEXTURE_2D, m_vramTexture);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, TileGenRAM::PageWords, page - first, GL_RED_INTEGER, GL_UNSIGNED_INT, m_tileRAM->GetPage(first));
+		}
+		else {
+			glBindTexture(GL_TEXTURE_2D, m_paletteTexture);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first - TileGenRAM::VRAMPages, TileGenRAM::PageWords, page - first, GL_RGBA, GL_UNSIGNED_BYTE, m_tileRAM->GetPage(first));
+		}
+	}
+}
+
+// Resolve the tile map layers into the bottom and top surface textures
+void CRender2D::DrawTilemaps(void)
+{
+	GLint prevFBO;
+	GLint viewport[4];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+
+	glDisable			(GL_SCISSOR_TEST);
+	glDisable			(GL_BLEND);
+	glViewport			(0, 0, 496, 384);
+
+	m_tileShader.EnableShader();
+	glUniform1uiv		(m_tileShader.uniformLocMap["regs"], 64, m_tileRAM->regs);
+
+	glActiveTexture		(GL_TEXTURE1);
+	glBindTexture		(GL_TEXTURE_2D, m_paletteTexture);
+	glActiveTexture		(GL_TEXTURE0);
+	glBindTexture		(GL_TEXTURE_2D, m_vramTexture);
+	glBindVertexArray	(m_vao);
+
+	for (int i = 0; i < 2; i++) {
+		glBindFramebuffer	(GL_FRAMEBUFFER, m_tileFBOs[i]);
+		glUniform1i			(m_tileShader.uniformLocMap["topSurface"], i);
+		glDrawArrays		(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	glBindVertexArray	(0);
+	m_tileShader.DisableShader();
+
+	glBindFramebuffer	(GL_FRAMEBUFFER, prevFBO);
+	glViewport			(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if (scissor) {
+		glEnable(GL_SCISSOR_TEST);
+	}
+}
+
 void CRender2D::PreRenderFrame(void)
 {
+	m_preRenderTimer.Begin();
+
+	if (m_gpuTilemap) {
+		if (m_tileRAM) {
+			UploadTileRAM();
+			DrawTilemaps();
+		}
+		m_preRenderTimer.End();
+		return;
+	}
+
 	glPixelStorei(GL_UNPACK_ROW_LENGTH, 512);	// skip the non viewable data
 
+	// upload only the runs of lines that differ from what the textures already hold
 	for (int i = 0; i < 2; i++) {
 		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i]);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 496, 384, GL_RGBA, GL_UNSIGNED_BYTE, m_drawBuffers[i]->data);
+		for (int y = 0; y < 384; ) {
+			if (m_drawBuffers[i]->lineVersion[y] == m_uploadedVersion[i][y]) {
+				y++;
+				continue;
+			}
+			int first = y;
+			for (; y < 384 && m_drawBuffers[i]->lineVersion[y] != m_uploadedVersion[i][y]; y++) {
+				m_uploadedVersion[i][y] = m_drawBuffers[i]->lineVersion[y];
+			}
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, 496, y - first, GL_RGBA, GL_UNSIGNED_BYTE, m_drawBuffers[i]->GetLine(first));
+		}
 	}
 
 	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	m_preRenderTimer.End();
 }
 
 void CRender2D::RenderFrameBottom(void)
 {
+	m_layerTimers[0].Begin();
 	Setup2D(true);
-	DrawSurface(m_textureIDs[0]);
+	if (!m_render3D) {
+		DrawSurface(m_textureIDs[0]);				// otherwise drawn by the composite
+	}
+	m_layerTimers[0].End();
 }
 
 void CRender2D::RenderFrameTop(void)
 {
-	Setup2D(false);
-	DrawSurface(m_textureIDs[1]);
+	m_layerTimers[1].Begin();
+	if (m_render3D) {
+		DrawComposite();
+	}
+	else {
+		Setup2D(false);
+		DrawSurface(m_textureIDs[1]);
+	}
+	m_layerTimers[1].End();
 }
 
 void CRender2D::EndFrame(void)
 {
 }
 
+UINT32 CRender2D::GetGPUMicros(void) const
+{
+	return m_preRenderTimer.GetMicros() + m_layerTimers[0].GetMicros() + m_layerTimers[1].GetMicros();
+}
+
 
 /******************************************************************************
  Emulation Callbacks
@@ -417,6 +571,44 @@ void CRender2D::AttachDrawBuffers(std::shared_ptr<TileGenBuffer> bottom, std::sh
 	m_drawBuffers[1] = top;
 }
 
+void CRender2D::AttachTileRAM(std::shared_ptr<TileGenRAM> ram)
+{
+	m_tileRAM = ram;
+}
+
+void CRender2D::AttachCompositeLayers(IRender3D* render3D)
+{
+	std::string um = "#define UPSCALEMODE " + std::to_string((int)m_upscaleMode) + '\n';
+
+	if (!m_compositeShader.LoadShaders(s_vertexShader, (std::string(s_fragmentShaderHeader) + um + "#define COMPOSITE\n" + s_fragmentShader + s_compositeFragmentShader).c_str())) {
+		ErrorLog("Unable to load the composite shader, drawing the layers separately.");
+		return;
+	}
+	if (!render3D->SetExternalComposite(true)) {
+		InfoLog("The 3D engine can't composite its layers with the 2D layers, drawing them separately.");
+		m_compositeShader.UnloadShaders();
+		return;
+	}
+
+	m_compositeShader.GetUniformLocationMap("bottom2D");
+	m_compositeShader.GetUniformLocationMap("top2D");
+	m_compositeShader.GetUniformLocationMap("base3D");
+	m_compositeShader.GetUniformLocationMap("trans3D1");
+	m_compositeShader.GetUniformLocationMap("trans3D2");
+	m_compositeShader.GetUniformLocationMap("alphaLayers");
+	m_compositeShader.GetUniformLocationMap("bottomRect");
+	m_compositeShader.GetUniformLocationMap("topRect");
+	m_compositeShader.EnableShader();
+	glUniform1i(m_compositeShader.uniformLocMap["bottom2D"], 0);	// texture units as bound by DrawComposite()
+	glUniform1i(m_compositeShader.uniformLocMap["top2D"], 1);
+	glUniform1i(m_compositeShader.uniformLocMap["base3D"], 2);
+	glUniform1i(m_compositeShader.uniformLocMap["trans3D1"], 3);
+	glUniform1i(m_compositeShader.uniformLocMap["trans3D2"], 4);
+	m_compositeShader.DisableShader();
+
+	m_render3D = render3D;
+}
+
 Result CRender2D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes, unsigned aaTarget, UpscaleMode upscaleMode)
 {
 	// Resolution
@@ -449,6 +641,52 @@ Result CRender2D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsign
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 496, 384, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 	}
 
+	// texture contents are undefined, force a full upload
+	memset(m_uploadedVersion, 0xFF, sizeof(m_uploadedVersion));
+
+	// tile maps resolved on the GPU from raw VRAM
+	m_gpuTilemap = m_config["GPUTilemap"].ValueAsDefault<bool>(false);
+	if (m_gpuTilemap) {
+
+		if (!m_tileShader.LoadShaders(s_vertexShader, (std::string(s_fragmentShaderHeader) + s_tilemapFragmentShader).c_str())) {
+			return ErrorLog("Unable to load the tile map shader.");
+		}
+		m_tileShader.GetUniformLocationMap("vram");
+		m_tileShader.GetUniformLocationMap("palette");
+		m_tileShader.GetUniformLocationMap("regs");
+		m_tileShader.GetUniformLocationMap("topSurface");
+		m_tileShader.EnableShader();
+		glUniform1i(m_tileShader.uniformLocMap["vram"], 0);		// texture unit 0
+		glUniform1i(m_tileShader.uniformLocMap["palette"], 1);	// texture unit 1
+		m_tileShader.DisableShader();
+
+		if (!m_vramTexture) {
+			glGenTextures(1, &m_vramTexture);
+			glGenTextures(1, &m_paletteTexture);
+			glGenFramebuffers(2, m_tileFBOs);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, m_vramTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, TileGenRAM::PageWords, TileGenRAM::VRAMPages, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+		glBindTexture(GL_TEXTURE_2D, m_paletteTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TileGenRAM::PageWords, TileGenRAM::PalettePages, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+		GLint prevFBO;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+		for (int i = 0; i < 2; i++) {
+			glBindFramebuffer(GL_FRAMEBUFFER, m_tileFBOs[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_textureIDs[i], 0);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+
+		memset(m_uploadedPageVersion, 0xFF, sizeof(m_uploadedPageVersion));
+	}
+
 	return Result::OKAY;
 }
 
@@ -476,4 +714,12 @@ CRender2D::~CRender2D(void)
 		glDeleteTextures(1, &t);
 		t = 0;
 	}
+
+	if (m_vramTexture) {
+		glDeleteFramebuffers(2, m_tileFBOs);
+		glDeleteTextures(1, &m_vramTexture);
+		glDeleteTextures(1, &m_paletteTexture);
+		m_vramTexture = 0;
+		m_paletteTexture = 0;
+	}
 }
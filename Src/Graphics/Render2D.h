@@ -34,8 +34,11 @@
 #include "Util/NewConfig.h"
 #include "New3D/GLSLShader.h"
 #include "FBO.h"
+#include "GPUTimer.h"
 #include "../Model3/TileGenBuffer.h"
 
+class IRender3D;
+
   /*
    * CRender2D:
    *
@@ -88,6 +91,14 @@ public:
 	 */
 	void EndFrame(void);
 
+	/*
+	 * GetGPUMicros(void):
+	 *
+	 * Returns the GPU time, in microseconds, of the 2D passes (surface
+	 * upload or tile map drawing, and both layers) of a recent frame.
+	 */
+	UINT32 GetGPUMicros(void) const;
+
 	/*
 	 * WriteVRAM(addr, data):
 	 *
@@ -152,6 +163,30 @@ public:
 	*/
 	void AttachDrawBuffers(std::shared_ptr<TileGenBuffer> bottom, std::shared_ptr<TileGenBuffer> top);
 
+	/*
+	* AttachTileRAM(ram):
+	*
+	* Attaches the raw tile generator memory snapshot to draw the tile maps
+	* from when they are rendered on the GPU (GPUTilemap).
+	*
+	* Parameters:
+	*    ram		Snapshot of VRAM, decoded palettes and registers
+	*/
+	void AttachTileRAM(std::shared_ptr<TileGenRAM> ram);
+
+	/*
+	* AttachCompositeLayers(render3D):
+	*
+	* Composites both surfaces and the 3D layers in a single pass, drawn by
+	* RenderFrameTop(), instead of blending each of them into the frame in a
+	* pass of its own (SinglePassComposite). Must be called after Init().
+	*
+	* Parameters:
+	*    render3D	3D renderer to take the layers from. If it can't leave
+	*				them in textures, the separate passes are kept.
+	*/
+	void AttachCompositeLayers(IRender3D* render3D);
+
 	/*
 	 * Init(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes);
 	 *
@@ -190,6 +225,9 @@ private:
 
 	void	Setup2D			(bool isBottom);
 	void	DrawSurface		(GLuint textureID);
+	void	UploadTileRAM	(void);
+	void	DrawTilemaps	(void);
+	void	DrawComposite	(void);
 
 	// Run-time configuration
 	const Util::Config::Node& m_config;
@@ -207,8 +245,24 @@ private:
 
 	GLuint m_vao;
 	GLuint m_textureIDs[2];
+	UINT32 m_uploadedVersion[2][384];	// line versions currently held by each texture
 	GLSLShader m_drawShader;
 	std::shared_ptr<TileGenBuffer> m_drawBuffers[2];
+	GPUTimer m_preRenderTimer;
+	GPUTimer m_layerTimers[2];			// bottom and top
+
+	// GPU tile map rendering
+	bool m_gpuTilemap = false;
+	GLuint m_vramTexture = 0;			// VRAM, one word per texel
+	GLuint m_paletteTexture = 0;		// decoded palettes
+	GLuint m_tileFBOs[2] = { 0, 0 };	// render targets for the surface textures
+	UINT32 m_uploadedPageVersion[TileGenRAM::NumPages];
+	GLSLShader m_tileShader;
+	std::shared_ptr<TileGenRAM> m_tileRAM;
+
+	// Single pass composite with the 3D layers
+	IRender3D* m_render3D = nullptr;	// layers to composite, or null to draw the surfaces separately
+	GLSLShader m_compositeShader;
 };
 
 
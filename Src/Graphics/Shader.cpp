@@ -44,8 +44,13 @@
 
 #include <new>
 #include <cstdio>
+#include <cstring>
+#include <vector>
 #include <GL/glew.h>
 #include "Supermodel.h"
+#include "Shader.h"
+#include "OSD/FileSystemPath.h"
+#include "Util/Format.h"
 
 
 // Load a source file. Pointer returned must be freed by caller. Returns NULL if failed.
@@ -120,6 +125,13 @@ Result LoadShaderProgram(GLuint *shaderProgramPtr, GLuint *vertexShaderPtr, GLui
 	*shaderProgramPtr	= shaderProgram;
 	*vertexShaderPtr 	= vertexShader;
 	*fragmentShaderPtr 	= fragmentShader;
+
+	// Use the program linked in an earlier run if there is one
+	if (LoadCachedProgram(shaderProgram, { vsSource, fsSource }))
+	{
+		glUseProgram(shaderProgram);
+		goto Quit;
+	}
 	
 	// Attempt to compile vertex shader
 	glShaderSource(vertexShader, 1, (const GLchar **) &vsSource, NULL);
@@ -157,7 +169,10 @@ Result LoadShaderProgram(GLuint *shaderProgramPtr, GLuint *vertexShaderPtr, GLui
 
 	// Enable the shader (if no errors)
 	if (ret == Result::OKAY)
+	{
+		SaveCachedProgram(shaderProgram, { vsSource, fsSource });
 		glUseProgram(shaderProgram);
+	}
 
 	// Clean up and quit 
 Quit:
@@ -179,3 +194,181 @@ void DestroyShaderProgram(GLuint shaderProgram, GLuint vertexShader, GLuint frag
 	glDeleteShader(fragmentShader);
 	glDeleteProgram(shaderProgram);
 }
+
+
+/*
+ * Shader Program Cache
+ *
+ * Each program binary is stored in its own file, named after a hash of
+ * everything the binary depends on:
+ *
+ *		magic		"SMPB"
+ *		version		UINT32
+ *		key			UINT64, the same hash as in the file name
+ *		format		UINT32, binary format reported by the driver
+ *		size		UINT32, size of the binary that follows
+ */
+
+static const char	s_programMagic[4]	= { 'S', 'M', 'P', 'B' };
+static const UINT32	s_programVersion	= 1;
+static bool			s_shaderCache		= true;
+static bool			s_gles				= false;
+
+struct ProgramHeader
+{
+	char	magic[4];
+	UINT32	version;
+	UINT64	key;
+	UINT32	format;
+	UINT32	size;
+};
+
+void EnableGLES(bool enable)
+{
+	s_gles = enable;
+}
+
+bool IsGLES(void)
+{
+	return s_gles;
+}
+
+std::string TranslateShaderSource(const char *source)
+{
+	std::string translated(source);
+	size_t start = translated.find("#version");
+	if (!s_gles || start == std::string::npos)
+		return translated;
+
+	// ES has no default precision for floats in fragment shaders, nor for
+	// most sampler types in any stage
+	static const char *header =
+		"#version 320 es\n"
+		"precision highp float;\n"
+		"precision highp int;\n"
+		"precision highp sampler2D;\n"
+		"precision highp usampler2D;\n"
+		"precision highp sampler2DMS;\n"
+		"precision highp samplerBuffer;\n"
+		"precision highp usamplerBuffer;\n";
+	size_t end = translated.find('\n', start);
+	translated.replace(start, end == std::string::npos ? std::string::npos : end + 1 - start, header);
+	return translated;
+}
+
+void EnableShaderCache(bool enable)
+{
+	s_shaderCache = enable;
+}
+
+static bool ProgramBinariesSupported(void)
+{
+	// Program binaries are core in ES 3.0
+	if (!s_shaderCache || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary || s_gles))
+		return false;
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	return numFormats > 0;
+}
+
+static UINT64 HashString(UINT64 hash, const char *str)
+{
+	// FNV-1a, with the terminating zero included so that sources can't run into each other
+	if (NULL == str)
+		str = "";
+	do
+		hash = (hash ^ UINT8(*str)) * 0x100000001B3ULL;
+	while (*str++);
+	return hash;
+}
+
+static UINT64 ProgramKey(std::initializer_list<const char *> sources)
+{
+	UINT64 hash = 0xCBF29CE484222325ULL;
+	hash = HashString(hash, (const char *) glGetString(GL_VENDOR));
+	hash = HashString(hash, (const char *) glGetString(GL_RENDERER));
+	hash = HashString(hash, (const char *) glGetString(GL_VERSION));
+	for (const char *source : sources)
+		hash = HashString(hash, source);
+	return hash;
+}
+
+static std::string ProgramPath(UINT64 key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "shader-%016llx.bin", (unsigned long long) key);
+	return Util::Format() << FileSystemPath::GetPath(FileSystemPath::Cache) << name;
+}
+
+bool LoadCachedProgram(GLuint program, std::initializer_list<const char *> sources)
+{
+	if (!ProgramBinariesSupported())
+		return false;
+
+	// Whatever happens below, the program will have to be linked from source and should be saved
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	UINT64 key = ProgramKey(sources);
+	FILE *fp = fopen(ProgramPath(key).c_str(), "rb");
+	if (NULL == fp)
+		return false;
+
+	ProgramHeader header;
+	std::vector<UINT8> binary;
+	bool valid = fread(&header, sizeof(header), 1, fp) == 1 && !memcmp(header.magic, s_programMagic, sizeof(s_programMagic)) &&
+		header.version == s_programVersion && header.key == key;
+	if (valid)
+	{
+		binary.resize(header.size);
+		valid = fread(binary.data(), 1, binary.size(), fp) == binary.size();
+	}
+	fclose(fp);
+	if (!valid)
+		return false;
+
+	// The driver may still reject a binary (e.g., after an update that kept the version string), leaving the program unlinked
+	glProgramBinary(program, header.format, binary.data(), GLsizei(binary.size()));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+void SaveCachedProgram(GLuint program, std::initializer_list<const char *> sources)
+{
+	if (!ProgramBinariesSupported())
+		return;
+
+	GLint linked = GL_FALSE, size = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (linked != GL_TRUE || size <= 0)
+		return;
+
+	ProgramHeader header;
+	memcpy(header.magic, s_programMagic, sizeof(s_programMagic));
+	header.version = s_programVersion;
+	header.key = ProgramKey(sources);
+	std::vector<UINT8> binary(size);
+	GLsizei length = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, size, &length, &format, binary.data());
+	if (length <= 0)
+		return;
+	header.format = format;
+	header.size = UINT32(length);
+
+	// Written under another name first, so that other instances starting at the same time never read (or write) half a file
+	std::string path = ProgramPath(header.key);
+	std::string temp = FileSystemPath::GetTempFilePath(path);
+	FILE *fp = fopen(temp.c_str(), "wb");
+	if (NULL == fp)
+		return;
+	bool written = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(binary.data(), 1, header.size, fp) == header.size;
+	written = fclose(fp) == 0 && written;
+	remove(path.c_str());
+	if (!written || rename(temp.c_str(), path.c_str()) != 0)
+	{
+		remove(temp.c_str());
+		DebugLog("Unable to write shader cache file %s.\n", path.c_str());
+	}
+}
@@ -29,6 +29,7 @@
 #define INCLUDED_SHADER_H
 
 #include <GL/glew.h>
+#include <initializer_list>
 #include <string>
 #include "Types.h"
 
@@ -71,5 +72,75 @@ extern Result LoadShaderProgram(GLuint *shaderProgramPtr, GLuint *vertexShaderPt
 extern void DestroyShaderProgram(GLuint shaderProgram, GLuint vertexShader, 
 								 GLuint fragmentShader);
 
+/*
+ * EnableGLES(enable):
+ *
+ * Selects the shading language shaders are compiled as. Shaders are written
+ * for desktop OpenGL; on an OpenGL ES 3.2 context, TranslateShaderSource()
+ * rewrites them for it. Must be called once the context has been created,
+ * before any shader is loaded.
+ */
+extern void EnableGLES(bool enable);
+
+/*
+ * IsGLES():
+ *
+ * Returns:
+ *		True if rendering to an OpenGL ES context, which lacks some desktop
+ *		calls and formats that the renderers then have to avoid.
+ */
+extern bool IsGLES(void);
+
+/*
+ * TranslateShaderSource(source):
+ *
+ * Prepares a shader source for the current context. For OpenGL ES, the
+ * desktop #version directive is replaced with "#version 320 es" followed by
+ * default precisions for every type that needs one. Anything a caller
+ * inserts after the #version line afterwards ends up ahead of these, which
+ * is fine for preprocessor definitions. Otherwise the source is unchanged.
+ *
+ * Parameters:
+ *		source		Shader source. May be empty.
+ *
+ * Returns:
+ *		The source to compile.
+ */
+extern std::string TranslateShaderSource(const char *source);
+
+/*
+ * EnableShaderCache(enable):
+ *
+ * Turns the on-disk cache of linked shader programs on or off. On by default.
+ */
+extern void EnableShaderCache(bool enable);
+
+/*
+ * LoadCachedProgram(program, sources):
+ *
+ * Loads a program linked from the given sources in an earlier run, as saved
+ * by SaveCachedProgram(). The cache is keyed by the sources along with the
+ * OpenGL renderer and driver version, so any change to either misses.
+ *
+ * Parameters:
+ *		program		A newly created program, with nothing attached.
+ *		sources		Source code of all the program's shader stages, in a
+ *					fixed order.
+ *
+ * Returns:
+ *		True if the program was loaded and is ready to use. Otherwise the
+ *		shaders must be compiled and linked as usual, and the program has
+ *		been marked so that its binary can be saved after linking.
+ */
+extern bool LoadCachedProgram(GLuint program, std::initializer_list<const char *> sources);
+
+/*
+ * SaveCachedProgram(program, sources):
+ *
+ * Saves the binary of a program that was just linked from the given sources,
+ * if it linked successfully. Errors are ignored, since the cache is optional.
+ */
+extern void SaveCachedProgram(GLuint program, std::initializer_list<const char *> sources);
+
 
 #endif	// INCLUDED_SHADER_H
@@ -120,6 +120,7 @@ static constexpr char s_fragmentShader[] = R"glsl(
 	}
 	#endif
 
+	#ifndef COMPOSITE
 	void main()
 	{
 		#if (UPSCALEMODE == 3)
@@ -130,6 +131,161 @@ static constexpr char s_fragmentShader[] = R"glsl(
 		fragColor = texture(tex1, fsTexCoord);
 		#endif
 	}
+	#endif
+
+	)glsl";
+
+// Composite fragment shader (SinglePassComposite). Appended to the fragment
+// shader above for its upscale filters. Produces the whole frame in one pass,
+// blending in the same order as the separate passes: bottom surface, 3D opaque
+// layer, 3D translucent layers, top surface.
+static constexpr char s_compositeFragmentShader[] = R"glsl(
+
+	// inputs
+	uniform sampler2D bottom2D;		// 2D surfaces
+	uniform sampler2D top2D;
+	uniform sampler2D base3D;		// 3D layers, the same size as the frame
+	uniform sampler2D trans3D1;
+	uniform sampler2D trans3D2;
+	uniform bool alphaLayers;		// anything was drawn to the translucent layers
+	uniform vec4 bottomRect;		// x, y, width and height of each surface's viewport
+	uniform vec4 topRect;
+
+	vec4 SampleSurface(sampler2D s, vec4 rect)
+	{
+		vec2 uv = (gl_FragCoord.xy - rect.xy) / rect.zw;
+		if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0)))) {
+			return vec4(0.0);
+		}
+		uv.y = 1.0 - uv.y;			// flip upside down
+
+		#if (UPSCALEMODE == 3)
+		return bicubic(s, uv);
+		#elif (UPSCALEMODE == 1)
+		return vec4(biquintic(s, uv).rgb, texture(s, uv).a);
+		#else
+		return texture(s, uv);
+		#endif
+	}
+
+	// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), applied to alpha as well
+	vec4 Blend(vec4 dst, vec4 src)
+	{
+		return (src * src.a) + (dst * (1.0 - src.a));
+	}
+
+	void main()
+	{
+		ivec2 tc = ivec2(gl_FragCoord.xy);
+
+		vec4 colour = Blend(vec4(0.0), SampleSurface(bottom2D, bottomRect));
+		colour = Blend(colour, texelFetch(base3D, tc, 0));
+
+		if (alphaLayers) {
+			vec4 colTrans1 = texelFetch(trans3D1, tc, 0);
+			vec4 colTrans2 = texelFetch(trans3D2, tc, 0);
+
+			// if both transparency layers overlap, the result is opaque
+			if (colTrans1.a * colTrans2.a > 0.0) {
+				colour = vec4(mix(colTrans1.rgb, colTrans2.rgb, (colTrans2.a + (1.0 - colTrans1.a)) / 2.0), 1.0);
+			}
+			else if (colTrans1.a > 0.0) {
+				colour = Blend(colour, colTrans1);
+			}
+			else {
+				colour = Blend(colour, colTrans2);
+			}
+		}
+
+		fragColor = Blend(colour, SampleSurface(top2D, topRect));
+	}
+
+	)glsl";
+
+// Tile map fragment shader (GPUTilemap). Draws one surface (bottom or top) of
+// the tile generator output from raw VRAM, following CTileGen::DrawLine().
+static constexpr char s_tilemapFragmentShader[] = R"glsl(
+
+	// inputs
+	uniform usampler2D vram;		// VRAM, one 32-bit word per texel, 1024 words per row
+	uniform sampler2D palette;		// decoded palettes, 1024 colours per row, A/A' in rows 0-31, B/B' in rows 32-63
+	uniform uint regs[64];			// tile generator registers
+	uniform bool topSurface;		// draw layers above (true) or below (false) the 3D graphics
+
+	// outputs
+	out vec4 fragColor;
+
+	uint ReadVRAM(int wordAddr)
+	{
+		return texelFetch(vram, ivec2(wordAddr & 1023, wordAddr >> 10), 0).r;
+	}
+
+	// 16-bit table entries are stored with the even entry in the upper half of each word
+	uint ReadTable16(int wordBase, int entry)
+	{
+		return (ReadVRAM(wordBase + (entry / 2)) >> uint((1 - (entry % 2)) * 16)) & 0xFFFFu;
+	}
+
+	vec4 DrawLayer(int layer, int x, int y)
+	{
+		uint reg = regs[0x60 / 4 + layer];
+
+		int xScroll = int(reg & 0x3FFu);
+		int yScroll = int((reg >> 16) & 0x1FFu);
+		if ((reg & 0x8000u) != 0u) {
+			xScroll = int(ReadTable16((0xF6000 + (layer * 0x400)) / 4, y));	// line scroll
+		}
+
+		int tx = x + xScroll;
+		int ty = y + yScroll;
+		int tileNumber = (((ty / 8) & 0x3F) * 64) + ((tx / 8) & 0x3F);
+		uint tileData = ReadTable16((0xF8000 + (layer * 0x2000)) / 4, tileNumber);
+		int hFine = tx & 7;
+		int vFine = ty & 7;
+
+		uint colourIndex;
+		if ((regs[0x20 / 4] & (1u << uint(12 + layer))) != 0u) {
+			// 4-bit pixels, 32 bytes per tile
+			int patternOffset = int(((tileData & 0x3FFFu) << 1) | ((tileData >> 15) & 1u)) * 8;
+			uint pattern = ReadVRAM(patternOffset + vFine);
+			colourIndex = (tileData & 0x7FF0u) | ((pattern >> uint((7 - hFine) * 4)) & 0xFu);
+		}
+		else {
+			// 8-bit pixels, 64 bytes per tile
+			int patternOffset = int(tileData & 0x3FFFu) * 16;
+			uint pattern = ReadVRAM(patternOffset + (vFine * 2) + (hFine / 4));
+			colourIndex = (tileData & 0x7F00u) | ((pattern >> uint((3 - (hFine & 3)) * 8)) & 0xFFu);
+		}
+
+		return texelFetch(palette, ivec2(int(colourIndex & 1023u), ((layer / 2) * 32) + int(colourIndex >> 10)), 0);
+	}
+
+	void main()
+	{
+		int x = int(gl_FragCoord.x);
+		int y = int(gl_FragCoord.y);	// texture row 0 is line 0
+
+		vec4 colour = vec4(0.0);
+
+		// layer pair A/A' is drawn last so it covers B/B'
+		for (int pair = 1; pair >= 0; pair--) {
+
+			uint lineMask = (ReadVRAM((0xF7000 / 4) + y) >> uint(pair == 0 ? 16 : 0)) & 0xFFFFu;
+			int layer = (pair * 2) + (((lineMask >> uint(15 - (x / 32))) & 1u) != 0u ? 0 : 1);	// set mask bit selects primary layer
+
+			uint reg = regs[0x60 / 4 + layer];
+			bool above3D = ((regs[0x20 / 4] >> uint(8 + layer)) & 1u) != 0u;
+
+			if ((reg & 0x80000000u) != 0u && above3D == topSurface) {
+				vec4 c = DrawLayer(layer, x, y);
+				if (c.a > 0.0) {
+					colour = c;
+				}
+			}
+		}
+
+		fragColor = colour;
+	}
 
 	)glsl";
 
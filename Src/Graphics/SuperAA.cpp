@@ -1,14 +1,28 @@
 #include "SuperAA.h"
+#include "GPUTimer.h"
 #include <string>
 
-SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors) :
+SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors, bool computeResolve, bool offscreen) :
 	m_aa(aaValue),
 	m_crtcolors(CRTcolors),
+	m_resolve((aaValue > 1) || (CRTcolors != CRTcolor::None) || offscreen),
+	m_presentTarget(0),
+	m_computeResolve(false),
+	m_resolveTex(0),
+	m_resolveFbo(0),
+	m_timerQueries{ 0, 0 },
+	m_timerPending{ false, false },
+	m_timerIndex(0),
+	m_resolveMicros(0),
+	m_frameQueries{ { 0, 0 }, { 0, 0 } },
+	m_framePending{ false, false },
+	m_frameIndex(0),
+	m_frameMicros(0),
 	m_vao(0),
 	m_width(0),
 	m_height(0)
 {
-	if ((m_aa > 1) || (m_crtcolors != CRTcolor::None)) {
+	if (m_resolve) {
 
 		static const char* vertexShader = R"glsl(
 
@@ -39,14 +53,12 @@ SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors) :
 		ccString += std::to_string((int)m_crtcolors);
 		ccString += '\n';
 
-		static const std::string fragmentShader = R"glsl(
+		// shared by the fragment and compute resolves
+		static const std::string resolveFunctions = R"glsl(
 
 		// inputs
 		uniform sampler2D tex1;			// base tex
 
-		// outputs
-		out vec4 fragColor;
-
 		#if (CRTCOLORS == 1)
 		const float cgamma = 2.5; // what is the 'real' gamma/EOTF of a japanese arcade CRT of that time? 2.4 or 2.5 is what the net so far agrees on
 		#elif (CRTCOLORS == 2)
@@ -109,9 +121,9 @@ SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors) :
 									0.9882066217159947);
 		#endif
 
-		vec3 GetTextureValue(sampler2D s)
+		vec3 GetTextureValue(sampler2D s, ivec2 outPos)
 		{
-			ivec2 texPos	= ivec2(gl_FragCoord.xy /*-vec2(0.5)*/) * aa;
+			ivec2 texPos	= outPos * aa;
 			vec3 texColour	= vec3(0.0);
 
 			for(int i=0; i < aa; i++) {
@@ -141,10 +153,8 @@ SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors) :
 				return pow(color * (1.0/1.055) + (0.055/1.055), 2.4);
 		}
 
-		void main()
+		vec3 ApplyCRTColors(vec3 finalColor)
 		{
-			vec3 finalColor = GetTextureValue(tex1);
-
 			#if (CRTCOLORS != 0)
 			{
 				// transform input space to linear space
@@ -159,12 +169,25 @@ SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors) :
 			}
 			#endif
 
-			fragColor = vec4(finalColor, 1.0);
+			return finalColor;
 		}
 
 		)glsl";
 
-		std::string fragmentShaderString = fragmentShaderVersion + aaString + ccString + fragmentShader;
+		static const std::string fragmentShader = R"glsl(
+
+		// outputs
+		out vec4 fragColor;
+
+		void main()
+		{
+			vec3 finalColor = GetTextureValue(tex1, ivec2(gl_FragCoord.xy /*-vec2(0.5)*/));
+			fragColor = vec4(ApplyCRTColors(finalColor), 1.0);
+		}
+
+		)glsl";
+
+		std::string fragmentShaderString = fragmentShaderVersion + aaString + ccString + resolveFunctions + fragmentShader;
 
 		// load shaders
 		m_shader.LoadShaders(vertexShader, fragmentShaderString.c_str());
@@ -179,6 +202,64 @@ SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors) :
 		glBindVertexArray(m_vao);
 		// no states needed since we do it in the shader
 		glBindVertexArray(0);
+
+		// optional compute resolve, each invocation reads the aa x aa block for one output pixel and writes it to an image
+		// that is then blitted to the back buffer
+		if (computeResolve) {
+			if (GLEW_VERSION_4_3 || GLEW_ARB_compute_shader) {
+
+				static const std::string computeShaderVersion = R"glsl(
+					#version 430 core
+
+				)glsl";
+
+				static const std::string computeShader = R"glsl(
+
+				layout(local_size_x = 8, local_size_y = 8) in;
+
+				// outputs
+				layout(rgba8) writeonly uniform image2D outImage;
+
+				void main()
+				{
+					ivec2 outPos = ivec2(gl_GlobalInvocationID.xy);
+					if (any(greaterThanEqual(outPos, imageSize(outImage)))) {
+						return;
+					}
+
+					vec3 finalColor = GetTextureValue(tex1, outPos);
+					imageStore(outImage, outPos, vec4(ApplyCRTColors(finalColor), 1.0));
+				}
+
+				)glsl";
+
+				std::string computeShaderString = computeShaderVersion + aaString + ccString + resolveFunctions + computeShader;
+
+				m_computeResolve = m_computeShader.LoadComputeShader(computeShaderString.c_str());
+				if (m_computeResolve) {
+					m_computeShader.EnableShader();
+					glUniform1i(m_computeShader.GetUniformLocation("tex1"), 0);		// texture unit zero
+					glUniform1i(m_computeShader.GetUniformLocation("outImage"), 0);	// image unit zero
+					m_computeShader.DisableShader();
+				}
+				else {
+					m_computeShader.UnloadShaders();
+					ErrorLog("Unable to build the compute resolve shader, using the fragment shader resolve.");
+				}
+			}
+			else {
+				InfoLog("Compute shaders are not supported, using the fragment shader resolve.");
+			}
+		}
+
+		if (GPUTimer::IsSupported()) {
+			glGenQueries(2, m_timerQueries);
+		}
+	}
+
+	// timestamps rather than GL_TIME_ELAPSED, which can't be nested around the resolve's query
+	if (GPUTimer::IsSupported()) {
+		glGenQueries(4, &m_frameQueries[0][0]);
 	}
 }
 
@@ -186,7 +267,19 @@ SuperAA::SuperAA(int aaValue, CRTcolor CRTcolors) :
 SuperAA::~SuperAA()
 {
 	m_shader.UnloadShaders();
+	m_computeShader.UnloadShaders();
 	m_fbo.Destroy();
+	DestroyResolveTarget();
+
+	if (m_timerQueries[0]) {
+		glDeleteQueries(2, m_timerQueries);
+		m_timerQueries[0] = m_timerQueries[1] = 0;
+	}
+
+	if (m_frameQueries[0][0]) {
+		glDeleteQueries(4, &m_frameQueries[0][0]);
+		m_frameQueries[0][0] = 0;
+	}
 
 	if (m_vao) {
 		glDeleteVertexArrays(1, &m_vao);
@@ -196,31 +289,140 @@ SuperAA::~SuperAA()
 
 void SuperAA::Init(int width, int height)
 {
-	if ((m_aa > 1) || (m_crtcolors != CRTcolor::None)) {
+	if (m_resolve) {
 		m_fbo.Destroy();
 		m_fbo.Create(width * m_aa, height * m_aa);
+		m_memoryAccount.SetGPU((size_t)width * m_aa * height * m_aa * 4 + (m_computeResolve ? (size_t)width * height * 4 : 0));
 
 		m_width = width;
 		m_height = height;
+
+		if (m_computeResolve) {
+			DestroyResolveTarget();
+
+			glGenTextures(1, &m_resolveTex);
+			glBindTexture(GL_TEXTURE_2D, m_resolveTex);
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glGenFramebuffers(1, &m_resolveFbo);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, m_resolveFbo);
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_resolveTex, 0);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		}
 	}
 }
 
+void SuperAA::DestroyResolveTarget()
+{
+	if (m_resolveFbo) {
+		glDeleteFramebuffers(1, &m_resolveFbo);
+		m_resolveFbo = 0;
+	}
+
+	if (m_resolveTex) {
+		glDeleteTextures(1, &m_resolveTex);
+		m_resolveTex = 0;
+	}
+}
+
+void SuperAA::BeginFrame()
+{
+	if (!m_frameQueries[0][0]) {
+		return;		// no timer queries
+	}
+
+	// read back the frame from two frames ago if it's done
+	if (m_framePending[m_frameIndex]) {
+		GLint available = 0;
+		glGetQueryObjectiv(m_frameQueries[m_frameIndex][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 start = 0, end = 0;
+			glGetQueryObjectui64v(m_frameQueries[m_frameIndex][0], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(m_frameQueries[m_frameIndex][1], GL_QUERY_RESULT, &end);
+			m_frameMicros = (UINT32)((end - start) / 1000);
+		}
+		m_framePending[m_frameIndex] = false;
+	}
+
+	glQueryCounter(m_frameQueries[m_frameIndex][0], GL_TIMESTAMP);
+}
+
 void SuperAA::Draw()
 {
-	if ((m_aa > 1) || (m_crtcolors != CRTcolor::None)) {
+	if (m_resolve) {
 		glDisable(GL_DEPTH_TEST);
 		glDisable(GL_STENCIL_TEST);
 		glDisable(GL_SCISSOR_TEST);
 		glDisable(GL_BLEND);
 
+		// the result from two frames ago should be ready by now, don't stall waiting for it if not
+		GLuint query = m_timerQueries[m_timerIndex];
+		if (query && m_timerPending[m_timerIndex]) {
+			GLint available = 0;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+				m_resolveMicros = (UINT32)(nanoseconds / 1000);
+			}
+		}
+		if (query) {
+			glBeginQuery(GL_TIME_ELAPSED, query);
+		}
+
 		glBindTexture(GL_TEXTURE_2D, m_fbo.GetTextureID());
-		glBindVertexArray(m_vao);
-		glViewport(0, 0, m_width, m_height);
-		m_shader.EnableShader();
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		m_shader.DisableShader();
-		glBindVertexArray(0);
+
+		if (m_computeResolve) {
+			m_computeShader.EnableShader();
+			glBindImageTexture(0, m_resolveTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+			glDispatchCompute((m_width + 7) / 8, (m_height + 7) / 8, 1);
+			glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+			m_computeShader.DisableShader();
+
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, m_resolveFbo);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_presentTarget);
+			glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+		else {
+			glBindFramebuffer(GL_FRAMEBUFFER, m_presentTarget);
+			glBindVertexArray(m_vao);
+			glViewport(0, 0, m_width, m_height);
+			m_shader.EnableShader();
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+			m_shader.DisableShader();
+			glBindVertexArray(0);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+
+		if (query) {
+			glEndQuery(GL_TIME_ELAPSED);
+			m_timerPending[m_timerIndex] = true;
+			m_timerIndex ^= 1;
+		}
 	}
+
+	if (m_frameQueries[0][0]) {
+		glQueryCounter(m_frameQueries[m_frameIndex][1], GL_TIMESTAMP);
+		m_framePending[m_frameIndex] = true;
+		m_frameIndex ^= 1;
+	}
+}
+
+UINT32 SuperAA::GetResolveMicros()
+{
+	return m_resolveMicros;
+}
+
+UINT32 SuperAA::GetFrameMicros()
+{
+	return m_frameMicros;
+}
+
+void SuperAA::SetPresentTarget(GLuint fbo)
+{
+	m_presentTarget = fbo;
 }
 
 GLuint SuperAA::GetTargetID()
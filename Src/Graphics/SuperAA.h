@@ -3,6 +3,7 @@
 #include "Supermodel.h"
 #include "FBO.h"
 #include "New3D/GLSLShader.h"
+#include "Util/MemoryUsage.h"
 
 // This class just implements super sampling. Super sampling looks fantastic but is quite expensive.
 // 8x and beyond values can start to eat ridiculous amounts of memory / gpu time, for less and less noticable returns
@@ -13,20 +14,43 @@
 class SuperAA
 {
 public:
-	SuperAA(int aaValue, CRTcolor CRTcolors);
+	SuperAA(int aaValue, CRTcolor CRTcolors, bool computeResolve, bool offscreen);		// computeResolve falls back to the fragment shader if compute shaders are unavailable,
+																						// offscreen always renders to the FBO and resolves into the present target
 	~SuperAA();
 
 	void Init(int width, int height);		// width & height are real window dimensions
-	void Draw();							// this is a no-op if AA is 1 and CRTcolors 0, since we'll be drawing straight on the back buffer anyway
+	void BeginFrame();						// starts timing the frame on the GPU, Draw() ends it
+	void Draw();							// this is a no-op if AA is 1 and CRTcolors 0 (unless offscreen), since we'll be drawing straight on the back buffer anyway
+	void SetPresentTarget(GLuint fbo);		// framebuffer Draw() resolves into (0, the back buffer, by default)
 
 	GLuint GetTargetID();
+	UINT32 GetResolveMicros();				// GPU time of a recent resolve pass (0 if no resolve is done)
+	UINT32 GetFrameMicros();				// GPU time of a recent frame, from BeginFrame() to the end of Draw()
+	int GetAA() const { return m_aa; }
 
 private:
+	void DestroyResolveTarget();
+
 	FBO m_fbo;
 	GLSLShader m_shader;
+	GLSLShader m_computeShader;
 	const int m_aa;
 	const CRTcolor m_crtcolors;
+	const bool m_resolve;					// render to the FBO and resolve it in Draw()
+	GLuint m_presentTarget;
+	bool m_computeResolve;
+	GLuint m_resolveTex;					// compute resolve output, blitted to the back buffer
+	GLuint m_resolveFbo;
+	GLuint m_timerQueries[2];				// alternate frames so results are read a frame late without stalling
+	bool m_timerPending[2];
+	int m_timerIndex;
+	UINT32 m_resolveMicros;
+	GLuint m_frameQueries[2][2];			// start and end timestamps, alternating frames like m_timerQueries
+	bool m_framePending[2];
+	int m_frameIndex;
+	UINT32 m_frameMicros;
 	GLuint m_vao;
 	int m_width;
 	int m_height;
+	Util::MemoryAccount m_memoryAccount{"Supersampling"};
 };
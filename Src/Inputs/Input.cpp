@@ -200,6 +200,11 @@ bool CInput::Configure(bool append, const char *escapeMapping)
 	return true;
 }
 
+void CInput::Hold()
+{
+	prevValue = value;
+}
+
 bool CInput::Changed() const
 {
 	return value != prevValue;
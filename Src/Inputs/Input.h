@@ -188,6 +188,12 @@ public:
 	 */
 	virtual void Poll() = 0;
 
+	/*
+	 * Called instead of Poll() when no input source can have changed since the last poll. The value stays as it is but
+	 * no longer counts as changed. Inputs whose value also depends on time must poll anyway.
+	 */
+	virtual void Hold();
+
 	/*
 	 * Returns true if the value of this input changed during the last poll.
 	 */
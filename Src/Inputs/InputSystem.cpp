@@ -44,6 +44,9 @@
 #include <sstream>
 using namespace std;
 
+// Effects that can be queued per joystick axis (FFConstantForce to FFVibrate)
+static const int NUM_QUEUED_FF_EFFECTS = FFVibrate + 1;
+
 #ifdef DEBUG
 unsigned CInputSystem::totalSrcsAcquired = 0;
 unsigned CInputSystem::totalSrcsReleased = 0;
@@ -428,11 +431,17 @@ CInputSystem::CInputSystem(const char *systemName)
     m_defKeySettings(),
     m_defMseSettings(),
     m_defJoySettings(),
+    m_ffPending(false),
+    m_ffThreadStop(false),
+    m_ffMutex(nullptr),
+    m_ffCondVar(nullptr),
+    m_ffThread(nullptr),
     m_dispX(0),
     m_dispY(0),
     m_dispW(0),
     m_dispH(0),
     m_grabMouse(false),
+    m_changeCount(0),
     name(systemName)
 {
   m_emptySource = new CMultiInputSource();
@@ -441,6 +450,8 @@ CInputSystem::CInputSystem(const char *systemName)
 
 CInputSystem::~CInputSystem()
 {
+  StopForceFeedbackThread();
+
   m_emptySource->Release();
 
   ClearSettings();
@@ -1575,6 +1586,8 @@ bool CInputSystem::Initialize()
   // Create cache to hold input sources
   CreateSourceCache();
 
+  StartForceFeedbackThread();
+
   GrabMouse();
   return true;
 }
@@ -1582,6 +1595,8 @@ bool CInputSystem::Initialize()
 void CInputSystem::SetDisplayGeom(unsigned dispX, unsigned dispY, unsigned dispW, unsigned dispH)
 {
   // Remember display geometry
+  if (dispX != m_dispX || dispY != m_dispY || dispW != m_dispW || dispH != m_dispH)
+    m_changeCount++;
   m_dispX = dispX;
   m_dispY = dispY;
   m_dispW = dispW;
@@ -1824,6 +1839,12 @@ Finish:
   return !cancelled;
 }
 
+bool CInputSystem::GetChangeCount(unsigned *count) const
+{
+  *count = m_changeCount;
+  return false;
+}
+
 void CInputSystem::GrabMouse()
 {
   m_grabMouse = true;
@@ -1842,7 +1863,133 @@ bool CInputSystem::SendForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCm
   const JoyDetails *joyDetails = GetJoyDetails(joyNum);
   if (!joyDetails->hasFFeedback || !joyDetails->axisHasFF[axisNum])
     return false;
-  return ProcessForceFeedbackCmd(joyNum, axisNum, ffCmd);
+  if (!m_ffThread)
+    return ProcessForceFeedbackCmd(joyNum, axisNum, ffCmd);
+
+  // Hand the command to the force feedback thread, as the device may block for a while. Only the latest value of each
+  // effect matters, so a command replaces any earlier one for the same effect that has not been applied yet.
+  m_ffMutex->Lock();
+  if (ffCmd.id == FFStop)
+  {
+    // Stopping affects the whole joystick, so it supersedes everything queued for it before now
+    for (int i = 0; i < NUM_JOY_AXES * NUM_QUEUED_FF_EFFECTS; i++)
+      m_ffEffects[joyNum * NUM_JOY_AXES * NUM_QUEUED_FF_EFFECTS + i].pending = false;
+    m_ffStopAxis[joyNum] = axisNum;
+  }
+  else
+  {
+    PendingFFEffect &effect = m_ffEffects[(joyNum * NUM_JOY_AXES + axisNum) * NUM_QUEUED_FF_EFFECTS + ffCmd.id];
+    effect.pending = true;
+    effect.force = ffCmd.force;
+  }
+  m_ffPending = true;
+  m_ffCondVar->Signal();
+  m_ffMutex->Unlock();
+  return true;
+}
+
+void CInputSystem::StartForceFeedbackThread()
+{
+  bool anyFFeedback = false;
+  for (int joyNum = 0; joyNum < m_numJoys; joyNum++)
+    anyFFeedback |= GetJoyDetails(joyNum)->hasFFeedback;
+  if (!anyFFeedback)
+    return;
+
+  m_ffEffects.assign(m_numJoys * NUM_JOY_AXES * NUM_QUEUED_FF_EFFECTS, PendingFFEffect());
+  m_ffStopAxis.assign(m_numJoys, -1);
+  m_ffPending = false;
+  m_ffThreadStop = false;
+  m_ffMutex = CThread::CreateMutex();
+  m_ffCondVar = CThread::CreateCondVar();
+  if (m_ffMutex && m_ffCondVar)
+    m_ffThread = CThread::CreateThread("Force feedback", ForceFeedbackThreadEntry, this);
+  if (nullptr == m_ffThread)
+  {
+    ErrorLog("Unable to create force feedback thread, applying force feedback on the drive board thread instead: %s\n", CThread::GetLastError());
+    StopForceFeedbackThread();
+  }
+}
+
+void CInputSystem::StopForceFeedbackThread()
+{
+  if (m_ffThread)
+  {
+    m_ffMutex->Lock();
+    m_ffThreadStop = true;
+    m_ffCondVar->Signal();
+    m_ffMutex->Unlock();
+    m_ffThread->Wait();
+    delete m_ffThread;
+    m_ffThread = nullptr;
+  }
+  delete m_ffCondVar;
+  m_ffCondVar = nullptr;
+  delete m_ffMutex;
+  m_ffMutex = nullptr;
+}
+
+int CInputSystem::ForceFeedbackThreadEntry(void *data)
+{
+  reinterpret_cast<CInputSystem *>(data)->RunForceFeedbackThread();
+  return 0;
+}
+
+void CInputSystem::RunForceFeedbackThread()
+{
+  struct Command
+  {
+    int joyNum;
+    int axisNum;
+    ForceFeedbackCmd ffCmd;
+  };
+  std::vector<Command> stops;
+  std::vector<Command> effects;
+
+  m_ffMutex->Lock();
+  while (true)
+  {
+    while (!m_ffPending && !m_ffThreadStop)
+      m_ffCondVar->Wait(m_ffMutex);
+    if (!m_ffPending)
+      break;  // stopping, and nothing left to apply
+
+    // Take everything queued so far, then apply it without holding the lock. Commands arriving meanwhile coalesce
+    // again and are picked up once the device has caught up, so it is driven no faster than it accepts them.
+    stops.clear();
+    effects.clear();
+    for (int joyNum = 0; joyNum < m_numJoys; joyNum++)
+    {
+      if (m_ffStopAxis[joyNum] >= 0)
+      {
+        stops.push_back({ joyNum, m_ffStopAxis[joyNum], { FFStop, 0.0f } });
+        m_ffStopAxis[joyNum] = -1;
+      }
+      for (int axisNum = 0; axisNum < NUM_JOY_AXES; axisNum++)
+      {
+        for (int effNum = 0; effNum < NUM_QUEUED_FF_EFFECTS; effNum++)
+        {
+          PendingFFEffect &effect = m_ffEffects[(joyNum * NUM_JOY_AXES + axisNum) * NUM_QUEUED_FF_EFFECTS + effNum];
+          if (effect.pending)
+          {
+            effects.push_back({ joyNum, axisNum, { EForceFeedback(effNum), effect.force } });
+            effect.pending = false;
+          }
+        }
+      }
+    }
+    m_ffPending = false;
+    m_ffMutex->Unlock();
+
+    // A stop only ever precedes the effects still queued, as it discards those sent before it
+    for (const Command &cmd : stops)
+      ProcessForceFeedbackCmd(cmd.joyNum, cmd.axisNum, cmd.ffCmd);
+    for (const Command &cmd : effects)
+      ProcessForceFeedbackCmd(cmd.joyNum, cmd.axisNum, cmd.ffCmd);
+
+    m_ffMutex->Lock();
+  }
+  m_ffMutex->Unlock();
 }
 
 bool CInputSystem::DetectJoystickAxis(unsigned joyNum, unsigned &axisNum, const char *escapeMapping, const char *confirmMapping)
@@ -35,6 +35,10 @@
 #include "MultiInputSource.h"
 #include "Util/NewConfig.h"
 
+class CThread;
+class CMutex;
+class CCondVar;
+
 class CInput;
 class CInputSource;
 
@@ -360,6 +364,20 @@ private:
   // Empty input source
   CMultiInputSource *m_emptySource;
 
+  // Force feedback commands waiting to be applied, coalesced to the latest value of each effect per joystick axis
+  struct PendingFFEffect
+  {
+    bool pending;
+    float force;
+  };
+  std::vector<PendingFFEffect> m_ffEffects;  // indexed by joystick, axis and effect
+  std::vector<int> m_ffStopAxis;             // per joystick, axis that requested a stop or -1 if none
+  bool m_ffPending;
+  bool m_ffThreadStop;
+  CMutex *m_ffMutex;
+  CCondVar *m_ffCondVar;
+  CThread *m_ffThread;
+
   //
   // Helper methods
   //
@@ -515,6 +533,18 @@ private:
    */
   void StoreJoySettings(Util::Config::Node *config, JoySettings *settings);
 
+  /*
+   * Starts the thread that applies force feedback commands, if any joystick supports force feedback.
+   */
+  void StartForceFeedbackThread();
+
+  static int ForceFeedbackThreadEntry(void *data);
+
+  /*
+   * Applies queued force feedback commands until the thread is stopped.
+   */
+  void RunForceFeedbackThread();
+
 protected:
   // Current display geometry
   unsigned m_dispX;
@@ -525,6 +555,9 @@ protected:
   // Flag to indicate if system has grabbed mouse
   bool m_grabMouse;
 
+  // Incremented whenever an input device or the display geometry changes state (see GetChangeCount())
+  unsigned m_changeCount;
+
   /*
    * Constructs an input system with the given name.
    */
@@ -688,6 +721,12 @@ protected:
    */
   virtual bool ProcessForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd) = 0;
 
+  /*
+   * Stops the force feedback thread once it has applied any commands still queued. Subclasses must call this before
+   * closing their joysticks, as the thread calls ProcessForceFeedbackCmd.
+   */
+  void StopForceFeedbackThread();
+
   //
   // Virtual methods subclass can override if required
   //
@@ -841,6 +880,13 @@ public:
    */
   virtual bool Poll() = 0;
 
+  /*
+   * Sets count to a number that changes whenever an input device or the display geometry has changed state since the
+   * previous call to Poll(). Returns false if the input system does not keep track of this, in which case every poll
+   * must be assumed to have changed something.
+   */
+  virtual bool GetChangeCount(unsigned *count) const;
+
   virtual void GrabMouse();
 
   virtual void UngrabMouse();
@@ -233,3 +233,8 @@ void CTriggerInput::Poll()
 		offscreenValue = m_offscreenInput->value;
 	}
 }
+
+void CTriggerInput::Hold()
+{
+	Poll();
+}
@@ -167,6 +167,11 @@ public:
 	 * Polls (updates) the input, updating its trigger value and offscreen value from the switch inputs
 	 */
 	void Poll();
+
+	/*
+	 * Auto-trigger counts down from one poll to the next, so the input is always polled
+	 */
+	void Hold();
 };
 
 #endif	// INCLUDED_INPUTTYPES_H
\ No newline at end of file
@@ -53,6 +53,8 @@ CInputs::CInputs(CInputSystem *system)
 	uiSaveState        = AddSwitchInput("UISaveState",        "Save State",            Game::INPUT_UI, "KEY_F5");
 	uiChangeSlot       = AddSwitchInput("UIChangeSlot",       "Change Save Slot",      Game::INPUT_UI, "KEY_F6");
 	uiLoadState        = AddSwitchInput("UILoadState",        "Load State",            Game::INPUT_UI, "KEY_F7");
+	uiRewind           = AddSwitchInput("UIRewind",           "Rewind",                Game::INPUT_UI, "KEY_F8");
+	uiFastForward      = AddSwitchInput("UIFastForward",      "Fast Forward",          Game::INPUT_UI, "KEY_TAB");
 	uiMusicVolUp       = AddSwitchInput("UIMusicVolUp",       "Increase Music Volume", Game::INPUT_UI, "KEY_F10");
 	uiMusicVolDown     = AddSwitchInput("UIMusicVolDown",     "Decrease Music Volume", Game::INPUT_UI, "KEY_F9");
 	uiSoundVolUp       = AddSwitchInput("UISoundVolUp",       "Increase Sound Volume", Game::INPUT_UI, "KEY_F12");
@@ -63,9 +65,14 @@ CInputs::CInputs(CInputSystem *system)
 	uiDumpInpState     = AddSwitchInput("UIDumpInputState",   "Dump Input State",      Game::INPUT_UI, "KEY_ALT+KEY_U");
 	uiDumpTimings      = AddSwitchInput("UIDumpTimings",      "Dump Frame Timings",    Game::INPUT_UI, "KEY_ALT+KEY_O");
 	uiScreenshot       = AddSwitchInput("UIScreenShot",	      "Screenshot",            Game::INPUT_UI, "KEY_ALT+KEY_S");
+	uiFrameStats       = AddSwitchInput("UIFrameStats",       "Toggle Frame Statistics", Game::INPUT_UI, "KEY_ALT+KEY_G");
+	uiSavePowerPCTrace = AddSwitchInput("UISavePowerPCTrace", "Save PowerPC Trace",    Game::INPUT_UI, "KEY_ALT+KEY_J");
 #ifdef SUPERMODEL_DEBUGGER
 	uiEnterDebugger    = AddSwitchInput("UIEnterDebugger",    "Enter Debugger",        Game::INPUT_UI, "KEY_ALT+KEY_B");
 #endif
+#ifdef SUPERMODEL_TRACE
+	uiSaveTrace        = AddSwitchInput("UISaveTrace",        "Save Trace",            Game::INPUT_UI, "KEY_ALT+KEY_Y");
+#endif
 
 	// Common Controls
 	start[0]           = AddSwitchInput("Start1",   "P1 Start",  Game::INPUT_COMMON, "NONE");
@@ -412,6 +419,7 @@ bool CInputs::Initialize()
 
 void CInputs::LoadFromConfig(const Util::Config::Node &config)
 {
+	m_pollAll = true;
 	m_system->LoadFromConfig(config);
 
 	for (vector<CInput*>::iterator it = m_inputs.begin(); it != m_inputs.end(); ++it)
@@ -428,6 +436,7 @@ void CInputs::StoreToConfig(Util::Config::Node *config)
 
 bool CInputs::ConfigureInputs(const Game &game)
 {
+	m_pollAll = true;
 	m_system->UngrabMouse();
 
 	// Print header and help message
@@ -653,6 +662,7 @@ void CInputs::CalibrateJoysticks()
 
 void CInputs::CalibrateJoystick(int joyNum)
 {
+	m_pollAll = true;
 	const JoyDetails *joyDetails = m_system->GetJoyDetails(joyNum);
 	if (joyDetails == NULL || joyDetails->numAxes == 0)
 	{
@@ -748,16 +758,114 @@ bool CInputs::Poll(const Game *game, unsigned dispX, unsigned dispY, unsigned di
 	if (!m_system->Poll())
 		return false;
 
-	// Poll all UI inputs and all the inputs used by the current game, or all inputs if game is NULL
+	// Poll all UI inputs and all the inputs used by the current game, or all inputs if game is NULL. Which inputs these
+	// are only changes with the game, so they are gathered once rather than tested every frame.
 	uint32_t gameFlags = game ? game->inputs : Game::INPUT_ALL;
-	for (vector<CInput*>::iterator it = m_inputs.begin(); it != m_inputs.end(); ++it)
+	if (m_pollInputs.empty() || gameFlags != m_pollGameFlags)
+	{
+		m_pollInputs.clear();
+		for (CInput *input : m_inputs)
+		{
+			if (input->IsUIInput() || (input->gameFlags & gameFlags))
+				m_pollInputs.push_back(input);
+		}
+		m_pollGameFlags = gameFlags;
+		m_pollAll = true;
+	}
+
+	// If no input device has changed state, every source reads the same as last time and polling the inputs again would
+	// only clear their edges
+	unsigned changeCount = 0;
+	bool changed = !m_system->GetChangeCount(&changeCount) || changeCount != m_pollChangeCount || m_pollAll;
+	m_pollChangeCount = changeCount;
+	m_pollAll = false;
+	for (CInput *input : m_pollInputs)
 	{
-		if ((*it)->IsUIInput() || ((*it)->gameFlags & gameFlags))
-			(*it)->Poll();
+		if (changed)
+			input->Poll();
+		else
+			input->Hold();
 	}
 	return true;
 }
 
+void CInputs::GetPlayerInputs(const Game &game, unsigned player, vector<pair<CInput*, CInput*>> *inputs)
+{
+	// Inputs that come in pairs, one for each player
+	CInput *pairs[][2] =
+	{
+		{ coin[0], coin[1] }, { start[0], start[1] },
+		{ up[0], up[1] }, { down[0], down[1] }, { left[0], left[1] }, { right[0], right[1] },
+		{ punch[0], punch[1] }, { kick[0], kick[1] }, { guard[0], guard[1] }, { escape[0], escape[1] },
+		{ shortPass[0], shortPass[1] }, { longPass[0], longPass[1] }, { shoot[0], shoot[1] },
+		{ gunX[0], gunX[1] }, { gunY[0], gunY[1] }, { trigger[0], trigger[1] },
+		{ analogGunX[0], analogGunX[1] }, { analogGunY[0], analogGunY[1] },
+		{ analogTriggerLeft[0], analogTriggerLeft[1] }, { analogTriggerRight[0], analogTriggerRight[1] }
+	};
+
+	inputs->clear();
+	if (player == 0)
+	{
+		for (CInput *input : m_inputs)
+		{
+			if (input->IsUIInput() || !(input->gameFlags & game.inputs))
+				continue;
+			bool player2 = false;
+			for (auto &p : pairs)
+				player2 |= input == p[1];
+			if (!player2)
+				inputs->push_back(make_pair(input, input));
+		}
+	}
+	else
+	{
+		for (auto &p : pairs)
+		{
+			if (p[1]->gameFlags & game.inputs)
+				inputs->push_back(make_pair(p[0], p[1]));
+		}
+	}
+}
+
+void CInputs::ReadPlayerState(const Game &game, unsigned player, vector<UINT16> *state)
+{
+	vector<pair<CInput*, CInput*>> inputs;
+	GetPlayerInputs(game, player, &inputs);
+	state->clear();
+	for (auto &input : inputs)
+		state->push_back(input.first->value);
+}
+
+void CInputs::WritePlayerState(const Game &game, unsigned player, const vector<UINT16> &state)
+{
+	vector<pair<CInput*, CInput*>> inputs;
+	GetPlayerInputs(game, player, &inputs);
+	for (size_t i = 0; i < inputs.size() && i < state.size(); i++)
+		inputs[i].second->value = state[i];
+	m_pollAll = true;
+}
+
+void CInputs::ReadGameState(const Game &game, vector<UINT16> *state)
+{
+	state->clear();
+	for (CInput *input : m_inputs)
+	{
+		if (!input->IsUIInput() && (input->gameFlags & game.inputs))
+			state->push_back(input->value);
+	}
+}
+
+void CInputs::WriteGameState(const Game &game, const vector<UINT16> &state)
+{
+	size_t i = 0;
+	for (CInput *input : m_inputs)
+	{
+		if (i < state.size() && !input->IsUIInput() && (input->gameFlags & game.inputs))
+			input->value = state[i++];
+	}
+	m_pollAll = true;
+}
+
 void CInputs::DumpState(const Game *game)
 {
 	// Print header
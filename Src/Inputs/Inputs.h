@@ -31,6 +31,7 @@
 #include "InputTypes.h"
 #include "Types.h"
 #include "Util/NewConfig.h"
+#include <utility>
 #include <vector>
 
 class CInputSystem;
@@ -49,6 +50,16 @@ private:
   // Vector of all created inputs
   std::vector<CInput*> m_inputs;
 
+  // Inputs polled for the game flags they were gathered for, in creation order (virtual inputs follow the inputs they are
+  // derived from)
+  std::vector<CInput*> m_pollInputs;
+  uint32_t m_pollGameFlags = 0;
+
+  // Input system change count at the last poll. Unless something changed since then, the inputs are held rather than
+  // polled. m_pollAll forces the next poll after mappings, settings or input values were changed from outside.
+  unsigned m_pollChangeCount = 0;
+  bool m_pollAll = true;
+
   /*
    * Adds a switch input (eg button) to this collection.
    */ 
@@ -79,6 +90,12 @@ private:
   CTriggerInput *AddTriggerInput(const char *id, const char *label, unsigned gameFlags, 
     CSwitchInput *trigger, CSwitchInput *offscreen, UINT16 offVal = 0x00, UINT16 onVal = 0x01);
 
+  /*
+   * Lists the inputs of the given game that the given player controls in netplay, each paired with the input whose value
+   * stands in for it locally (see ReadPlayerState()).
+   */
+  void GetPlayerInputs(const Game &game, unsigned player, std::vector<std::pair<CInput*, CInput*>> *inputs);
+
   void PrintHeader(const char *fmt, ...);
 
   void PrintConfigureInputsHelp();
@@ -92,6 +109,8 @@ public:
   CSwitchInput  *uiSaveState;
   CSwitchInput  *uiChangeSlot;
   CSwitchInput  *uiLoadState;
+  CSwitchInput  *uiRewind;
+  CSwitchInput  *uiFastForward;
   CSwitchInput  *uiMusicVolUp;
   CSwitchInput  *uiMusicVolDown;
   CSwitchInput  *uiSoundVolUp;
@@ -102,9 +121,14 @@ public:
   CSwitchInput  *uiDumpInpState;
   CSwitchInput  *uiDumpTimings;
   CSwitchInput  *uiScreenshot;
+  CSwitchInput  *uiFrameStats;
+  CSwitchInput  *uiSavePowerPCTrace;
 #ifdef SUPERMODEL_DEBUGGER
   CSwitchInput  *uiEnterDebugger;
 #endif
+#ifdef SUPERMODEL_TRACE
+  CSwitchInput  *uiSaveTrace;
+#endif
 
   // Common controls between all games
   CSwitchInput  *coin[2];
@@ -299,6 +323,27 @@ public:
    */
   bool Poll(const Game *game, unsigned dispX, unsigned dispY, unsigned dispW, unsigned dispH);
 
+  /*
+   * Reads the values of the inputs of the given game that the given player (0 or 1) controls in netplay. Every player plays
+   * with their own player 1 controls, and player 0 also has all inputs that are not tied to a player.
+   */
+  void ReadPlayerState(const Game &game, unsigned player, std::vector<UINT16> *state);
+
+  /*
+   * Sets the inputs that the given player controls to a state returned by ReadPlayerState().
+   */
+  void WritePlayerState(const Game &game, unsigned player, const std::vector<UINT16> &state);
+
+  /*
+   * Reads the values of all the inputs of the given game (but not the UI inputs), in a fixed order.
+   */
+  void ReadGameState(const Game &game, std::vector<UINT16> *state);
+
+  /*
+   * Sets the inputs of the given game to a state returned by ReadGameState().
+   */
+  void WriteGameState(const Game &game, const std::vector<UINT16> &state);
+
   /*
    * Prints the current values of the inputs for the given game, or all inputs if game is NULL, to stdout for debugging purposes.
    */
@@ -56,17 +56,7 @@
 void C53C810::SaveState(CBlockFile *SaveState)
 {
   SaveState->NewBlock("53C810", __FILE__);
-  SaveState->Write(Ctx.regs, sizeof(Ctx.regs));
-  SaveState->Write(&Ctx.regTEMP, sizeof(Ctx.regTEMP));
-  SaveState->Write(&Ctx.regDSP, sizeof(Ctx.regDSP));
-  SaveState->Write(&Ctx.regDSPS, sizeof(Ctx.regDSPS));
-  SaveState->Write(&Ctx.regDBC, sizeof(Ctx.regDBC));
-  SaveState->Write(&Ctx.regDCMD, sizeof(Ctx.regDCMD));
-  SaveState->Write(&Ctx.regDCNTL, sizeof(Ctx.regDCNTL));
-  SaveState->Write(&Ctx.regDMODE, sizeof(Ctx.regDMODE));
-  SaveState->Write(&Ctx.regDSTAT, sizeof(Ctx.regDSTAT));
-  SaveState->Write(&Ctx.regDIEN, sizeof(Ctx.regDIEN));
-  SaveState->Write(&Ctx.regISTAT, sizeof(Ctx.regISTAT));
+  SaveState->Write(stateRegions);
 }
 
 void C53C810::LoadState(CBlockFile *SaveState)
@@ -77,17 +67,7 @@ void C53C810::LoadState(CBlockFile *SaveState)
     return;
   }
   
-  SaveState->Read(Ctx.regs, sizeof(Ctx.regs));
-  SaveState->Read(&Ctx.regTEMP, sizeof(Ctx.regTEMP));
-  SaveState->Read(&Ctx.regDSP, sizeof(Ctx.regDSP));
-  SaveState->Read(&Ctx.regDSPS, sizeof(Ctx.regDSPS));
-  SaveState->Read(&Ctx.regDBC, sizeof(Ctx.regDBC));
-  SaveState->Read(&Ctx.regDCMD, sizeof(Ctx.regDCMD));
-  SaveState->Read(&Ctx.regDCNTL, sizeof(Ctx.regDCNTL));
-  SaveState->Read(&Ctx.regDMODE, sizeof(Ctx.regDMODE));
-  SaveState->Read(&Ctx.regDSTAT, sizeof(Ctx.regDSTAT));
-  SaveState->Read(&Ctx.regDIEN, sizeof(Ctx.regDIEN));
-  SaveState->Read(&Ctx.regISTAT, sizeof(Ctx.regISTAT));
+  SaveState->Read(stateRegions);
 }
 
 
@@ -118,7 +98,7 @@ static Result SCRIPTS_Int_IntFly(struct NCR53C810Context *Ctx)
 static Result SCRIPTS_MoveMemory(struct NCR53C810Context *Ctx)
 {
   UINT32    src, dest;
-  unsigned  numBytes, i;
+  unsigned  numBytes, numWords, i;
 
   // Get operands
   src = Ctx->regDSPS;
@@ -129,8 +109,15 @@ static Result SCRIPTS_MoveMemory(struct NCR53C810Context *Ctx)
   DebugLog("53C810: Move Memory %08X -> %08X, %X\n", src, dest, numBytes);
   //if (dest==0x94000000)printf("53C810: Move Memory %08X -> %08X, %X\n", src, dest, numBytes);
 
-  // Perform a 32-bit copy if possible
-  for (i = 0; i < (numBytes/4); i++)
+  // Perform a 32-bit copy if possible, as a single block when the bus can
+  numWords = numBytes / 4;
+  if (numWords && ((src | dest) & 3) == 0 && Ctx->Bus->MoveBlock32(dest, src, numWords, false))
+  {
+    dest += numWords * 4;
+    src += numWords * 4;
+    numWords = 0;
+  }
+  for (i = 0; i < numWords; i++)
   {
     Ctx->Bus->Write32(dest, Ctx->Bus->Read32(src));
     dest += 4;
@@ -513,6 +500,9 @@ C53C810::C53C810(void)
   Ctx.Bus = NULL;
   Ctx.IRQ = NULL;
   scsiIRQ = 0;
+  stateRegions.Add(Ctx.regs, sizeof(Ctx.regs)).Add(&Ctx.regTEMP).Add(&Ctx.regDSP).Add(&Ctx.regDSPS);
+  stateRegions.Add(&Ctx.regDBC).Add(&Ctx.regDCMD).Add(&Ctx.regDCNTL).Add(&Ctx.regDMODE);
+  stateRegions.Add(&Ctx.regDSTAT).Add(&Ctx.regDIEN).Add(&Ctx.regISTAT);
   DebugLog("Built 53C810\n");
 }
 
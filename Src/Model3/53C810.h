@@ -205,6 +205,9 @@ private:
 	// Context (register file)
 	struct NCR53C810Context	Ctx;
 
+	// Registers saved in save states
+	CBlockFile::StateRegions	stateRegions;
+
 	// IRQ identifier for this SCSI controller
 	unsigned	scsiIRQ;
 
@@ -44,18 +44,7 @@
 void C93C46::SaveState(CBlockFile *SaveState)
 {
 	SaveState->NewBlock("93C46", __FILE__);
-	SaveState->Write(regs, sizeof(regs));
-	SaveState->Write(&CS, sizeof(CS));
-	SaveState->Write(&CLK, sizeof(CLK));
-	SaveState->Write(&DI, sizeof(DI));
-	SaveState->Write(&DO, sizeof(DO));
-	SaveState->Write(&bitBufferOut, sizeof(bitBufferOut));
-	SaveState->Write(&bitBufferIn, sizeof(bitBufferIn));
-	SaveState->Write(&bitsOut, sizeof(bitsOut));
-	SaveState->Write(&receiving, sizeof(receiving));
-	SaveState->Write(&addr, sizeof(addr));
-	SaveState->Write(&busyCycles, sizeof(busyCycles));
-	SaveState->Write(&locked, sizeof(locked));
+	SaveState->Write(stateRegions);
 }
 
 void C93C46::LoadState(CBlockFile *SaveState)
@@ -66,18 +55,7 @@ void C93C46::LoadState(CBlockFile *SaveState)
 		return;
 	}
 	
-	SaveState->Read(regs, sizeof(regs));
-	SaveState->Read(&CS, sizeof(CS));
-	SaveState->Read(&CLK, sizeof(CLK));
-	SaveState->Read(&DI, sizeof(DI));
-	SaveState->Read(&DO, sizeof(DO));
-	SaveState->Read(&bitBufferOut, sizeof(bitBufferOut));
-	SaveState->Read(&bitBufferIn, sizeof(bitBufferIn));
-	SaveState->Read(&bitsOut, sizeof(bitsOut));
-	SaveState->Read(&receiving, sizeof(receiving));
-	SaveState->Read(&addr, sizeof(addr));
-	SaveState->Read(&busyCycles, sizeof(busyCycles));
-	SaveState->Read(&locked, sizeof(locked));
+	SaveState->Read(stateRegions);
 }
 
 
@@ -157,7 +135,10 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 			else if ((bitBufferIn&0xFFC00000) == 0x01400000)	// WRITE
 			{
 				if (!locked)
+				{
 					regs[(bitBufferIn>>16)&0x3F] = bitBufferIn&0xFFFF;
+					written = true;
+				}
 				DO = 1;	// ready (write completed)
 				DebugLog("93C46: WRITE %X=%04X (lock=%d)\n", (bitBufferIn>>16)&0x3F, bitBufferIn&0xFFFF, locked);
 			}
@@ -167,6 +148,7 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 				{
 					for (int i = 0; i < 64; i++)
 						regs[i] = bitBufferIn&0xFFFF;
+					written = true;
 				}
 				DO = 1;
 				DebugLog("93C46: WRALL %04X (lock=%d)\n", bitBufferIn&0xFFFF, locked);
@@ -174,7 +156,10 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 			else if ((bitBufferIn&0xFFFFFFC0) == 0x1C0)			// ERASE
 			{
 				if (!locked)
+				{
 					regs[bitBufferIn&0x3F] = 0xFFFF;
+					written = true;
+				}
 				DO = 1;
 				DebugLog("93C46: ERASE %X (lock=%d)\n", bitBufferIn&0x3F, locked);
 			}
@@ -184,6 +169,7 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 				{
 					for (int i = 0; i < 64; i++)
 						regs[i] = 0xFFFF;
+					written = true;
 					DebugLog("93C46: ERALL (lock=%d)\n", locked);
 				}
 				DO = 1;
@@ -232,6 +218,13 @@ void C93C46::Clear(void)
 	memset(regs, 0xFF, sizeof(regs));
 }
 
+bool C93C46::CheckWritten(void)
+{
+	bool wasWritten = written;
+	written = false;
+	return wasWritten;
+}
+
 void C93C46::Reset(void)
 {
 	receiving = true;
@@ -256,6 +249,10 @@ void C93C46::Init(void)
 C93C46::C93C46(void)
 {	
 	memset(regs, 0xFF, sizeof(regs));	
+	written = false;
+	stateRegions.Add(regs, sizeof(regs)).Add(&CS).Add(&CLK).Add(&DI).Add(&DO);
+	stateRegions.Add(&bitBufferOut).Add(&bitBufferIn).Add(&bitsOut).Add(&receiving);
+	stateRegions.Add(&addr).Add(&busyCycles).Add(&locked);
 	DebugLog("Built 93C46 EEPROM\n");
 }
 
@@ -65,6 +65,17 @@ public:
 	 * Clears the EEPROM contents by writing all 1's.
 	 */
 	void Clear(void);
+
+	/*
+	 * CheckWritten(void):
+	 *
+	 * Returns whether the memory has been written to since the last call,
+	 * and clears the flag.
+	 *
+	 * Returns:
+	 *		True if a write or erase command was carried out.
+	 */
+	bool CheckWritten(void);
 	
 	/*
 	 * Write(pinCS, pinCLK, pinDI):
@@ -123,6 +134,10 @@ private:
 	unsigned	addr;			// latched address
 	int			busyCycles;		// when > 0, counts down delay cycles and indicates busy
 	bool		locked;			// whether the EEPROM is in a locked state
+
+	CBlockFile::StateRegions	stateRegions;	// the above, as saved in save states
+
+	bool		written;		// whether the memory was written since the last CheckWritten()
 };
 
 
@@ -101,17 +101,7 @@ void CCrypto::SaveState(CBlockFile *SaveState)
   if (!key)
     return; // no security board
   SaveState->NewBlock("Sega 315-5881", __FILE__);	
-	SaveState->Write(buffer.get(), BUFFER_SIZE);
-	SaveState->Write(line_buffer.get(), LINE_SIZE);
-	SaveState->Write(line_buffer_prev.get(), LINE_SIZE);
-	SaveState->Write(&prot_cur_address, sizeof(prot_cur_address));
-	SaveState->Write(&subkey, sizeof(subkey));
-	SaveState->Write(&enc_ready, sizeof(enc_ready));
-	SaveState->Write(&dec_hist, sizeof(dec_hist));
-	SaveState->Write(&dec_header, sizeof(dec_header));
-	SaveState->Write(&buffer_pos, sizeof(buffer_pos));
-	SaveState->Write(&line_buffer_pos, sizeof(line_buffer_pos));
-	SaveState->Write(&line_buffer_size, sizeof(line_buffer_size));
+	SaveState->Write(state_regions);
 }
 
 void CCrypto::LoadState(CBlockFile *SaveState)
@@ -124,17 +114,8 @@ void CCrypto::LoadState(CBlockFile *SaveState)
 		ErrorLog("Unable to load security board encryption device state. Save state file is corrupt.");
 		return;
 	}
-	SaveState->Read(buffer.get(), BUFFER_SIZE);
-	SaveState->Read(line_buffer.get(), LINE_SIZE);
-	SaveState->Read(line_buffer_prev.get(), LINE_SIZE);
-	SaveState->Read(&prot_cur_address, sizeof(prot_cur_address));
-	SaveState->Read(&subkey, sizeof(subkey));
-	SaveState->Read(&enc_ready, sizeof(enc_ready));
-	SaveState->Read(&dec_hist, sizeof(dec_hist));
-	SaveState->Read(&dec_header, sizeof(dec_header));
-	SaveState->Read(&buffer_pos, sizeof(buffer_pos));
-	SaveState->Read(&line_buffer_pos, sizeof(line_buffer_pos));
-	SaveState->Read(&line_buffer_size, sizeof(line_buffer_size));
+	SaveState->Read(state_regions);
+	build_sequence_key_tables();
 }
 
 void CCrypto::Init(uint32_t encryptionKey, std::function<uint16_t(uint32_t)> ReadRAMCallback)
@@ -143,6 +124,11 @@ void CCrypto::Init(uint32_t encryptionKey, std::function<uint16_t(uint32_t)> Rea
 	line_buffer = std::make_unique<UINT8[]>(LINE_SIZE);
 	line_buffer_prev = std::make_unique<UINT8[]>(LINE_SIZE);
 
+	state_regions = CBlockFile::StateRegions();
+	state_regions.Add(buffer.get(), BUFFER_SIZE).Add(line_buffer.get(), LINE_SIZE).Add(line_buffer_prev.get(), LINE_SIZE);
+	state_regions.Add(&prot_cur_address).Add(&subkey).Add(&enc_ready).Add(&dec_hist).Add(&dec_header);
+	state_regions.Add(&buffer_pos).Add(&line_buffer_pos).Add(&line_buffer_size);
+
 	m_read = ReadRAMCallback;
 	//m_read.bind_relative_to(*owner());
 
@@ -161,6 +147,8 @@ void CCrypto::Init(uint32_t encryptionKey, std::function<uint16_t(uint32_t)> Rea
 */
 
 	key = encryptionKey;
+	build_game_key_tables();
+	build_sequence_key_tables();
 }
 
 void CCrypto::Reset()
@@ -171,6 +159,7 @@ void CCrypto::Reset()
 
 	prot_cur_address = 0;
 	subkey = 0;
+	build_sequence_key_tables();
 	dec_hist = 0;
 	dec_header = 0;
 	enc_ready = false;
@@ -226,7 +215,11 @@ void CCrypto::SetAddressHigh(UINT16 data)
 
 void CCrypto::SetSubKey(UINT16 data)
 {
-	subkey = data;
+	if (subkey != data)
+	{
+		subkey = data;
+		build_sequence_key_tables();
+	}
 	enc_ready = false;
 }
 
@@ -667,114 +660,148 @@ int CCrypto::feistel_function(int input, const struct sbox *sboxes, UINT32 subke
 }
 
 /**************************
-This implementation is an "educational" version. It must be noted that it can be speed-optimized in a number of ways.
-The most evident one is to factor out the parts of the key-scheduling that must only be done once (like the game-key &
-sequence-key parts) as noted in the comments inlined in the function. More sophisticated speed-ups can be gained by
-noticing that the weak key-scheduling would allow to create some pregenerated look-up tables for doing most of the work
-of the function. Even so, it would still be pretty slow, so caching techniques could be a wiser option here.
+The key schedule is split by how often its inputs change. The game-key part is
+done once in Init(), the sequence-key part whenever the sub-key is written. With
+both fixed, every round of the first network depends only on its 8-bit input and
+is reduced to a single 256-entry table. The second network also takes the middle
+result as key material, so its rounds are evaluated from per-round tables of
+gathered sbox inputs and scattered sbox outputs, with the middle-result key
+schedule looked up a byte at a time. The bit swaps are split into byte tables.
 **************************/
 
-UINT16 CCrypto::block_decrypt(UINT32 game_key, UINT16 sequence_key, UINT16 counter, UINT16 data)
+void CCrypto::build_game_key_tables()
 {
-	int j;
-	int aux, aux2;
-	int A, B;
-	int middle_result;
-	UINT32 fn1_subkeys[4];
-	UINT32 fn2_subkeys[4];
+	int j, r, m, k, v;
 
-	/* Game-key scheduling; this could be done just once per game at initialization time */
-	memset(fn1_subkeys, 0, sizeof(UINT32) * 4);
-	memset(fn2_subkeys, 0, sizeof(UINT32) * 4);
+	memset(fn1_game_subkeys, 0, sizeof(fn1_game_subkeys));
+	memset(fn2_game_subkeys, 0, sizeof(fn2_game_subkeys));
 
 	for (j = 0; j < FN1GK; ++j) {
-		if (BIT(game_key, fn1_game_key_scheduling[j][0]) != 0) {
-			aux = fn1_game_key_scheduling[j][1] % 24;
-			aux2 = fn1_game_key_scheduling[j][1] / 24;
-			fn1_subkeys[aux2] ^= (1 << aux);
-		}
+		if (BIT(key, fn1_game_key_scheduling[j][0]) != 0)
+			fn1_game_subkeys[fn1_game_key_scheduling[j][1] / 24] ^= (1 << (fn1_game_key_scheduling[j][1] % 24));
 	}
 
 	for (j = 0; j < FN2GK; ++j) {
-		if (BIT(game_key, fn2_game_key_scheduling[j][0]) != 0) {
-			aux = fn2_game_key_scheduling[j][1] % 24;
-			aux2 = fn2_game_key_scheduling[j][1] / 24;
-			fn2_subkeys[aux2] ^= (1 << aux);
+		if (BIT(key, fn2_game_key_scheduling[j][0]) != 0)
+			fn2_game_subkeys[fn2_game_key_scheduling[j][1] / 24] ^= (1 << (fn2_game_key_scheduling[j][1] % 24));
+	}
+
+	// Second network sbox inputs and outputs, independent of any key
+	for (r = 0; r < 4; ++r) {
+		for (v = 0; v < 256; ++v) {
+			UINT32 gathered = 0;
+			for (m = 0; m < 4; ++m) {
+				int aux = 0;
+				for (k = 0; k < 6; ++k)
+					if (fn2_sboxes[r][m].inputs[k] != -1)
+						aux |= BIT(v, fn2_sboxes[r][m].inputs[k]) << k;
+				gathered |= aux << (6 * m);
+			}
+			fn2_gather[r][v] = gathered;
+		}
+		for (m = 0; m < 4; ++m) {
+			for (v = 0; v < 64; ++v) {
+				int aux = fn2_sboxes[r][m].table[v];
+				int result = 0;
+				for (k = 0; k < 2; ++k)
+					result |= BIT(aux, k) << fn2_sboxes[r][m].outputs[k];
+				fn2_scatter[r][m][v] = result;
+			}
 		}
 	}
-	/********************************************************/
 
-	/* Sequence-key scheduling; this could be done just once per decryption run */
-	for (j = 0; j < 20; ++j) {
-		if (BIT(sequence_key, fn1_sequence_key_scheduling[j][0]) != 0) {
-			aux = fn1_sequence_key_scheduling[j][1] % 24;
-			aux2 = fn1_sequence_key_scheduling[j][1] / 24;
-			fn1_subkeys[aux2] ^= (1 << aux);
+	// Middle-result key schedule for each value of the low and high byte
+	for (j = 0; j < 2; ++j) {
+		for (v = 0; v < 256; ++v) {
+			memset(fn2_middle_subkeys[j][v], 0, sizeof(fn2_middle_subkeys[j][v]));
+			for (k = 0; k < 8; ++k) {
+				if (BIT(v, k) != 0) {
+					int pos = fn2_middle_result_scheduling[j * 8 + k];
+					fn2_middle_subkeys[j][v][pos / 24] ^= (1 << (pos % 24));
+				}
+			}
 		}
 	}
 
-	for (j = 0; j < 16; ++j) {
-		if (BIT(sequence_key, j) != 0) {
-			aux = fn2_sequence_key_scheduling[j] % 24;
-			aux2 = fn2_sequence_key_scheduling[j] / 24;
-			fn2_subkeys[aux2] ^= (1 << aux);
+	// Bit swaps are linear over disjoint bits, so each byte can be swapped alone
+	for (j = 0; j < 2; ++j) {
+		for (v = 0; v < 256; ++v) {
+			int val = v << (8 * j);
+			counter_swap[j][v] = BITSWAP16(val, 5, 12, 14, 13, 9, 3, 6, 4, 8, 1, 15, 11, 0, 7, 10, 2);
+			data_swap[j][v] = BITSWAP16(val, 14, 3, 8, 12, 13, 7, 15, 4, 6, 2, 9, 5, 11, 0, 1, 10);
+			result_swap[j][v] = BITSWAP16(val, 15, 7, 6, 14, 13, 12, 5, 4, 3, 2, 11, 10, 9, 1, 0, 8);
 		}
 	}
+}
 
-	/**************************************************************/
+void CCrypto::build_sequence_key_tables()
+{
+	int j, r, v;
+	UINT32 fn1_subkeys[4];
 
-	// First Feistel Network
+	memcpy(fn1_subkeys, fn1_game_subkeys, sizeof(fn1_subkeys));
+	memcpy(fn2_subkeys, fn2_game_subkeys, sizeof(fn2_subkeys));
 
-	aux = BITSWAP16(counter, 5, 12, 14, 13, 9, 3, 6, 4, 8, 1, 15, 11, 0, 7, 10, 2);
+	for (j = 0; j < 20; ++j) {
+		if (BIT(subkey, fn1_sequence_key_scheduling[j][0]) != 0)
+			fn1_subkeys[fn1_sequence_key_scheduling[j][1] / 24] ^= (1 << (fn1_sequence_key_scheduling[j][1] % 24));
+	}
 
-	// 1st round
-	B = aux >> 8;
-	A = (aux & 0xff) ^ feistel_function(B, fn1_sboxes[0], fn1_subkeys[0]);
+	for (j = 0; j < 16; ++j) {
+		if (BIT(subkey, j) != 0)
+			fn2_subkeys[fn2_sequence_key_scheduling[j] / 24] ^= (1 << (fn2_sequence_key_scheduling[j] % 24));
+	}
 
-	// 2nd round
-	B ^= feistel_function(A, fn1_sboxes[1], fn1_subkeys[1]);
+	for (r = 0; r < 4; ++r) {
+		for (v = 0; v < 256; ++v)
+			fn1_rounds[r][v] = feistel_function(v, fn1_sboxes[r], fn1_subkeys[r]);
+	}
+}
 
-	// 3rd round
-	A ^= feistel_function(B, fn1_sboxes[2], fn1_subkeys[2]);
+UINT16 CCrypto::block_decrypt(UINT16 counter, UINT16 data)
+{
+	int aux;
+	int A, B;
+	int middle_result;
+	UINT32 subkeys[4];
 
-	// 4th round
-	B ^= feistel_function(A, fn1_sboxes[3], fn1_subkeys[3]);
+	// First Feistel Network
 
-	middle_result = (B << 8) | A;
+	aux = counter_swap[0][counter & 0xff] | counter_swap[1][counter >> 8];
+
+	B = aux >> 8;
+	A = (aux & 0xff) ^ fn1_rounds[0][B];
+	B ^= fn1_rounds[1][A];
+	A ^= fn1_rounds[2][B];
+	B ^= fn1_rounds[3][A];
 
+	middle_result = (B << 8) | A;
 
 	/* Middle-result-key sheduling */
-	for (j = 0; j < 16; ++j) {
-		if (BIT(middle_result, j) != 0) {
-			aux = fn2_middle_result_scheduling[j] % 24;
-			aux2 = fn2_middle_result_scheduling[j] / 24;
-			fn2_subkeys[aux2] ^= (1 << aux);
-		}
-	}
-	/*********************/
+	const UINT32 *mid_lo = fn2_middle_subkeys[0][middle_result & 0xff];
+	const UINT32 *mid_hi = fn2_middle_subkeys[1][middle_result >> 8];
+	for (int r = 0; r < 4; ++r)
+		subkeys[r] = fn2_subkeys[r] ^ mid_lo[r] ^ mid_hi[r];
 
 	// Second Feistel Network
 
-	aux = BITSWAP16(data, 14, 3, 8, 12, 13, 7, 15, 4, 6, 2, 9, 5, 11, 0, 1, 10);
+	aux = data_swap[0][data & 0xff] | data_swap[1][data >> 8];
 
-	// 1st round
-	B = aux >> 8;
-	A = (aux & 0xff) ^ feistel_function(B, fn2_sboxes[0], fn2_subkeys[0]);
-
-	// 2nd round
-	B ^= feistel_function(A, fn2_sboxes[1], fn2_subkeys[1]);
-
-	// 3rd round
-	A ^= feistel_function(B, fn2_sboxes[2], fn2_subkeys[2]);
+	auto feistel2 = [&](int r, int input) -> int
+	{
+		UINT32 x = fn2_gather[r][input] ^ subkeys[r];
+		return fn2_scatter[r][0][x & 0x3f] | fn2_scatter[r][1][(x >> 6) & 0x3f] | fn2_scatter[r][2][(x >> 12) & 0x3f] | fn2_scatter[r][3][(x >> 18) & 0x3f];
+	};
 
-	// 4th round
-	B ^= feistel_function(A, fn2_sboxes[3], fn2_subkeys[3]);
+	B = aux >> 8;
+	A = (aux & 0xff) ^ feistel2(0, B);
+	B ^= feistel2(1, A);
+	A ^= feistel2(2, B);
+	B ^= feistel2(3, A);
 
 	aux = (B << 8) | A;
 
-	aux = BITSWAP16(aux, 15, 7, 6, 14, 13, 12, 5, 4, 3, 2, 11, 10, 9, 1, 0, 8);
-
-	return aux;
+	return result_swap[0][aux & 0xff] | result_swap[1][aux >> 8];
 }
 
 
@@ -784,7 +811,7 @@ UINT16 CCrypto::get_decrypted_16()
 
 	enc = m_read(prot_cur_address);
 
-	UINT16 dec = block_decrypt(key, subkey, prot_cur_address, enc);
+	UINT16 dec = block_decrypt(prot_cur_address, enc);
 	UINT16 res = (dec & 3) | (dec_hist & 0xfffc);
 	dec_hist = dec;
 
@@ -37,8 +37,7 @@
 #include <cstdint>
 #include <memory>
 #include <functional>
-
-class CBlockFile;
+#include "BlockFile.h"
 
 class CCrypto
 {
@@ -57,6 +56,10 @@ public:
 	void SetAddressHigh(uint16_t data);
 	void SetSubKey(uint16_t data);
 
+	// Runs the block cipher alone for the current keys. Only for the micro-benchmarks: Decrypt() can't be fed
+	// arbitrary data, because the decompressor trusts the stream.
+	uint16_t DecryptBlock(uint16_t counter, uint16_t data) { return block_decrypt(counter, data); }
+
 	std::function<uint16_t(uint32_t)> m_read;
 
 	/*
@@ -80,6 +83,8 @@ private:
 
 	bool enc_ready;
 
+	CBlockFile::StateRegions state_regions; // saved in save states
+
 	int buffer_pos, line_buffer_pos, line_buffer_size, buffer_bit, buffer_bit2;
 	uint8_t buffer2[2];
 	uint16_t buffer2a;
@@ -108,8 +113,22 @@ private:
 
 	static const uint8_t trees[9][2][32];
 
+	// Key schedule and round tables (see build_game_key_tables())
+	uint32_t fn1_game_subkeys[4];
+	uint32_t fn2_game_subkeys[4];
+	uint32_t fn2_subkeys[4];                  // game key ^ sequence key
+	uint8_t  fn1_rounds[4][256];              // complete FN1 rounds for current sequence key
+	uint32_t fn2_gather[4][256];              // FN2 sbox inputs, 4 x 6 bits per round
+	uint8_t  fn2_scatter[4][4][64];           // FN2 sbox outputs in result bit positions
+	uint32_t fn2_middle_subkeys[2][256][4];   // middle result key schedule, per byte
+	uint16_t counter_swap[2][256];
+	uint16_t data_swap[2][256];
+	uint16_t result_swap[2][256];
+
 	int feistel_function(int input, const struct sbox *sboxes, uint32_t subkeys);
-	uint16_t block_decrypt(uint32_t game_key, uint16_t sequence_key, uint16_t counter, uint16_t data);
+	void build_game_key_tables();
+	void build_sequence_key_tables();
+	uint16_t block_decrypt(uint16_t counter, uint16_t data);
 
 	uint16_t get_decrypted_16();
 	int get_compressed_bit();
@@ -41,131 +41,172 @@
 
 #include "Supermodel.h"
 #include "Sound/MPEG/MpegAudio.h"
+#include "Util/Trace.h"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSB_X86_SIMD
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define DSB_NEON_SIMD
+#include <arm_neon.h>
+#endif
 
 /******************************************************************************
  Resampler
 
- MPEG Layer 2 audio can be 32, 44.1, or 48 KHz. Here, an up-sampling algorithm
- is provided, which should work for any frequency less than 44.1 KHz and an
- output frequency of 44.1 KHz. Down-sampling is not yet implemented, but would
- work in a similar fashion. The chief difference is that the input index would
- sometimes advance by more than one for a single output sample and the
- fractions, nFrac and pFrac, would sometimes exceed 1.0.
-
- Up-Sampling Description
- -----------------------
-
- Linear interpolation is used to up-sample. Not as accurate as the Shannon
- reconstruction equation but it seems to work quite well.
-
- 1. Linear Interpolation
-
- Input samples for a given frame (here, this means 1/60Hz, not to be confused
- with an MPEG frame, which is shorter) are numbered 0 ... L-1 (L samples in
- total). Output samples are 0 ... M-1.
+ MPEG Layer 2 audio can be 32, 44.1, or 48 KHz. Here, a band-limited resampler
+ is provided which converts any input frequency to the 44.1 KHz output. In
+ practice, all games so far use 32 KHz.
 
- For two adjacent input samples at times p ("previous") and n ("next"), in[p]
- and in[n], and output out[t] at time t, linear interpolation yields:
+ 1. Polyphase Windowed-Sinc Interpolation
 
- 		out[t] = (n-t)/(n-p) * in[p] + (t-p)/(n-p) * in[n]
+ An ideal reconstruction of the input at time t is the sum of every input
+ sample weighted by sinc(t - n). This is truncated to NumTaps input samples
+ around t and tapered with a Blackman window to keep the stop band clean. The
+ cut-off is placed slightly below the lower of the two Nyquist frequencies so
+ that images (up-sampling) or aliases (down-sampling) are suppressed.
 
- Note that (n-p) = 1/fin (fin being the input sampling frequency).
+ Rather than evaluating sinc() per output sample, the fractional position is
+ quantized to one of NumPhases positions between two input samples and a
+ separate, pre-computed set of NumTaps coefficients is kept for each. Each
+ output sample is then a single dot product, which is done 4 taps at a time
+ with SSE or NEON where available. Each phase is normalized to unity gain.
 
- Let pFrac = (n-t)/(n-p) and nFrac = (t-p)/(n-p). As t moves from p to n, pFrac
- moves from 1 to 0 and nFrac from 0 to 1, as we expect.
+ 2. Input History
 
- If we proceed one output sample at a time, we must add the time difference
- between output samples, 1/fout, to t. Call this delta_t. If we divide delta_t
- by (n-p), we can add it directly to nFrac and subtract from pFrac. Therefore:
+ The last NumTaps input samples are kept in a small ring per channel. Every
+ sample is written twice, NumTaps apart, so the window for the current output
+ sample is always contiguous and can be loaded directly. The window is centred
+ between taps NumTaps/2-1 and NumTaps/2, which introduces a fixed delay of
+ NumTaps/2 input samples (0.25 ms at 32 KHz).
 
- 	delta = (1/fout)/(n-p) = fin/fout
-
- What happens when nFrac exceeds 1.0 or pFrac goes below 0.0? That can't
- be allowed to happen -- it means that we've actually moved along the line into
- the region between the next set of samples. We use pFrac < 0 as the condition
- to update the input samples.
-
- It so happens that when fin < fout, pFrac and nFrac will never exceed 1.0. So
- there is no need to check or mask the fixed point values when using them to
- interpolate samples.
-
- 2. Input Buffer Overflows
+ 3. Continuity Between Frames
 
- For some low sampling rates, particularly those that are a factor of 2 or 4
- smaller, it is possible that the very last sample or two needed from the input
- stream will be beyond the end. Fetching two extra samples (which can introduce
- an update lag of two samples -- imperceptible and inconsequential) fixes this,
- and so we do it.
+ Input is consumed one sample at a time as the 16.16 fixed point output
+ position, m_frac, crosses 1.0. The position and history persist across
+ frames, so the next frame continues exactly where the previous one ended. Two
+ extra input samples are decoded per frame. Any input samples left unconsumed
+ when a frame's output is complete (normally two or three) are copied to the
+ beginning of the buffer, and their number is returned so that the buffer
+ update function will know to skip them. This keeps the decoder in step with
+ the output rate.
+******************************************************************************/
 
- 3. Continuity Between Frames
+// Dot product of two NumTaps-long windows. h must be 16-byte aligned.
+template <int N>
+static inline float DotTaps(const float *x, const float *h)
+{
+#if defined(DSB_X86_SIMD)
+	__m128 acc = _mm_mul_ps(_mm_loadu_ps(x), _mm_load_ps(h));
+	for (int k = 4; k < N; k += 4)
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_load_ps(h + k)));
+	acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+	acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+	return _mm_cvtss_f32(acc);
+#elif defined(DSB_NEON_SIMD)
+	float32x4_t acc = vmulq_f32(vld1q_f32(x), vld1q_f32(h));
+	for (int k = 4; k < N; k += 4)
+		acc = vmlaq_f32(acc, vld1q_f32(x + k), vld1q_f32(h + k));
+	float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+	return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+	float acc = 0.0f;
+	for (int k = 0; k < N; k++)
+		acc += x[k] * h[k];
+	return acc;
+#endif
+}
 
- The very last output sample will typically sit somewhere between two input
- samples. It is wrong to start the next frame by assuming everything is lined
- up again. The first sample of the next frame will often have to be interpol-
- ated with the last sample of the previous frame. To facilitate this, we check
- to see how many input samples remain unprocessed when up-sampling is finished,
- and then copy those to the beginning of the buffer. We then return the number
- of samples so that the buffer update function will know to skip them.
+void CDSBResampler::BuildFilter(int outRate, int inRate)
+{
+	const double pi = 3.14159265358979323846;
+	const double halfWidth = NumTaps / 2;
+	double cutoff = 0.9 * std::min(1.0, (double) outRate / (double) inRate);	// relative to input Nyquist
 
- We also must maintain the state of pFrac and nFrac to resume interpolation
- correctly. Therefore, these variables are persistent.
+	for (int p = 0; p < NumPhases; p++)
+	{
+		double frac = (double) p / (double) NumPhases;
+		double sum = 0.0;
+		double taps[NumTaps];
+		for (int k = 0; k < NumTaps; k++)
+		{
+			double d = (double) (k - (NumTaps/2 - 1)) - frac;	// distance of tap from output position
+			double x = pi * cutoff * d;
+			double sinc = (d == 0.0) ? 1.0 : sin(x) / x;
+			double window = 0.42 + 0.5 * cos(pi * d / halfWidth) + 0.08 * cos(2.0 * pi * d / halfWidth);
+			taps[k] = sinc * window;
+			sum += taps[k];
+		}
+		for (int k = 0; k < NumTaps; k++)
+			m_coeffs[p][k] = (float) (taps[k] / sum);
+	}
 
- 4. Fixed Point Arithmetic
+	m_inRate = inRate;
+	m_outRate = outRate;
+}
 
- Fixed point arithmetic is used to track fractions. For such numbers, the low
- 8 bits represent a fraction (0x100 would be 1.0, 0x080 would be 0.5, etc.)
- and the upper bits are the integral portion.
-******************************************************************************/
+inline void CDSBResampler::Push(INT16 left, INT16 right)
+{
+	m_histL[m_histPos] = m_histL[m_histPos + NumTaps] = (float) left;
+	m_histR[m_histPos] = m_histR[m_histPos + NumTaps] = (float) right;
+	m_histPos = (m_histPos + 1) % NumTaps;
+}
 
 void CDSBResampler::Reset(void)
 {
-	// Initial state of fractions (24.8 fixed point)
-	nFrac = 0<<8;	// fraction of next sample to use (0->1.0 as x moves p->n)
-	pFrac = 1<<8;	// previous sample (1.0->0 as x moves p->n)
+	memset(m_histL, 0, sizeof(m_histL));
+	memset(m_histR, 0, sizeof(m_histR));
+	m_histPos = 0;
+	m_frac = 1<<16;	// first output sample pulls in the first input sample
 }
 
 // Mixes audio and returns number of samples copied back to start of buffer (ie. offset at which new samples should be written)
 int CDSBResampler::UpSampleAndMix(float *outL, float *outR, INT16 *inL, INT16 *inR, UINT8 volumeL, UINT8 volumeR, int sizeOut, int sizeIn, int outRate, int inRate)
 {
-	int 	delta = (inRate<<8)/outRate;	// (1/fout)/(1/fin)=fin/fout, 24.8 fixed point
+	UINT32	delta = (UINT32) (((UINT64) inRate << 16) / (UINT64) outRate);	// fin/fout, 16.16 fixed point
 	int		outIdx = 0;
 	int		inIdx = 0;
 	float	v[2], musicVol;
 
+	if (inRate != m_inRate || outRate != m_outRate)
+		BuildFilter(outRate, inRate);
+
 	// Obtain program volume settings
-	musicVol = (float)std::max(0,std::min(200,m_config["MusicVolume"].ValueAs<int>()));
+	musicVol = (float)std::max(0,std::min(200,m_musicVolume.Get()));
 	musicVol = musicVol * (float) (1.0 / 100.0);
 
-	v[0] = musicVol * (float) volumeL * (float) (1.0 / (255.0*256.0)); // 256 is there to correct for fixed point interpolation below
-	v[1] = musicVol * (float) volumeR * (float) (1.0 / (255.0*256.0));
+	v[0] = musicVol * (float) volumeL * (float) (1.0 / 255.0);
+	v[1] = musicVol * (float) volumeR * (float) (1.0 / 255.0);
 
-	// Up-sample and mix!
+	// Resample and mix!
 	while (outIdx < sizeOut)
 	{
-		// nFrac, pFrac will never exceed 1.0 (0x100) (only true if delta does not exceed 1)
-		INT32 leftSample  = (int)inL[inIdx]*pFrac+(int)inL[inIdx+1]*nFrac;	// left channel
-		INT32 rightSample = (int)inR[inIdx]*pFrac+(int)inR[inIdx+1]*nFrac;	// right channel
+		// Advance input until the output position lies within the centre of the window
+		while (m_frac >= (1<<16))
+		{
+			int i = std::min(inIdx, sizeIn - 1);	// should not run dry (2 spare samples are decoded per frame)
+			Push(inL[i], inR[i]);
+			inIdx = std::min(inIdx + 1, sizeIn);
+			m_frac -= (1<<16);
+		}
+
+		const float *h = m_coeffs[m_frac >> (16 - 8)];
+		float leftSample  = DotTaps<NumTaps>(&m_histL[m_histPos], h);
+		float rightSample = DotTaps<NumTaps>(&m_histR[m_histPos], h);
 
 		// Apply DSB volume+overall music volume setting, and mix into output
-		outL[outIdx] += (float)leftSample  * v[0];
-		outR[outIdx] += (float)rightSample * v[1];
+		outL[outIdx] += leftSample  * v[0];
+		outR[outIdx] += rightSample * v[1];
 		outIdx++;
 
 		// Time step
-		pFrac -= delta;
-		nFrac += delta;
-
-		// Time to move to next samples?
-		if (pFrac <= 0)	// when pFrac becomes 0, advance samples, reset pFrac to 1
-		{
-			pFrac += (1<<8);
-			nFrac -= (1<<8);
-			inIdx++;	// advance samples (for upsampling only; downsampling may advance by more than one -- add delta every loop iteration)
-		}
+		m_frac += delta;
 	}
 
-	// Copy remaining "active" input samples to start of buffer
+	// Copy remaining unconsumed input samples to start of buffer
 	int i = 0;
 	int j = inIdx;
 	while (j < sizeIn)
@@ -403,6 +444,7 @@ void CDSB1::SendCommand(UINT8 data)
 
 void CDSB1::RunFrame(float *audioL, float *audioR)
 {
+	TRACE_ZONE("DSB");
 	if (!m_config["EmulateDSB"].ValueAs<bool>())
 	{
 		// DSB code applies SCSP volume, too, so we must still mix
@@ -569,9 +611,18 @@ Result CDSB1::Init(const UINT8 *progROMPtr, const UINT8 *mpegROMPtr)
 
 	// Initialize Z80 CPU
 	Z80.Init(this, Z80IRQCallback);
+	Z80.AddPollPort(0xF1);	// status has no read side effects, so command polling loops can idle
 
 	retainedSamples = 0;
 
+	// Decode MPEG ahead of playback on a separate thread
+	if (m_config["MultiThreaded"].ValueAs<bool>())
+		MpegDec::StartDecodeThread();
+
+	// Decode the MPEG ROM in the background so that tracks start and loop without decoding
+	if (m_config["PreDecodeMPEG"].ValueAs<bool>())
+		MpegDec::StartPreDecode(mpegROM, 0x1000000);	// 16 MB
+
 	return Result::OKAY;
 }
 
@@ -603,6 +654,9 @@ CDSB1::CDSB1(const Util::Config::Node &config)
 
 CDSB1::~CDSB1(void)
 {
+	MpegDec::StopDecodeThread();
+	MpegDec::StopPreDecode();
+
 	delete [] memoryPool;
 	memoryPool = NULL;
 
@@ -967,6 +1021,7 @@ void CDSB2::SendCommand(UINT8 data)
 
 void CDSB2::RunFrame(float *audioL, float *audioR)
 {
+  TRACE_ZONE("DSB");
   if (!m_config["EmulateDSB"].ValueAs<bool>())
   {
     // DSB code applies SCSP volume, too, so we must still mix
@@ -1207,15 +1262,32 @@ Result CDSB2::Init(const UINT8 *progROMPtr, const UINT8 *mpegROMPtr)
 	mpegL = (INT16 *) &memoryPool[DSB2_OFFSET_MPEG_LEFT];
 	mpegR = (INT16 *) &memoryPool[DSB2_OFFSET_MPEG_RIGHT];
 
+	// Program ROM: 000000-01FFFF, RAM: F00000-F1FFFF
+	memset(fetchMap, 0, sizeof(fetchMap));
+	for (unsigned page = 0; page < 2; page++)
+	{
+		fetchMap[0x00 + page] = &progROM[page << 16];
+		fetchMap[0xF0 + page] = &ram[page << 16];
+	}
+
 	// Initialize 68K CPU
 	M68KSetContext(&M68K);
 	M68KInit();
 	M68KAttachBus(this);
+	M68KAttachFetchMap(fetchMap);
 	M68KSetIRQCallback(NULL);	// use default behavior (autovector, clear interrupt)
 	M68KGetContext(&M68K);
 
 	retainedSamples = 0;
 
+	// Decode MPEG ahead of playback on a separate thread
+	if (m_config["MultiThreaded"].ValueAs<bool>())
+		MpegDec::StartDecodeThread();
+
+	// Decode the MPEG ROM in the background so that tracks start and loop without decoding
+	if (m_config["PreDecodeMPEG"].ValueAs<bool>())
+		MpegDec::StartPreDecode(mpegROM, 0x1000000);	// 16 MB
+
 	return Result::OKAY;
 }
 
@@ -1234,6 +1306,7 @@ CDSB2::CDSB2(const Util::Config::Node &config)
 	ram			= NULL;
 	mpegL		= NULL;
 	mpegR		= NULL;
+	memset(fetchMap, 0, sizeof(fetchMap));
 
 	cmdLatch	= 0;
 	mpegState	= ST_IDLE;
@@ -1262,6 +1335,9 @@ CDSB2::CDSB2(const Util::Config::Node &config)
 
 CDSB2::~CDSB2(void)
 {
+	MpegDec::StopDecodeThread();
+	MpegDec::StopPreDecode();
+
 	if (memoryPool != NULL)
 	{
 		delete [] memoryPool;
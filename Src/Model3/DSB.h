@@ -53,9 +53,11 @@
 /*
  * CDSBResampler:
  *
- * Frame-by-frame resampler. Resamples one single frame of audio and maintains
- * continuity between frames by copying unprocessed input samples to the
- * beginning of the buffer and retaining the internal interpolation state.
+ * Frame-by-frame polyphase windowed-sinc resampler. Resamples one single frame
+ * of audio and maintains continuity between frames by keeping the most recent
+ * input samples in an internal history ring, copying the (few) unconsumed
+ * input samples to the beginning of the buffer, and retaining the fractional
+ * output position.
  *
  * See DSB.cpp for a detailed description of how this works.
  *
@@ -74,14 +76,30 @@ public:
 	int		UpSampleAndMix(float *outL, float *outR, INT16 *inL, INT16 *inR, UINT8 volumeL, UINT8 volumeR, int sizeOut, int sizeIn, int outRate, int inRate);
 	void	Reset(void);
 	CDSBResampler(const Util::Config::Node &config)
-	  : m_config(config)
+	  : m_config(config),
+	    m_musicVolume(config, "MusicVolume", 100)
 	{
+		m_inRate = 0;
+		m_outRate = 0;
 		Reset();
 	}
 private:
+	static constexpr int NumTaps = 16;		// filter length (must be a multiple of 4)
+	static constexpr int NumPhases = 256;	// fractional positions between input samples
+
+	void	BuildFilter(int outRate, int inRate);
+	inline void	Push(INT16 left, INT16 right);
+
 	const Util::Config::Node &m_config;
-	int	nFrac;
-	int	pFrac;
+	Util::Config::Binding<int> m_musicVolume;
+
+	alignas(16) float	m_coeffs[NumPhases][NumTaps];	// one filter per phase, oldest tap first
+	alignas(16) float	m_histL[2*NumTaps];				// input history, written twice so any window is contiguous
+	alignas(16) float	m_histR[2*NumTaps];
+	int		m_histPos;	// oldest sample in history
+	UINT32	m_frac;		// 16.16 position of next output sample past the centre of the window
+	int		m_inRate;	// rates the filter was built for
+	int		m_outRate;
 };
 
 
@@ -304,6 +322,7 @@ private:
 	const UINT8	*mpegROM;		// MPEG music ROM
 	UINT8		*memoryPool;	// all memory allocated here
 	UINT8		*ram;			// 68K RAM
+	const UINT8	*fetchMap[0x100];	// 64 KB pages of program ROM and RAM, for 68K code fetches
 
 	// Command FIFO
 	UINT8	fifo[FIFO_STACK_SIZE];
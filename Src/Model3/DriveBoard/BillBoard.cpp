@@ -184,6 +184,11 @@ CBillBoard::CBillBoard(const Util::Config::Node& config)
   m_z80Clock = 8.0f;
   m_z80NMI = false;
 
+  // Ports the Z80 may spin on without side effects (DIP switch, PPC command, lamp test status)
+  m_z80.AddPollPort(0x20);
+  m_z80.AddPollPort(0x21);
+  m_z80.AddPollPort(0x26);
+
   DebugLog("Built Drive Board (billboard)\n");
 }
 
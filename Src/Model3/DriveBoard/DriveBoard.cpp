@@ -92,6 +92,10 @@ void CDriveBoard::SaveState(CBlockFile* SaveState)
 
             // Save CPU state
             m_z80.SaveState(SaveState, "DriveBoard Z80");
+
+            // Save interrupt schedule
+            SaveState->NewBlock("DriveBoard.Timing", __FILE__);
+            SaveState->Write(&m_nextInterrupt, sizeof(m_nextInterrupt));
         }
     }
 }
@@ -132,6 +136,11 @@ void CDriveBoard::LoadState(CBlockFile* SaveState)
             // Load CPU state
             // TODO: we should have a way to check whether this succeeds... make CZ80::LoadState() return a bool
             m_z80.LoadState(SaveState, "DriveBoard Z80");
+
+            // Older save states don't have the interrupt schedule, so deliver the next interrupt right away
+            m_nextInterrupt = 0;
+            if (SaveState->FindBlock("DriveBoard.Timing") == Result::OKAY)
+                SaveState->Read(&m_nextInterrupt, sizeof(m_nextInterrupt));
         }
     }
 
@@ -288,21 +297,30 @@ void CDriveBoard::RunFrame(void)
     return;
   }
 
-  // Assuming Z80 runs @ 4.0MHz and NMI triggers @ 60.0KHz for WheelBoard and JoystickBoard
-  // Assuming Z80 runs @ 8.0MHz and INT triggers @ 60.0KHz for BillBoard
+  // Assuming Z80 runs @ 4.0MHz and NMI triggers every 10000 cycles (400Hz) for WheelBoard and JoystickBoard
+  // Assuming Z80 runs @ 8.0MHz and INT triggers every 10000 cycles (800Hz) for BillBoard
   // TODO - find out if Z80 frequency is correct and exact frequency of NMI interrupts (just guesswork at the moment!)
+  //
+  // The Z80 runs in slices that end exactly on the next interrupt, with the
+  // countdown carried across frames, so interrupts arrive at an even rate
+  // rather than being realigned to the start of every frame.
   int cycles = (int)(m_z80Clock * 1000000 / 60);
-  constexpr int loopCycles = 10000;
   while (cycles > 0)
   {
-    if (m_allowInterrupts)
+    if (m_nextInterrupt <= 0)
     {
-      if(m_z80NMI)
-        m_z80.TriggerNMI();
-      else
-        m_z80.SetINT(true);
+      if (m_allowInterrupts)
+      {
+        if(m_z80NMI)
+          m_z80.TriggerNMI();
+        else
+          m_z80.SetINT(true);
+      }
+      m_nextInterrupt += m_interruptCycles;
     }
-    cycles -= m_z80.Run(std::min<int>(loopCycles, cycles));
+    int ran = m_z80.Run(std::min<int>(m_nextInterrupt, cycles));
+    cycles -= ran;
+    m_nextInterrupt -= ran;
   }
 }
 
@@ -367,6 +385,7 @@ void CDriveBoard::Reset()
     m_dataSent = 0;
     m_dataReceived = 0;
     m_z80.Reset();        // always reset to provide a valid Z80 state
+    m_nextInterrupt = 0;
 
     // Configure options (cannot be done in Init() because command line settings weren't yet parsed)
     SetForceFeedbackStrength(m_config["ForceFeedbackStrength"].ValueAsDefault<unsigned>(5));
@@ -400,6 +419,8 @@ CDriveBoard::CDriveBoard(const Util::Config::Node& config)
     m_dummyROM(NULL),
     m_z80Clock(4.0f),
     m_z80NMI(true),
+    m_interruptCycles(10000),
+    m_nextInterrupt(0),
     m_inputs(NULL),
     m_inputFlags(0),
     m_outputs(NULL)
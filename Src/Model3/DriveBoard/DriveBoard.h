@@ -316,6 +316,8 @@ protected:
   CZ80 m_z80;             // Z80 CPU
   float m_z80Clock;       // Z80 clock frequency
   bool m_z80NMI;          // Non Masquable Interrupt or Interrupt
+  int m_interruptCycles;  // Z80 cycles between interrupts
+  int m_nextInterrupt;    // Z80 cycles until the next interrupt is due
 
   CInputs* m_inputs;
   unsigned m_inputFlags;
@@ -171,6 +171,12 @@ void CWheelBoard::Reset(void)
 {
   CDriveBoard::Reset();
 
+  // Ports the Z80 may spin on without side effects (DIP switches, PPC command, encoder status)
+  m_z80.AddPollPort(0x20);
+  m_z80.AddPollPort(0x21);
+  m_z80.AddPollPort(0x28);
+  m_z80.AddPollPort(0x2c);
+
   m_seg1Digit1 = 0xFF;
   m_seg1Digit2 = 0xFF;
   m_seg2Digit1 = 0xFF;
@@ -96,6 +96,24 @@ public:
    * Clears all non-volatile memory.
    */
   virtual void ClearNVRAM(void) = 0;
+
+  /*
+   * CheckNVRAMWritten(void):
+   *
+   * Returns whether non-volatile memory may have changed since the last
+   * call, i.e., whether it has been written to or loaded, and clears the
+   * flag. Used to save it periodically while running.
+   */
+  virtual bool CheckNVRAMWritten(void) = 0;
+
+  /*
+   * GetMemoryChecksum(void):
+   *
+   * Returns a checksum of main RAM, quick enough to take every frame. Used
+   * to tell when playing back recorded inputs no longer reproduces the
+   * recorded run.
+   */
+  virtual uint32_t GetMemoryChecksum(void) const = 0;
   
   /*
    * RunFrame(void):
@@ -111,6 +129,19 @@ public:
    */
   virtual void RenderFrame(void) = 0;
 
+  /*
+   * SetOutputEnabled(video, audio):
+   *
+   * Enables or disables video and audio output. Frames run while output is
+   * disabled are emulated in full, but are not rendered and/or their audio
+   * is discarded. Used to quickly re-run frames after loading a state.
+   *
+   * Parameters:
+   *    video   True to render frames (the default), false not to.
+   *    audio   True to play the frames' audio (the default), false not to.
+   */
+  virtual void SetOutputEnabled(bool video, bool audio) = 0;
+
   /*
    * Reset(void):
    *
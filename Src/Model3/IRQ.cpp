@@ -44,8 +44,7 @@
 void CIRQ::SaveState(CBlockFile *SaveState)
 {
 	SaveState->NewBlock("IRQ", __FILE__);
-	SaveState->Write(&irqEnable, sizeof(irqEnable));
-	SaveState->Write(&irqState, sizeof(irqState));
+	SaveState->Write(stateRegions);
 }
 
 void CIRQ::LoadState(CBlockFile *SaveState)
@@ -56,8 +55,7 @@ void CIRQ::LoadState(CBlockFile *SaveState)
 		return;
 	}
 	
-	SaveState->Read(&irqEnable, sizeof(irqEnable));
-	SaveState->Read(&irqState, sizeof(irqState));
+	SaveState->Read(stateRegions);
 }
 
 
@@ -116,6 +114,7 @@ CIRQ::CIRQ(void) :
 	irqEnable(0),
 	irqState(0)
 {	
+	stateRegions.Add(&irqEnable).Add(&irqState);
 	DebugLog("Built IRQ controller\n");
 }
 
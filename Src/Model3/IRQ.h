@@ -144,6 +144,8 @@ public:
 private:
 	unsigned	irqEnable;	// 8 bits, 1=enabled, 0=disabled
 	unsigned	irqState;	// bits correspond to irqEnable, 1=pending, 0=not pending
+
+	CBlockFile::StateRegions	stateRegions;	// the above, as saved in save states
 };
 
 
@@ -79,11 +79,7 @@
 void CMPC10x::SaveState(CBlockFile *SaveState)
 {
 	SaveState->NewBlock("MPC10x", __FILE__);
-	SaveState->Write(regs, sizeof(regs));
-	SaveState->Write(&pciBus, sizeof(pciBus));
-	SaveState->Write(&pciDevice, sizeof(pciDevice));
-	SaveState->Write(&pciFunction, sizeof(pciFunction));
-	SaveState->Write(&pciReg, sizeof(pciReg));
+	SaveState->Write(stateRegions);
 }
 
 void CMPC10x::LoadState(CBlockFile *SaveState)
@@ -94,11 +90,7 @@ void CMPC10x::LoadState(CBlockFile *SaveState)
 		return;
 	}
 	
-	SaveState->Read(regs, sizeof(regs));
-	SaveState->Read(&pciBus, sizeof(pciBus));
-	SaveState->Read(&pciDevice, sizeof(pciDevice));
-	SaveState->Read(&pciFunction, sizeof(pciFunction));
-	SaveState->Read(&pciReg, sizeof(pciReg));
+	SaveState->Read(stateRegions);
 }
 
 
@@ -355,6 +347,7 @@ CMPC10x::CMPC10x(void) :
 	pciFunction(0),
 	pciReg(0)
 {	
+	stateRegions.Add(regs, sizeof(regs)).Add(&pciBus).Add(&pciDevice).Add(&pciFunction).Add(&pciReg);
 	DebugLog("Built MPC10x\n");
 }
 
@@ -182,6 +182,8 @@ private:
 	unsigned	pciDevice;		// PCI device component (5 bits)
 	unsigned	pciFunction;	// PCI function component (3 bits)
 	unsigned	pciReg;			// PCI register component (7 bits)
+
+	CBlockFile::StateRegions	stateRegions;	// regs and PCI address, as saved in save states
 };
 
 
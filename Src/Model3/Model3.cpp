@@ -226,6 +226,7 @@
 #include "DriveBoard/WheelBoard.h"
 #include "Game.h"
 #include "ROMSet.h"
+#include "ROMImageCache.h"
 #ifdef NET_BOARD
 #include "Network/NetBoard.h"
 #include "Network/SimNetBoard.h"
@@ -234,6 +235,8 @@
 #include "OSD/Video.h"
 #include "Util/Format.h"
 #include "Util/ByteSwap.h"
+#include "Util/HugePages.h"
+#include "Util/Trace.h"
 #include <functional>
 #include <set>
 #include <iostream>
@@ -247,7 +250,6 @@
 
 UINT8 CModel3::ReadInputs(unsigned reg)
 {
-  UINT8 adc[8];
   UINT8 data;
   reg &= 0x3F;
   switch (reg)
@@ -256,401 +258,418 @@ UINT8 CModel3::ReadInputs(unsigned reg)
     return inputBank;
 
   case 0x04:  // current input bank
+    if ((inputBank&1) == 0)
+      return m_inputImage[0x04];
+    return (m_inputBank1&0xDF)|(EEPROM.Read()<<5);  // bank 1 contains EEPROM data bit
+
+  case 0x0C:  // game-specific inputs
 
     data = 0xFF;
 
-    if ((inputBank&1) == 0)
-    {
-      data &= ~(Inputs->coin[0]->value);        // Coin 1
-      data &= ~(Inputs->coin[1]->value<<1);     // Coin 2
-      data &= ~(Inputs->test[0]->value<<2);     // Test A
-      data &= ~(Inputs->service[0]->value<<3);  // Service A
-      data &= ~(Inputs->start[0]->value<<4);    // Start 1
-      data &= ~(Inputs->start[1]->value<<5);    // Start 2
-    }
-    else
+    if (DriveBoard->IsAttached() && DriveBoard->GetType() != Game::DRIVE_BOARD_BILLBOARD)
     {
-      data &= ~(Inputs->service[1]->value<<6);  // Service B
-      data &= ~(Inputs->test[1]->value<<7);     // Test B
-      data = (data&0xDF)|(EEPROM.Read()<<5);    // bank 1 contains EEPROM data bit
+      // If driveboard is set as billboard, don't read BillBoard reg (no inputs)
+      data = m_deterministic ? m_drvBrdDataIn : DriveBoard->Read();
     }
 
-    if ((m_game.inputs & Game::INPUT_SKI))
-    {
-      if ((inputBank&1) == 0)
-      {
-        data &= ~(Inputs->skiPollLeft->value<<5);
-        data &= ~(Inputs->skiSelect1->value<<6);
-        data &= ~(Inputs->skiSelect2->value<<7);
-        data &= ~(Inputs->skiSelect3->value<<4);
-      }
-    }
+    return data & m_inputImage[0x0C];
+
+  case 0x10: // Drive board
+      return OutputRegister[0];
+  case 0x14: // Lamps
+      return OutputRegister[1];
+
+  case 0x2C:  // Serial FIFO 1
+    return serialFIFO1;
 
+  case 0x30:  // Serial FIFO 2
+    return serialFIFO2;
+
+  case 0x3C:  // ADC
+
+    // Read out appropriate channel
+    data = m_adc[adcChannel&7];
+    ++adcChannel;
     return data;
 
-  case 0x08:  // game-specific inputs
+  default:
+    break;
+  }
 
-    data = 0xFF;
+  return m_inputImage[reg];
+}
 
-    if ((m_game.inputs & Game::INPUT_SKI))
-    {
-      data &= ~(Inputs->skiPollRight->value<<0);
-    }
+/*
+ * Games poll the input registers many times per frame, so the parts of them
+ * made up of inputs are worked out once per frame, before it is run, and
+ * ReadInputs() only looks them up. Both banks of register 0x04 are built so
+ * that switching banks needs nothing more. The EEPROM data bit, the drive
+ * board and the ADC channel counter are still read as the game accesses
+ * them.
+ */
+void CModel3::UpdateInputImage(void)
+{
+  UINT8 data;
 
-    if ((m_game.inputs & Game::INPUT_JOYSTICK1))
-    {
-      data &= ~(Inputs->up[0]->value<<5);     // P1 Up
-      data &= ~(Inputs->down[0]->value<<4);   // P1 Down
-      data &= ~(Inputs->left[0]->value<<7);   // P1 Left
-      data &= ~(Inputs->right[0]->value<<6);  // P1 Right
-    }
+  memset(m_inputImage, 0xFF, sizeof(m_inputImage));  // controls are active low
 
-    if ((m_game.inputs & Game::INPUT_FIGHTING))
-    {
-      data &= ~(Inputs->escape[0]->value<<3); // P1 Escape
-      data &= ~(Inputs->guard[0]->value<<2);  // P1 Guard
-      data &= ~(Inputs->kick[0]->value<<1);   // P1 Kick
-      data &= ~(Inputs->punch[0]->value<<0);  // P1 Punch
-    }
+  // Register 0x04, bank 0
+  data = 0xFF;
+  data &= ~(Inputs->coin[0]->value);        // Coin 1
+  data &= ~(Inputs->coin[1]->value<<1);     // Coin 2
+  data &= ~(Inputs->test[0]->value<<2);     // Test A
+  data &= ~(Inputs->service[0]->value<<3);  // Service A
+  data &= ~(Inputs->start[0]->value<<4);    // Start 1
+  data &= ~(Inputs->start[1]->value<<5);    // Start 2
 
-    if ((m_game.inputs & Game::INPUT_SPIKEOUT))
-    {
-      data &= ~(Inputs->shift->value<<2);     // Shift
-      data &= ~(Inputs->beat->value<<0);      // Beat
-      data &= ~(Inputs->charge->value<<1);    // Charge
-      data &= ~(Inputs->jump->value<<3);      // Jump
-    }
+  if ((m_game.inputs & Game::INPUT_SKI))
+  {
+    data &= ~(Inputs->skiPollLeft->value<<5);
+    data &= ~(Inputs->skiSelect1->value<<6);
+    data &= ~(Inputs->skiSelect2->value<<7);
+    data &= ~(Inputs->skiSelect3->value<<4);
+  }
 
-    if ((m_game.inputs & Game::INPUT_SOCCER))
-    {
-      data &= ~(Inputs->shortPass[0]->value<<2);  // P1 Short Pass
-      data &= ~(Inputs->longPass[0]->value<<0);   // P1 Long Pass
-      data &= ~(Inputs->shoot[0]->value<<1);      // P1 Shoot
-    }
+  m_inputImage[0x04] = data;
 
-    if ((m_game.inputs & Game::INPUT_VR4))
-    {
-      data &= ~(Inputs->vr[0]->value<<0); // VR1 Red
-      data &= ~(Inputs->vr[1]->value<<1); // VR2 Blue
-      data &= ~(Inputs->vr[2]->value<<2); // VR3 Yellow
-      data &= ~(Inputs->vr[3]->value<<3); // VR4 Green
-    }
+  // Register 0x04, bank 1 (without the EEPROM data bit)
+  data = 0xFF;
+  data &= ~(Inputs->service[1]->value<<6);  // Service B
+  data &= ~(Inputs->test[1]->value<<7);     // Test B
+  m_inputBank1 = data;
 
-    if ((m_game.inputs & Game::INPUT_VIEWCHANGE))
-    {
-      // Harley is wired slightly differently
-      if ((m_game.inputs & Game::INPUT_HARLEY))
-        data &= ~(Inputs->viewChange->value<<1);  // View change
-      else
-        data &= ~(Inputs->viewChange->value<<0);  // View change
-    }
+  // Register 0x08: game-specific inputs
+  data = 0xFF;
 
-    if ((m_game.inputs & Game::INPUT_SHIFT4))
-    {
-      if (Inputs->gearShift4->value == 2)       // Shift 2
-        data &= ~0x60;
-      else if (Inputs->gearShift4->value == 4)  // Shift 4
-        data &= ~0x20;
-      if (Inputs->gearShift4->value == 1)       // Shift 1
-        data &= ~0x50;
-      else if (Inputs->gearShift4->value == 3)  // Shift 3
-        data &= ~0x10;
-    }
+  if ((m_game.inputs & Game::INPUT_SKI))
+  {
+    data &= ~(Inputs->skiPollRight->value<<0);
+  }
 
-    if ((m_game.inputs & Game::INPUT_SHIFTUPDOWN))
-    {
-      // Harley is wired slightly differently
-      if ((m_game.inputs & Game::INPUT_HARLEY))
-      {
-        if (Inputs->gearShiftUp->value)         // Shift up
-          data &= ~0x20;
-        else if (Inputs->gearShiftDown->value)  // Shift down
-          data &= ~0x10;
-      }
-      else
-      {
-        if (Inputs->gearShiftUp->value)         // Shift up
-          data &= ~0x50;
-        else if (Inputs->gearShiftDown->value)  // Shift down
-          data &= ~0x60;
-      }
-    }
+  if ((m_game.inputs & Game::INPUT_JOYSTICK1))
+  {
+    data &= ~(Inputs->up[0]->value<<5);     // P1 Up
+    data &= ~(Inputs->down[0]->value<<4);   // P1 Down
+    data &= ~(Inputs->left[0]->value<<7);   // P1 Left
+    data &= ~(Inputs->right[0]->value<<6);  // P1 Right
+  }
 
-    if ((m_game.inputs & Game::INPUT_HANDBRAKE))
-      data &= ~(Inputs->handBrake->value<<1);   // Hand brake
+  if ((m_game.inputs & Game::INPUT_FIGHTING))
+  {
+    data &= ~(Inputs->escape[0]->value<<3); // P1 Escape
+    data &= ~(Inputs->guard[0]->value<<2);  // P1 Guard
+    data &= ~(Inputs->kick[0]->value<<1);   // P1 Kick
+    data &= ~(Inputs->punch[0]->value<<0);  // P1 Punch
+  }
 
-    if ((m_game.inputs & Game::INPUT_HARLEY))
-      data &= ~(Inputs->musicSelect->value<<0); // Music select
+  if ((m_game.inputs & Game::INPUT_SPIKEOUT))
+  {
+    data &= ~(Inputs->shift->value<<2);     // Shift
+    data &= ~(Inputs->beat->value<<0);      // Beat
+    data &= ~(Inputs->charge->value<<1);    // Charge
+    data &= ~(Inputs->jump->value<<3);      // Jump
+  }
 
-    if ((m_game.inputs & Game::INPUT_GUN1))
-      data &= ~(Inputs->trigger[0]->value<<0);  // P1 Trigger
+  if ((m_game.inputs & Game::INPUT_SOCCER))
+  {
+    data &= ~(Inputs->shortPass[0]->value<<2);  // P1 Short Pass
+    data &= ~(Inputs->longPass[0]->value<<0);   // P1 Long Pass
+    data &= ~(Inputs->shoot[0]->value<<1);      // P1 Shoot
+  }
 
-    if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
-    {
-      data &= ~(Inputs->analogJoyTrigger1->value<<5); // Trigger 1
-      data &= ~(Inputs->analogJoyTrigger2->value<<4); // Trigger 2
-      data &= ~(Inputs->analogJoyEvent1->value<<0);   // Event Button 1
-      data &= ~(Inputs->analogJoyEvent2->value<<1);   // Event Button 2
-    }
+  if ((m_game.inputs & Game::INPUT_VR4))
+  {
+    data &= ~(Inputs->vr[0]->value<<0); // VR1 Red
+    data &= ~(Inputs->vr[1]->value<<1); // VR2 Blue
+    data &= ~(Inputs->vr[2]->value<<2); // VR3 Yellow
+    data &= ~(Inputs->vr[3]->value<<3); // VR4 Green
+  }
+
+  if ((m_game.inputs & Game::INPUT_VIEWCHANGE))
+  {
+    // Harley is wired slightly differently
+    if ((m_game.inputs & Game::INPUT_HARLEY))
+      data &= ~(Inputs->viewChange->value<<1);  // View change
+    else
+      data &= ~(Inputs->viewChange->value<<0);  // View change
+  }
+
+  if ((m_game.inputs & Game::INPUT_SHIFT4))
+  {
+    if (Inputs->gearShift4->value == 2)       // Shift 2
+      data &= ~0x60;
+    else if (Inputs->gearShift4->value == 4)  // Shift 4
+      data &= ~0x20;
+    if (Inputs->gearShift4->value == 1)       // Shift 1
+      data &= ~0x50;
+    else if (Inputs->gearShift4->value == 3)  // Shift 3
+      data &= ~0x10;
+  }
 
-    if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // First twin joystick
+  if ((m_game.inputs & Game::INPUT_SHIFTUPDOWN))
+  {
+    // Harley is wired slightly differently
+    if ((m_game.inputs & Game::INPUT_HARLEY))
     {
-      /*
-       * Process left joystick inputs first
-       */
-
-      // Shot trigger and Turbo
-      data &= ~(Inputs->twinJoyShot1->value<<0);
-      data &= ~(Inputs->twinJoyTurbo1->value<<1);
-
-      // Stick
-      data &= ~(Inputs->twinJoyLeft1->value<<7);
-      data &= ~(Inputs->twinJoyRight1->value<<6);
-      data &= ~(Inputs->twinJoyUp1->value<<5);
-      data &= ~(Inputs->twinJoyDown1->value<<4);
-
-      /*
-       * Next, process twin joystick macro inputs (higher level inputs
-       * that map to actions on both joysticks simultaneously).
-       */
-
-      /*
-       * Forward/reverse/turn are mutually exclusive.
-       *
-       * Turn Left:   1D 2U
-       * Turn Right:  1U 2D
-       * Forward:     1U 2U
-       * Reverse:     1D 2D
-       */
-      if (Inputs->twinJoyTurnLeft->value)
-        data &= ~0x10;
-      else if (Inputs->twinJoyTurnRight->value)
-        data &= ~0x20;
-      else if (Inputs->twinJoyForward->value)
+      if (Inputs->gearShiftUp->value)         // Shift up
         data &= ~0x20;
-      else if (Inputs->twinJoyReverse->value)
+      else if (Inputs->gearShiftDown->value)  // Shift down
         data &= ~0x10;
-
-      /*
-       * Strafe/crouch/jump are mutually exclusive.
-       *
-       * Strafe Left:   1L 2L
-       * Strafe Right:  1R 2R
-       * Jump:          1L 2R
-       * Crouch:        1R 2L
-       */
-      if (Inputs->twinJoyStrafeLeft->value)
-        data &= ~0x80;
-      else if (Inputs->twinJoyStrafeRight->value)
-        data &= ~0x40;
-      else if (Inputs->twinJoyJump->value)
-        data &= ~0x80;
-      else if (Inputs->twinJoyCrouch->value)
-        data &= ~0x40;
     }
-
-    if ((m_game.inputs & Game::INPUT_ANALOG_GUN1))
+    else
     {
-      data &= ~(Inputs->analogTriggerLeft[0]->value<<0);
-      data &= ~(Inputs->analogTriggerRight[0]->value<<1);
+      if (Inputs->gearShiftUp->value)         // Shift up
+        data &= ~0x50;
+      else if (Inputs->gearShiftDown->value)  // Shift down
+        data &= ~0x60;
     }
+  }
 
-    if ((m_game.inputs & Game::INPUT_MAGTRUCK))
-      data &= ~(Inputs->magicalPedal1->value << 0);
+  if ((m_game.inputs & Game::INPUT_HANDBRAKE))
+    data &= ~(Inputs->handBrake->value<<1);   // Hand brake
 
-    if ((m_game.inputs & Game::INPUT_FISHING))
-    {
-      if (m_game.name == "getbassur")
-      {
-        // bass fishing
-        data &= ~(Inputs->fishingCast->value << 0);
-        data &= ~(Inputs->fishingSelect->value << 1);
-      }
-      else
-      {
-        // get bass fishing
-        data &= ~(!Inputs->fishingCast->value << 4);
-        data &= ~(!Inputs->fishingSelect->value << 5);
-      }
-    }
-    return data;
+  if ((m_game.inputs & Game::INPUT_HARLEY))
+    data &= ~(Inputs->musicSelect->value<<0); // Music select
 
-  case 0x10: // Drive board
-      return OutputRegister[0];
-  case 0x14: // Lamps
-      return OutputRegister[1];
+  if ((m_game.inputs & Game::INPUT_GUN1))
+    data &= ~(Inputs->trigger[0]->value<<0);  // P1 Trigger
 
-  case 0x0C:  // game-specific inputs
+  if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
+  {
+    data &= ~(Inputs->analogJoyTrigger1->value<<5); // Trigger 1
+    data &= ~(Inputs->analogJoyTrigger2->value<<4); // Trigger 2
+    data &= ~(Inputs->analogJoyEvent1->value<<0);   // Event Button 1
+    data &= ~(Inputs->analogJoyEvent2->value<<1);   // Event Button 2
+  }
 
-    data = 0xFF;
+  if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // First twin joystick
+  {
+    /*
+     * Process left joystick inputs first
+     */
+
+    // Shot trigger and Turbo
+    data &= ~(Inputs->twinJoyShot1->value<<0);
+    data &= ~(Inputs->twinJoyTurbo1->value<<1);
+
+    // Stick
+    data &= ~(Inputs->twinJoyLeft1->value<<7);
+    data &= ~(Inputs->twinJoyRight1->value<<6);
+    data &= ~(Inputs->twinJoyUp1->value<<5);
+    data &= ~(Inputs->twinJoyDown1->value<<4);
+
+    /*
+     * Next, process twin joystick macro inputs (higher level inputs
+     * that map to actions on both joysticks simultaneously).
+     */
+
+    /*
+     * Forward/reverse/turn are mutually exclusive.
+     *
+     * Turn Left:   1D 2U
+     * Turn Right:  1U 2D
+     * Forward:     1U 2U
+     * Reverse:     1D 2D
+     */
+    if (Inputs->twinJoyTurnLeft->value)
+      data &= ~0x10;
+    else if (Inputs->twinJoyTurnRight->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyForward->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyReverse->value)
+      data &= ~0x10;
+
+    /*
+     * Strafe/crouch/jump are mutually exclusive.
+     *
+     * Strafe Left:   1L 2L
+     * Strafe Right:  1R 2R
+     * Jump:          1L 2R
+     * Crouch:        1R 2L
+     */
+    if (Inputs->twinJoyStrafeLeft->value)
+      data &= ~0x80;
+    else if (Inputs->twinJoyStrafeRight->value)
+      data &= ~0x40;
+    else if (Inputs->twinJoyJump->value)
+      data &= ~0x80;
+    else if (Inputs->twinJoyCrouch->value)
+      data &= ~0x40;
+  }
 
-    if (DriveBoard->IsAttached() && DriveBoard->GetType() != Game::DRIVE_BOARD_BILLBOARD)
-    {
-      // If driveboard is set as billboard, don't read BillBoard reg (no inputs)
-      data = DriveBoard->Read();
-    }
+  if ((m_game.inputs & Game::INPUT_ANALOG_GUN1))
+  {
+    data &= ~(Inputs->analogTriggerLeft[0]->value<<0);
+    data &= ~(Inputs->analogTriggerRight[0]->value<<1);
+  }
 
-    if ((m_game.inputs & Game::INPUT_JOYSTICK2))
-    {
-      data &= ~(Inputs->up[1]->value<<5);     // P2 Up
-      data &= ~(Inputs->down[1]->value<<4);   // P2 Down
-      data &= ~(Inputs->left[1]->value<<7);   // P2 Left
-      data &= ~(Inputs->right[1]->value<<6);  // P2 Right
-    }
+  if ((m_game.inputs & Game::INPUT_MAGTRUCK))
+    data &= ~(Inputs->magicalPedal1->value << 0);
 
-    if ((m_game.inputs & Game::INPUT_FIGHTING))
+  if ((m_game.inputs & Game::INPUT_FISHING))
+  {
+    if (m_game.name == "getbassur")
     {
-      data &= ~(Inputs->escape[1]->value<<3); // P2 Escape
-      data &= ~(Inputs->guard[1]->value<<2);  // P2 Guard
-      data &= ~(Inputs->kick[1]->value<<1);   // P2 Kick
-      data &= ~(Inputs->punch[1]->value<<0);  // P2 Punch
+      // bass fishing
+      data &= ~(Inputs->fishingCast->value << 0);
+      data &= ~(Inputs->fishingSelect->value << 1);
     }
-
-    if ((m_game.inputs & Game::INPUT_SOCCER))
+    else
     {
-      data &= ~(Inputs->shortPass[1]->value<<2);  // P2 Short Pass
-      data &= ~(Inputs->longPass[1]->value<<0);   // P2 Long Pass
-      data &= ~(Inputs->shoot[1]->value<<1);      // P2 Shoot
+      // get bass fishing
+      data &= ~(!Inputs->fishingCast->value << 4);
+      data &= ~(!Inputs->fishingSelect->value << 5);
     }
+  }
+  m_inputImage[0x08] = data;
 
-    if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // Second twin joystick (see register 0x08 for comments)
-    {
-
-      data &= ~(Inputs->twinJoyShot2->value<<0);
-      data &= ~(Inputs->twinJoyTurbo2->value<<1);
-
-      data &= ~(Inputs->twinJoyLeft2->value<<7);
-      data &= ~(Inputs->twinJoyRight2->value<<6);
-      data &= ~(Inputs->twinJoyUp2->value<<5);
-      data &= ~(Inputs->twinJoyDown2->value<<4);
+  // Register 0x0C: game-specific inputs, combined with the drive board when read
+  data = 0xFF;
 
-      if (Inputs->twinJoyTurnLeft->value)
-        data &= ~0x20;
-      else if (Inputs->twinJoyTurnRight->value)
-        data &= ~0x10;
-      else if (Inputs->twinJoyForward->value)
-        data &= ~0x20;
-      else if (Inputs->twinJoyReverse->value)
-        data &= ~0x10;
+  if ((m_game.inputs & Game::INPUT_JOYSTICK2))
+  {
+    data &= ~(Inputs->up[1]->value<<5);     // P2 Up
+    data &= ~(Inputs->down[1]->value<<4);   // P2 Down
+    data &= ~(Inputs->left[1]->value<<7);   // P2 Left
+    data &= ~(Inputs->right[1]->value<<6);  // P2 Right
+  }
 
-      if (Inputs->twinJoyStrafeLeft->value)
-        data &= ~0x80;
-      else if (Inputs->twinJoyStrafeRight->value)
-        data &= ~0x40;
-      else if (Inputs->twinJoyJump->value)
-        data &= ~0x40;
-      else if (Inputs->twinJoyCrouch->value)
-        data &= ~0x80;
-    }
+  if ((m_game.inputs & Game::INPUT_FIGHTING))
+  {
+    data &= ~(Inputs->escape[1]->value<<3); // P2 Escape
+    data &= ~(Inputs->guard[1]->value<<2);  // P2 Guard
+    data &= ~(Inputs->kick[1]->value<<1);   // P2 Kick
+    data &= ~(Inputs->punch[1]->value<<0);  // P2 Punch
+  }
 
-    if ((m_game.inputs & Game::INPUT_GUN2))
-      data &= ~(Inputs->trigger[1]->value<<0);  // P2 Trigger
+  if ((m_game.inputs & Game::INPUT_SOCCER))
+  {
+    data &= ~(Inputs->shortPass[1]->value<<2);  // P2 Short Pass
+    data &= ~(Inputs->longPass[1]->value<<0);   // P2 Long Pass
+    data &= ~(Inputs->shoot[1]->value<<1);      // P2 Shoot
+  }
 
-    if ((m_game.inputs & Game::INPUT_ANALOG_GUN2))
-    {
-      data &= ~(Inputs->analogTriggerLeft[1]->value<<0);
-      data &= ~(Inputs->analogTriggerRight[1]->value<<1);
-    }
+  if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // Second twin joystick (see register 0x08 for comments)
+  {
 
-    if ((m_game.inputs & Game::INPUT_MAGTRUCK))
-      data &= ~(Inputs->magicalPedal2->value << 0);
+    data &= ~(Inputs->twinJoyShot2->value<<0);
+    data &= ~(Inputs->twinJoyTurbo2->value<<1);
+
+    data &= ~(Inputs->twinJoyLeft2->value<<7);
+    data &= ~(Inputs->twinJoyRight2->value<<6);
+    data &= ~(Inputs->twinJoyUp2->value<<5);
+    data &= ~(Inputs->twinJoyDown2->value<<4);
+
+    if (Inputs->twinJoyTurnLeft->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyTurnRight->value)
+      data &= ~0x10;
+    else if (Inputs->twinJoyForward->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyReverse->value)
+      data &= ~0x10;
+
+    if (Inputs->twinJoyStrafeLeft->value)
+      data &= ~0x80;
+    else if (Inputs->twinJoyStrafeRight->value)
+      data &= ~0x40;
+    else if (Inputs->twinJoyJump->value)
+      data &= ~0x40;
+    else if (Inputs->twinJoyCrouch->value)
+      data &= ~0x80;
+  }
 
-    return data;
+  if ((m_game.inputs & Game::INPUT_GUN2))
+    data &= ~(Inputs->trigger[1]->value<<0);  // P2 Trigger
 
-  case 0x18:         // swtrilgy and getbass. Remove IO board error on getbass. Not sure, but may be related to device feedback ?
-      data = 0x7f;   // Note : when this returned value is wrong, there is a side effect on Ocean Hunter game, a sort of 3d interlaced effect
-      if (m_game.name == "bassdx" || m_game.name == "getbassdx" || m_game.name == "getbass")  // Prevent I/O erreur after a while (related to tension)
-      {
-          data = 0x01;
-      }
-      return data;
+  if ((m_game.inputs & Game::INPUT_ANALOG_GUN2))
+  {
+    data &= ~(Inputs->analogTriggerLeft[1]->value<<0);
+    data &= ~(Inputs->analogTriggerRight[1]->value<<1);
+  }
 
-  case 0x2C:  // Serial FIFO 1
-    return serialFIFO1;
+  if ((m_game.inputs & Game::INPUT_MAGTRUCK))
+    data &= ~(Inputs->magicalPedal2->value << 0);
 
-  case 0x30:  // Serial FIFO 2
-    return serialFIFO2;
+  m_inputImage[0x0C] = data;
 
-  case 0x34:  // Serial FIFO full/empty flags
-    if (m_game.inputs & (Game::INPUT_GUN1 | Game::INPUT_GUN2)) {
-      return 0x0C;
-    }
-    else {
-      return 0;
-    }
+  // Register 0x18: swtrilgy and getbass. Remove IO board error on getbass. Not sure, but may be related to device feedback ?
+  data = 0x7f;   // Note : when this returned value is wrong, there is a side effect on Ocean Hunter game, a sort of 3d interlaced effect
+  if (m_game.name == "bassdx" || m_game.name == "getbassdx" || m_game.name == "getbass")  // Prevent I/O erreur after a while (related to tension)
+  {
+      data = 0x01;
+  }
+  m_inputImage[0x18] = data;
 
-  case 0x3C:  // ADC
+  // Register 0x34: serial FIFO full/empty flags
+  if (m_game.inputs & (Game::INPUT_GUN1 | Game::INPUT_GUN2)) {
+    m_inputImage[0x34] = 0x0C;
+  }
+  else {
+    m_inputImage[0x34] = 0;
+  }
 
-    // Load ADC channels with input data
-    memset(adc, 0, sizeof(adc));
-    if ((m_game.inputs & Game::INPUT_VEHICLE))
-    {
-      adc[0] = (UINT8)Inputs->steering->value;
-      adc[1] = (UINT8)Inputs->accelerator->value;
-      adc[2] = (UINT8)Inputs->brake->value;
-      if ((m_game.inputs & Game::INPUT_HARLEY))
-        adc[3] = (UINT8)Inputs->rearBrake->value;
-    }
+  // Load ADC channels with input data
+  memset(m_adc, 0, sizeof(m_adc));
+  if ((m_game.inputs & Game::INPUT_VEHICLE))
+  {
+    m_adc[0] = (UINT8)Inputs->steering->value;
+    m_adc[1] = (UINT8)Inputs->accelerator->value;
+    m_adc[2] = (UINT8)Inputs->brake->value;
+    if ((m_game.inputs & Game::INPUT_HARLEY))
+      m_adc[3] = (UINT8)Inputs->rearBrake->value;
+  }
 
-    if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
-    {
-      adc[0] = (UINT8)Inputs->analogJoyY->value;
-      adc[1] = (UINT8)Inputs->analogJoyX->value;
-    }
+  if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
+  {
+    m_adc[0] = (UINT8)Inputs->analogJoyY->value;
+    m_adc[1] = (UINT8)Inputs->analogJoyX->value;
+  }
 
-    if (m_game.inputs & (Game::INPUT_ANALOG_GUN1 | Game::INPUT_ANALOG_GUN2))
-    {
-      adc[0] = (UINT8)Inputs->analogGunX[0]->value;
-      adc[2] = (UINT8)Inputs->analogGunY[0]->value;
-      adc[1] = (UINT8)Inputs->analogGunX[1]->value;
-      adc[3] = (UINT8)Inputs->analogGunY[1]->value;
-
-  	  // Unclear why this is necessary or how to cleanly fix it, so I'm
-  	  // disabling it but leaving it here for future reference. The proper fix is
-  	  // probably to allow users to define inverted controls for this game only,
-  	  // which means the input system must support loading per-game config (not
-  	  // all analog_gun games require axis inversion to be playable).
+  if (m_game.inputs & (Game::INPUT_ANALOG_GUN1 | Game::INPUT_ANALOG_GUN2))
+  {
+    m_adc[0] = (UINT8)Inputs->analogGunX[0]->value;
+    m_adc[2] = (UINT8)Inputs->analogGunY[0]->value;
+    m_adc[1] = (UINT8)Inputs->analogGunX[1]->value;
+    m_adc[3] = (UINT8)Inputs->analogGunY[1]->value;
+
+	  // Unclear why this is necessary or how to cleanly fix it, so I'm
+	  // disabling it but leaving it here for future reference. The proper fix is
+	  // probably to allow users to define inverted controls for this game only,
+	  // which means the input system must support loading per-game config (not
+	  // all analog_gun games require axis inversion to be playable).
 	  if (m_game.name == "lostwsga" || m_game.name == "lostwsgo")
 	  { // to do, not a string compare
-        adc[0] =       (UINT8)Inputs->analogGunX[0]->value; // order is different for some reason in lost world
-        adc[1] = 255 - (UINT8)Inputs->analogGunY[0]->value; // why are values inverted? is this the wrong place to fix this
-        adc[2] =       (UINT8)Inputs->analogGunX[1]->value;
-        adc[3] = 255 - (UINT8)Inputs->analogGunY[1]->value;
-      }
-    }
-
-    if ((m_game.inputs & Game::INPUT_SKI))
-    {
-      adc[0] = (UINT8)Inputs->skiY->value;
-      adc[1] = (UINT8)Inputs->skiX->value;
-    }
-
-    if ((m_game.inputs & Game::INPUT_MAGTRUCK))
-    {
-      adc[0] = uint8_t(Inputs->magicalLever1->value);
-      adc[1] = uint8_t(Inputs->magicalLever2->value);
+      m_adc[0] =       (UINT8)Inputs->analogGunX[0]->value; // order is different for some reason in lost world
+      m_adc[1] = 255 - (UINT8)Inputs->analogGunY[0]->value; // why are values inverted? is this the wrong place to fix this
+      m_adc[2] =       (UINT8)Inputs->analogGunX[1]->value;
+      m_adc[3] = 255 - (UINT8)Inputs->analogGunY[1]->value;
     }
+  }
 
-    if ((m_game.inputs & Game::INPUT_FISHING))
-    {
-      adc[0] = uint8_t(Inputs->fishingRodY->value);
-      adc[1] = uint8_t(Inputs->fishingRodX->value);
-      adc[2] = uint8_t(Inputs->fishingTension->value); // get bass fishing only : Tension Sensor ?
-      adc[3] = uint8_t(Inputs->fishingReel->value);
-      adc[5] = uint8_t(Inputs->fishingStickX->value);
-      adc[4] = uint8_t(Inputs->fishingStickY->value);
-    }
+  if ((m_game.inputs & Game::INPUT_SKI))
+  {
+    m_adc[0] = (UINT8)Inputs->skiY->value;
+    m_adc[1] = (UINT8)Inputs->skiX->value;
+  }
 
-    // Read out appropriate channel
-    data = adc[adcChannel&7];
-    ++adcChannel;
-    return data;
+  if ((m_game.inputs & Game::INPUT_MAGTRUCK))
+  {
+    m_adc[0] = uint8_t(Inputs->magicalLever1->value);
+    m_adc[1] = uint8_t(Inputs->magicalLever2->value);
+  }
 
-  default:
-    break;
+  if ((m_game.inputs & Game::INPUT_FISHING))
+  {
+    m_adc[0] = uint8_t(Inputs->fishingRodY->value);
+    m_adc[1] = uint8_t(Inputs->fishingRodX->value);
+    m_adc[2] = uint8_t(Inputs->fishingTension->value); // get bass fishing only : Tension Sensor ?
+    m_adc[3] = uint8_t(Inputs->fishingReel->value);
+    m_adc[5] = uint8_t(Inputs->fishingStickX->value);
+    m_adc[4] = uint8_t(Inputs->fishingStickY->value);
   }
 
-  return 0xFF;  // controls are active low
 }
 
 void CModel3::WriteInputs(unsigned reg, UINT8 data)
@@ -659,12 +678,22 @@ void CModel3::WriteInputs(unsigned reg, UINT8 data)
   {
   case 0:
     EEPROM.Write((data>>6)&1,(data>>7)&1,(data>>5)&1);
+    if (EEPROM.CheckWritten())
+      m_nvramWritten = true;
     inputBank = data;
     break;
 
   case 0x10:  // Drive board
     if (DriveBoard->IsAttached())
-      DriveBoard->Write(data);
+    {
+      if (m_deterministic)
+      {
+        m_drvBrdDataOut = data;
+        m_drvBrdDataWritten = true;
+      }
+      else
+        DriveBoard->Write(data);
+    }
     if (NULL != Outputs) // TODO - check gameInputs
       Outputs->SetValue(OutputRawDrive, data);
     OutputRegister[0] = data;
@@ -866,9 +895,50 @@ void CModel3::SetCROMBank(unsigned idx)
   cromBankReg = idx;
   idx = (~idx) & 0xF;
   cromBank = &crom[0x800000 + (idx*0x800000)];
+  for (unsigned page = 0; page < 0x80; page++)
+  {
+    m_readMap[0xFF00 + page].ptr = &cromBank[page << 16];
+    m_readMap[0xFF00 + page].sizes = 1 | 2 | 4;
+  }
+  ppc_set_fetch_bank(2, (UINT32 *) cromBank);
   DebugLog("CROM bank setting: %d (%02X), PC=%08X, LR=%08X\n", idx, cromBankReg, ppc_get_pc(), ppc_get_lr());
 }
 
+/*
+ * Plain memory outside of RAM is described by a table of 64 KB pages so that
+ * the access handlers can reach it without going through the address decoder.
+ * Each page lists the access sizes that go straight to memory. Everything else
+ * (including all MMIO) falls through to the decoder. Only the sizes the decoder
+ * handles as plain memory accesses are listed, to preserve its behavior.
+ */
+void CModel3::BuildMemoryMap(void)
+{
+  memset(m_readMap, 0, sizeof(m_readMap));
+  memset(m_writeMap, 0, sizeof(m_writeMap));
+
+  auto Map = [](MemoryPage *map, UINT32 start, UINT32 end, UINT8 *ptr, unsigned sizes, bool *written = NULL)
+  {
+    for (UINT32 page = start >> 16; page <= (end >> 16); page++, ptr += 0x10000)
+    {
+      map[page].ptr = ptr;
+      map[page].sizes = sizes;
+      map[page].written = written;
+    }
+  };
+
+  // Fixed CROM (banked CROM is mapped by SetCROMBank())
+  Map(m_readMap, 0xFF800000, 0xFFFFFFFF, crom, 1 | 2 | 4);
+
+  // Backup RAM and security board RAM, along with their 0xFExxxxxx mirrors
+  for (UINT32 base: { 0xF0000000, 0xFE000000 })
+  {
+    Map(m_readMap, base + 0x0C0000, base + 0x0DFFFF, backupRAM, 2 | 4);
+    Map(m_writeMap, base + 0x0C0000, base + 0x0DFFFF, backupRAM, 1 | 2 | 4, &m_nvramWritten);
+    Map(m_readMap, base + 0x180000, base + 0x19FFFF, securityRAM, 4);
+    Map(m_writeMap, base + 0x180000, base + 0x19FFFF, securityRAM, 4);
+  }
+}
+
 UINT8 CModel3::ReadSystemRegister(unsigned reg) const
 {
   switch (reg&0x3F)
@@ -902,10 +972,14 @@ void CModel3::WriteSystemRegister(unsigned reg, UINT8 data)
   case 0x14:  // IRQ enable
     IRQ.WriteIRQEnable(data);
     DebugLog("IRQ ENABLE=%02X\n", data);
+    if (m_irqWait && !(IRQ.ReadIRQEnable() & IRQ.ReadIRQState() & m_irqWait))
+      ppc_end_slice();
     break;
   case 0x18:  // IRQ acknowledge
     IRQ.Deassert(data);
     DebugLog("IRQ ACK? %02X=%02X\n", reg, data);
+    if (m_irqWait && !(IRQ.ReadIRQEnable() & IRQ.ReadIRQState() & m_irqWait))
+      ppc_end_slice();
     break;
   case 0x0C:  // JTAG Test Access Port
   {
@@ -935,6 +1009,70 @@ void CModel3::WriteSystemRegister(unsigned reg, UINT8 data)
  for the MPC10x. Write32() handles the MPC10x most correctly.
 ******************************************************************************/
 
+const char * const BusAccessCounts::regionNames[BusAccessCounts::NumRegions] =
+{
+  "RAM", "CROM", "Real3D regs", "culling RAM", "polygon RAM", "textures", "Real3D DMA", "tile gen",
+  "inputs", "sound", "backup RAM", "security", "system", "PCI", "SCSI", "other"
+};
+
+#ifdef SUPERMODEL_TRACE
+
+// Follows the decoding of the handlers below
+static BusAccessCounts::Region GetBusRegion(UINT32 addr)
+{
+  if (addr < 0x00800000)
+    return BusAccessCounts::RAM;
+
+  switch (addr >> 24)
+  {
+  case 0x84: case 0x88: case 0x9C:
+    return BusAccessCounts::Real3DRegs;
+  case 0x8C: case 0x8E:
+    return BusAccessCounts::CullingRAM;
+  case 0x98:
+    return BusAccessCounts::PolygonRAM;
+  case 0x90: case 0x94:
+    return BusAccessCounts::Textures;
+  case 0xC2:
+    return BusAccessCounts::Real3DDMA;
+  case 0xF1:
+    return BusAccessCounts::TileGen;
+  case 0xFF:
+    return BusAccessCounts::CROM;
+  case 0xC0: case 0xC1: case 0xF9:
+    return BusAccessCounts::SCSI;
+  case 0xF8:
+    return BusAccessCounts::PCI;
+  case 0xF0: case 0xFE:
+    switch ((addr >> 16) & 0xFF)
+    {
+    case 0x04:
+      return BusAccessCounts::Inputs;
+    case 0x08:
+      return BusAccessCounts::Sound;
+    case 0x0C: case 0x0D:
+      return BusAccessCounts::BackupRAM;
+    case 0x10: case 0x14:
+      return BusAccessCounts::System;
+    case 0x18: case 0x19: case 0x1A:
+      return BusAccessCounts::Security;
+    default:
+      return ((addr >> 16) & 0xFF) >= 0x80 ? BusAccessCounts::PCI : BusAccessCounts::Other;
+    }
+  default:
+    return BusAccessCounts::Other;
+  }
+}
+
+// sizeIdx is 0, 1 or 2 for 8, 16 or 32 bits
+#define COUNT_BUS_ACCESS(counts, addr, sizeIdx) ((counts)[GetBusRegion(addr)][sizeIdx]++)
+
+#else
+
+#define COUNT_BUS_ACCESS(counts, addr, sizeIdx) ((void) 0)
+
+#endif  // SUPERMODEL_TRACE
+
 /*
  * CModel3::Read8(addr):
  * CModel3::Read16(addr):
@@ -945,10 +1083,17 @@ void CModel3::WriteSystemRegister(unsigned reg, UINT8 data)
  */
 UINT8 CModel3::Read8(UINT32 addr)
 {
+  COUNT_BUS_ACCESS(m_busCounts.reads, addr, 0);
+
   // RAM (most frequently accessed)
   if (addr<0x00800000)
     return ram[addr^3];
 
+  // Plain memory
+  const MemoryPage &page = m_readMap[addr >> 16];
+  if (page.sizes & 1)
+    return page.ptr[(addr & 0xFFFF) ^ 3];
+
   // Other
   switch ((addr >> 24))
   {
@@ -1079,10 +1224,17 @@ UINT16 CModel3::Read16(UINT32 addr)
     return data;
   }
 
+  COUNT_BUS_ACCESS(m_busCounts.reads, addr, 1);
+
   // RAM (most frequently accessed)
   if (addr<0x00800000)
     return *(UINT16 *) &ram[addr^2];
 
+  // Plain memory
+  const MemoryPage &page = m_readMap[addr >> 16];
+  if (page.sizes & 2)
+    return *(UINT16 *) &page.ptr[(addr & 0xFFFF) ^ 2];
+
   // Other
   switch ((addr>>24))
   {
@@ -1192,10 +1344,17 @@ UINT32 CModel3::Read32(UINT32 addr)
     return data;
   }
 
+  COUNT_BUS_ACCESS(m_busCounts.reads, addr, 2);
+
   // RAM (most frequently accessed)
   if (addr < 0x00800000)
     return *(UINT32 *) &ram[addr];
 
+  // Plain memory
+  const MemoryPage &page = m_readMap[addr >> 16];
+  if (page.sizes & 4)
+    return *(UINT32 *) &page.ptr[addr & 0xFFFF];
+
   // Other
   switch ((addr>>24))
   {
@@ -1391,10 +1550,24 @@ UINT64 CModel3::Read64(UINT32 addr)
  */
 void CModel3::Write8(UINT32 addr, UINT8 data)
 {
+  COUNT_BUS_ACCESS(m_busCounts.writes, addr, 0);
+
   // RAM (most frequently accessed)
   if (addr < 0x00800000)
   {
     ram[addr^3] = data;
+    m_ramStatePages[addr >> CBlockFile::PageShift] = 1;
+    ppc_invalidate_code(addr);
+    return;
+  }
+
+  // Plain memory
+  const MemoryPage &page = m_writeMap[addr >> 16];
+  if (page.sizes & 1)
+  {
+    page.ptr[(addr & 0xFFFF) ^ 3] = data;
+    if (page.written)
+      *page.written = true;
     return;
   }
 
@@ -1422,7 +1595,10 @@ void CModel3::Write8(UINT32 addr, UINT8 data)
       //printf("PPC: %08X=%02X * (PC=%08X, LR=%08X)\n", addr, data, ppc_get_pc(), ppc_get_lr());
       if ((addr & 0xF) == 0)      // MIDI data port
       {
-        SoundBoard.WriteMIDIPort(data);
+        if (m_deterministic)
+          m_midiQueue.push_back(data);
+        else
+          SoundBoard.WriteMIDIPort(data);
         IRQ.Deassert(0x40);
       }
       else if ((addr & 0xF) == 4) // MIDI control port
@@ -1437,6 +1613,7 @@ void CModel3::Write8(UINT32 addr, UINT8 data)
     case 0x0C:
     case 0x0D:
       backupRAM[(addr&0x1FFFF)^3] = data;
+      m_nvramWritten = true;
       break;
 
     // System registers
@@ -1539,10 +1716,24 @@ void CModel3::Write16(UINT32 addr, UINT16 data)
     return;
   }
 
+  COUNT_BUS_ACCESS(m_busCounts.writes, addr, 1);
+
   // RAM (most frequently accessed)
   if (addr < 0x00800000)
   {
     *(UINT16 *) &ram[addr^2] = data;
+    m_ramStatePages[addr >> CBlockFile::PageShift] = 1;
+    ppc_invalidate_code(addr);
+    return;
+  }
+
+  // Plain memory
+  const MemoryPage &page = m_writeMap[addr >> 16];
+  if (page.sizes & 2)
+  {
+    *(UINT16 *) &page.ptr[(addr & 0xFFFF) ^ 2] = data;
+    if (page.written)
+      *page.written = true;
     return;
   }
 
@@ -1564,6 +1755,7 @@ void CModel3::Write16(UINT32 addr, UINT16 data)
     case 0x0C:
     case 0x0D:
       *(UINT16 *) &backupRAM[(addr&0x1FFFF)^2] = data;
+      m_nvramWritten = true;
       break;
 
     // MPC105
@@ -1632,10 +1824,24 @@ void CModel3::Write32(UINT32 addr, UINT32 data)
     return;
   }
 
+  COUNT_BUS_ACCESS(m_busCounts.writes, addr, 2);
+
   // RAM (most frequently accessed)
   if (addr<0x00800000)
   {
     *(UINT32 *) &ram[addr] = data;
+    m_ramStatePages[addr >> CBlockFile::PageShift] = 1;
+    ppc_invalidate_code(addr);
+    return;
+  }
+
+  // Plain memory
+  const MemoryPage &page = m_writeMap[addr >> 16];
+  if (page.sizes & 4)
+  {
+    *(UINT32 *) &page.ptr[addr & 0xFFFF] = data;
+    if (page.written)
+      *page.written = true;
     return;
   }
 
@@ -1647,7 +1853,7 @@ void CModel3::Write32(UINT32 addr, UINT32 data)
     GPU.Flush();
     break;
 
-  // Real3D low culling RAM
+  // Real3D low culling RAM (aligned PowerPC stores bypass the bus, see CReal3D::MapWriteWindows())
   case 0x8C:  // 8C000000-8C400000
     GPU.WriteLowCullingRAM(addr&0x3FFFFF,FLIPENDIAN32(data));
     break;
@@ -1705,6 +1911,7 @@ void CModel3::Write32(UINT32 addr, UINT32 data)
     case 0x0C:
     case 0x0D:
       *(UINT32 *) &backupRAM[(addr&0x1FFFF)] = data;
+      m_nvramWritten = true;
       break;
 
     // MPC105
@@ -1863,11 +2070,105 @@ void CModel3::Write64(UINT32 addr, UINT64 data)
     Write32(addr+4, (UINT32) data);
 }
 
+/*
+ * Block moves for the DMA devices (SCSI and Real3D). Only plain memory (RAM
+ * and the page map) is accepted as the source, and only Real3D culling RAM,
+ * polygon RAM and the texture FIFO as the destination, which is where games
+ * stream their scene and texture data. Anything else is left to the
+ * word-by-word path.
+ */
+bool CModel3::MoveBlock32(UINT32 dest, UINT32 src, unsigned numWords, bool reverseBytes)
+{
+  if (numWords == 0 || ((dest | src) & 3) != 0 || numWords > (0x400000 / 4))
+    return false;
+
+  // Returns host memory for src and the number of bytes contiguous with it
+  auto Source = [this](UINT32 addr, UINT32 *avail) -> const UINT32 *
+  {
+    if (addr < 0x00800000)
+    {
+      *avail = 0x00800000 - addr;
+      return (const UINT32 *) &ram[addr];
+    }
+    const MemoryPage &page = m_readMap[addr >> 16];
+    if (!(page.sizes & 4))
+      return nullptr;
+    *avail = 0x10000 - (addr & 0xFFFF);
+    return (const UINT32 *) &page.ptr[addr & 0xFFFF];
+  };
+
+  // Destination must lie entirely within one Real3D region (the texture FIFO
+  // ignores the address)
+  void (CReal3D::*WriteBlock)(uint32_t, const uint32_t *, unsigned, bool) = nullptr;
+  UINT32 offset = dest & 0xFFFFFF;
+  UINT32 regionSize = 0;
+  switch (dest >> 24)
+  {
+  case 0x8C:
+    WriteBlock = &CReal3D::WriteLowCullingRAMBlock;
+    regionSize = 0x400000;
+    break;
+  case 0x8E:
+    WriteBlock = &CReal3D::WriteHighCullingRAMBlock;
+    regionSize = 0x100000;
+    break;
+  case 0x94:
+    break;
+  case 0x98:
+    WriteBlock = &CReal3D::WritePolygonRAMBlock;
+    regionSize = 0x400000;
+    break;
+  default:
+    return false;
+  }
+  if (WriteBlock && offset + numWords * 4 > regionSize)
+    return false;
+
+  // Check the whole source range before moving anything
+  UINT32 addr = src;
+  UINT32 remaining = numWords * 4;
+  while (remaining != 0)
+  {
+    UINT32 avail;
+    if (Source(addr, &avail) == nullptr)
+      return false;
+    avail = std::min(avail, remaining);
+    addr += avail;
+    remaining -= avail;
+  }
+
+  // The bus is big endian and Real3D little endian, so words are reversed
+  // on the way in unless the DMA already reversed them
+  addr = src;
+  remaining = numWords * 4;
+  while (remaining != 0)
+  {
+    UINT32 avail;
+    const UINT32 *ptr = Source(addr, &avail);
+    avail = std::min(avail, remaining);
+    if (WriteBlock)
+      (GPU.*WriteBlock)(offset, ptr, avail / 4, !reverseBytes);
+    else
+      GPU.WriteTextureFIFOBlock(ptr, avail / 4, !reverseBytes);
+    offset += avail;
+    addr += avail;
+    remaining -= avail;
+  }
+
+  return true;
+}
+
 
 /******************************************************************************
  Emulation and Interface Functions
 ******************************************************************************/
 
+void CModel3::SaveGraphicsState(CBlockFile *SaveState)
+{
+  GPU.SaveState(SaveState);
+  TileGen.SaveState(SaveState);
+}
+
 void CModel3::SaveState(CBlockFile *SaveState)
 {
   // Write Model 3 state
@@ -1879,7 +2180,7 @@ void CModel3::SaveState(CBlockFile *SaveState)
   SaveState->Write(&adcChannel, sizeof(adcChannel));
   SaveState->Write(&cromBankReg, sizeof(cromBankReg));
   SaveState->Write(&securityPtr, sizeof(securityPtr));
-  SaveState->Write(ram, 0x800000);
+  SaveState->Write(ram, 0x800000, m_ramStatePages);
   SaveState->Write(backupRAM, 0x20000);
   SaveState->Write(securityRAM, 0x20000);
   SaveState->Write(&midiCtrlPort, sizeof(midiCtrlPort));
@@ -1920,6 +2221,7 @@ void CModel3::LoadState(CBlockFile *SaveState)
   SaveState->Read(ram, 0x800000);
   SaveState->Read(backupRAM, 0x20000);
   SaveState->Read(securityRAM, 0x20000);
+  m_nvramWritten = true;
   SaveState->Read(&midiCtrlPort, sizeof(midiCtrlPort));
   int32_t securityFirstRead;
   SaveState->Read(&securityFirstRead, sizeof(securityFirstRead));
@@ -1937,6 +2239,11 @@ void CModel3::LoadState(CBlockFile *SaveState)
   DriveBoard->LoadState(SaveState);
   m_cryptoDevice.LoadState(SaveState);
   m_jtag.LoadState(SaveState);
+
+  // States are saved between frames, when nothing is held back between boards
+  m_midiQueue.clear();
+  m_drvBrdDataWritten = false;
+  m_drvBrdDataIn = DriveBoard->IsAttached() ? DriveBoard->Read() : 0;
 }
 
 void CModel3::SaveNVRAM(CBlockFile *NVRAM)
@@ -1961,17 +2268,50 @@ void CModel3::LoadNVRAM(CBlockFile *NVRAM)
     return;
   }
   NVRAM->Read(backupRAM, 0x20000);
+  m_nvramWritten = true;
 }
 
 void CModel3::ClearNVRAM(void)
 {
   memset(backupRAM, 0, 0x20000);
   EEPROM.Clear();
+  m_nvramWritten = true;
+}
+
+bool CModel3::CheckNVRAMWritten(void)
+{
+  bool written = m_nvramWritten;
+  m_nvramWritten = false;
+  return written;
+}
+
+uint32_t CModel3::GetMemoryChecksum(void) const
+{
+  // Four independent lanes keep the multiplies from waiting on each other. The shift folds the upper bits of each word
+  // back down so that they affect every bit of the result.
+  const uint64_t *words = reinterpret_cast<const uint64_t *>(ram);
+  uint64_t lanes[4] = { 0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, 0xe484222325cbf29cULL, 0x25cbf29ce4842223ULL };
+  for (size_t i = 0; i < 0x800000 / sizeof(uint64_t); i += 4)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      lanes[j] = (lanes[j] ^ words[i + j]) * 0x100000001b3ULL;
+      lanes[j] ^= lanes[j] >> 32;
+    }
+  }
+  uint64_t hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+  hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdULL;
+  hash = (hash ^ (hash >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+  return uint32_t(hash ^ (hash >> 33));
 }
 
 void CModel3::RunFrame(void)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("Frame");
+  UINT64 start = CThread::GetMicros();
+
+  // Inputs don't change during a frame
+  UpdateInputImage();
 
   // See if currently running multi-threaded
   if (m_multiThreaded)
@@ -1980,10 +2320,11 @@ void CModel3::RunFrame(void)
     if (!StartThreads())
       goto ThreadError;
 
-    // Wake threads for PPC main board (if multi-threading GPU), sound board (if sync'd) and drive board (if attached) so they can process a frame
-    if ((m_gpuMultiThreaded       && !ppcBrdThreadSync->Post()) ||
-        (syncSndBrdThread         && !sndBrdThreadSync->Post()) ||
-        (DriveBoard->IsAttached()  && !drvBrdThreadSync->Post()))
+    // Wake threads for PPC main board (if multi-threading GPU), sound board (if sync'd), drive board (if attached) and net board (if emulated) so they can process a frame
+    if ((m_gpuMultiThreaded       && !PostFrameStart(ppcBrdThreadSync, ppcBrdFrameStart)) ||
+        (syncSndBrdThread         && !PostFrameStart(sndBrdThreadSync, sndBrdFrameStart)) ||
+        (DriveBoard->IsAttached()  && !PostFrameStart(drvBrdThreadSync, drvBrdFrameStart)) ||
+        (netBrdThreaded           && !PostFrameStart(netBrdThreadSync, netBrdFrameStart)))
       goto ThreadError;
 
     // If not multi-threading GPU, then run PPC main board for a frame and sync GPUs now in this thread
@@ -1994,43 +2335,68 @@ void CModel3::RunFrame(void)
     }
 
     // Render frame
-    RenderFrame();
+    if (m_videoEnabled)
+      RenderFrame();
+
+    // When synchronizing lock-free, each thread posts once when its frame is done
+    if (m_lockFreeSync)
+    {
+      TRACE_ZONE("Wait for threads");
+      int numThreads = (m_gpuMultiThreaded ? 1 : 0) + (syncSndBrdThread ? 1 : 0) + (DriveBoard->IsAttached() ? 1 : 0) + (netBrdThreaded ? 1 : 0);
+      for (int i = 0; i < numThreads; i++)
+      {
+        if (!frameDone->Wait())
+          goto ThreadError;
+      }
+    }
 
     // Enter notify wait critical section
-    if (!notifyLock->Lock())
+    if (!LockNotify())
       goto ThreadError;
 
-    // Wait for PPC main board, sound board and drive board threads to finish their work (if they are running and haven't finished already)
+    // Wait for PPC main board, sound board, drive board and net board threads to finish their work (if they are running and haven't finished already)
     while ((m_gpuMultiThreaded      && !ppcBrdThreadDone) ||
            (syncSndBrdThread        && !sndBrdThreadDone) ||
-           (DriveBoard->IsAttached() && !drvBrdThreadDone))
+           (DriveBoard->IsAttached() && !drvBrdThreadDone) ||
+           (netBrdThreaded          && !netBrdThreadDone))
     {
-      if (!notifySync->Wait(notifyLock))
+      if (!WaitNotify())
         goto ThreadError;
     }
     ppcBrdThreadDone = false;
     sndBrdThreadDone = false;
     drvBrdThreadDone = false;
+    netBrdThreadDone = false;
 
     // Leave notify wait critical section
-    if (!notifyLock->Unlock())
+    if (!UnlockNotify())
       goto ThreadError;
 
     // If multi-threading GPU, then sync GPUs last while PPC main board thread is waiting
     if (m_gpuMultiThreaded)
       SyncGPUs();
 
+    // Without audio output, the unsync'd sound board thread is idle and the sound board runs here
+    if (!m_audioEnabled && !syncSndBrdThread)
+      RunSoundBoardFrame();
+
 #ifdef NET_BOARD
-    if (NetBoard->IsRunning() && m_config["SimulateNet"].ValueAs<bool>())
+    // The simulated net board has no CPU of its own and swaps CommRAM banks, so it runs here between frames, as does the
+    // emulated one when deterministic
+    if (NetBoard->IsRunning() && !netBrdThreaded)
         RunNetBoardFrame();
 #endif
+
+    if (m_deterministic)
+      ExchangeBoardData();
   }
   else
   {
     // If not multi-threaded, then just process and render a single frame for PPC main board, sound board and drive board in turn in this thread
     RunMainBoardFrame();
     SyncGPUs();
-    RenderFrame();
+    if (m_videoEnabled)
+      RenderFrame();
     RunSoundBoardFrame();
     if (DriveBoard->IsAttached())
       RunDriveBoardFrame();
@@ -2038,9 +2404,13 @@ void CModel3::RunFrame(void)
     if (NetBoard->IsRunning())
       RunNetBoardFrame();
 #endif
+
+    // Still needed if threading failed and fell back to this
+    if (m_deterministic)
+      ExchangeBoardData();
   }
 
-  timings.frameTicks = CThread::GetTicks() - start;
+  timings.frameMicros = UINT32(CThread::GetMicros() - start);
   // Frame counter
   timings.frameId++;
   return;
@@ -2050,9 +2420,8 @@ ThreadError:
   m_multiThreaded = false;
 }
 
-static unsigned GetCPUClockFrequencyInHz(const Game &game, Util::Config::Node &config)
+static unsigned GetCPUClockFrequencyInHz(const Game &game, unsigned mhz)
 {
-  unsigned mhz = config["PowerPCFrequency"].ValueAsDefault<unsigned>(0);
   if (!mhz)
   {
     if (game.stepping == "1.0")
@@ -2073,7 +2442,12 @@ static unsigned GetCPUClockFrequencyInHz(const Game &game, Util::Config::Node &c
 
 void CModel3::RunMainBoardFrame(void)
 {
-	UINT32 start = CThread::GetTicks();
+	TRACE_ZONE("Main board");
+	UINT64 start = CThread::GetMicros();
+	UINT64 startCycles = ppc_total_cycles();
+
+	// Bring the Real3D working memory up to date after the snapshot swap, before the PPC can write to it
+	timings.copySize = GPU.CatchUpWorkingMemory();
 
 	/* 
    * Compute display timings. Refresh rate is 57.524160 Hz and we assume frame timing is the same as System 24:
@@ -2085,7 +2459,7 @@ void CModel3::RunMainBoardFrame(void)
 	 *
    * 424 lines total: 384 display and 40 blanking/vsync.
 	 */ 
-	unsigned ppcCycles		= GetCPUClockFrequencyInHz(m_game, m_config);
+	unsigned ppcCycles		= GetCPUClockFrequencyInHz(m_game, m_ppcFrequency.Get());
 	unsigned frameCycles	= (unsigned)((float)ppcCycles / 57.524160f);
 	unsigned lineCycles     = frameCycles / 424;
 	unsigned dispCycles     = lineCycles * (TileGen.ReadRegister(0x08) + 40);
@@ -2112,13 +2486,14 @@ void CModel3::RunMainBoardFrame(void)
 		ppc_execute(offsetCycles);
 		IRQ.Assert(0x02);								// start at 33% of the frame
 
-		// keep running cycles until IRQ2 is acknowledged
+		// keep running cycles until IRQ2 is acknowledged, which ends the time slice (see WriteSystemRegister())
 		// Ski Champ can hang if we check the MIDI control port too early
 		// and miss MIDI interrupts pending before the next IRQ2
-		while (IRQ.ReadIRQEnable() & 0x2 && IRQ.ReadIRQState() & 0x2 && dispCycles > 1000)
+		if ((IRQ.ReadIRQEnable() & IRQ.ReadIRQState() & 0x2) && dispCycles > 1000)
 		{
-			ppc_execute(1000);
-			dispCycles -= 1000;
+			m_irqWait = 0x02;
+			dispCycles -= ppc_execute(dispCycles - 1000);
+			m_irqWait = 0;
 		}
 
 		/*
@@ -2142,8 +2517,7 @@ void CModel3::RunMainBoardFrame(void)
 
 			// Process MIDI interrupt
 			IRQ.Assert(0x40);
-			ppc_execute(1000); // give PowerPC time to acknowledge IR
-			dispCycles -= 1000;
+			dispCycles -= ppc_execute(1000); // give PowerPC time to acknowledge IR
 
 			++irqCount;
 			if (irqCount > 128)
@@ -2162,27 +2536,43 @@ void CModel3::RunMainBoardFrame(void)
 	// Run the PowerPC for the active display part of the frame
 	ppc_execute(dispCycles);
 
-	timings.ppcTicks = CThread::GetTicks() - start;
+	timings.ppcMicros = UINT32(CThread::GetMicros() - start);
+	timings.ppcCycles = UINT32(ppc_total_cycles() - startCycles);
+
+#ifdef SUPERMODEL_TRACE
+	TRACE_COUNTER("PPC cycles", timings.ppcCycles);
+	for (int i = 0; i < BusAccessCounts::NumRegions; i++)
+	{
+		const UINT32 *r = m_busCounts.reads[i], *w = m_busCounts.writes[i];
+		TRACE_COUNTER(BusAccessCounts::regionNames[i], r[0] + r[1] + r[2] + w[0] + w[1] + w[2]);
+	}
+	m_lastBusCounts = m_busCounts;
+	m_busCounts = BusAccessCounts();
+#endif
 }
 
 void CModel3::SyncGPUs(void)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("Sync GPUs");
+  UINT64 start = CThread::GetMicros();
 
-  timings.syncSize = GPU.SyncSnapshots() + TileGen.SyncSnapshots();
+  // Tile generator layers are only drawn for frames that are rendered
+  timings.syncSize = GPU.SyncSnapshots() + (m_videoEnabled ? TileGen.SyncSnapshots() : 0);
   gpusReady = true;
 
-  timings.syncTicks = CThread::GetTicks() - start;
+  timings.syncMicros = UINT32(CThread::GetMicros() - start);
 }
 
 void CModel3::RenderFrame(void)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("Render");
+  UINT64 start = CThread::GetMicros();
 
   // Call OSD video callbacks
   if (BeginFrameVideo() && gpusReady)
   {
     // Render frame
+    m_superAA->BeginFrame();
     TileGen.BeginFrame();
     GPU.BeginFrame();
     TileGen.PreRenderFrame();
@@ -2192,26 +2582,78 @@ void CModel3::RenderFrame(void)
     GPU.EndFrame();
     TileGen.EndFrame();
     m_superAA->Draw();
+    timings.resolveMicros = m_superAA->GetResolveMicros();
+    timings.gpuMicros = m_superAA->GetFrameMicros();
+    timings.tileGenMicros = m_render2D->GetGPUMicros();
+    m_render3D->GetGPUTimings(&timings.render3DMicros);
+    m_render3D->GetRenderStats(&timings.render3DStats);
   }
 
   EndFrameVideo();
 
-  timings.renderTicks = CThread::GetTicks() - start;
+  timings.renderMicros = UINT32(CThread::GetMicros() - start);
+}
+
+void CModel3::SetOutputEnabled(bool video, bool audio)
+{
+  m_videoEnabled = video;
+  if (audio == m_audioEnabled)
+    return;
+
+  // An unsync'd sound board thread is paced by the audio device, so while there is no audio output the sound board runs in
+  // step with each frame instead (see RunFrame())
+  if (startedThreads && !syncSndBrdThread)
+  {
+    SetAudioCallback(NULL, NULL);
+    PauseThreads();
+    m_audioEnabled = audio;
+    SoundBoard.SetOutputEnabled(audio);
+    ResumeThreads();
+    if (audio)
+      SetAudioCallback(AudioCallback, this);
+    return;
+  }
+
+  m_audioEnabled = audio;
+  SoundBoard.SetOutputEnabled(audio);
+}
+
+/*
+ * With deterministic multi-threading, the sound and drive boards run their frames alongside the PowerPC's rather than
+ * after it, so whatever passes between them is held back and handed over here, once every thread has finished its
+ * frame. Each board thus sees exactly the same data at the same point in its frame on every run, one frame later than
+ * single-threaded emulation would deliver it.
+ */
+void CModel3::ExchangeBoardData(void)
+{
+  for (UINT8 data: m_midiQueue)
+    SoundBoard.WriteMIDIPort(data);
+  m_midiQueue.clear();
+
+  if (DriveBoard->IsAttached())
+  {
+    if (m_drvBrdDataWritten)
+      DriveBoard->Write(m_drvBrdDataOut);
+    m_drvBrdDataWritten = false;
+    m_drvBrdDataIn = DriveBoard->Read();
+  }
 }
 
 bool CModel3::RunSoundBoardFrame(void)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("Sound board");
+  UINT64 start = CThread::GetMicros();
   bool bufferFull = SoundBoard.RunFrame();
-  timings.sndTicks = CThread::GetTicks() - start;
+  timings.sndMicros = UINT32(CThread::GetMicros() - start);
   return bufferFull;
 }
 
 void CModel3::RunDriveBoardFrame(void)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("Drive board");
+  UINT64 start = CThread::GetMicros();
   DriveBoard->RunFrame();
-  timings.drvTicks = CThread::GetTicks() - start;
+  timings.drvMicros = UINT32(CThread::GetMicros() - start);
 }
 
 #ifdef NET_BOARD
@@ -2248,12 +2690,28 @@ bool CModel3::StartThreads(void)
     if (drvBrdThreadSync == NULL)
       goto ThreadError;
   }
+  if (netBrdThreaded)
+  {
+    netBrdThreadSync = CThread::CreateSemaphore(0);
+    if (netBrdThreadSync == NULL)
+      goto ThreadError;
+  }
   notifyLock = CThread::CreateMutex();
   if (notifyLock == NULL)
     goto ThreadError;
   notifySync = CThread::CreateCondVar();
   if (notifySync == NULL)
     goto ThreadError;
+  if (m_lockFreeSync)
+  {
+    ppcBrdFrameStart = CThread::CreateFastSemaphore(0);
+    sndBrdFrameStart = CThread::CreateFastSemaphore(0);
+    drvBrdFrameStart = CThread::CreateFastSemaphore(0);
+    netBrdFrameStart = CThread::CreateFastSemaphore(0);
+    frameDone = CThread::CreateFastSemaphore(0);
+    if (ppcBrdFrameStart == NULL || sndBrdFrameStart == NULL || drvBrdFrameStart == NULL || netBrdFrameStart == NULL || frameDone == NULL)
+      goto ThreadError;
+  }
 
   // Reset thread flags
   pauseThreads = false;
@@ -2283,6 +2741,14 @@ bool CModel3::StartThreads(void)
       goto ThreadError;
   }
 
+  // Create net board thread, if emulating the net board's 68K
+  if (netBrdThreaded)
+  {
+    netBrdThread = CThread::CreateThread("NetBoard", StartNetBoardThread, this);
+    if (netBrdThread == NULL)
+      goto ThreadError;
+  }
+
   // Set audio callback if sound board thread is unsync'd
   if (!syncSndBrdThread)
   {
@@ -2305,19 +2771,19 @@ bool CModel3::PauseThreads(void)
     return true;
 
   // Enter notify critical section
-  if (!notifyLock->Lock())
+  if (!LockNotify())
     goto ThreadError;
 
   // Let threads know that they should pause and wait for all of them to do so
   pauseThreads = true;
-  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning)
+  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning || netBrdThreadRunning)
   {
-    if (!notifySync->Wait(notifyLock))
+    if (!WaitNotify())
       goto ThreadError;
   }
 
   // Leave notify critical section
-  if (!notifyLock->Unlock())
+  if (!UnlockNotify())
     goto ThreadError;
   return true;
 
@@ -2333,14 +2799,14 @@ bool CModel3::ResumeThreads(void)
     return true;
 
   // Enter notify critical section
-  if (!notifyLock->Lock())
+  if (!LockNotify())
     goto ThreadError;
 
   // Let all threads know that they can continue running
   pauseThreads = false;
 
   // Leave notify critical section
-  if (!notifyLock->Unlock())
+  if (!UnlockNotify())
     goto ThreadError;
   return true;
 
@@ -2360,14 +2826,14 @@ bool CModel3::StopThreads(void)
     SetAudioCallback(NULL, NULL);
 
   // Enter notify critical section
-  if (!notifyLock->Lock())
+  if (!LockNotify())
     goto ThreadError;
 
   // Let threads know that they should pause and wait for all of them to do so
   pauseThreads = true;
-  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning)
+  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning || netBrdThreadRunning)
   {
-    if (!notifySync->Wait(notifyLock))
+    if (!WaitNotify())
       goto ThreadError;
   }
 
@@ -2375,20 +2841,20 @@ bool CModel3::StopThreads(void)
   stopThreads = true;
 
   // Leave notify critical section
-  if (!notifyLock->Unlock())
+  if (!UnlockNotify())
     goto ThreadError;
 
   // Resume each thread in turn and wait for them to exit
   if (ppcBrdThread != NULL)
   {
-    if (ppcBrdThreadSync->Post())
+    if (PostFrameStart(ppcBrdThreadSync, ppcBrdFrameStart))
       ppcBrdThread->Wait();
   }
   if (sndBrdThread != NULL)
   {
     if (syncSndBrdThread)
     {
-      if (sndBrdThreadSync->Post())
+      if (PostFrameStart(sndBrdThreadSync, sndBrdFrameStart))
         sndBrdThread->Wait();
     }
     else
@@ -2399,9 +2865,14 @@ bool CModel3::StopThreads(void)
   }
   if (drvBrdThread != NULL)
   {
-    if (drvBrdThreadSync->Post())
+    if (PostFrameStart(drvBrdThreadSync, drvBrdFrameStart))
       drvBrdThread->Wait();
   }
+  if (netBrdThread != NULL)
+  {
+    if (PostFrameStart(netBrdThreadSync, netBrdFrameStart))
+      netBrdThread->Wait();
+  }
 
   // Delete all thread and synchronization objects
   DeleteThreadObjects();
@@ -2432,6 +2903,11 @@ void CModel3::DeleteThreadObjects(void)
     delete drvBrdThread;
     drvBrdThread = NULL;
   }
+  if (netBrdThread != NULL)
+  {
+    delete netBrdThread;
+    netBrdThread = NULL;
+  }
 
 
   // Delete synchronization objects
@@ -2450,6 +2926,11 @@ void CModel3::DeleteThreadObjects(void)
     delete drvBrdThreadSync;
     drvBrdThreadSync = NULL;
   }
+  if (netBrdThreadSync != NULL)
+  {
+    delete netBrdThreadSync;
+    netBrdThreadSync = NULL;
+  }
 
 
   if (sndBrdNotifyLock != NULL)
@@ -2472,18 +2953,95 @@ void CModel3::DeleteThreadObjects(void)
     delete notifySync;
     notifySync = NULL;
   }
+
+  delete ppcBrdFrameStart;
+  delete sndBrdFrameStart;
+  delete drvBrdFrameStart;
+  delete netBrdFrameStart;
+  delete frameDone;
+  ppcBrdFrameStart = NULL;
+  sndBrdFrameStart = NULL;
+  drvBrdFrameStart = NULL;
+  netBrdFrameStart = NULL;
+  frameDone = NULL;
+}
+
+/*
+ * The notify critical section protects the thread state flags. When
+ * synchronizing lock-free (LockFreeThreadSync), the flags are only accessed
+ * atomically, the frame handoff is performed with fast semaphores, and the
+ * rare waits for threads to pause simply poll.
+ */
+
+bool CModel3::LockNotify(void)
+{
+  return m_lockFreeSync || notifyLock->Lock();
+}
+
+bool CModel3::UnlockNotify(void)
+{
+  return m_lockFreeSync || notifyLock->Unlock();
+}
+
+bool CModel3::SignalNotify(void)
+{
+  return m_lockFreeSync || notifySync->SignalAll();
+}
+
+bool CModel3::WaitNotify(void)
+{
+  TRACE_ZONE("Wait for threads");
+  if (!m_lockFreeSync)
+    return notifySync->Wait(notifyLock);
+  CThread::Sleep(1);
+  return true;
+}
+
+bool CModel3::PostFrameStart(CSemaphore *sync, CFastSemaphore *fastSync)
+{
+  return m_lockFreeSync ? fastSync->Post() : sync->Post();
+}
+
+bool CModel3::WaitFrameStart(CSemaphore *sync, CFastSemaphore *fastSync)
+{
+  TRACE_ZONE("Wait for frame start");
+  return m_lockFreeSync ? fastSync->Wait() : sync->Wait();
 }
 
 void CModel3::DumpTimings(void)
 {
-  printf("PPC:%3ums%c render:%3ums%c sync:%4uK%c%3ums%c snd:%3ums%c drv:%3ums%c frame:%3ums%c\n",
-    timings.ppcTicks, (timings.ppcTicks > timings.renderTicks ? '!' : ','),
-    timings.renderTicks, (timings.renderTicks > timings.ppcTicks ? '!' : ','),
+  // CPU side, then GPU side. A '!' marks a value over its budget (or the
+  // larger of PPC and render time, which bounds the frame when multi-threaded).
+  const GPUPassTimings &gpu = timings.render3DMicros;
+  printf("PPC:%6uus%c render:%6uus%c sync:%4uK%c%5uus%c copy:%4uK%c snd:%5uus%c drv:%5uus%c frame:%6uus%c\n",
+    timings.ppcMicros, (timings.ppcMicros > timings.renderMicros ? '!' : ','),
+    timings.renderMicros, (timings.renderMicros > timings.ppcMicros ? '!' : ','),
     timings.syncSize / 1024, (timings.syncSize / 1024 > 128 ? '!' : ','),
-    timings.syncTicks, (timings.syncTicks > 1 ? '!' : ','),
-    timings.sndTicks, (timings.sndTicks > 10 ? '!' : ','),
-    timings.drvTicks, (timings.drvTicks > 10 ? '!' : ','),
-    timings.frameTicks, (timings.frameTicks > 16 ? '!' : ' '));
+    timings.syncMicros, (timings.syncMicros > 1000 ? '!' : ','),
+    timings.copySize / 1024, (timings.copySize / 1024 > 128 ? '!' : ','),
+    timings.sndMicros, (timings.sndMicros > 10000 ? '!' : ','),
+    timings.drvMicros, (timings.drvMicros > 10000 ? '!' : ','),
+    timings.frameMicros, (timings.frameMicros > 16000 ? '!' : ' '));
+  printf("  gpu:%5uus%c 2D:%5uus fog:%5uus layers:%5u/%5u/%5u/%5uus composite:%5uus resolve:%5uus%c\n",
+    timings.gpuMicros, (timings.gpuMicros > 16000 ? '!' : ','),
+    timings.tileGenMicros, gpu.fogMicros,
+    gpu.layerMicros[0], gpu.layerMicros[1], gpu.layerMicros[2], gpu.layerMicros[3],
+    gpu.compositeMicros,
+    timings.resolveMicros, (timings.resolveMicros > 2000 ? '!' : ' '));
+  printf("  PPC: %u cycles\n", timings.ppcCycles);
+#ifdef SUPERMODEL_TRACE
+  // Bus accesses by 8/16/32-bit size, regions that weren't touched are left out
+  for (int i = 0; i < BusAccessCounts::NumRegions; i++)
+  {
+    const UINT32 *r = m_lastBusCounts.reads[i], *w = m_lastBusCounts.writes[i];
+    if (r[0] + r[1] + r[2] + w[0] + w[1] + w[2] != 0)
+      printf("    %-12s read:%7u/%7u/%7u  write:%7u/%7u/%7u\n", BusAccessCounts::regionNames[i], r[0], r[1], r[2], w[0], w[1], w[2]);
+  }
+#endif
+  const RenderStats &stats = timings.render3DStats;
+  printf("  3D: %u viewports, %u nodes, %u models (%u cached, %u decoded), %u meshes, %u draws, %u uniforms, %uK verts, %uK texels uploaded\n",
+    stats.viewports, stats.nodes, stats.models, stats.modelCacheHits, stats.modelCacheMisses, stats.meshes,
+    stats.drawCalls, stats.uniformUpdates, stats.vertsUploaded / 1024, stats.texelsUploaded / 1024);
 }
 
 FrameTimings CModel3::GetTimings(void)
@@ -2519,8 +3077,16 @@ int CModel3::StartDriveBoardThread(void *data)
   return model3->RunDriveBoardThread();
 }
 
+int CModel3::StartNetBoardThread(void *data)
+{
+  // Call method on CModel3 to run net board thread
+  CModel3 *model3 = (CModel3*)data;
+  return model3->RunNetBoardThread();
+}
+
 int CModel3::RunMainBoardThread(void)
 {
+  TRACE_THREAD("Main board");
   for (;;)
   {
     bool wait = true;
@@ -2528,11 +3094,11 @@ int CModel3::RunMainBoardThread(void)
     while (wait && !exit)
     {
       // Wait on PPC main board thread semaphore
-      if (!ppcBrdThreadSync->Wait())
+      if (!WaitFrameStart(ppcBrdThreadSync, ppcBrdFrameStart))
         goto ThreadError;
 
       // Enter notify critical section
-      if (!notifyLock->Lock())
+      if (!LockNotify())
         goto ThreadError;
 
       // Check threads are not being stopped or paused
@@ -2545,7 +3111,7 @@ int CModel3::RunMainBoardThread(void)
       }
 
       // Leave notify critical section
-      if (!notifyLock->Unlock())
+      if (!UnlockNotify())
         goto ThreadError;
     }
     if (exit)
@@ -2555,17 +3121,19 @@ int CModel3::RunMainBoardThread(void)
     RunMainBoardFrame();
 
     // Enter notify critical section
-    if (!notifyLock->Lock())
+    if (!LockNotify())
       goto ThreadError;
 
     // Let other threads know processing has finished
     ppcBrdThreadRunning = false;
     ppcBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (!SignalNotify())
       goto ThreadError;
 
     // Leave notify critical section
-    if (!notifyLock->Unlock())
+    if (!UnlockNotify())
+      goto ThreadError;
+    if (m_lockFreeSync && !frameDone->Post())
       goto ThreadError;
   }
 
@@ -2590,14 +3158,14 @@ bool CModel3::WakeSoundBoardThread(void)
     goto ThreadError;
 
   // Enter main notify critical section
-  if (!notifyLock->Lock())
+  if (!LockNotify())
     goto ThreadError;
 
   // See if sound board thread is currently running
   wake = !sndBrdThreadRunning;
 
   // Leave main notify critical section
-  if (!notifyLock->Unlock())
+  if (!UnlockNotify())
     goto ThreadError;
 
   // Only send wake notification to sound board thread if it was not running
@@ -2622,6 +3190,7 @@ ThreadError:
 
 int CModel3::RunSoundBoardThread(void)
 {
+  TRACE_THREAD("Sound board");
   for (;;)
   {
     bool wait = true;
@@ -2635,26 +3204,32 @@ int CModel3::RunSoundBoardThread(void)
       // Wait for notification from audio callback
       while (!sndBrdWakeNotify)
       {
+        TRACE_ZONE("Wait for audio");
         if (!sndBrdNotifySync->Wait(sndBrdNotifyLock))
           goto ThreadError;
       }
       sndBrdWakeNotify = false;
 
       // Enter main notify critical section
-      if (!notifyLock->Lock())
+      if (!LockNotify())
         goto ThreadError;
 
-      // Check threads are not being stopped or paused
+      // Check threads are not being stopped or paused. The running flag is set
+      // before testing for a pause so that, when lock-free, PauseThreads() cannot
+      // miss this thread starting.
       if (stopThreads)
         exit = true;
-      else if (!pauseThreads)
+      else
       {
-        wait = false;
         sndBrdThreadRunning = true;
+        if (pauseThreads)
+          sndBrdThreadRunning = false;
+        else
+          wait = false;
       }
 
       // Leave main notify critical section
-      if (!notifyLock->Unlock())
+      if (!UnlockNotify())
         goto ThreadError;
 
       // Leave sound board notify critical section
@@ -2669,13 +3244,13 @@ int CModel3::RunSoundBoardThread(void)
     {
       // Enter main notify critical section
       bool paused;
-      if (!notifyLock->Lock())
+      if (!LockNotify())
         goto ThreadError;
 
       paused = pauseThreads;
 
       // Leave main notify critical section
-      if (!notifyLock->Unlock())
+      if (!UnlockNotify())
         goto ThreadError;
 
       if (paused || RunSoundBoardFrame())
@@ -2684,17 +3259,17 @@ int CModel3::RunSoundBoardThread(void)
     }
 
     // Enter main notify critical section
-    if (!notifyLock->Lock())
+    if (!LockNotify())
       goto ThreadError;
 
     // Let other threads know processing has finished
     sndBrdThreadRunning = false;
     sndBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (!SignalNotify())
       goto ThreadError;
 
     // Leave main notify critical section
-    if (!notifyLock->Unlock())
+    if (!UnlockNotify())
       goto ThreadError;
   }
 
@@ -2706,6 +3281,7 @@ ThreadError:
 
 int CModel3::RunSoundBoardThreadSyncd(void)
 {
+  TRACE_THREAD("Sound board");
   for (;;)
   {
     bool wait = true;
@@ -2713,11 +3289,11 @@ int CModel3::RunSoundBoardThreadSyncd(void)
     while (wait && !exit)
     {
       // Wait on sound board thread semaphore
-      if (!sndBrdThreadSync->Wait())
+      if (!WaitFrameStart(sndBrdThreadSync, sndBrdFrameStart))
         goto ThreadError;
 
       // Enter notify critical section
-      if (!notifyLock->Lock())
+      if (!LockNotify())
         goto ThreadError;
 
       // Check threads are not being stopped or paused
@@ -2730,7 +3306,7 @@ int CModel3::RunSoundBoardThreadSyncd(void)
       }
 
       // Leave notify critical section
-      if (!notifyLock->Unlock())
+      if (!UnlockNotify())
         goto ThreadError;
     }
     if (exit)
@@ -2740,17 +3316,19 @@ int CModel3::RunSoundBoardThreadSyncd(void)
     RunSoundBoardFrame();
 
     // Enter notify critical section
-    if (!notifyLock->Lock())
+    if (!LockNotify())
       goto ThreadError;
 
     // Let other threads know processing has finished
     sndBrdThreadRunning = false;
     sndBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (!SignalNotify())
       goto ThreadError;
 
     // Leave notify critical section
-    if (!notifyLock->Unlock())
+    if (!UnlockNotify())
+      goto ThreadError;
+    if (m_lockFreeSync && !frameDone->Post())
       goto ThreadError;
   }
 
@@ -2762,6 +3340,7 @@ ThreadError:
 
 int CModel3::RunDriveBoardThread(void)
 {
+  TRACE_THREAD("Drive board");
   for (;;)
   {
     bool wait = true;
@@ -2769,11 +3348,11 @@ int CModel3::RunDriveBoardThread(void)
     while (wait && !exit)
     {
       // Wait on drive board thread semaphore
-      if (!drvBrdThreadSync->Wait())
+      if (!WaitFrameStart(drvBrdThreadSync, drvBrdFrameStart))
         goto ThreadError;
 
       // Enter notify critical section
-      if (!notifyLock->Lock())
+      if (!LockNotify())
         goto ThreadError;
 
       // Check threads are not being stopped or paused
@@ -2786,7 +3365,7 @@ int CModel3::RunDriveBoardThread(void)
       }
 
       // Leave notify critical section
-      if (!notifyLock->Unlock())
+      if (!UnlockNotify())
         goto ThreadError;
     }
     if (exit)
@@ -2796,17 +3375,19 @@ int CModel3::RunDriveBoardThread(void)
     RunDriveBoardFrame();
 
     // Enter notify critical section
-    if (!notifyLock->Lock())
+    if (!LockNotify())
       goto ThreadError;
 
     // Let other threads know processing has finished
     drvBrdThreadRunning = false;
     drvBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (!SignalNotify())
       goto ThreadError;
 
     // Leave notify critical section
-    if (!notifyLock->Unlock())
+    if (!UnlockNotify())
+      goto ThreadError;
+    if (m_lockFreeSync && !frameDone->Post())
       goto ThreadError;
   }
 
@@ -2816,12 +3397,74 @@ ThreadError:
   return 1;
 }
 
+int CModel3::RunNetBoardThread(void)
+{
+  TRACE_THREAD("Net board");
+  for (;;)
+  {
+    bool wait = true;
+    bool exit = false;
+    while (wait && !exit)
+    {
+      // Wait on net board thread semaphore
+      if (!WaitFrameStart(netBrdThreadSync, netBrdFrameStart))
+        goto ThreadError;
+
+      // Enter notify critical section
+      if (!LockNotify())
+        goto ThreadError;
+
+      // Check threads are not being stopped or paused
+      if (stopThreads)
+        exit = true;
+      else if (!pauseThreads)
+      {
+        wait = false;
+        netBrdThreadRunning = true;
+      }
+
+      // Leave notify critical section
+      if (!UnlockNotify())
+        goto ThreadError;
+    }
+    if (exit)
+      return 0;
+
+    // Process a single frame for net board
+#ifdef NET_BOARD
+    RunNetBoardFrame();
+#endif
+
+    // Enter notify critical section
+    if (!LockNotify())
+      goto ThreadError;
+
+    // Let other threads know processing has finished
+    netBrdThreadRunning = false;
+    netBrdThreadDone = true;
+    if (!SignalNotify())
+      goto ThreadError;
+
+    // Leave notify critical section
+    if (!UnlockNotify())
+      goto ThreadError;
+    if (m_lockFreeSync && !frameDone->Post())
+      goto ThreadError;
+  }
+
+ThreadError:
+  ErrorLog("Threading error in RunNetBoardThread: %s\nSwitching back to single-threaded mode.\n", CThread::GetLastError());
+  m_multiThreaded = false;
+  return 1;
+}
+
 void CModel3::Reset(void)
 {
   // Clear memory (but do not modify backup RAM!)
   memset(ram, 0, 0x800000);
 
   // Initial bank is bank 0
+  BuildMemoryMap();
   SetCROMBank(0xFF);
 
   // Reset security device
@@ -2855,19 +3498,31 @@ void CModel3::Reset(void)
 
   m_cryptoDevice.Reset();
 
+  // Nothing is held back between boards at a frame boundary
+  m_midiQueue.clear();
+  m_drvBrdDataWritten = false;
+  m_drvBrdDataIn = DriveBoard->IsAttached() ? DriveBoard->Read() : 0;
+
   gpusReady = false;
 
-  timings.ppcTicks = 0;
+  timings.ppcMicros = 0;
+  timings.ppcCycles = 0;
   timings.syncSize = 0;
-  timings.syncTicks = 0;
-  timings.renderTicks = 0;
-  timings.sndTicks = 0;
-  timings.drvTicks = 0;
+  timings.copySize = 0;
+  timings.syncMicros = 0;
+  timings.renderMicros = 0;
+  timings.resolveMicros = 0;
+  timings.gpuMicros = 0;
+  timings.tileGenMicros = 0;
+  timings.render3DMicros = GPUPassTimings();
+  timings.render3DStats = RenderStats();
+  timings.sndMicros = 0;
+  timings.drvMicros = 0;
 #ifdef NET_BOARD
-  timings.netTicks = 0;
+  timings.netMicros = 0;
   NetBoard->Reset();
 #endif
-  timings.frameTicks = 0;
+  timings.frameMicros = 0;
   timings.frameId = 0;
   
   DebugLog("Model 3 reset\n");
@@ -2883,54 +3538,80 @@ const Game &CModel3::GetGame() const
   return m_game;
 }
 
+static std::vector<ROMImageCache::Section> GetROMImageSections(UINT8 *pool);
+
 // Stepping-dependent parameters (MPC10x type, etc.) are initialized here
 Result CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
 {
   m_game = Game();
 
-  /*
-   * Copy in ROM data with mirroring as necessary for the following cases:
-   *
-   *  - VROM: 64MB. If <= 32MB, mirror to high 32MB.
-   *  - Banked CROM: 128MB. If <= 64MB, mirror to high 64MB.
-   *  - Fixed CROM: 8MB. If < 8MB, loaded only in high part of space and low
-   *    part is a mirror of (banked) CROM0.
-   *  - Sample ROM: 16MB. If <= 8MB, mirror to high 8MB.
-   */
-  if (rom_set.get_rom("vrom").size <= 32*0x100000)
-  {
-    rom_set.get_rom("vrom").CopyTo(&vrom[0], 32*100000);
-    rom_set.get_rom("vrom").CopyTo(&vrom[32*0x100000], 32*0x100000);
-  }
-  else
-    rom_set.get_rom("vrom").CopyTo(vrom, 64*0x100000);
-  if (rom_set.get_rom("banked_crom").size <= 64*0x100000)
-  {
-    rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 64*0x100000);
-    rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 64*0x100000], 64*0x100000);
-  }
-  else
-    rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 128*0x100000);
-  size_t crom_size = rom_set.get_rom("crom").size;
-  rom_set.get_rom("crom").CopyTo(&crom[8*0x100000 - crom_size], crom_size);
-  if (crom_size < 8*0x100000)
-    rom_set.get_rom("banked_crom").CopyTo(&crom[0], 8*0x100000 - crom_size);
-  if (rom_set.get_rom("sound_samples").size <= 8*0x100000)
+  // Processed ROM images can be mapped from the cache rather than rebuilt
+  // from the ROM set. A ROM set loaded without data can only come from the
+  // cache, even if a game-specific setting has since disabled it.
+  bool romCache = !rom_set.cache_key.empty() && (m_config["ROMCache"].ValueAs<bool>() || !rom_set.get_rom("crom").data);
+  std::string romCachePath = ROMImageCache::GetPath(game.name);
+  std::vector<ROMImageCache::Section> romSections = GetROMImageSections(memoryPool);
+  if (!romCache || !ROMImageCache::Load(romCachePath, rom_set.cache_key, romSections))
   {
-    rom_set.get_rom("sound_samples").CopyTo(&sampleROM[0], 8*0x100000);
-    rom_set.get_rom("sound_samples").CopyTo(&sampleROM[8*0x100000], 8*0x100000);
+    if (!rom_set.get_rom("crom").data)
+      return ErrorLog("ROM image cache '%s' could not be loaded.", romCachePath.c_str());
+
+    /*
+     * Copy in ROM data with mirroring as necessary for the following cases:
+     *
+     *  - VROM: 64MB. If <= 32MB, mirror to high 32MB.
+     *  - Banked CROM: 128MB. If <= 64MB, mirror to high 64MB.
+     *  - Fixed CROM: 8MB. If < 8MB, loaded only in high part of space and low
+     *    part is a mirror of (banked) CROM0.
+     *  - Sample ROM: 16MB. If <= 8MB, mirror to high 8MB.
+     */
+    if (rom_set.get_rom("vrom").size <= 32*0x100000)
+    {
+      rom_set.get_rom("vrom").CopyTo(&vrom[0], 32*100000);
+      rom_set.get_rom("vrom").CopyTo(&vrom[32*0x100000], 32*0x100000);
+    }
+    else
+      rom_set.get_rom("vrom").CopyTo(vrom, 64*0x100000);
+    if (rom_set.get_rom("banked_crom").size <= 64*0x100000)
+    {
+      rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 64*0x100000);
+      rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 64*0x100000], 64*0x100000);
+    }
+    else
+      rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 128*0x100000);
+    size_t crom_size = rom_set.get_rom("crom").size;
+    rom_set.get_rom("crom").CopyTo(&crom[8*0x100000 - crom_size], crom_size);
+    if (crom_size < 8*0x100000)
+      rom_set.get_rom("banked_crom").CopyTo(&crom[0], 8*0x100000 - crom_size);
+    if (rom_set.get_rom("sound_samples").size <= 8*0x100000)
+    {
+      rom_set.get_rom("sound_samples").CopyTo(&sampleROM[0], 8*0x100000);
+      rom_set.get_rom("sound_samples").CopyTo(&sampleROM[8*0x100000], 8*0x100000);
+    }
+    else
+      rom_set.get_rom("sound_samples").CopyTo(sampleROM, 16*0x100000);
+    rom_set.get_rom("sound_program").CopyTo(soundROM, 512*1024);
+    rom_set.get_rom("mpeg_program").CopyTo(dsbROM, 128*1024);
+    rom_set.get_rom("mpeg_music").CopyTo(mpegROM, 16*0x100000);
+    rom_set.get_rom("driveboard_program").CopyTo(driveROM, 64*1024);
+
+    // Convert PowerPC and 68K ROMs to little endian words
+    Util::FlipEndian32(crom, 8*0x100000 + 128*0x100000);
+    Util::FlipEndian16(soundROM, 512*1024);
+    Util::FlipEndian16(sampleROM, 16*0x100000);
+
+    // DSB2 68K program needs to be byte swapped
+    if (rom_set.get_rom("mpeg_program").size && game.mpeg_board == "DSB2")
+      Util::FlipEndian16(dsbROM, 128*1024);
+
+    // Once stored, the image is mapped back over the copy just built so that
+    // only the parts of CROM and VROM the game touches stay resident
+    if (romCache)
+    {
+      ROMImageCache::Store(romCachePath, rom_set.cache_key, romSections);
+      ROMImageCache::Map(romCachePath, rom_set.cache_key, romSections);
+    }
   }
-  else
-    rom_set.get_rom("sound_samples").CopyTo(sampleROM, 16*0x100000);
-  rom_set.get_rom("sound_program").CopyTo(soundROM, 512*1024);
-  rom_set.get_rom("mpeg_program").CopyTo(dsbROM, 128*1024);
-  rom_set.get_rom("mpeg_music").CopyTo(mpegROM, 16*0x100000);
-  rom_set.get_rom("driveboard_program").CopyTo(driveROM, 64*1024);
-
-  // Convert PowerPC and 68K ROMs to little endian words
-  Util::FlipEndian32(crom, 8*0x100000 + 128*0x100000);
-  Util::FlipEndian16(soundROM, 512*1024);
-  Util::FlipEndian16(sampleROM, 16*0x100000);
 
   // Configure CPU and PCI bridge
   PPC_CONFIG  ppc_config;
@@ -2980,10 +3661,19 @@ Result CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
   PPCFetchRegions[1].start = 0xFF800000;
   PPCFetchRegions[1].end = 0xFFFFFFFF;
   PPCFetchRegions[1].ptr = (UINT32 *) crom;
-  PPCFetchRegions[2].start = 0;
-  PPCFetchRegions[2].end = 0;
-  PPCFetchRegions[2].ptr = NULL;
+  PPCFetchRegions[2].start = 0xFF000000;
+  PPCFetchRegions[2].end = 0xFF7FFFFF;
+  PPCFetchRegions[2].ptr = (UINT32 *) cromBank;
+  PPCFetchRegions[2].banked = true;
+  PPCFetchRegions[3].start = 0;
+  PPCFetchRegions[3].end = 0;
+  PPCFetchRegions[3].ptr = NULL;
   ppc_set_fetch(PPCFetchRegions);
+  ppc_set_ram(ram, 0x800000, m_ramStatePages);
+  ppc_set_dynarec(m_config["PowerPCDynarec"].ValueAs<bool>());
+  ppc_set_idle_skip(m_config["PowerPCIdleSkip"].ValueAs<bool>() && game.ppc_idle_skip);
+  ppc_set_fast_fpu(m_config["PowerPCFastFPU"].ValueAs<bool>());
+  ppc_set_trace(m_config["PowerPCTrace"].ValueAs<bool>());
 
   // Initialize Real3D
   m_stepping = ((game.stepping[0] - '0') << 4) | (game.stepping[2] - '0');
@@ -3001,7 +3691,6 @@ Result CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
     }
     else if (game.mpeg_board == "DSB2")
     {
-      Util::FlipEndian16(dsbROM, 128*1024); // 68K program needs to be byte swapped
       DSB = new(std::nothrow) CDSB2(m_config);
       if (NULL == DSB)
         return ErrorLog("Insufficient memory for Digital Sound Board object.");
@@ -3088,6 +3777,7 @@ Result CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
   }
 
   m_runNetBoard = m_game.stepping != "1.0" && NetBoard->IsAttached();
+  netBrdThreaded = NetBoard->IsAttached() && !m_config["SimulateNet"].ValueAs<bool>() && !m_deterministic;
 #endif
   return Result::OKAY;
 }
@@ -3097,6 +3787,8 @@ void CModel3::AttachRenderers(CRender2D *Render2DPtr, IRender3D *Render3DPtr, Su
   TileGen.AttachRenderer(Render2DPtr);
   GPU.AttachRenderer(Render3DPtr);
   m_superAA = superAA;
+  m_render2D = Render2DPtr;
+  m_render3D = Render3DPtr;
 }
 
 void CModel3::AttachInputs(CInputs *InputsPtr)
@@ -3157,16 +3849,32 @@ constexpr static int DRIVEROM_OFFSET	= DSBMPEGROM_OFFSET + DSBMPEGROM_SIZE;
 constexpr static int NETBUFFER_OFFSET	= DRIVEROM_OFFSET + DRIVEROM_SIZE;
 constexpr static int NETRAM_OFFSET		= NETBUFFER_OFFSET + NETBUFFER_SIZE;
 
+// The contiguous ROM areas of the memory pool kept in the ROM image cache:
+// CROM and VROM, then the sound, MPEG, and drive board ROMs
+static std::vector<ROMImageCache::Section> GetROMImageSections(UINT8 *pool)
+{
+  return
+  {
+    { pool ? &pool[CROM_OFFSET] : NULL, size_t(BACKUPRAM_OFFSET - CROM_OFFSET) },
+    { pool ? &pool[SOUNDROM_OFFSET] : NULL, size_t(NETBUFFER_OFFSET - SOUNDROM_OFFSET) }
+  };
+}
+
+bool CModel3::IsROMImageCached(const Game &game, const ROMSet &rom_set)
+{
+  return !rom_set.cache_key.empty() && ROMImageCache::IsValid(ROMImageCache::GetPath(game.name), rom_set.cache_key, GetROMImageSections(NULL));
+}
+
 // Model 3 initialization. Some initialization is deferred until ROMs are loaded in LoadROMSet()
 Result CModel3::Init(void)
 {
   constexpr float memSizeMB = (float)MEM_POOL_SIZE / (float)0x100000;
 
   // Allocate all memory for ROMs and PPC RAM
-  memoryPool = new(std::nothrow) UINT8[MEM_POOL_SIZE];
+  memoryPool = Util::AllocateHugePages(MEM_POOL_SIZE, "Model 3 RAM and ROMs");  // zero-filled
   if (NULL == memoryPool)
     return ErrorLog("Insufficient memory for Model 3 object (needs %1.1f MB).", memSizeMB);
-  memset(memoryPool, 0, MEM_POOL_SIZE);
+  m_memoryAccount.SetCPU(MEM_POOL_SIZE);
 
   // Set up pointers
   ram = &memoryPool[RAM_OFFSET];
@@ -3236,12 +3944,17 @@ CModel3::CModel3(Util::Config::Node &config)
   : m_config(config),
     m_multiThreaded(config["MultiThreaded"].ValueAs<bool>()),
     m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>()),
+    m_lockFreeSync(config["LockFreeThreadSync"].ValueAs<bool>()),
+    m_deterministic(m_multiThreaded && config["Deterministic"].ValueAsDefault<bool>(false)),
+    m_ppcFrequency(config, "PowerPCFrequency", 0),
     sndBrdWakeNotify(false),
     TileGen(config),
     GPU(config),
     SoundBoard(config),
     m_jtag(GPU),
-    m_superAA(nullptr)
+    m_superAA(nullptr),
+    m_render2D(nullptr),
+    m_render3D(nullptr)
 {
   // Initialize pointers so dtor can know whether to free them
   memoryPool = NULL;
@@ -3261,6 +3974,11 @@ CModel3::CModel3(Util::Config::Node &config)
   securityRAM = NULL;
   netRAM = NULL;
   netBuffer = NULL;
+  memset(m_ramStatePages, 0, sizeof(m_ramStatePages));
+  m_nvramWritten = false;
+  memset(m_inputImage, 0xFF, sizeof(m_inputImage));
+  m_inputBank1 = 0xFF;
+  memset(m_adc, 0, sizeof(m_adc));
 
   DSB = NULL;
   DriveBoard = NULL;
@@ -3278,6 +3996,8 @@ CModel3::CModel3(Util::Config::Node &config)
   ppcBrdThread = NULL;
   sndBrdThread = NULL;
   drvBrdThread = NULL;
+  netBrdThread = NULL;
+  netBrdThreaded = false;
 
   ppcBrdThreadRunning = false;
   ppcBrdThreadDone = false;
@@ -3285,14 +4005,25 @@ CModel3::CModel3(Util::Config::Node &config)
   sndBrdThreadDone = false;
   drvBrdThreadRunning = false;
   drvBrdThreadDone = false;
+  netBrdThreadRunning = false;
+  netBrdThreadDone = false;
 
-  syncSndBrdThread = false;
+  syncSndBrdThread = m_deterministic;  // audio output then draws on the buffered samples instead of pacing the sound board
+  m_drvBrdDataOut = 0;
+  m_drvBrdDataWritten = false;
+  m_drvBrdDataIn = 0;
   ppcBrdThreadSync = NULL;
   sndBrdThreadSync = NULL;
   drvBrdThreadSync = NULL;
+  netBrdThreadSync = NULL;
 
   notifyLock = NULL;
   notifySync = NULL;
+  ppcBrdFrameStart = NULL;
+  sndBrdFrameStart = NULL;
+  drvBrdFrameStart = NULL;
+  netBrdFrameStart = NULL;
+  frameDone = NULL;
 
   m_stepping = 0;
   inputBank = 0;
@@ -3302,10 +4033,13 @@ CModel3::CModel3(Util::Config::Node &config)
   adcChannel = 0;
 
   midiCtrlPort = 0;
+  m_irqWait = 0;
   driveROM = nullptr;
   OutputRegister[0] = OutputRegister[1] = 0;
   cromBankReg = 0;
   memset(PPCFetchRegions, 0, sizeof(PPCFetchRegions));
+  memset(m_readMap, 0, sizeof(m_readMap));
+  memset(m_writeMap, 0, sizeof(m_writeMap));
   gpusReady = false;
   sndBrdNotifyLock = nullptr;
   sndBrdNotifySync = nullptr;
@@ -3347,10 +4081,13 @@ CModel3::~CModel3(void)
   // Stop all threads
   StopThreads();
 
+  // Release PowerPC recompiler code cache
+  ppc_shutdown();
+
   // Free memory
   if (memoryPool != NULL)
   {
-    delete [] memoryPool;
+    Util::FreeHugePages(memoryPool, MEM_POOL_SIZE);
     memoryPool = NULL;
   }
 
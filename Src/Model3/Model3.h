@@ -45,9 +45,12 @@
 #include "Network/INetBoard.h"
 #endif // NET_BOARD
 #include "Util/NewConfig.h"
+#include "Util/MemoryUsage.h"
 #include "Graphics/SuperAA.h"
 #include "OSD/Thread.h"
 
+#include <vector>
+
 /*
  * FrameTimings
  *
@@ -55,19 +58,64 @@
  */
 struct FrameTimings
 {
-  UINT32 ppcTicks;
+  UINT32 ppcMicros;
+  UINT32 ppcCycles;   // PowerPC cycles run, including those skipped by idle loop detection
   UINT32 syncSize;
-  UINT32 syncTicks;
-  UINT32 renderTicks;
-  UINT32 sndTicks;
-  UINT32 drvTicks;
+  UINT32 copySize;    // Real3D working memory copied back from the snapshots
+  UINT32 syncMicros;
+  UINT32 renderMicros;
+  UINT32 resolveMicros; // GPU time of the supersampling/CRT color resolve
+  UINT32 gpuMicros;     // GPU time of the whole rendered frame
+  UINT32 tileGenMicros; // GPU time of the 2D passes
+  GPUPassTimings render3DMicros;  // GPU time of the 3D passes
+  RenderStats render3DStats;      // what the 3D renderer traversed, drew and uploaded
+  UINT32 sndMicros;
+  UINT32 drvMicros;
 #ifdef NET_BOARD
-  UINT32 netTicks;
+  UINT32 netMicros;
 #endif
-  UINT32 frameTicks;
+  UINT32 frameMicros;
   UINT64 frameId;
 };
 
+/*
+ * BusAccessCounts
+ *
+ * Accesses that went through the CModel3 read and write handlers in a frame,
+ * by region of the memory map and size (8, 16 and 32 bits). 64-bit and
+ * unaligned accesses are counted as the smaller ones they are split into.
+ * Aligned RAM accesses made directly by the PowerPC never reach the handlers.
+ * Only counted in trace builds (SUPERMODEL_TRACE).
+ */
+struct BusAccessCounts
+{
+  enum Region
+  {
+    RAM,
+    CROM,
+    Real3DRegs,     // status, configuration and render trigger
+    CullingRAM,
+    PolygonRAM,
+    Textures,       // texture port and FIFO
+    Real3DDMA,
+    TileGen,
+    Inputs,
+    Sound,          // MIDI ports of the sound board
+    BackupRAM,
+    Security,
+    System,         // system registers and RTC
+    PCI,            // MPC105/106
+    SCSI,           // or the net board, which shares its addresses
+    Other,
+    NumRegions
+  };
+
+  static const char * const regionNames[NumRegions];
+
+  UINT32 reads[NumRegions][3];
+  UINT32 writes[NumRegions][3];
+};
+
 /*
  * CModel3:
  *
@@ -90,8 +138,11 @@ public:
   void SaveNVRAM(CBlockFile *NVRAM);
   void LoadNVRAM(CBlockFile *NVRAM);
   void ClearNVRAM(void);
+  bool CheckNVRAMWritten(void);
+  uint32_t GetMemoryChecksum(void) const;
   void RunFrame(void);
   void RenderFrame(void);
+  void SetOutputEnabled(bool video, bool audio);
   void Reset(void);
   const Game &GetGame(void) const;
   void AttachRenderers(CRender2D *Render2DPtr, IRender3D *Render3DPtr, SuperAA *superAA);
@@ -114,12 +165,14 @@ public:
   void Write16(UINT32 addr, UINT16 data);
   void Write32(UINT32 addr, UINT32 data);
   void Write64(UINT32 addr, UINT64 data);
+  bool MoveBlock32(UINT32 dest, UINT32 src, unsigned numWords, bool reverseBytes);
 
   /*
    * LoadGame(game, rom_set):
    *
    * Loads a game, copying in the provided ROMs and setting the hardware
-   * stepping.
+   * stepping. If ROMCache is enabled, the processed ROM image is mapped from
+   * the cache instead when possible, and the ROMs need only be sized.
    *
    * Parameters:
    *    game      Game information.
@@ -130,6 +183,14 @@ public:
    */
   Result LoadGame(const Game &game, const ROMSet &rom_set);
 
+  /*
+   * IsROMImageCached(game, rom_set):
+   *
+   * Returns true if the ROM image cache holds a valid image of the given ROM
+   * set, in which case LoadGame() does not need the ROM data.
+   */
+  static bool IsROMImageCached(const Game &game, const ROMSet &rom_set);
+
   /*
    * GetSoundBoard(void):
    *
@@ -176,6 +237,18 @@ public:
    */
   FrameTimings GetTimings(void);
 
+  /*
+   * SaveGraphicsState(SaveState):
+   *
+   * Saves just the Real3D and tile generator state, which is all that
+   * CModel3GraphicsState needs to render the frame again. Threads must be
+   * paused.
+   *
+   * Parameters:
+   *    SaveState   Block file to write to.
+   */
+  void SaveGraphicsState(CBlockFile *SaveState);
+
   /*
    * CModel3(config):
    * ~CModel3(void):
@@ -199,11 +272,13 @@ public:
 private:
   // Private member functions
   UINT8     ReadInputs(unsigned reg);
+  void      UpdateInputImage(void);
   void      WriteInputs(unsigned reg, UINT8 data);
   uint16_t  ReadSecurityRAM(uint32_t addr);
   UINT32    ReadSecurity(unsigned reg);
   void      WriteSecurity(unsigned reg, UINT32 data);
   void      SetCROMBank(unsigned idx);
+  void      BuildMemoryMap(void);
   UINT8     ReadSystemRegister(unsigned reg) const;
   void      WriteSystemRegister(unsigned reg, UINT8 data);
 
@@ -218,11 +293,18 @@ private:
   bool    StartThreads(void);                         // Starts all threads
   bool    StopThreads(void);                          // Stops all threads
   void    DeleteThreadObjects(void);                  // Deletes all threads and synchronization objects
+  bool    LockNotify(void);                           // Enters notify critical section (no-op when lock-free)
+  bool    UnlockNotify(void);                         // Leaves notify critical section (no-op when lock-free)
+  bool    SignalNotify(void);                         // Signals change of thread state flags (no-op when lock-free)
+  bool    WaitNotify(void);                           // Waits for change of thread state flags (polls when lock-free)
+  bool    PostFrameStart(CSemaphore *sync, CFastSemaphore *fastSync); // Wakes a thread to process a frame
+  bool    WaitFrameStart(CSemaphore *sync, CFastSemaphore *fastSync); // Waits to be woken to process a frame
 
   static int StartMainBoardThread(void *data);        // Callback to start PPC main board thread
   static int StartSoundBoardThread(void *data);       // Callback to start sound board thread (unsync'd)
   static int StartSoundBoardThreadSyncd(void *data);  // Callback to start sound board thread (sync'd)
   static int StartDriveBoardThread(void *data);       // Callback to start drive board thread
+  static int StartNetBoardThread(void *data);         // Callback to start net board thread
 
   static void AudioCallback(void *data);              // Audio buffer callback
 
@@ -231,11 +313,18 @@ private:
   int     RunSoundBoardThread(void);                  // Runs sound board thread (not sync'd in step with render thread, ie running at full speed)
   int     RunSoundBoardThreadSyncd(void);             // Runs sound board thread (sync'd in step with render thread)
   int     RunDriveBoardThread(void);                  // Runs drive board thread (sync'd in step with render thread)
+  int     RunNetBoardThread(void);                    // Runs net board thread (sync'd in step with render thread)
+  void    ExchangeBoardData(void);                    // Passes data between boards at the end of a deterministic frame
 
   // Runtime configuration
   Util::Config::Node &m_config;
   bool m_multiThreaded;
   bool m_gpuMultiThreaded;
+  bool m_lockFreeSync;
+  bool m_deterministic;     // boards exchange data only between frames, so multi-threaded runs repeat exactly
+  Util::Config::Binding<unsigned> m_ppcFrequency;   // read every frame
+  bool m_videoEnabled = true;
+  bool m_audioEnabled = true;
 
   // Game and hardware information
   Game m_game;
@@ -250,12 +339,19 @@ private:
   UINT8   serialFIFO1, serialFIFO2;
   UINT8   gunReg;
   int     adcChannel;
+  UINT8   m_inputImage[0x40]; // register values made up of inputs, built each frame (see UpdateInputImage())
+  UINT8   m_inputBank1;       // register 0x04 in bank 1, without the EEPROM data bit
+  UINT8   m_adc[8];           // ADC channels
 
   // MIDI port
   UINT8   midiCtrlPort; // controls MIDI (SCSP) IRQ behavior
 
+  // IRQs whose acknowledgement ends the current PowerPC time slice
+  UINT8   m_irqWait;
+
   // Emulated core Model 3 memory regions
   UINT8   *memoryPool;  // single allocated region for all ROM and system RAM
+  Util::MemoryAccount m_memoryAccount{"Model 3 RAM and ROMs"};
   UINT8   *ram;         // 8 MB PowerPC RAM
   UINT8   *crom;        // 8+128 MB CROM (fixed CROM first, then 64MB of banked CROMs -- Daytona2 might need extra?)
   UINT8   *vrom;        // 64 MB VROM (video ROM, visible only to Real3D)
@@ -269,34 +365,54 @@ private:
   UINT8   *netRAM;		// 64 KB RAM
   UINT8	  *netBuffer;	// 128 KB buffer
   UINT8   OutputRegister[2];   // Input/output register for driveboard and lamps
+  UINT8   m_ramStatePages[0x800000 >> CBlockFile::PageShift];  // RAM pages written since the last in-memory save state
+  bool    m_nvramWritten; // backup RAM or EEPROM written since the last CheckNVRAMWritten()
 
   // Banked CROM
   UINT8     *cromBank;    // currently mapped in CROM bank
   unsigned  cromBankReg;  // the CROM bank register
 
+  // Memory map of plain memory outside of RAM (64 KB pages)
+  struct MemoryPage
+  {
+    UINT8     *ptr;       // host memory for start of page
+    unsigned  sizes;      // access sizes (1, 2, and/or 4 bytes OR'd together) that may use ptr directly
+    bool      *written;   // flag set by every direct write (NULL if none)
+  };
+  MemoryPage  m_readMap[0x10000];
+  MemoryPage  m_writeMap[0x10000];
+
   // Security device
   bool      m_securityFirstRead = true;
   unsigned  securityPtr;  // pointer to current offset in security data
 
   // PowerPC
-  PPC_FETCH_REGION  PPCFetchRegions[3];
+  PPC_FETCH_REGION  PPCFetchRegions[4];
 
   // Multiple threading
   bool        gpusReady;           // True if GPUs are ready to render
   bool        startedThreads;      // True if threads have been created and started
-  bool        pauseThreads;        // True if threads should pause
-  bool        stopThreads;         // True if threads should stop
+  std::atomic<bool> pauseThreads; // True if threads should pause
+  std::atomic<bool> stopThreads;  // True if threads should stop
   bool        syncSndBrdThread;    // True if sound board thread should be sync'd in step with render thread
   CThread     *ppcBrdThread;       // PPC main board thread
   CThread     *sndBrdThread;       // Sound board thread
   CThread     *drvBrdThread;       // Drive board thread
-  bool        ppcBrdThreadRunning; // Flag to indicate PPC main board thread is currently processing
-  bool        ppcBrdThreadDone;    // Flag to indicate PPC main board thread has finished processing
-  bool        sndBrdThreadRunning; // Flag to indicate sound board thread is currently processing
-  bool        sndBrdThreadDone;    // Flag to indicate sound board thread has finished processing
+  CThread     *netBrdThread;       // Net board thread (emulated net board only)
+  bool        netBrdThreaded;      // True if the emulated net board's 68K runs on its own thread
+  std::vector<UINT8> m_midiQueue;  // MIDI bytes written by the PowerPC this frame (deterministic mode)
+  UINT8       m_drvBrdDataOut;     // Last byte written to the drive board this frame (deterministic mode)
+  bool        m_drvBrdDataWritten; // True if the drive board was written to this frame (deterministic mode)
+  UINT8       m_drvBrdDataIn;      // Drive board output as of the end of the last frame (deterministic mode)
+  std::atomic<bool> ppcBrdThreadRunning; // Flag to indicate PPC main board thread is currently processing
+  std::atomic<bool> ppcBrdThreadDone;    // Flag to indicate PPC main board thread has finished processing
+  std::atomic<bool> sndBrdThreadRunning; // Flag to indicate sound board thread is currently processing
+  std::atomic<bool> sndBrdThreadDone;    // Flag to indicate sound board thread has finished processing
   bool        sndBrdWakeNotify;    // Flag to indicate that sound board thread has been woken by audio callback (when not sync'd with render thread)
-  bool        drvBrdThreadRunning; // Flag to indicate drive board thread is currently processing
-  bool        drvBrdThreadDone;    // Flag to indicate drive board thread has finished processing
+  std::atomic<bool> drvBrdThreadRunning; // Flag to indicate drive board thread is currently processing
+  std::atomic<bool> drvBrdThreadDone;    // Flag to indicate drive board thread has finished processing
+  std::atomic<bool> netBrdThreadRunning; // Flag to indicate net board thread is currently processing
+  std::atomic<bool> netBrdThreadDone;    // Flag to indicate net board thread has finished processing
 
   // Thread synchronization objects
   CSemaphore  *ppcBrdThreadSync;
@@ -304,11 +420,21 @@ private:
   CMutex      *sndBrdNotifyLock;
   CCondVar    *sndBrdNotifySync;
   CSemaphore  *drvBrdThreadSync;
+  CSemaphore  *netBrdThreadSync;
   CMutex      *notifyLock;
   CCondVar    *notifySync;
+  CFastSemaphore  *ppcBrdFrameStart;  // lock-free equivalents of ppcBrdThreadSync, etc.
+  CFastSemaphore  *sndBrdFrameStart;
+  CFastSemaphore  *drvBrdFrameStart;
+  CFastSemaphore  *netBrdFrameStart;
+  CFastSemaphore  *frameDone;         // posted by each sync'd thread when its frame is done (lock-free only)
 
   // Frame timings
   FrameTimings timings;
+#ifdef SUPERMODEL_TRACE
+  BusAccessCounts m_busCounts{};      // this frame so far
+  BusAccessCounts m_lastBusCounts{};  // last complete frame
+#endif
 
   // Other devices
   CIRQ        IRQ;            // Model 3 IRQ controller
@@ -325,6 +451,8 @@ private:
   CCrypto     m_cryptoDevice; // Encryption device
   CJTAG       m_jtag;         // JTAG interface
   SuperAA     *m_superAA;
+  CRender2D   *m_render2D;
+  IRender3D   *m_render3D;
 #ifdef NET_BOARD
   INetBoard   *NetBoard;      // Net board
   bool		m_runNetBoard;
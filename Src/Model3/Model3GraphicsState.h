@@ -23,7 +23,9 @@
  * Model3GraphicsState.h
  *
  * Minimalistic implementation of IEmulator designed to load and view graphics
- * state.
+ * state. It either renders a single state over and over (for analysis), or
+ * replays a sequence of states captured from a live session one per frame, so
+ * that the renderers can be benchmarked without emulating anything else.
  */
 
 #ifndef INCLUDED_MODEL3GRAPHICSSTATE_H
@@ -33,13 +35,18 @@
 #include "Game.h"
 #include "ROMSet.h"
 #include "CPU/Bus.h"
+#include "Graphics/SuperAA.h"
 #include "Model3/IEmulator.h"
 #include "Model3/IRQ.h"
+#include "Model3/Model3.h"
 #include "Model3/Real3D.h"
 #include "Model3/TileGen.h"
 #include "OSD/Logger.h"
+#include "OSD/Thread.h"
 #include "OSD/Video.h"
 #include "Util/NewConfig.h"
+#include <string>
+#include <vector>
 
 /*
  * CModel3GraphicsState:
@@ -71,33 +78,89 @@ public:
   {
   }
 
+  bool CheckNVRAMWritten(void) override
+  {
+    return false;
+  }
+
+  uint32_t GetMemoryChecksum(void) const override
+  {
+    return 0;
+  }
+
   void RunFrame(void) override
   {
+    // The first frame after a reset shows the state that was just loaded
+    if (m_replay && !m_stateLoaded)
+    {
+      LoadStateFile(m_stateFiles[m_nextState]);
+      m_nextState = (m_nextState + 1) % m_stateFiles.size();
+    }
+    m_stateLoaded = false;
     RenderFrame();
   }
 
   void RenderFrame(void) override
   {
-    BeginFrameVideo();
-    m_tileGen.BeginFrame();
-    m_real3D.BeginFrame();
-    m_real3D.RenderFrame();
-    m_real3D.EndFrame();
-    m_tileGen.EndFrame();
+    if (!m_replay)
+    {
+      BeginFrameVideo();
+      m_tileGen.BeginFrame();
+      m_real3D.BeginFrame();
+      m_real3D.RenderFrame();
+      m_real3D.EndFrame();
+      m_tileGen.EndFrame();
+      EndFrameVideo();
+      return;
+    }
+
+    // Same sequence as CModel3::RenderFrame(), without the threads
+    uint64_t start = CThread::GetMicros();
+    if (BeginFrameVideo())
+    {
+      m_superAA->BeginFrame();
+      m_tileGen.BeginFrame();
+      m_real3D.BeginFrame();
+      m_tileGen.PreRenderFrame();
+      m_tileGen.RenderFrameBottom();
+      m_real3D.RenderFrame();
+      m_tileGen.RenderFrameTop();
+      m_real3D.EndFrame();
+      m_tileGen.EndFrame();
+      m_superAA->Draw();
+      m_timings.resolveMicros = m_superAA->GetResolveMicros();
+      m_timings.gpuMicros = m_superAA->GetFrameMicros();
+      m_timings.tileGenMicros = m_render2D->GetGPUMicros();
+      m_render3D->GetGPUTimings(&m_timings.render3DMicros);
+      m_render3D->GetRenderStats(&m_timings.render3DStats);
+    }
     EndFrameVideo();
+    m_timings.renderMicros = UINT32(CThread::GetMicros() - start);
+  }
+
+  /*
+   * GetTimings(void):
+   *
+   * Returns timings for the most recently replayed frame. Only the render
+   * and GPU times are filled in.
+   */
+  FrameTimings GetTimings(void) const
+  {
+    return m_timings;
+  }
+
+  void SetOutputEnabled(bool video, bool audio) override
+  {
   }
 
   void Reset(void) override
   {
-    // Load state
-    CBlockFile SaveState;
-    if (Result::OKAY != SaveState.Load(m_stateFilePath.c_str()))
-      ErrorLog("Unable to load state from '%s'.", m_stateFilePath.c_str());
-    else
-    {
-      LoadState(&SaveState);
-      SaveState.Close();
-    }
+    // Texture RAM starts out unknown to the renderer, so the first state always uploads it
+    m_real3D.SetKeepUnchangedTextures(false);
+    LoadStateFile(m_stateFiles[0]);
+    m_real3D.SetKeepUnchangedTextures(m_replay);
+    m_nextState = 1 % m_stateFiles.size();
+    m_stateLoaded = true;
   }
 
   const Game &GetGame(void) const override
@@ -110,7 +173,7 @@ public:
     m_game = game;
     if (rom_set.get_rom("vrom").size <= 32*0x100000)
     {
-      rom_set.get_rom("vrom").CopyTo(&m_vrom.get()[0], 32*100000);
+      rom_set.get_rom("vrom").CopyTo(&m_vrom.get()[0], 32*0x100000);
       rom_set.get_rom("vrom").CopyTo(&m_vrom.get()[32*0x100000], 32*0x100000);
     }
     else
@@ -124,6 +187,9 @@ public:
   {
     m_tileGen.AttachRenderer(render2D);
     m_real3D.AttachRenderer(render3D);
+    m_render2D = render2D;
+    m_render3D = render3D;
+    m_superAA = superAA;
   }
 
   void AttachInputs(CInputs *InputsPtr) override
@@ -155,11 +221,25 @@ public:
     return true;
   }
 
-  CModel3GraphicsState(const Util::Config::Node &config, const std::string &filePath)
-    : m_stateFilePath(filePath),
+  /*
+   * CModel3GraphicsState(config, stateFiles, replay):
+   *
+   * Parameters:
+   *    config      Run-time configuration.
+   *    stateFiles  Save states to load, at least one. Only the first is used
+   *                unless replaying.
+   *    replay      If true, each frame loads the next state in the sequence
+   *                (wrapping around) and is rendered with the 2D layers and
+   *                timed, as CModel3 would. Otherwise only the 3D scene of
+   *                the first state is rendered.
+   */
+  CModel3GraphicsState(const Util::Config::Node &config, const std::vector<std::string> &stateFiles, bool replay)
+    : m_stateFiles(stateFiles),
+      m_replay(replay),
       m_tileGen(config),
       m_real3D(config)
   {
+    m_timings = FrameTimings();
   }
 
   virtual ~CModel3GraphicsState(void)
@@ -167,7 +247,26 @@ public:
   }
 
 private:
-  const std::string         m_stateFilePath;
+  void LoadStateFile(const std::string &file)
+  {
+    CBlockFile SaveState;
+    if (Result::OKAY != SaveState.Load(file))
+      ErrorLog("Unable to load state from '%s'.", file.c_str());
+    else
+    {
+      LoadState(&SaveState);
+      SaveState.Close();
+    }
+  }
+
+  const std::vector<std::string> m_stateFiles;
+  const bool                m_replay;
+  size_t                    m_nextState = 0;
+  bool                      m_stateLoaded = false;
+  FrameTimings              m_timings;
+  CRender2D                 *m_render2D = nullptr;
+  IRender3D                 *m_render3D = nullptr;
+  SuperAA                   *m_superAA = nullptr;
   std::shared_ptr<uint8_t>  m_vrom;
   Game                      m_game;
   CIRQ                      m_irq;
@@ -0,0 +1,242 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ROMImageCache.cpp
+ *
+ * File layout: a Header, the size of each section (UINT64), and the key
+ * string, followed by each section's data. The data of every section
+ * begins on an Alignment boundary so it can be mapped straight into memory.
+ */
+
+#include "ROMImageCache.h"
+#include "Supermodel.h"
+#include "OSD/FileSystemPath.h"
+#include "Util/Format.h"
+#include <cstdio>
+#include <cstring>
+#include <new>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>	// mmap()
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ROMImageCache
+{
+  static const char   s_magic[4]  = { 'S', 'M', 'R', 'I' };
+  static const UINT32 s_version   = 1;
+
+  struct Header
+  {
+    char    magic[4];
+    UINT32  version;
+    UINT32  numSections;
+    UINT32  keySize;
+  };
+
+  static size_t Align(size_t n)
+  {
+    return (n + Alignment - 1) & ~(Alignment - 1);
+  }
+
+  static size_t DataOffset(const std::string &key, const std::vector<Section> &sections)
+  {
+    return Align(sizeof(Header) + sections.size() * sizeof(UINT64) + key.size());
+  }
+
+  // Builds the complete expected header (everything before the data)
+  static std::vector<UINT8> BuildHeader(const std::string &key, const std::vector<Section> &sections)
+  {
+    Header header;
+    memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.numSections = UINT32(sections.size());
+    header.keySize = UINT32(key.size());
+
+    std::vector<UINT8> bytes((const UINT8 *) &header, (const UINT8 *) &header + sizeof(header));
+    for (auto &section: sections)
+    {
+      UINT64 size = section.size;
+      bytes.insert(bytes.end(), (const UINT8 *) &size, (const UINT8 *) &size + sizeof(size));
+    }
+    bytes.insert(bytes.end(), key.begin(), key.end());
+    return bytes;
+  }
+
+  static size_t TotalSize(const std::string &key, const std::vector<Section> &sections)
+  {
+    size_t size = DataOffset(key, sections);
+    for (auto &section: sections)
+      size += Align(section.size);
+    return size;
+  }
+
+  static bool HeaderMatches(FILE *fp, const std::vector<UINT8> &expected)
+  {
+    std::vector<UINT8> actual(expected.size());
+    return fread(actual.data(), 1, actual.size(), fp) == actual.size() && actual == expected;
+  }
+
+  std::string GetPath(const std::string &gameName)
+  {
+    return Util::Format() << FileSystemPath::GetPath(FileSystemPath::Cache) << gameName << ".rom";
+  }
+
+  bool IsValid(const std::string &path, const std::string &key, const std::vector<Section> &sections)
+  {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (NULL == fp)
+      return false;
+    bool valid = HeaderMatches(fp, BuildHeader(key, sections));
+    valid = valid && fseek(fp, 0, SEEK_END) == 0 && ftell(fp) >= long(TotalSize(key, sections));
+    fclose(fp);
+    return valid;
+  }
+
+#ifndef _WIN32
+  static bool MapSections(const std::string &path, const std::string &key, const std::vector<Section> &sections)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    // A truncated file would fault on access rather than fail here
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < TotalSize(key, sections))
+    {
+      close(fd);
+      return false;
+    }
+
+    size_t offset = DataOffset(key, sections);
+    bool mapped = true;
+    for (auto &section: sections)
+    {
+      if (mapped && mmap(section.ptr, section.size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, off_t(offset)) == MAP_FAILED)
+        mapped = false;
+      if (!mapped)
+      {
+        // Restore ordinary memory so the file can be read in instead
+        mmap(section.ptr, section.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0);
+      }
+      offset += Align(section.size);
+    }
+    close(fd);  // mappings remain valid
+    return mapped;
+  }
+#endif
+
+  bool Load(const std::string &path, const std::string &key, const std::vector<Section> &sections)
+  {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (NULL == fp)
+      return false;
+    if (!HeaderMatches(fp, BuildHeader(key, sections)))
+    {
+      fclose(fp);
+      return false;
+    }
+
+#ifndef _WIN32
+    if (MapSections(path, key, sections))
+    {
+      fclose(fp);
+      InfoLog("Mapped ROM image from '%s'.", path.c_str());
+      return true;
+    }
+#endif
+
+    size_t offset = DataOffset(key, sections);
+    bool error = false;
+    for (auto &section: sections)
+    {
+      error = error || fseek(fp, long(offset), SEEK_SET) != 0 || fread(section.ptr, 1, section.size, fp) != section.size;
+      offset += Align(section.size);
+    }
+    fclose(fp);
+    if (error)
+    {
+      // Don't leave a partially loaded image behind
+      for (auto &section: sections)
+        memset(section.ptr, 0, section.size);
+      ErrorLog("Unable to read ROM image cache '%s'.", path.c_str());
+      return false;
+    }
+    InfoLog("Loaded ROM image from '%s'.", path.c_str());
+    return true;
+  }
+
+  bool Map(const std::string &path, const std::string &key, const std::vector<Section> &sections)
+  {
+#ifdef _WIN32
+    return false;
+#else
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (NULL == fp)
+      return false;
+    bool mapped = HeaderMatches(fp, BuildHeader(key, sections)) && MapSections(path, key, sections);
+    fclose(fp);
+    if (mapped)
+      InfoLog("Mapped ROM image from '%s'.", path.c_str());
+    return mapped;
+#endif
+  }
+
+  void Store(const std::string &path, const std::string &key, const std::vector<Section> &sections)
+  {
+    // Write to a temporary file first so that other instances never see a
+    // partial image (or write to the same temporary file)
+    std::string tmpPath = FileSystemPath::GetTempFilePath(path);
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (NULL == fp)
+    {
+      ErrorLog("Unable to write ROM image cache '%s'.", tmpPath.c_str());
+      return;
+    }
+
+    std::vector<UINT8> header = BuildHeader(key, sections);
+    std::vector<UINT8> padding(Alignment, 0);
+    bool error = fwrite(header.data(), 1, header.size(), fp) != header.size();
+    error = error || fwrite(padding.data(), 1, DataOffset(key, sections) - header.size(), fp) != DataOffset(key, sections) - header.size();
+    for (auto &section: sections)
+    {
+      size_t padSize = Align(section.size) - section.size;
+      error = error || fwrite(section.ptr, 1, section.size, fp) != section.size;
+      error = error || fwrite(padding.data(), 1, padSize, fp) != padSize;
+    }
+    error = (fclose(fp) != 0) || error;
+
+    if (!error)
+    {
+      std::remove(path.c_str());
+      error = std::rename(tmpPath.c_str(), path.c_str()) != 0;
+    }
+    if (error)
+    {
+      std::remove(tmpPath.c_str());
+      ErrorLog("Unable to write ROM image cache '%s'.", path.c_str());
+      return;
+    }
+    InfoLog("Wrote ROM image to '%s'.", path.c_str());
+  }
+}
@@ -0,0 +1,98 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ROMImageCache.h
+ *
+ * Cache of fully processed (interleaved, patched, and byte swapped) Model 3
+ * ROM memory, stored exactly as it is laid out in the emulator's memory pool.
+ */
+
+#ifndef INCLUDED_ROMIMAGECACHE_H
+#define INCLUDED_ROMIMAGECACHE_H
+
+#include "Types.h"
+#include <string>
+#include <vector>
+
+namespace ROMImageCache
+{
+  // A span of the memory pool stored in the cache. Must be aligned to
+  // Alignment so that it can be mapped directly from the file.
+  struct Section
+  {
+    UINT8   *ptr;
+    size_t  size;
+  };
+
+  static constexpr size_t Alignment = 0x10000;
+
+  /*
+   * GetPath(gameName):
+   *
+   * Returns the path of the cache file for the given game.
+   */
+  std::string GetPath(const std::string &gameName);
+
+  /*
+   * IsValid(path, key, sections):
+   *
+   * Checks only the header of a cache file. Returns true if it exists and
+   * was written for the same key (see ROMSet::cache_key) and section sizes.
+   */
+  bool IsValid(const std::string &path, const std::string &key, const std::vector<Section> &sections);
+
+  /*
+   * Load(path, key, sections):
+   *
+   * Maps a valid cache file read-only over the given sections so that the
+   * pages are shared with every other process using the same ROM set. Where
+   * mapping is not possible, the file is read in instead.
+   *
+   * Returns:
+   *    True if the sections were loaded, false if the cache is missing or
+   *    invalid (sections are left untouched).
+   */
+  bool Load(const std::string &path, const std::string &key, const std::vector<Section> &sections);
+
+  /*
+   * Map(path, key, sections):
+   *
+   * Like Load(), but only maps the file and never reads it in. Pages are
+   * brought in on demand when first touched, and whatever the sections held
+   * before is released.
+   *
+   * Returns:
+   *    True if the sections were mapped, false otherwise (sections are left
+   *    untouched).
+   */
+  bool Map(const std::string &path, const std::string &key, const std::vector<Section> &sections);
+
+  /*
+   * Store(path, key, sections):
+   *
+   * Writes the sections to a new cache file, replacing any existing one.
+   * Errors are logged but otherwise ignored, since the cache is optional.
+   */
+  void Store(const std::string &path, const std::string &key, const std::vector<Section> &sections);
+}
+
+#endif  // INCLUDED_ROMIMAGECACHE_H
@@ -47,15 +47,44 @@
 #include "JTAG.h"
 #include "CPU/PowerPC/ppc.h"
 #include "Util/BMPFile.h"
+#include "Util/ByteSwap.h"
+#include "Util/HugePages.h"
+#include "Util/CPUFeatures.h"
 #include <cstring>
 #include <algorithm>
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define REAL3D_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define REAL3D_TARGET(isa)
+#else
+#define REAL3D_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define REAL3D_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+// Baseline vector instructions the dirty bitmap scan can use without a CPU check
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define REAL3D_SSE2_SCAN
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define REAL3D_NEON_SCAN
+#endif
+
 // Macros that divide memory regions into pages and mark them as dirty when they are written to
 #define PAGE_WIDTH 12
 #define PAGE_SIZE (1<<PAGE_WIDTH)
 #define DIRTY_SIZE(arraySize) (1+((arraySize)-1)/(8*PAGE_SIZE))
 #define MARK_DIRTY(dirtyArray, addr) dirtyArray[(addr)>>(PAGE_WIDTH+3)] |= 1<<(((addr)>>PAGE_WIDTH)&7)
 
+// With fine dirty tracking, each page also gets a 64-bit mask of the 64-byte lines written within it
+#define LINE_WIDTH 6
+#define LINES_SIZE(arraySize) (8*(1+((arraySize)-1)/PAGE_SIZE))
+#define MARK_DIRTY_LINE(dirtyArray, lineArray, addr) do { MARK_DIRTY(dirtyArray, addr); if (lineArray) (lineArray)[(addr)>>PAGE_WIDTH] |= 1ull<<(((addr)>>LINE_WIDTH)&63); } while (0)
+
 // Offsets of memory regions within Real3D memory pool
 #define OFFSET_8C           0x0000000 // 4 MB, culling RAM low (at 0x8C000000)
 #define OFFSET_8E           0x0400000 // 1 MB, culling RAM high (at 0x8E000000)
@@ -73,7 +102,21 @@
 #define OFFSET_98_DIRTY     (OFFSET_8E_DIRTY+DIRTY_SIZE(0x100000))
 #define OFFSET_TEXRAM_DIRTY (OFFSET_98_DIRTY+DIRTY_SIZE(0x400000))
 #define MEM_POOL_SIZE_DIRTY (DIRTY_SIZE(MEM_POOL_SIZE_RO))
-#define MEMORY_POOL_SIZE  (MEM_POOL_SIZE_RW+MEM_POOL_SIZE_RO+MEM_POOL_SIZE_DIRTY)
+#define OFFSET_8C_STALE     (OFFSET_8C_DIRTY+MEM_POOL_SIZE_DIRTY)
+#define OFFSET_8E_STALE     (OFFSET_8C_STALE+DIRTY_SIZE(0x400000))
+#define OFFSET_98_STALE     (OFFSET_8E_STALE+DIRTY_SIZE(0x100000))
+#define OFFSET_TEXRAM_STALE (OFFSET_98_STALE+DIRTY_SIZE(0x400000))
+#define OFFSET_8C_LINES     (OFFSET_8C_STALE+MEM_POOL_SIZE_DIRTY)
+#define OFFSET_8E_LINES     (OFFSET_8C_LINES+LINES_SIZE(0x400000))
+#define OFFSET_98_LINES     (OFFSET_8E_LINES+LINES_SIZE(0x100000))
+#define OFFSET_TEXRAM_LINES (OFFSET_98_LINES+LINES_SIZE(0x400000))
+#define MEM_POOL_SIZE_LINES (LINES_SIZE(MEM_POOL_SIZE_RO))
+#define OFFSET_8C_STALE_LINES     (OFFSET_8C_LINES+MEM_POOL_SIZE_LINES)
+#define OFFSET_8E_STALE_LINES     (OFFSET_8C_STALE_LINES+LINES_SIZE(0x400000))
+#define OFFSET_98_STALE_LINES     (OFFSET_8E_STALE_LINES+LINES_SIZE(0x100000))
+#define OFFSET_TEXRAM_STALE_LINES (OFFSET_98_STALE_LINES+LINES_SIZE(0x400000))
+#define OFFSET_TEXFIFO_BACK (OFFSET_8C_STALE_LINES+MEM_POOL_SIZE_LINES) // 1 MB, second texture FIFO, decoded while the other fills
+#define MEMORY_POOL_SIZE  (MEM_POOL_SIZE_RW+MEM_POOL_SIZE_RO+2*MEM_POOL_SIZE_DIRTY+2*MEM_POOL_SIZE_LINES+0x100000)
 
 
 
@@ -85,7 +128,15 @@ void CReal3D::SaveState(CBlockFile *SaveState)
 {
   SaveState->NewBlock("Real3D", __FILE__);
 
-  SaveState->Write(memoryPool, MEM_POOL_SIZE_RW); // Don't write out read-only snapshots or dirty page arrays
+  // Don't write out read-only snapshots or dirty page arrays. The working copies may have been swapped with the snapshots, so
+  // they are written region by region (in the same order as the memory pool) once they are brought up to date.
+  WaitForTextures();
+  CatchUpWorkingMemory();
+  SaveState->Write(cullingRAMLo, 0x400000, cullingRAMLoStatePages);
+  SaveState->Write(cullingRAMHi, 0x100000, cullingRAMHiStatePages);
+  SaveState->Write(polyRAM, 0x400000, polyRAMStatePages);
+  SaveState->Write(textureRAM, 0x800000, textureRAMStatePages);
+  SaveState->Write(textureFIFO, 0x100000);
   SaveState->Write(&fifoIdx, sizeof(fifoIdx));
   SaveState->Write(m_vromTextureFIFO, sizeof(m_vromTextureFIFO));
 
@@ -119,12 +170,37 @@ void CReal3D::LoadState(CBlockFile *SaveState)
     return;
   }
 
-  SaveState->Read(memoryPool, MEM_POOL_SIZE_RW);
+  // Workers must not be writing the working memory while it is loaded
+  WaitForTextures();
+  if (m_catchUpPending)
+    CatchUpWorkingMemory();
+  SaveState->Read(cullingRAMLo, 0x400000);
+  SaveState->Read(cullingRAMHi, 0x100000);
+  SaveState->Read(polyRAM, 0x400000);
+  bool texturesChanged = true;
+  const void *textures = m_keepUnchangedTextures ? SaveState->ReadView(0x800000) : nullptr;
+  if (textures)
+  {
+    texturesChanged = memcmp(textureRAM, textures, 0x800000) != 0;
+    if (texturesChanged)
+      memcpy(textureRAM, textures, 0x800000);
+  }
+  else
+    SaveState->Read(textureRAM, 0x800000);
+  SaveState->Read(textureFIFO, 0x100000);
 
-  // If multi-threaded, update read-only snapshots too
+  // If multi-threaded, update read-only snapshots too (nothing is left for the working copies to catch up on)
   if (m_gpuMultiThreaded)
+  {
     UpdateSnapshots(true);
-  Render3D->UploadTextures(0, 0, 0, 2048, 2048);
+    memset(&memoryPool[OFFSET_8C_DIRTY], 0, OFFSET_TEXFIFO_BACK - OFFSET_8C_DIRTY);  // all dirty, stale and line arrays
+  }
+  if (texturesChanged)
+    Render3D->UploadTextures(0, 0, 0, 2048, 2048);
+  m_sceneChanged = true;
+  m_polyRAMChangesKnown = false;
+  for (int i = 0; i < 4; i++)
+    m_losLatched[i] = Render3D->GetLosValue(i);
   SaveState->Read(&fifoIdx, sizeof(fifoIdx));
   SaveState->Read(&m_vromTextureFIFO, sizeof(m_vromTextureFIFO));
 
@@ -162,6 +238,7 @@ void CReal3D::BeginVBlank(int statusCycles)
   // and in WriteDMARegister32/ReadDMARegister32, however it may be that they are completely unrelated.  It appears that step 1.x games
   // access just the former while step 2.x access the latter.  It is not known yet what this bit/these bits actually represent.
 	statusChange = ppc_total_cycles() + statusCycles;
+	ppc_set_next_event(statusChange);	// status polling loops must not be skipped past this point
 	m_evenFrame = !m_evenFrame;
 }
 
@@ -176,18 +253,194 @@ uint32_t CReal3D::SyncSnapshots(void)
   commandPortWrittenRO = commandPortWritten;
   commandPortWritten = false;
 
+  // The last flush's textures belong to this frame
+  WaitForTextures();
+
+  // Writes are only tracked for the snapshots, so without them the scene can never be known to be unchanged
   if (!m_gpuMultiThreaded)
+  {
+    m_sceneChanged = true;
+    m_polyRAMChangesKnown = false;
     return 0;
+  }
 
   // Update read-only queue
   queuedUploadTexturesRO = queuedUploadTextures;
   queuedUploadTextures.clear();
 
+  // The renderer runs alongside the PPC, so its results are only taken while both are stopped
+  if (m_deterministic)
+  {
+    for (int i = 0; i < 4; i++)
+      m_losLatched[i] = Render3D->GetLosValue(i);
+  }
+
   // Update read-only snapshots
-  return UpdateSnapshots(false);
+  return SwapSnapshots();
+}
+
+uint32_t CReal3D::SwapSnapshots(void)
+{
+  // Normally the PPC thread has already done this at the start of its frame
+  uint32_t copied = CatchUpWorkingMemory();
+
+  // The working copies become the snapshots, so nothing needs copying here. The old snapshots become the working copies and
+  // are missing this frame's writes, which the dirty arrays (now the stale arrays) record.
+  std::swap(cullingRAMLo, cullingRAMLoRO);
+  std::swap(cullingRAMHi, cullingRAMHiRO);
+  std::swap(polyRAM, polyRAMRO);
+  std::swap(textureRAM, textureRAMRO);
+  std::swap(cullingRAMLoDirty, cullingRAMLoStale);
+  std::swap(cullingRAMHiDirty, cullingRAMHiStale);
+  std::swap(polyRAMDirty, polyRAMStale);
+  std::swap(textureRAMDirty, textureRAMStale);
+  std::swap(cullingRAMLoLines, cullingRAMLoStaleLines);
+  std::swap(cullingRAMHiLines, cullingRAMHiStaleLines);
+  std::swap(polyRAMLines, polyRAMStaleLines);
+  std::swap(textureRAMLines, textureRAMStaleLines);
+  m_sceneChanged |= SceneMemoryWritten();
+
+  // The catch-up clears the stale pages, so the renderer gets its own record of them. Frames may be synced more than
+  // once before the renderer begins one.
+  static_assert(sizeof(m_polyRAMChanges) == DIRTY_SIZE(0x400000), "one bit per polygon RAM page");
+  for (size_t i = 0; i < sizeof(m_polyRAMChanges); i++)
+    m_polyRAMChanges[i] |= polyRAMStale[i];
+  static_assert(sizeof(m_cullingRAMChanges) == DIRTY_SIZE(0x400000) + DIRTY_SIZE(0x100000), "one bit per culling RAM page");
+  for (size_t i = 0; i < DIRTY_SIZE(0x400000); i++)
+    m_cullingRAMChanges[i] |= cullingRAMLoStale[i];
+  for (size_t i = 0; i < DIRTY_SIZE(0x100000); i++)
+    m_cullingRAMChanges[DIRTY_SIZE(0x400000) + i] |= cullingRAMHiStale[i];
+
+  Render3D->AttachMemory(cullingRAMLoRO, cullingRAMHiRO, polyRAMRO, vrom, textureRAMRO);
+  MapWriteWindows(true);
+
+  // Start copying the regions back while the tile generator and renderer get on with the frame
+  if (m_catchUpParallel)
+  {
+    for (int region = 0; region < 4; region++)
+      m_catchUpJobs.Run([this, region]() { m_catchUpCopied[region] = CatchUpRegion(region); });
+    m_catchUpPending = true;
+  }
+
+  return copied;
+}
+
+uint32_t CReal3D::CatchUpWorkingMemory(void)
+{
+  if (!m_gpuMultiThreaded)
+    return 0;
+
+  // Copy already started at sync, just wait for the jobs
+  if (m_catchUpParallel)
+  {
+    if (!m_catchUpPending)
+      return 0;
+    m_catchUpJobs.Wait();
+    m_catchUpPending = false;
+    return m_catchUpCopied[0] + m_catchUpCopied[1] + m_catchUpCopied[2] + m_catchUpCopied[3];
+  }
+
+  // Only reads the snapshots, so this can run while the renderer is using them
+  uint32_t copied = 0;
+  for (int region = 0; region < 4; region++)
+    copied += CatchUpRegion(region);
+  return copied;
+}
+
+// PowerPC stores go straight into the working copies of culling and polygon RAM, so the windows must follow
+// them whenever they are swapped
+void CReal3D::MapWriteWindows(bool map)
+{
+  static_assert(PAGE_WIDTH == 12 && LINE_WIDTH == 6, "PPC_WRITE_WINDOW tracks 4 KB pages of 64-byte lines");
+
+  struct
+  {
+    unsigned  block;
+    uint32_t  *mem;
+    uint32_t  size;
+    uint8_t   *dirty;
+    uint64_t  *lines;
+    uint8_t   *statePages;
+  } regions[] =
+  {
+    { 0x8C, cullingRAMLo, 0x400000, cullingRAMLoDirty,  cullingRAMLoLines,  cullingRAMLoStatePages },
+    { 0x8E, cullingRAMHi, 0x100000, cullingRAMHiDirty,  cullingRAMHiLines,  cullingRAMHiStatePages },
+    { 0x98, polyRAM,      0x400000, polyRAMDirty,       polyRAMLines,       polyRAMStatePages }
+  };
+
+  for (auto &region: regions)
+  {
+    if (!map)
+    {
+      ppc_set_write_window(region.block, NULL);
+      continue;
+    }
+    PPC_WRITE_WINDOW window;
+    window.ptr = region.mem;
+    window.mask = region.size - 1;
+    window.dirtyPages = m_gpuMultiThreaded ? region.dirty : NULL;
+    window.dirtyLines = m_gpuMultiThreaded ? region.lines : NULL;
+    window.statePages = region.statePages;
+    ppc_set_write_window(region.block, &window);
+  }
+}
+
+uint32_t CReal3D::CatchUpRegion(int region)
+{
+  switch (region)
+  {
+  case 0:   return UpdateSnapshot(false, (uint8_t*)cullingRAMLoRO, (uint8_t*)cullingRAMLo, 0x400000, cullingRAMLoStale, cullingRAMLoStaleLines);
+  case 1:   return UpdateSnapshot(false, (uint8_t*)cullingRAMHiRO, (uint8_t*)cullingRAMHi, 0x100000, cullingRAMHiStale, cullingRAMHiStaleLines);
+  case 2:   return UpdateSnapshot(false, (uint8_t*)polyRAMRO,      (uint8_t*)polyRAM,      0x400000, polyRAMStale, polyRAMStaleLines);
+  default:  return UpdateSnapshot(false, (uint8_t*)textureRAMRO,   (uint8_t*)textureRAM,   0x800000, textureRAMStale, textureRAMStaleLines);
+  }
+}
+
+// Number of leading bytes of a dirty array that are known to be clean, so the scan can step over them in one go
+static inline unsigned CleanDirtyBytes(const uint8_t *dirty, unsigned remaining)
+{
+#if defined(REAL3D_SSE2_SCAN)
+  if (remaining >= 16 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)dirty), _mm_setzero_si128())) == 0xFFFF)
+    return 16;
+#elif defined(REAL3D_NEON_SCAN)
+  if (remaining >= 16 && vmaxvq_u8(vld1q_u8(dirty)) == 0)
+    return 16;
+#endif
+  uint64_t word;
+  if (remaining >= 8 && (memcpy(&word, dirty, 8), word == 0))
+    return 8;
+  return 0;
+}
+
+// Whether culling or polygon RAM was written between the last two swaps. Only valid right after a swap, before the
+// catch-up clears the stale arrays
+bool CReal3D::SceneMemoryWritten(void) const
+{
+  const struct
+  {
+    const uint8_t *stale;
+    unsigned      size;
+  } regions[] =
+  {
+    { cullingRAMLoStale,  DIRTY_SIZE(0x400000) },
+    { cullingRAMHiStale,  DIRTY_SIZE(0x100000) },
+    { polyRAMStale,       DIRTY_SIZE(0x400000) }
+  };
+
+  for (auto &region: regions)
+  {
+    for (unsigned i = 0; i < region.size; )
+    {
+      unsigned clean = CleanDirtyBytes(&region.stale[i], region.size - i);
+      if (clean == 0 && region.stale[i] != 0)
+        return true;
+      i += clean ? clean : 1;
+    }
+  }
+  return false;
 }
 
-uint32_t CReal3D::UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, uint8_t *dirty)
+uint32_t CReal3D::UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, uint8_t *dirty, uint64_t *lines)
 {
   unsigned dirtySize = DIRTY_SIZE(size);
   if (copyWhole)
@@ -195,39 +448,60 @@ uint32_t CReal3D::UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, uns
     // If updating whole region, then just copy all data in one go
     memcpy(dst, src, size);
     memset(dirty, 0, dirtySize);
+    if (lines)
+      memset(lines, 0, LINES_SIZE(size));
     return size;
   }
   else
   {
     // Otherwise, loop through dirty pages array to find out what needs to be updated and copy only those parts
     uint32_t copied = 0;
-    uint8_t *pSrc = src;
-    uint8_t *pDst = dst;
     for (unsigned i = 0; i < dirtySize; i++)
     {
+      unsigned clean = CleanDirtyBytes(&dirty[i], dirtySize - i);
+      if (clean)
+      {
+        i += clean - 1;
+        continue;
+      }
+
       uint8_t d = dirty[i];
-      if (d)
+      for (unsigned j = 0; d != 0; j++, d >>= 1)
       {
-        for (unsigned j = 0; j < 8; j++)
+        if ((d & 1) == 0)
+          continue;
+
+        unsigned page = i * 8 + j;
+        uint8_t *pSrc = src + page * PAGE_SIZE;
+        uint8_t *pDst = dst + page * PAGE_SIZE;
+        bool lastPage = (page + 1) * PAGE_SIZE >= size;
+
+        // Without line masks (or with every line written) the whole page is copied
+        uint64_t mask = lines ? lines[page] : 0;
+        if (lines)
+          lines[page] = 0;
+        if (mask == 0 || mask == ~0ull)
+          mask = ~0ull;
+
+        // Copy each run of written lines.  If not at very end of region, then copy an extra 4 bytes to allow for a possible 32-bit overlap
+        for (unsigned k = 0; k < 64; )
         {
-          if (d&1)
+          if (((mask >> k) & 1) == 0)
           {
-            // If not at very end of region, then copy an extra 4 bytes to allow for a possible 32-bit overlap
-            uint32_t toCopy = (i < dirtySize - 1 || j < 7 ? PAGE_SIZE + 4 : PAGE_SIZE);
-            memcpy(pDst, pSrc, toCopy);
-            copied += toCopy;
+            k++;
+            continue;
           }
-          d >>= 1;
-          pSrc += PAGE_SIZE;
-          pDst += PAGE_SIZE;
+          unsigned end = k;
+          while (end < 64 && ((mask >> end) & 1))
+            end++;
+          uint32_t offset = k << LINE_WIDTH;
+          uint32_t toCopy = ((end - k) << LINE_WIDTH) + ((lastPage && end == 64) ? 0 : 4);
+          memcpy(pDst + offset, pSrc + offset, toCopy);
+          copied += toCopy;
+          k = end;
         }
-        dirty[i] = 0;
-      }
-      else
-      {
-        pSrc += 8 * PAGE_SIZE;
-        pDst += 8 * PAGE_SIZE;
       }
+      dirty[i] = 0;
     }
     return copied;
   }
@@ -236,10 +510,10 @@ uint32_t CReal3D::UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, uns
 uint32_t CReal3D::UpdateSnapshots(bool copyWhole)
 {
   // Update all memory region snapshots
-  uint32_t cullLoCopied  = UpdateSnapshot(copyWhole, (uint8_t*)cullingRAMLo, (uint8_t*)cullingRAMLoRO, 0x400000, cullingRAMLoDirty);
-  uint32_t cullHiCopied  = UpdateSnapshot(copyWhole, (uint8_t*)cullingRAMHi, (uint8_t*)cullingRAMHiRO, 0x100000, cullingRAMHiDirty);
-  uint32_t polyCopied    = UpdateSnapshot(copyWhole, (uint8_t*)polyRAM,      (uint8_t*)polyRAMRO,      0x400000, polyRAMDirty);
-  uint32_t textureCopied = UpdateSnapshot(copyWhole, (uint8_t*)textureRAM,   (uint8_t*)textureRAMRO,   0x800000, textureRAMDirty);
+  uint32_t cullLoCopied  = UpdateSnapshot(copyWhole, (uint8_t*)cullingRAMLo, (uint8_t*)cullingRAMLoRO, 0x400000, cullingRAMLoDirty, cullingRAMLoLines);
+  uint32_t cullHiCopied  = UpdateSnapshot(copyWhole, (uint8_t*)cullingRAMHi, (uint8_t*)cullingRAMHiRO, 0x100000, cullingRAMHiDirty, cullingRAMHiLines);
+  uint32_t polyCopied    = UpdateSnapshot(copyWhole, (uint8_t*)polyRAM,      (uint8_t*)polyRAMRO,      0x400000, polyRAMDirty, polyRAMLines);
+  uint32_t textureCopied = UpdateSnapshot(copyWhole, (uint8_t*)textureRAM,   (uint8_t*)textureRAMRO,   0x800000, textureRAMDirty, textureRAMLines);
   //printf("Read3D copied - cullLo:%4uK, cullHi:%4uK, poly:%4uK, texture:%4uK\n", cullLoCopied / 1024, cullHiCopied / 1024, polyCopied / 1024, textureCopied / 1024);
   return cullLoCopied + cullHiCopied + polyCopied + textureCopied;
 }
@@ -257,6 +531,15 @@ void CReal3D::BeginFrame(void)
     queuedUploadTexturesRO.clear();
   }
 
+  // Unchanged memory builds the same scene, whether or not the command port was written
+  Render3D->SetSceneUnchanged(!m_sceneChanged);
+  m_sceneChanged = false;
+  Render3D->SetPolygonRAMChanges(m_polyRAMChangesKnown ? m_polyRAMChanges : nullptr);
+  Render3D->SetCullingRAMChanges(m_polyRAMChangesKnown ? m_cullingRAMChanges : nullptr, m_cullingRAMChanges + DIRTY_SIZE(0x400000));
+  memset(m_polyRAMChanges, 0, sizeof(m_polyRAMChanges));
+  memset(m_cullingRAMChanges, 0, sizeof(m_cullingRAMChanges));
+  m_polyRAMChangesKnown = m_gpuMultiThreaded;
+
   Render3D->BeginFrame();
 }
 
@@ -320,6 +603,118 @@ static constexpr unsigned decode8x2[16] =
   15, 14
 };
 
+/*
+ * 8x8 tile decoders
+ *
+ * Whole 8x8 tiles are by far the most common case. The source tile is stored
+ * as pairs of rows, so every pair of destination rows is a fixed shuffle of
+ * 16 source texels (or 16 source bytes for 8-bit textures, which are doubled
+ * up into 16-bit words and stored through the byte select mask).
+ */
+
+static void StoreTile16Generic(uint16_t *dst, const uint16_t *src)
+{
+  for (unsigned yy = 0; yy < 8; yy++)
+  {
+    for (unsigned xx = 0; xx < 8; xx++)
+      dst[xx] = src[decode8x8[yy * 8 + xx]];
+    dst += 2048;
+  }
+}
+
+static void StoreTile8Generic(uint16_t *dst, const uint16_t *src, uint16_t keepMask)
+{
+  for (unsigned yy = 0; yy < 8; yy++)
+  {
+    for (unsigned xx = 0; xx < 8; xx++)
+    {
+      const uint8_t shift = (8 * ((xx & 1) ^ 1));
+      uint16_t tempData = (src[decode8x8[(yy ^ 1) * 8 + (xx ^ 1)] / 2] >> shift) & 0xFF;
+      tempData |= tempData << 8;
+      dst[xx] = (dst[xx] & keepMask) | (tempData & ~keepMask);
+    }
+    dst += 2048;
+  }
+}
+
+#if defined(REAL3D_X86_SIMD)
+
+REAL3D_TARGET("ssse3")
+static void StoreTile16SSSE3(uint16_t *dst, const uint16_t *src)
+{
+  // Words 1,0,5,4 of each half of the block belong to the first row, 3,2,7,6 to the second
+  const __m128i shuffle = _mm_setr_epi8(2, 3, 0, 1, 10, 11, 8, 9, 6, 7, 4, 5, 14, 15, 12, 13);
+  for (unsigned yy = 0; yy < 8; yy += 2)
+  {
+    __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), shuffle);
+    __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 8)), shuffle);
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi64(lo, hi));
+    _mm_storeu_si128((__m128i *)(dst + 2048), _mm_unpackhi_epi64(lo, hi));
+    src += 16;
+    dst += 2 * 2048;
+  }
+}
+
+REAL3D_TARGET("ssse3")
+static void StoreTile8SSSE3(uint16_t *dst, const uint16_t *src, uint16_t keepMask)
+{
+  // Each selected byte is written to both halves of its texel
+  const __m128i shuffle0 = _mm_setr_epi8(3, 3, 2, 2, 7, 7, 6, 6, 11, 11, 10, 10, 15, 15, 14, 14);
+  const __m128i shuffle1 = _mm_setr_epi8(1, 1, 0, 0, 5, 5, 4, 4, 9, 9, 8, 8, 13, 13, 12, 12);
+  const __m128i keep = _mm_set1_epi16((short)keepMask);
+  for (unsigned yy = 0; yy < 8; yy += 2)
+  {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)src);
+    __m128i old0 = _mm_loadu_si128((const __m128i *)dst);
+    __m128i old1 = _mm_loadu_si128((const __m128i *)(dst + 2048));
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_and_si128(old0, keep), _mm_andnot_si128(keep, _mm_shuffle_epi8(bytes, shuffle0))));
+    _mm_storeu_si128((__m128i *)(dst + 2048), _mm_or_si128(_mm_and_si128(old1, keep), _mm_andnot_si128(keep, _mm_shuffle_epi8(bytes, shuffle1))));
+    src += 8;
+    dst += 2 * 2048;
+  }
+}
+
+#elif defined(REAL3D_NEON_SIMD)
+
+static void StoreTile16NEON(uint16_t *dst, const uint16_t *src)
+{
+  // Swapping the words of each dword then splitting even and odd dwords gives the row pair
+  for (unsigned yy = 0; yy < 8; yy += 2)
+  {
+    uint32x4_t lo = vreinterpretq_u32_u16(vrev32q_u16(vld1q_u16(src)));
+    uint32x4_t hi = vreinterpretq_u32_u16(vrev32q_u16(vld1q_u16(src + 8)));
+    uint32x4x2_t rows = vuzpq_u32(lo, hi);
+    vst1q_u16(dst, vreinterpretq_u16_u32(rows.val[0]));
+    vst1q_u16(dst + 2048, vreinterpretq_u16_u32(rows.val[1]));
+    src += 16;
+    dst += 2 * 2048;
+  }
+}
+
+static inline uint16x8_t DoubleBytesNEON(uint16x4_t bytes)
+{
+  uint8x8_t b = vreinterpret_u8_u16(bytes);
+  uint8x8x2_t texels = vzip_u8(b, b);
+  return vreinterpretq_u16_u8(vcombine_u8(texels.val[0], texels.val[1]));
+}
+
+static void StoreTile8NEON(uint16_t *dst, const uint16_t *src, uint16_t keepMask)
+{
+  // Reversing the bytes of each dword leaves the first row in the even words and the second in the odd ones
+  const uint16x8_t keep = vdupq_n_u16(keepMask);
+  for (unsigned yy = 0; yy < 8; yy += 2)
+  {
+    uint16x8_t bytes = vreinterpretq_u16_u8(vrev32q_u8(vld1q_u8((const uint8_t *)src)));
+    uint16x8x2_t rows = vuzpq_u16(bytes, bytes);
+    vst1q_u16(dst, vbslq_u16(keep, vld1q_u16(dst), DoubleBytesNEON(vget_low_u16(rows.val[0]))));
+    vst1q_u16(dst + 2048, vbslq_u16(keep, vld1q_u16(dst + 2048), DoubleBytesNEON(vget_low_u16(rows.val[1]))));
+    src += 8;
+    dst += 2 * 2048;
+  }
+}
+
+#endif
+
 void CReal3D::StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigned width, unsigned height, const uint16_t *texData, bool sixteenBit, bool writeLSB, bool writeMSB, uint32_t &texDataOffset)
 {
   const uint32_t tileX = (std::min)(8u, width);
@@ -329,6 +724,26 @@ void CReal3D::StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigne
 
   texDataOffset = 0;
 
+  // Each texture RAM line is one save state page as well
+  if ((sixteenBit || writeLSB || writeMSB) && yPos < 2048)
+    memset(&textureRAMStatePages[yPos], 1, (std::min)(height, 2048 - yPos));
+
+  // A texture RAM line is exactly one dirty page, so mark each line once rather than every texel
+  if (m_gpuMultiThreaded && (sixteenBit || writeLSB || writeMSB))
+  {
+    unsigned firstLine = (xPos * 2) >> LINE_WIDTH;
+    unsigned lastLine = ((xPos + width) * 2 - 1) >> LINE_WIDTH;
+    uint64_t lineMask = ((lastLine == 63) ? ~0ull : ((1ull << (lastLine + 1)) - 1)) & ~((1ull << firstLine) - 1);
+    for (uint32_t y = yPos; y < (yPos + height); y++)
+    {
+      MARK_DIRTY(textureRAMDirty, y * 2048 * 2);
+      if (textureRAMLines)
+        textureRAMLines[y] |= lineMask;
+    }
+  }
+
+  const bool wholeTiles = (tileX == 8) && (tileY == 8);
+
   if (sixteenBit)  // 16-bit textures
   {
     // Outer 2 loops: NxN tiles
@@ -338,20 +753,19 @@ void CReal3D::StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigne
       {
         // Inner 2 loops: NxN texels for the current tile
         uint32_t destOffset = y * 2048 + x;
-        for (uint32_t yy = 0; yy < tileY; yy++)
+        if (wholeTiles)
+          m_storeTile16(&textureRAM[destOffset], texData);
+        else
         {
-          for (uint32_t xx = 0; xx < tileX; xx++)
+          for (uint32_t yy = 0; yy < tileY; yy++)
           {
-            if (m_gpuMultiThreaded)
-              MARK_DIRTY(textureRAMDirty, destOffset * 2);
-
-            textureRAM[destOffset++] = texData[decode[yy * tileX + xx]];
-
-            texDataOffset++;
+            for (uint32_t xx = 0; xx < tileX; xx++)
+              textureRAM[destOffset++] = texData[decode[yy * tileX + xx]];
+            destOffset += 2048 - tileX; // next line
           }
-          destOffset += 2048 - tileX; // next line
         }
         texData += tileY * tileX; // next tile
+        texDataOffset += tileY * tileX;
       }
     }
   }
@@ -376,13 +790,18 @@ void CReal3D::StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigne
       {
         // Inner 2 loops: NxN texels for the current tile
         uint32_t destOffset = y * 2048 + x;
+        if (wholeTiles && (writeLSB | writeMSB))
+        {
+          m_storeTile8(&textureRAM[destOffset], texData, byteMask[byteSelect]);
+          texData += offset; // next tile
+          texDataOffset += offset; // next tile
+          continue;
+        }
         for (uint32_t yy = 0; yy < tileY; yy++)
         {
           for (uint32_t xx = 0; xx < tileX; xx++)
           {
             if (writeLSB | writeMSB) {
-              if (m_gpuMultiThreaded)
-                MARK_DIRTY(textureRAMDirty, destOffset * 2);
               textureRAM[destOffset] &= byteMask[byteSelect];
               const uint8_t shift = (8 * ((xx & 1) ^ 1));
               const uint8_t index = (yy ^ 1) * tileX + (xx ^ 1) - (tileX & 1);
@@ -502,7 +921,14 @@ void CReal3D::DMACopy(void)
 {
   DebugLog("Real3D DMA copy (PC=%08X, LR=%08X): %08X -> %08X, %X %s\n", ppc_get_pc(), ppc_get_lr(), dmaSrc, dmaDest, dmaLength*4, (dmaConfig&0x80)?"(byte reversed)":"");
   //printf("Real3D DMA copy (PC=%08X, LR=%08X): %08X -> %08X, %X %s\n", ppc_get_pc(), ppc_get_lr(), dmaSrc, dmaDest, dmaLength*4, (dmaConfig&0x80)?"(byte reversed)":"");
-  if ((dmaConfig&0x80)) // reverse bytes
+  // Plain memory to Real3D memory is moved as one block
+  if (Bus->MoveBlock32(dmaDest, dmaSrc, dmaLength, (dmaConfig&0x80) != 0))
+  {
+    dmaSrc += dmaLength*4;
+    dmaDest += dmaLength*4;
+    dmaLength = 0;
+  }
+  else if ((dmaConfig&0x80)) // reverse bytes
   {
     while (dmaLength != 0)
     {
@@ -629,28 +1055,56 @@ void CReal3D::Flush(void)
   // Upload textures (if any)
   if (fifoIdx > 2) // If the texture header/data aren't present, discard the texture (prevents garbage textures in Ski Champ)
   {
-    for (uint32_t i = 0; i < fifoIdx - 2; )
+    if (m_asyncTextures)
     {
-      uint32_t size = 2+textureFIFO[i+0]/2;
-      size /= 4;
-      uint32_t header = textureFIFO[i+1]; // texture information header
+      // Decode the filled FIFO on a worker and let the PPC carry on filling the other one. Only one decode runs at a
+      // time, so texture RAM is still written in upload order, and never alongside the copy back from the snapshots.
+      WaitForTextures();
+      if (m_catchUpPending)
+        CatchUpWorkingMemory();
+      std::swap(textureFIFO, textureFIFOBack);
+      const uint32_t *fifo = textureFIFOBack;
+      uint32_t numWords = fifoIdx;
+      m_textureJobs.Run([this, fifo, numWords]() { UploadTextureFIFO(fifo, numWords); });
+      m_texturesPending = true;
+    }
+    else
+      UploadTextureFIFO(textureFIFO, fifoIdx);
+  }
 
-      // Spikeout seems to be uploading 0 length textures
-      if (0 == size)
-      {
-        DebugLog("Real3D: 0-length texture upload @ PC=%08X (%08X %08X %08X)\n", ppc_get_pc(), textureFIFO[i+0], textureFIFO[i+1], textureFIFO[i+2]);
-        break;
-      }
+  // Reset texture FIFO
+  fifoIdx = 0;
+}
 
-      UploadTexture(header,(uint16_t *)&textureFIFO[i+2]);
-      DebugLog("Real3D: Texture upload completed: %X bytes (%X)\n", size*4, textureFIFO[i+0]);
+void CReal3D::UploadTextureFIFO(const uint32_t *fifo, uint32_t numWords)
+{
+  for (uint32_t i = 0; i < numWords - 2; )
+  {
+    uint32_t size = 2+fifo[i+0]/2;
+    size /= 4;
+    uint32_t header = fifo[i+1]; // texture information header
 
-      i += size;
+    // Spikeout seems to be uploading 0 length textures
+    if (0 == size)
+    {
+      DebugLog("Real3D: 0-length texture upload (%08X %08X %08X)\n", fifo[i+0], fifo[i+1], fifo[i+2]);
+      break;
     }
+
+    UploadTexture(header,(const uint16_t *)&fifo[i+2]);
+    DebugLog("Real3D: Texture upload completed: %X bytes (%X)\n", size*4, fifo[i+0]);
+
+    i += size;
   }
+}
 
-  // Reset texture FIFO
-  fifoIdx = 0;
+void CReal3D::WaitForTextures(void)
+{
+  if (m_texturesPending)
+  {
+    m_textureJobs.Wait();
+    m_texturesPending = false;
+  }
 }
 
 void CReal3D::WriteTextureFIFO(uint32_t data)
@@ -665,6 +1119,22 @@ void CReal3D::WriteTextureFIFO(uint32_t data)
     textureFIFO[fifoIdx++] = data;
 }
 
+void CReal3D::WriteTextureFIFOBlock(const uint32_t *data, unsigned numWords, bool reverseBytes)
+{
+  unsigned space = (0x100000/4) - fifoIdx;
+  if (numWords > space)
+  {
+    if (!error)
+      ErrorLog("Overflow in Real3D texture FIFO!");
+    error = true;
+    numWords = space;
+  }
+  memcpy(&textureFIFO[fifoIdx], data, numWords * 4);
+  if (reverseBytes)
+    Util::FlipEndian32((uint8_t *) &textureFIFO[fifoIdx], numWords * 4);
+  fifoIdx += numWords;
+}
+
 void CReal3D::WriteTexturePort(unsigned reg, uint32_t data)
 {
   if (step == 0x10)
@@ -683,6 +1153,7 @@ void CReal3D::WriteTexturePort(unsigned reg, uint32_t data)
   {
     if (m_vromTextureFIFOIdx == 2)
     {
+      WaitForTextures();
       uint32_t addr = m_vromTextureFIFO[0];
       uint32_t header = m_vromTextureFIFO[1];
 
@@ -702,24 +1173,59 @@ void CReal3D::WriteTexturePort(unsigned reg, uint32_t data)
 void CReal3D::WriteLowCullingRAM(uint32_t addr, uint32_t data)
 {
   if (m_gpuMultiThreaded)
-    MARK_DIRTY(cullingRAMLoDirty, addr);
+    MARK_DIRTY_LINE(cullingRAMLoDirty, cullingRAMLoLines, addr);
+  cullingRAMLoStatePages[addr >> CBlockFile::PageShift] = 1;
   cullingRAMLo[addr/4] = data;
 }
 
 void CReal3D::WriteHighCullingRAM(uint32_t addr, uint32_t data)
 {
   if (m_gpuMultiThreaded)
-    MARK_DIRTY(cullingRAMHiDirty, addr);
+    MARK_DIRTY_LINE(cullingRAMHiDirty, cullingRAMHiLines, addr);
+  cullingRAMHiStatePages[addr >> CBlockFile::PageShift] = 1;
   cullingRAMHi[addr/4] = data;
 }
 
 void CReal3D::WritePolygonRAM(uint32_t addr, uint32_t data)
 {
   if (m_gpuMultiThreaded)
-    MARK_DIRTY(polyRAMDirty, addr);
+    MARK_DIRTY_LINE(polyRAMDirty, polyRAMLines, addr);
+  polyRAMStatePages[addr >> CBlockFile::PageShift] = 1;
   polyRAM[addr/4] = data;
 }
 
+void CReal3D::WriteMemoryBlock(uint32_t *mem, uint8_t *dirty, uint64_t *lines, uint8_t *statePages, uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes)
+{
+  if (numWords == 0)
+    return;
+  uint32_t end = addr + numWords * 4;
+  if (m_gpuMultiThreaded)
+  {
+    for (uint32_t line = addr & ~((1 << LINE_WIDTH) - 1); line < end; line += 1 << LINE_WIDTH)
+      MARK_DIRTY_LINE(dirty, lines, line);
+  }
+  for (uint32_t page = addr >> CBlockFile::PageShift; page <= ((end - 1) >> CBlockFile::PageShift); page++)
+    statePages[page] = 1;
+  memcpy(&mem[addr / 4], data, numWords * 4);
+  if (reverseBytes)
+    Util::FlipEndian32((uint8_t *) &mem[addr / 4], numWords * 4);
+}
+
+void CReal3D::WriteLowCullingRAMBlock(uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes)
+{
+  WriteMemoryBlock(cullingRAMLo, cullingRAMLoDirty, cullingRAMLoLines, cullingRAMLoStatePages, addr, data, numWords, reverseBytes);
+}
+
+void CReal3D::WriteHighCullingRAMBlock(uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes)
+{
+  WriteMemoryBlock(cullingRAMHi, cullingRAMHiDirty, cullingRAMHiLines, cullingRAMHiStatePages, addr, data, numWords, reverseBytes);
+}
+
+void CReal3D::WritePolygonRAMBlock(uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes)
+{
+  WriteMemoryBlock(polyRAM, polyRAMDirty, polyRAMLines, polyRAMStatePages, addr, data, numWords, reverseBytes);
+}
+
 void CReal3D::WriteJTAGModeword(CASIC::Name device, uint32_t data)
 {
     if (device == CASIC::Name::Dummy)
@@ -789,7 +1295,7 @@ uint32_t CReal3D::ReadRegister(unsigned reg)
   else if (reg >= 20 && reg<=32) {	// line of sight registers
 
 	int index = (reg - 20) / 4;
-	float val = Render3D->GetLosValue(index);
+	float val = m_deterministic ? m_losLatched[index] : Render3D->GetLosValue(index);
 	return *(uint32_t*)(&val);
   }
 
@@ -848,6 +1354,9 @@ void CReal3D::Reset(void)
   m_pingPong = 0;
   commandPortWritten = false;
   commandPortWrittenRO = false;
+  m_sceneChanged = true;
+  m_polyRAMChangesKnown = false;
+  memset(m_losLatched, 0, sizeof(m_losLatched));
 
   queuedUploadTextures.clear();
   queuedUploadTexturesRO.clear();
@@ -863,6 +1372,9 @@ void CReal3D::Reset(void)
   dmaStatus = 0;
   dmaConfig = 0;
 
+  WaitForTextures();
+  if (m_catchUpPending)
+    CatchUpWorkingMemory();
   unsigned memSize = (m_gpuMultiThreaded ? MEMORY_POOL_SIZE : MEM_POOL_SIZE_RW);
   memset(memoryPool, 0, memSize);
   memset(m_vromTextureFIFO, 0, sizeof(m_vromTextureFIFO));
@@ -887,10 +1399,16 @@ void CReal3D::AttachRenderer(IRender3D *Render3DPtr)
     Render3D->AttachMemory(cullingRAMLo, cullingRAMHi, polyRAM, vrom, textureRAM);
 
   Render3D->SetStepping(step);
+  m_sceneChanged = true;
 
   DebugLog("Real3D attached a Render3D object\n");
 }
 
+void CReal3D::SetKeepUnchangedTextures(bool enable)
+{
+  m_keepUnchangedTextures = enable;
+}
+
 void CReal3D::SetStepping(int stepping)
 {
   step = stepping;
@@ -921,9 +1439,10 @@ Result CReal3D::Init(const uint8_t *vromPtr, IBus *BusObjectPtr, CIRQ *IRQObject
   dmaIRQ = dmaIRQBit;
 
   // Allocate all Real3D RAM regions
-  memoryPool = new(std::nothrow) uint8_t[memSize];
+  memoryPool = Util::AllocateHugePages(memSize, "Real3D memory");
   if (NULL == memoryPool)
     return ErrorLog("Insufficient memory for Real3D object (needs %1.1f MB).", memSizeMB);
+  m_memoryAccount.SetCPU(memSize);
 
   // Set up main pointers
   cullingRAMLo = (uint32_t *) &memoryPool[OFFSET_8C];
@@ -931,6 +1450,7 @@ Result CReal3D::Init(const uint8_t *vromPtr, IBus *BusObjectPtr, CIRQ *IRQObject
   polyRAM = (uint32_t *) &memoryPool[OFFSET_98];
   textureRAM = (uint16_t *) &memoryPool[OFFSET_TEXRAM];
   textureFIFO = (uint32_t *) &memoryPool[OFFSET_TEXFIFO];
+  textureFIFOBack = m_gpuMultiThreaded ? (uint32_t *) &memoryPool[OFFSET_TEXFIFO_BACK] : nullptr;
 
   // If multi-threaded, set up pointers for read-only snapshots and dirty page arrays too
   if (m_gpuMultiThreaded)
@@ -943,11 +1463,36 @@ Result CReal3D::Init(const uint8_t *vromPtr, IBus *BusObjectPtr, CIRQ *IRQObject
     cullingRAMHiDirty = (uint8_t *) &memoryPool[OFFSET_8E_DIRTY];
     polyRAMDirty = (uint8_t *) &memoryPool[OFFSET_98_DIRTY];
     textureRAMDirty = (uint8_t *) &memoryPool[OFFSET_TEXRAM_DIRTY];
+    cullingRAMLoStale = (uint8_t *) &memoryPool[OFFSET_8C_STALE];
+    cullingRAMHiStale = (uint8_t *) &memoryPool[OFFSET_8E_STALE];
+    polyRAMStale = (uint8_t *) &memoryPool[OFFSET_98_STALE];
+    textureRAMStale = (uint8_t *) &memoryPool[OFFSET_TEXRAM_STALE];
+
+    // Line masks are left unset without fine dirty tracking, which copies whole pages
+    if (m_config["FineDirtyTracking"].ValueAs<bool>())
+    {
+      cullingRAMLoLines = (uint64_t *) &memoryPool[OFFSET_8C_LINES];
+      cullingRAMHiLines = (uint64_t *) &memoryPool[OFFSET_8E_LINES];
+      polyRAMLines = (uint64_t *) &memoryPool[OFFSET_98_LINES];
+      textureRAMLines = (uint64_t *) &memoryPool[OFFSET_TEXRAM_LINES];
+      cullingRAMLoStaleLines = (uint64_t *) &memoryPool[OFFSET_8C_STALE_LINES];
+      cullingRAMHiStaleLines = (uint64_t *) &memoryPool[OFFSET_8E_STALE_LINES];
+      polyRAMStaleLines = (uint64_t *) &memoryPool[OFFSET_98_STALE_LINES];
+      textureRAMStaleLines = (uint64_t *) &memoryPool[OFFSET_TEXRAM_STALE_LINES];
+    }
   }
 
   // VROM pointer passed to us
   vrom = (uint32_t *) vromPtr;
 
+  // Copy the memory regions back after each swap in parallel, on the shared job pool
+  m_catchUpParallel = m_gpuMultiThreaded && m_config["MultiThreaded"].ValueAsDefault<bool>(false) && Util::Jobs::NumWorkers() > 0;
+  m_catchUpPending = false;
+
+  // Texture uploads are only queued for the renderer when multi-threaded, so only then can they be decoded off the PPC
+  m_asyncTextures = m_catchUpParallel;
+  m_texturesPending = false;
+  MapWriteWindows(true);
   DebugLog("Initialized Real3D (allocated %1.1f MB)\n", memSizeMB);
   return Result::OKAY;
 }
@@ -955,6 +1500,7 @@ Result CReal3D::Init(const uint8_t *vromPtr, IBus *BusObjectPtr, CIRQ *IRQObject
 CReal3D::CReal3D(const Util::Config::Node &config)
   : m_config(config),
     m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>()),
+    m_deterministic(m_gpuMultiThreaded && config["MultiThreaded"].ValueAsDefault<bool>(false) && config["Deterministic"].ValueAsDefault<bool>(false)),
     Bus(nullptr),
     IRQ(nullptr),
     commandPortWritten(false),
@@ -962,6 +1508,7 @@ CReal3D::CReal3D(const Util::Config::Node &config)
     cullingRAMHi(nullptr),
     cullingRAMHiDirty(nullptr),
     cullingRAMHiRO(nullptr),
+    cullingRAMHiStale(nullptr),
     dmaConfig(0),
     dmaData(0),
     dmaDest(0),
@@ -977,17 +1524,34 @@ CReal3D::CReal3D(const Util::Config::Node &config)
     polyRAMRO(nullptr),
     step(0),
     textureRAMDirty(nullptr),
-    textureRAMRO(nullptr)
+    textureRAMRO(nullptr),
+    polyRAMStale(nullptr),
+    textureRAMStale(nullptr),
+    cullingRAMLoLines(nullptr),
+    cullingRAMHiLines(nullptr),
+    polyRAMLines(nullptr),
+    textureRAMLines(nullptr),
+    cullingRAMLoStaleLines(nullptr),
+    cullingRAMHiStaleLines(nullptr),
+    polyRAMStaleLines(nullptr),
+    textureRAMStaleLines(nullptr),
+    m_catchUpParallel(false),
+    m_catchUpPending(false),
+    m_keepUnchangedTextures(false),
+    m_asyncTextures(false),
+    m_texturesPending(false)
 {
   Render3D = NULL;
   memoryPool = NULL;
   cullingRAMLo = NULL;
   cullingRAMLoRO = NULL;
   cullingRAMLoDirty = NULL;
+  cullingRAMLoStale = NULL;
   cullingRAMHi = NULL;
   polyRAM = NULL;
   textureRAM = NULL;
   textureFIFO = NULL;
+  textureFIFOBack = NULL;
   vrom = NULL;
   error = false;
   fifoIdx = 0;
@@ -996,8 +1560,31 @@ CReal3D::CReal3D(const Util::Config::Node &config)
   m_vromTextureFIFOIdx = 0;
   m_internalRenderConfig[0] = 0;
   m_internalRenderConfig[1] = 0;
+  memset(cullingRAMLoStatePages, 0, sizeof(cullingRAMLoStatePages));
+  memset(cullingRAMHiStatePages, 0, sizeof(cullingRAMHiStatePages));
+  memset(polyRAMStatePages, 0, sizeof(polyRAMStatePages));
+  memset(textureRAMStatePages, 0, sizeof(textureRAMStatePages));
+
+  const char *decoder = "generic";
+  m_storeTile16 = StoreTile16Generic;
+  m_storeTile8 = StoreTile8Generic;
+#if defined(REAL3D_X86_SIMD)
+  if (Util::GetCPUFeatures().ssse3)
+  {
+    m_storeTile16 = StoreTile16SSSE3;
+    m_storeTile8 = StoreTile8SSSE3;
+    decoder = "SSSE3";
+  }
+#elif defined(REAL3D_NEON_SIMD)
+  if (Util::GetCPUFeatures().neon)
+  {
+    m_storeTile16 = StoreTile16NEON;
+    m_storeTile8 = StoreTile8NEON;
+    decoder = "NEON";
+  }
+#endif
 
-  DebugLog("Built Real3D\n");
+  DebugLog("Built Real3D (%s texture decoder)\n", decoder);
 }
 
 /*
@@ -1007,6 +1594,10 @@ CReal3D::CReal3D(const Util::Config::Node &config)
  */
 CReal3D::~CReal3D(void)
 {
+  WaitForTextures();
+  if (memoryPool != NULL)
+    MapWriteWindows(false);
+
   // Dump memory
 #if 0
   FILE  *fp;
@@ -1079,14 +1670,18 @@ CReal3D::~CReal3D(void)
     printf("Wrote textures as L4 (channel 3) to 'textures_l4_3.bmp'\n");
   }
 
+  CatchUpWorkingMemory();
+
   Render3D = nullptr;
-  delete [] memoryPool;
+  Util::FreeHugePages(memoryPool, m_gpuMultiThreaded ? MEMORY_POOL_SIZE : MEM_POOL_SIZE_RW);
   memoryPool = nullptr;
+  m_memoryAccount.SetCPU(0);
   cullingRAMLo = nullptr;
   cullingRAMHi = nullptr;
   polyRAM = nullptr;
   textureRAM = nullptr;
   textureFIFO = nullptr;
+  textureFIFOBack = nullptr;
   vrom = nullptr;
   DebugLog("Destroyed Real3D\n");
 }
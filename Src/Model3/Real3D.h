@@ -33,8 +33,11 @@
 #include "JTAG.h"
 #include "PCI.h"
 #include "CPU/Bus.h"
+#include "BlockFile.h"
 #include "Graphics/IRender3D.h"
 #include "Util/NewConfig.h"
+#include "Util/JobSystem.h"
+#include "Util/MemoryUsage.h"
 
 #include <cstdint>
 #include <unordered_map>
@@ -128,6 +131,22 @@ public:
    */
   uint32_t SyncSnapshots(void);
 
+  /*
+   * CatchUpWorkingMemory(void):
+   *
+   * SyncSnapshots() swaps the working memory with the read-only snapshots
+   * rather than copying it, leaving the new working copies without the pages
+   * written during the last frame. This copies those pages back from the
+   * snapshots. It must be called before the PPC writes to Real3D memory again
+   * and only reads the snapshots, so it can run alongside the renderer. When
+   * catch-up workers are running, the copy is started by SyncSnapshots() and
+   * this waits for it to finish.
+   *
+   * Returns:
+   *    Number of bytes copied.
+   */
+  uint32_t CatchUpWorkingMemory(void);
+
   /*
    * BeginFrame(void):
    *
@@ -162,6 +181,11 @@ public:
    * are uploaded and the FIFO is reset. On the real device, this seems to 
    * cause a frame to be rendered as well but this is not performed here.
    *
+   * When multi-threaded with workers available, the filled FIFO is swapped
+   * with a second buffer and decoded into texture RAM by a job, so the PPC
+   * does not stall on large batches. Everything that touches texture RAM
+   * from the PPC thread waits for it first, at the latest SyncSnapshots().
+   *
    * This should be called when the command port is written.
    */
   void Flush(void);
@@ -235,6 +259,19 @@ public:
    *    data  Data to write.
    */
   void WriteTextureFIFO(uint32_t data);
+
+  /*
+   * WriteTextureFIFOBlock(data, numWords, reverseBytes):
+   *
+   * Appends a block of words to the texture FIFO. Same result as writing
+   * each word in turn with WriteTextureFIFO().
+   *
+   * Parameters:
+   *    data          Words to write.
+   *    numWords      Number of words.
+   *    reverseBytes  If true, each word is byte reversed on the way in.
+   */
+  void WriteTextureFIFOBlock(const uint32_t *data, unsigned numWords, bool reverseBytes);
   
   /*
    * WriteTexturePort(reg, data):
@@ -263,6 +300,26 @@ public:
    *    data  Data to write.
    */
   void WritePolygonRAM(uint32_t addr, uint32_t data);
+
+  /*
+   * WriteLowCullingRAMBlock(addr, data, numWords, reverseBytes):
+   * WriteHighCullingRAMBlock(addr, data, numWords, reverseBytes):
+   * WritePolygonRAMBlock(addr, data, numWords, reverseBytes):
+   *
+   * Block versions of the writes above. Same result as writing each word in
+   * turn, but dirty pages and lines are marked once per range.
+   *
+   * Parameters:
+   *    addr          Word aligned start address. The block must lie
+   *                  entirely within the region.
+   *    data          Words to write.
+   *    numWords      Number of words.
+   *    reverseBytes  If true, each word is byte reversed on the way in, as
+   *                  big endian buses must do.
+   */
+  void WriteLowCullingRAMBlock(uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes);
+  void WriteHighCullingRAMBlock(uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes);
+  void WritePolygonRAMBlock(uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes);
   
   /*
   * WriteJTAGModeword(device, data):
@@ -359,6 +416,19 @@ public:
    */
   void SetStepping(int stepping);
 
+  /*
+   * SetKeepUnchangedTextures(enable):
+   *
+   * When enabled, LoadState() only has the renderer upload texture RAM if the
+   * loaded contents differ from what is already there. This is only safe when
+   * the renderer has seen every texture write since the last load, as when
+   * replaying a sequence of graphics states.
+   *
+   * Parameters:
+   *    enable      True to skip uploads of unchanged texture RAM.
+   */
+  void SetKeepUnchangedTextures(bool enable);
+
   
   /*
    * Init(vromPtr, BusObjectPtr, IRQObjectPtr, dmaIRQBit):
@@ -402,12 +472,24 @@ private:
   void      StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigned width, unsigned height, const uint16_t *texData, bool sixteenBit, bool writeLSB, bool writeMSB, uint32_t &texDataOffset);
 
   void      UploadTexture(uint32_t header, const uint16_t *texData);
+  void      UploadTextureFIFO(const uint32_t *fifo, uint32_t numWords);
+  void      WaitForTextures(void);
+  void      WriteMemoryBlock(uint32_t *mem, uint8_t *dirty, uint64_t *lines, uint8_t *statePages, uint32_t addr, const uint32_t *data, unsigned numWords, bool reverseBytes);
   uint32_t  UpdateSnapshots(bool copyWhole);
-  uint32_t  UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, uint8_t *dirty);
+  uint32_t  SwapSnapshots(void);
+  uint32_t  UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, uint8_t *dirty, uint64_t *lines);
+  uint32_t  CatchUpRegion(int region);
+  void      MapWriteWindows(bool map);
+  bool      SceneMemoryWritten(void) const;
 
   // Config 
   const Util::Config::Node &m_config;
   const bool                m_gpuMultiThreaded;
+  const bool                m_deterministic;    // line-of-sight results are only taken between frames
+
+  // Whole 8x8 tile decoders (SIMD versions are selected at start-up when available)
+  void (*m_storeTile16)(uint16_t *dst, const uint16_t *src);
+  void (*m_storeTile8)(uint16_t *dst, const uint16_t *src, uint16_t keepMask);
 
   // Renderer attached to the Real3D
   IRender3D *Render3D;
@@ -422,12 +504,14 @@ private:
 
   // Real3D memory
   uint8_t   *memoryPool;        // all memory allocated here
+  Util::MemoryAccount m_memoryAccount{"Real3D memory"};  // including the read-only snapshots
   uint32_t  *cullingRAMLo;      // 4MB of culling RAM at 8C000000
   uint32_t  *cullingRAMHi;      // 1MB of culling RAM at 8E000000
   uint32_t  *polyRAM;           // 4MB of polygon RAM at 98000000
   uint16_t  *textureRAM;        // 8MB of internal texture RAM
   uint32_t  *textureFIFO;       // 1MB texture FIFO at 0x94000000
   uint32_t  fifoIdx;            // index into texture FIFO
+  uint32_t  *textureFIFOBack;   // 1MB FIFO being decoded by a job while the other fills
   uint32_t  m_vromTextureFIFO[2];
   uint32_t  m_vromTextureFIFOIdx;
   
@@ -443,6 +527,41 @@ private:
   uint8_t   *polyRAMDirty;
   uint8_t   *textureRAMDirty;
 
+  // Pages of the working memory still to be copied back from the snapshots after a swap
+  uint8_t   *cullingRAMLoStale;
+  uint8_t   *cullingRAMHiStale;
+  uint8_t   *polyRAMStale;
+  uint8_t   *textureRAMStale;
+
+  // Masks of the 64-byte lines written within each dirty/stale page (null unless fine dirty tracking is enabled)
+  uint64_t  *cullingRAMLoLines;
+  uint64_t  *cullingRAMHiLines;
+  uint64_t  *polyRAMLines;
+  uint64_t  *textureRAMLines;
+  uint64_t  *cullingRAMLoStaleLines;
+  uint64_t  *cullingRAMHiStaleLines;
+  uint64_t  *polyRAMStaleLines;
+  uint64_t  *textureRAMStaleLines;
+
+  // Pages written since the last in-memory save state (see CBlockFile::Write(data, numBytes, changedPages))
+  uint8_t   cullingRAMLoStatePages[0x400000 >> CBlockFile::PageShift];
+  uint8_t   cullingRAMHiStatePages[0x100000 >> CBlockFile::PageShift];
+  uint8_t   polyRAMStatePages[0x400000 >> CBlockFile::PageShift];
+  uint8_t   textureRAMStatePages[0x800000 >> CBlockFile::PageShift];
+
+  // Catch-up jobs (one per memory region) copy the working memory back from the snapshots after a swap
+  Util::JobGroup              m_catchUpJobs;
+  uint32_t                    m_catchUpCopied[4];
+  bool                        m_catchUpParallel;
+  bool                        m_catchUpPending;   // jobs have been queued and not yet waited for
+
+  bool                        m_keepUnchangedTextures;
+
+  // Texture FIFO decoding job started by Flush()
+  Util::JobGroup              m_textureJobs;
+  bool                        m_asyncTextures;
+  bool                        m_texturesPending;  // a FIFO is being decoded and not yet waited for
+
   // Queued texture uploads
   std::vector<QueuedUploadTextures> queuedUploadTextures;
   std::vector<QueuedUploadTextures> queuedUploadTexturesRO;  // Read-only copy of queue
@@ -466,6 +585,18 @@ private:
   // Command port
   bool  commandPortWritten;
   bool  commandPortWrittenRO; // Read-only copy of flag
+
+  // Culling or polygon RAM may have changed since the renderer last built its scene
+  bool  m_sceneChanged = true;
+
+  // Polygon and culling RAM pages written since the renderer last began a frame, passed on to it so that it can keep the
+  // models and scene subtrees that weren't. Only tracked when multi-threaded.
+  uint8_t m_polyRAMChanges[128] = {};  // one bit per 4 KB page
+  uint8_t m_cullingRAMChanges[128 + 32] = {};  // likewise, low culling RAM then high culling RAM
+  bool  m_polyRAMChangesKnown = false;
+
+  // Line-of-sight results as of the last frame sync, read back instead of the renderer's when deterministic
+  float m_losLatched[4] = {};
   
   // Status and command registers
   uint32_t m_pingPong;
@@ -0,0 +1,222 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * RewindBuffer.cpp
+ *
+ * Encoded states are a series of page records:
+ *
+ *    page      (uint32_t)  Page number.
+ *    runs      ...         Until the page is covered: the number of unchanged
+ *                          bytes (uint16_t), the number of changed bytes
+ *                          (uint16_t), and the changed bytes XORed with the
+ *                          reference.
+ *
+ * Pages identical to the reference have no record.
+ */
+
+#include "RewindBuffer.h"
+#include "IEmulator.h"
+#include "Supermodel.h"
+#include <algorithm>
+#include <cstring>
+
+// Shortest run of unchanged bytes worth ending a run of changed bytes for
+static const size_t s_minUnchangedRun = 4;
+
+static void Put16(std::vector<uint8_t> *out, uint16_t value)
+{
+  out->insert(out->end(), (const uint8_t *) &value, (const uint8_t *) &value + sizeof(value));
+}
+
+static void Put32(std::vector<uint8_t> *out, uint32_t value)
+{
+  out->insert(out->end(), (const uint8_t *) &value, (const uint8_t *) &value + sizeof(value));
+}
+
+bool CRewindBuffer::EncodePage(std::vector<uint8_t> *out, const uint8_t *data, const uint8_t *reference, uint32_t page, size_t size) const
+{
+  static const uint8_t zero[CBlockFile::PageSize] = { 0 };
+  size_t offset = size_t(page) << CBlockFile::PageShift;
+  size_t pageSize = std::min(size_t(CBlockFile::PageSize), size - offset);
+  const uint8_t *a = &data[offset];
+  const uint8_t *b = reference ? &reference[offset] : zero;
+  if (memcmp(a, b, pageSize) == 0)
+    return false;
+
+  Put32(out, page);
+  size_t pos = 0;
+  while (pos < pageSize)
+  {
+    size_t unchangedStart = pos;
+    while (pos + 8 <= pageSize && memcmp(&a[pos], &b[pos], 8) == 0)
+      pos += 8;
+    while (pos < pageSize && a[pos] == b[pos])
+      pos++;
+    size_t changedStart = pos;
+    size_t changedEnd = pos;
+    while (pos < pageSize && pos - changedEnd < s_minUnchangedRun)
+    {
+      if (a[pos] != b[pos])
+        changedEnd = pos + 1;
+      pos++;
+    }
+    pos = changedEnd;
+    Put16(out, uint16_t(changedStart - unchangedStart));
+    Put16(out, uint16_t(changedEnd - changedStart));
+    size_t outPos = out->size();
+    out->resize(outPos + changedEnd - changedStart);
+    for (size_t i = changedStart; i < changedEnd; i++)
+      (*out)[outPos++] = a[i] ^ b[i];
+  }
+  return true;
+}
+
+std::vector<uint8_t> CRewindBuffer::Encode(const std::vector<uint8_t> &data, const std::vector<uint8_t> *reference, std::vector<uint8_t> *changedPages) const
+{
+  std::vector<uint8_t> out;
+  uint32_t numPages = uint32_t((data.size() + CBlockFile::PageSize - 1) >> CBlockFile::PageShift);
+  for (uint32_t page = 0; page < numPages; page++)
+  {
+    if (changedPages && !(*changedPages)[page])
+      continue;
+    bool changed = EncodePage(&out, data.data(), reference ? reference->data() : nullptr, page, data.size());
+    if (changedPages && !changed)
+      (*changedPages)[page] = 0;  // written back to its keyframe contents
+  }
+  return out;
+}
+
+void CRewindBuffer::Apply(std::vector<uint8_t> *data, const std::vector<uint8_t> &encoded, std::vector<uint8_t> *pages)
+{
+  size_t in = 0;
+  while (in < encoded.size())
+  {
+    uint32_t page;
+    memcpy(&page, &encoded[in], sizeof(page));
+    in += sizeof(page);
+    if (pages)
+      (*pages)[page] = 1;
+
+    size_t offset = size_t(page) << CBlockFile::PageShift;
+    size_t pageSize = std::min(size_t(CBlockFile::PageSize), data->size() - offset);
+    uint8_t *dest = &(*data)[offset];
+    size_t pos = 0;
+    while (pos < pageSize)
+    {
+      uint16_t numUnchanged;
+      uint16_t numChanged;
+      memcpy(&numUnchanged, &encoded[in], sizeof(numUnchanged));
+      memcpy(&numChanged, &encoded[in + 2], sizeof(numChanged));
+      in += 4;
+      pos += numUnchanged;
+      for (uint16_t i = 0; i < numChanged; i++)
+        dest[pos++] ^= encoded[in++];
+    }
+  }
+}
+
+void CRewindBuffer::Capture(IEmulator *emulator)
+{
+  CBlockFile state;
+  state.CreateInMemory(&m_image, "Supermodel Rewind State", "Supermodel Version " SUPERMODEL_VERSION);
+  emulator->SaveState(&state);
+  state.Close();
+
+  if (m_needKeyframe || m_groups.back().deltas.size() + 1 >= m_keyframeInterval || m_groups.back().size != m_image.data.size())
+  {
+    // Only the newest keyframe is kept as is
+    if (!m_groups.empty())
+      m_groups.back().keyframe = Encode(m_keyframe, nullptr, nullptr);
+    m_groups.push_back(Group{ m_image.data.size(), {}, {} });
+    m_keyframe = m_image.data;
+    m_changedPages.assign(m_image.touchedPages.size(), 0);
+    m_needKeyframe = false;
+  }
+  else
+  {
+    // Pages touched by any capture since the keyframe may still differ from it
+    for (size_t page = 0; page < m_changedPages.size(); page++)
+      m_changedPages[page] |= m_image.touchedPages[page];
+    m_groups.back().deltas.push_back(Encode(m_image.data, &m_keyframe, &m_changedPages));
+  }
+  m_numStates++;
+
+  while (m_numStates > m_maxStates && m_groups.size() > 1)
+  {
+    m_numStates -= unsigned(1 + m_groups.front().deltas.size());
+    m_groups.pop_front();
+  }
+}
+
+bool CRewindBuffer::Rewind(IEmulator *emulator)
+{
+  if (m_groups.empty())
+    return false;
+
+  // Rebuild the newest state in the memory image, which then matches the
+  // emulator state again once it is loaded
+  Group &group = m_groups.back();
+  if (m_image.data.size() != group.size)
+    m_image.trackedOffsets.clear();   // layout of the tracked regions may differ
+  m_image.data = m_keyframe;
+  if (!group.deltas.empty())
+  {
+    m_changedPages.assign(m_changedPages.size(), 0);
+    Apply(&m_image.data, group.deltas.back(), &m_changedPages);
+    group.deltas.pop_back();
+  }
+  else
+  {
+    m_groups.pop_back();
+    if (!m_groups.empty())
+    {
+      m_keyframe.assign(m_groups.back().size, 0);
+      Apply(&m_keyframe, m_groups.back().keyframe, nullptr);
+      m_groups.back().keyframe.clear();
+    }
+    m_needKeyframe = true;  // the pages changed since that keyframe are not known
+  }
+  m_numStates--;
+
+  CBlockFile state;
+  state.LoadFromMemory(m_image.data.data(), m_image.data.size());
+  emulator->LoadState(&state);
+  state.Close();
+  return true;
+}
+
+void CRewindBuffer::Invalidate()
+{
+  m_groups.clear();
+  m_keyframe.clear();
+  m_changedPages.clear();
+  m_image.data.clear();
+  m_numStates = 0;
+  m_needKeyframe = true;
+}
+
+CRewindBuffer::CRewindBuffer(unsigned maxStates, unsigned keyframeInterval)
+  : m_maxStates(maxStates),
+    m_keyframeInterval(std::max(1u, keyframeInterval))
+{
+  m_image.trackPages = true;
+}
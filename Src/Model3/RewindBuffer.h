@@ -0,0 +1,124 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * RewindBuffer.h
+ *
+ * In-memory ring of recent save states that the emulator can be rewound to.
+ */
+
+#ifndef INCLUDED_REWINDBUFFER_H
+#define INCLUDED_REWINDBUFFER_H
+
+#include "BlockFile.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class IEmulator;
+
+/*
+ * CRewindBuffer:
+ *
+ * States are captured into a CBlockFile memory image, so that only the pages
+ * flagged by the emulator's write tracking (plus the small, untracked parts
+ * of the state) have to be examined. Every keyframeInterval states, a
+ * keyframe is stored; the states in between are stored as the XOR of each
+ * changed page with the keyframe, run-length encoded. Keyframes other than
+ * the newest are encoded the same way against zero.
+ */
+class CRewindBuffer
+{
+public:
+  /*
+   * Capture(emulator):
+   *
+   * Saves the emulator's state as the newest state in the buffer, dropping
+   * the oldest states when it is full. The emulator threads must be paused.
+   */
+  void Capture(IEmulator *emulator);
+
+  /*
+   * Rewind(emulator):
+   *
+   * Loads the newest state in the buffer and removes it, so that repeated
+   * calls go further back. The emulator threads must be paused.
+   *
+   * Returns:
+   *    True if a state was loaded, false if the buffer is empty.
+   */
+  bool Rewind(IEmulator *emulator);
+
+  /*
+   * Invalidate():
+   *
+   * Discards all states. Must be called whenever the emulator state changes
+   * other than by running (e.g., on reset or when a save state is loaded),
+   * since memory rewritten that way is not flagged by write tracking.
+   */
+  void Invalidate();
+
+  /*
+   * GetNumStates():
+   *
+   * Returns:
+   *    Number of states in the buffer.
+   */
+  unsigned GetNumStates() const
+  {
+    return m_numStates;
+  }
+
+  /*
+   * CRewindBuffer(maxStates, keyframeInterval):
+   *
+   * Parameters:
+   *    maxStates         Number of states to keep. The oldest keyframe and
+   *                      its deltas are dropped together, so slightly more
+   *                      may be kept.
+   *    keyframeInterval  Number of states per keyframe.
+   */
+  CRewindBuffer(unsigned maxStates, unsigned keyframeInterval);
+
+private:
+  // A keyframe and the deltas against it
+  struct Group
+  {
+    size_t                            size;       // size of each state in bytes
+    std::vector<uint8_t>              keyframe;   // encoded against zero (empty for the newest group, see m_keyframe)
+    std::vector<std::vector<uint8_t>> deltas;     // encoded against the keyframe
+  };
+
+  bool EncodePage(std::vector<uint8_t> *out, const uint8_t *data, const uint8_t *reference, uint32_t page, size_t size) const;
+  std::vector<uint8_t> Encode(const std::vector<uint8_t> &data, const std::vector<uint8_t> *reference, std::vector<uint8_t> *changedPages) const;
+  static void Apply(std::vector<uint8_t> *data, const std::vector<uint8_t> &encoded, std::vector<uint8_t> *pages);
+
+  unsigned                m_maxStates;
+  unsigned                m_keyframeInterval;
+  unsigned                m_numStates = 0;
+  std::deque<Group>       m_groups;
+  std::vector<uint8_t>    m_keyframe;         // keyframe of the newest group
+  std::vector<uint8_t>    m_changedPages;     // pages that may differ from m_keyframe
+  bool                    m_needKeyframe = true;
+  CBlockFile::MemoryImage m_image;            // most recently captured or loaded state
+};
+
+#endif  // INCLUDED_REWINDBUFFER_H
@@ -0,0 +1,60 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * RunAhead.cpp
+ *
+ * Implementation of CRunAhead.
+ */
+
+#include "RunAhead.h"
+#include "IEmulator.h"
+#include "Supermodel.h"
+
+void CRunAhead::RunFrame(IEmulator *emulator)
+{
+  // The real frame: its audio is played, but what is shown comes from the future
+  emulator->SetOutputEnabled(false, true);
+  emulator->RunFrame();
+
+  CBlockFile state;
+  state.CreateInMemory(&m_image, "Supermodel Run-Ahead State", "Supermodel Version " SUPERMODEL_VERSION);
+  emulator->SaveState(&state);
+  state.Close();
+
+  // Frames ahead, with the same inputs. Only the last one is rendered.
+  emulator->SetOutputEnabled(false, false);
+  for (unsigned i = 1; i < m_numFrames; i++)
+    emulator->RunFrame();
+  emulator->SetOutputEnabled(true, false);
+  emulator->RunFrame();
+
+  CBlockFile saved;
+  saved.LoadFromMemory(m_image.data.data(), m_image.data.size());
+  emulator->LoadState(&saved);
+  saved.Close();
+  emulator->SetOutputEnabled(true, true);
+}
+
+CRunAhead::CRunAhead(unsigned numFrames)
+  : m_numFrames(numFrames < 1 ? 1 : numFrames)
+{
+}
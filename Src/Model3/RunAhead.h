@@ -0,0 +1,69 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * RunAhead.h
+ *
+ * Hides a game's internal input lag by showing frames from the future.
+ */
+
+#ifndef INCLUDED_RUNAHEAD_H
+#define INCLUDED_RUNAHEAD_H
+
+#include "BlockFile.h"
+
+class IEmulator;
+
+/*
+ * CRunAhead:
+ *
+ * Each frame is run for real with its audio but without being shown, then
+ * the state is saved in memory and the emulator keeps running with the same
+ * inputs, showing only the last of those frames ahead. Restoring the state
+ * afterwards discards them, so games that take a few frames to react to
+ * input respond on the very next frame shown. Emulation must be
+ * single-threaded, since every frame is run numFrames + 1 times.
+ */
+class CRunAhead
+{
+public:
+  /*
+   * RunFrame(emulator):
+   *
+   * Runs one frame in place of IEmulator::RunFrame(), with video and audio
+   * output enabled.
+   */
+  void RunFrame(IEmulator *emulator);
+
+  /*
+   * CRunAhead(numFrames):
+   *
+   * Parameters:
+   *    numFrames   Number of frames to run ahead (at least 1).
+   */
+  CRunAhead(unsigned numFrames);
+
+private:
+  unsigned                m_numFrames;
+  CBlockFile::MemoryImage m_image;      // state after the last real frame
+};
+
+#endif  // INCLUDED_RUNAHEAD_H
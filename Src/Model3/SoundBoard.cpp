@@ -59,6 +59,7 @@
 #include "Supermodel.h"
 #include "OSD/Audio.h"
 #include "Sound/SCSP.h"
+#include "Util/JobSystem.h"
 
 // DEBUG
 //#define SUPERMODEL_LOG_AUDIO	// define this to log all audio to sound.bin
@@ -75,8 +76,10 @@ static FILE		*soundFP;
 #define OFFSET_AUDIO_FRONTRIGHT (OFFSET_AUDIO_FRONTLEFT + LENGTH_CHANNEL_BUFFER)    // 2940 bytes right audio channel
 #define OFFSET_AUDIO_REARLEFT   (OFFSET_AUDIO_FRONTRIGHT + LENGTH_CHANNEL_BUFFER)   // 2940 bytes (32 bits, 44.1 KHz, 1/60th second) left audio channel
 #define OFFSET_AUDIO_REARRIGHT  (OFFSET_AUDIO_REARLEFT + LENGTH_CHANNEL_BUFFER)     // 2940 bytes right audio channel
+#define OFFSET_AUDIO_DSBLEFT    (OFFSET_AUDIO_REARRIGHT + LENGTH_CHANNEL_BUFFER)    // 2940 bytes DSB left audio channel
+#define OFFSET_AUDIO_DSBRIGHT   (OFFSET_AUDIO_DSBLEFT + LENGTH_CHANNEL_BUFFER)      // 2940 bytes DSB right audio channel
 
-#define MEMORY_POOL_SIZE        (0x100000 + 0x100000 + 4*LENGTH_CHANNEL_BUFFER)
+#define MEMORY_POOL_SIZE        (0x100000 + 0x100000 + 6*LENGTH_CHANNEL_BUFFER)
 
 
 /******************************************************************************
@@ -89,10 +92,42 @@ void CSoundBoard::UpdateROMBanks(void)
 		sampleBank = &sampleROM[0x800000];
 	else
 		sampleBank = &sampleROM[0x000000];
+
+	// Sample ROM bank: 800000-FFFFFF
+	for (unsigned page = 0; page < 0x80; page++)
+		m_readMap[0x80 + page] = &sampleBank[page << 16];
+}
+
+/*
+ * RAM and ROM are described by a table of 64 KB pages so that the handlers
+ * can reach them without going through the address decoder. SCSP registers
+ * and unmapped regions are left null and fall through to the decoder, as do
+ * 32-bit accesses that straddle two pages.
+ */
+void CSoundBoard::BuildMemoryMap(void)
+{
+	memset(m_readMap, 0, sizeof(m_readMap));
+	memset(m_writeMap, 0, sizeof(m_writeMap));
+
+	for (unsigned page = 0; page < 0x10; page++)
+	{
+		// SCSP RAM 1 and 2: 000000-0FFFFF, 200000-2FFFFF
+		m_readMap[0x00 + page] = m_writeMap[0x00 + page] = &ram1[page << 16];
+		m_readMap[0x20 + page] = m_writeMap[0x20 + page] = &ram2[page << 16];
+
+		// Program ROM: 600000-67FFFF, mirrored up to 6FFFFF
+		m_readMap[0x60 + page] = &soundROM[(page & 7) << 16];
+	}
+
+	UpdateROMBanks();
 }
 
 UINT8 CSoundBoard::Read8(UINT32 a)
 {
+	const UINT8 *page = m_readMap[(a>>16)&0xFF];
+	if (page != NULL)
+		return page[(a&0xFFFF)^1];
+
 	switch ((a>>20)&0xF)
 	{
 	case 0x0:	// SCSP RAM 1 (master): 000000-0FFFFF
@@ -130,6 +165,10 @@ UINT8 CSoundBoard::Read8(UINT32 a)
 
 UINT16 CSoundBoard::Read16(UINT32 a)
 {
+	const UINT8 *page = m_readMap[(a>>16)&0xFF];
+	if (page != NULL)
+		return *(UINT16 *) &page[a&0xFFFF];
+
 	switch ((a>>20)&0xF)
 	{
 	case 0x0:	// SCSP RAM 1 (master): 000000-0FFFFF
@@ -169,6 +208,14 @@ UINT32 CSoundBoard::Read32(UINT32 a)
 {
 	UINT32	hi, lo;
 
+	const UINT8 *page = m_readMap[(a>>16)&0xFF];
+	if (page != NULL && (a&0xFFFF) <= 0xFFFC)
+	{
+		hi = *(UINT16 *) &page[a&0xFFFF];
+		lo = *(UINT16 *) &page[(a+2)&0xFFFF];
+		return (hi<<16)|lo;
+	}
+
 	switch ((a>>20)&0xF)
 	{
 	case 0x0:	// SCSP RAM 1 (master): 000000-0FFFFF
@@ -214,6 +261,13 @@ UINT32 CSoundBoard::Read32(UINT32 a)
 
 void CSoundBoard::Write8(unsigned int a,unsigned char d)  
 { 
+	UINT8 *page = m_writeMap[(a>>16)&0xFF];
+	if (page != NULL)
+	{
+		page[(a&0xFFFF)^1] = d;
+		return;
+	}
+
 	switch ((a>>20)&0xF)
 	{
 	case 0x0:	// SCSP RAM 1 (master): 000000-0FFFFF
@@ -246,6 +300,13 @@ void CSoundBoard::Write8(unsigned int a,unsigned char d)
 
 void CSoundBoard::Write16(unsigned int a,unsigned short d) 
 { 
+	UINT8 *page = m_writeMap[(a>>16)&0xFF];
+	if (page != NULL)
+	{
+		*(UINT16 *) &page[a&0xFFFF] = d;
+		return;
+	}
+
 	switch ((a>>20)&0xF)
 	{
 	case 0x0:	// SCSP RAM 1 (master): 000000-0FFFFF
@@ -272,6 +333,14 @@ void CSoundBoard::Write16(unsigned int a,unsigned short d)
 
 void CSoundBoard::Write32(unsigned int a,unsigned int d)
 {
+	UINT8 *page = m_writeMap[(a>>16)&0xFF];
+	if (page != NULL && (a&0xFFFF) <= 0xFFFC)
+	{
+		*(UINT16 *) &page[a&0xFFFF] = (d>>16);
+		*(UINT16 *) &page[(a+2)&0xFFFF] = (d&0xFFFF);
+		return;
+	}
+
 	switch ((a>>20)&0xF)
 	{
 	case 0x0:	// SCSP RAM 1 (master): 000000-0FFFFF
@@ -313,6 +382,7 @@ static int	irqLine = 0;
 // Interrupt acknowledge callback (TODO: don't need this, default behavior in M68K.cpp should be fine)
 int IRQAck(int irqLevel)
 {
+	SCSP_Sync();
 	M68KSetIRQ(0);
 	irqLine = 0;
 	return M68K_IRQ_AUTOVECTOR;
@@ -339,6 +409,18 @@ int SCSP68KRunCallback(int numCycles)
 	return M68KRun(numCycles) - numCycles;
 }
 
+// SCSP callback for querying how far into a batch the 68K is
+int SCSP68KCyclesCallback(void)
+{
+	return M68KGetCyclesRun();
+}
+
+// SCSP callback for ending a batch early
+void SCSP68KStopCallback(void)
+{
+	M68KEndTimeslice();
+}
+
 
 /******************************************************************************
  Sound Board Interface
@@ -367,8 +449,28 @@ static INT16 ClampINT16(float x)
 
 bool CSoundBoard::RunFrame(void)
 {
-	// Run sound board first to generate SCSP audio
-	if (m_config["EmulateSound"].ValueAs<bool>())
+	/*
+	 * The DSB only receives commands from the PowerPC, never from the sound
+	 * 68K, so its frame is independent of the SCSPs' and can run on the job
+	 * pool meanwhile. It renders into its own buffers, which are mixed in
+	 * once both are done. The debugger expects each CPU to run on its board's
+	 * thread, so it keeps everything serial.
+	 */
+	Util::JobGroup dsbFrame;
+#ifndef SUPERMODEL_DEBUGGER
+	bool parallelDSB = (NULL != DSB) && Util::Jobs::NumWorkers() > 0;
+#else
+	bool parallelDSB = false;
+#endif
+	if (parallelDSB)
+	{
+		memset(audioDSBL, 0, LENGTH_CHANNEL_BUFFER);
+		memset(audioDSBR, 0, LENGTH_CHANNEL_BUFFER);
+		dsbFrame.Run([this]() { DSB->RunFrame(audioDSBL, audioDSBR); });
+	}
+
+	// Run sound board to generate SCSP audio
+	if (m_emulateSound.Get())
 	{
 		M68KSetContext(&M68K);
 		SCSP_Update();
@@ -383,7 +485,7 @@ bool CSoundBoard::RunFrame(void)
 	}
 
 	// Compute sound volume as 
-	float soundVol = (float)std::max(0,std::min(200,m_config["SoundVolume"].ValueAs<int>()));
+	float soundVol = (float)std::max(0,std::min(200,m_soundVolume.Get()));
 	soundVol = soundVol * (float)(1.0 / 100.0);
 
 	// Apply sound volume setting to SCSP channels only
@@ -399,14 +501,24 @@ bool CSoundBoard::RunFrame(void)
 		// Will need to mix with proper front, rear channels or both (game specific)
 		constexpr bool mixDSBWithFront = true; // Everything to front channels for now
 		// Case "both" not handled for now
-		if (mixDSBWithFront)
-			DSB->RunFrame(audioFL, audioFR);
+		float *mixL = mixDSBWithFront ? audioFL : audioRL;
+		float *mixR = mixDSBWithFront ? audioFR : audioRR;
+		if (parallelDSB)
+		{
+			dsbFrame.Wait();
+			for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
+				mixL[i] += audioDSBL[i];
+				mixR[i] += audioDSBR[i];
+			}
+		}
 		else
-			DSB->RunFrame(audioRL, audioRR);
+			DSB->RunFrame(mixL, mixR);
 	}
 
 	// Output the audio buffers
-	bool bufferFull = OutputAudio(NUM_SAMPLES_PER_FRAME, audioFL, audioFR, audioRL, audioRR, m_config["FlipStereo"].ValueAs<bool>());
+	if (!m_outputEnabled)
+		return false;
+	bool bufferFull = OutputAudio(NUM_SAMPLES_PER_FRAME, audioFL, audioFR, audioRL, audioRR, m_flipStereo.Get());
 
 #ifdef SUPERMODEL_LOG_AUDIO
 	// Output to binary file
@@ -427,6 +539,11 @@ bool CSoundBoard::RunFrame(void)
 	return bufferFull;
 }
 
+void CSoundBoard::SetOutputEnabled(bool enabled)
+{
+	m_outputEnabled = enabled;
+}
+
 void CSoundBoard::Reset(void)
 {
 	// Even if SCSP emulation is disabled, we must reset to establish a valid 68K state
@@ -518,17 +635,21 @@ Result CSoundBoard::Init(const UINT8 *soundROMPtr, const UINT8 *sampleROMPtr)
 	audioFR = (float*)&memoryPool[OFFSET_AUDIO_FRONTRIGHT];
 	audioRL = (float*)&memoryPool[OFFSET_AUDIO_REARLEFT];
 	audioRR = (float*)&memoryPool[OFFSET_AUDIO_REARRIGHT];
+	audioDSBL = (float*)&memoryPool[OFFSET_AUDIO_DSBLEFT];
+	audioDSBR = (float*)&memoryPool[OFFSET_AUDIO_DSBRIGHT];
+	BuildMemoryMap();
 
 	// Initialize 68K core
 	M68KSetContext(&M68K);
 	M68KInit();
 	M68KAttachBus(this);
+	M68KAttachFetchMap(m_readMap);	// RAM and ROM pages only; follows ROM banking
 	M68KSetIRQCallback(IRQAck);
 	M68KGetContext(&M68K);
 		
 	// Initialize SCSPs
 	SCSP_SetBuffers(audioFL, audioFR, audioRL, audioRR, NUM_SAMPLES_PER_FRAME);
-	SCSP_SetCB(SCSP68KRunCallback, SCSP68KIRQCallback);
+	SCSP_SetCB(SCSP68KRunCallback, SCSP68KIRQCallback, SCSP68KCyclesCallback, SCSP68KStopCallback);
 	if (Result::OKAY != SCSP_Init(m_config, 2))
 		return Result::FAIL;
 	SCSP_SetRAM(0, ram1);
@@ -555,7 +676,10 @@ CDSB *CSoundBoard::GetDSB(void)
 }
 
 CSoundBoard::CSoundBoard(const Util::Config::Node &config)
-  : m_config(config)
+  : m_config(config),
+    m_emulateSound(config, "EmulateSound", true),
+    m_soundVolume(config, "SoundVolume", 100),
+    m_flipStereo(config, "FlipStereo", false)
 {
 	DSB = NULL;
 	memoryPool = NULL;
@@ -565,11 +689,15 @@ CSoundBoard::CSoundBoard(const Util::Config::Node &config)
 	audioFR = NULL;
 	audioRL = NULL;
 	audioRR = NULL;
+	audioDSBL = NULL;
+	audioDSBR = NULL;
 	soundROM = NULL;
 	sampleROM = NULL;
 
 	sampleBank = nullptr;
 	ctrlReg = 0;
+	memset(m_readMap, 0, sizeof(m_readMap));
+	memset(m_writeMap, 0, sizeof(m_writeMap));
 
 	DebugLog("Built Sound Board\n");
 }
@@ -596,6 +724,8 @@ CSoundBoard::~CSoundBoard(void)
 	audioFR = NULL;
 	audioRL = NULL;
 	audioRR = NULL;
+	audioDSBL = NULL;
+	audioDSBR = NULL;
 	soundROM = NULL;
 	sampleROM = NULL;
 
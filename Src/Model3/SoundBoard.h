@@ -111,6 +111,17 @@ public:
 	 */
 	bool RunFrame(void);
 
+	/*
+	 * SetOutputEnabled(enabled):
+	 *
+	 * Enables or disables audio output. While disabled, frames are still
+	 * emulated in full but their audio is discarded.
+	 *
+	 * Parameters:
+	 *		enabled		True to output audio (the default), false not to.
+	 */
+	void SetOutputEnabled(bool enabled);
+
 	/*
 	 * Reset(void):
 	 *
@@ -181,9 +192,14 @@ public:
 private:
 	// Private helper functions
 	void		UpdateROMBanks(void);
+	void		BuildMemoryMap(void);
 	
 	// Config
 	const Util::Config::Node &m_config;
+	Util::Config::Binding<bool> m_emulateSound;
+	Util::Config::Binding<int> m_soundVolume;
+	Util::Config::Binding<bool> m_flipStereo;
+	bool		m_outputEnabled = true;
 
 	// Digital Sound Board
 	CDSB		*DSB;
@@ -198,12 +214,17 @@ private:
 	UINT8		*memoryPool;	// single allocated region for all sound board RAM
 	UINT8		*ram1, *ram2;	// SCSP1 and SCSP2 RAM
 	
+	// Memory map of RAM and ROM (64 KB pages, null where the address decoder must be used)
+	const UINT8	*m_readMap[0x100];
+	UINT8		*m_writeMap[0x100];
+
 	// Registers
 	UINT8	ctrlReg;			// control register: ROM banking
 	
 	// Audio
 	float* audioFL, * audioFR;	// left and right front audio channels (1/60th second, 44.1 KHz)
 	float* audioRL, * audioRR;	// left and right rear audio channels (1/60th second, 44.1 KHz)
+	float* audioDSBL, * audioDSBR;	// DSB output, rendered alongside the SCSPs and then mixed in
 };
 
 
@@ -38,7 +38,9 @@
  *
  * The computed palettes are updated whenever the real palette is modified, a
  * single color entry at a time. If the color register is modified, the entire
- * palette has to be recomputed accordingly.
+ * palette has to be recomputed accordingly. Games fade by writing the color
+ * registers every frame, so this is deferred until the next snapshot sync and
+ * done at most once per frame.
  *
  * The read-only copy of the palette, which is generated for the renderer, only
  * stores the two computed palettes.
@@ -56,6 +58,21 @@
 #include <cstring>
 #include <algorithm>
 #include "Supermodel.h"
+#include "Util/CPUFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TILEGEN_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TILEGEN_TARGET(isa)
+#else
+#define TILEGEN_TARGET(isa)	__attribute__((target(isa)))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define TILEGEN_NEON_SIMD
+#include <arm_neon.h>
+#endif
 
 // Offsets of memory regions within TileGen memory pool
 #define OFFSET_VRAM         0x000000	// VRAM and palette data
@@ -63,6 +80,138 @@
 
 #define MEMORY_POOL_SIZE	(MEM_POOL_SIZE_RW)
 
+// 5-bit color components expanded to 8 bits (n * 255 / 31)
+static const UINT8 s_expand5[32] =
+{
+	0, 8, 16, 24, 32, 41, 49, 57, 65, 74, 82, 90, 98, 106, 115, 123,
+	131, 139, 148, 156, 164, 172, 180, 189, 197, 205, 213, 222, 230, 238, 246, 255
+};
+
+
+/******************************************************************************
+ Tile Row Decoders
+******************************************************************************/
+
+/*
+ * Whole tile row decoders
+ *
+ * These draw one row of 8 pixels of a tile whose left edge sits on the line
+ * buffer position (hFine == 0, the case for every tile but the first after a
+ * scroll or layer change). Decoded palette entries have an alpha of either 0
+ * or 255, so the sign bit of a colour is its opacity flag and doubles as the
+ * store mask.
+ */
+
+static void DrawRow4Generic(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern)
+{
+	for (int i = 0; i < 8; i++) {
+		auto colour32 = pal[paletteIndex | ((pattern >> ((7 - i) * 4)) & 0xFu)];
+		if (colour32 >= 0x1000000) {
+			dst[i] = colour32;
+		}
+	}
+}
+
+static void DrawRow8Generic(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern1, UINT32 pattern2)
+{
+	for (int i = 0; i < 4; i++) {
+		auto colour32 = pal[paletteIndex | ((pattern1 >> ((3 - i) * 8)) & 0xFFu)];
+		if (colour32 >= 0x1000000) {
+			dst[i] = colour32;
+		}
+	}
+
+	for (int i = 0; i < 4; i++) {
+		auto colour32 = pal[paletteIndex | ((pattern2 >> ((3 - i) * 8)) & 0xFFu)];
+		if (colour32 >= 0x1000000) {
+			dst[4 + i] = colour32;
+		}
+	}
+}
+
+#if defined(TILEGEN_X86_SIMD)
+
+// SSE4.1: palette lookups are scalar, transparent pixels are blended out
+TILEGEN_TARGET("sse4.1")
+static inline void StoreRowSSE41(UINT32* dst, __m128i lo, __m128i hi)
+{
+	__m128 old0 = _mm_loadu_ps((const float*)dst);
+	__m128 old1 = _mm_loadu_ps((const float*)(dst + 4));
+	_mm_storeu_ps((float*)dst, _mm_blendv_ps(old0, _mm_castsi128_ps(lo), _mm_castsi128_ps(lo)));
+	_mm_storeu_ps((float*)(dst + 4), _mm_blendv_ps(old1, _mm_castsi128_ps(hi), _mm_castsi128_ps(hi)));
+}
+
+TILEGEN_TARGET("sse4.1")
+static void DrawRow4SSE41(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern)
+{
+	__m128i lo = _mm_setr_epi32(pal[paletteIndex | ((pattern >> 28) & 0xF)], pal[paletteIndex | ((pattern >> 24) & 0xF)],
+								pal[paletteIndex | ((pattern >> 20) & 0xF)], pal[paletteIndex | ((pattern >> 16) & 0xF)]);
+	__m128i hi = _mm_setr_epi32(pal[paletteIndex | ((pattern >> 12) & 0xF)], pal[paletteIndex | ((pattern >> 8) & 0xF)],
+								pal[paletteIndex | ((pattern >> 4) & 0xF)], pal[paletteIndex | (pattern & 0xF)]);
+	StoreRowSSE41(dst, lo, hi);
+}
+
+TILEGEN_TARGET("sse4.1")
+static void DrawRow8SSE41(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern1, UINT32 pattern2)
+{
+	__m128i lo = _mm_setr_epi32(pal[paletteIndex | (pattern1 >> 24)], pal[paletteIndex | ((pattern1 >> 16) & 0xFF)],
+								pal[paletteIndex | ((pattern1 >> 8) & 0xFF)], pal[paletteIndex | (pattern1 & 0xFF)]);
+	__m128i hi = _mm_setr_epi32(pal[paletteIndex | (pattern2 >> 24)], pal[paletteIndex | ((pattern2 >> 16) & 0xFF)],
+								pal[paletteIndex | ((pattern2 >> 8) & 0xFF)], pal[paletteIndex | (pattern2 & 0xFF)]);
+	StoreRowSSE41(dst, lo, hi);
+}
+
+// AVX2: indices are unpacked with variable shifts, looked up with a gather and written with a masked store
+TILEGEN_TARGET("avx2")
+static void DrawRow4AVX2(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern)
+{
+	__m256i index = _mm256_srlv_epi32(_mm256_set1_epi32(int(pattern)), _mm256_setr_epi32(28, 24, 20, 16, 12, 8, 4, 0));
+	index = _mm256_or_si256(_mm256_and_si256(index, _mm256_set1_epi32(0xF)), _mm256_set1_epi32(paletteIndex));
+	__m256i colour = _mm256_i32gather_epi32((const int*)pal, index, 4);
+	_mm256_maskstore_epi32((int*)dst, colour, colour);
+}
+
+TILEGEN_TARGET("avx2")
+static void DrawRow8AVX2(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern1, UINT32 pattern2)
+{
+	__m256i pattern = _mm256_setr_epi32(int(pattern1), int(pattern1), int(pattern1), int(pattern1), int(pattern2), int(pattern2), int(pattern2), int(pattern2));
+	__m256i index = _mm256_srlv_epi32(pattern, _mm256_setr_epi32(24, 16, 8, 0, 24, 16, 8, 0));
+	index = _mm256_or_si256(_mm256_and_si256(index, _mm256_set1_epi32(0xFF)), _mm256_set1_epi32(paletteIndex));
+	__m256i colour = _mm256_i32gather_epi32((const int*)pal, index, 4);
+	_mm256_maskstore_epi32((int*)dst, colour, colour);
+}
+
+#elif defined(TILEGEN_NEON_SIMD)
+
+// NEON: palette lookups are scalar, transparent pixels are selected out using the sign bit
+static inline void StoreRowNEON(UINT32* dst, uint32x4_t lo, uint32x4_t hi)
+{
+	uint32x4_t mask0 = vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(lo), 31));
+	uint32x4_t mask1 = vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(hi), 31));
+	vst1q_u32(dst, vbslq_u32(mask0, lo, vld1q_u32(dst)));
+	vst1q_u32(dst + 4, vbslq_u32(mask1, hi, vld1q_u32(dst + 4)));
+}
+
+static void DrawRow4NEON(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern)
+{
+	const uint32_t lo[4] = { pal[paletteIndex | ((pattern >> 28) & 0xF)], pal[paletteIndex | ((pattern >> 24) & 0xF)],
+							 pal[paletteIndex | ((pattern >> 20) & 0xF)], pal[paletteIndex | ((pattern >> 16) & 0xF)] };
+	const uint32_t hi[4] = { pal[paletteIndex | ((pattern >> 12) & 0xF)], pal[paletteIndex | ((pattern >> 8) & 0xF)],
+							 pal[paletteIndex | ((pattern >> 4) & 0xF)], pal[paletteIndex | (pattern & 0xF)] };
+	StoreRowNEON(dst, vld1q_u32(lo), vld1q_u32(hi));
+}
+
+static void DrawRow8NEON(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern1, UINT32 pattern2)
+{
+	const uint32_t lo[4] = { pal[paletteIndex | (pattern1 >> 24)], pal[paletteIndex | ((pattern1 >> 16) & 0xFF)],
+							 pal[paletteIndex | ((pattern1 >> 8) & 0xFF)], pal[paletteIndex | (pattern1 & 0xFF)] };
+	const uint32_t hi[4] = { pal[paletteIndex | (pattern2 >> 24)], pal[paletteIndex | ((pattern2 >> 16) & 0xFF)],
+							 pal[paletteIndex | ((pattern2 >> 8) & 0xFF)], pal[paletteIndex | (pattern2 & 0xFF)] };
+	StoreRowNEON(dst, vld1q_u32(lo), vld1q_u32(hi));
+}
+
+#endif
+
 
 /******************************************************************************
  Save States
@@ -91,11 +240,13 @@ void CTileGen::LoadState(CBlockFile *SaveState)
 		WriteRAM32(i, data);
 	}	
 	SaveState->Read(m_regs, sizeof(m_regs));
+	m_dirtyAll = true;
+	m_dirtyPages.set();
 
 	m_colourOffsetRegs[0].Update(m_regs[0x40 / 4]);
-	RecomputePalettes(0);	// layer 0 & 1
 	m_colourOffsetRegs[1].Update(m_regs[0x44 / 4]);
-	RecomputePalettes(1);	// layer 2 & 3
+	m_palStale[0] = true;	// layer 0 & 1
+	m_palStale[1] = true;	// layer 2 & 3
 
 	SyncSnapshots();
 }
@@ -128,24 +279,63 @@ void CTileGen::EndVBlank(void)
 
 UINT32 CTileGen::SyncSnapshots(void)
 {
-	// clear surfaces
-	for (auto& s : m_drawSurface) {
-		s->Clear();
+	// the lines of the last frame are drawn from the snapshot, so must be done before it changes
+	FinishDrawing();
+
+	m_syncCount++;
+	for (int layer = 0; layer < 2; layer++) {
+		if (m_palStale[layer]) {
+			RecomputePalettes(layer);
+		}
 	}
+	SyncTileRAM();
+	std::swap(m_ram, m_ramRO);
 
-	// draw buffers (this should be called elsewhere later)
-	for (int i = 0; i < 384; i++) {
-		DrawLine(i);
+	if (m_gpuTilemap) {
+		Render2D->AttachTileRAM(m_ramRO);
+		return UINT32(0);
+	}
+
+	UpdateLineVersions();
+
+	// draw buffers from the snapshot. Nothing writes to it until the next sync, so when pipelined the
+	// jobs carry on while the PPC runs the next frame and the 3D scene is built, and are only waited
+	// for when the tile layers are uploaded
+	for (unsigned i = 0; i < m_drawJobs; i++) {
+		int firstLine	= int((i * 384) / m_drawJobs);
+		int lastLine	= int(((i + 1) * 384) / m_drawJobs);
+		m_drawGroup.Run([this, firstLine, lastLine]() {
+			DrawLines(firstLine, lastLine);
+		});
+	}
+
+	m_drawPending = true;
+
+	if (!m_drawPipelined) {
+		FinishDrawing();
+	}
+
+	return UINT32(0);
+}
+
+void CTileGen::FinishDrawing(void)
+{
+	if (!m_drawPending) {
+		return;
 	}
 
+	m_drawGroup.Wait();
+	m_drawPending = false;
+
 	// swap buffers
 	for (int i = 0; i < 2; i++) {
 		std::swap(m_drawSurface[i], m_drawSurfaceRO[i]);
 	}
 
-	Render2D->AttachDrawBuffers(m_drawSurfaceRO[0], m_drawSurfaceRO[1]);
-	
-	return UINT32(0);
+	// no renderer when run headless (e.g. by the micro-benchmarks)
+	if (Render2D) {
+		Render2D->AttachDrawBuffers(m_drawSurfaceRO[0], m_drawSurfaceRO[1]);
+	}
 }
 
 void CTileGen::BeginFrame(void)
@@ -155,6 +345,7 @@ void CTileGen::BeginFrame(void)
 
 void CTileGen::PreRenderFrame(void)
 {
+  FinishDrawing();
   Render2D->PreRenderFrame();
 }
 
@@ -184,9 +375,17 @@ UINT32 CTileGen::ReadRAM32(unsigned addr) const
 
 void CTileGen::WriteRAM32(unsigned addr, UINT32 data)
 {
+	if (*(UINT32 *) &m_vram[addr] == data) {
+		return;
+	}
+
 	*(UINT32 *) &m_vram[addr] = data;
 
-	if (addr >= 0x100000) {
+	if (addr < 0x100000) {
+		MarkVRAMDirty(addr);
+		m_dirtyPages.set(addr / (TileGenRAM::PageWords * 4));
+	}
+	else {
 
 		addr -= 0x100000;
 		unsigned color = addr / 4;	// color index
@@ -250,17 +449,20 @@ void CTileGen::WriteRegister(unsigned reg, UINT32 data)
 	case 0x64:
 	case 0x68:
 	case 0x6C:
+		if (m_regs[reg / 4] != data) {
+			m_dirtyAll = true;		// layer enables, priorities and scrolling apply to every line
+		}
 		break;
 	case 0x40:	// layer A/A' color offset
 		if (m_regs[reg / 4] != data) {
 			m_colourOffsetRegs[0].Update(data);
-			RecomputePalettes(0);
+			m_palStale[0] = true;
 		}
 		break;
 	case 0x44:	// layer B/B' color offset
 		if (m_regs[reg / 4] != data) {
 			m_colourOffsetRegs[1].Update(data);
-			RecomputePalettes(1);
+			m_palStale[1] = true;
 		}
 		break;
 	case 0x10:	// IRQ acknowledge
@@ -283,6 +485,8 @@ void CTileGen::Reset(void)
 	unsigned memSize = (m_gpuMultiThreaded ? MEMORY_POOL_SIZE : MEM_POOL_SIZE_RW);
 	memset(memoryPool, 0, memSize);
 	memset(m_regs, 0, sizeof(m_regs));
+	m_dirtyAll = true;
+	m_dirtyPages.set();
 
 	DebugLog("Tile Generator reset\n");
 }
@@ -312,6 +516,8 @@ Result CTileGen::Init(CIRQ *IRQObjectPtr)
 	if (NULL == memoryPool)
 		return ErrorLog("Insufficient memory for tile generator object (needs %1.1f MB).", memSizeMB);
 	
+	m_memoryAccount.SetCPU(memSize + 2 * sizeof(TileGenRAM) + 4 * sizeof(TileGenBuffer) + 2 * 0x8000 * sizeof(UINT32));
+
 	// Set up main pointers
 	m_vram	= (UINT8 *) &memoryPool[OFFSET_VRAM];
 	m_vramP	= (UINT32*)m_vram;
@@ -326,7 +532,13 @@ Result CTileGen::Init(CIRQ *IRQObjectPtr)
 
 CTileGen::CTileGen(const Util::Config::Node& config)
 	: //m_config(config),
+	m_drawRow4(DrawRow4Generic),
+	m_drawRow8(DrawRow8Generic),
 	m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>()),
+	m_gpuTilemap(config["GPUTilemap"].ValueAsDefault<bool>(false)),
+	m_drawJobs(1),
+	m_drawPipelined(false),
+	m_drawPending(false),
 	IRQ(nullptr),
 	Render2D(nullptr),
 	memoryPool(nullptr),
@@ -334,8 +546,24 @@ CTileGen::CTileGen(const Util::Config::Node& config)
 	m_vramP(nullptr),
 	m_palP(nullptr),
 	m_pal{nullptr},
-	m_regs{}
-{
+	m_palStale{false, false},
+	m_regs{},
+	m_syncCount(0),
+	m_lineVersion{},
+	m_dirtyNameRows{},
+	m_dirtyAll(true),
+	m_pageVersion{}
+{
+	m_dirtyPages.set();
+
+	m_ram	= std::make_shared<TileGenRAM>();
+	m_ramRO	= std::make_shared<TileGenRAM>();
+
+	if (config["MultiThreaded"].ValueAsDefault<bool>(false)) {
+		m_drawJobs		= std::min(std::max(config["TileGenThreads"].ValueAsDefault<unsigned>(1), 1u), 16u);
+		m_drawPipelined	= config["TileGenPipeline"].ValueAsDefault<bool>(true);
+	}
+
 	for (auto& s : m_drawSurface) {
 		s = std::make_shared<TileGenBuffer>();
 	}
@@ -349,11 +577,34 @@ CTileGen::CTileGen(const Util::Config::Node& config)
 		memset(p, 0, 0x8000 * sizeof(UINT32));
 	}
 
-	DebugLog("Built Tile Generator\n");
+	const char* decoder = "generic";
+#if defined(TILEGEN_X86_SIMD)
+	const Util::CPUFeatures& cpu = Util::GetCPUFeatures();
+	if (cpu.avx2) {
+		m_drawRow4	= DrawRow4AVX2;
+		m_drawRow8	= DrawRow8AVX2;
+		decoder		= "AVX2";
+	}
+	else if (cpu.sse41) {
+		m_drawRow4	= DrawRow4SSE41;
+		m_drawRow8	= DrawRow8SSE41;
+		decoder		= "SSE4.1";
+	}
+#elif defined(TILEGEN_NEON_SIMD)
+	if (Util::GetCPUFeatures().neon) {
+		m_drawRow4	= DrawRow4NEON;
+		m_drawRow8	= DrawRow8NEON;
+		decoder		= "NEON";
+	}
+#endif
+
+	DebugLog("Built Tile Generator (%s tile decoder)\n", decoder);
 }
 
 CTileGen::~CTileGen(void)
 {
+	m_drawGroup.Wait();		// lines still being drawn from the snapshot
+
 	// Dump tile generator RAM
 #if 0
 	FILE *fp;
@@ -367,7 +618,7 @@ CTileGen::~CTileGen(void)
 	else
 		printf("unable to dump %s\n", "tileram");
 #endif
-		
+
 	IRQ = nullptr;
 	delete [] memoryPool;
 	memoryPool = nullptr;
@@ -386,32 +637,32 @@ CTileGen::~CTileGen(void)
 
 bool CTileGen::IsEnabled(int layerNumber) const
 {
-	return (m_regs[0x60 / 4 + layerNumber] & 0x80000000) > 0;
+	return (m_ramRO->regs[0x60 / 4 + layerNumber] & 0x80000000) > 0;
 }
 
 bool CTileGen::Above3D(int layerNumber) const
 {
-	return (m_regs[0x20 / 4] >> (8 + layerNumber)) & 0x1;
+	return (m_ramRO->regs[0x20 / 4] >> (8 + layerNumber)) & 0x1;
 }
 
 bool CTileGen::Is4Bit(int layerNumber) const
 {
-	return (m_regs[0x20 / 4] & (1 << (12 + layerNumber))) != 0;
+	return (m_ramRO->regs[0x20 / 4] & (1 << (12 + layerNumber))) != 0;
 }
 
 int CTileGen::GetYScroll(int layerNumber) const
 {
-	return (m_regs[0x60 / 4 + layerNumber] >> 16) & 0x1FF;
+	return (m_ramRO->regs[0x60 / 4 + layerNumber] >> 16) & 0x1FF;
 }
 
 int CTileGen::GetXScroll(int layerNumber) const
 {
-	return m_regs[0x60 / 4 + layerNumber] & 0x3FF;
+	return m_ramRO->regs[0x60 / 4 + layerNumber] & 0x3FF;
 }
 
 bool CTileGen::LineScrollMode(int layerNumber) const
 {
-	return (m_regs[0x60 / 4 + layerNumber] & 0x8000) != 0;
+	return (m_ramRO->regs[0x60 / 4 + layerNumber] & 0x8000) != 0;
 }
 
 int CTileGen::GetLineScroll(int layerNumber, int yCoord) const
@@ -419,7 +670,7 @@ int CTileGen::GetLineScroll(int layerNumber, int yCoord) const
 	int index = ((0xF6000 + (layerNumber * 0x400)) / 4) + (yCoord / 2);
 	int shift = (1 - (yCoord % 2)) * 16;
 
-	return (m_vramP[index] >> shift) & 0xFFFFu;
+	return (m_ramRO->vram[index] >> shift) & 0xFFFFu;
 }
 
 int CTileGen::GetTileNumber(int xCoord, int yCoord, int xScroll, int yScroll) const
@@ -436,7 +687,7 @@ int CTileGen::GetTileData(int layerNum, int tileNumber) const
 	int offset = tileNumber / 2;							// two tiles per 32bit word
 	int shift = (1 - (tileNumber % 2)) * 16;				// triple check this
 
-	return (m_vramP[addressBase + offset] >> shift) & 0xFFFFu;
+	return (m_ramRO->vram[addressBase + offset] >> shift) & 0xFFFFu;
 }
 
 int CTileGen::GetVFine(int yCoord, int yScroll) const
@@ -454,7 +705,7 @@ int CTileGen::GetLineMask(int layerNumber, int yCoord) const
 	auto shift = (layerNumber < 2) ? 16u : 0u;
 	int index = (0xF7000 / 4) + yCoord;
 
-	return ((m_vramP[index] >> shift) & 0xFFFFu);
+	return ((m_ramRO->vram[index] >> shift) & 0xFFFFu);
 }
 
 int CTileGen::GetPixelMask(int lineMask, int xCoord) const
@@ -467,9 +718,9 @@ int CTileGen::GetPixelMask(int lineMask, int xCoord) const
 UINT32 CTileGen::GetColour32(int layer, UINT32 data) const
 {
 	int a = (((data >> 15) +1) & 1) * 255;
-	int b = ((((data >> 10) & 0x1F) * 255) / 31) & a;
-	int g = ((((data >> 5 ) & 0x1F) * 255) / 31) & a;
-	int r = (((data & 0x1F)         * 255) / 31) & a;
+	int b = s_expand5[(data >> 10) & 0x1F] & a;
+	int g = s_expand5[(data >> 5 ) & 0x1F] & a;
+	int r = s_expand5[data & 0x1F] & a;
 
 	auto rr = m_colourOffsetRegs[layer].r + r;
 	auto gg = m_colourOffsetRegs[layer].g + g;
@@ -499,7 +750,13 @@ void CTileGen::Draw4Bit(int tileData, int hFine, int vFine, UINT32* const lineBu
 	// Upper color bits; the lower 4 bits come from the tile pattern
 	int paletteIndex = tileData & 0x7FF0;
 
-	auto pattern = m_vramP[patternOffset + vFine];
+	auto pattern = m_ramRO->vram[patternOffset + vFine];
+
+	if (hFine == 0) {
+		m_drawRow4(lineBuffer + x, pal, paletteIndex, pattern);
+		x += 8;
+		return;
+	}
 
 	for (int i = 0; i < 8 - hFine; i++, x++) {
 		auto p = (pattern >> ((7 - (hFine + i)) * 4)) & 0xFu;
@@ -536,8 +793,14 @@ void CTileGen::Draw8Bit(int tileData, int hFine, int vFine, UINT32* const lineBu
 	// Upper color bits
 	int paletteIndex = tileData & 0x7F00;
 
-	auto pattern1 = m_vramP[patternOffset + (vFine * 2)];			// first 4 pixels
-	auto pattern2 = m_vramP[patternOffset + (vFine * 2) + 1];		// next 4 pixels
+	auto pattern1 = m_ramRO->vram[patternOffset + (vFine * 2)];			// first 4 pixels
+	auto pattern2 = m_ramRO->vram[patternOffset + (vFine * 2) + 1];		// next 4 pixels
+
+	if (hFine == 0) {
+		m_drawRow8(lineBuffer + x, pal, paletteIndex, pattern1, pattern2);
+		x += 8;
+		return;
+	}
 
 	// might not hit this loop
 	for (int i = 0; i < 4 - hFine; i++, x++) {
@@ -561,13 +824,144 @@ void CTileGen::Draw8Bit(int tileData, int hFine, int vFine, UINT32* const lineBu
 
 void CTileGen::WritePalette(int layer, int address, UINT32 data)
 {
-	m_pal[layer][address] = GetColour32(layer, data);
+	if (m_palStale[layer]) {
+		return;		// the whole palette is recomputed at the next sync
+	}
+
+	auto colour32 = GetColour32(layer, data);
+
+	if (m_pal[layer][address] != colour32) {
+		m_pal[layer][address] = colour32;
+		m_dirtyAll = true;		// any tile may use the colour
+		m_dirtyPages.set(TileGenRAM::VRAMPages + ((layer * 0x8000) + address) / TileGenRAM::PageWords);
+	}
+}
+
+void CTileGen::MarkVRAMDirty(unsigned addr)
+{
+	if (addr >= 0xF8000) {
+		// Name tables: 64x64 tiles, 2 per word. The lines affected depend on
+		// the vertical scroll, which is applied when the versions are updated.
+		int layer	= (addr - 0xF8000) / 0x2000;
+		int row		= ((addr & 0x1FFF) / 4) / 32;
+		m_dirtyNameRows[layer] |= UINT64(1) << row;
+	}
+	else if (addr >= 0xF6000 && addr < 0xF7000) {
+		// Line scroll tables: one 16-bit entry per line
+		int line = ((addr & 0x3FF) / 4) * 2;
+		if (line < 384) {
+			m_dirtyLines.set(line);
+			m_dirtyLines.set(line + 1);
+		}
+	}
+	else if (addr >= 0xF7000 && addr < 0xF7600) {
+		// Line mask table: one word per line
+		m_dirtyLines.set((addr - 0xF7000) / 4);
+	}
+	else {
+		// Tile patterns can be used anywhere
+		m_dirtyAll = true;
+	}
+}
+
+void CTileGen::UpdateLineVersions(void)
+{
+	if (m_dirtyAll) {
+		m_dirtyLines.set();
+	}
+	else {
+		for (int layer = 0; layer < 4; layer++) {
+			if (m_dirtyNameRows[layer] == 0) {
+				continue;
+			}
+			int yScroll = (m_regs[0x60 / 4 + layer] >> 16) & 0x1FF;	// live register, GetYScroll() reads the snapshot
+			for (int line = 0; line < 384; line++) {
+				if ((m_dirtyNameRows[layer] >> (((line + yScroll) / 8) & 0x3F)) & 1) {
+					m_dirtyLines.set(line);
+				}
+			}
+		}
+	}
+
+	for (int line = 0; line < 384; line++) {
+		if (m_dirtyLines[line]) {
+			m_lineVersion[line] = m_syncCount;
+		}
+	}
+
+	m_dirtyLines.reset();
+	memset(m_dirtyNameRows, 0, sizeof(m_dirtyNameRows));
+	m_dirtyAll = false;
+}
+
+void CTileGen::SyncTileRAM(void)
+{
+	for (int page = 0; page < TileGenRAM::NumPages; page++) {
+		if (m_dirtyPages[page]) {
+			m_pageVersion[page] = m_syncCount;
+		}
+
+		if (m_ram->pageVersion[page] != m_pageVersion[page]) {
+			const UINT32* src = page < TileGenRAM::VRAMPages
+				? m_vramP + (page * TileGenRAM::PageWords)
+				: m_pal[(page - TileGenRAM::VRAMPages) / 32] + (((page - TileGenRAM::VRAMPages) % 32) * TileGenRAM::PageWords);
+			memcpy(m_ram->GetPage(page), src, TileGenRAM::PageWords * sizeof(UINT32));
+			m_ram->pageVersion[page] = m_pageVersion[page];
+		}
+	}
+
+	memcpy(m_ram->regs, m_regs, sizeof(m_regs));
+	m_dirtyPages.reset();
 }
 
 void CTileGen::RecomputePalettes(int layer)
 {
-	for (int i = 0; i < 32768; i++) {
-		WritePalette(layer, i, m_palP[i]);
+	// A component only takes 32 values, or 0 when transparent, so the offset and clamp are applied
+	// once here rather than per colour. Indexed by the transparency bit and the component, i.e. bits
+	// 15-10 of the colour for blue, which also carries the alpha.
+	UINT32 rTable[64], gTable[64], bTable[64];
+	for (int i = 0; i < 64; i++) {
+		int a = (i & 0x20) ? 0 : 255;
+		int c = s_expand5[i & 0x1F] & a;
+		rTable[i] = UINT32(std::min(std::max(c + m_colourOffsetRegs[layer].r, 0), 255));
+		gTable[i] = UINT32(std::min(std::max(c + m_colourOffsetRegs[layer].g, 0), 255)) << 8;
+		bTable[i] = UINT32(std::min(std::max(c + m_colourOffsetRegs[layer].b, 0), 255)) << 16 | UINT32(a) << 24;
+	}
+
+	UINT32* pal = m_pal[layer];
+	for (int page = 0; page < 0x8000 / TileGenRAM::PageWords; page++) {
+		bool changed = false;
+		for (int i = page * TileGenRAM::PageWords; i < (page + 1) * TileGenRAM::PageWords; i++) {
+			UINT32 data = m_palP[i];
+			UINT32 transparent = (data >> 10) & 0x20;
+			UINT32 colour32 = rTable[transparent | (data & 0x1F)] | gTable[transparent | ((data >> 5) & 0x1F)] | bTable[(data >> 10) & 0x3F];
+			changed |= pal[i] != colour32;
+			pal[i] = colour32;
+		}
+		if (changed) {
+			m_dirtyAll = true;
+			m_dirtyPages.set(TileGenRAM::VRAMPages + (layer * 0x8000) / TileGenRAM::PageWords + page);
+		}
+	}
+
+	m_palStale[layer] = false;
+}
+
+void CTileGen::DrawLines(int firstLine, int lastLine)
+{
+	for (int i = firstLine; i < lastLine; i++) {
+
+		// lines already drawn from the current state still hold the right contents
+		if (m_drawSurface[0]->lineVersion[i] == m_lineVersion[i]) {
+			continue;
+		}
+
+		for (auto& s : m_drawSurface) {
+			s->ClearLine(i);
+			s->lineVersion[i] = m_lineVersion[i];
+		}
+
+		DrawLine(i);
 	}
 }
 
@@ -602,11 +996,13 @@ void CTileGen::DrawLine(int line)
 				int vFine		= GetVFine(line, scrollY[layer]);
 				int tileData	= GetTileData(index, tileNumber);
 
+				const UINT32* pal = m_ramRO->pal + ((index / 2) * 0x8000);
+
 				if (Is4Bit(index)) {
-					Draw4Bit(tileData, hFine, vFine, drawLayers[layer], m_pal[index / 2], x);
+					Draw4Bit(tileData, hFine, vFine, drawLayers[layer], pal, x);
 				}
 				else {
-					Draw8Bit(tileData, hFine, vFine, drawLayers[layer], m_pal[index / 2], x);
+					Draw8Bit(tileData, hFine, vFine, drawLayers[layer], pal, x);
 				}
 			}
 			else {
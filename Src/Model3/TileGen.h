@@ -31,6 +31,10 @@
 #include "IRQ.h"
 #include "Graphics/Render2D.h"
 #include "TileGenBuffer.h"
+#include "Util/JobSystem.h"
+#include "Util/MemoryUsage.h"
+#include <vector>
+#include <bitset>
 
   /*
    * CTileGen:
@@ -83,6 +87,9 @@ public:
 	 * end of each frame when both the render thread and the PPC thread have finished
 	 * their work.  If multi-threaded rendering is not enabled, then this method does
 	 * nothing.
+	 *
+	 * The lines of the frame are drawn from the snapshot by jobs. When pipelined,
+	 * they are only waited for by PreRenderFrame() or the next sync.
 	 */
 	UINT32 SyncSnapshots(void);
 
@@ -101,7 +108,8 @@ public:
 	 * PreRenderFrame(void):
 	 *
 	 * Draws the all top layers (above 3D graphics) and bottom layers (below 3D
-	 * graphics) but does not yet display them. May send data to the GPU.
+	 * graphics) but does not yet display them. May send data to the GPU. Waits
+	 * for the lines started by the last SyncSnapshots() first.
 	 *
 	 * Invokes the equivalent method in the underlying 2D renderer.
 	 */
@@ -251,6 +259,22 @@ public:
 	 */
 	void DrawLine(int line);	// from 0-383
 
+	/*
+	 * DrawLines(firstLine, lastLine):
+	 *
+	 * Draws a range of lines from the read-only snapshot. Lines are independent
+	 * of each other, so ranges may be drawn concurrently, and while VRAM and
+	 * registers are being written.
+	 *
+	 * Parameters:
+	 *		firstLine	First line to draw.
+	 *		lastLine	One past the last line to draw.
+	 */
+	void DrawLines(int firstLine, int lastLine);
+
+	// Waits for the lines being drawn and makes them visible to the renderer
+	void FinishDrawing(void);
+
 	/*
 	 * CTileGen(config):
 	 * ~CTileGen(void):
@@ -308,24 +332,56 @@ private:
 	void	Draw8Bit		(int tileData, int hFine, int vFine, UINT32* const lineBuffer, const UINT32* const pal, int& x) const;
 
 	void	WritePalette	(int layer, int address, UINT32 data);
-	void	RecomputePalettes(int layer);	// 0 = bottom, 1 = top
+	void	RecomputePalettes(int layer);	// 0 = bottom, 1 = top, done at the sync after a color offset change
+
+	// Dirty tracking
+	void	MarkVRAMDirty	(unsigned addr);
+	void	UpdateLineVersions(void);
+	void	SyncTileRAM		(void);
+
+	// Whole tile row decoders (8 pixels), selected by CPU features at construction
+	typedef void (*DrawRow4Func)(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern);
+	typedef void (*DrawRow8Func)(UINT32* dst, const UINT32* pal, int paletteIndex, UINT32 pattern1, UINT32 pattern2);
+
+	DrawRow4Func	m_drawRow4;
+	DrawRow8Func	m_drawRow8;
 
 	//const Util::Config::Node& m_config;
 	const bool m_gpuMultiThreaded;
+	const bool m_gpuTilemap;	// tile maps are drawn by the renderer from a copy of the raw memory
+	unsigned m_drawJobs;		// number of line ranges drawn in parallel on the job system
+	bool m_drawPipelined;		// lines are drawn while the next frame is emulated, rather than during the sync
+	bool m_drawPending;			// lines are being drawn into m_drawSurface
+	Util::JobGroup m_drawGroup;
 
 	CIRQ*		IRQ;		// IRQ controller the tile generator is attached to
 	CRender2D*	Render2D;	// 2D renderer the tile generator is attached to
 
 	UINT8*		memoryPool;		// all memory allocated here
+	Util::MemoryAccount m_memoryAccount{"Tile generator"};	// the pool, RAM snapshots, palettes and draw surfaces
 	UINT8*		m_vram;			// 1.125MB of VRAM
 	UINT32*		m_vramP;		// vram pointer but integer size
 	UINT32*		m_palP;			// just a pointer to the palette ram which comes after the vram
 
 	UINT32*		m_pal[2];		// cached decoded pallettes. 0 = layer 0&1, 1 = layer 2&3
+	bool		m_palStale[2];	// color offset changed since the palette was decoded
 
 	// Registers
 	UINT32	m_regs[64];
 
+	// Dirty tracking: lines are only redrawn when the state they are drawn from has changed
+	UINT32	m_syncCount;					// number of snapshot syncs, used as version number for modified lines
+	UINT32	m_lineVersion[384];				// version of the state each line must be drawn from
+	std::bitset<384> m_dirtyLines;			// lines modified since last sync
+	UINT64	m_dirtyNameRows[4];				// name table rows (one bit per row of 8 lines) modified since last sync, per layer
+	bool	m_dirtyAll;						// everything must be redrawn
+
+	// Only modified pages are copied to the snapshot, which the lines are drawn from (or the renderer reads in GPU tile map mode)
+	UINT32	m_pageVersion[TileGenRAM::NumPages];
+	std::bitset<TileGenRAM::NumPages> m_dirtyPages;
+	std::shared_ptr<TileGenRAM> m_ram;		// snapshot being updated
+	std::shared_ptr<TileGenRAM> m_ramRO;	// snapshot being drawn from
+
 	// buffers we draw to
 	std::shared_ptr<TileGenBuffer> m_drawSurface[2];	// drawing surfaces 0 = bottom, 1 = top
 	std::shared_ptr<TileGenBuffer> m_drawSurfaceRO[2];	// read only version for threading, we can swap between the 2. Maybe not needed.
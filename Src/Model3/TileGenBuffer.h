@@ -6,12 +6,34 @@
 
 struct TileGenBuffer
 {
-	TileGenBuffer() : data{ 0 } {}
+	TileGenBuffer() : data{ 0 }, lineVersion{ 0 } {}
 
 	UINT32* GetLine(int number) { return data + (512 * number); };
 	void	Clear() { std::memset(data, 0, sizeof(data)); }
+	void	ClearLine(int number) { std::memset(GetLine(number), 0, 512 * sizeof(UINT32)); }
 
 	UINT32 data[512 * 384];
+	UINT32 lineVersion[384];	// version of the tile generator state each line was drawn from; equal versions mean equal contents
+};
+
+// Raw tile generator memory for rendering the tile maps on the GPU. Stored in
+// pages of 1024 words (one texture row): 256 VRAM pages, then 64 pages of
+// decoded palettes (A/A' followed by B/B').
+struct TileGenRAM
+{
+	static constexpr int PageWords		= 1024;
+	static constexpr int VRAMPages		= 256;
+	static constexpr int PalettePages	= 64;
+	static constexpr int NumPages		= VRAMPages + PalettePages;
+
+	TileGenRAM() : vram{ 0 }, pal{ 0 }, regs{ 0 }, pageVersion{ 0 } {}
+
+	UINT32* GetPage(int number) { return number < VRAMPages ? vram + (PageWords * number) : pal + (PageWords * (number - VRAMPages)); }
+
+	UINT32 vram[VRAMPages * PageWords];		// patterns, scroll, mask and name tables
+	UINT32 pal[PalettePages * PageWords];	// decoded palettes
+	UINT32 regs[64];
+	UINT32 pageVersion[NumPages];			// as for TileGenBuffer::lineVersion
 };
 
 #endif
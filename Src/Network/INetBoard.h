@@ -57,6 +57,13 @@ public:
 
 	virtual UINT16 ReadIORegister(unsigned reg) = 0;
 	virtual void WriteIORegister(unsigned reg, UINT16 data) = 0;
+
+	// Microseconds to lengthen (or, if negative, shorten) the host's frame
+	// pacing by since the last call, to keep linked machines in step
+	virtual int TakeClockAdjust(void)
+	{
+		return 0;
+	}
 };
 
 #endif
\ No newline at end of file
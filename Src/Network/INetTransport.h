@@ -0,0 +1,73 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef INCLUDED_INETTRANSPORT_H
+#define INCLUDED_INETTRANSPORT_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * INetTransport:
+ *
+ * Link between this machine and its neighbors in the ring: messages are sent
+ * to the next machine and received from the previous one, in order.
+ */
+class INetTransport
+{
+public:
+	virtual ~INetTransport()
+	{
+	}
+
+	// Makes one attempt to link up with both neighbors; true once linked
+	virtual bool Connect() = 0;
+	virtual bool Connected() = 0;
+
+	// An empty message tells the next machine that the link is broken
+	virtual bool Send(const void* data, int length) = 0;
+
+	// timeoutMS -1 = wait until data arrives, 0 = no waiting, 1+ wait time in milliseconds
+	virtual bool CheckDataAvailable(int timeoutMS = 0) = 0;
+
+	/*
+	 * Receive(timeoutMS, timedOut):
+	 *
+	 * Returns the next message from the previous machine, or an empty one if
+	 * the link is broken or the timeout expired first (timedOut tells which).
+	 * A datagram transport skips a message that misses its deadline so that
+	 * later ones stay in step with the sender. Stream transports may ignore
+	 * the timeout and always wait.
+	 */
+	virtual std::vector<char>& Receive(int timeoutMS = -1, bool* timedOut = nullptr) = 0;
+
+	/*
+	 * Receive(dest, capacity, timeoutMS, timedOut, arrivalMicros):
+	 *
+	 * As above, but copies the message straight into dest (anything past
+	 * capacity is dropped) and returns its length. arrivalMicros is set to
+	 * CThread::GetMicros() at the time the message came off the wire.
+	 */
+	virtual int Receive(void* dest, int capacity, int timeoutMS = -1, bool* timedOut = nullptr, uint64_t* arrivalMicros = nullptr) = 0;
+};
+
+#endif
@@ -118,6 +118,10 @@
 	#define SAFE_ARRAY_DELETE(x) { delete[] (x); (x) = nullptr; }
 #endif
 
+// IRQ5 is the board's periodic tick; the 68K runs for four of them per frame (see RunFrame())
+static const int irq5Interval = 4000000 / 60;
+static const int cyclesPerFrame = 4 * irq5Interval;
+
 static int(*Runnet68kCB)(int cycles);
 static void(*Intnet68kCB)(int irq);
 
@@ -1197,6 +1201,9 @@ CNetBoard::CNetBoard(const Util::Config::Node &config) : m_config(config)
 	recv_size = 0;
 	send_offset = 0;
 	send_size = 0;
+
+	m_resetPending = false;
+	m_irq5Countdown = 0;
 }
 
 CNetBoard::~CNetBoard(void)
@@ -1230,45 +1237,34 @@ void CNetBoard::LoadState(CBlockFile * SaveState)
 
 void CNetBoard::RunFrame(void)
 {
+	if (m_resetPending.exchange(false))
+		Reset();
+
 	if (!IsRunning())
 		return;
 
 	M68KSetContext(&M68K);
 
-	/*if (int5 == false)
+	// Four IRQ5 periods per frame keeps certain games from cancelling with a
+	// network error. The countdown carries over between frames, so the timer
+	// keeps a steady rate instead of restarting at fixed points in each frame.
+	int remaining = cyclesPerFrame;
+	while (remaining > 0)
 	{
-		int5 = true;
-		interrupt5 = std::thread([this] { inter5(); });
-	}*/
+		if (m_irq5Countdown <= 0)
+		{
+			M68KSetIRQ(5);
+			m_irq5Countdown += irq5Interval;
+		}
 
+		int slice = std::min(remaining, m_irq5Countdown);
+		int ran = M68KRun(slice);
+		if (ran <= 0)
+			ran = slice;
 
-	M68KSetIRQ(5); // apparently, must be called every xx milli secondes or every frames or 3-4 in a frame
-	/*if (test_irq == 0 || test_irq<2)
-	{
-		test_irq ++;
+		remaining -= ran;
+		m_irq5Countdown -= ran;
 	}
-	else
-	{
-		test_irq = 0;
-		M68KSetIRQ(5);
-		//M68KRun(10000);
-	}*/
-
-	M68KRun((4000000 / 60)); // original
-	//M68KRun((4000000 / 60)*3); // 12Mhz
-
-	//DebugLog("NetBoard PC=%06X\n", M68KGetPC());
-
-	//M68KSetIRQ(6);
-	//M68KRun(10000);
-
-	// 3 times more avoid network error canceled on certain games (certainly due to irq5 that would be calling 3-4 times in a frame)
-	M68KSetIRQ(5);
-	M68KRun((4000000 / 60));
-	M68KSetIRQ(5);
-	M68KRun((4000000 / 60));
-	M68KSetIRQ(5);
-	M68KRun((4000000 / 60));
 
 	M68KGetContext(&M68K);
 }
@@ -1282,6 +1278,7 @@ void CNetBoard::Reset(void)
 	recv_size=0;
 	send_offset=0;
 	send_size=0;
+	m_irq5Countdown = 0;
 
 
 	// uncomment to dump network memory for analyse with IDA or 68k disasm
@@ -1361,8 +1358,9 @@ UINT16 CNetBoard::ReadIORegister(unsigned reg)
 
 void CNetBoard::WriteIORegister(unsigned reg, UINT16 data)
 {
+	// the 68K may be running on its own thread, so leave the reset to RunFrame()
 	if (reg == 0xc0 && !(data != 0 && IsRunning()))
-		Reset();	// don't reset if we are activating the netboard but it is already activated
+		m_resetPending = true;	// don't reset if we are activating the netboard but it is already activated
 
 	*(UINT16*)&ioreg[reg] = data;
 }
\ No newline at end of file
@@ -27,6 +27,7 @@
 #include "CPU/Bus.h"
 #include "CPU/68K/68K.h"
 #include "OSD/Thread.h"
+#include <atomic>
 #include <memory>
 #include "INetBoard.h"
 #include "TCPSend.h"
@@ -100,6 +101,9 @@ private:
 	UINT16		send_offset;
 	UINT16		send_size;
 
+	std::atomic<bool> m_resetPending;	// set by the main board, acted on by whichever thread runs the net board
+	int			m_irq5Countdown;	// 68K cycles until the next IRQ5
+
 	// netsock
 	UINT16 port_in = 0;
 	UINT16 port_out = 0;
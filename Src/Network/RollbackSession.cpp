@@ -0,0 +1,323 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "Supermodel.h"
+#include "RollbackSession.h"
+#include "UDPTransport.h"
+#include "Game.h"
+#include "Inputs/Inputs.h"
+#include "Model3/IEmulator.h"
+#include <OSD/Thread.h>
+
+/*
+ * Messages start with their type:
+ *
+ *	hello	player (uint8_t), game name
+ *	nvram	total size (uint32_t), next chunk of player 1's NVRAM
+ *	input	frame (uint32_t), input values (UINT16 each)
+ */
+enum MessageType : uint8_t
+{
+	msgHello,
+	msgNVRAM,
+	msgInput
+};
+
+static const unsigned historySize = 256;
+static const unsigned maxInputDelay = 10;
+static const unsigned maxRollbackLimit = 30;
+static const uint32_t connectTimeoutMS = 60000;
+static const uint32_t nvramChunkSize = 32768;
+static const unsigned statsFrames = 3600;		// frames between statistics in the debug log
+
+CRollbackSession::CRollbackSession(const Util::Config::Node& config, IEmulator* emulator, CInputs* inputs) :
+	m_game(emulator->GetGame()),
+	m_emulator(emulator),
+	m_inputs(inputs),
+	m_peer(config["NetplayPeer"].ValueAs<std::string>()),
+	m_local(historySize),
+	m_remote(historySize),
+	m_used(historySize),
+	m_rollbackFrame(INT_MAX)
+{
+	m_player = config["NetplayPlayer"].ValueAsDefault<unsigned>(1) == 2 ? 1 : 0;
+	m_inputDelay = std::min(config["NetplayInputDelay"].ValueAsDefault<unsigned>(1), maxInputDelay);
+	m_maxRollback = std::min(std::max(config["NetplayMaxRollback"].ValueAsDefault<unsigned>(8), 1u), maxRollbackLimit);
+	m_states.resize(m_maxRollback + 1);
+	m_message.resize(1 + sizeof(uint32_t) + nvramChunkSize);
+
+	m_transport = std::make_unique<UDPTransport>(m_peer, config["NetplayPortOut"].ValueAs<unsigned>(), config["NetplayPortIn"].ValueAs<unsigned>(), config["NetRedundancy"].ValueAsDefault<int>(2));
+}
+
+unsigned CRollbackSession::GetPlayer(void) const
+{
+	return m_player;
+}
+
+std::vector<UINT16>& CRollbackSession::Local(int frame)
+{
+	return m_local[unsigned(frame) % historySize];
+}
+
+std::vector<UINT16>& CRollbackSession::Remote(int frame)
+{
+	return m_remote[unsigned(frame) % historySize];
+}
+
+std::vector<UINT16>& CRollbackSession::Used(int frame)
+{
+	return m_used[unsigned(frame) % historySize];
+}
+
+bool CRollbackSession::Start(void)
+{
+	printf("Waiting for netplay peer %s ..\n", m_peer.c_str());
+
+	uint32_t start = CThread::GetTicks();
+	while (!m_transport->Connect())
+	{
+		if (CThread::GetTicks() - start > connectTimeoutMS)
+		{
+			ErrorLog("Unable to reach netplay peer %s.", m_peer.c_str());
+			return false;
+		}
+		CThread::Sleep(1);
+	}
+
+	if (!Handshake() || !SyncNVRAM())
+		return false;
+	m_emulator->Reset();
+
+	// until the other player's inputs come in, predict that they haven't touched anything
+	m_inputs->ReadPlayerState(m_game, 1 - m_player, &m_prediction);
+
+	// the first frames run before any local inputs take effect
+	for (unsigned i = 0; i < m_inputDelay; i++)
+	{
+		m_inputs->ReadPlayerState(m_game, m_player, &Local(i));
+		SendInput(i);
+	}
+
+	printf("Netplay started as player %u.\n", m_player + 1);
+	return true;
+}
+
+bool CRollbackSession::Handshake(void)
+{
+	m_message.assign(1, msgHello);
+	m_message.push_back(uint8_t(m_player));
+	m_message.insert(m_message.end(), m_game.name.begin(), m_game.name.end());
+	m_transport->Send(m_message.data(), int(m_message.size()));
+
+	m_message.resize(1 + sizeof(uint32_t) + nvramChunkSize);
+	int size = m_transport->Receive(m_message.data(), int(m_message.size()));
+	if (size < 2 || m_message[0] != msgHello)
+	{
+		ErrorLog("Netplay peer did not respond.");
+		return false;
+	}
+	if (std::string((const char*)&m_message[2], size - 2) != m_game.name)
+	{
+		ErrorLog("Netplay peer is running a different game.");
+		return false;
+	}
+	if (m_message[1] == m_player)
+	{
+		ErrorLog("Netplay peer is also player %u. One machine must be player 1 and the other player 2.", m_player + 1);
+		return false;
+	}
+	return true;
+}
+
+bool CRollbackSession::SyncNVRAM(void)
+{
+	if (m_player == 0)
+	{
+		CBlockFile::MemoryImage image;
+		CBlockFile nvram;
+		nvram.CreateInMemory(&image, "Supermodel NVRAM State", "Supermodel Version " SUPERMODEL_VERSION);
+		m_emulator->SaveNVRAM(&nvram);
+		nvram.Close();
+
+		uint32_t total = uint32_t(image.data.size());
+		for (uint32_t offset = 0; offset < total; offset += nvramChunkSize)
+		{
+			uint32_t length = std::min(nvramChunkSize, total - offset);
+			m_message[0] = msgNVRAM;
+			memcpy(&m_message[1], &total, sizeof(total));
+			memcpy(&m_message[1 + sizeof(total)], &image.data[offset], length);
+			m_transport->Send(m_message.data(), int(1 + sizeof(total) + length));
+		}
+		return true;
+	}
+
+	// player 2 plays on player 1's NVRAM
+	std::vector<uint8_t> data;
+	uint32_t total = 0;
+	do
+	{
+		int size = m_transport->Receive(m_message.data(), int(m_message.size()));
+		if (size < int(1 + sizeof(total)) || m_message[0] != msgNVRAM)
+		{
+			ErrorLog("Unable to receive NVRAM from netplay peer.");
+			return false;
+		}
+		memcpy(&total, &m_message[1], sizeof(total));
+		data.insert(data.end(), &m_message[1 + sizeof(total)], &m_message[size]);
+	} while (data.size() < total);
+
+	CBlockFile nvram;
+	nvram.LoadFromMemory(data.data(), data.size());
+	m_emulator->LoadNVRAM(&nvram);
+	nvram.Close();
+	return true;
+}
+
+void CRollbackSession::SendInput(int frame)
+{
+	const std::vector<UINT16>& state = Local(frame);
+	uint32_t frameNum = uint32_t(frame);
+	m_message.resize(1 + sizeof(frameNum) + state.size() * sizeof(UINT16));
+	m_message[0] = msgInput;
+	memcpy(&m_message[1], &frameNum, sizeof(frameNum));
+	if (!state.empty())
+		memcpy(&m_message[1 + sizeof(frameNum)], state.data(), state.size() * sizeof(UINT16));
+	m_transport->Send(m_message.data(), int(m_message.size()));
+}
+
+bool CRollbackSession::ReceiveInputs(bool wait)
+{
+	// the transport delivers in order, so each input is for the frame after the last
+	m_message.resize(1 + sizeof(uint32_t) + nvramChunkSize);
+	while (wait || m_transport->CheckDataAvailable(0))
+	{
+		int size = m_transport->Receive(m_message.data(), int(m_message.size()));
+		if (size == 0)
+			return false;
+		wait = false;
+
+		uint32_t frame;
+		if (size < int(1 + sizeof(frame)) || m_message[0] != msgInput)
+			continue;
+		memcpy(&frame, &m_message[1], sizeof(frame));
+		if (int(frame) != m_remoteFrame + 1)
+			continue;
+
+		std::vector<UINT16>& state = Remote(frame);
+		state.resize((size - 1 - sizeof(frame)) / sizeof(UINT16));
+		if (state.size() != m_prediction.size())
+		{
+			ErrorLog("Netplay peer sent inputs that don't match this game.");
+			return false;
+		}
+		if (!state.empty())
+			memcpy(state.data(), &m_message[1 + sizeof(frame)], state.size() * sizeof(UINT16));
+		m_remoteFrame = int(frame);
+		m_prediction = state;
+
+		// a frame that already ran with a different prediction has to be run again
+		if (m_remoteFrame < m_frame && state != Used(m_remoteFrame))
+			m_rollbackFrame = std::min(m_rollbackFrame, m_remoteFrame);
+	}
+	return true;
+}
+
+void CRollbackSession::SaveState(int frame)
+{
+	CBlockFile state;
+	state.CreateInMemory(&m_states[unsigned(frame) % m_states.size()], "Supermodel Rollback State", "Supermodel Version " SUPERMODEL_VERSION);
+	m_emulator->SaveState(&state);
+	state.Close();
+}
+
+void CRollbackSession::LoadState(int frame)
+{
+	const CBlockFile::MemoryImage& image = m_states[unsigned(frame) % m_states.size()];
+	CBlockFile state;
+	state.LoadFromMemory(image.data.data(), image.data.size());
+	m_emulator->LoadState(&state);
+	state.Close();
+}
+
+void CRollbackSession::Step(int frame)
+{
+	Used(frame) = frame <= m_remoteFrame ? Remote(frame) : m_prediction;
+	m_inputs->WritePlayerState(m_game, m_player, Local(frame));
+	m_inputs->WritePlayerState(m_game, 1 - m_player, Used(frame));
+	m_emulator->RunFrame();
+}
+
+bool CRollbackSession::RunFrame(void)
+{
+	// local inputs take effect m_inputDelay frames from now
+	int inputFrame = m_frame + int(m_inputDelay);
+	m_inputs->ReadPlayerState(m_game, m_player, &Local(inputFrame));
+	SendInput(inputFrame);
+
+	if (!ReceiveInputs(false))
+		return false;
+
+	// don't get further ahead of the other player than can be rolled back
+	if (m_frame - m_remoteFrame > int(m_maxRollback))
+	{
+		m_stalls++;
+		do
+		{
+			if (!ReceiveInputs(true))
+				return false;
+		} while (m_frame - m_remoteFrame > int(m_maxRollback));
+	}
+
+	if (m_rollbackFrame < m_frame)
+	{
+		LoadState(m_rollbackFrame);
+		m_emulator->SetOutputEnabled(false, false);
+		for (int frame = m_rollbackFrame; frame < m_frame; frame++)
+		{
+			if (frame > m_rollbackFrame)
+				SaveState(frame);
+			Step(frame);
+		}
+		m_emulator->SetOutputEnabled(true, true);
+
+		m_rollbacks++;
+		m_resimulated += unsigned(m_frame - m_rollbackFrame);
+		m_rollbackFrame = INT_MAX;
+	}
+
+	SaveState(m_frame);
+	Step(m_frame);
+	m_frame++;
+
+	if (m_frame % statsFrames == 0)
+	{
+		DebugLog("Netplay: %u rollbacks re-running %u frames, %u stalls over %u frames\n", m_rollbacks, m_resimulated, m_stalls, statsFrames);
+		m_rollbacks = 0;
+		m_resimulated = 0;
+		m_stalls = 0;
+	}
+
+	return true;
+}
@@ -0,0 +1,106 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef INCLUDED_ROLLBACKSESSION_H
+#define INCLUDED_ROLLBACKSESSION_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BlockFile.h"
+#include "INetTransport.h"
+#include "Types.h"
+#include "Util/NewConfig.h"
+
+class IEmulator;
+class CInputs;
+struct Game;
+
+/*
+ * CRollbackSession:
+ *
+ * Netplay between two machines that each run the whole game, in the style of
+ * GGPO. Only the players' inputs are exchanged. Each frame runs straight away
+ * with the other player's input predicted to be the last one received. When
+ * an input arrives that differs from the prediction, the state saved before
+ * that frame is loaded and the frames since are run again with the actual
+ * inputs, without output.
+ *
+ * Both machines must run the same build with the same settings, and the
+ * emulation has to be single-threaded so that it is deterministic.
+ */
+class CRollbackSession
+{
+public:
+	CRollbackSession(const Util::Config::Node& config, IEmulator* emulator, CInputs* inputs);
+
+	// Links up with the other machine and starts both from player 1's NVRAM and a reset
+	bool Start(void);
+
+	// Runs the next frame with the inputs just polled; false if the link broke
+	bool RunFrame(void);
+
+	// Player (0 or 1) that the local inputs control
+	unsigned GetPlayer(void) const;
+
+private:
+	std::vector<UINT16>& Local(int frame);
+	std::vector<UINT16>& Remote(int frame);
+	std::vector<UINT16>& Used(int frame);
+	bool Handshake(void);
+	bool SyncNVRAM(void);
+	void SendInput(int frame);
+	bool ReceiveInputs(bool wait);
+	void SaveState(int frame);
+	void LoadState(int frame);
+	void Step(int frame);
+
+	const Game& m_game;
+	IEmulator* m_emulator;
+	CInputs* m_inputs;
+	std::string m_peer;
+	std::unique_ptr<INetTransport> m_transport;
+	std::vector<uint8_t> m_message;
+
+	unsigned m_player;
+	unsigned m_inputDelay;			// frames between local inputs being polled and taking effect
+	unsigned m_maxRollback;			// frames that may run ahead of the other player's inputs
+
+	// per frame, indexed by frame % historySize
+	std::vector<std::vector<UINT16>> m_local;
+	std::vector<std::vector<UINT16>> m_remote;
+	std::vector<std::vector<UINT16>> m_used;	// remote inputs the frame was last run with
+	std::vector<CBlockFile::MemoryImage> m_states;	// state before the frame, indexed by frame % (m_maxRollback + 1)
+
+	int m_frame = 0;				// next frame to run
+	int m_remoteFrame = -1;			// newest frame with the other player's inputs
+	int m_rollbackFrame;			// earliest frame that ran with a wrong prediction
+	std::vector<UINT16> m_prediction;
+
+	// statistics for the debug log
+	unsigned m_rollbacks = 0;
+	unsigned m_resimulated = 0;
+	unsigned m_stalls = 0;
+};
+
+#endif
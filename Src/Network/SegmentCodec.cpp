@@ -0,0 +1,186 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "SegmentCodec.h"
+#include <cstring>
+
+// message layout: kind, sequence number, then the raw segment (key) or runs of skip count, length and bytes (delta)
+enum : uint8_t
+{
+	kindKey,
+	kindDelta
+};
+
+static const unsigned headerSize = 3;
+static const unsigned runHeaderSize = 4;
+static const uint16_t keyframeInterval = 60;		// frames; bounds how long a receiver can be left without a usable reference
+
+static inline void PutU16(std::vector<uint8_t>& out, size_t offset, uint16_t value)
+{
+	memcpy(&out[offset], &value, sizeof(value));
+}
+
+static inline uint16_t GetU16(const uint8_t* in)
+{
+	uint16_t value;
+	memcpy(&value, in, sizeof(value));
+	return value;
+}
+
+void SegmentCodec::Reset(unsigned numChannels, unsigned segmentSize)
+{
+	m_segmentSize = segmentSize;
+	m_send.assign(numChannels, Channel());
+	m_receive.assign(numChannels, Channel());
+	for (auto& channel : m_send)
+		channel.reference.resize(segmentSize);
+	for (auto& channel : m_receive)
+		channel.reference.resize(segmentSize);
+}
+
+unsigned SegmentCodec::MaxMessageSize() const
+{
+	return headerSize + m_segmentSize;
+}
+
+void SegmentCodec::Encode(unsigned channel, const uint8_t* segment, std::vector<uint8_t>& message)
+{
+	Channel& state = m_send[channel];
+	const uint8_t* reference = state.reference.data();
+	size_t start = message.size();
+	size_t limit = start + headerSize + m_segmentSize;
+
+	state.seq++;
+	message.resize(start + headerSize);
+	message[start] = kindDelta;
+	PutU16(message, start + 1, state.seq);
+
+	if (state.valid && state.seq % keyframeInterval != 0)
+	{
+		unsigned pos = 0;
+		unsigned last = 0;
+		while (pos < m_segmentSize)
+		{
+			// skip what hasn't changed
+			while (pos < m_segmentSize && segment[pos] == reference[pos])
+				pos++;
+			if (pos == m_segmentSize)
+				break;
+
+			// extend the changed run across gaps too short to be worth a new run
+			unsigned end = pos + 1;
+			while (end < m_segmentSize)
+			{
+				if (segment[end] != reference[end])
+				{
+					end++;
+					continue;
+				}
+				unsigned gap = end;
+				while (gap < m_segmentSize && gap - end < runHeaderSize && segment[gap] == reference[gap])
+					gap++;
+				if (gap == m_segmentSize || gap - end >= runHeaderSize)
+					break;
+				end = gap;
+			}
+
+			size_t offset = message.size();
+			if (offset + runHeaderSize + (end - pos) >= limit)
+				break;
+			message.resize(offset + runHeaderSize + (end - pos));
+			PutU16(message, offset, uint16_t(pos - last));
+			PutU16(message, offset + 2, uint16_t(end - pos));
+			memcpy(&message[offset + runHeaderSize], segment + pos, end - pos);
+
+			pos = last = end;
+		}
+
+		// the delta covers the whole segment unless it ran out of room
+		if (pos == m_segmentSize)
+		{
+			memcpy(state.reference.data(), segment, m_segmentSize);
+			return;
+		}
+	}
+
+	message.resize(start + headerSize + m_segmentSize);
+	message[start] = kindKey;
+	memcpy(&message[start + headerSize], segment, m_segmentSize);
+	memcpy(state.reference.data(), segment, m_segmentSize);
+	state.valid = true;
+}
+
+bool SegmentCodec::Decode(unsigned channel, const uint8_t* message, unsigned size, uint8_t* dest)
+{
+	if (channel >= m_receive.size() || size < headerSize)
+		return false;
+
+	Channel& state = m_receive[channel];
+	uint8_t kind = message[0];
+	uint16_t seq = GetU16(message + 1);
+	const uint8_t* data = message + headerSize;
+	const uint8_t* end = message + size;
+
+	if (kind == kindKey)
+	{
+		if (unsigned(end - data) != m_segmentSize)
+			return false;
+		memcpy(state.reference.data(), data, m_segmentSize);
+	}
+	else
+	{
+		// a delta only applies on top of the message just before it
+		if (!state.valid || seq != uint16_t(state.seq + 1))
+		{
+			state.valid = false;
+			return false;
+		}
+
+		unsigned pos = 0;
+		while (data < end)
+		{
+			if (end - data < int(runHeaderSize))
+			{
+				state.valid = false;
+				return false;
+			}
+			unsigned skip = GetU16(data);
+			unsigned length = GetU16(data + 2);
+			data += runHeaderSize;
+			pos += skip;
+			if (pos + length > m_segmentSize || unsigned(end - data) < length)
+			{
+				state.valid = false;
+				return false;
+			}
+			memcpy(&state.reference[pos], data, length);
+			data += length;
+			pos += length;
+		}
+	}
+
+	state.seq = seq;
+	state.valid = true;
+	memcpy(dest, state.reference.data(), m_segmentSize);
+	return true;
+}
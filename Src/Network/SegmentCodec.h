@@ -0,0 +1,69 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef INCLUDED_SEGMENTCODEC_H
+#define INCLUDED_SEGMENTCODEC_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * SegmentCodec:
+ *
+ * Each link carries the same few segments every frame, mostly unchanged, so
+ * each one is sent as the difference from its previous version on a numbered
+ * channel: runs of unchanged bytes are skipped and changed runs copied. A full
+ * keyframe goes out periodically, and whenever the delta wouldn't be smaller.
+ *
+ * Every message carries a per-channel sequence number. A delta that doesn't
+ * follow on from what the receiver holds (a datagram went missing) is refused
+ * and the channel waits for the next keyframe.
+ */
+class SegmentCodec
+{
+public:
+	void Reset(unsigned numChannels, unsigned segmentSize);
+
+	// Largest encoded message
+	unsigned MaxMessageSize() const;
+
+	// Appends the encoded segment to message
+	void Encode(unsigned channel, const uint8_t* segment, std::vector<uint8_t>& message);
+
+	// Decodes a message into dest (segmentSize bytes); false if it can't be applied
+	bool Decode(unsigned channel, const uint8_t* message, unsigned size, uint8_t* dest);
+
+private:
+
+	struct Channel
+	{
+		std::vector<uint8_t> reference;
+		uint16_t seq = 0;
+		bool valid = false;
+	};
+
+	unsigned m_segmentSize = 0;
+	std::vector<Channel> m_send;
+	std::vector<Channel> m_receive;
+};
+
+#endif
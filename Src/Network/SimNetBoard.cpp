@@ -20,9 +20,12 @@
  ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+#include <algorithm>
 #include <thread>
 #include "Supermodel.h"
 #include "SimNetBoard.h"
+#include "TCPTransport.h"
+#include "UDPTransport.h"
 #include <OSD/Thread.h>
 
  // these make 16-bit read/writes much neater
@@ -31,6 +34,15 @@
 
 static const uint64_t netGUID = 0x5bf177da34872;
 
+// frames without any link data before a datagram link is considered broken (about 5 seconds)
+static const unsigned maxMissedFrames = 300;
+static const unsigned latencyReportSamples = 3600;	// segments between hop latency reports in the debug log
+static const unsigned maxFrameDelay = 3;
+
+// every link message starts with the frame it was sent in and how far into that frame, see SyncClock()
+static const unsigned stampSize = 8;
+static const int64_t maxClockNudge = 100;	// microseconds the frame pacing may move by per frame
+
 inline bool CSimNetBoard::IsGame(const char* gameName)
 {
 	return (m_gameInfo.name == gameName) || (m_gameInfo.parent == gameName);
@@ -86,8 +98,22 @@ Result CSimNetBoard::Init(uint8_t* netRAMPtr, uint8_t* netBufferPtr)
 	port_out = m_config["PortOut"].ValueAs<unsigned>();
 	addr_out = m_config["AddressOut"].ValueAs<std::string>();
 
-	nets = std::make_unique<TCPSend>(addr_out, port_out);
-	netr = std::make_unique<TCPReceive>(port_in);
+	std::string transport = m_config["NetTransport"].ValueAsDefault<std::string>("tcp");
+	if (transport == "udp")
+	{
+		m_transport = std::make_unique<UDPTransport>(addr_out, port_out, port_in, m_config["NetRedundancy"].ValueAsDefault<int>(2));
+		m_frameBudget = m_config["NetFrameBudget"].ValueAsDefault<int>(10);
+	}
+	else
+	{
+		if (transport != "tcp")
+			ErrorLog("Unknown net board transport '%s'; using TCP.", transport.c_str());
+		m_transport = std::make_unique<TCPTransport>(addr_out, port_out, port_in);
+		m_frameBudget = -1;
+	}
+
+	m_frameDelay = std::min(m_config["NetFrameDelay"].ValueAsDefault<unsigned>(0), maxFrameDelay);
+	m_compress = m_config["NetCompression"].ValueAsDefault<bool>(false);
 
 	return Result::OKAY;
 }
@@ -146,14 +172,14 @@ void CSimNetBoard::RunFrame(void)
 			if (RAM16[0x400] == 0)	// master
 			{
 				// flush receive buffer
-				while (netr->CheckDataAvailable())
+				while (m_transport->CheckDataAvailable())
 				{
-					netr->Receive();
+					m_transport->Receive();
 				}
 
 				// check all linked instances have the same GUID
-				nets->Send(&netGUID, sizeof(netGUID));
-				auto& recv_data = netr->Receive();
+				m_transport->Send(&netGUID, sizeof(netGUID));
+				auto& recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				uint64_t testGUID;
@@ -162,8 +188,8 @@ void CSimNetBoard::RunFrame(void)
 					testGUID = 0;
 
 				// send the GUID for one more loop
-				nets->Send(&testGUID, sizeof(testGUID));
-				netr->Receive();
+				m_transport->Send(&testGUID, sizeof(testGUID));
+				m_transport->Receive();
 				
 				if (testGUID != netGUID)
 				{
@@ -174,38 +200,38 @@ void CSimNetBoard::RunFrame(void)
 
 				// master has an index of zero
 				machineIndex = 0;
-				nets->Send(&machineIndex, sizeof(machineIndex));
+				m_transport->Send(&machineIndex, sizeof(machineIndex));
 
 				// receive back the number of other linked machines
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				numMachines = recv_data[0];
 
 				// send the number of other linked machines
-				nets->Send(&numMachines, sizeof(numMachines));
-				netr->Receive();
+				m_transport->Send(&numMachines, sizeof(numMachines));
+				m_transport->Receive();
 			}
 			else
 			{
 				// receive GUID from the previous machine and check it matches
-				auto& recv_data = netr->Receive();
+				auto& recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				uint64_t testGUID;
 				memcpy(&testGUID, recv_data.data(), recv_data.size());
 				if (testGUID != netGUID)
 					testGUID = 0;
-				nets->Send(&testGUID, sizeof(testGUID));
+				m_transport->Send(&testGUID, sizeof(testGUID));
 
 				// one more time, in case a later machine has a GUID mismatch
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&testGUID, recv_data.data(), recv_data.size());
 				if (testGUID != netGUID)
 					testGUID = 0;
-				nets->Send(&testGUID, sizeof(testGUID));
+				m_transport->Send(&testGUID, sizeof(testGUID));
 
 				if (testGUID != netGUID)
 				{
@@ -215,18 +241,18 @@ void CSimNetBoard::RunFrame(void)
 				}
 
 				// receive the previous machine's index, increment it, send it to the next machine
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				machineIndex = recv_data[0] + 1;
-				nets->Send(&machineIndex, sizeof(machineIndex));
+				m_transport->Send(&machineIndex, sizeof(machineIndex));
 
 				// receive the number of other linked machines and forward it on
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				numMachines = recv_data[0];
-				nets->Send(&numMachines, sizeof(numMachines));
+				m_transport->Send(&numMachines, sizeof(numMachines));
 			}
 
 			// if there are no other linked machines, only continue if Supermodel is linked to itself
@@ -258,6 +284,7 @@ void CSimNetBoard::RunFrame(void)
 			CommRAM16[0xc] = FLIPENDIAN16(0x100);
 			CommRAM16[0xe] = FLIPENDIAN16(RAM16[0x402] - m_segmentSize + 0x200);
 
+			StartLink();
 			m_state = State::ready;
 		}
 		else
@@ -275,12 +302,12 @@ void CSimNetBoard::RunFrame(void)
 			if (RAM16[0x200] == 0)	// master
 			{
 				// flush receive buffer
-				while (netr->CheckDataAvailable())
-					netr->Receive();
+				while (m_transport->CheckDataAvailable())
+					m_transport->Receive();
 
 				// check all linked instances have the same GUID
-				nets->Send(&netGUID, sizeof(netGUID));
-				auto& recv_data = netr->Receive();
+				m_transport->Send(&netGUID, sizeof(netGUID));
+				auto& recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 
@@ -290,8 +317,8 @@ void CSimNetBoard::RunFrame(void)
 					testGUID = 0;
 
 				// send the GUID for one more loop
-				nets->Send(&testGUID, sizeof(testGUID));
-				netr->Receive();
+				m_transport->Send(&testGUID, sizeof(testGUID));
+				m_transport->Receive();
 
 				if (testGUID != netGUID)
 				{
@@ -302,38 +329,38 @@ void CSimNetBoard::RunFrame(void)
 
 				// master has indices set to zero
 				machineIndex.total = 0; machineIndex.playable = 0;
-				nets->Send(&machineIndex, sizeof(machineIndex));
+				m_transport->Send(&machineIndex, sizeof(machineIndex));
 
 				// receive back the number of other linked machines
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&numMachines, recv_data.data(), recv_data.size());
 
 				// send the number of other linked machines
-				nets->Send(&numMachines, sizeof(numMachines));
-				netr->Receive();
+				m_transport->Send(&numMachines, sizeof(numMachines));
+				m_transport->Receive();
 			}
 			else if (RAM16[0x200] < 0x8000)	// slave
 			{
 				// receive GUID from the previous machine and check it matches
-				auto& recv_data = netr->Receive();
+				auto& recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				uint64_t testGUID;
 				memcpy(&testGUID, recv_data.data(), recv_data.size());
 				if (testGUID != netGUID)
 					testGUID = 0;
-				nets->Send(&testGUID, sizeof(testGUID));
+				m_transport->Send(&testGUID, sizeof(testGUID));
 
 				// one more time, in case a later machine has a GUID mismatch
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&testGUID, recv_data.data(), recv_data.size());
 				if (testGUID != netGUID)
 					testGUID = 0;
-				nets->Send(&testGUID, sizeof(testGUID));
+				m_transport->Send(&testGUID, sizeof(testGUID));
 
 				if (testGUID != netGUID)
 				{
@@ -343,46 +370,46 @@ void CSimNetBoard::RunFrame(void)
 				}
 
 				// receive the indices of the previous machine and increment them
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&machineIndex, recv_data.data(), recv_data.size());
 				machineIndex.total++; machineIndex.playable++;
 
 				// send our indices to the next machine
-				nets->Send(&machineIndex, sizeof(machineIndex));
+				m_transport->Send(&machineIndex, sizeof(machineIndex));
 
 				// receive the number of machines
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&numMachines, recv_data.data(), recv_data.size());
 
 				// forward the number of machines
-				nets->Send(&numMachines, sizeof(numMachines));
+				m_transport->Send(&numMachines, sizeof(numMachines));
 			}
 			else
 			{
 				// relay/satellite
 				
 				// receive GUID from the previous machine and check it matches
-				auto& recv_data = netr->Receive();
+				auto& recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				uint64_t testGUID;
 				memcpy(&testGUID, recv_data.data(), recv_data.size());
 				if (testGUID != netGUID)
 					testGUID = 0;
-				nets->Send(&testGUID, sizeof(testGUID));
+				m_transport->Send(&testGUID, sizeof(testGUID));
 
 				// one more time, in case a later machine has a GUID mismatch
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&testGUID, recv_data.data(), recv_data.size());
 				if (testGUID != netGUID)
 					testGUID = 0;
-				nets->Send(&testGUID, sizeof(testGUID));
+				m_transport->Send(&testGUID, sizeof(testGUID));
 
 				if (testGUID != netGUID)
 				{
@@ -392,23 +419,23 @@ void CSimNetBoard::RunFrame(void)
 				}
 
 				// receive the indices of the previous machine; don't increment the playable index
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&machineIndex, recv_data.data(), recv_data.size());
 				machineIndex.total++;
 
 				// send our indices to the next machine
-				nets->Send(&machineIndex, sizeof(machineIndex));
+				m_transport->Send(&machineIndex, sizeof(machineIndex));
 
 				// receive the number of machines
-				recv_data = netr->Receive();
+				recv_data = m_transport->Receive();
 				if (recv_data.empty())
 					break;
 				memcpy(&numMachines, recv_data.data(), recv_data.size());
 
 				// forward the number of machines
-				nets->Send(&numMachines, sizeof(numMachines));
+				m_transport->Send(&numMachines, sizeof(numMachines));
 
 				// indicate that this machine is a relay/satellite
 				if (!IsGame("dirtdvls"))
@@ -449,32 +476,93 @@ void CSimNetBoard::RunFrame(void)
 			CommRAM16[0xc] = FLIPENDIAN16(0x100);
 			CommRAM16[0xe] = FLIPENDIAN16(RAM16[0x206] + 0x80);
 
+			StartLink();
 			m_state = State::ready;
 		}
 		break;
 
 	case State::ready:
+		{
+			uint64_t now = CThread::GetMicros();
+			int64_t period = int64_t(now - m_frameStart);
+			if (m_frameStart && period < 4 * m_framePeriod)	// leaves out pauses
+				m_framePeriod += (period - m_framePeriod) / 16;
+			m_frameStart = now;
+			m_linkFrame++;
+		}
+
 		m_counter++;
 		CommRAM16[0x6] = FLIPENDIAN16(m_counter);
 		
-		// we only send what we need to; helps cut down on bandwidth
-		// each machine has to receive back its own data (TODO: copy this data manually?)
-		for (int i = 0; i < m_numMachines; i++)
+		if (m_frameDelay)
+			PipelineFrame();
+		else
 		{
-			nets->Send(CommRAM + 0x100 + i * m_segmentSize, m_segmentSize);
-			auto& recv_data = netr->Receive();
-			if (recv_data.empty())
+			// we only send what we need to; helps cut down on bandwidth
+			// each machine has to receive back its own data (TODO: copy this data manually?)
+			// with a frame budget, segments that don't arrive in time keep last frame's data
+			uint32_t deadline = SDL_GetTicks() + uint32_t(m_frameBudget);
+			bool received = false;
+			// when compressing, each relay step is its own codec channel
+			for (int i = 0; i < m_numMachines; i++)
 			{
-				// link broken - send an "empty" packet to alert other machines
-				nets->Send(nullptr, 0);
-				m_state = State::error;
-				if (m_gameType == GameType::one)
-					m_status1 = 0x40;			// send "link broken" message to mainboard
-				break;
+				uint8_t* segment = CommRAM + 0x100 + i * m_segmentSize;
+				StampMessage();
+				if (m_compress)
+					m_codec.Encode(i, segment, m_linkSend);
+				else
+					m_linkSend.insert(m_linkSend.end(), segment, segment + m_segmentSize);
+				m_transport->Send(m_linkSend.data(), int(m_linkSend.size()));
+				uint64_t sent = CThread::GetMicros();
+				int timeout = -1;
+				if (m_frameBudget >= 0)
+					timeout = std::max(int32_t(deadline - SDL_GetTicks()), 0);
+				bool timedOut;
+				uint64_t arrival;
+				int size = m_transport->Receive(m_linkReceive.data(), int(m_linkReceive.size()), timeout, &timedOut, &arrival);
+				if (timedOut)
+					continue;
+				if (size == 0)
+				{
+					LinkBroken();
+					break;
+				}
+				received = true;
+				if (size <= int(stampSize))
+					continue;
+				SampleClock(m_linkReceive.data(), arrival);
+
+				// a delta that can't be applied keeps last frame's data until the next keyframe
+				if (m_compress)
+				{
+					if (!m_codec.Decode(i, &m_linkReceive[stampSize], unsigned(size) - stampSize, segment + m_segmentSize))
+						continue;
+				}
+				else if (size == int(m_linkReceive.size()))
+					memcpy(segment + m_segmentSize, &m_linkReceive[stampSize], m_segmentSize);
+				else
+					continue;
+
+				// time from our segment going out to the previous machine's arriving: one hop plus any lag between machines
+				uint64_t latency = arrival > sent ? arrival - sent : 0;
+				m_latencyTotal += latency;
+				m_latencyMax = std::max(m_latencyMax, latency);
+				m_latencySamples++;
+			}
+
+			if (m_latencySamples >= latencyReportSamples)
+			{
+				DebugLog("Net board hop latency: %u us average, %u us worst over %u segments\n", unsigned(m_latencyTotal / m_latencySamples), unsigned(m_latencyMax), m_latencySamples);
+				m_latencyTotal = 0;
+				m_latencyMax = 0;
+				m_latencySamples = 0;
 			}
-			memcpy(CommRAM + 0x100 + (i + 1) * m_segmentSize, recv_data.data(), recv_data.size());
+
+			CountFrame(received);
 		}
 
+		SyncClock();
+
 		// swap CommRAM banks
 		if (m_commbank)
 		{
@@ -502,8 +590,8 @@ void CSimNetBoard::Reset(void)
 	// if netboard was active, send an "empty" packet so the other machines don't get stuck waiting for data
 	if (m_state == State::ready)
 	{
-		nets->Send(nullptr, 0);
-		netr->Receive();
+		m_transport->Send(nullptr, 0);
+		m_transport->Receive(m_frameBudget);
 	}
 
 	m_running = false;
@@ -525,22 +613,245 @@ void CSimNetBoard::GetGame(const Game& gameInfo)
 	m_gameInfo = gameInfo;
 }
 
-void CSimNetBoard::ConnectProc(void)
+void CSimNetBoard::LinkBroken(void)
 {
-	if (m_connected)
-		return;
+	// send an "empty" packet to alert other machines
+	m_transport->Send(nullptr, 0);
+	m_state = State::error;
+	if (m_gameType == GameType::one)
+		m_status1 = 0x40;			// send "link broken" message to mainboard
+}
 
-	printf("Connecting to %s:%i ..\n", addr_out.c_str(), port_out);
+void CSimNetBoard::CountFrame(bool received)
+{
+	m_missedFrames = received ? 0 : m_missedFrames + 1;
+	if (m_state == State::ready && m_missedFrames >= maxMissedFrames)
+	{
+		ErrorLog("Net board link lost.");
+		LinkBroken();
+	}
+}
+
+void CSimNetBoard::StartLink(void)
+{
+	// both ends of every link start from scratch, so the first segment on each channel is a keyframe
+	m_codec.Reset(m_numMachines, m_segmentSize);
+	m_linkReceive.resize(stampSize + (m_compress ? m_codec.MaxMessageSize() : m_segmentSize));
+	m_pipeFrames = 0;
+
+	m_master = (RAM16[0x400] == 0);
+	m_linkFrame = 0;
+	m_frameStart = 0;
+	m_clockError = 0;
+	m_clockSampled = false;
+}
+
+/*
+ * PipelineFrame():
+ *
+ * Link play with a fixed delay of m_frameDelay frames. Rather than relaying
+ * the segments hop by hop within the frame, every machine sends its own
+ * segment as soon as the frame starts and forwards the others' as they come
+ * in, so a segment reaches every machine in the ring within network time.
+ * Segments queue up by their distance back around the ring (which is also
+ * their CommRAM slot) and are consumed m_frameDelay frames after they were
+ * sent, by which time they have normally arrived and nothing needs to wait.
+ *
+ * Messages are a hop count followed by the segment, which when compressing is
+ * coded on the channel for that hop count.
+ */
+void CSimNetBoard::PipelineFrame(void)
+{
+	uint8_t* segments = CommRAM + 0x100;
+	unsigned depth = m_frameDelay + 1;
 
-	// wait until TCPSend has connected to the next machine
-	while (!nets->Connect())
+	if (m_pipeFrames == 0)
 	{
-		if (m_quit)
+		m_segmentQueues.assign(m_numMachines + 1, SegmentQueue());
+		for (auto& queue : m_segmentQueues)
+			queue.data.resize(depth * m_segmentSize);
+		m_linkReceive.resize(stampSize + 1 + (m_compress ? m_codec.MaxMessageSize() : m_segmentSize));
+		m_pipeSegment.resize(m_segmentSize);
+	}
+
+	// our own segment goes round the ring and, like the others, comes back in the last slot
+	SendSegment(0, segments);
+	PushSegment(m_numMachines, segments);
+
+	while (m_transport->CheckDataAvailable(0))
+	{
+		if (!ReceiveSegment())
 			return;
 	}
 
-	// wait until TCPReceive has accepted a connection from the previous machine
-	while (!netr->Connected())
+	// nothing to consume until the pipeline has filled
+	if (++m_pipeFrames <= m_frameDelay)
+		return;
+
+	// segments that still haven't arrived within the frame budget keep last frame's data
+	uint32_t deadline = SDL_GetTicks() + uint32_t(m_frameBudget);
+	bool received = false;
+	for (int slot = 1; slot < m_numMachines; slot++)
+	{
+		SegmentQueue& queue = m_segmentQueues[slot];
+		while (queue.count == 0)
+		{
+			int timeout = -1;
+			if (m_frameBudget >= 0)
+				timeout = std::max(int32_t(deadline - SDL_GetTicks()), 0);
+			if (!m_transport->CheckDataAvailable(timeout))
+			{
+				if (timeout < 0)
+				{
+					LinkBroken();
+					return;
+				}
+				break;
+			}
+			if (!ReceiveSegment())
+				return;
+		}
+
+		if (queue.count)
+		{
+			PopSegment(slot, segments + slot * m_segmentSize);
+			received = true;
+		}
+	}
+
+	PopSegment(m_numMachines, segments + m_numMachines * m_segmentSize);
+
+	CountFrame(received || m_numMachines == 1);
+}
+
+bool CSimNetBoard::ReceiveSegment(void)
+{
+	uint64_t arrival;
+	int size = m_transport->Receive(m_linkReceive.data(), int(m_linkReceive.size()), -1, nullptr, &arrival);
+	if (size == 0)
+	{
+		LinkBroken();
+		return false;
+	}
+
+	if (size <= int(stampSize))
+		return true;
+	SampleClock(m_linkReceive.data(), arrival);
+
+	// anything else is left over from before the pipeline started
+	const uint8_t* message = &m_linkReceive[stampSize];
+	unsigned slot = message[0] + 1u;
+	if (slot >= m_numMachines)
+		return true;
+
+	const uint8_t* segment = message + 1;
+	if (m_compress)
+	{
+		// a delta that can't be applied is dropped and the slot waits for the next keyframe
+		if (!m_codec.Decode(slot - 1, message + 1, unsigned(size) - stampSize - 1, m_pipeSegment.data()))
+			return true;
+		segment = m_pipeSegment.data();
+	}
+	else if (size != int(m_linkReceive.size()))
+		return true;
+
+	// pass it on until it has reached every machine
+	if (slot + 1 < m_numMachines)
+		SendSegment(slot, segment);
+
+	PushSegment(slot, segment);
+	return true;
+}
+
+void CSimNetBoard::SendSegment(unsigned hops, const uint8_t* segment)
+{
+	StampMessage();
+	m_linkSend.push_back(uint8_t(hops));
+	if (m_compress)
+		m_codec.Encode(hops, segment, m_linkSend);
+	else
+		m_linkSend.insert(m_linkSend.end(), segment, segment + m_segmentSize);
+	m_transport->Send(m_linkSend.data(), int(m_linkSend.size()));
+}
+
+void CSimNetBoard::PushSegment(unsigned slot, const uint8_t* data)
+{
+	SegmentQueue& queue = m_segmentQueues[slot];
+	unsigned depth = m_frameDelay + 1;
+
+	// a machine that has got ahead of us would otherwise stretch the delay; drop its oldest segment instead
+	if (queue.count == depth)
+	{
+		queue.head = (queue.head + 1) % depth;
+		queue.count--;
+	}
+
+	memcpy(&queue.data[((queue.head + queue.count) % depth) * m_segmentSize], data, m_segmentSize);
+	queue.count++;
+}
+
+void CSimNetBoard::PopSegment(unsigned slot, uint8_t* dest)
+{
+	SegmentQueue& queue = m_segmentQueues[slot];
+
+	memcpy(dest, &queue.data[queue.head * m_segmentSize], m_segmentSize);
+	queue.head = (queue.head + 1) % (m_frameDelay + 1);
+	queue.count--;
+}
+
+void CSimNetBoard::StampMessage(void)
+{
+	uint32_t stamp[2] = { m_linkFrame, uint32_t(CThread::GetMicros() - m_frameStart) };
+	m_linkSend.assign((const uint8_t*)stamp, (const uint8_t*)stamp + stampSize);
+}
+
+void CSimNetBoard::SampleClock(const uint8_t* stamp, uint64_t arrival)
+{
+	uint32_t frame, phase;
+	memcpy(&frame, stamp, 4);
+	memcpy(&phase, stamp + 4, 4);
+
+	// when the previous machine's start of our current frame, one hop on, is seen here, relative to our start
+	int64_t error = int64_t(arrival - m_frameStart) - int64_t(phase) + int64_t(int32_t(m_linkFrame - frame)) * m_framePeriod;
+	m_clockError += (error - m_clockError) / 8;
+	m_clockSampled = true;
+}
+
+/*
+ * SyncClock():
+ *
+ * Every machine paces its frames by its own clock, so small differences
+ * between the clocks add up until machines stall waiting for each other's
+ * segments. From the frame number and send time each message carries, a
+ * machine knows when the previous machine in the ring starts its frames
+ * (plus a hop, which is as early as its data can be here) relative to its
+ * own. All but the master nudge their pacing toward that by a little every
+ * frame, so the ring settles on the master's frame clock and, with
+ * NetFrameDelay, segments are already waiting when they are needed.
+ */
+void CSimNetBoard::SyncClock(void)
+{
+	if (m_master || !m_clockSampled)
+		return;
+
+	m_clockSampled = false;
+	m_clockAdjust += int(std::clamp<int64_t>(m_clockError / 32, -maxClockNudge, maxClockNudge));
+}
+
+int CSimNetBoard::TakeClockAdjust(void)
+{
+	return m_clockAdjust.exchange(0);
+}
+
+void CSimNetBoard::ConnectProc(void)
+{
+	if (m_connected)
+		return;
+
+	printf("Connecting to %s:%i ..\n", addr_out.c_str(), port_out);
+
+	// wait until linked to both the next and the previous machine
+	while (!m_transport->Connect())
 	{
 		if (m_quit)
 			return;
@@ -24,9 +24,14 @@
 #define INCLUDED_SIMNETBOARD_H
 
 #include <cstdint>
-#include "TCPSend.h"
-#include "TCPReceive.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "INetTransport.h"
 #include "INetBoard.h"
+#include "SegmentCodec.h"
 
 enum class State
 {
@@ -73,6 +78,8 @@ public:
 	uint16_t ReadIORegister(unsigned reg);
 	void WriteIORegister(unsigned reg, uint16_t data);
 
+	int TakeClockAdjust(void);
+
 private:
 	// Config
 	const Util::Config::Node& m_config;
@@ -90,8 +97,40 @@ private:
 	std::atomic_bool m_quit = false;
 	std::atomic_bool m_connected = false;
 
-	std::unique_ptr<TCPSend> nets = nullptr;
-	std::unique_ptr<TCPReceive> netr = nullptr;
+	std::unique_ptr<INetTransport> m_transport = nullptr;
+	int m_frameBudget = -1;			// longest wait for link data per frame in ms (-1 = unlimited)
+	unsigned m_missedFrames = 0;	// consecutive frames in which no link data arrived in time
+	uint64_t m_latencyTotal = 0;	// hop latency in microseconds, accumulated for the debug log
+	uint64_t m_latencyMax = 0;
+	unsigned m_latencySamples = 0;
+
+	// delta-coded segments, see SegmentCodec
+	bool m_compress = false;
+	SegmentCodec m_codec;
+	std::vector<uint8_t> m_linkSend;
+	std::vector<uint8_t> m_linkReceive;
+
+	// pipelined link play, see PipelineFrame()
+	struct SegmentQueue
+	{
+		std::vector<uint8_t> data;	// room for m_frameDelay + 1 segments
+		unsigned head = 0;
+		unsigned count = 0;
+	};
+
+	unsigned m_frameDelay = 0;		// frames between a segment being sent and consumed (0 = relay within the frame)
+	unsigned m_pipeFrames = 0;		// frames run since the pipeline started
+	std::vector<SegmentQueue> m_segmentQueues;	// indexed by CommRAM slot
+	std::vector<uint8_t> m_pipeSegment;
+
+	// frame clock, see SyncClock()
+	bool m_master = false;
+	uint32_t m_linkFrame = 0;		// frames run since the link started
+	uint64_t m_frameStart = 0;		// CThread::GetMicros() when this frame's link work began
+	int64_t m_framePeriod = 16667;	// microseconds between frames, smoothed
+	int64_t m_clockError = 0;		// how long after our frame starts the previous machine's do, smoothed
+	bool m_clockSampled = false;	// m_clockError has had a sample this frame
+	std::atomic_int m_clockAdjust = 0;
 
 	Game m_gameInfo;
 	GameType m_gameType = GameType::unknown;
@@ -111,6 +150,17 @@ private:
 	bool m_commbank = false;
 
 	inline bool IsGame(const char* gameName);
+	void LinkBroken(void);
+	void CountFrame(bool received);
+	void StartLink(void);
+	void PipelineFrame(void);
+	bool ReceiveSegment(void);
+	void SendSegment(unsigned hops, const uint8_t* segment);
+	void PushSegment(unsigned slot, const uint8_t* data);
+	void PopSegment(unsigned slot, uint8_t* dest);
+	void StampMessage(void);
+	void SampleClock(const uint8_t* stamp, uint64_t arrival);
+	void SyncClock(void);
 	void ConnectProc(void);
 };
 
@@ -23,6 +23,9 @@
 #include "TCPReceive.h"
 #include "OSD/Logger.h"
 #include "OSD/Thread.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
 #if defined(_DEBUG)
 #include <cstdio>
@@ -31,10 +34,23 @@
 #define DPRINTF(a, ...)
 #endif
 
+static const size_t ringSize = 0x20000;		// power of 2, comfortably larger than a frame of segments
+static const uint32_t queueSize = 64;		// power of 2, messages the I/O thread can get ahead by
+static const uint32_t waitMS = 100;			// longest the I/O thread sleeps before checking whether to exit
+
 TCPReceive::TCPReceive(int port) :
 	m_listenSocket(nullptr),
 	m_receiveSocket(nullptr),
-	m_socketSet(nullptr)
+	m_socketSet(nullptr),
+	m_ring(ringSize),
+	m_ringHead(0),
+	m_ringTail(0),
+	m_lastArrival(0),
+	m_headerBytes(0),
+	m_messageBytes(0),
+	m_queue(queueSize),
+	m_queueHead(0),
+	m_queueTail(0)
 {
 	SDLNet_Init();
 
@@ -43,11 +59,12 @@ TCPReceive::TCPReceive(int port) :
 	IPaddress ip;
 	int result = SDLNet_ResolveHost(&ip, nullptr, port);
 
-	if (result == 0) {
+	if (result == 0 && m_socketSet) {
 		m_listenSocket = SDLNet_TCP_Open(&ip);
 		if (m_listenSocket) {
+			SDLNet_TCP_AddSocket(m_socketSet, m_listenSocket);
 			m_running = true;
-			m_listenThread = std::thread(&TCPReceive::ListenFunc, this);
+			m_ioThread = std::thread(&TCPReceive::IOFunc, this);
 		}
 	}
 }
@@ -56,8 +73,8 @@ TCPReceive::~TCPReceive()
 {
 	m_running = false;
 
-	if (m_listenThread.joinable()) {
-		m_listenThread.join();
+	if (m_ioThread.joinable()) {
+		m_ioThread.join();
 	}
 
 	if (m_listenSocket) {
@@ -80,73 +97,214 @@ TCPReceive::~TCPReceive()
 
 bool TCPReceive::CheckDataAvailable(int timeoutMS)
 {
-	if (!m_receiveSocket) {
-		return false;
+	return WaitMessage(timeoutMS);
+}
+
+std::vector<char>& TCPReceive::Receive()
+{
+	m_recBuffer.clear();
+
+	if (WaitMessage(-1)) {
+
+		uint32_t head = m_queueHead.load(std::memory_order_relaxed);
+		Message& message = m_queue[head & (queueSize - 1)];
+
+		// trade buffers with the queue rather than copy; both sides keep their capacity
+		m_recBuffer.swap(message.data);
+		m_recBuffer.resize(message.length);
+
+		m_queueHead.store(head + 1, std::memory_order_release);
 	}
 
-	return SDLNet_CheckSockets(m_socketSet, timeoutMS) > 0;
+	return m_recBuffer;
 }
 
-std::vector<char>& TCPReceive::Receive()
+int TCPReceive::Receive(void* dest, int capacity, uint64_t* arrivalMicros)
 {
-	if (!m_receiveSocket) {
-		DPRINTF("Can't receive because no socket.\n");
-		m_recBuffer.clear();
-		return m_recBuffer;
+	if (!WaitMessage(-1)) {
+		return 0;
 	}
 
-	int size = 0;
-	int result = SDLNet_TCP_Recv(m_receiveSocket, &size, sizeof(int));
-	DPRINTF("Received %i bytes\n", result);
-	if (result <= 0) {
-		SDLNet_TCP_Close(m_receiveSocket);
-		m_receiveSocket = nullptr;
+	uint32_t head = m_queueHead.load(std::memory_order_relaxed);
+	const Message& message = m_queue[head & (queueSize - 1)];
+
+	int size = message.length;
+	if (size) {
+		memcpy(dest, message.data.data(), std::min(size, capacity));
+	}
+
+	if (arrivalMicros) {
+		*arrivalMicros = message.arrival;
 	}
 
-	// reserve our space
-	m_recBuffer.resize(size);
+	m_queueHead.store(head + 1, std::memory_order_release);
 
-	while (size) {
+	return size;
+}
 
-		result = SDLNet_TCP_Recv(m_receiveSocket, m_recBuffer.data() + (m_recBuffer.size() - size), size);
-		DPRINTF("Received %i bytes\n", result);
-		if (result <= 0) {
-			SDLNet_TCP_Close(m_receiveSocket);
-			m_receiveSocket = nullptr;
-			break;
-		}
+bool TCPReceive::WaitMessage(int timeoutMS)
+{
+	// true once there's a message, or there never will be
+	auto ready = [this] {
+		return m_queueHead.load(std::memory_order_relaxed) != m_queueTail.load(std::memory_order_acquire) || !m_receiveSocket;
+	};
 
-		size -= result;
+	if (!ready() && timeoutMS != 0) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (timeoutMS < 0) {
+			m_cv.wait(lock, ready);
+		}
+		else {
+			m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMS), ready);
+		}
 	}
 
-	return m_recBuffer;
+	return m_queueHead.load(std::memory_order_relaxed) != m_queueTail.load(std::memory_order_acquire);
 }
 
-void TCPReceive::ListenFunc()
+void TCPReceive::IOFunc()
 {
 	while (m_running) {
 
-		CThread::Sleep(16);
-		if (m_receiveSocket) continue;
+		// the emulation thread is behind; leave the rest in the socket until it catches up
+		if (m_queueTail.load(std::memory_order_relaxed) - m_queueHead.load(std::memory_order_acquire) >= queueSize) {
+			CThread::Sleep(1);
+			Parse();
+			continue;
+		}
+
+		int result = SDLNet_CheckSockets(m_socketSet, waitMS);
+		if (result < 0) {
+			CThread::Sleep(waitMS);		// nothing in the set to wait on; shouldn't happen
+			continue;
+		}
+		if (result == 0) {
+			continue;
+		}
 
-		auto socket = SDLNet_TCP_Accept(m_listenSocket);
+		if (!m_receiveSocket) {
+			if (SDLNet_SocketReady(m_listenSocket)) {
+				Accept();
+			}
+		}
+		else if (SDLNet_SocketReady(m_receiveSocket.load())) {
+			if (Fill()) {
+				Parse();
+			}
+		}
+	}
+}
 
-		if (socket) {
+void TCPReceive::Accept()
+{
+	auto socket = SDLNet_TCP_Accept(m_listenSocket);
 
-			// remove old socket if required from socket set
-			if (m_receiveSocket) {
-				SDLNet_DelSocket(m_socketSet, (SDLNet_GenericSocket)m_receiveSocket.load());
+	if (socket) {
+
+		// only one connection at a time, so stop listening until it drops
+		SDLNet_TCP_DelSocket(m_socketSet, m_listenSocket);
+		SDLNet_TCP_AddSocket(m_socketSet, socket);
+
+		m_receiveSocket = socket;
+
+		DPRINTF("Accepted connection.\n");
+	}
+}
+
+bool TCPReceive::Fill()
+{
+	// read whatever is waiting, up to the end of the ring or the unparsed data
+	size_t offset = size_t(m_ringTail & (ringSize - 1));
+	size_t space = std::min(ringSize - offset, ringSize - size_t(m_ringTail - m_ringHead));
+
+	if (!space) {
+		return true;
+	}
+
+	int result = SDLNet_TCP_Recv(m_receiveSocket, m_ring.data() + offset, int(space));
+	DPRINTF("Received %i bytes\n", result);
+	if (result <= 0) {
+		Disconnect();
+		return false;
+	}
+
+	m_ringTail += result;
+	m_lastArrival = CThread::GetMicros();
+	return true;
+}
+
+void TCPReceive::Parse()
+{
+	// copies up to length bytes out of the ring, returning how many there were
+	auto read = [this](char* dest, int length) {
+		int total = 0;
+		while (total < length && m_ringHead != m_ringTail) {
+			size_t offset = size_t(m_ringHead & (ringSize - 1));
+			size_t chunk = std::min({ size_t(length - total), size_t(m_ringTail - m_ringHead), ringSize - offset });
+			memcpy(dest + total, m_ring.data() + offset, chunk);
+			m_ringHead += chunk;
+			total += int(chunk);
+		}
+		return total;
+	};
+
+	while (m_ringHead != m_ringTail) {
+
+		uint32_t tail = m_queueTail.load(std::memory_order_relaxed);
+		if (tail - m_queueHead.load(std::memory_order_acquire) >= queueSize) {
+			return;
+		}
+
+		Message& message = m_queue[tail & (queueSize - 1)];
+
+		// each message is prefixed with its length
+		if (m_headerBytes < int(sizeof(int))) {
+			m_headerBytes += read((char*)&message.length + m_headerBytes, int(sizeof(int)) - m_headerBytes);
+			if (m_headerBytes < int(sizeof(int))) {
+				return;
+			}
+			if (message.length < 0) {
+				Disconnect();
+				return;
 			}
+			if (message.data.size() < size_t(message.length)) {
+				message.data.resize(message.length);
+			}
+			m_messageBytes = 0;
+		}
 
-			m_receiveSocket = socket;
+		m_messageBytes += read(message.data.data() + m_messageBytes, message.length - m_messageBytes);
+		if (m_messageBytes < message.length) {
+			return;
+		}
 
-			SDLNet_AddSocket(m_socketSet, (SDLNet_GenericSocket)socket);
+		message.arrival = m_lastArrival;
+		m_headerBytes = 0;
 
-			// add socket to socket set
-			DPRINTF("Accepted connection.\n");
+		m_queueTail.store(tail + 1, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
 		}
+		m_cv.notify_one();
+	}
+}
+
+void TCPReceive::Disconnect()
+{
+	SDLNet_TCP_DelSocket(m_socketSet, m_receiveSocket.load());
+	SDLNet_TCP_Close(m_receiveSocket);
+
+	// anything left over belongs to the old connection
+	m_ringHead = m_ringTail = 0;
+	m_headerBytes = 0;
 
+	SDLNet_TCP_AddSocket(m_socketSet, m_listenSocket);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_receiveSocket = nullptr;
 	}
+	m_cv.notify_one();
 }
 
 bool TCPReceive::Connected()
@@ -25,9 +25,21 @@
 
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 #include "SDLIncludes.h"
 
+/*
+ * TCPReceive:
+ *
+ * Accepts the connection from the previous machine and reads its messages on
+ * a dedicated I/O thread, which sleeps in SDLNet_CheckSockets() until the
+ * socket has something for it. Complete messages are handed over through a
+ * single-producer, single-consumer queue, so receiving one that has already
+ * arrived costs the emulation thread a copy and no system calls.
+ */
 class TCPReceive
 {
 public:
@@ -36,18 +48,48 @@ public:
 
 	bool CheckDataAvailable(int timeoutMS = 0);		// timeoutMS -1 = wait forever until data arrives, 0 = no waiting, 1+ wait time in milliseconds
 	std::vector<char>& Receive();
+	int Receive(void* dest, int capacity, uint64_t* arrivalMicros = nullptr);	// reads straight into dest, dropping anything past capacity; returns the message length
 	bool Connected();
 
 private:
 
-	void ListenFunc();
+	struct Message
+	{
+		std::vector<char> data;		// reused from message to message; only ever grows
+		int length;
+		uint64_t arrival;			// CThread::GetMicros() when the last bytes came in
+	};
+
+	void IOFunc();
+	void Accept();
+	bool Fill();
+	void Parse();
+	void Disconnect();
+	bool WaitMessage(int timeoutMS);
 
 	TCPsocket m_listenSocket;
 	std::atomic<TCPsocket> m_receiveSocket;
 	SDLNet_SocketSet m_socketSet;
-	std::thread m_listenThread;
+	std::thread m_ioThread;
 	std::atomic_bool m_running;
 	std::vector<char> m_recBuffer;
+
+	// I/O thread only: read-ahead ring so that several messages usually arrive in one recv call
+	std::vector<char> m_ring;
+	uint64_t m_ringHead;		// next byte to parse
+	uint64_t m_ringTail;		// next byte to fill
+	uint64_t m_lastArrival;
+	int m_headerBytes;			// bytes of the current message's length prefix read so far
+	int m_messageBytes;			// bytes of the current message's body read so far
+
+	// completed messages; the I/O thread fills at the tail, the emulation thread drains at the head
+	std::vector<Message> m_queue;
+	std::atomic<uint32_t> m_queueHead;
+	std::atomic<uint32_t> m_queueTail;
+
+	// only used to sleep when the queue is empty
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "TCPTransport.h"
+
+TCPTransport::TCPTransport(std::string& ip, int portOut, int portIn) :
+	m_send(std::make_unique<TCPSend>(ip, portOut)),
+	m_receive(std::make_unique<TCPReceive>(portIn))
+{
+}
+
+bool TCPTransport::Connect()
+{
+	// connect out to the next machine first, then wait for the previous one to connect in
+	if (!m_send->Connected() && !m_send->Connect())
+		return false;
+
+	return m_receive->Connected();
+}
+
+bool TCPTransport::Connected()
+{
+	return m_send->Connected() && m_receive->Connected();
+}
+
+bool TCPTransport::Send(const void* data, int length)
+{
+	return m_send->Send(data, length);
+}
+
+bool TCPTransport::CheckDataAvailable(int timeoutMS)
+{
+	return m_receive->CheckDataAvailable(timeoutMS);
+}
+
+std::vector<char>& TCPTransport::Receive(int timeoutMS, bool* timedOut)
+{
+	// the stream can't skip a late message without losing its place, so always wait
+	if (timedOut)
+		*timedOut = false;
+
+	return m_receive->Receive();
+}
+
+int TCPTransport::Receive(void* dest, int capacity, int timeoutMS, bool* timedOut, uint64_t* arrivalMicros)
+{
+	if (timedOut)
+		*timedOut = false;
+
+	return m_receive->Receive(dest, capacity, arrivalMicros);
+}
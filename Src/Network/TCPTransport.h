@@ -0,0 +1,51 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _TCPTRANSPORT_H_
+#define _TCPTRANSPORT_H_
+
+#include <memory>
+#include <string>
+#include "INetTransport.h"
+#include "TCPSend.h"
+#include "TCPReceive.h"
+
+// One TCP connection out to the next machine and one in from the previous one
+class TCPTransport : public INetTransport
+{
+public:
+	TCPTransport(std::string& ip, int portOut, int portIn);
+
+	bool Connect();
+	bool Connected();
+	bool Send(const void* data, int length);
+	bool CheckDataAvailable(int timeoutMS = 0);
+	std::vector<char>& Receive(int timeoutMS = -1, bool* timedOut = nullptr);
+	int Receive(void* dest, int capacity, int timeoutMS = -1, bool* timedOut = nullptr, uint64_t* arrivalMicros = nullptr);
+
+private:
+
+	std::unique_ptr<TCPSend> m_send;
+	std::unique_ptr<TCPReceive> m_receive;
+};
+
+#endif
@@ -0,0 +1,402 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "UDPTransport.h"
+#include "OSD/Logger.h"
+#include "OSD/Thread.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+#if defined(_DEBUG)
+#include <cstdio>
+#define DPRINTF DebugLog
+#else
+#define DPRINTF(a, ...)
+#endif
+
+static const uint16_t	packetMagic		= 0x4c53;	// "SL"
+static const int		maxPacketSize	= 65507;	// largest UDP payload
+static const int		mtuPacketSize	= 1400;		// redundant copies are only added up to this size
+static const uint32_t	resendMS		= 2;
+static const uint32_t	helloMS			= 100;
+static const uint32_t	linkTimeoutMS	= 5000;		// how long an unbounded wait lasts before the link is declared broken
+static const size_t		maxUnacked		= 256;
+
+struct PacketHeader
+{
+	uint16_t magic;
+	uint8_t type;
+	uint8_t count;		// number of messages that follow (data only)
+	uint32_t session;
+	uint32_t seq;		// data: newest message in the packet; ack: next message expected
+	uint32_t base;		// data: oldest message the sender still holds
+};
+
+// sequence numbers wrap, so compare them by distance
+static inline int32_t SeqDiff(uint32_t a, uint32_t b)
+{
+	return int32_t(a - b);
+}
+
+UDPTransport::UDPTransport(std::string& ip, int portOut, int portIn, int redundancy) :
+	m_ip(ip),
+	m_portOut(portOut),
+	m_redundancy(std::min(std::max(redundancy, 1), 255)),
+	m_socket(nullptr),
+	m_socketSet(nullptr),
+	m_inPacket(nullptr),
+	m_outPacket(nullptr),
+	m_resolved(false),
+	m_lastHello(0),
+	m_nextLinked(false),
+	m_prevLinked(false),
+	m_broken(false),
+	m_sendSeq(0),
+	m_lastSend(0),
+	m_prevSession(0),
+	m_synced(false),
+	m_recvSeq(0)
+{
+	SDLNet_Init();
+
+	// a fresh session lets the next machine tell a restart from a stale datagram
+	m_session = std::random_device()() | 1;
+
+	m_socket = SDLNet_UDP_Open(portIn);
+	m_socketSet = SDLNet_AllocSocketSet(1);
+	m_inPacket = SDLNet_AllocPacket(maxPacketSize);
+	m_outPacket = SDLNet_AllocPacket(maxPacketSize);
+
+	if (m_socket && m_socketSet)
+		SDLNet_UDP_AddSocket(m_socketSet, m_socket);
+	else
+		ErrorLog("Unable to open UDP port %i for the net board.", portIn);
+}
+
+UDPTransport::~UDPTransport()
+{
+	if (m_outPacket)
+		SDLNet_FreePacket(m_outPacket);
+	if (m_inPacket)
+		SDLNet_FreePacket(m_inPacket);
+	if (m_socketSet)
+		SDLNet_FreeSocketSet(m_socketSet);
+	if (m_socket)
+		SDLNet_UDP_Close(m_socket);
+
+	SDLNet_Quit();
+}
+
+bool UDPTransport::Connect()
+{
+	if (!m_socket || !m_socketSet || !m_inPacket || !m_outPacket)
+		return false;
+
+	if (!m_resolved)
+	{
+		if (SDLNet_ResolveHost(&m_next, m_ip.c_str(), m_portOut) != 0)
+			return false;
+		m_resolved = true;
+	}
+
+	// keep announcing ourselves until the next machine answers
+	uint32_t now = SDL_GetTicks();
+	if (!m_nextLinked && (m_lastHello == 0 || now - m_lastHello >= helloMS))
+	{
+		SendHeader(PacketType::hello, 0, 0, m_next);
+		m_lastHello = now;
+	}
+
+	Poll(0);
+
+	return m_nextLinked && m_prevLinked;
+}
+
+bool UDPTransport::Connected()
+{
+	return m_nextLinked && m_prevLinked && !m_broken;
+}
+
+bool UDPTransport::Send(const void* data, int length)
+{
+	if (!Connected() || length < 0 || length > maxPacketSize - int(sizeof(PacketHeader) + sizeof(uint16_t)))
+		return false;
+
+	DPRINTF("Sending %i bytes\n", length);
+
+	if (m_unacked.size() >= maxUnacked)
+		m_unacked.pop_front();		// the next machine has stopped acknowledging; give up on the oldest
+
+	m_unacked.push_back({ m_sendSeq, std::vector<char>((const char*)data, (const char*)data + length) });
+	SendData(m_sendSeq);
+	m_sendSeq++;
+
+	return true;
+}
+
+bool UDPTransport::CheckDataAvailable(int timeoutMS)
+{
+	if (HasMessage())
+		return true;
+
+	uint32_t start = SDL_GetTicks();
+	do
+	{
+		uint32_t elapsed = SDL_GetTicks() - start;
+		int wait = timeoutMS < 0 ? int(resendMS) : std::min<int>(resendMS, timeoutMS - int(elapsed));
+		Poll(wait > 0 ? wait : 0);
+		if (HasMessage())
+			return true;
+	} while (!m_broken && (timeoutMS < 0 || SDL_GetTicks() - start < uint32_t(timeoutMS)));
+
+	return false;
+}
+
+std::vector<char>& UDPTransport::Receive(int timeoutMS, bool* timedOut)
+{
+	m_recBuffer.clear();
+
+	if (WaitMessage(timeoutMS, timedOut))
+	{
+		m_recBuffer.swap(m_pending.find(m_recvSeq)->second.payload);
+		NextMessage();
+	}
+
+	return m_recBuffer;
+}
+
+int UDPTransport::Receive(void* dest, int capacity, int timeoutMS, bool* timedOut, uint64_t* arrivalMicros)
+{
+	if (!WaitMessage(timeoutMS, timedOut))
+		return 0;
+
+	const Arrival& message = m_pending.find(m_recvSeq)->second;
+	int size = int(message.payload.size());
+	if (size)
+		memcpy(dest, message.payload.data(), std::min(size, capacity));
+	if (arrivalMicros)
+		*arrivalMicros = message.micros;
+
+	NextMessage();
+	return size;
+}
+
+bool UDPTransport::WaitMessage(int timeoutMS, bool* timedOut)
+{
+	if (timedOut)
+		*timedOut = false;
+
+	uint32_t start = SDL_GetTicks();
+	uint32_t limit = timeoutMS < 0 ? linkTimeoutMS : uint32_t(timeoutMS);
+	while (!m_broken)
+	{
+		if (HasMessage())
+			return true;
+
+		uint32_t elapsed = SDL_GetTicks() - start;
+		if (elapsed >= limit)
+		{
+			if (timeoutMS < 0)
+			{
+				ErrorLog("Net board link timed out.");
+				m_broken = true;
+				break;
+			}
+
+			// skip the late message so that the next one lines up with the sender
+			if (m_synced)
+			{
+				m_recvSeq++;
+				m_pending.erase(m_pending.begin(), m_pending.lower_bound(m_recvSeq));
+			}
+			if (timedOut)
+				*timedOut = true;
+			break;
+		}
+
+		Poll(int(std::min(limit - elapsed, resendMS)));
+	}
+
+	return false;
+}
+
+void UDPTransport::NextMessage()
+{
+	auto it = m_pending.find(m_recvSeq);
+	DPRINTF("Received %i bytes\n", int(it->second.payload.size()));
+
+	// an empty message means the link is broken further up the ring
+	if (it->second.payload.empty())
+		m_broken = true;
+
+	m_pending.erase(it);
+	m_recvSeq++;
+}
+
+bool UDPTransport::HasMessage()
+{
+	return m_synced && m_pending.count(m_recvSeq) != 0;
+}
+
+void UDPTransport::Poll(int timeoutMS)
+{
+	if (!m_socket || !m_socketSet)
+		return;
+
+	if (SDLNet_CheckSockets(m_socketSet, timeoutMS) > 0)
+	{
+		while (SDLNet_UDP_Recv(m_socket, m_inPacket) > 0)
+			HandlePacket();
+	}
+
+	// resend whatever the next machine hasn't acknowledged yet, oldest first
+	if (!m_unacked.empty() && SDL_GetTicks() - m_lastSend >= resendMS)
+		SendData(m_unacked.front().seq + std::min<uint32_t>(m_redundancy, uint32_t(m_unacked.size())) - 1);
+}
+
+void UDPTransport::HandlePacket()
+{
+	PacketHeader header;
+	if (m_inPacket->len < int(sizeof(header)))
+		return;
+	memcpy(&header, m_inPacket->data, sizeof(header));
+	if (header.magic != packetMagic)
+		return;
+
+	switch (PacketType(header.type))
+	{
+	case PacketType::hello:
+		// a new session from the previous machine restarts its sequence
+		if (header.session != m_prevSession)
+		{
+			m_prevSession = header.session;
+			m_synced = false;
+			m_pending.clear();
+		}
+		m_prevLinked = true;
+		SendHeader(PacketType::helloAck, 0, 0, m_inPacket->address);
+		break;
+
+	case PacketType::helloAck:
+		if (header.session == m_session)
+			m_nextLinked = true;
+		break;
+
+	case PacketType::data:
+	{
+		if (header.session != m_prevSession)
+			break;
+
+		if (!m_synced)
+		{
+			m_recvSeq = header.base;
+			m_synced = true;
+		}
+
+		// messages run from newest to oldest
+		uint64_t arrival = CThread::GetMicros();
+		const uint8_t* p = m_inPacket->data + sizeof(header);
+		const uint8_t* end = m_inPacket->data + m_inPacket->len;
+		uint32_t seq = header.seq;
+		for (int i = 0; i < header.count; i++, seq--)
+		{
+			uint16_t length;
+			if (end - p < int(sizeof(length)))
+				break;
+			memcpy(&length, p, sizeof(length));
+			p += sizeof(length);
+			if (end - p < length)
+				break;
+			if (SeqDiff(seq, m_recvSeq) >= 0 && m_pending.count(seq) == 0)
+				m_pending[seq] = { std::vector<char>(p, p + length), arrival };
+			p += length;
+		}
+
+		SendAck(m_inPacket->address);
+		break;
+	}
+
+	case PacketType::ack:
+		if (header.session != m_session)
+			break;
+		while (!m_unacked.empty() && SeqDiff(header.seq, m_unacked.front().seq) > 0)
+			m_unacked.pop_front();
+		break;
+	}
+}
+
+void UDPTransport::SendHeader(PacketType type, uint32_t seq, uint32_t base, const IPaddress& address)
+{
+	PacketHeader header = { packetMagic, uint8_t(type), 0, m_session, seq, base };
+
+	// acknowledgements carry the session they answer
+	if (type == PacketType::helloAck || type == PacketType::ack)
+		header.session = m_prevSession;
+
+	memcpy(m_outPacket->data, &header, sizeof(header));
+	m_outPacket->len = sizeof(header);
+	m_outPacket->address = address;
+	SDLNet_UDP_Send(m_socket, -1, m_outPacket);
+}
+
+void UDPTransport::SendData(uint32_t newestSeq)
+{
+	if (m_unacked.empty())
+		return;
+
+	// newestSeq and as many of the unacknowledged messages before it as fit
+	uint32_t first = m_unacked.front().seq;
+	size_t newest = size_t(SeqDiff(newestSeq, first));
+	size_t size = sizeof(PacketHeader);
+	uint8_t count = 0;
+	for (size_t i = newest + 1; i-- > 0 && count < m_redundancy; )
+	{
+		size_t messageSize = sizeof(uint16_t) + m_unacked[i].payload.size();
+		if (count > 0 && size + messageSize > size_t(mtuPacketSize))
+			break;
+		uint16_t length = uint16_t(m_unacked[i].payload.size());
+		memcpy(m_outPacket->data + size, &length, sizeof(length));
+		if (length)
+			memcpy(m_outPacket->data + size + sizeof(length), m_unacked[i].payload.data(), length);
+		size += messageSize;
+		count++;
+	}
+
+	PacketHeader header = { packetMagic, uint8_t(PacketType::data), count, m_session, newestSeq, first };
+	memcpy(m_outPacket->data, &header, sizeof(header));
+	m_outPacket->len = int(size);
+	m_outPacket->address = m_next;
+	SDLNet_UDP_Send(m_socket, -1, m_outPacket);
+
+	m_lastSend = SDL_GetTicks();
+}
+
+void UDPTransport::SendAck(const IPaddress& address)
+{
+	// everything before the first message still missing has arrived
+	uint32_t next = m_recvSeq;
+	while (m_pending.count(next))
+		next++;
+
+	SendHeader(PacketType::ack, next, 0, address);
+}
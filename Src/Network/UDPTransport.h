@@ -0,0 +1,117 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _UDPTRANSPORT_H_
+#define _UDPTRANSPORT_H_
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "INetTransport.h"
+#include "SDLIncludes.h"
+
+/*
+ * UDPTransport:
+ *
+ * Sends messages to the next machine as sequence-numbered datagrams over a
+ * single socket bound to the incoming port. Each datagram repeats the most
+ * recent unacknowledged messages (up to the redundancy count) so that a lost
+ * datagram is usually covered by the next one. The receiver acknowledges
+ * what it has, and anything still unacknowledged is resent while waiting.
+ */
+class UDPTransport : public INetTransport
+{
+public:
+	UDPTransport(std::string& ip, int portOut, int portIn, int redundancy);
+	~UDPTransport();
+
+	bool Connect();
+	bool Connected();
+	bool Send(const void* data, int length);
+	bool CheckDataAvailable(int timeoutMS = 0);
+	std::vector<char>& Receive(int timeoutMS = -1, bool* timedOut = nullptr);
+	int Receive(void* dest, int capacity, int timeoutMS = -1, bool* timedOut = nullptr, uint64_t* arrivalMicros = nullptr);
+
+private:
+
+	enum class PacketType : uint8_t
+	{
+		hello,		// announces a session to the next machine
+		helloAck,
+		data,
+		ack
+	};
+
+	struct Message
+	{
+		uint32_t seq;
+		std::vector<char> payload;
+	};
+
+	struct Arrival
+	{
+		std::vector<char> payload;
+		uint64_t micros;		// CThread::GetMicros() when the first copy landed
+	};
+
+	void Poll(int timeoutMS);
+	void HandlePacket();
+	void SendHeader(PacketType type, uint32_t seq, uint32_t base, const IPaddress& address);
+	void SendData(uint32_t newestSeq);
+	void SendAck(const IPaddress& address);
+	bool HasMessage();
+	bool WaitMessage(int timeoutMS, bool* timedOut);
+	void NextMessage();
+
+	std::string		m_ip;
+	int				m_portOut;
+	int				m_redundancy;
+	UDPsocket		m_socket;
+	SDLNet_SocketSet m_socketSet;
+	UDPpacket*		m_inPacket;
+	UDPpacket*		m_outPacket;
+	IPaddress		m_next;
+	bool			m_resolved;
+	uint32_t		m_session;
+	uint32_t		m_lastHello;
+
+	// link state
+	bool			m_nextLinked;
+	bool			m_prevLinked;
+	bool			m_broken;
+
+	// sending side: messages not yet acknowledged by the next machine
+	uint32_t		m_sendSeq;
+	std::deque<Message> m_unacked;
+	uint32_t		m_lastSend;
+
+	// receiving side: messages that arrived ahead of the one expected next
+	uint32_t		m_prevSession;
+	bool			m_synced;
+	uint32_t		m_recvSeq;
+	std::map<uint32_t, Arrival> m_pending;
+	std::vector<char> m_recBuffer;
+};
+
+#endif
@@ -53,6 +53,22 @@ extern Result OpenAudio(const Util::Config::Node& config);
  */
 extern bool OutputAudio(unsigned numSamples, const float* leftFrontBuffer, const float* rightFrontBuffer, const float* leftRearBuffer, const float* rightRearBuffer, bool flipStereo);
 
+/*
+ * GetAudioBufferFill()
+ *
+ * Returns how full the audio buffer is, from 0 (empty) to 1 (at latency limit).
+ * May be called from any thread.
+ */
+extern float GetAudioBufferFill();
+
+/*
+ * GetAudioUnderRuns()
+ *
+ * Returns how many times the audio buffer has run dry since audio was opened.
+ * May be called from any thread.
+ */
+extern unsigned GetAudioUnderRuns();
+
 /*
  * CloseAudio()
  *
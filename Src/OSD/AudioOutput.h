@@ -0,0 +1,87 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * AudioOutput.h
+ *
+ * Interface to the native audio output backends (WASAPI on Windows, ALSA on
+ * Linux, Core Audio on macOS). SDL's audio callback runs on large, fixed
+ * buffers; a native backend drives the device directly with small periods and
+ * refills it from the audio ring buffer whenever the device asks for more.
+ * SDL audio remains the fallback if there is no backend or it fails to open.
+ */
+
+#ifndef INCLUDED_AUDIOOUTPUT_H
+#define INCLUDED_AUDIOOUTPUT_H
+
+#include "Types.h"
+
+class CAudioOutput
+{
+public:
+  /*
+   * Called on the backend's playback thread to fill dest with the given
+   * number of interleaved sample frames.
+   */
+  typedef void (*PullFPtr)(void *dest, unsigned numSamples);
+
+  virtual ~CAudioOutput()
+  {
+  }
+
+  /*
+   * Open():
+   *
+   * Opens the default output device with exactly the given format (16-bit
+   * integer or 32-bit float samples) and a period as close to periodSamples
+   * as the device allows. Returns false if the device cannot be opened this
+   * way, in which case the caller falls back to SDL.
+   */
+  virtual bool Open(unsigned sampleRate, unsigned channels, bool floatSamples, unsigned periodSamples, PullFPtr pull) = 0;
+
+  /*
+   * Start():
+   *
+   * Starts playback. pull will be called from now until Close().
+   */
+  virtual bool Start() = 0;
+
+  virtual void Close() = 0;
+
+  /*
+   * GetPeriod():
+   *
+   * Returns the period negotiated with the device, in sample frames.
+   */
+  virtual unsigned GetPeriod() const = 0;
+
+  virtual const char *GetName() const = 0;
+};
+
+/*
+ * CreateNativeAudioOutput():
+ *
+ * Returns the native backend for this platform, or nullptr if this build has
+ * none. Implemented by the platform's backend.
+ */
+extern CAudioOutput *CreateNativeAudioOutput();
+
+#endif  // INCLUDED_AUDIOOUTPUT_H
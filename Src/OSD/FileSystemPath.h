@@ -32,9 +32,10 @@
 
 namespace FileSystemPath
 {
-    enum PathType { Analysis, Config, Log, NVRAM, Saves, Screenshots, Assets }; // Filesystem path types
+    enum PathType { Analysis, Config, Log, NVRAM, Saves, Screenshots, Assets, Cache }; // Filesystem path types
     bool PathExists(std::string fileSystemPath); // Checks if a directory exists (returns true if exists, false if it doesn't)
     std::string GetPath(PathType pathType);  // Generates a path to be used by Supermodel files
+    std::string GetTempFilePath(const std::string &filePath); // Name, unique to this process, under which to write a file before renaming it to filePath
 }
 
 
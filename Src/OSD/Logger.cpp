@@ -21,11 +21,15 @@
  **/
 
 #include "OSD/Logger.h"
+#include <algorithm>
+#include <chrono>
 #include <set>
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
 #else
 #include <syslog.h>
+#include <unistd.h>
 #endif
 
 
@@ -236,15 +240,7 @@ void CFileLogger::DebugLog(const char *fmt, va_list vl)
     return;
   }
 
-  char string1[4096];
-  char string2[4096];
-
-  vsnprintf(string1, sizeof(string1), fmt, vl);
-  snprintf(string2, sizeof(string2), "[Debug] %s", string1);
-
-  // Debug logging is so copious that we don't bother to guarantee it is saved
-  std::unique_lock<std::mutex> lock(m_mtx);
-  WriteToFiles(string2);
+  Log("[Debug] ", false, fmt, vl);
 }
 
 void CFileLogger::InfoLog(const char *fmt, va_list vl)
@@ -254,16 +250,7 @@ void CFileLogger::InfoLog(const char *fmt, va_list vl)
     return;
   }
 
-  char string1[4096];
-  char string2[4096];
-
-  vsnprintf(string1, sizeof(string1), fmt, vl);
-  snprintf(string2, sizeof(string2), "[Info]  %s\n", string1);
-
-  // Write to file, close, and reopen to ensure it was saved
-  std::unique_lock<std::mutex> lock(m_mtx);
-  WriteToFiles(string2);
-  ReopenFiles(std::ios::app);
+  Log("[Info]  ", true, fmt, vl);
 }
 
 void CFileLogger::ErrorLog(const char *fmt, va_list vl)
@@ -273,43 +260,157 @@ void CFileLogger::ErrorLog(const char *fmt, va_list vl)
     return;
   }
 
-  char string1[4096];
-  char string2[4096];
+  Log("[Error] ", true, fmt, vl);
+}
 
-  vsnprintf(string1, sizeof(string1), fmt, vl);
-  snprintf(string2, sizeof(string2), "[Error] %s\n", string1);
+void CFileLogger::Log(const char *prefix, bool newline, const char *fmt, va_list vl)
+{
+  // Rate limit before doing any formatting. Threads racing at the turn of a
+  // second may let a few extra messages through, which doesn't matter.
+  int64_t second = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  if (m_rateSecond.load(std::memory_order_relaxed) != second)
+  {
+    m_rateSecond.store(second, std::memory_order_relaxed);
+    m_rateCount.store(0, std::memory_order_relaxed);
+  }
+  if (m_rateCount.fetch_add(1, std::memory_order_relaxed) >= MAX_RECORDS_PER_SECOND)
+  {
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Claim a free record, giving up if the writer has fallen a full ring behind
+  uint32_t pos = m_writePos.load(std::memory_order_relaxed);
+  Record *record;
+  while (true)
+  {
+    record = &m_records[pos & (NUM_RECORDS - 1)];
+    int32_t diff = int32_t(record->sequence.load(std::memory_order_acquire) - pos);
+    if (diff == 0)
+    {
+      if (m_writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+    {
+      pos = m_writePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Format the message, always leaving room for the newline
+  size_t prefixLen = strlen(prefix);
+  memcpy(record->text, prefix, prefixLen);
+  int len = vsnprintf(record->text + prefixLen, RECORD_SIZE - prefixLen - 1, fmt, vl);
+  size_t end = prefixLen + std::min<size_t>(std::max(len, 0), RECORD_SIZE - prefixLen - 2);
+  if (newline)
+  {
+    record->text[end++] = '\n';
+  }
+  record->text[end] = '\0';
+
+  record->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void CFileLogger::RunWriter()
+{
+  auto lastSync = std::chrono::steady_clock::now();
+  while (true)
+  {
+    bool stopping = m_stop.load(std::memory_order_acquire);
+    bool wrote = Drain();
+    if (wrote)
+    {
+      for (FILE *fp: m_logFiles)
+        fflush(fp);
+      for (FILE *fp: m_systemFiles)
+        fflush(fp);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastSync >= std::chrono::seconds(1) || stopping)
+    {
+      ReportRepeats();
+      SyncFiles();
+      lastSync = now;
+    }
 
-  // Write to file, close, and reopen to ensure it was saved
-  std::unique_lock<std::mutex> lock(m_mtx);
-  WriteToFiles(string2);
-  ReopenFiles(std::ios::app);
+    if (stopping)
+      break;
+    if (!wrote)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
 }
 
-void CFileLogger::ReopenFiles(std::ios_base::openmode mode)
+bool CFileLogger::Drain()
 {
-  // Close existing
-  for (std::ofstream &ofs: m_logFiles)
+  bool wrote = false;
+  while (true)
+  {
+    Record &record = m_records[m_readPos & (NUM_RECORDS - 1)];
+    if (record.sequence.load(std::memory_order_acquire) != m_readPos + 1)
+      break;
+
+    if (m_lastMessage == record.text)
+    {
+      m_repeats++;
+    }
+    else
+    {
+      ReportRepeats();
+      WriteToFiles(record.text);
+      m_lastMessage = record.text;
+      wrote = true;
+    }
+
+    record.sequence.store(m_readPos + NUM_RECORDS, std::memory_order_release);
+    m_readPos++;
+  }
+
+  uint32_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0)
   {
-    ofs.close();
+    ReportRepeats();
+    char string[128];
+    snprintf(string, sizeof(string), "[Info]  %u log messages discarded because too many were logged\n", dropped);
+    WriteToFiles(string);
+    m_lastMessage.clear();
+    wrote = true;
   }
-  m_logFiles.clear();
+  return wrote;
+}
 
-  // (Re-)Open
+void CFileLogger::ReportRepeats()
+{
+  if (m_repeats == 0)
+    return;
+  char string[128];
+  snprintf(string, sizeof(string), "[Info]  Last message repeated %u times\n", m_repeats);
+  WriteToFiles(string);
+  m_repeats = 0;
+}
+
+void CFileLogger::OpenFiles()
+{
   for (const auto &filename: m_logFilenames)
   {
-    std::ofstream ofs(filename.c_str(), mode);
-    if (ofs.is_open() && ofs.good())
+    FILE *fp = fopen(filename.c_str(), "w");
+    if (fp != nullptr)
     {
-      m_logFiles.emplace_back(std::move(ofs));
+      m_logFiles.push_back(fp);
     }
   }
 }
 
 void CFileLogger::WriteToFiles(const char *str)
 {
-  for (std::ofstream &ofs: m_logFiles)
+  for (FILE *fp: m_logFiles)
   {
-    ofs << str;
+    fputs(str, fp);
   }
 
   for (FILE *fp: m_systemFiles)
@@ -318,19 +419,54 @@ void CFileLogger::WriteToFiles(const char *str)
   }
 }
 
+void CFileLogger::SyncFiles()
+{
+  for (FILE *fp: m_logFiles)
+  {
+    fflush(fp);
+#ifdef _WIN32
+    _commit(_fileno(fp));
+#else
+    fsync(fileno(fp));
+#endif
+  }
+}
+
 CFileLogger::CFileLogger(CLogger::LogLevel level, const std::vector<std::string> &filenames)
-  : m_logLevel(level),
-    m_logFilenames(filenames)
+  : CFileLogger(level, filenames, std::vector<FILE *>())
 {
-  ReopenFiles(std::ios::out);
 }
 
 CFileLogger::CFileLogger(CLogger::LogLevel level, const std::vector<std::string> &filenames, const std::vector<FILE *> &systemFiles)
   : m_logLevel(level),
     m_logFilenames(filenames),
-    m_systemFiles(systemFiles)
+    m_systemFiles(systemFiles),
+    m_records(new Record[NUM_RECORDS]),
+    m_writePos(0),
+    m_readPos(0),
+    m_rateSecond(0),
+    m_rateCount(0),
+    m_dropped(0),
+    m_stop(false),
+    m_repeats(0)
 {
-  ReopenFiles(std::ios::out);
+  for (unsigned i = 0; i < NUM_RECORDS; i++)
+  {
+    m_records[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  OpenFiles();
+  m_writer = std::thread(&CFileLogger::RunWriter, this);
+}
+
+CFileLogger::~CFileLogger()
+{
+  // Writer drains whatever is left before exiting
+  m_stop.store(true, std::memory_order_release);
+  m_writer.join();
+  for (FILE *fp: m_logFiles)
+  {
+    fclose(fp);
+  }
 }
 
 /*
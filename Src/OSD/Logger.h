@@ -33,12 +33,15 @@
 #include "Types.h"
 #include "Version.h"
 #include "Util/NewConfig.h"
+#include <atomic>
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 
@@ -173,9 +176,16 @@ class CConsoleErrorLogger: public CLogger
 /*
  * CFileLogger:
  *
- * Default logger that logs to debug and error log files. Files are opened and
- * closed for each message in order to preserve contents in case of program
- * crash.
+ * Default logger that logs to debug and error log files. Messages are
+ * formatted by the calling thread into a lock-free ring and written out by a
+ * separate writer thread, so logging never waits on the disk. The files are
+ * flushed after every batch of messages and synced to disk every second in
+ * order to preserve contents in case of program crash.
+ *
+ * To keep a flood of messages from swamping the log, at most
+ * MAX_RECORDS_PER_SECOND messages are accepted each second, identical
+ * consecutive messages are collapsed into a repeat count, and the number of
+ * messages discarded is noted in the log.
  */
 class CFileLogger: public CLogger
 {
@@ -185,16 +195,47 @@ public:
   void ErrorLog(const char *fmt, va_list vl);
   CFileLogger(LogLevel level, const std::vector<std::string> &filenames);
   CFileLogger(LogLevel level, const std::vector<std::string> &filenames, const std::vector<FILE *> &systemFiles);
+  ~CFileLogger();
 
 private:
-  std::mutex m_mtx; // needed because we may close/reopen files and logging must be thread-safe
+  static const unsigned NUM_RECORDS = 1024;           // must be a power of 2
+  static const unsigned RECORD_SIZE = 512;            // longer messages are truncated
+  static const unsigned MAX_RECORDS_PER_SECOND = 200;
+
+  struct Record
+  {
+    std::atomic<uint32_t> sequence; // equals the write position it is free for, or that plus 1 once written
+    char text[RECORD_SIZE];
+  };
+
   LogLevel m_logLevel;
   const std::vector<std::string> m_logFilenames;
-  std::vector<std::ofstream> m_logFiles;
+  std::vector<FILE *> m_logFiles;
   std::vector<FILE *> m_systemFiles;
 
-  void ReopenFiles(std::ios_base::openmode mode);
+  // Ring of formatted messages, written by any thread and read by the writer thread
+  std::unique_ptr<Record[]> m_records;
+  std::atomic<uint32_t> m_writePos;
+  uint32_t m_readPos;
+
+  // Rate limiting
+  std::atomic<int64_t> m_rateSecond;
+  std::atomic<uint32_t> m_rateCount;
+  std::atomic<uint32_t> m_dropped;
+
+  // Writer thread state
+  std::atomic<bool> m_stop;
+  std::thread m_writer;
+  std::string m_lastMessage;
+  unsigned m_repeats;
+
+  void Log(const char *prefix, bool newline, const char *fmt, va_list vl);
+  void RunWriter();
+  bool Drain();
+  void ReportRepeats();
+  void OpenFiles();
   void WriteToFiles(const char *str);
+  void SyncFiles();
 };
 
 /*
@@ -0,0 +1,170 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * CoreAudioOutput.cpp
+ *
+ * Core Audio output backend. The default output unit renders on Core Audio's
+ * own real-time I/O thread, which calls back for each I/O cycle, so only the
+ * device's I/O buffer size needs to be brought down to the requested period.
+ * The buffer size is a device-wide setting; Core Audio uses the smallest one
+ * asked for by any application.
+ */
+
+#include "OSD/AudioOutput.h"
+#include "Supermodel.h"
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <CoreAudio/CoreAudio.h>
+
+class CCoreAudioOutput : public CAudioOutput
+{
+public:
+  CCoreAudioOutput()
+    : m_unit(nullptr),
+      m_initialized(false),
+      m_pull(nullptr),
+      m_period(0)
+  {
+  }
+
+  ~CCoreAudioOutput()
+  {
+    Close();
+  }
+
+  bool Open(unsigned sampleRate, unsigned channels, bool floatSamples, unsigned periodSamples, PullFPtr pull) override
+  {
+    AudioComponentDescription desc = {};
+    desc.componentType = kAudioUnitType_Output;
+    desc.componentSubType = kAudioUnitSubType_DefaultOutput;
+    desc.componentManufacturer = kAudioUnitManufacturer_Apple;
+    AudioComponent component = AudioComponentFindNext(nullptr, &desc);
+    OSStatus status = component ? AudioComponentInstanceNew(component, &m_unit) : OSStatus(kAudio_UnimplementedError);
+    if (status != noErr)
+    {
+      m_unit = nullptr;
+      ErrorLog("Unable to open Core Audio output unit (error %d).\n", int(status));
+      return false;
+    }
+
+    // The output unit converts to the device's format if it differs
+    UInt32 bytesPerSample = channels * (floatSamples ? sizeof(float) : sizeof(INT16));
+    AudioStreamBasicDescription format = {};
+    format.mSampleRate = sampleRate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = (floatSamples ? kAudioFormatFlagIsFloat : kAudioFormatFlagIsSignedInteger) | kAudioFormatFlagIsPacked;
+    format.mBytesPerPacket = bytesPerSample;
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = bytesPerSample;
+    format.mChannelsPerFrame = channels;
+    format.mBitsPerChannel = floatSamples ? 32 : 16;
+    status = AudioUnitSetProperty(m_unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &format, sizeof(format));
+
+    AURenderCallbackStruct callback = { Render, this };
+    if (status == noErr)
+      status = AudioUnitSetProperty(m_unit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &callback, sizeof(callback));
+    if (status != noErr)
+    {
+      ErrorLog("Unable to configure Core Audio output unit (error %d).\n", int(status));
+      Close();
+      return false;
+    }
+
+    // Shrink the device's I/O buffer to the period and read back what it settled on
+    AudioDeviceID device = kAudioObjectUnknown;
+    UInt32 size = sizeof(device);
+    UInt32 frames = periodSamples;
+    AudioObjectPropertyAddress address = { kAudioDevicePropertyBufferFrameSize, kAudioObjectPropertyScopeGlobal, 0 };
+    if (AudioUnitGetProperty(m_unit, kAudioOutputUnitProperty_CurrentDevice, kAudioUnitScope_Global, 0, &device, &size) == noErr)
+    {
+      AudioObjectSetPropertyData(device, &address, 0, nullptr, sizeof(frames), &frames);
+      size = sizeof(frames);
+      AudioObjectGetPropertyData(device, &address, 0, nullptr, &size, &frames);
+    }
+
+    status = AudioUnitInitialize(m_unit);
+    if (status != noErr)
+    {
+      ErrorLog("Unable to initialize Core Audio output unit (error %d).\n", int(status));
+      Close();
+      return false;
+    }
+    m_initialized = true;
+
+    m_pull = pull;
+    m_period = frames;
+    return true;
+  }
+
+  bool Start() override
+  {
+    OSStatus status = AudioOutputUnitStart(m_unit);
+    if (status != noErr)
+    {
+      ErrorLog("Unable to start Core Audio playback (error %d).\n", int(status));
+      return false;
+    }
+    return true;
+  }
+
+  void Close() override
+  {
+    if (m_unit)
+    {
+      AudioOutputUnitStop(m_unit);
+      if (m_initialized)
+        AudioUnitUninitialize(m_unit);
+      AudioComponentInstanceDispose(m_unit);
+      m_unit = nullptr;
+      m_initialized = false;
+    }
+  }
+
+  unsigned GetPeriod() const override
+  {
+    return m_period;
+  }
+
+  const char *GetName() const override
+  {
+    return "Core Audio";
+  }
+
+private:
+  AudioUnit m_unit;
+  bool m_initialized;
+  PullFPtr m_pull;
+  unsigned m_period;
+
+  static OSStatus Render(void *refCon, AudioUnitRenderActionFlags *flags, const AudioTimeStamp *timeStamp, UInt32 bus, UInt32 numFrames, AudioBufferList *data)
+  {
+    // Interleaved formats have a single buffer
+    CCoreAudioOutput *self = reinterpret_cast<CCoreAudioOutput *>(refCon);
+    self->m_pull(data->mBuffers[0].mData, numFrames);
+    return noErr;
+  }
+};
+
+CAudioOutput *CreateNativeAudioOutput()
+{
+  return new CCoreAudioOutput();
+}
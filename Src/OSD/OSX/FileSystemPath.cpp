@@ -21,6 +21,7 @@
 
 #include "FileSystemPath.h"
 #include <string>
+#include <unistd.h>
 
 namespace FileSystemPath
 {
@@ -43,6 +44,14 @@ namespace FileSystemPath
             return "";
         case Assets:
             return "Assets/";
+        case Cache:
+            return "Cache/";
         }
     }
+
+    // Name, unique to this process, under which to write a file before renaming it to filePath
+    std::string GetTempFilePath(const std::string &filePath)
+    {
+        return filePath + "." + std::to_string(getpid()) + ".tmp";
+    }
 }
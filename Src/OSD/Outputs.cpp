@@ -64,9 +64,15 @@ EOutputs COutputs::GetOutputByName(const char *name)
 }
 
 COutputs::COutputs()
+	: m_dirty(0)
 {
-	memset(m_first, true, sizeof(m_first));
-	memset(m_values, 0, sizeof(m_values));
+	for (unsigned i = 0; i < NUM_OUTPUTS; i++)
+	{
+		m_first[i] = true;
+		m_values[i] = 0;
+	}
+	memset(m_sent, false, sizeof(m_sent));
+	memset(m_sentValues, 0, sizeof(m_sentValues));
 }
 
 COutputs::~COutputs()
@@ -97,12 +103,27 @@ void COutputs::SetValue(EOutputs output, UINT8 value)
 	int idx = (unsigned)output;
 	if (idx < 0 || idx >= NUM_OUTPUTS)
 		return;
-	bool firstSet = m_first[idx];
-	UINT8 prevValue = m_values[idx];
-	m_first[idx] = false;
-	m_values[idx] = value;
+	bool firstSet = m_first[idx].exchange(false);
+	UINT8 prevValue = m_values[idx].exchange(value);
 	if (firstSet || value != prevValue)
-		SendOutput(output, prevValue, value);
+		m_dirty.fetch_or(1u << idx);
+}
+
+void COutputs::Flush()
+{
+	UINT32 dirty = m_dirty.exchange(0);
+	for (unsigned idx = 0; dirty != 0; idx++, dirty >>= 1)
+	{
+		if (!(dirty & 1))
+			continue;
+		UINT8 value = m_values[idx];
+		if (m_sent[idx] && value == m_sentValues[idx])
+			continue;
+		UINT8 prevValue = m_sentValues[idx];
+		m_sent[idx] = true;
+		m_sentValues[idx] = value;
+		SendOutput((EOutputs)idx, prevValue, value);
+	}
 }
 
 bool COutputs::HasValue(EOutputs output) 
@@ -31,6 +31,8 @@
 #include "Game.h"
 #include "Types.h"
 
+#include <atomic>
+
 /*
  * EOutputs enumeration of all available outputs.
  * Currently just contains the outputs for the driving games - more will need to be added for the other games.
@@ -120,10 +122,22 @@ public:
 	/*
 	 * SetValue(output, value):
 	 *
-	 * Sets the current value of the given output.
+	 * Sets the current value of the given output.  The change is only passed
+	 * on to the subclass by the next call to Flush(), so this may be called
+	 * from any thread and as often as the game likes.
 	 */
 	void SetValue(EOutputs output, UINT8 value);
 
+	/*
+	 * Flush():
+	 *
+	 * Calls SendOutput() for every output whose value has changed since the
+	 * last flush.  Outputs that changed and changed back in between are not
+	 * sent.  Should be called once per frame from the thread that owns the
+	 * outputs.
+	 */
+	void Flush();
+
 	/* 
 	 * HasValue(EOutputs output)
 	 *
@@ -143,7 +157,7 @@ protected:
 	/*
 	 * SendOutput():
 	 *
-	 * Called when an output's value changes so that the subclass can handle it appropriately.
+	 * Called by Flush() when an output's value has changed so that the subclass can handle it appropriately.
 	 * To be implemented by the subclass.
 	 */
 	virtual void SendOutput(EOutputs output, UINT8 prevValue, UINT8 value) = 0;
@@ -151,9 +165,12 @@ protected:
 private:
 	static const char* s_outputNames[]; // Static array of output names
 
-	Game m_game;                  // Currently running game
-	bool m_first[NUM_OUTPUTS];    // For each output, true if an initial value has been set
-	UINT8 m_values[NUM_OUTPUTS];  // Current value of each output
+	Game m_game;                              // Currently running game
+	std::atomic<bool> m_first[NUM_OUTPUTS];   // For each output, true until an initial value has been set
+	std::atomic<UINT8> m_values[NUM_OUTPUTS]; // Current value of each output
+	std::atomic<UINT32> m_dirty;              // Bit mask of outputs set since the last flush
+	bool m_sent[NUM_OUTPUTS];                 // For each output, true if a value has been sent
+	UINT8 m_sentValues[NUM_OUTPUTS];          // Last value sent for each output
 };
 
 #endif	// INCLUDED_OUTPUTS_H
@@ -57,9 +57,18 @@
 
 #include "Supermodel.h"
 #include "SDLIncludes.h"
+#include "OSD/Thread.h"
+#include "OSD/AudioOutput.h"
 
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_X86_SIMD
+#include <emmintrin.h>
+#endif
 
   // Model3 audio output is 44.1KHz 4-channel sound and frame rate is 60fps
 #define SAMPLE_RATE_M3     (44100)
@@ -72,6 +81,9 @@
 
 #define NUM_CHANNELS_M3 (4)
 
+// Largest chunk OutputAudio() may produce, including rate control stretching
+#define MAX_SAMPLES_PER_CHUNK   ((SAMPLE_RATE_M3 / MIN_SND_FREQ) + 8)
+
 Game::AudioTypes AudioType;
 int nbHostAudioChannels = NUM_CHANNELS_M3;   // Number of channels on host
 
@@ -95,37 +107,67 @@ float balanceFactorRearLeft   = 1.0f;
 float balanceFactorRearRight  = 1.0f;
 
 static bool enabled = true;         // True if sound output is enabled
+static bool floatOutput = false;    // True if the host device takes 32-bit float samples rather than 16-bit integers
 static constexpr unsigned latency = 20;       // Audio latency to use (ie size of audio buffer) as percentage of max buffer size
-static constexpr bool underRunLoop = true;    // True if should loop back to beginning of buffer on under-run, otherwise sound is just skipped
 
 static constexpr unsigned playSamples = 512;  // Size (in samples) of callback play buffer
+static constexpr unsigned nativeLatencyFrames = 6;  // Audio latency to use with a native backend, in sound board frames
 
-static UINT32 audioBufferSize = 0;  // Size (in bytes) of audio buffer
-static INT8* audioBuffer = NULL;    // Audio buffer
-
-static UINT32 writePos = 0;         // Current position at which writing into buffer
-static UINT32 playPos = 0;          // Current position at which playing data in buffer via callback
+static CAudioOutput* nativeOutput = nullptr;  // Native backend if one is open, else SDL audio is used
 
-static bool writeWrapped = false;   // True if write position has wrapped around at end of buffer but play position has not done so yet
-
-static unsigned underRuns = 0;      // Number of buffer under-runs that have occured
+/*
+ * Audio ring buffer
+ *
+ * Single-producer (sound board thread, OutputAudio()), single-consumer (SDL
+ * audio thread, PlayCallback()) ring of host-format sample frames. Read and
+ * write positions are free-running sample counters: each side only ever
+ * advances its own counter, publishing it with release semantics after the
+ * data has been copied, and reads the other side's with acquire semantics.
+ * No lock is needed. Storage is rounded up to a power of two samples so that
+ * the counters can wrap at 2^32 and be masked into the buffer, while the
+ * usable capacity remains the latency-derived size.
+ */
+static INT8* audioBuffer = NULL;            // Audio buffer
+static UINT32 ringMask = 0;                 // Storage size (in samples) - 1
+static UINT32 ringCapacity = 0;             // Usable size (in samples), ie latency
+static UINT32 wakeLevel = 0;                // Fill level (in samples) at or below which the producer is woken
+static std::atomic<UINT32> writeCount(0);   // Total samples written (owned by OutputAudio)
+static std::atomic<UINT32> readCount(0);    // Total samples played (owned by PlayCallback)
+alignas(float) static INT8 lastSample[NUM_CHANNELS_M3 * sizeof(float)];   // Last sample frame played, faded out on under-run
+
+static std::atomic<unsigned> underRuns(0);  // Number of buffer under-runs that have occured
 static unsigned overRuns = 0;       // Number of buffer over-runs that have occured
 
 static AudioCallbackFPtr callback = NULL; // Pointer to audio callback that is called when audio buffer is less than half empty
 static void* callbackData = NULL;         // Pointer to data to be passed to audio callback when it is called
+static std::mutex callbackMutex;          // Guards the callback pointers against the playback thread
 
 static const Util::Config::Node* s_config = 0;
 
+/*
+ * Dynamic rate control
+ *
+ * When the sound board is paced by video frames rather than by the audio
+ * callback (single-threaded mode), the emulated frame rate and the host audio
+ * clock drift apart and the buffer slowly drains or fills. Each chunk is then
+ * linearly resampled by up to +/-0.5% to steer the smoothed fill level towards
+ * half full. The pitch change is inaudible.
+ */
+static constexpr float maxRateDelta = 0.005f;
+static bool rateControl = false;            // True if dynamic rate control is enabled
+static float rateFill = 0.5f;               // Smoothed buffer fill level
+static double ratePhase = 0.0;              // Position of next output sample relative to end of previous chunk
+static float rateHistory[NUM_CHANNELS_M3];  // Last input sample of previous chunk for each channel
+static float rateBuffer[NUM_CHANNELS_M3][MAX_SAMPLES_PER_CHUNK];
+
 
 void SetAudioCallback(AudioCallbackFPtr newCallback, void* newData)
 {
     // Lock audio whilst changing callback pointers
-    SDL_LockAudio();
+    std::lock_guard<std::mutex> lock(callbackMutex);
 
     callback = newCallback;
     callbackData = newData;
-
-    SDL_UnlockAudio();
 }
 
 void SetAudioEnabled(bool newEnabled)
@@ -142,23 +184,6 @@ void SetAudioType(Game::AudioTypes type)
     AudioType = type;
 }
 
-static INT16 MixINT16(float x, float y)
-{
-    INT32 sum = (INT32)((x + y)*0.5f); //!! dither
-    if (sum > INT16_MAX) {
-        sum = INT16_MAX;
-    }
-    if (sum < INT16_MIN) {
-        sum = INT16_MIN;
-    }
-    return (INT16)sum;
-}
-
-static float MixFloat(float x, float y)
-{
-    return (x + y)*0.5f;
-}
-
 static INT16 ClampINT16(float x)
 {
     INT32 xi = (INT32)x; //!! dither
@@ -171,240 +196,315 @@ static INT16 ClampINT16(float x)
     return (INT16)xi;
 }
 
-static void PlayCallback(void* data, Uint8* stream, int len)
+static inline void CopyFromRing(INT8* dest, UINT32 pos, UINT32 numSamples)
 {
-    //printf("PlayCallback(%d) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u]\n",
-    //	len, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize);
+    UINT32 start = pos & ringMask;
+    UINT32 len1 = std::min(numSamples, ringMask + 1 - start);
+    memcpy(dest, audioBuffer + start * bytes_per_sample_host, len1 * bytes_per_sample_host);
+    if (len1 < numSamples)
+        memcpy(dest + len1 * bytes_per_sample_host, audioBuffer, (numSamples - len1) * bytes_per_sample_host);
+}
 
-    // Get current write position and adjust it if write has wrapped but play position has not
-    UINT32 adjWritePos = writePos;
-    if (writeWrapped)
-        adjWritePos += audioBufferSize;
+static inline void CopyToRing(UINT32 pos, const INT8* src, UINT32 numSamples)
+{
+    UINT32 start = pos & ringMask;
+    UINT32 len1 = std::min(numSamples, ringMask + 1 - start);
+    memcpy(audioBuffer + start * bytes_per_sample_host, src, len1 * bytes_per_sample_host);
+    if (len1 < numSamples)
+        memcpy(audioBuffer, src + len1 * bytes_per_sample_host, (numSamples - len1) * bytes_per_sample_host);
+}
 
-    // Check if play position overlaps write position (ie buffer under-run)
-    if (playPos + len > adjWritePos)
+template <typename T>
+static void RampDown(T* p, const T* last, UINT32 missing)
+{
+    UINT32 rampLength = std::min<UINT32>(missing, 64);
+    for (UINT32 i = 0; i < missing; i++)
+    {
+        INT32 gain = i < rampLength ? INT32(rampLength - i) : 0;
+        for (int c = 0; c < nbHostAudioChannels; c++)
+            *p++ = T((last[c] * gain) / INT32(rampLength));
+    }
+}
+
+/*
+ * Fills the host buffer from the ring. Called on the playback thread, by SDL's
+ * audio callback or by the native backend.
+ */
+static void PullAudio(void* dest, unsigned wanted)
+{
+    Uint8* stream = (Uint8*)dest;
+    UINT32 read = readCount.load(std::memory_order_relaxed);
+    UINT32 available = writeCount.load(std::memory_order_acquire) - read;
+    UINT32 numSamples = std::min(wanted, available);
+
+    if (enabled)
+        CopyFromRing((INT8*)stream, read, numSamples);
+    else
+        memset(stream, 0, numSamples * bytes_per_sample_host);
+
+    if (numSamples > 0)
+        memcpy(lastSample, stream + (numSamples - 1) * bytes_per_sample_host, bytes_per_sample_host);
+
+    if (numSamples < wanted)
     {
         underRuns++;
 
-        //printf("Audio buffer under-run #%u in PlayCallback(%d) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u]\n",
-        //	underRuns, len, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize);
+        //printf("Audio buffer under-run #%u in PlayCallback(%d) [available = %u]\n", underRuns, len, available);
 
-        // See what action to take on under-run
-        if (underRunLoop)
-        {
-            // If loop, then move play position back to beginning of data in buffer
-            playPos = adjWritePos + bytes_per_frame_host;
-
-            // Check if play position has moved past end of buffer
-            if (playPos >= audioBufferSize)
-                // If so, wrap it around to beginning again (but keep write wrapped flag as before)
-                playPos -= audioBufferSize;
-            else
-                // Otherwise, set write wrapped flag as will now appear as if write has wrapped but play position has not
-                writeWrapped = true;
-        }
+        // Ramp the last sample down to silence rather than clicking
+        Uint8* p = stream + numSamples * bytes_per_sample_host;
+        if (floatOutput)
+            RampDown((float*)p, (const float*)lastSample, wanted - numSamples);
         else
-        {
-            // Otherwise, just copy silence to audio output stream and exit
-            memset(stream, 0, len);
-            return;
-        }
+            RampDown((INT16*)p, (const INT16*)lastSample, wanted - numSamples);
+        memset(lastSample, 0, sizeof(lastSample));
     }
 
-    INT8* src1;
-    INT8* src2;
-    UINT32 len1;
-    UINT32 len2;
+    // Release consumed samples to the producer
+    readCount.store(read + numSamples, std::memory_order_release);
 
-    // Check if play region extends past end of buffer
-    if (playPos + len > audioBufferSize)
+    // Only wake the sound board once enough has drained for it to run a batch of frames
+    if (available - numSamples <= wakeLevel)
     {
-        // If so, split play region into two
-        src1 = audioBuffer + playPos;
-        src2 = audioBuffer;
-        len1 = audioBufferSize - playPos;
-        len2 = len - len1;
-    }
-    else
-    {
-        // Otherwise, just copy whole region
-        src1 = audioBuffer + playPos;
-        src2 = nullptr;
-        len1 = len;
-        len2 = 0;
+        std::lock_guard<std::mutex> lock(callbackMutex);
+        if (callback)
+            callback(callbackData);
     }
+}
 
-    // Check if audio is enabled
-    if (enabled)
+static void PlayCallback(void* data, Uint8* stream, int len)
+{
+    // The callback runs on a thread owned by SDL
+    static bool scheduled = false;
+    if (!scheduled)
     {
-        // If so, copy play region into audio output stream
-        memcpy(stream, src1, len1);
-
-        // Also, if not looping on under-runs then blank region out
-        if (!underRunLoop)
-            memset(src1, 0, len1);
-
-        if (len2)
-        {
-            // If region was split into two, copy second half into audio output stream as well
-            memcpy(stream + len1, src2, len2);
-
-            // Also, if not looping on under-runs then blank region out
-            if (!underRunLoop)
-                memset(src2, 0, len2);
-        }
+        CThread::ApplyScheduling("Audio");
+        scheduled = true;
     }
-    else
-        // Otherwise, just copy silence to audio output stream
-        memset(stream, 0, len);
 
-    // Move play position forward for next time
-    playPos += len;
+    PullAudio(stream, UINT32(len) / bytes_per_sample_host);
+}
 
-    bool bufferFull = adjWritePos + 2 * bytes_per_frame_host > playPos + audioBufferSize;
+unsigned GetAudioUnderRuns()
+{
+    return underRuns.load(std::memory_order_relaxed);
+}
 
-    // Check if play position has moved past end of buffer
-    if (playPos >= audioBufferSize)
+float GetAudioBufferFill()
+{
+    if (ringCapacity == 0)
+        return 0.0f;
+    UINT32 fill = writeCount.load(std::memory_order_relaxed) - readCount.load(std::memory_order_relaxed);
+    return std::min(1.0f, float(fill) / float(ringCapacity));
+}
+
+static unsigned ResampleChannels(unsigned numSamples, const float* const in[NUM_CHANNELS_M3], double step)
+{
+    unsigned n = 0;
+    double pos = ratePhase;
+    while (pos < numSamples && n < MAX_SAMPLES_PER_CHUNK)
     {
-        // If so, wrap it around to beginning again and reset write wrapped flag
-        playPos -= audioBufferSize;
-        writeWrapped = false;
+        unsigned i = unsigned(pos);
+        float frac = float(pos - i);
+        for (int c = 0; c < NUM_CHANNELS_M3; c++)
+        {
+            float x0 = i == 0 ? rateHistory[c] : in[c][i - 1];
+            rateBuffer[c][n] = x0 + (in[c][i] - x0) * frac;
+        }
+        n++;
+        pos += step;
     }
-
-    // If buffer is not full then call audio callback
-    if (callback && !bufferFull)
-        callback(callbackData);
+    ratePhase = std::max(0.0, pos - numSamples);
+    for (int c = 0; c < NUM_CHANNELS_M3; c++)
+        rateHistory[c] = in[c][numSamples - 1];
+    return n;
 }
 
-static void MixChannels(unsigned numSamples, const float* leftFrontBuffer, const float* rightFrontBuffer, const float* leftRearBuffer, const float* rightRearBuffer, void* dest, bool flipStereo)
+/*
+ * Channel mixing
+ *
+ * Every game audio type and host channel count boils down to each host
+ * channel being a weighted sum of the four Model 3 channels, so the layout is
+ * resolved into a mixing matrix once per chunk, with the balance factors and
+ * the output scale folded in, and the per-sample loops are free of branches.
+ * Four sample frames are mixed at a time with SSE2 where available: 16-bit
+ * output is truncated and saturated by the conversion and pack instructions,
+ * and float output needs no conversion or clamping at all.
+ */
+static void BuildMixMatrix(float m[NUM_CHANNELS_M3][NUM_CHANNELS_M3], bool flipStereo, float scale)
 {
-    INT16* p = (INT16*)dest;
+    enum { FL, FR, RL, RR };
+    const float balance[NUM_CHANNELS_M3] = { balanceFactorFrontLeft, balanceFactorFrontRight, balanceFactorRearLeft, balanceFactorRearRight };
+    float rows[NUM_CHANNELS_M3][NUM_CHANNELS_M3] = {};
+
+    // Flip again left/right if configured in audio
+    switch (AudioType) {
+    case Game::STEREO_RL:
+    case Game::QUAD_1_FRL_2_RRL:
+    case Game::QUAD_1_RRL_2_FRL:
+        flipStereo = !flipStereo;
+        break;
+    default:
+        break;
+    }
 
     if (nbHostAudioChannels == 1) {
-        for (unsigned i = 0; i < numSamples; i++) {
-            INT16 monovalue = MixINT16(
-                MixFloat(leftFrontBuffer[i] * balanceFactorFrontLeft,rightFrontBuffer[i] * balanceFactorFrontRight),
-                MixFloat(leftRearBuffer[i]  * balanceFactorRearLeft, rightRearBuffer[i]  * balanceFactorRearRight));
-            *p++ = monovalue;
-        }
+        rows[0][FL] = rows[0][FR] = rows[0][RL] = rows[0][RR] = 0.25f;
+        flipStereo = false;
+    } else if (nbHostAudioChannels == 2) {
+        rows[0][FL] = rows[0][RL] = 0.5f;
+        rows[1][FR] = rows[1][RR] = 0.5f;
     } else {
-        // Flip again left/right if configured in audio
+        // Now order channels according to audio type
         switch (AudioType) {
+        case Game::MONO:
+            for (int c = 0; c < NUM_CHANNELS_M3; c++)
+                rows[c][FL] = rows[c][FR] = rows[c][RL] = rows[c][RR] = 0.25f;
+            break;
+
+        case Game::STEREO_LR:
         case Game::STEREO_RL:
-        case Game::QUAD_1_FRL_2_RRL:
+            rows[0][FL] = rows[0][FR] = 0.5f;
+            rows[1][RL] = rows[1][RR] = 0.5f;
+            rows[2][FL] = rows[2][FR] = 0.5f;
+            rows[3][RL] = rows[3][RR] = 0.5f;
+            break;
+
+        case Game::QUAD_1_RLR_2_FLR:
         case Game::QUAD_1_RRL_2_FRL:
-            flipStereo = !flipStereo;
+            // Reversed channels Front/Rear Left then Front/Rear Right
+            rows[0][RL] = rows[1][RR] = rows[2][FL] = rows[3][FR] = 1.0f;
+            break;
+
+        case Game::QUAD_1_LR_2_FR_MIX:
+            // Split mix: one goes to left/right, other front/rear (mono)
+            // =>Remix all!
+            rows[0][FL] = rows[0][RL] = 0.5f;
+            rows[1][FL] = rows[1][RR] = 0.5f;
+            rows[2][FR] = rows[2][RL] = 0.5f;
+            rows[3][FR] = rows[3][RR] = 0.5f;
+            break;
+
+        default:
+            // Normal channels Front Left/Right then Rear Left/Right
+            rows[0][FL] = rows[1][FR] = rows[2][RL] = rows[3][RR] = 1.0f;
             break;
         }
+    }
 
-        // Now order channels according to audio type
-        if (nbHostAudioChannels == 2) {
-            for (unsigned i = 0; i < numSamples; i++) {
-                INT16 leftvalue = MixINT16(leftFrontBuffer[i] * balanceFactorFrontLeft, leftRearBuffer[i] * balanceFactorRearLeft);
-                INT16 rightvalue = MixINT16(rightFrontBuffer[i]*balanceFactorFrontRight, rightRearBuffer[i]*balanceFactorRearRight);
-                if (flipStereo) // swap left and right channels
-                {
-                    *p++ = rightvalue;
-                    *p++ = leftvalue;
-                } else {
-                    *p++ = leftvalue;
-                    *p++ = rightvalue;
-                }
-            }
-        } else if (nbHostAudioChannels == 4) {
-            for (unsigned i = 0; i < numSamples; i++) {
-                float frontLeftValue = leftFrontBuffer[i]*balanceFactorFrontLeft;
-                float frontRightValue = rightFrontBuffer[i]*balanceFactorFrontRight;
-                float rearLeftValue = leftRearBuffer[i]*balanceFactorRearLeft;
-                float rearRightValue = rightRearBuffer[i]*balanceFactorRearRight;
-
-                // Check game audio type
-                switch (AudioType) {
-                case Game::MONO: {
-                    INT16 monovalue = MixINT16(MixFloat(frontLeftValue, frontRightValue), MixFloat(rearLeftValue, rearRightValue));
-                    *p++ = monovalue;
-                    *p++ = monovalue;
-                    *p++ = monovalue;
-                    *p++ = monovalue;
-                } break;
-
-                case Game::STEREO_LR:
-                case Game::STEREO_RL: {
-                    INT16 leftvalue =  MixINT16(frontLeftValue, frontRightValue);
-                    INT16 rightvalue = MixINT16(rearLeftValue,  rearRightValue);
-                    if (flipStereo) // swap left and right channels
-                    {
-                        *p++ = rightvalue;
-                        *p++ = leftvalue;
-                        *p++ = rightvalue;
-                        *p++ = leftvalue;
-                    } else {
-                        *p++ = leftvalue;
-                        *p++ = rightvalue;
-                        *p++ = leftvalue;
-                        *p++ = rightvalue;
-                    }
-                } break;
-
-                case Game::QUAD_1_FLR_2_RLR:
-                case Game::QUAD_1_FRL_2_RRL: {
-                    // Normal channels Front Left/Right then Rear Left/Right
-                    if (flipStereo) // swap left and right channels
-                    {
-                        *p++ = ClampINT16(frontRightValue);
-                        *p++ = ClampINT16(frontLeftValue);
-                        *p++ = ClampINT16(rearRightValue);
-                        *p++ = ClampINT16(rearLeftValue);
-                    } else {
-                        *p++ = ClampINT16(frontLeftValue);
-                        *p++ = ClampINT16(frontRightValue);
-                        *p++ = ClampINT16(rearLeftValue);
-                        *p++ = ClampINT16(rearRightValue);
-                    }
-                } break;
-
-                case Game::QUAD_1_RLR_2_FLR:
-                case Game::QUAD_1_RRL_2_FRL:
-                    // Reversed channels Front/Rear Left then Front/Rear Right
-                    if (flipStereo) // swap left and right channels
-                    {
-                        *p++ = ClampINT16(rearRightValue);
-                        *p++ = ClampINT16(rearLeftValue);
-                        *p++ = ClampINT16(frontRightValue);
-                        *p++ = ClampINT16(frontLeftValue);
-                    } else {
-                        *p++ = ClampINT16(rearLeftValue);
-                        *p++ = ClampINT16(rearRightValue);
-                        *p++ = ClampINT16(frontLeftValue);
-                        *p++ = ClampINT16(frontRightValue);
-                    }
-                    break;
-
-                case Game::QUAD_1_LR_2_FR_MIX:
-                    // Split mix: one goes to left/right, other front/rear (mono)
-                    // =>Remix all!
-                    INT16 newfrontLeftValue = MixINT16(frontLeftValue, rearLeftValue);
-                    INT16 newfrontRightValue = MixINT16(frontLeftValue, rearRightValue);
-                    INT16 newrearLeftValue = MixINT16(frontRightValue, rearLeftValue);
-                    INT16 newrearRightValue = MixINT16(frontRightValue, rearRightValue);
-
-                    if (flipStereo) // swap left and right channels
-                    {
-                        *p++ = newfrontRightValue;
-                        *p++ = newfrontLeftValue;
-                        *p++ = newrearRightValue;
-                        *p++ = newrearLeftValue;
-                    } else {
-                        *p++ = newfrontLeftValue;
-                        *p++ = newfrontRightValue;
-                        *p++ = newrearLeftValue;
-                        *p++ = newrearRightValue;
-                    }
-                    break;
-                }
-            }
+    for (int c = 0; c < nbHostAudioChannels; c++) {
+        // Swap left and right channels, which are always interleaved in pairs
+        int row = flipStereo ? c ^ 1 : c;
+        for (int j = 0; j < NUM_CHANNELS_M3; j++)
+            m[c][j] = rows[row][j] * balance[j] * scale;
+    }
+}
+
+static inline void StoreSample(INT16* p, float x)
+{
+    *p = ClampINT16(x);
+}
+
+static inline void StoreSample(float* p, float x)
+{
+    *p = x;
+}
+
+#if defined(AUDIO_X86_SIMD)
+static inline void StoreSamples(INT16* p, __m128 a, __m128 b)
+{
+    _mm_storeu_si128((__m128i*)p, _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+}
+
+static inline void StoreSamples(float* p, __m128 a, __m128 b)
+{
+    _mm_storeu_ps(p, a);
+    _mm_storeu_ps(p + 4, b);
+}
+
+static inline void StoreSamples(INT16* p, __m128 a)
+{
+    __m128i x = _mm_cvttps_epi32(a);
+    _mm_storel_epi64((__m128i*)p, _mm_packs_epi32(x, x));
+}
+
+static inline void StoreSamples(float* p, __m128 a)
+{
+    _mm_storeu_ps(p, a);
+}
+#endif
+
+template <int Channels, typename T>
+static void MixKernel(unsigned numSamples, const float* const in[NUM_CHANNELS_M3], const float m[NUM_CHANNELS_M3][NUM_CHANNELS_M3], T* p)
+{
+    unsigned i = 0;
+
+#if defined(AUDIO_X86_SIMD)
+    __m128 w[Channels][NUM_CHANNELS_M3];
+    for (int c = 0; c < Channels; c++)
+        for (int j = 0; j < NUM_CHANNELS_M3; j++)
+            w[c][j] = _mm_set1_ps(m[c][j]);
+
+    for (; i + 4 <= numSamples; i += 4) {
+        __m128 x0 = _mm_loadu_ps(in[0] + i);
+        __m128 x1 = _mm_loadu_ps(in[1] + i);
+        __m128 x2 = _mm_loadu_ps(in[2] + i);
+        __m128 x3 = _mm_loadu_ps(in[3] + i);
+
+        // One vector per host channel, holding 4 consecutive samples
+        __m128 y[Channels];
+        for (int c = 0; c < Channels; c++)
+            y[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, w[c][0]), _mm_mul_ps(x1, w[c][1])),
+                              _mm_add_ps(_mm_mul_ps(x2, w[c][2]), _mm_mul_ps(x3, w[c][3])));
+
+        // Interleave into sample frames
+        if constexpr (Channels == 1) {
+            StoreSamples(p, y[0]);
+        } else if constexpr (Channels == 2) {
+            StoreSamples(p, _mm_unpacklo_ps(y[0], y[1]), _mm_unpackhi_ps(y[0], y[1]));
+        } else {
+            _MM_TRANSPOSE4_PS(y[0], y[1], y[2], y[3]);
+            StoreSamples(p, y[0], y[1]);
+            StoreSamples(p + 8, y[2], y[3]);
         }
+        p += 4 * Channels;
     }
+#endif
+
+    for (; i < numSamples; i++) {
+        for (int c = 0; c < Channels; c++)
+            StoreSample(p++, in[0][i] * m[c][0] + in[1][i] * m[c][1] + in[2][i] * m[c][2] + in[3][i] * m[c][3]);
+    }
+}
+
+template <typename T>
+static void MixChannels(unsigned numSamples, const float* const in[NUM_CHANNELS_M3], const float m[NUM_CHANNELS_M3][NUM_CHANNELS_M3], T* p)
+{
+    switch (nbHostAudioChannels) {
+    case 1:
+        MixKernel<1>(numSamples, in, m, p);
+        break;
+    case 2:
+        MixKernel<2>(numSamples, in, m, p);
+        break;
+    default:
+        MixKernel<4>(numSamples, in, m, p);
+        break;
+    }
+}
+
+static void MixChannels(unsigned numSamples, const float* leftFrontBuffer, const float* rightFrontBuffer, const float* leftRearBuffer, const float* rightRearBuffer, void* dest, bool flipStereo)
+{
+    const float* in[NUM_CHANNELS_M3] = { leftFrontBuffer, rightFrontBuffer, leftRearBuffer, rightRearBuffer };
+    float m[NUM_CHANNELS_M3][NUM_CHANNELS_M3];
+
+    // Sound board output is at 16-bit scale; float samples are normalized to +/-1.0
+    BuildMixMatrix(m, flipStereo, floatOutput ? 1.0f / 32768.0f : 1.0f);
+
+    if (floatOutput)
+        MixChannels(numSamples, in, m, (float*)dest);
+    else
+        MixChannels(numSamples, in, m, (INT16*)dest);
 }
 
 /*
@@ -433,6 +533,8 @@ Result OpenAudio(const Util::Config::Node& config)
 
     // Number of channels requested in config (default is 4)
     nbHostAudioChannels = (int)s_config->Get("NbSoundChannels").ValueAs<int>();
+    rateControl = s_config->Get("AudioRateControl").ValueAs<bool>();
+    floatOutput = s_config->Get("AudioFloatOutput").ValueAs<bool>();
 
     // If game is only stereo or mono, enforce host to reduce number of channels
     switch (AudioType) {
@@ -458,17 +560,31 @@ Result OpenAudio(const Util::Config::Node& config)
     balanceFactorRearLeft   = (BalanceLeftRight < 0.f ? 1.f + BalanceLeftRight : 1.f) * (BalanceFrontRear > 0 ? 1.f - BalanceFrontRear : 1.f);
     balanceFactorRearRight  = (BalanceLeftRight > 0.f ? 1.f - BalanceLeftRight : 1.f) * (BalanceFrontRear > 0 ? 1.f - BalanceFrontRear : 1.f);
 
+    // Try the native backend first, with its small periods, then fall back to SDL
+    if (s_config->Get("NativeAudio").ValueAs<bool>() && (nativeOutput = CreateNativeAudioOutput()) != nullptr)
+    {
+        unsigned period = std::max(32u, std::min(1024u, s_config->Get("AudioPeriod").ValueAs<unsigned>()));
+        if (nativeOutput->Open(SAMPLE_RATE_M3, nbHostAudioChannels, floatOutput, period, PullAudio))
+            InfoLog("Audio output: %s, %u-sample period.", nativeOutput->GetName(), nativeOutput->GetPeriod());
+        else
+        {
+            InfoLog("Unable to open native audio output; using SDL audio.");
+            delete nativeOutput;
+            nativeOutput = nullptr;
+        }
+    }
+
     // Set up audio specification
     SDL_AudioSpec desired{};
     desired.freq = SAMPLE_RATE_M3;
     // Number of host channels to use (choice limited to 1,2,4)
     desired.channels = nbHostAudioChannels;
-    desired.format = AUDIO_S16SYS;
+    desired.format = floatOutput ? AUDIO_F32SYS : AUDIO_S16SYS;
     desired.samples = playSamples;
     desired.callback = PlayCallback;
 
     // Now force SDL to use the format we requested (nullptr); it will convert if necessary
-    if (SDL_OpenAudio(&desired, nullptr) < 0) {
+    if (nativeOutput == nullptr && SDL_OpenAudio(&desired, nullptr) < 0) {
         if (desired.channels==2) {
             return ErrorLog("Unable to open 44.1KHz 2-channel audio with SDL: %s\n", SDL_GetError());
         } else if (desired.channels==4) {
@@ -484,205 +600,121 @@ Result OpenAudio(const Util::Config::Node& config)
     if (soundFreq_Hz<MIN_SND_FREQ)
         soundFreq_Hz = MIN_SND_FREQ;
     samples_per_frame_host = (INT32)(SAMPLE_RATE_M3 / soundFreq_Hz);
-    bytes_per_sample_host = (nbHostAudioChannels * sizeof(INT16));
+    bytes_per_sample_host = (nbHostAudioChannels * (floatOutput ? sizeof(float) : sizeof(INT16)));
     bytes_per_frame_host =  (samples_per_frame_host * bytes_per_sample_host);
 
 
     // Create audio buffer
-    uint32_t bufferSize = ((SAMPLE_RATE_M3 * latency) / MAX_LATENCY) * bytes_per_sample_host;
-    if (!(bufferSize % bytes_per_sample_host == 0)) {
-        return ErrorLog("must be an integer multiple of the sample size\n");
-    }
-    audioBufferSize = bufferSize;
-
-    int minBufferSize = 3 * bytes_per_frame_host;
-    audioBufferSize = std::max<int>(minBufferSize, audioBufferSize);
+    UINT32 bufferSamples = (SAMPLE_RATE_M3 * latency) / MAX_LATENCY;
+    if (nativeOutput)
+        bufferSamples = nativeLatencyFrames * samples_per_frame_host + 2 * nativeOutput->GetPeriod();
+    ringCapacity = std::max<UINT32>(3 * samples_per_frame_host, bufferSamples);
+    UINT32 storageSamples = 1;
+    while (storageSamples < ringCapacity)
+        storageSamples <<= 1;
+    ringMask = storageSamples - 1;
+    UINT32 audioBufferSize = storageSamples * bytes_per_sample_host;
     audioBuffer = new(std::nothrow) INT8[audioBufferSize];
     if (audioBuffer == NULL) {
         float audioBufMB = (float)audioBufferSize / (float)0x100000;
         return ErrorLog("Insufficient memory for audio latency buffer (need %1.1f MB).", audioBufMB);
     }
     memset(audioBuffer, 0, sizeof(INT8) * audioBufferSize);
+    memset(lastSample, 0, sizeof(lastSample));
+    memset(rateHistory, 0, sizeof(rateHistory));
+    rateFill = 0.5f;
+    ratePhase = 0.0;
 
-    // Set initial play position to be beginning of buffer and initial write position to be half-way into buffer
-    playPos = 0;
-    uint32_t endOfBuffer = bufferSize - bytes_per_frame_host;
-    uint32_t midpointAfterFirstFrameUnaligned = bytes_per_frame_host + (bufferSize - bytes_per_frame_host) / 2;
-    uint32_t extraPaddingNeeded = (bytes_per_frame_host - midpointAfterFirstFrameUnaligned % bytes_per_frame_host) % bytes_per_frame_host;
-    uint32_t midpointAfterFirstFrame = midpointAfterFirstFrameUnaligned + extraPaddingNeeded;
-    if (!((endOfBuffer % (nbHostAudioChannels*sizeof(INT16))) == 0)) {
-        return ErrorLog("must be an integer multiple of the sample size\n");
-    }
-    if (!((midpointAfterFirstFrame % nbHostAudioChannels*sizeof(INT16)) == 0)) {
-        return ErrorLog("must be an integer multiple of the sample size\n");
-    }
+    // The sound board fills up to 2 frames short of capacity (see OutputAudio)
+    // and is woken once 2 more frames have drained, so it runs frames in batches
+    // rather than on every callback
+    wakeLevel = ringCapacity - std::min(ringCapacity, 4 * (UINT32)samples_per_frame_host);
 
-    writePos = std::min<int>(endOfBuffer, midpointAfterFirstFrame);
-    writeWrapped = false;
+    // Start half full of silence so that playback does not begin with an under-run
+    UINT32 prefill = (ringCapacity / 2) - (ringCapacity / 2) % samples_per_frame_host;
+    readCount.store(0, std::memory_order_relaxed);
+    writeCount.store(prefill, std::memory_order_release);
 
     // Reset counters
     underRuns = 0;
     overRuns = 0;
 
     // Start audio playing
-    SDL_PauseAudio(0);
+    if (nativeOutput)
+    {
+        if (!nativeOutput->Start())
+        {
+            nativeOutput->Close();
+            delete nativeOutput;
+            nativeOutput = nullptr;
+            return Result::FAIL;
+        }
+    }
+    else
+        SDL_PauseAudio(0);
     return Result::OKAY;
 }
 
 bool OutputAudio(unsigned numSamples, const float* leftFrontBuffer, const float* rightFrontBuffer, const float* leftRearBuffer, const float* rightRearBuffer, bool flipStereo)
 {
-    //printf("OutputAudio(%u) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u]\n",
-    //	numSamples, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize);
-
-    UINT32 bytesRemaining;
-    UINT32 bytesToCopy;
-    INT16* src;
-
     // Number of samples should never be more than max number of samples per frame
     if (numSamples > (unsigned)samples_per_frame_host)
         numSamples = samples_per_frame_host;
 
-    // Mix together left and right channels into single chunk of data
-    INT16 mixBuffer[NUM_CHANNELS_M3 * (SAMPLE_RATE_M3 / MIN_SND_FREQ)];
-    MixChannels(numSamples, leftFrontBuffer, rightFrontBuffer, leftRearBuffer, rightRearBuffer, mixBuffer, flipStereo);
-
-    // Lock SDL audio callback so that it doesn't interfere with following code
-    SDL_LockAudio();
-
-    // Calculate number of bytes for current sound chunk
-    UINT32 numBytes = numSamples * bytes_per_sample_host;
-
-    // Get end of current play region (writing must occur past this point)
-    UINT32 playEndPos = playPos + bytes_per_frame_host;
-
-    // Undo any wrap-around of the write position that may have occurred to create following ordering: playPos < playEndPos < writePos
-    if (playEndPos > writePos && writeWrapped)
-        writePos += audioBufferSize;
-
-    // Check if play region has caught up with write position and now overlaps it (ie buffer under-run)
-    if (playEndPos > writePos)
+    // Stretch or shrink the chunk slightly if pacing against the video frame rate
+    if (rateControl && callback == NULL && numSamples > 0)
     {
-        underRuns++;
-
-        //printf("Audio buffer under-run #%u in OutputAudio(%u) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u, numBytes = %u]\n",
-        //	underRuns, numSamples, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize, numBytes);
-
-        // See what action to take on under-run
-		if (underRunLoop)
-		{
-            // If loop, then move play position back to beginning of data in buffer
-            playPos = writePos + numBytes + bytes_per_frame_host;
-
-            // Check if play position has moved past end of buffer
-            if (playPos >= audioBufferSize)
-                // If so, wrap it around to beginning again (but keep write wrapped flag as before)
-                playPos -= audioBufferSize;
-			else
-			{
-                // Otherwise, set write wrapped flag as will now appear as if write has wrapped but play position has not
-                writeWrapped = true;
-                writePos += audioBufferSize;
-            }
-		}
-		else
-		{
-            // Otherwise, bump write position forward in chunks until it is past end of play region
-			do
-			{
-                writePos += numBytes;
-			}
-			while (playEndPos > writePos);
-        }
+        rateFill += 0.05f * (GetAudioBufferFill() - rateFill);
+        float error = std::max(-1.0f, std::min(1.0f, (0.5f - rateFill) * 2.0f));
+        double ratio = 1.0 + maxRateDelta * error;
+        const float* in[NUM_CHANNELS_M3] = { leftFrontBuffer, rightFrontBuffer, leftRearBuffer, rightRearBuffer };
+        numSamples = ResampleChannels(numSamples, in, 1.0 / ratio);
+        leftFrontBuffer = rateBuffer[0];
+        rightFrontBuffer = rateBuffer[1];
+        leftRearBuffer = rateBuffer[2];
+        rightRearBuffer = rateBuffer[3];
     }
 
-    // Check if write position has caught up with play region and now overlaps it (ie buffer over-run)
-    bool overRun = writePos + numBytes > playPos + audioBufferSize;
-
-    bool bufferFull = writePos + 2 * bytes_per_frame_host > playPos + audioBufferSize;
+    // Mix together left and right channels into single chunk of data
+    float mixBuffer[NUM_CHANNELS_M3 * MAX_SAMPLES_PER_CHUNK];
+    MixChannels(numSamples, leftFrontBuffer, rightFrontBuffer, leftRearBuffer, rightRearBuffer, mixBuffer, flipStereo);
 
-    // Move write position back to within buffer
-    if (writePos >= audioBufferSize)
-        writePos -= audioBufferSize;
+    UINT32 write = writeCount.load(std::memory_order_relaxed);
+    UINT32 fill = write - readCount.load(std::memory_order_acquire);
+    UINT32 space = ringCapacity - std::min(ringCapacity, fill);
 
-    // Handle buffer over-run
-    if (overRun)
+    // Handle buffer over-run by discarding current chunk of data
+    if (numSamples > space)
     {
         overRuns++;
 
-        //printf("Audio buffer over-run #%u in OutputAudio(%u) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u, numBytes = %u]\n",
-        //	overRuns, numSamples, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize, numBytes);
-
-        bufferFull = true;
-
-        // Discard current chunk of data
-    }
-    else
-    {
-    src = mixBuffer;
-    INT8* dst1;
-    INT8* dst2;
-    UINT32 len1;
-    UINT32 len2;
-
-    // Check if write region extends past end of buffer
-	if (writePos + numBytes > audioBufferSize)
-	{
-        // If so, split write region into two
-        dst1 = audioBuffer + writePos;
-        dst2 = audioBuffer;
-        len1 = audioBufferSize - writePos;
-        len2 = numBytes - len1;
-	}
-	else
-	{
-        // Otherwise, just copy whole region
-        dst1 = audioBuffer + writePos;
-        dst2 = NULL;
-        len1 = numBytes;
-        len2 = NULL;
-    }
-
-    // Copy chunk to write position in buffer
-    bytesRemaining = numBytes;
-    bytesToCopy = (bytesRemaining > len1 ? len1 : bytesRemaining);
-    memcpy(dst1, src, bytesToCopy);
-
-    // Adjust for number of bytes copied
-    bytesRemaining -= bytesToCopy;
-    src = (INT16*)((UINT8*)src + bytesToCopy);
-
-	if (bytesRemaining)
-	{
-        // If write region was split into two, copy second half of chunk into buffer as well
-        bytesToCopy = (bytesRemaining > len2 ? len2 : bytesRemaining);
-        memcpy(dst2, src, bytesToCopy);
-    }
-
-    // Move write position forward for next time
-    writePos += numBytes;
+        //printf("Audio buffer over-run #%u in OutputAudio(%u) [fill = %u, capacity = %u]\n", overRuns, numSamples, fill, ringCapacity);
 
-    // Check if write position has moved past end of buffer
-	if (writePos >= audioBufferSize)
-	{
-        // If so, wrap it around to beginning again and set write wrapped flag
-        writePos -= audioBufferSize;
-        writeWrapped = true;
-    }
+        return true;
     }
 
-    // Unlock SDL audio callback
-    SDL_UnlockAudio();
+    // Copy chunk into buffer and publish it to the consumer
+    CopyToRing(write, (const INT8*)mixBuffer, numSamples);
+    writeCount.store(write + numSamples, std::memory_order_release);
 
-    // Return whether buffer is half full
-    return bufferFull;
+    // Return whether buffer is full (less than 2 frames of space left)
+    return space - numSamples < 2 * (UINT32)samples_per_frame_host;
 }
 
 void CloseAudio()
 {
-    // Close SDL audio output
-    SDL_CloseAudio();
+    // Close native or SDL audio output
+    if (nativeOutput)
+    {
+        nativeOutput->Close();
+        delete nativeOutput;
+        nativeOutput = nullptr;
+    }
+    else
+        SDL_CloseAudio();
 
     // Delete audio buffer
     delete[] audioBuffer;
     audioBuffer = nullptr;
+    ringCapacity = 0;
 }
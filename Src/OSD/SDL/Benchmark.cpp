@@ -0,0 +1,433 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2023 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "Benchmark.h"
+#include "BlockFile.h"
+#include "OSD/Thread.h"
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>    // GetProcessMemoryInfo()
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h> // getrusage()
+#endif
+
+// Peak resident set size of the process in KB, or 0 if unknown
+static uint64_t GetPeakRSSKB()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return uint64_t(counters.PeakWorkingSetSize) / 1024;
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return uint64_t(usage.ru_maxrss) / 1024;  // bytes
+#else
+  return uint64_t(usage.ru_maxrss);         // KB
+#endif
+#endif
+}
+
+/*
+ * Input recordings start with a header and the save state the recording
+ * starts from:
+ *
+ *    magic         "SMINPUTS"
+ *    version       uint32_t
+ *    numInputs     uint32_t, values per frame
+ *    game          char[32], name of the game, zero padded
+ *    settingsKey   uint64_t, hash of the settings that change what the game sees
+ *    stateSize     uint32_t, size of the save state
+ *    packedSize    uint32_t, size of the save state compressed with zlib
+ *    state         uint8_t[packedSize]
+ *
+ * Then, for each frame, the game's inputs (in the order of
+ * CInputs::ReadGameState()) that changed since the previous frame, with all
+ * of them starting out as 0, and a checksum of RAM as the frame began:
+ *
+ *    numChanged    varint
+ *    changes       numChanged pairs of varints: the number of unchanged
+ *                  inputs skipped since the previous change, and the zigzag
+ *                  encoded difference from the input's previous value
+ *    checksum      uint16_t, low bits of IEmulator::GetMemoryChecksum()
+ *
+ * Varints hold 7 bits per byte, least significant first, with the top bit
+ * set in all but the last byte. As most inputs stay the same from one frame
+ * to the next, most frames take 3 bytes.
+ */
+static const char INPUT_RECORDING_MAGIC[8] = { 'S', 'M', 'I', 'N', 'P', 'U', 'T', 'S' };
+static const uint32_t INPUT_RECORDING_VERSION = 2;
+static const size_t INPUT_RECORDING_NAME_SIZE = 32;
+
+static void PutVarint(std::vector<uint8_t> *buffer, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    buffer->push_back(uint8_t(value | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(uint8_t(value));
+}
+
+static bool GetVarint(FILE *fp, uint32_t *value)
+{
+  *value = 0;
+  for (int shift = 0; shift < 35; shift += 7)
+  {
+    int c = fgetc(fp);
+    if (c == EOF)
+      return false;
+    *value |= uint32_t(c & 0x7F) << shift;
+    if ((c & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+Result CInputRecording::OpenForRecording(const std::string &file, uint64_t settingsKey, const std::vector<uint8_t> &initialState)
+{
+  m_initialState = initialState;
+  return Open(file, settingsKey, false);
+}
+
+Result CInputRecording::OpenForPlayback(const std::string &file, uint64_t settingsKey)
+{
+  return Open(file, settingsKey, true);
+}
+
+Result CInputRecording::Open(const std::string &file, uint64_t settingsKey, bool playback)
+{
+  m_playback = playback;
+  m_inputs->ReadGameState(m_game, &m_state);
+  std::fill(m_state.begin(), m_state.end(), 0);
+
+  char name[INPUT_RECORDING_NAME_SIZE] = { 0 };
+  strncpy(name, m_game.name.c_str(), sizeof(name) - 1);
+  uint32_t numInputs = uint32_t(m_state.size());
+
+  m_file = fopen(file.c_str(), playback ? "rb" : "wb");
+  if (!m_file)
+    return ErrorLog("Unable to open '%s' for %s inputs.", file.c_str(), playback ? "playing back" : "recording");
+
+  if (!playback)
+  {
+    uLongf packedSize = compressBound(uLong(m_initialState.size()));
+    std::vector<uint8_t> packed(packedSize);
+    if (compress2(packed.data(), &packedSize, m_initialState.data(), uLong(m_initialState.size()), Z_BEST_SPEED) != Z_OK)
+      return ErrorLog("Unable to compress the initial state for '%s'.", file.c_str());
+    uint32_t stateSize = uint32_t(m_initialState.size());
+    uint32_t packedSize32 = uint32_t(packedSize);
+    fwrite(INPUT_RECORDING_MAGIC, sizeof(INPUT_RECORDING_MAGIC), 1, m_file);
+    fwrite(&INPUT_RECORDING_VERSION, sizeof(INPUT_RECORDING_VERSION), 1, m_file);
+    fwrite(&numInputs, sizeof(numInputs), 1, m_file);
+    fwrite(name, sizeof(name), 1, m_file);
+    fwrite(&settingsKey, sizeof(settingsKey), 1, m_file);
+    fwrite(&stateSize, sizeof(stateSize), 1, m_file);
+    fwrite(&packedSize32, sizeof(packedSize32), 1, m_file);
+    if (fwrite(packed.data(), packedSize, 1, m_file) != 1)
+      return ErrorLog("Unable to write to '%s'.", file.c_str());
+    return Result::OKAY;
+  }
+
+  char magic[sizeof(INPUT_RECORDING_MAGIC)];
+  uint32_t version = 0;
+  uint32_t fileInputs = 0;
+  char fileName[INPUT_RECORDING_NAME_SIZE];
+  uint64_t fileSettingsKey = 0;
+  uint32_t stateSize = 0;
+  uint32_t packedSize = 0;
+  if (fread(magic, sizeof(magic), 1, m_file) != 1 || memcmp(magic, INPUT_RECORDING_MAGIC, sizeof(magic)) ||
+      fread(&version, sizeof(version), 1, m_file) != 1 || version != INPUT_RECORDING_VERSION ||
+      fread(&fileInputs, sizeof(fileInputs), 1, m_file) != 1 ||
+      fread(fileName, sizeof(fileName), 1, m_file) != 1 ||
+      fread(&fileSettingsKey, sizeof(fileSettingsKey), 1, m_file) != 1 ||
+      fread(&stateSize, sizeof(stateSize), 1, m_file) != 1 ||
+      fread(&packedSize, sizeof(packedSize), 1, m_file) != 1)
+    return ErrorLog("'%s' is not a Supermodel input recording, or was made by an incompatible version.", file.c_str());
+  fileName[sizeof(fileName) - 1] = '\0';
+  if (strcmp(fileName, name) || fileInputs != numInputs)
+    return ErrorLog("'%s' was recorded with %s, not %s.", file.c_str(), fileName, name);
+
+  std::vector<uint8_t> packed(packedSize);
+  m_initialState.resize(stateSize);
+  uLongf unpackedSize = stateSize;
+  if ((packedSize > 0 && fread(packed.data(), packedSize, 1, m_file) != 1) ||
+      uncompress(m_initialState.data(), &unpackedSize, packed.data(), packedSize) != Z_OK || unpackedSize != stateSize)
+    return ErrorLog("The initial state in '%s' is damaged.", file.c_str());
+  if (fileSettingsKey != settingsKey)
+    InfoLog("'%s' was recorded with different emulation settings and may not play back the same way.", file.c_str());
+  return Result::OKAY;
+}
+
+bool CInputRecording::ReadFrame()
+{
+  uint32_t numChanged;
+  if (!GetVarint(m_file, &numChanged))
+    return false;
+  size_t index = 0;
+  for (uint32_t i = 0; i < numChanged; i++)
+  {
+    uint32_t skip;
+    uint32_t delta;
+    if (!GetVarint(m_file, &skip) || !GetVarint(m_file, &delta) || (index += skip) >= m_state.size())
+      return false;
+    int32_t difference = int32_t(delta >> 1) ^ -int32_t(delta & 1);
+    m_state[index] = UINT16(m_state[index] + difference);
+    index++;
+  }
+  uint16_t checksum;
+  if (fread(&checksum, sizeof(checksum), 1, m_file) != 1)
+    return false;
+
+  // A run that has gone out of sync stays that way, so only the first frame is reported
+  if (m_inSync && checksum != uint16_t(m_emulator->GetMemoryChecksum()))
+  {
+    m_inSync = false;
+    ErrorLog("Input playback is out of sync with the recording from frame %llu on.", (unsigned long long) m_frames);
+  }
+  return true;
+}
+
+bool CInputRecording::WriteFrame(const std::vector<UINT16> &inputs)
+{
+  m_buffer.clear();
+  uint32_t numChanged = 0;
+  for (size_t i = 0; i < inputs.size(); i++)
+    numChanged += inputs[i] != m_state[i];
+  PutVarint(&m_buffer, numChanged);
+  size_t skipped = 0;
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    if (inputs[i] == m_state[i])
+    {
+      skipped++;
+      continue;
+    }
+    int32_t difference = int32_t(inputs[i]) - int32_t(m_state[i]);
+    PutVarint(&m_buffer, uint32_t(skipped));
+    PutVarint(&m_buffer, (uint32_t(difference) << 1) ^ uint32_t(difference >> 31));
+    m_state[i] = inputs[i];
+    skipped = 0;
+  }
+  uint16_t checksum = uint16_t(m_emulator->GetMemoryChecksum());
+  m_buffer.push_back(uint8_t(checksum));
+  m_buffer.push_back(uint8_t(checksum >> 8));
+  return fwrite(m_buffer.data(), m_buffer.size(), 1, m_file) == 1;
+}
+
+void CInputRecording::Update()
+{
+  if (!m_file || m_ended)
+    return;
+
+  if (m_playback)
+  {
+    if (ReadFrame())
+      m_inputs->WriteGameState(m_game, m_state);
+    else
+    {
+      m_ended = true;
+      InfoLog("Input playback ended after %llu frames%s.", (unsigned long long) m_frames, m_inSync ? ", in sync with the recording" : "");
+      return;
+    }
+  }
+  else
+  {
+    std::vector<UINT16> inputs;
+    m_inputs->ReadGameState(m_game, &inputs);
+    if (!WriteFrame(inputs))
+    {
+      m_ended = true;
+      ErrorLog("Input recording stopped: unable to write to the file.");
+      return;
+    }
+  }
+  m_frames++;
+}
+
+CInputRecording::CInputRecording(const Game &game, CInputs *inputs, const IEmulator *emulator)
+  : m_game(game),
+    m_inputs(inputs),
+    m_emulator(emulator)
+{
+}
+
+CInputRecording::~CInputRecording()
+{
+  if (m_file)
+  {
+    if (!m_playback)
+      InfoLog("Recorded inputs for %llu frames.", (unsigned long long) m_frames);
+    fclose(m_file);
+  }
+}
+
+bool CBenchmark::AddFrame(const FrameTimings *timings)
+{
+  if (timings)
+  {
+    const UINT32 micros[NumMetrics] = { timings->ppcMicros, timings->syncMicros, timings->renderMicros, timings->sndMicros, timings->drvMicros, timings->gpuMicros };
+    for (int i = 0; i < NumMetrics; i++)
+    {
+      m_totalMicros[i] += micros[i];
+      m_maxMicros[i] = std::max(m_maxMicros[i], micros[i]);
+    }
+    m_totalDrawCalls += timings->render3DMicros.drawCalls;
+    m_maxDrawCalls = std::max(m_maxDrawCalls, timings->render3DMicros.drawCalls);
+    m_haveTimings = true;
+  }
+  if (++m_frames < m_numFrames)
+    return false;
+  m_endMicros = CThread::GetMicros();
+  return true;
+}
+
+uint64_t CBenchmark::Hash(const uint8_t *data, size_t size)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ data[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
+void CBenchmark::Report(IEmulator *emulator, uint64_t frameHash) const
+{
+  static const char *names[NumMetrics] = { "PowerPC", "Sync", "Render", "Sound", "Drive board", "GPU" };
+  static const char *keys[NumMetrics] = { "ppc", "sync", "render", "sound", "drive", "gpu" };
+
+  uint64_t elapsed = (m_endMicros ? m_endMicros : CThread::GetMicros()) - m_startMicros;
+  printf("\nBenchmark: %u frames in %.3f s, %.2f FPS (%.3f ms per frame)\n", m_frames, elapsed / 1e6,
+    elapsed ? m_frames * 1e6 / elapsed : 0.0, m_frames ? elapsed / 1e3 / m_frames : 0.0);
+
+  if (m_haveTimings && m_frames)
+  {
+    // Anything that wasn't measured (e.g., the PowerPC when replaying graphics states) is left out
+    puts("                avg ms    max ms");
+    for (int i = 0; i < NumMetrics; i++)
+    {
+      if (m_totalMicros[i])
+        printf("  %-12s %8.3f  %8.3f\n", names[i], m_totalMicros[i] / 1e3 / m_frames, m_maxMicros[i] / 1e3);
+    }
+    if (m_totalDrawCalls)
+      printf("  %-12s %8.1f  %6u\n", "Draw calls", double(m_totalDrawCalls) / m_frames, m_maxDrawCalls);
+  }
+
+  // The hash of a save state covers everything the emulated machine remembers
+  CBlockFile::MemoryImage image;
+  CBlockFile state;
+  state.CreateInMemory(&image, "Supermodel Benchmark State", "Supermodel Version " SUPERMODEL_VERSION);
+  emulator->SaveState(&state);
+  state.Close();
+  uint64_t hash = Hash(image.data.data(), image.data.size());
+  uint64_t peakRSS = GetPeakRSSKB();
+  printf("  Peak memory: %.1f MB\n", peakRSS / 1024.0);
+  printf("  State hash:  %016llx\n", (unsigned long long) hash);
+  printf("  Frame hash:  %016llx\n\n", (unsigned long long) frameHash);
+
+  if (m_resultsFile.empty())
+    return;
+  FILE *fp = fopen(m_resultsFile.c_str(), "a");
+  if (!fp)
+  {
+    ErrorLog("Unable to append benchmark results to '%s'.", m_resultsFile.c_str());
+    return;
+  }
+  fprintf(fp, "{\"game\":\"%s\",\"version\":\"%s\",\"frames\":%u,\"seconds\":%.6f,\"fps\":%.3f", emulator->GetGame().name.c_str(), SUPERMODEL_VERSION,
+    m_frames, elapsed / 1e6, elapsed ? m_frames * 1e6 / elapsed : 0.0);
+  if (m_haveTimings && m_frames)
+  {
+    fprintf(fp, ",\"ms\":{");
+    const char *separator = "";
+    for (int i = 0; i < NumMetrics; i++)
+    {
+      if (!m_totalMicros[i])
+        continue;
+      fprintf(fp, "%s\"%s\":{\"avg\":%.4f,\"max\":%.4f}", separator, keys[i], m_totalMicros[i] / 1e3 / m_frames, m_maxMicros[i] / 1e3);
+      separator = ",";
+    }
+    fprintf(fp, "},\"draw_calls\":{\"avg\":%.2f,\"max\":%u}", double(m_totalDrawCalls) / m_frames, m_maxDrawCalls);
+  }
+  fprintf(fp, ",\"peak_rss_kb\":%llu,\"state_hash\":\"%016llx\",\"frame_hash\":\"%016llx\"}\n",
+    (unsigned long long) peakRSS, (unsigned long long) hash, (unsigned long long) frameHash);
+  fclose(fp);
+}
+
+bool CBenchmark::Recommend(const Util::Config::Node &config, Util::Config::Node *profile) const
+{
+  // Graphics state replays have no PowerPC or sound timings to go by
+  if (!m_haveTimings || !m_frames || !m_totalMicros[MetricPPC])
+    return false;
+
+  const double frameMicros = 1e6 / 57.524160;
+  double avg[NumMetrics];
+  for (int i = 0; i < NumMetrics; i++)
+    avg[i] = double(m_totalMicros[i]) / m_frames;
+
+  // Threads overlap the PowerPC with rendering and the boards, worth it once their sum takes up most of a frame
+  bool multiThreaded = avg[MetricPPC] + avg[MetricSync] + avg[MetricRender] + avg[MetricSound] + avg[MetricDrive] > 0.75 * frameMicros;
+
+  // The recompiler is where a PowerPC-bound game has the most to gain (the interpreter is used where it isn't available)
+  bool dynarec = config["PowerPCDynarec"].ValueAs<bool>() || avg[MetricPPC] > 0.5 * frameMicros;
+
+  // GPU time goes roughly with the number of samples, so step down until it would fit
+  int supersampling = config["Supersampling"].ValueAs<int>();
+  if (m_totalMicros[MetricGPU] && supersampling > 1)
+  {
+    double gpuPerSample = avg[MetricGPU] / (supersampling * supersampling);
+    int maxSupersampling = supersampling;
+    while (maxSupersampling > 1 && gpuPerSample * maxSupersampling * maxSupersampling > 0.8 * frameMicros)
+      maxSupersampling--;
+    supersampling = maxSupersampling;
+  }
+
+  // Frames ran unthrottled, so if they didn't keep well ahead of the refresh rate, let slow ones be skipped
+  uint64_t elapsed = (m_endMicros ? m_endMicros : CThread::GetMicros()) - m_startMicros;
+  double fps = elapsed ? m_frames * 1e6 / elapsed : 0.0;
+  bool autoFrameskip = fps < 1.1 * 57.524160;
+
+  profile->Set("MultiThreaded", multiThreaded);
+  profile->Set("PowerPCDynarec", dynarec);
+  profile->Set("Supersampling", supersampling);
+  profile->Set("AutoFrameskip", autoFrameskip);
+  printf("Recommended settings: MultiThreaded=%d PowerPCDynarec=%d Supersampling=%d AutoFrameskip=%d\n",
+    multiThreaded, dynarec, supersampling, autoFrameskip);
+  return true;
+}
+
+CBenchmark::CBenchmark(unsigned numFrames, const std::string &resultsFile)
+  : m_numFrames(numFrames),
+    m_resultsFile(resultsFile),
+    m_startMicros(CThread::GetMicros())
+{
+}
@@ -0,0 +1,190 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2023 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+/*
+ * Benchmark.h
+ *
+ * Repeatable performance measurement. Inputs played during a normal session
+ * can be recorded frame by frame to a file, along with the state the machine
+ * started from, and fed back in later so that a run does the same work every
+ * time. Each frame also records a checksum of RAM, so that playback notices
+ * when it stops reproducing the recorded run. A
+ * benchmark runs a set number of frames as fast as possible and then reports
+ * how long they took, where the time went, and hashes of the final machine
+ * state and of the last frame displayed that tell whether two builds really
+ * emulated and drew the same thing. Results can also be appended to a file as
+ * one line of JSON per run, for scripts that track performance over time
+ * (see Scripts/bench.sh). The timings can also be turned into a profile of
+ * settings recommended for the game on this host, which is applied on top of
+ * the configuration file from then on.
+ */
+
+#ifndef INCLUDED_BENCHMARK_H
+#define INCLUDED_BENCHMARK_H
+
+#include "Supermodel.h"
+#include "Game.h"
+#include "Inputs/Inputs.h"
+#include "Model3/IEmulator.h"
+#include "Model3/Model3.h"
+#include "Util/NewConfig.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class CInputRecording
+{
+public:
+  /*
+   * OpenForRecording(file, settingsKey, initialState):
+   * OpenForPlayback(file, settingsKey):
+   *
+   * Creates a recording of the game's inputs, or opens one for playing back.
+   * A recording can only be played back with the game it was made with, and
+   * is warned about if the settings that change what the game sees differ.
+   *
+   * Parameters:
+   *    file          File path.
+   *    settingsKey   Hash of those settings.
+   *    initialState  Save state to start the recording from (e.g., a
+   *                  CBlockFile::MemoryImage's data). When playing back, it
+   *                  is available from GetInitialState().
+   *
+   * Returns:
+   *    OKAY if the file was opened, FAIL otherwise (with an error logged).
+   */
+  Result OpenForRecording(const std::string &file, uint64_t settingsKey, const std::vector<uint8_t> &initialState);
+  Result OpenForPlayback(const std::string &file, uint64_t settingsKey);
+
+  // The save state a recording being played back starts from
+  const std::vector<uint8_t> &GetInitialState() const
+  {
+    return m_initialState;
+  }
+
+  /*
+   * Update():
+   *
+   * Called once per frame, right after the inputs are polled. Appends the
+   * current inputs to a recording, or replaces them with the next frame of
+   * the one being played back. Once playback reaches the end of the file the
+   * inputs are left as they were last set.
+   */
+  void Update();
+
+  CInputRecording(const Game &game, CInputs *inputs, const IEmulator *emulator);
+  ~CInputRecording();
+
+private:
+  Result Open(const std::string &file, uint64_t settingsKey, bool playback);
+  bool ReadFrame();
+  bool WriteFrame(const std::vector<UINT16> &inputs);
+
+  const Game &m_game;
+  CInputs *m_inputs;
+  const IEmulator *m_emulator;
+  FILE *m_file = nullptr;
+  bool m_playback = false;
+  bool m_ended = false;
+  bool m_inSync = true;
+  std::vector<UINT16> m_state;        // inputs as of the last frame
+  std::vector<uint8_t> m_initialState;
+  std::vector<uint8_t> m_buffer;
+  uint64_t m_frames = 0;
+};
+
+class CBenchmark
+{
+public:
+  /*
+   * AddFrame(timings):
+   *
+   * Records a frame that has just been run, with the emulator's timings for
+   * it if available.
+   *
+   * Returns:
+   *    True once the requested number of frames has been run.
+   */
+  bool AddFrame(const FrameTimings *timings);
+
+  /*
+   * Report(emulator, frameHash):
+   *
+   * Prints the results, including a hash of the emulator's state and the
+   * given hash of the last frame displayed, and appends them to the results
+   * file if there is one.
+   */
+  void Report(IEmulator *emulator, uint64_t frameHash) const;
+
+  /*
+   * Recommend(config, profile):
+   *
+   * Sets the settings recommended for running the game on this host, judged
+   * from the timings of the frames run with the given config, in the profile
+   * section. Only settings that trade quality or accuracy for speed are
+   * covered; anything a game needs to run correctly is left to the
+   * configuration file.
+   *
+   * Returns:
+   *    False if there were no timings to go by.
+   */
+  bool Recommend(const Util::Config::Node &config, Util::Config::Node *profile) const;
+
+  /*
+   * CBenchmark(numFrames, resultsFile):
+   *
+   * Parameters:
+   *    numFrames     Number of frames to run.
+   *    resultsFile   File to append the results to as a line of JSON, or
+   *                  empty for none.
+   */
+  CBenchmark(unsigned numFrames, const std::string &resultsFile);
+
+  // FNV-1a, as used for the state and frame hashes
+  static uint64_t Hash(const uint8_t *data, size_t size);
+
+private:
+  enum Metric
+  {
+    MetricPPC = 0,
+    MetricSync,
+    MetricRender,
+    MetricSound,
+    MetricDrive,
+    MetricGPU,
+    NumMetrics
+  };
+
+  const unsigned m_numFrames;
+  const std::string m_resultsFile;
+  unsigned m_frames = 0;
+  uint64_t m_startMicros;
+  uint64_t m_endMicros = 0;
+  uint64_t m_totalMicros[NumMetrics] = { 0 };
+  UINT32 m_maxMicros[NumMetrics] = { 0 };
+  uint64_t m_totalDrawCalls = 0;
+  UINT32 m_maxDrawCalls = 0;
+  bool m_haveTimings = false;
+};
+
+#endif  // INCLUDED_BENCHMARK_H
@@ -0,0 +1,314 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+// Winsock has to come before anything that may pull in windows.h
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET  (-1)
+#define closesocket     close
+#endif
+
+#include "ControlServer.h"
+#include "Util/MemoryUsage.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static const unsigned REPLY_TIMEOUT_MS = 5000;  // main loop must answer commands within this
+static const size_t MAX_REQUEST_SIZE = 4096;
+
+static const struct
+{
+  const char              *path;
+  CControlServer::Command command;
+} s_commands[] =
+{
+  { "/pause",       CControlServer::Command::Pause      },
+  { "/resume",      CControlServer::Command::Resume     },
+  { "/reset",       CControlServer::Command::Reset      },
+  { "/screenshot",  CControlServer::Command::Screenshot },
+  { "/save-state",  CControlServer::Command::SaveState  },
+  { "/load-state",  CControlServer::Command::LoadState  }
+};
+
+static std::string JSONString(const std::string &str)
+{
+  std::string out = "\"";
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    if (c >= ' ')
+      out += c;
+  }
+  return out + "\"";
+}
+
+static void SendResponse(SOCKET socket, const char *status, const std::string &body)
+{
+  char header[256];
+  int len = snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", status, unsigned(body.size()));
+  std::string response = std::string(header, len) + body;
+  for (size_t sent = 0; sent < response.size(); )
+  {
+    int n = send(socket, response.data() + sent, int(response.size() - sent), 0);
+    if (n <= 0)
+      break;
+    sent += size_t(n);
+  }
+}
+
+Result CControlServer::Start(unsigned port)
+{
+#ifdef _WIN32
+  WSADATA wsaData;
+  if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    return ErrorLog("Unable to initialize Winsock for the control endpoint.");
+#endif
+
+  SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listenSocket == INVALID_SOCKET)
+    return ErrorLog("Unable to create a socket for the control endpoint.");
+  int reuse = 1;
+  setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char *) &reuse, sizeof(reuse));
+
+  // Only reachable from this machine
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(uint16_t(port));
+  if (bind(listenSocket, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(listenSocket, 4) != 0)
+  {
+    closesocket(listenSocket);
+    return ErrorLog("Unable to listen on port %u for the control endpoint.", port);
+  }
+
+  m_listenSocket = intptr_t(listenSocket);
+  m_stop = false;
+  m_thread = std::thread(&CControlServer::Run, this);
+  InfoLog("Control endpoint listening on http://127.0.0.1:%u/.", port);
+  return Result::OKAY;
+}
+
+void CControlServer::Run()
+{
+  SOCKET listenSocket = SOCKET(m_listenSocket);
+  while (!m_stop)
+  {
+    // Wake up regularly to check whether to stop
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(listenSocket, &readable);
+    timeval timeout = { 0, 100000 };
+    if (select(int(listenSocket) + 1, &readable, NULL, NULL, &timeout) <= 0)
+      continue;
+
+    SOCKET client = accept(listenSocket, NULL, NULL);
+    if (client == INVALID_SOCKET)
+      continue;
+    HandleConnection(intptr_t(client));
+    closesocket(client);
+  }
+}
+
+void CControlServer::HandleConnection(intptr_t socket)
+{
+  SOCKET client = SOCKET(socket);
+
+  // Only the request line matters, but read the whole header so that the
+  // client is not reset while still sending it
+  std::string request;
+  char buffer[512];
+  while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE)
+  {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(client, &readable);
+    timeval timeout = { 1, 0 };
+    if (select(int(client) + 1, &readable, NULL, NULL, &timeout) <= 0)
+      return;
+    int n = recv(client, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+      return;
+    request.append(buffer, size_t(n));
+  }
+
+  // "<method> <path>[?<query>] HTTP/1.x"
+  size_t pathStart = request.find(' ');
+  if (pathStart == std::string::npos)
+    return SendResponse(client, "400 Bad Request", "{\"ok\":false,\"error\":\"bad request\"}");
+  size_t pathEnd = request.find_first_of(" ?\r\n", ++pathStart);
+  std::string path = request.substr(pathStart, pathEnd == std::string::npos ? std::string::npos : pathEnd - pathStart);
+
+  if (path == "/status")
+    return SendResponse(client, "200 OK", GetStatus());
+  for (auto &entry : s_commands)
+  {
+    if (path == entry.path)
+    {
+      std::string reply;
+      bool ok = RunCommand(entry.command, &reply);
+      std::string body = std::string("{\"ok\":") + (ok ? "true" : "false") + ",\"" + (ok ? "message" : "error") + "\":" + JSONString(reply) + "}";
+      return SendResponse(client, ok ? "200 OK" : "409 Conflict", body);
+    }
+  }
+  SendResponse(client, "404 Not Found", "{\"ok\":false,\"error\":\"unknown path; use /status, /pause, /resume, /reset, /screenshot, /save-state, or /load-state\"}");
+}
+
+std::string CControlServer::GetStatus()
+{
+  Status status;
+  FrameTotals totals;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    status = m_status;
+    totals = m_totals;
+    m_totals = FrameTotals();
+  }
+
+  char json[1024];
+  int len = snprintf(json, sizeof(json),
+    "{\"frames\":%llu,\"paused\":%s,"
+    "\"frame_ms\":{\"count\":%u,\"mean\":%.3f,\"max\":%.3f,\"late\":%u},"
+    "\"audio_underruns\":%u,\"net_board\":\"%s\"",
+    (unsigned long long) status.frames, status.paused ? "true" : "false",
+    totals.count, totals.count ? double(totals.sumMicros) / totals.count / 1000.0 : 0.0, totals.maxMicros / 1000.0, totals.late,
+    status.audioUnderRuns, status.netBoard);
+  if (status.haveTimings && len < int(sizeof(json)))
+  {
+    const FrameTimings &t = status.timings;
+    len += snprintf(json + len, sizeof(json) - len,
+      ",\"last_frame_ms\":{\"ppc\":%.3f,\"sync\":%.3f,\"render\":%.3f,\"sound\":%.3f,\"gpu\":%.3f,\"gpu_2d\":%.3f,\"gpu_resolve\":%.3f}",
+      t.ppcMicros / 1000.0, t.syncMicros / 1000.0, t.renderMicros / 1000.0, t.sndMicros / 1000.0, t.gpuMicros / 1000.0, t.tileGenMicros / 1000.0, t.resolveMicros / 1000.0);
+  }
+  std::string body(json, std::min(len, int(sizeof(json)) - 1));
+
+  // Memory accounts are read directly, they can be from any thread
+  body += ",\"memory\":[";
+  for (const Util::MemoryUsage &u: Util::GetMemoryUsage())
+  {
+    snprintf(json, sizeof(json), "%s{\"name\":\"%s\",\"cpu_bytes\":%llu,\"gpu_bytes\":%llu}",
+      body.back() == '[' ? "" : ",", u.name, (unsigned long long) u.cpuBytes, (unsigned long long) u.gpuBytes);
+    body += json;
+  }
+  return body + "]}";
+}
+
+bool CControlServer::RunCommand(Command command, std::string *reply)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_pendingCommand = command;
+  m_waiting = true;
+  m_haveReply = false;
+  m_replied.wait_for(lock, std::chrono::milliseconds(REPLY_TIMEOUT_MS), [this] { return m_haveReply || m_stop; });
+
+  // A late reply is dropped
+  m_pendingCommand = Command::None;
+  m_waiting = false;
+  if (!m_haveReply)
+  {
+    *reply = "the emulator did not respond";
+    return false;
+  }
+  *reply = m_reply;
+  return m_replyOK;
+}
+
+void CControlServer::Update(const Status &status, UINT32 frameMicros)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_status = status;
+  if (frameMicros)
+  {
+    m_totals.count++;
+    m_totals.late += frameMicros > 1.5 * m_framePeriodMicros;
+    m_totals.sumMicros += frameMicros;
+    m_totals.maxMicros = std::max(m_totals.maxMicros, frameMicros);
+  }
+}
+
+bool CControlServer::NextCommand(Command *command)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_pendingCommand == Command::None)
+    return false;
+  *command = m_pendingCommand;
+  m_pendingCommand = Command::None;
+  return true;
+}
+
+void CControlServer::Reply(bool ok, const std::string &message)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_waiting)
+      return;
+    m_haveReply = true;
+    m_replyOK = ok;
+    m_reply = message;
+  }
+  m_replied.notify_one();
+}
+
+CControlServer::CControlServer(double framePeriodMicros)
+  : m_framePeriodMicros(framePeriodMicros),
+    m_listenSocket(intptr_t(INVALID_SOCKET)),
+    m_stop(false),
+    m_pendingCommand(Command::None),
+    m_waiting(false),
+    m_haveReply(false),
+    m_replyOK(false)
+{
+}
+
+CControlServer::~CControlServer(void)
+{
+  if (m_thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_replied.notify_one();
+    m_thread.join();
+  }
+  if (m_listenSocket != intptr_t(INVALID_SOCKET))
+  {
+    closesocket(SOCKET(m_listenSocket));
+#ifdef _WIN32
+    WSACleanup();
+#endif
+  }
+}
@@ -0,0 +1,148 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+/*
+ * ControlServer.h
+ *
+ * Local HTTP endpoint for monitoring and operating a running cabinet without
+ * its keyboard, e.g. from fleet monitoring scripts. A thread of its own
+ * accepts connections on 127.0.0.1 and answers every request with a JSON
+ * object. GET /status returns frame time statistics since the previous
+ * status request, the emulator's latest timings, audio under-runs, the net
+ * board link state, and memory usage by subsystem. Any other path is a command (pause, resume, reset,
+ * screenshot, save-state, load-state) that is queued for the main loop, which
+ * carries it out between frames and replies. The server thread never touches
+ * the emulator; statistics are handed over once per frame under a lock.
+ */
+
+#ifndef INCLUDED_CONTROLSERVER_H
+#define INCLUDED_CONTROLSERVER_H
+
+#include "Supermodel.h"
+#include "Model3/Model3.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class CControlServer
+{
+public:
+  enum class Command
+  {
+    None = 0,
+    Pause,
+    Resume,
+    Reset,
+    Screenshot,
+    SaveState,  // to memory
+    LoadState   // from memory
+  };
+
+  // Per-frame state reported by the main loop
+  struct Status
+  {
+    bool          paused = false;
+    UINT64        frames = 0;         // frames run so far
+    bool          haveTimings = false;
+    FrameTimings  timings = {};       // of the last frame
+    unsigned      audioUnderRuns = 0; // since start-up
+    const char    *netBoard = "none"; // "none", "stopped", or "running"
+  };
+
+  /*
+   * Start(port):
+   *
+   * Starts listening on 127.0.0.1:port.
+   *
+   * Returns:
+   *    OKAY if listening, FAIL otherwise (with an error logged).
+   */
+  Result Start(unsigned port);
+
+  /*
+   * Update(status, frameMicros):
+   *
+   * Called by the main loop once per frame. frameMicros is the time since
+   * the previous frame, or 0 if the frame should not count towards frame
+   * time statistics (paused or fast-forwarded).
+   */
+  void Update(const Status &status, UINT32 frameMicros);
+
+  /*
+   * NextCommand(command):
+   *
+   * Called by the main loop once per frame. Returns true if a command is
+   * waiting, which must then be answered with Reply().
+   */
+  bool NextCommand(Command *command);
+
+  /*
+   * Reply(ok, message):
+   *
+   * Answers the command returned by NextCommand().
+   */
+  void Reply(bool ok, const std::string &message);
+
+  /*
+   * CControlServer(framePeriodMicros):
+   * ~CControlServer(void):
+   *
+   * Frames taking over 1.5 times framePeriodMicros are counted as late. The
+   * destructor stops the server.
+   */
+  CControlServer(double framePeriodMicros);
+  ~CControlServer(void);
+
+private:
+  struct FrameTotals
+  {
+    UINT32 count = 0;
+    UINT32 late = 0;
+    UINT64 sumMicros = 0;
+    UINT32 maxMicros = 0;
+  };
+
+  void Run();
+  void HandleConnection(intptr_t socket);
+  std::string GetStatus();
+  bool RunCommand(Command command, std::string *reply);
+
+  double              m_framePeriodMicros;
+  intptr_t            m_listenSocket;
+  std::thread         m_thread;
+  std::atomic<bool>   m_stop;
+
+  std::mutex              m_mutex;
+  std::condition_variable m_replied;
+  Status                  m_status;
+  FrameTotals             m_totals;         // since the last status request
+  Command                 m_pendingCommand;
+  bool                    m_waiting;        // for a reply to the pending or taken command
+  bool                    m_haveReply;
+  bool                    m_replyOK;
+  std::string             m_reply;
+};
+
+#endif  // INCLUDED_CONTROLSERVER_H
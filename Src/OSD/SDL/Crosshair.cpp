@@ -29,6 +29,16 @@
 #include "Inputs/Inputs.h"
 #include "Util/Format.h"
 
+static SDL_Surface* LoadRGBA(const std::string& file)
+{
+  SDL_Surface* surface = SDL_LoadBMP(file.c_str());
+  if (surface == NULL)
+    return NULL;
+  SDL_Surface* converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+  SDL_FreeSurface(surface);
+  return converted;
+}
+
 Result CCrosshair::Init()
 {
   const std::string p1CrosshairFile = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Assets) << "p1crosshair.bmp";
@@ -45,8 +55,9 @@ Result CCrosshair::Init()
     m_isBitmapCrosshair = false;
   }
 
-  SDL_Surface* surfaceCrosshairP1 = SDL_LoadBMP(p1CrosshairFile.c_str());
-  SDL_Surface* surfaceCrosshairP2 = SDL_LoadBMP(p2CrosshairFile.c_str());
+  // Converted to RGBA byte order, since OpenGL ES can't upload BGRA
+  SDL_Surface* surfaceCrosshairP1 = LoadRGBA(p1CrosshairFile);
+  SDL_Surface* surfaceCrosshairP2 = LoadRGBA(p2CrosshairFile);
   if (surfaceCrosshairP1 == NULL || surfaceCrosshairP2 == NULL)
       return Result::FAIL;
 
@@ -58,12 +69,12 @@ Result CCrosshair::Init()
   glGenTextures(2, m_crosshairTexId);
 
   glBindTexture(GL_TEXTURE_2D, m_crosshairTexId[0]);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_p1CrosshairW, m_p1CrosshairH, 0, GL_BGRA, GL_UNSIGNED_BYTE, surfaceCrosshairP1->pixels);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_p1CrosshairW, m_p1CrosshairH, 0, GL_RGBA, GL_UNSIGNED_BYTE, surfaceCrosshairP1->pixels);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
   glBindTexture(GL_TEXTURE_2D, m_crosshairTexId[1]);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_p1CrosshairW, m_p1CrosshairH, 0, GL_BGRA, GL_UNSIGNED_BYTE, surfaceCrosshairP2->pixels);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_p1CrosshairW, m_p1CrosshairH, 0, GL_RGBA, GL_UNSIGNED_BYTE, surfaceCrosshairP2->pixels);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
@@ -0,0 +1,218 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2023 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "FrameCapture.h"
+#include <csignal>
+#include <cstring>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+static const char *const k_pipeMode = "wb";
+#else
+static const char *const k_pipeMode = "w";
+#endif
+
+Result CFrameCapture::Open(const std::string &target)
+{
+  m_pipe = !target.empty() && target[0] == '|';
+  if (m_pipe)
+  {
+#ifdef SIGPIPE
+    signal(SIGPIPE, SIG_IGN);   // an encoder that exits early must not take the emulator with it
+#endif
+    m_out = popen(target.c_str() + 1, k_pipeMode);
+  }
+  else
+    m_out = fopen(target.c_str(), "wb");
+  if (nullptr == m_out)
+    return ErrorLog("Unable to open '%s' for frame capture.", m_pipe ? target.c_str() + 1 : target.c_str());
+
+  fprintf(m_out, "YUV4MPEG2 W%u H%u F%u:1000 Ip A1:1 C444\n", m_width, m_height, unsigned(m_refreshRateMilliHz));
+
+  glGenBuffers(NUM_READBACKS, m_pbos);
+  for (GLuint pbo: m_pbos)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, m_width * m_height * 4, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  m_freeFrames = CThread::CreateSemaphore(NUM_FRAMES);
+  m_queuedFrames = CThread::CreateSemaphore(0);
+  if (m_freeFrames && m_queuedFrames)
+    m_writer = CThread::CreateThread("FrameCapture", StartWriter, this);
+  if (nullptr == m_writer)
+  {
+    ErrorLog("Unable to create frame capture thread: %s", CThread::GetLastError());
+    Close();
+    return Result::FAIL;
+  }
+
+  InfoLog("Capturing %ux%u frames to '%s'.", m_width, m_height, target.c_str());
+  return Result::OKAY;
+}
+
+void CFrameCapture::Capture(GLuint readFramebuffer, unsigned width, unsigned height)
+{
+  if (nullptr == m_writer)
+    return;
+  if (width != m_width || height != m_height)
+  {
+    if (!m_warnedSize)
+      ErrorLog("Frame capture is %ux%u, skipping frames drawn at %ux%u.", m_width, m_height, width, height);
+    m_warnedSize = true;
+    return;
+  }
+
+  // The readback issued NUM_READBACKS frames ago into this PBO has long
+  // completed by now, so mapping it does not stall
+  unsigned readback = unsigned(m_captured % NUM_READBACKS);
+  if (m_captured >= NUM_READBACKS)
+    QueueReadback(readback);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[readback]);
+  glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  m_captured++;
+}
+
+void CFrameCapture::QueueReadback(unsigned readback)
+{
+  size_t size = size_t(m_width) * m_height * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[readback]);
+  const uint8_t *pixels = reinterpret_cast<const uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+  if (pixels)
+  {
+    m_freeFrames->Wait();   // only blocks when the writer is NUM_FRAMES behind
+    m_frames[m_head].assign(pixels, pixels + size);
+    m_head = (m_head + 1) % NUM_FRAMES;
+    m_queuedFrames->Post();
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void CFrameCapture::Close()
+{
+  if (m_writer)
+  {
+    // Flush the readbacks still in flight, oldest first, then end the stream
+    uint64_t first = m_captured > NUM_READBACKS ? m_captured - NUM_READBACKS : 0;
+    for (uint64_t frame = first; frame < m_captured; frame++)
+      QueueReadback(unsigned(frame % NUM_READBACKS));
+    m_freeFrames->Wait();
+    m_frames[m_head].clear();
+    m_queuedFrames->Post();
+    m_writer->Wait();
+    delete m_writer;
+    m_writer = nullptr;
+    InfoLog("Captured %llu frames.", (unsigned long long) m_captured);
+  }
+
+  if (m_pbos[0])
+    glDeleteBuffers(NUM_READBACKS, m_pbos);
+  memset(m_pbos, 0, sizeof(m_pbos));
+
+  delete m_freeFrames;
+  delete m_queuedFrames;
+  m_freeFrames = nullptr;
+  m_queuedFrames = nullptr;
+
+  if (m_out)
+  {
+    if (m_pipe)
+      pclose(m_out);
+    else
+      fclose(m_out);
+  }
+  m_out = nullptr;
+}
+
+int CFrameCapture::StartWriter(void *data)
+{
+  reinterpret_cast<CFrameCapture *>(data)->WriteFrames();
+  return 0;
+}
+
+void CFrameCapture::WriteFrames()
+{
+  while (m_queuedFrames->Wait())
+  {
+    std::vector<uint8_t> &frame = m_frames[m_tail];
+    if (frame.empty())
+      break;
+
+    if (!m_writeFailed)
+    {
+      ConvertFrame(frame.data());
+      if (fputs("FRAME\n", m_out) < 0 || fwrite(m_planes.data(), 1, m_planes.size(), m_out) != m_planes.size())
+      {
+        // Keep draining frames so that emulation is not held up
+        ErrorLog("Frame capture stopped: unable to write to the capture target.");
+        m_writeFailed = true;
+      }
+    }
+
+    m_tail = (m_tail + 1) % NUM_FRAMES;
+    m_freeFrames->Post();
+  }
+}
+
+// Converts to BT.601 limited range Y'CbCr without subsampling. OpenGL reads
+// rows back bottom to top, so they are flipped here as well.
+void CFrameCapture::ConvertFrame(const uint8_t *rgba)
+{
+  size_t planeSize = size_t(m_width) * m_height;
+  m_planes.resize(planeSize * 3);
+  uint8_t *y = m_planes.data();
+  uint8_t *u = y + planeSize;
+  uint8_t *v = u + planeSize;
+
+  for (unsigned row = 0; row < m_height; row++)
+  {
+    const uint8_t *src = rgba + size_t(m_height - 1 - row) * m_width * 4;
+    for (unsigned col = 0; col < m_width; col++, src += 4)
+    {
+      int r = src[0];
+      int g = src[1];
+      int b = src[2];
+      *y++ = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+      *u++ = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+      *v++ = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+  }
+}
+
+CFrameCapture::CFrameCapture(unsigned width, unsigned height, uint64_t refreshRateMilliHz)
+  : m_width(width),
+    m_height(height),
+    m_refreshRateMilliHz(refreshRateMilliHz)
+{
+}
+
+CFrameCapture::~CFrameCapture()
+{
+  Close();
+}
@@ -0,0 +1,112 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2023 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+/*
+ * FrameCapture.h
+ *
+ * Continuous capture of the displayed frames to a YUV4MPEG2 (.y4m) file or to
+ * an external encoder reading one from its standard input. Frames are read
+ * back asynchronously through a ring of pixel buffer objects that are only
+ * mapped a few frames later, once the GPU is done with them, and converted and
+ * written on a separate thread so that emulation never waits on the encoder
+ * unless it falls behind by more than a handful of frames.
+ */
+
+#ifndef INCLUDED_FRAMECAPTURE_H
+#define INCLUDED_FRAMECAPTURE_H
+
+#include "Supermodel.h"
+#include "OSD/Thread.h"
+#include <GL/glew.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class CFrameCapture
+{
+public:
+  /*
+   * Open(target):
+   *
+   * Starts capturing. A target beginning with '|' is a command line that the
+   * stream is piped into (e.g. "|ffmpeg -i - out.mp4"), anything else a file
+   * name.
+   *
+   * Returns:
+   *    OKAY if the target was opened, FAIL otherwise (with an error logged).
+   */
+  Result Open(const std::string &target);
+
+  /*
+   * Capture(readFramebuffer):
+   *
+   * Queues a readback of the frame just drawn into the given framebuffer (0
+   * for the window's back buffer). Must be called from the thread the OpenGL
+   * context is current on, before the buffers are swapped. Frames of another
+   * size than the one the capture was created with are skipped.
+   */
+  void Capture(GLuint readFramebuffer, unsigned width, unsigned height);
+
+  /*
+   * Close():
+   *
+   * Flushes the frames still in flight and closes the target. Called by the
+   * destructor as well, which must therefore also run with the OpenGL context
+   * current.
+   */
+  void Close();
+
+  CFrameCapture(unsigned width, unsigned height, uint64_t refreshRateMilliHz);
+  ~CFrameCapture();
+
+private:
+  static const unsigned NUM_READBACKS = 3;  // PBOs in flight; each is mapped this many frames after its readback
+  static const unsigned NUM_FRAMES = 8;     // frames queued for the writer thread
+
+  static int StartWriter(void *data);
+  void WriteFrames();
+  void ConvertFrame(const uint8_t *rgba);
+  void QueueReadback(unsigned readback);
+
+  const unsigned m_width;
+  const unsigned m_height;
+  const uint64_t m_refreshRateMilliHz;
+
+  GLuint m_pbos[NUM_READBACKS] = { 0 };
+  uint64_t m_captured = 0;
+  bool m_warnedSize = false;
+
+  // Frames from the readbacks to the writer thread (an empty frame ends the stream)
+  std::vector<uint8_t> m_frames[NUM_FRAMES];
+  unsigned m_head = 0;
+  unsigned m_tail = 0;
+  CSemaphore *m_freeFrames = nullptr;
+  CSemaphore *m_queuedFrames = nullptr;
+  CThread *m_writer = nullptr;
+
+  FILE *m_out = nullptr;
+  bool m_pipe = false;
+  bool m_writeFailed = false;
+  std::vector<uint8_t> m_planes;  // Y, U and V planes of the frame being written
+};
+
+#endif  // INCLUDED_FRAMECAPTURE_H
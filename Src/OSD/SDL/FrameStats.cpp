@@ -0,0 +1,157 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2023 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "FrameStats.h"
+#include "OSD/Audio.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+
+void CFrameStats::Histogram::Clear()
+{
+  memset(counts, 0, sizeof(counts));
+  max = 0;
+}
+
+void CFrameStats::Histogram::Add(UINT32 micros)
+{
+  counts[std::min(micros / BUCKET_MICROS, NUM_BUCKETS - 1)]++;
+  max = std::max(max, micros);
+}
+
+UINT32 CFrameStats::Histogram::Percentile(unsigned percent, UINT32 total) const
+{
+  // Upper edge of the bucket the percentile falls in, which is never more than the maximum
+  UINT64 target = (UINT64(total) * percent + 99) / 100;
+  UINT64 count = 0;
+  for (unsigned i = 0; i < NUM_BUCKETS; i++)
+  {
+    count += counts[i];
+    if (count >= target)
+      return std::min((i + 1) * BUCKET_MICROS, max);
+  }
+  return max;
+}
+
+void CFrameStats::AddFrame(UINT32 frameMicros, const FrameTimings *timings)
+{
+  m_histograms[MetricFrame].Add(frameMicros);
+  if (timings)
+  {
+    m_histograms[MetricPPC].Add(timings->ppcMicros);
+    m_histograms[MetricSync].Add(timings->syncMicros);
+    m_histograms[MetricRender].Add(timings->renderMicros);
+    m_histograms[MetricSound].Add(timings->sndMicros);
+  }
+  m_numFrames++;
+  if (frameMicros > m_framePeriodMicros * 1.5)
+    m_lateFrames++;
+
+  m_recent[m_recentPos] = frameMicros;
+  m_recentPos = (m_recentPos + 1) % NUM_RECENT;
+
+  m_elapsedMicros += frameMicros;
+  if (m_logIntervalMicros && m_elapsedMicros >= m_logIntervalMicros)
+    LogSummary();
+}
+
+void CFrameStats::LogSummary()
+{
+  static const char *names[NumMetrics] = { "frame", "PPC", "sync", "render", "sound" };
+
+  unsigned underRuns = GetAudioUnderRuns();
+  char line[512];
+  int len = snprintf(line, sizeof(line), "Frame stats over %u frames (p50/p99/max ms):", m_numFrames);
+  for (int i = 0; i < NumMetrics && len < int(sizeof(line)); i++)
+  {
+    const Histogram &h = m_histograms[i];
+    len += snprintf(line + len, sizeof(line) - len, " %s %.1f/%.1f/%.1f,", names[i],
+      h.Percentile(50, m_numFrames) / 1000.0, h.Percentile(99, m_numFrames) / 1000.0, h.max / 1000.0);
+  }
+  if (len < int(sizeof(line)))
+    snprintf(line + len, sizeof(line) - len, " late frames %u, audio under-runs %u", m_lateFrames, underRuns - m_underRuns);
+  InfoLog("%s", line);
+
+  for (Histogram &h : m_histograms)
+    h.Clear();
+  m_numFrames = 0;
+  m_lateFrames = 0;
+  m_elapsedMicros = 0;
+  m_underRuns = underRuns;
+}
+
+void CFrameStats::DrawOverlay(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes) const
+{
+  // Bars are drawn as scissored clears, so no state beyond the scissor and clear color needs to be touched
+  GLboolean scissorEnabled = glIsEnabled(GL_SCISSOR_TEST);
+  GLint scissorBox[4];
+  GLfloat clearColor[4];
+  glGetIntegerv(GL_SCISSOR_BOX, scissorBox);
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+  glEnable(GL_SCISSOR_TEST);
+
+  // The graph spans two frame periods vertically
+  int barWidth = std::max(1, int(xRes / 2 / NUM_RECENT));
+  int height = std::max(1, int(yRes / 4));
+  int x = int(xOffset) + barWidth;
+  int y = int(yOffset) + barWidth;
+  double scale = height / (2.0 * m_framePeriodMicros);
+
+  for (unsigned i = 0; i < NUM_RECENT; i++)
+  {
+    UINT32 micros = m_recent[(m_recentPos + i) % NUM_RECENT];
+    if (micros == 0)
+      continue;
+    if (micros <= m_framePeriodMicros * 1.1)
+      glClearColor(0.0f, 0.8f, 0.0f, 1.0f);
+    else if (micros <= m_framePeriodMicros * 1.5)
+      glClearColor(0.9f, 0.8f, 0.0f, 1.0f);
+    else
+      glClearColor(0.9f, 0.0f, 0.0f, 1.0f);
+    int barHeight = std::min(height, std::max(1, int(micros * scale)));
+    glScissor(x + int(i) * barWidth, y, std::max(1, barWidth - 1), barHeight);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+
+  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  glScissor(x, y + height / 2, int(NUM_RECENT) * barWidth, 1);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+  glScissor(scissorBox[0], scissorBox[1], scissorBox[2], scissorBox[3]);
+  if (!scissorEnabled)
+    glDisable(GL_SCISSOR_TEST);
+}
+
+CFrameStats::CFrameStats(double framePeriodMicros, unsigned logIntervalSeconds)
+  : m_framePeriodMicros(framePeriodMicros),
+    m_logIntervalMicros(UINT64(logIntervalSeconds) * 1000000),
+    m_numFrames(0),
+    m_lateFrames(0),
+    m_elapsedMicros(0),
+    m_underRuns(GetAudioUnderRuns()),
+    m_recentPos(0)
+{
+  for (Histogram &h : m_histograms)
+    h.Clear();
+  memset(m_recent, 0, sizeof(m_recent));
+}
@@ -0,0 +1,109 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2023 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+/*
+ * FrameStats.h
+ *
+ * Frame time statistics for keeping an eye on a running cabinet. Each frame
+ * adds its wall-clock time and the emulator's own timings to fixed-size
+ * histograms, which makes recording cheap enough to always be on. A one-line
+ * summary of the percentiles can be written to the log periodically, and the
+ * most recent frame times can be drawn over the picture as a bar graph.
+ */
+
+#ifndef INCLUDED_FRAMESTATS_H
+#define INCLUDED_FRAMESTATS_H
+
+#include "Supermodel.h"
+#include "Model3/Model3.h"
+
+class CFrameStats
+{
+public:
+  /*
+   * CFrameStats(framePeriodMicros, logIntervalSeconds):
+   *
+   * Parameters:
+   *    framePeriodMicros   Intended time between frames. Frames taking over
+   *                        1.5 times this long are counted as late.
+   *    logIntervalSeconds  How often a summary is written to the log, or 0
+   *                        to never write one.
+   */
+  CFrameStats(double framePeriodMicros, unsigned logIntervalSeconds);
+
+  /*
+   * AddFrame(frameMicros, timings):
+   *
+   * Records a frame that took frameMicros from the start of the previous
+   * one, along with the emulator's timings for it (if available).
+   */
+  void AddFrame(UINT32 frameMicros, const FrameTimings *timings);
+
+  /*
+   * DrawOverlay(xOffset, yOffset, xRes, yRes):
+   *
+   * Draws the most recent frame times as bars in the bottom left corner of
+   * the given viewport of the current framebuffer. The line across the graph
+   * marks the frame period and bars turn yellow and red as frames run over it.
+   */
+  void DrawOverlay(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes) const;
+
+private:
+  enum Metric
+  {
+    MetricFrame = 0,
+    MetricPPC,
+    MetricSync,
+    MetricRender,
+    MetricSound,
+    NumMetrics
+  };
+
+  static const unsigned BUCKET_MICROS = 100;
+  static const unsigned NUM_BUCKETS = 500;    // up to 50 ms, with longer times in the last bucket
+  static const unsigned NUM_RECENT = 120;
+
+  struct Histogram
+  {
+    UINT32 counts[NUM_BUCKETS];
+    UINT32 max;
+
+    void Clear();
+    void Add(UINT32 micros);
+    UINT32 Percentile(unsigned percent, UINT32 total) const;
+  };
+
+  double m_framePeriodMicros;
+  UINT64 m_logIntervalMicros;
+  Histogram m_histograms[NumMetrics];
+  UINT32 m_numFrames;
+  UINT32 m_lateFrames;
+  UINT64 m_elapsedMicros;
+  unsigned m_underRuns;
+  UINT32 m_recent[NUM_RECENT];
+  unsigned m_recentPos;
+
+  void LogSummary();
+};
+
+#endif  // INCLUDED_FRAMESTATS_H
@@ -69,21 +69,28 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdarg>
+#include <ctime>
 #include <memory>
 #include <vector>
 #include <algorithm>
+#include <filesystem>
 #include <GL/glew.h>
 
 #ifdef SUPERMODEL_WIN32
 #include "DirectInputSystem.h"
 #include "WinOutputs.h"
 #endif
+#ifdef __linux__
+#include "EvdevInputSystem.h"
+#endif
 
 #include "Supermodel.h"
 #include "Util/Format.h"
 #include "Util/NewConfig.h"
 #include "Util/ConfigBuilders.h"
+#include "Util/Trace.h"
 #include "OSD/FileSystemPath.h"
+#include "OSD/VariableRefresh.h"
 #include "GameLoader.h"
 #include "SDLInputSystem.h"
 #include "SDLIncludes.h"
@@ -92,15 +99,31 @@
 #include "Graphics/New3D/New3D.h"
 #include "Model3/IEmulator.h"
 #include "Model3/Model3.h"
+#include "Model3/RewindBuffer.h"
+#include "Model3/RunAhead.h"
+#ifdef NET_BOARD
+#include "Network/RollbackSession.h"
+#endif
 #include "OSD/Audio.h"
+#include "OSD/Thread.h"
 #include "Graphics/New3D/VBO.h"
 #include "Graphics/SuperAA.h"
+#include "Graphics/GLLoader.h"
+#include "Graphics/Shader.h"
 #include "Sound/MPEG/MpegAudio.h"
 
 #include <iostream>
 #include "Util/BMPFile.h"
+#include "Util/JobSystem.h"
+#include "Util/CPUFeatures.h"
+#include "Util/MemoryUsage.h"
 
 #include "Crosshair.h"
+#include "FrameCapture.h"
+#include "FrameStats.h"
+#include "ControlServer.h"
+#include "Benchmark.h"
+#include "Model3/Model3GraphicsState.h"
 
 /******************************************************************************
  Global Run-time Config
@@ -108,6 +131,7 @@
 
 static const std::string s_analysisPath = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Analysis);
 static const std::string s_configFilePath = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Config) << "Supermodel.ini";
+static const std::string s_profileFilePath = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Config) << "Profiles.ini";
 static const std::string s_gameXMLFilePath = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Config) << "Games.xml";
 static const std::string s_musicXMLFilePath = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Config) << "Music.xml";
 static const std::string s_logFilePath = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Log) << "Supermodel.log";
@@ -137,6 +161,27 @@ static CRTcolor CRTcolors = CRTcolor::None; // default to no gamma/color adaptio
  * Crosshair stuff
  */
 static CCrosshair* s_crosshair = nullptr;
+static CFrameCapture* s_capture = nullptr;
+static CFrameStats* s_frameStats = nullptr;
+static bool s_showFrameStats = false;
+static CControlServer* s_control = nullptr;
+
+// Scissor box (to clip visible area), scaled by the current supersampling factor
+static void SetGLScissor(unsigned xOff, unsigned yOff, unsigned xSize, unsigned ySize, unsigned totalXSize, unsigned totalYSize)
+{
+  UINT32 correction = (UINT32)(((ySize / 384.) * 2.) + 0.5); // due to the 2D layer compensation (2 pixels off)
+
+  glEnable(GL_SCISSOR_TEST);
+
+  if (s_runtime_config["WideScreen"].ValueAsDefault<bool>(false))
+  {
+    glScissor(0* aaValue, correction* aaValue, totalXSize * aaValue, (totalYSize - (correction * 2)) * aaValue);
+  }
+  else
+  {
+    glScissor((xOff + correction) * aaValue, (yOff + correction) * aaValue, (xSize - (correction * 2)) * aaValue, (ySize - (correction * 2)) * aaValue);
+  }
+}
 
 static Result SetGLGeometry(unsigned *xOffsetPtr, unsigned *yOffsetPtr, unsigned *xResPtr, unsigned *yResPtr, unsigned *totalXResPtr, unsigned *totalYResPtr, bool keepAspectRatio)
 {
@@ -172,7 +217,10 @@ static Result SetGLGeometry(unsigned *xOffsetPtr, unsigned *yOffsetPtr, unsigned
   // OpenGL initialization
   glViewport(0,0,*xResPtr,*yResPtr);
   glClearColor(0.0,0.0,0.0,0.0);
-  glClearDepth(1.0);
+  if (IsGLES())
+    glClearDepthf(1.0f);
+  else
+    glClearDepth(1.0);
   glDepthFunc(GL_LESS);
   glEnable(GL_DEPTH_TEST);
   glDisable(GL_CULL_FACE);
@@ -188,19 +236,7 @@ static Result SetGLGeometry(unsigned *xOffsetPtr, unsigned *yOffsetPtr, unsigned
   *xResPtr = (unsigned) xResF;
   *yResPtr = (unsigned) yResF;
 
-  UINT32 correction = (UINT32)(((*yResPtr / 384.) * 2.) + 0.5); // due to the 2D layer compensation (2 pixels off)
-
-  glEnable(GL_SCISSOR_TEST);
-
-  // Scissor box (to clip visible area)
-  if (s_runtime_config["WideScreen"].ValueAsDefault<bool>(false))
-  {
-    glScissor(0* aaValue, correction* aaValue, *totalXResPtr * aaValue, (*totalYResPtr - (correction * 2)) * aaValue);
-  }
-  else
-  {
-    glScissor((*xOffsetPtr + correction) * aaValue, (*yOffsetPtr + correction) * aaValue, (*xResPtr - (correction * 2)) * aaValue, (*yResPtr - (correction * 2)) * aaValue);
-  }
+  SetGLScissor(*xOffsetPtr, *yOffsetPtr, *xResPtr, *yResPtr, *totalXResPtr, *totalYResPtr);
   return Result::OKAY;
 }
 
@@ -209,12 +245,34 @@ static void GLAPIENTRY DebugCallback(GLenum source, GLenum type, GLuint id, GLen
     printf("OGLDebug:: 0x%X: %s\n", id, message);
 }
 
+/*
+ * Variable refresh rate:
+ *
+ * A G-Sync, FreeSync or HDMI VRR display refreshes whenever a frame is
+ * presented, so there is no need to pick between vsync judder and tearing at
+ * rates other than the display's. With VRR active, frames are presented as
+ * soon as they are rendered with vsync off and the frame timer alone paces
+ * them at exactly the emulated rate. VRR=auto enables this if the display
+ * looks VRR capable, VRR=on regardless.
+ */
+static bool s_vrr = false;
+
+static bool UseVSync()
+{
+  return s_runtime_config["VSync"].ValueAsDefault<bool>(false) && !s_vrr;
+}
+
 // In windows with an nvidia card (sorry not tested anything else) you can customise the resolution.
 // This also allows you to set a totally custom refresh rate. Apparently you can drive most monitors at
 // 57.5fps with no issues. Anyway this code will automatically pick up your custom refresh rate, and set it if it exists.
 // If it doesn't exist, then it'll probably just default to 60 or whatever your refresh rate is.
 static void SetFullScreenRefreshRate()
 {
+    // A VRR display follows the frame rate in any mode
+    if (s_vrr) {
+        return;
+    }
+
     float refreshRateHz = std::abs(s_runtime_config["RefreshRate"].ValueAs<float>());
 
     if (refreshRateHz > 57.f && refreshRateHz < 58.f) {
@@ -271,6 +329,12 @@ static Result CreateGLScreen(bool coreContext, bool quadRendering, const std::st
     return ErrorLog("Internal error: CreateGLScreen() called more than once");
   }
 
+  // OpenGL ES contexts are created through EGL, which SDL would otherwise
+  // only try on X11 after GLX
+  bool gles = s_runtime_config["GLES"].ValueAsDefault<bool>(false);
+  if (gles)
+    SDL_SetHint(SDL_HINT_VIDEO_X11_FORCE_EGL, "1");
+
   // Initialize video subsystem
   if (SDL_Init(SDL_INIT_VIDEO) != 0)
     return ErrorLog("Unable to initialize SDL video subsystem: %s\n", SDL_GetError());
@@ -291,7 +355,12 @@ static Result CreateGLScreen(bool coreContext, bool quadRendering, const std::st
   }
   SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER,1);
 
-  if (coreContext) {
+  if (gles) {
+      SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
+      SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+      SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+  }
+  else if (coreContext) {
       SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
       if (quadRendering) {
@@ -304,8 +373,9 @@ static Result CreateGLScreen(bool coreContext, bool quadRendering, const std::st
       }
   }
 
-  // Set video mode
-  s_window = SDL_CreateWindow(caption.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, *xResPtr, *yResPtr, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | (fullScreen ? SDL_WINDOW_FULLSCREEN : 0));
+  // Set video mode (headless instances keep their window hidden and only ever draw into its back buffer)
+  Uint32 visibility = s_runtime_config["Headless"].ValueAs<bool>() ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN;
+  s_window = SDL_CreateWindow(caption.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, *xResPtr, *yResPtr, SDL_WINDOW_OPENGL | visibility | (fullScreen ? SDL_WINDOW_FULLSCREEN : 0));
   if (nullptr == s_window)
   {
     ErrorLog("Unable to create an OpenGL display: %s\n", SDL_GetError());
@@ -325,23 +395,44 @@ static Result CreateGLScreen(bool coreContext, bool quadRendering, const std::st
     return Result::FAIL;
   }
 
+  // Present without vsync on a VRR display
+  std::string vrr = s_runtime_config["VRR"].ValueAs<std::string>();
+  s_vrr = vrr == "on" || (vrr == "auto" && VariableRefresh::IsCapable());
+  if (s_vrr)
+    printf("Variable refresh rate: presenting frames immediately at %1.3f Hz\n", std::abs(s_runtime_config["RefreshRate"].ValueAs<float>()));
+
   // Set vsync
-  SDL_GL_SetSwapInterval(s_runtime_config["VSync"].ValueAsDefault<bool>(false) ? 1 : 0);
+  SDL_GL_SetSwapInterval(UseVSync() ? 1 : 0);
 
   // Set the context as the current window context
   SDL_GL_MakeCurrent(s_window, context);
 
-  // Initialize GLEW, allowing us to use features beyond OpenGL 1.2
+  // Initialize GLEW, allowing us to use features beyond OpenGL 1.2. Under EGL,
+  // a GLX build of GLEW finds no GLX display, which only matters to GLX
+  // extensions.
   err = glewInit();
-  if (GLEW_OK != err)
+  if (GLEW_OK != err && !(gles && GLEW_ERROR_NO_GLX_DISPLAY == err))
   {
     ErrorLog("OpenGL initialization failed: %s\n", glewGetErrorString(err));
     return Result::FAIL;
   }
 
+  // ES 3.2 has entry points that desktop OpenGL only gained in 4.x, which
+  // GLEW leaves alone for a context that reports version 3.2
+  if (gles)
+  {
+    glClearDepthf = (PFNGLCLEARDEPTHFPROC) SDL_GL_GetProcAddress("glClearDepthf");
+    glTexStorage2DMultisample = (PFNGLTEXSTORAGE2DMULTISAMPLEPROC) SDL_GL_GetProcAddress("glTexStorage2DMultisample");
+    glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC) SDL_GL_GetProcAddress("glGetProgramBinary");
+    glProgramBinary = (PFNGLPROGRAMBINARYPROC) SDL_GL_GetProcAddress("glProgramBinary");
+    glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC) SDL_GL_GetProcAddress("glProgramParameteri");
+  }
+  EnableGLES(gles);
+
   // print some basic GPU info
   GLint profile = 0;
-  glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+  if (!gles)
+    glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
 
   printf("GPU info: %s ", glGetString(GL_VERSION));
 
@@ -353,6 +444,10 @@ static Result CreateGLScreen(bool coreContext, bool quadRendering, const std::st
       printf("(compatibility profile)");
   }
 
+  if (gles) {
+      printf("(OpenGL ES)");
+  }
+
   printf("\n\n");
 
   //glDebugMessageCallback(DebugCallback, NULL);
@@ -540,10 +635,253 @@ static void DumpPPCRegisters(IBus *bus)
 }
 #endif
 
-static void SaveFrameBuffer(const std::string& file)
+/******************************************************************************
+ Asynchronous Presentation
+
+ Frames are rendered into one of three offscreen color buffers and handed to a
+ presenter thread that owns a second, shared GL context. The presenter blits
+ the most recent completed frame to the window and performs the (possibly
+ vsync-blocking) buffer swap, so emulation never waits on the display. Frames
+ that are superseded before they are presented are dropped (mailbox style).
+******************************************************************************/
+
+static constexpr int NUM_PRESENT_BUFFERS = 3;
+
+static struct PresentState
+{
+  SDL_GLContext renderContext = nullptr;
+  SDL_GLContext presentContext = nullptr;
+  CThread *thread = nullptr;
+  CMutex *mutex = nullptr;
+  CSemaphore *ready = nullptr;
+  bool stop = false;
+  unsigned width = 0;
+  unsigned height = 0;
+
+  struct Buffer
+  {
+    GLuint texture = 0;
+    GLuint fbo = 0;       // render context framebuffer (FBOs are not shared between contexts)
+    GLsync fence = 0;     // signaled when rendering into the buffer completes
+  } buffers[NUM_PRESENT_BUFFERS];
+
+  int latest = -1;        // completed frame waiting to be presented (protected by mutex)
+  int presenting = -1;    // frame the presenter is currently displaying (protected by mutex)
+  int rendering = 0;      // frame being rendered by the emulation thread
+  int lastRendered = -1;  // most recently completed frame, for screenshots
+} s_present;
+
+static int RunPresenter(void *data)
+{
+  TRACE_THREAD("Presenter");
+  SDL_GL_MakeCurrent(s_window, s_present.presentContext);
+  SDL_GL_SetSwapInterval(UseVSync() ? 1 : 0);
+
+  GLuint readFbos[NUM_PRESENT_BUFFERS];
+  glGenFramebuffers(NUM_PRESENT_BUFFERS, readFbos);
+  for (int i = 0; i < NUM_PRESENT_BUFFERS; i++)
+  {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbos[i]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s_present.buffers[i].texture, 0);
+  }
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+  while (s_present.ready->Wait() && !s_present.stop)
+  {
+    s_present.mutex->Lock();
+    int buffer = s_present.latest;
+    s_present.latest = -1;
+    s_present.presenting = buffer;
+    s_present.mutex->Unlock();
+
+    if (buffer < 0)   // frame was already taken by an earlier wake-up
+      continue;
+
+    glWaitSync(s_present.buffers[buffer].fence, 0, GL_TIMEOUT_IGNORED);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbos[buffer]);
+    glBlitFramebuffer(0, 0, s_present.width, s_present.height, 0, 0, s_present.width, s_present.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    SDL_GL_SwapWindow(s_window);
+
+    s_present.mutex->Lock();
+    s_present.presenting = -1;
+    s_present.mutex->Unlock();
+  }
+
+  glDeleteFramebuffers(NUM_PRESENT_BUFFERS, readFbos);
+  SDL_GL_MakeCurrent(s_window, nullptr);
+  return 0;
+}
+
+static void StopPresenter()
+{
+  if (s_present.thread)
+  {
+    s_present.stop = true;
+    s_present.ready->Post();
+    s_present.thread->Wait();
+    delete s_present.thread;
+    s_present.thread = nullptr;
+  }
+
+  for (auto &buffer: s_present.buffers)
+  {
+    if (buffer.fence)
+      glDeleteSync(buffer.fence);
+    if (buffer.fbo)
+      glDeleteFramebuffers(1, &buffer.fbo);
+    if (buffer.texture)
+      glDeleteTextures(1, &buffer.texture);
+    buffer = PresentState::Buffer();
+  }
+
+  if (s_present.presentContext)
+    SDL_GL_DeleteContext(s_present.presentContext);
+  s_present.presentContext = nullptr;
+
+  delete s_present.ready;
+  delete s_present.mutex;
+  s_present.ready = nullptr;
+  s_present.mutex = nullptr;
+  s_present.latest = -1;
+  s_present.presenting = -1;
+  s_present.lastRendered = -1;
+}
+
+static bool StartPresenter(unsigned width, unsigned height)
+{
+  // The presenter context shares objects with the render context, which must
+  // remain current on the emulation thread
+  s_present.renderContext = SDL_GL_GetCurrentContext();
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+  s_present.presentContext = SDL_GL_CreateContext(s_window);
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+  SDL_GL_MakeCurrent(s_window, s_present.renderContext);
+  if (nullptr == s_present.presentContext)
+  {
+    ErrorLog("Unable to create presentation context, presenting synchronously: %s\n", SDL_GetError());
+    return false;
+  }
+
+  s_present.width = width;
+  s_present.height = height;
+  for (auto &buffer: s_present.buffers)
+  {
+    glGenTextures(1, &buffer.texture);
+    glBindTexture(GL_TEXTURE_2D, buffer.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenFramebuffers(1, &buffer.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, buffer.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, buffer.texture, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glFinish();   // textures must be complete before the presenter attaches them
+
+  s_present.stop = false;
+  s_present.mutex = CThread::CreateMutex();
+  s_present.ready = CThread::CreateSemaphore(0);
+  if (s_present.mutex && s_present.ready)
+    s_present.thread = CThread::CreateThread("Presenter", RunPresenter, nullptr);
+  if (nullptr == s_present.thread)
+  {
+    ErrorLog("Unable to create presenter thread, presenting synchronously: %s\n", CThread::GetLastError());
+    StopPresenter();
+    return false;
+  }
+  return true;
+}
+
+/******************************************************************************
+ Loader Context
+
+ A further shared context, current on a loader thread that the 3D renderer
+ links shader programs on, so that building them doesn't stall rendering.
+******************************************************************************/
+
+static GLLoader *s_loader = nullptr;
+static SDL_GLContext s_loaderContext = nullptr;
+
+static void StopLoader()
+{
+  delete s_loader;    // runs whatever is still queued first
+  s_loader = nullptr;
+
+  if (s_loaderContext)
+    SDL_GL_DeleteContext(s_loaderContext);
+  s_loaderContext = nullptr;
+}
+
+static bool StartLoader()
+{
+  SDL_GLContext renderContext = SDL_GL_GetCurrentContext();
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+  s_loaderContext = SDL_GL_CreateContext(s_window);
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+  SDL_GL_MakeCurrent(s_window, renderContext);
+  if (nullptr == s_loaderContext)
+  {
+    ErrorLog("Unable to create loader context, linking shaders on the render thread: %s\n", SDL_GetError());
+    return false;
+  }
+
+  s_loader = new GLLoader(
+    [] { TRACE_THREAD("Loader"); return SDL_GL_MakeCurrent(s_window, s_loaderContext) == 0; },
+    [] { SDL_GL_MakeCurrent(s_window, nullptr); });
+  if (!s_loader->Start())
+  {
+    ErrorLog("Unable to start the loader thread, linking shaders on the render thread: %s\n", SDL_GetError());
+    StopLoader();
+    return false;
+  }
+  return true;
+}
+
+// Returns the framebuffer the next frame should be rendered into. Never blocks:
+// with three buffers one is always neither waiting nor being presented.
+static GLuint AcquirePresentBuffer()
+{
+  s_present.mutex->Lock();
+  int buffer = 0;
+  while (buffer == s_present.latest || buffer == s_present.presenting)
+    buffer++;
+  s_present.mutex->Unlock();
+
+  s_present.rendering = buffer;
+  return s_present.buffers[buffer].fbo;
+}
+
+static void QueuePresentBuffer()
+{
+  auto &buffer = s_present.buffers[s_present.rendering];
+  if (buffer.fence)
+    glDeleteSync(buffer.fence);
+  buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();    // fence must reach the GPU before another context waits on it
+
+  s_present.mutex->Lock();
+  s_present.latest = s_present.rendering;   // replaces any frame not yet presented
+  s_present.mutex->Unlock();
+  s_present.lastRendered = s_present.rendering;
+  s_present.ready->Post();
+}
+
+// Reads back the last frame displayed as RGBA8
+static std::shared_ptr<uint8_t> ReadFrameBuffer()
 {
     std::shared_ptr<uint8_t> pixels(new uint8_t[totalXRes * totalYRes * 4], std::default_delete<uint8_t[]>());
+    if (s_present.thread && s_present.lastRendered >= 0)
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, s_present.buffers[s_present.lastRendered].fbo);
     glReadPixels(0, 0, totalXRes, totalYRes, GL_RGBA, GL_UNSIGNED_BYTE, pixels.get());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    return pixels;
+}
+
+static void SaveFrameBuffer(const std::string& file)
+{
+    std::shared_ptr<uint8_t> pixels = ReadFrameBuffer();
     Util::WriteSurfaceToBMP<Util::RGBA8>(file, pixels.get(), totalXRes, totalYRes, true);
 }
 
@@ -571,13 +909,55 @@ void Screenshot()
     SaveFrameBuffer(file);
 }
 
+static void SavePowerPCTrace()
+{
+  std::string file = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Log) << "Supermodel.ppctrace.txt";
+  if (ppc_save_trace(file.c_str()))
+    printf("PowerPC trace saved: %s\n", file.c_str());
+  else
+    ErrorLog("Unable to save PowerPC trace to '%s'.", file.c_str());
+}
+
+/*
+ * StoreProfile(benchmark, game):
+ *
+ * Replaces the game's section of the profile file with the settings the
+ * benchmark recommends. The other games' sections are kept.
+ */
+static void StoreProfile(const CBenchmark &benchmark, const Game &game)
+{
+  Util::Config::Node profiles("Global");
+  if (std::filesystem::exists(s_profileFilePath))
+    Util::Config::FromINIFile(&profiles, s_profileFilePath);
+  Util::Config::Node *section = profiles.TryGet(game.name);
+  if (section == nullptr)
+    section = &profiles.Add(game.name);
+  if (!benchmark.Recommend(s_runtime_config, section))
+  {
+    ErrorLog("No timings to recommend settings for '%s' from.", game.name.c_str());
+    return;
+  }
+  Util::Config::WriteINIFile(s_profileFilePath, profiles,
+    ";\n; Profiles.ini\n;\n; Settings recommended for each game on this host by -bench-profile, applied\n; over the global section of Supermodel.ini. Delete a section to drop it.\n;");
+}
+
+#ifdef SUPERMODEL_TRACE
+static void SaveTrace()
+{
+  std::string file = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Log) << "Supermodel.trace.json";
+  if (Util::Trace::Save(file))
+    printf("Trace saved: %s\n", file.c_str());
+  else
+    ErrorLog("Unable to save trace to '%s'.", file.c_str());
+}
+#endif
+
 /******************************************************************************
  Render State Analysis
 ******************************************************************************/
 
 #ifdef DEBUG
 
-#include "Model3/Model3GraphicsState.h"
 #include "OSD/SDL/PolyAnalysis.h"
 #include <fstream>
 
@@ -700,17 +1080,52 @@ static void TestPolygonHeaderBits(IEmulator *Emu)
 static const int STATE_FILE_VERSION = 4;  // save state file version
 static const int NVRAM_FILE_VERSION = 0;  // NVRAM file version
 static unsigned s_saveSlot = 0;           // save state slot #
+static const unsigned REWIND_CAPTURE_FRAMES = 60; // frames between rewind states
+static const unsigned REWIND_KEYFRAME_INTERVAL = 10;  // rewind states per keyframe
+static const unsigned FAST_FORWARD_RENDER_INTERVAL = 8; // frames per rendered frame while fast-forwarding
+static const unsigned AUTO_FRAMESKIP_MAX = 4;   // most frames in a row left unrendered by automatic frameskip
+
+// Save states are captured in memory and then compressed and written out by
+// a background thread, one at a time
+static struct StateWriter
+{
+  CThread *thread = nullptr;
+  CBlockFile::MemoryImage image;
+  std::string filePath;
+} s_stateWriter;
+
+static int WriteStateFile(void *data)
+{
+  const std::string &file_path = s_stateWriter.filePath;
+  if (Result::OKAY != CBlockFile::WriteCompressed(file_path, s_stateWriter.image.data.data(), s_stateWriter.image.data.size()))
+  {
+    ErrorLog("Unable to save state to '%s'.", file_path.c_str());
+    return 1;
+  }
+  printf("Saved state to '%s'.\n", file_path.c_str());
+  DebugLog("Saved state to '%s'.\n", file_path.c_str());
+  return 0;
+}
+
+static void WaitForStateWriter()
+{
+  if (s_stateWriter.thread)
+  {
+    s_stateWriter.thread->Wait();
+    delete s_stateWriter.thread;
+    s_stateWriter.thread = nullptr;
+  }
+}
 
 static void SaveState(IEmulator *Model3)
 {
   CBlockFile  SaveState;
 
+  // The image is reused, so any previous state must be written out first
+  WaitForStateWriter();
+
   std::string file_path = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Saves) << Model3->GetGame().name << ".st" << s_saveSlot;
-  if (Result::OKAY != SaveState.Create(file_path, "Supermodel Save State", "Supermodel Version " SUPERMODEL_VERSION))
-  {
-    ErrorLog("Unable to save state to '%s'.", file_path.c_str());
-    return;
-  }
+  SaveState.CreateInMemory(&s_stateWriter.image, "Supermodel Save State", "Supermodel Version " SUPERMODEL_VERSION);
 
   // Write file format version and ROM set ID to header block
   int32_t fileVersion = STATE_FILE_VERSION;
@@ -720,14 +1135,59 @@ static void SaveState(IEmulator *Model3)
   // Save state
   Model3->SaveState(&SaveState);
   SaveState.Close();
-  printf("Saved state to '%s'.\n", file_path.c_str());
-  DebugLog("Saved state to '%s'.\n", file_path.c_str());
+
+  s_stateWriter.filePath = file_path;
+  s_stateWriter.thread = CThread::CreateThread("StateWriter", WriteStateFile, nullptr);
+  if (nullptr == s_stateWriter.thread)
+    WriteStateFile(nullptr);
+}
+
+// Graphics states captured for -replay-gfx are numbered files sharing a base
+// name, one per frame, holding just the Real3D and tile generator blocks
+static CBlockFile::MemoryImage s_gfxStateImage;
+
+static std::string GetGraphicsStatePath(const std::string &base, unsigned frame)
+{
+  return Util::Format() << base << "." << frame;
+}
+
+static void SaveGraphicsState(CModel3 *Model3, const std::string &file_path)
+{
+  CBlockFile  SaveState;
+
+  SaveState.CreateInMemory(&s_gfxStateImage, "Supermodel Save State", "Supermodel Version " SUPERMODEL_VERSION);
+  int32_t fileVersion = STATE_FILE_VERSION;
+  SaveState.Write(&fileVersion, sizeof(fileVersion));
+  SaveState.Write(Model3->GetGame().name);
+  Model3->SaveGraphicsState(&SaveState);
+  SaveState.Close();
+
+  if (Result::OKAY != CBlockFile::WriteCompressed(file_path, s_gfxStateImage.data.data(), s_gfxStateImage.data.size()))
+    ErrorLog("Unable to save graphics state to '%s'.", file_path.c_str());
+}
+
+static std::vector<std::string> FindGraphicsStates(const std::string &base)
+{
+  std::vector<std::string> files;
+  for (unsigned frame = 0; ; frame++)
+  {
+    std::string file = GetGraphicsStatePath(base, frame);
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (fp == NULL)
+      break;
+    fclose(fp);
+    files.push_back(file);
+  }
+  return files;
 }
 
 static void LoadState(IEmulator *Model3, std::string file_path = std::string())
 {
   CBlockFile  SaveState;
 
+  // A state still being written may be the one to load
+  WaitForStateWriter();
+
   // Generate file path
   if (file_path.empty())
     file_path = Util::Format() << FileSystemPath::GetPath(FileSystemPath::Saves) << Model3->GetGame().name << ".st" << s_saveSlot;
@@ -760,16 +1220,106 @@ static void LoadState(IEmulator *Model3, std::string file_path = std::string())
   DebugLog("Loaded state from '%s'.\n", file_path.c_str());
 }
 
-static void SaveNVRAM(IEmulator *Model3)
+// Held for the control endpoint's save-state and load-state commands
+static CBlockFile::MemoryImage s_controlStateImage;
+
+static void SaveStateToMemory(IEmulator *Model3, CBlockFile::MemoryImage *image = &s_controlStateImage)
 {
-  CBlockFile  NVRAM;
+  CBlockFile  SaveState;
 
-  std::string file_path = Util::Format() << FileSystemPath::GetPath(FileSystemPath::NVRAM) << Model3->GetGame().name << ".nv";
-  if (Result::OKAY != NVRAM.Create(file_path, "Supermodel NVRAM State", "Supermodel Version " SUPERMODEL_VERSION))
+  SaveState.CreateInMemory(image, "Supermodel Save State", "Supermodel Version " SUPERMODEL_VERSION);
+  int32_t fileVersion = STATE_FILE_VERSION;
+  SaveState.Write(&fileVersion, sizeof(fileVersion));
+  SaveState.Write(Model3->GetGame().name);
+  Model3->SaveState(&SaveState);
+  SaveState.Close();
+}
+
+static bool LoadStateFromMemory(IEmulator *Model3, const std::vector<uint8_t> &data = s_controlStateImage.data)
+{
+  CBlockFile  SaveState;
+
+  if (data.empty())
+    return false;
+  SaveState.LoadFromMemory(data.data(), data.size());
+  if (Result::OKAY != SaveState.FindBlock("Supermodel Save State"))
+    return false;
+  int32_t fileVersion = 0;
+  SaveState.Read(&fileVersion, sizeof(fileVersion));
+  if (fileVersion != STATE_FILE_VERSION)
+    return false;
+  Model3->LoadState(&SaveState);
+  SaveState.Close();
+  return true;
+}
+
+// NVRAM is also saved while running, a few seconds at most after the game
+// changes it, so that little is lost if the machine loses power. It is
+// captured in memory between frames and written out by a background thread
+static struct NVRAMWriter
+{
+  CThread *thread = nullptr;
+  CBlockFile::MemoryImage image;
+  std::string filePath;
+} s_nvramWriter;
+
+// Writes to a temporary file that then replaces the old one, so that a
+// complete NVRAM file exists at all times
+static bool WriteNVRAMFile()
+{
+  const std::string &file_path = s_nvramWriter.filePath;
+  const std::vector<uint8_t> &data = s_nvramWriter.image.data;
+  std::string tmp_path = FileSystemPath::GetTempFilePath(file_path);
+  FILE *fp = fopen(tmp_path.c_str(), "wb");
+  bool error = NULL == fp;
+  if (fp)
   {
-    ErrorLog("Unable to save NVRAM to '%s'. Make sure directory exists!", file_path.c_str());
-    return;
+    error = fwrite(data.data(), 1, data.size(), fp) != data.size();
+    error = (fclose(fp) != 0) || error;
+  }
+  std::error_code ec;
+  if (!error)
+    std::filesystem::rename(tmp_path, file_path, ec);  // replaces the old file in one step, unlike std::rename() on Windows
+  if (error || ec)
+  {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+static int WriteNVRAMCheckpoint(void *data)
+{
+  const std::string &file_path = s_nvramWriter.filePath;
+  if (!WriteNVRAMFile())
+  {
+    ErrorLog("Unable to save NVRAM to '%s'.", file_path.c_str());
+    return 1;
+  }
+  DebugLog("Checkpointed NVRAM to '%s'.\n", file_path.c_str());
+  return 0;
+}
+
+static void WaitForNVRAMWriter()
+{
+  if (s_nvramWriter.thread)
+  {
+    s_nvramWriter.thread->Wait();
+    delete s_nvramWriter.thread;
+    s_nvramWriter.thread = nullptr;
   }
+}
+
+// Returns whether the NVRAM differs from when it was last captured
+static bool CaptureNVRAM(IEmulator *Model3)
+{
+  CBlockFile  NVRAM;
+
+  // The image is reused, so any previous checkpoint must be written out first
+  WaitForNVRAMWriter();
+
+  s_nvramWriter.filePath = Util::Format() << FileSystemPath::GetPath(FileSystemPath::NVRAM) << Model3->GetGame().name << ".nv";
+  NVRAM.CreateInMemory(&s_nvramWriter.image, "Supermodel NVRAM State", "Supermodel Version " SUPERMODEL_VERSION);
 
   // Write file format version and ROM set ID to header block
   int32_t fileVersion = NVRAM_FILE_VERSION;
@@ -779,6 +1329,29 @@ static void SaveNVRAM(IEmulator *Model3)
   // Save NVRAM
   Model3->SaveNVRAM(&NVRAM);
   NVRAM.Close();
+
+  const std::vector<uint8_t> &touched = s_nvramWriter.image.touchedPages;
+  return std::any_of(touched.begin(), touched.end(), [](uint8_t page) { return page != 0; });
+}
+
+static void CheckpointNVRAM(IEmulator *Model3)
+{
+  if (!CaptureNVRAM(Model3))
+    return;
+  s_nvramWriter.thread = CThread::CreateThread("NVRAMWriter", WriteNVRAMCheckpoint, nullptr);
+  if (nullptr == s_nvramWriter.thread)
+    WriteNVRAMCheckpoint(nullptr);
+}
+
+static void SaveNVRAM(IEmulator *Model3)
+{
+  CaptureNVRAM(Model3);
+  const std::string &file_path = s_nvramWriter.filePath;
+  if (!WriteNVRAMFile())
+  {
+    ErrorLog("Unable to save NVRAM to '%s'. Make sure directory exists!", file_path.c_str());
+    return;
+  }
   DebugLog("Saved NVRAM to '%s'.\n", file_path.c_str());
 }
 
@@ -816,6 +1389,91 @@ static void LoadNVRAM(IEmulator *Model3)
   DebugLog("Loaded NVRAM from '%s'.\n", file_path.c_str());
 }
 
+/*
+ * Fast boot: the first time a game runs undisturbed for FastBootFrames frames
+ * after power-on, its state is kept in the cache directory and loaded right
+ * after every later power-on, skipping the self-test. The snapshot is tied
+ * to the ROMs, to the NVRAM contents at power-on and to the settings that
+ * change what the game sees; if any of them differ, a new one is taken.
+ * The NVRAM in the snapshot is what the game made of the loaded NVRAM while
+ * booting, so it replaces it and is saved on exit as usual.
+ */
+static std::string GetBootStatePath(const Game &game)
+{
+  return Util::Format() << FileSystemPath::GetPath(FileSystemPath::Cache) << game.name << ".boot";
+}
+
+// Settings that change what the game sees, so that runs with different ones can't be expected to match
+static std::string GetEmulationSettingsKey()
+{
+  return Util::Format() << s_runtime_config["PowerPCFrequency"].ValueAsDefault<unsigned>(0)
+    << ':' << s_runtime_config["PowerPCFastFPU"].ValueAs<bool>()
+    << ':' << s_runtime_config["EmulateSound"].ValueAs<bool>()
+    << ':' << s_runtime_config["EmulateDSB"].ValueAs<bool>()
+    << ':' << s_runtime_config["ForceFeedback"].ValueAs<bool>();
+}
+
+static uint64_t GetInputRecordingKey()
+{
+  std::string key = GetEmulationSettingsKey();
+  return CBenchmark::Hash(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+}
+
+static uint64_t GetBootKey(IEmulator *Model3, const std::string &romKey)
+{
+  CBlockFile::MemoryImage image;
+  CBlockFile  NVRAM;
+  NVRAM.CreateInMemory(&image, "Supermodel NVRAM State", "Supermodel Version " SUPERMODEL_VERSION);
+  Model3->SaveNVRAM(&NVRAM);
+  NVRAM.Close();
+
+  std::string key = Util::Format() << SUPERMODEL_VERSION << ':' << STATE_FILE_VERSION << ':' << romKey
+    << ':' << Util::Hex(CBenchmark::Hash(image.data.data(), image.data.size()))
+    << ':' << GetEmulationSettingsKey();
+  return CBenchmark::Hash(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+}
+
+static void SaveBootState(IEmulator *Model3, uint64_t bootKey)
+{
+  CBlockFile::MemoryImage image;
+  CBlockFile  SaveState;
+
+  std::string file_path = GetBootStatePath(Model3->GetGame());
+  SaveState.CreateInMemory(&image, "Supermodel Save State", "Supermodel Version " SUPERMODEL_VERSION);
+  int32_t fileVersion = STATE_FILE_VERSION;
+  SaveState.Write(&fileVersion, sizeof(fileVersion));
+  SaveState.Write(&bootKey, sizeof(bootKey));
+  SaveState.Write(Model3->GetGame().name);
+  Model3->SaveState(&SaveState);
+  SaveState.Close();
+
+  if (Result::OKAY != CBlockFile::WriteCompressed(file_path, image.data.data(), image.data.size()))
+    ErrorLog("Unable to save boot state to '%s'.", file_path.c_str());
+  else
+    DebugLog("Saved boot state to '%s'.\n", file_path.c_str());
+}
+
+static bool LoadBootState(IEmulator *Model3, uint64_t bootKey)
+{
+  CBlockFile  SaveState;
+
+  // A missing or stale snapshot is expected and simply taken again
+  std::string file_path = GetBootStatePath(Model3->GetGame());
+  if (Result::OKAY != SaveState.Load(file_path) || Result::OKAY != SaveState.FindBlock("Supermodel Save State"))
+    return false;
+  int32_t fileVersion = 0;
+  uint64_t key = 0;
+  SaveState.Read(&fileVersion, sizeof(fileVersion));
+  SaveState.Read(&key, sizeof(key));
+  if (fileVersion != STATE_FILE_VERSION || key != bootKey)
+    return false;
+
+  Model3->LoadState(&SaveState);
+  SaveState.Close();
+  DebugLog("Loaded boot state from '%s'.\n", file_path.c_str());
+  return true;
+}
+
 
 /*
 static void PrintGLError(GLenum error)
@@ -835,6 +1493,86 @@ static void PrintGLError(GLenum error)
 }
 */
 
+/******************************************************************************
+ Paused Frame
+
+ While paused, the last frame rendered is kept in a texture and shown again
+ each time around the main loop, with the crosshairs and overlays drawn over
+ it afresh, rather than rendering the whole frame again. The main loop also
+ sleeps until there is input, so a paused emulator leaves the GPU and CPU idle.
+******************************************************************************/
+
+static const unsigned PAUSED_EVENT_WAIT_MS = 100;  // longest wait for input while paused, so control commands are still served
+
+static struct PausedFrame
+{
+  GLuint texture = 0;
+  GLuint fbo = 0;
+  unsigned width = 0;
+  unsigned height = 0;
+  bool capture = false;   // keep the next frame rendered
+  bool valid = false;
+} s_pausedFrame;
+
+static void ReleasePausedFrame()
+{
+  if (s_pausedFrame.fbo)
+    glDeleteFramebuffers(1, &s_pausedFrame.fbo);
+  if (s_pausedFrame.texture)
+    glDeleteTextures(1, &s_pausedFrame.texture);
+  s_pausedFrame = PausedFrame();
+}
+
+static void CopyFrame(GLuint source, GLuint target)
+{
+  // The scissor box is left set to the game area, but borders are part of the frame too
+  GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+  glDisable(GL_SCISSOR_TEST);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+  glBlitFramebuffer(0, 0, totalXRes, totalYRes, 0, 0, totalXRes, totalYRes, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  if (scissor)
+    glEnable(GL_SCISSOR_TEST);
+}
+
+// Keeps the frame in the given framebuffer, before anything is drawn over it
+static void CapturePausedFrame(GLuint source)
+{
+  if (s_pausedFrame.width != totalXRes || s_pausedFrame.height != totalYRes)
+  {
+    ReleasePausedFrame();
+    s_pausedFrame.width = totalXRes;
+    s_pausedFrame.height = totalYRes;
+    glGenTextures(1, &s_pausedFrame.texture);
+    glBindTexture(GL_TEXTURE_2D, s_pausedFrame.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, totalXRes, totalYRes, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &s_pausedFrame.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, s_pausedFrame.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s_pausedFrame.texture, 0);
+  }
+
+  CopyFrame(source, s_pausedFrame.fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, source);
+  s_pausedFrame.valid = true;
+}
+
+// Shows the kept frame again in place of rendering one. Returns false if there is none.
+static bool ShowPausedFrame()
+{
+  if (!s_pausedFrame.valid)
+    return false;
+
+  CopyFrame(s_pausedFrame.fbo, s_present.thread ? s_present.buffers[s_present.rendering].fbo : 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  EndFrameVideo();
+  return true;
+}
+
+
 /******************************************************************************
  Video Callbacks
 ******************************************************************************/
@@ -849,12 +1587,31 @@ bool BeginFrameVideo()
 
 void EndFrameVideo()
 {
+  if (s_present.thread)
+    glBindFramebuffer(GL_FRAMEBUFFER, s_present.buffers[s_present.rendering].fbo);
+
+  if (s_pausedFrame.capture)
+    CapturePausedFrame(s_present.thread ? s_present.buffers[s_present.rendering].fbo : 0);
+
   // Show crosshairs for light gun games
   if (videoInputs)
     s_crosshair->Update(currentInputs, videoInputs, xOffset, yOffset, xRes, yRes);
 
-  // Swap the buffers
-  SDL_GL_SwapWindow(s_window);
+  if (s_capture)
+    s_capture->Capture(s_present.thread ? s_present.buffers[s_present.rendering].fbo : 0, totalXRes, totalYRes);
+
+  // Frame time graph, drawn after the capture so it never ends up in recordings
+  if (s_showFrameStats && s_frameStats)
+    s_frameStats->DrawOverlay(xOffset, yOffset, xRes, yRes);
+
+  // Swap the buffers, or hand the frame to the presenter thread
+  if (s_present.thread)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    QueuePresentBuffer();
+  }
+  else
+    SDL_GL_SwapWindow(s_window);
 }
 
 
@@ -873,6 +1630,130 @@ static uint64_t GetDesiredRefreshRateMilliHz()
   return refreshRateMilliHz;
 }
 
+/*
+ * Dynamic resolution:
+ *
+ * Steps the supersampling factor between MinSupersampling and Supersampling
+ * so that the GPU time of a frame fits in the refresh period. GPU time is
+ * averaged over a window of frames. The factor is lowered when the average
+ * is close to the budget and raised when the larger render target is
+ * expected to fit comfortably (GPU time scales with the number of samples).
+ * After a change, the renderers are recreated and measuring pauses for a
+ * while so the new target can settle.
+ */
+struct DynamicResolution
+{
+  bool      enabled = false;
+  int       minAA = 1;
+  int       maxAA = 1;
+  uint64_t  budgetMicros = 0; // frame period at the desired refresh rate
+  uint64_t  sumMicros = 0;    // GPU time accumulated in the current window
+  unsigned  frames = 0;       // frames in the current window
+  unsigned  cooldown = 0;     // frames left to wait after a change
+};
+
+static void InitDynamicResolution(DynamicResolution *dr)
+{
+  dr->enabled = s_runtime_config["DynamicResolution"].ValueAs<bool>();
+  dr->maxAA = aaValue;
+  dr->minAA = std::clamp(s_runtime_config["MinSupersampling"].ValueAs<int>(), 1, aaValue);
+  dr->budgetMicros = 1000000000ULL / std::max<uint64_t>(1, GetDesiredRefreshRateMilliHz());
+  dr->sumMicros = 0;
+  dr->frames = 0;
+  dr->cooldown = 0;
+  if (dr->enabled && dr->minAA == dr->maxAA)
+    dr->enabled = false;  // nothing to step between
+}
+
+// Returns the supersampling factor to use from the next frame on
+static int UpdateDynamicResolution(DynamicResolution *dr, UINT32 gpuMicros, int aa)
+{
+  if (!dr->enabled || gpuMicros == 0)
+    return aa;
+  if (dr->cooldown > 0)
+  {
+    dr->cooldown--;
+    return aa;
+  }
+
+  dr->sumMicros += gpuMicros;
+  if (++dr->frames < 30)
+    return aa;
+  uint64_t avgMicros = dr->sumMicros / dr->frames;
+  dr->sumMicros = 0;
+  dr->frames = 0;
+
+  int newAA = aa;
+  if (avgMicros * 10 > dr->budgetMicros * 9 && aa > dr->minAA)
+    newAA = aa - 1;
+  else if (aa < dr->maxAA && avgMicros * (aa + 1) * (aa + 1) * 10 < dr->budgetMicros * aa * aa * 7)
+    newAA = aa + 1;
+
+  if (newAA != aa)
+    dr->cooldown = 120;
+  return newAA;
+}
+
+// Frame pacing state. The OS sleep is trusted until spinTicks before the
+// target, after which we spin. spinTicks follows the worst recent sleep
+// overshoot and decays slowly, so it shrinks on systems with accurate timers.
+static struct FramePacer
+{
+  int64_t spinTicks = 0;
+  int64_t minSpinTicks = 0;
+  int64_t maxSpinTicks = 0;
+  int64_t workTicks = 0;      // recent worst frame time from input poll to end of frame
+#ifdef SUPERMODEL_WIN32
+  HANDLE timer = nullptr;
+#endif
+} s_pacer;
+
+static void InitFramePacer()
+{
+  s_pacer.minSpinTicks = int64_t(s_perfCounterFrequency / 20000);   // 50 us
+  s_pacer.maxSpinTicks = int64_t(s_perfCounterFrequency / 500);     // 2 ms
+  s_pacer.spinTicks = s_pacer.maxSpinTicks;
+  s_pacer.workTicks = 0;
+
+#ifdef SUPERMODEL_WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+  // High resolution waitable timers are available from Windows 10 1803 on
+  if (nullptr == s_pacer.timer)
+    s_pacer.timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+  if (nullptr == s_pacer.timer)
+    s_pacer.timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+#endif
+}
+
+// Sleeps for approximately the given number of performance counter ticks
+static void OSSleep(int64_t ticks)
+{
+  ticks = std::min(ticks, int64_t(s_perfCounterFrequency));    // at most 1 second, avoids overflow below
+  int64_t ns = ticks * 1000000000 / int64_t(s_perfCounterFrequency);
+
+#if defined(SUPERMODEL_WIN32)
+  if (s_pacer.timer)
+  {
+    LARGE_INTEGER due;
+    due.QuadPart = -(ns / 100);   // negative is relative, in 100 ns units
+    if (SetWaitableTimer(s_pacer.timer, &due, 0, nullptr, nullptr, FALSE))
+    {
+      WaitForSingleObject(s_pacer.timer, INFINITE);
+      return;
+    }
+  }
+  SDL_Delay(1);
+#elif defined(__linux__)
+  timespec ts = { time_t(ns / 1000000000), long(ns % 1000000000) };
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, nullptr);
+#else
+  timespec ts = { time_t(ns / 1000000000), long(ns % 1000000000) };
+  nanosleep(&ts, nullptr);
+#endif
+}
+
 static void SuperSleepUntil(const uint64_t target)
 {
   uint64_t time = SDL_GetPerformanceCounter();
@@ -883,12 +1764,18 @@ static void SuperSleepUntil(const uint64_t target)
     return;
   }
 
-  // Because OS sleep is not accurate,
-  // we actually sleep until a maximum of 2 milliseconds are left.
-  while (int64_t(target - time) * 1000 > 2 * int64_t(s_perfCounterFrequency))
+  // Because OS sleep is not accurate, we only sleep until the spin window is
+  // left, widening it whenever a sleep overshoots by more than it allows
+  while (int64_t(target - time) > s_pacer.spinTicks)
   {
-    SDL_Delay(1);
-    time = SDL_GetPerformanceCounter();
+    int64_t request = int64_t(target - time) - s_pacer.spinTicks;
+    OSSleep(request);
+    uint64_t woke = SDL_GetPerformanceCounter();
+    int64_t overshoot = int64_t(woke - time) - request;
+    s_pacer.spinTicks -= s_pacer.spinTicks / 64;
+    s_pacer.spinTicks = std::max(s_pacer.spinTicks, overshoot + overshoot / 4);
+    s_pacer.spinTicks = std::min(std::max(s_pacer.spinTicks, s_pacer.minSpinTicks), s_pacer.maxSpinTicks);
+    time = woke;
   }
 
   // Spin until requested time
@@ -910,6 +1797,32 @@ static void SuperSleepUntil(const uint64_t target)
  Main Program Loop
 ******************************************************************************/
 
+// Creates the 2D and 3D renderers for the current geometry and supersampling factor and attaches them to the emulator
+static Result CreateRenderers(IEmulator *Model3, SuperAA *superAA, CRender2D **Render2D, IRender3D **Render3D, UpscaleMode upscaleMode)
+{
+  superAA->Init(totalXRes, totalYRes);  // pass actual frame sizes here
+  *Render2D = new CRender2D(s_runtime_config);
+  if (s_runtime_config["New3DEngine"].ValueAs<bool>())
+  {
+    New3D::CNew3D *new3D = new New3D::CNew3D(s_runtime_config, Model3->GetGame().name);
+    new3D->SetLoader(s_loader);
+    *Render3D = new3D;
+  }
+  else
+    *Render3D = new Legacy3D::CLegacy3D(s_runtime_config);
+
+  if (Result::OKAY != (*Render2D)->Init(xOffset * aaValue, yOffset * aaValue, xRes * aaValue, yRes * aaValue, totalXRes * aaValue, totalYRes * aaValue, superAA->GetTargetID(), upscaleMode))
+    return Result::FAIL;
+  if (Result::OKAY != (*Render3D)->Init(xOffset * aaValue, yOffset * aaValue, xRes * aaValue, yRes * aaValue, totalXRes * aaValue, totalYRes * aaValue, superAA->GetTargetID()))
+    return Result::FAIL;
+
+  if (s_runtime_config["SinglePassComposite"].ValueAs<bool>())
+    (*Render2D)->AttachCompositeLayers(*Render3D);
+
+  Model3->AttachRenderers(*Render2D, *Render3D, superAA);
+  return Result::OKAY;
+}
+
 #ifdef SUPERMODEL_DEBUGGER
 int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *Inputs, COutputs *Outputs, std::shared_ptr<Debugger::CDebugger> Debugger)
 {
@@ -920,11 +1833,39 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
 #endif // SUPERMODEL_DEBUGGER
   std::string initialState = s_runtime_config["InitStateFile"].ValueAs<std::string>();
   uint64_t    prevFPSTicks;
+  uint64_t    prevFrameStartTime;
   unsigned    fpsFramesElapsed;
   bool        gameHasLightguns = false;
   bool        quit = false;
   bool        paused = false;
   bool        dumpTimings = false;
+  std::unique_ptr<CRewindBuffer> rewindBuffer;
+  unsigned    rewindFrames = 0;
+  std::unique_ptr<CRunAhead> runAhead;
+  unsigned    fastForwardFrames = 0;
+  // Skipped frames don't produce line-of-sight results, so which frames are skipped would change what games see
+  bool        autoFrameskip = s_runtime_config["AutoFrameskip"].ValueAs<bool>() && !s_runtime_config["Deterministic"].ValueAs<bool>();
+  bool        behindSchedule = false;
+  unsigned    skippedFrames = 0;
+  std::unique_ptr<CInputRecording> inputRecording;
+  std::unique_ptr<CBenchmark> benchmark;
+  std::string recordGfx = s_runtime_config["RecordGfx"].ValueAs<std::string>();
+  unsigned    recordGfxFrames = recordGfx.empty() ? 0 : s_runtime_config["RecordGfxFrames"].ValueAs<unsigned>();
+  unsigned    recordedGfxFrames = 0;
+  bool        outputEnabled = true;
+  bool        audioOutputEnabled = true;
+  UINT64      controlFrames = 0;
+  std::string romKey = rom_set->cache_key;
+  uint64_t    bootKey = 0;
+  unsigned    bootCaptureFrames = 0;
+  uint64_t    nvramCheckpointMicros = uint64_t(s_runtime_config["NVRAMCheckpoint"].ValueAs<unsigned>()) * 1000000;
+  uint64_t    nvramCheckpointTime = 0;
+  bool        ppcTrace = s_runtime_config["PowerPCTrace"].ValueAs<bool>();
+  bool        ppcTraceSaved = false;
+#ifdef NET_BOARD
+  std::unique_ptr<CRollbackSession> netplay;
+  bool        peerNVRAM = false;
+#endif
 
   // Initialize and load ROMs
   if (Result::OKAY != Model3->Init())
@@ -939,9 +1880,19 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   // Load NVRAM
   LoadNVRAM(Model3);
 
+  // Fast boot only applies to plain power-ons, not to anything that has to
+  // start from the same point as another run or machine
+  if (s_runtime_config["FastBoot"].ValueAs<bool>() && !romKey.empty() && initialState.empty() &&
+      s_runtime_config["PlayInputs"].ValueAs<std::string>().empty() &&
+      s_runtime_config["RecordInputs"].ValueAs<std::string>().empty() &&
+      s_runtime_config["BenchFrames"].ValueAs<unsigned>() == 0 &&
+      s_runtime_config["NetplayPeer"].ValueAsDefault<std::string>("").empty() &&
+      !s_runtime_config["Network"].ValueAsDefault<bool>(false))
+    bootKey = GetBootKey(Model3, romKey);
+
   // Set the video mode
   char baseTitleStr[128];
-  char titleStr[128];
+  char titleStr[384];
   totalXRes = xRes = s_runtime_config["XResolution"].ValueAs<unsigned>();
   totalYRes = yRes = s_runtime_config["YResolution"].ValueAs<unsigned>();
   snprintf(baseTitleStr, sizeof(baseTitleStr), "Supermodel - %s", game.title.c_str());
@@ -993,21 +1944,46 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   s_perfCounterFrequency = SDL_GetPerformanceFrequency();
   uint64_t perfCountPerFrame = s_perfCounterFrequency * 1000 / GetDesiredRefreshRateMilliHz();
   uint64_t nextTime = 0;
+  InitFramePacer();
+
+  // Start the presenter thread. SuperAA must then always resolve into the
+  // offscreen buffers, even without supersampling.
+  if (s_runtime_config["AsyncPresent"].ValueAs<bool>())
+    StartPresenter(totalXRes, totalYRes);
+  if (s_runtime_config["LoaderThread"].ValueAs<bool>())
+    StartLoader();
 
   // Initialize the renderers
-  SuperAA* superAA = new SuperAA(aaValue, CRTcolors);
-  superAA->Init(totalXRes, totalYRes);  // pass actual frame sizes here
-  CRender2D *Render2D = new CRender2D(s_runtime_config);
-  IRender3D *Render3D = s_runtime_config["New3DEngine"].ValueAs<bool>() ? ((IRender3D *) new New3D::CNew3D(s_runtime_config, Model3->GetGame().name)) : ((IRender3D *) new Legacy3D::CLegacy3D(s_runtime_config));
+  SuperAA* superAA = new SuperAA(aaValue, CRTcolors, s_runtime_config["ComputeResolve"].ValueAs<bool>(), s_present.thread != nullptr);
+  CRender2D *Render2D = nullptr;
+  IRender3D *Render3D = nullptr;
 
   UpscaleMode upscaleMode = (UpscaleMode)s_runtime_config["UpscaleMode"].ValueAs<int>();
 
-  if (Result::OKAY != Render2D->Init(xOffset*aaValue, yOffset*aaValue, xRes*aaValue, yRes*aaValue, totalXRes*aaValue, totalYRes*aaValue, superAA->GetTargetID(), upscaleMode))
-    goto QuitError;
-  if (Result::OKAY != Render3D->Init(xOffset*aaValue, yOffset*aaValue, xRes*aaValue, yRes*aaValue, totalXRes*aaValue, totalYRes*aaValue, superAA->GetTargetID()))
+  DynamicResolution dynamicRes;
+  InitDynamicResolution(&dynamicRes);
+
+  if (Result::OKAY != CreateRenderers(Model3, superAA, &Render2D, &Render3D, upscaleMode))
     goto QuitError;
 
-  Model3->AttachRenderers(Render2D,Render3D, superAA);
+  // Record the displayed frames
+  if (!s_runtime_config["Capture"].ValueAs<std::string>().empty())
+  {
+    s_capture = new CFrameCapture(totalXRes, totalYRes, GetDesiredRefreshRateMilliHz());
+    if (Result::OKAY != s_capture->Open(s_runtime_config["Capture"].ValueAs<std::string>()))
+      goto QuitError;
+  }
+
+  // Frame time statistics
+  s_frameStats = new CFrameStats(1e9 / double(GetDesiredRefreshRateMilliHz()), s_runtime_config["FrameStatsInterval"].ValueAs<unsigned>());
+
+  // Local endpoint for monitoring and operating the cabinet remotely
+  if (s_runtime_config["ControlPort"].ValueAs<unsigned>() > 0)
+  {
+    s_control = new CControlServer(1e9 / double(GetDesiredRefreshRateMilliHz()));
+    if (Result::OKAY != s_control->Start(s_runtime_config["ControlPort"].ValueAs<unsigned>()))
+      goto QuitError;
+  }
 
   // Reset emulator
   Model3->Reset();
@@ -1016,6 +1992,73 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   if (!initialState.empty())
     LoadState(Model3, initialState);
 
+  // Skip the self-test if it has been seen through before, else watch for
+  // the point to take the snapshot at
+  if (bootKey != 0)
+  {
+    if (LoadBootState(Model3, bootKey))
+      puts("Fast boot: skipped power-on self-test.");
+    else
+      bootCaptureFrames = std::max(s_runtime_config["FastBootFrames"].ValueAs<unsigned>(), 1u);
+  }
+
+  // Keep the states of the last few seconds in memory for rewinding
+  if (s_runtime_config["RewindBuffer"].ValueAs<unsigned>() > 0)
+    rewindBuffer.reset(new CRewindBuffer(s_runtime_config["RewindBuffer"].ValueAs<unsigned>(), REWIND_KEYFRAME_INTERVAL));
+
+  // Show frames from a few frames ahead to hide the game's own input lag
+  if (s_runtime_config["RunAhead"].ValueAs<unsigned>() > 0)
+    runAhead.reset(new CRunAhead(s_runtime_config["RunAhead"].ValueAs<unsigned>()));
+
+#ifdef NET_BOARD
+  // Link up with the other player for rollback netplay
+  if (!s_runtime_config["NetplayPeer"].ValueAs<std::string>().empty())
+  {
+    netplay.reset(new CRollbackSession(s_runtime_config, Model3, Inputs));
+    if (!netplay->Start())
+      goto QuitError;
+    peerNVRAM = netplay->GetPlayer() != 0;  // player 2 plays on player 1's NVRAM
+  }
+  else
+#endif
+  if (s_runtime_config["FastForward"].ValueAs<unsigned>() > 0)
+  {
+    // Skip ahead (e.g., past the attract mode) as fast as possible, without rendering or playing anything
+    unsigned frames = s_runtime_config["FastForward"].ValueAs<unsigned>();
+    uint64_t start = CThread::GetMicros();
+    Model3->SetOutputEnabled(false, false);
+    for (unsigned i = 0; i < frames; i++)
+      Model3->RunFrame();
+    Model3->SetOutputEnabled(true, true);
+    printf("Fast-forwarded %u frames in %.2f seconds.\n", frames, double(CThread::GetMicros() - start) / 1e6);
+  }
+
+  // Record the inputs from here on, starting from the current state, or play back a recording from the state it started from
+  if (!s_runtime_config["PlayInputs"].ValueAs<std::string>().empty())
+  {
+    inputRecording.reset(new CInputRecording(game, Inputs, Model3));
+    if (Result::OKAY != inputRecording->OpenForPlayback(s_runtime_config["PlayInputs"].ValueAs<std::string>(), GetInputRecordingKey()))
+      goto QuitError;
+    Model3->PauseThreads();
+    bool loaded = LoadStateFromMemory(Model3, inputRecording->GetInitialState());
+    Model3->ResumeThreads();
+    if (!loaded)
+    {
+      ErrorLog("The initial state in '%s' is incompatible with this version of Supermodel.", s_runtime_config["PlayInputs"].ValueAs<std::string>().c_str());
+      goto QuitError;
+    }
+  }
+  else if (!s_runtime_config["RecordInputs"].ValueAs<std::string>().empty())
+  {
+    CBlockFile::MemoryImage image;
+    Model3->PauseThreads();
+    SaveStateToMemory(Model3, &image);
+    Model3->ResumeThreads();
+    inputRecording.reset(new CInputRecording(game, Inputs, Model3));
+    if (Result::OKAY != inputRecording->OpenForRecording(s_runtime_config["RecordInputs"].ValueAs<std::string>(), GetInputRecordingKey(), image.data))
+      goto QuitError;
+  }
+
 #ifdef SUPERMODEL_DEBUGGER
   // If debugger was supplied, set it as logger and attach it to system
   oldLogger = GetLogger();
@@ -1029,28 +2072,253 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   // Emulate!
   fpsFramesElapsed = 0;
   prevFPSTicks = SDL_GetPerformanceCounter();
+  prevFrameStartTime = 0;
   quit = false;
+  if (s_runtime_config["BenchFrames"].ValueAs<unsigned>() > 0)
+    benchmark.reset(new CBenchmark(s_runtime_config["BenchFrames"].ValueAs<unsigned>(), s_runtime_config["BenchOutput"].ValueAs<std::string>()));
   paused = false;
   dumpTimings = false;
+
+  // Checkpoint NVRAM whenever it changes from what it is now (under the same
+  // conditions as it is saved on exit)
+#ifdef NET_BOARD
+  if (peerNVRAM)
+    nvramCheckpointMicros = 0;
+#endif
+  if (benchmark || dynamic_cast<CModel3GraphicsState *>(Model3))
+    nvramCheckpointMicros = 0;
+  if (nvramCheckpointMicros > 0)
+  {
+    CaptureNVRAM(Model3);
+    Model3->CheckNVRAMWritten();
+    nvramCheckpointTime = CThread::GetMicros();
+  }
 #ifdef DEBUG
-  if (dynamic_cast<CModel3GraphicsState *>(Model3))
+  if (!s_gfxStatePath.empty())
   {
     TestPolygonHeaderBits(Model3);
     quit = true;
   }
 #endif
+  TRACE_THREAD("Main");
   while (!quit)
   {
+    // Once the paused frame is kept, there is nothing to do until there is input
+    if (paused && s_pausedFrame.valid)
+      SDL_WaitEventTimeout(nullptr, PAUSED_EVENT_WAIT_MS);
+
+    // In late input poll mode, wait until only the time needed to emulate
+    // and render a frame is left before the frame is due, so the inputs are
+    // sampled as close as possible to the frame being shown
+    bool throttled = paused || s_runtime_config["Throttle"].ValueAs<bool>();
+    if (throttled && s_runtime_config["LateInputPoll"].ValueAs<bool>())
+    {
+      uint64_t lead = uint64_t(s_pacer.workTicks + s_pacer.workTicks / 4 + s_pacer.spinTicks);
+      if (nextTime > lead)
+        SuperSleepUntil(nextTime - lead);
+    }
+    uint64_t frameStartTime = SDL_GetPerformanceCounter();
+    uint64_t frameTicks = prevFrameStartTime ? frameStartTime - prevFrameStartTime : 0;
+    prevFrameStartTime = frameStartTime;
+
     // Poll the inputs
     if (!Inputs->Poll(&game, xOffset, yOffset, xRes, yRes))
       quit = true;
+    if (inputRecording && !paused)
+      inputRecording->Update();
 
-    // Render if paused, otherwise run a frame
+    // While fast-forwarding, only one frame in every few is rendered and frames are not paced
+    bool fastForward = !paused && Inputs->uiFastForward->value;
+#ifdef NET_BOARD
+    fastForward = fastForward && !netplay;
+#endif
+    bool output = !fastForward || ++fastForwardFrames % FAST_FORWARD_RENDER_INTERVAL == 0;
+
+    // With automatic frameskip, frames are still emulated in full and their
+    // audio played, so that game speed, sound and link play are unaffected,
+    // but aren't rendered while the last frame finished behind schedule
+    bool skip = autoFrameskip && !paused && !fastForward && behindSchedule && skippedFrames < AUTO_FRAMESKIP_MAX;
+    skippedFrames = skip ? skippedFrames + 1 : 0;
+    bool video = output && !skip;
+    if (video != outputEnabled || output != audioOutputEnabled)
+    {
+      Model3->SetOutputEnabled(video, output);
+      outputEnabled = video;
+      audioOutputEnabled = output;
+    }
+
+    superAA->SetPresentTarget(s_present.thread ? AcquirePresentBuffer() : 0);
+
+    // Render if paused, otherwise run a frame. While paused, the frame is
+    // only rendered once and then shown again.
+    if (!paused)
+      s_pausedFrame.valid = false;
     if (paused)
-      Model3->RenderFrame();
+    {
+      if (!ShowPausedFrame())
+      {
+        s_pausedFrame.capture = true;
+        Model3->RenderFrame();
+        s_pausedFrame.capture = false;
+      }
+    }
+#ifdef NET_BOARD
+    else if (netplay)
+    {
+      if (!netplay->RunFrame())
+      {
+        ErrorLog("Netplay link lost. Continuing without the other player.");
+        netplay.reset();
+      }
+    }
+#endif
+    else if (runAhead && outputEnabled)
+      runAhead->RunFrame(Model3);
     else
       Model3->RunFrame();
 
+    // Pass on this frame's output changes all at once
+    if (Outputs != NULL)
+      Outputs->Flush();
+
+    // Take the fast boot snapshot once the game has run long enough without
+    // being played or serviced
+    if (bootCaptureFrames > 0 && !paused)
+    {
+      for (int i = 0; i < 2; i++)
+      {
+        if (Inputs->coin[i]->value || Inputs->start[i]->value || Inputs->test[i]->value || Inputs->service[i]->value)
+          bootCaptureFrames = 0;
+      }
+      if (bootCaptureFrames > 0 && --bootCaptureFrames == 0)
+      {
+        Model3->PauseThreads();
+        SaveBootState(Model3, bootKey);
+        Model3->ResumeThreads();
+      }
+    }
+
+    // Save NVRAM in the background if the game has written to it since the
+    // last checkpoint, at most once per interval
+    if (nvramCheckpointMicros > 0 && !paused && CThread::GetMicros() - nvramCheckpointTime >= nvramCheckpointMicros)
+    {
+      nvramCheckpointTime = CThread::GetMicros();
+      if (Model3->CheckNVRAMWritten())
+        CheckpointNVRAM(Model3);
+    }
+
+    // Keep the instructions that led up to a fatal PowerPC error
+    if (ppcTrace && !ppcTraceSaved && ppc_halted())
+    {
+      ppcTraceSaved = true;
+      SavePowerPCTrace();
+    }
+
+    // Capture a rewind state every second of emulated time
+    if (rewindBuffer && !paused && ++rewindFrames >= REWIND_CAPTURE_FRAMES)
+    {
+      rewindFrames = 0;
+      Model3->PauseThreads();
+      rewindBuffer->Capture(Model3);
+      Model3->ResumeThreads();
+    }
+
+    // Resize the render target if the GPU is over or well under its frame budget
+    int newAAValue = (paused || !outputEnabled) ? aaValue : UpdateDynamicResolution(&dynamicRes, superAA->GetFrameMicros(), aaValue);
+    if (newAAValue != aaValue)
+    {
+      // The supersampling factor is built into the resolve shader, so everything sized by it is recreated
+      delete Render2D;
+      delete Render3D;
+      delete superAA;
+      Render2D = nullptr;
+      Render3D = nullptr;
+
+      aaValue = newAAValue;
+      superAA = new SuperAA(aaValue, CRTcolors, s_runtime_config["ComputeResolve"].ValueAs<bool>(), s_present.thread != nullptr);
+      SetGLScissor(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes);
+      if (Result::OKAY != CreateRenderers(Model3, superAA, &Render2D, &Render3D, upscaleMode))
+        goto QuitError;
+
+      Render3D->UploadTextures(0, 0, 0, 2048, 2048);    // sync texture memory
+      DebugLog("Dynamic resolution: supersampling changed to %d\n", aaValue);
+    }
+
+    // Carry out commands from the control endpoint between frames
+    CControlServer::Command command;
+    if (s_control && s_control->NextCommand(&command))
+    {
+      bool wasPaused = paused;
+      if (command == CControlServer::Command::Pause || command == CControlServer::Command::Resume)
+      {
+        paused = command == CControlServer::Command::Pause;
+        if (paused != wasPaused)
+        {
+          if (paused)
+          {
+            Model3->PauseThreads();
+            SetAudioEnabled(false);
+            snprintf(titleStr, sizeof(titleStr), "%s (Paused)", baseTitleStr);
+            SDL_SetWindowTitle(s_window, titleStr);
+          }
+          else
+          {
+            Model3->ResumeThreads();
+            SetAudioEnabled(true);
+            SDL_SetWindowTitle(s_window, baseTitleStr);
+          }
+          if (Outputs != NULL)
+            Outputs->SetValue(OutputPause, paused);
+        }
+        s_control->Reply(true, paused ? "paused" : "running");
+      }
+      else if (command == CControlServer::Command::Screenshot)
+      {
+        Screenshot();
+        s_control->Reply(true, "screenshot saved");
+      }
+#ifdef NET_BOARD
+      else if (netplay && (command == CControlServer::Command::Reset || command == CControlServer::Command::LoadState))
+        s_control->Reply(false, "not available during netplay");
+#endif
+      else
+      {
+        if (!paused)
+        {
+          Model3->PauseThreads();
+          SetAudioEnabled(false);
+        }
+        s_pausedFrame.valid = false;
+
+        if (command == CControlServer::Command::SaveState)
+        {
+          SaveStateToMemory(Model3);
+          s_control->Reply(true, "state saved");
+        }
+        else if (command == CControlServer::Command::LoadState && !LoadStateFromMemory(Model3))
+          s_control->Reply(false, "no state saved");
+        else
+        {
+          if (command == CControlServer::Command::Reset)
+            Model3->Reset();
+          if (rewindBuffer)
+            rewindBuffer->Invalidate();
+          bootCaptureFrames = 0;
+#ifdef SUPERMODEL_DEBUGGER
+          if (Debugger != NULL)
+            Debugger->Reset();
+#endif // SUPERMODEL_DEBUGGER
+          s_control->Reply(true, command == CControlServer::Command::Reset ? "reset" : "state loaded");
+        }
+
+        if (!paused)
+        {
+          Model3->ResumeThreads();
+          SetAudioEnabled(true);
+        }
+      }
+    }
+
 #ifdef SUPERMODEL_DEBUGGER
     bool processUI = true;
     if (Debugger != NULL)
@@ -1079,6 +2347,13 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       // Quit emulator
       quit = true;
     }
+#ifdef NET_BOARD
+    else if (netplay && (Inputs->uiReset->Pressed() || Inputs->uiLoadState->Pressed() || Inputs->uiRewind->Pressed()))
+    {
+      // Both machines have to stay in step
+      puts("Resetting, loading states and rewinding are not available during netplay.");
+    }
+#endif
     else if (Inputs->uiReset->Pressed())
     {
       if (!paused)
@@ -1089,6 +2364,11 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
 
       // Reset emulator
       Model3->Reset();
+      if (rewindBuffer)
+        rewindBuffer->Invalidate();
+      bootCaptureFrames = 0;
+      ppcTraceSaved = false;
+      s_pausedFrame.valid = false;
 
 #ifdef SUPERMODEL_DEBUGGER
       // If debugger was supplied, reset it too
@@ -1127,7 +2407,7 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       if (Outputs != NULL)
         Outputs->SetValue(OutputPause, paused);
     }
-    else if (Inputs->uiFullScreen->Pressed())
+    else if (Inputs->uiFullScreen->Pressed() && !s_runtime_config["Headless"].ValueAs<bool>())
     {
       // Toggle emulator fullscreen
       s_runtime_config.Get("FullScreen").SetValue(!s_runtime_config["FullScreen"].ValueAs<bool>());
@@ -1138,6 +2418,13 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       Render2D = nullptr;
       Render3D = nullptr;
 
+      // Presentation buffers are sized to the window
+      bool restartPresenter = s_present.thread != nullptr;
+      StopPresenter();
+      ReleasePausedFrame();
+      bool restartLoader = s_loader != nullptr;
+      StopLoader();
+
       // Resize screen
       totalXRes = xRes = s_runtime_config["XResolution"].ValueAs<unsigned>();
       totalYRes = yRes = s_runtime_config["YResolution"].ValueAs<unsigned>();
@@ -1145,18 +2432,15 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       bool fullscreenc = s_runtime_config["FullScreen"].ValueAs<bool>();
       if (Result::OKAY != ResizeGLScreen(&xOffset,&yOffset,&xRes,&yRes,&totalXRes,&totalYRes,!stretchc,fullscreenc))
         goto QuitError;
+      if (restartPresenter)
+        StartPresenter(totalXRes, totalYRes);
+      if (restartLoader)
+        StartLoader();
 
       // Recreate renderers and attach to the emulator
-      superAA->Init(totalXRes, totalYRes);
-      Render2D = new CRender2D(s_runtime_config);
-      Render3D = s_runtime_config["New3DEngine"].ValueAs<bool>() ? ((IRender3D *) new New3D::CNew3D(s_runtime_config, Model3->GetGame().name)) : ((IRender3D *) new Legacy3D::CLegacy3D(s_runtime_config));
-      if (Result::OKAY != Render2D->Init(xOffset * aaValue, yOffset * aaValue, xRes * aaValue, yRes * aaValue, totalXRes * aaValue, totalYRes * aaValue, superAA->GetTargetID(), upscaleMode))
-        goto QuitError;
-      if (Result::OKAY != Render3D->Init(xOffset * aaValue, yOffset * aaValue, xRes * aaValue, yRes * aaValue, totalXRes * aaValue, totalYRes * aaValue, superAA->GetTargetID()))
+      if (Result::OKAY != CreateRenderers(Model3, superAA, &Render2D, &Render3D, upscaleMode))
         goto QuitError;
 
-      Model3->AttachRenderers(Render2D, Render3D, superAA);
-
       Render3D->UploadTextures(0, 0, 0, 2048, 2048);    // sync texture memory
 
       Inputs->GetInputSystem()->SetMouseVisibility(!s_runtime_config["FullScreen"].ValueAs<bool>());
@@ -1195,6 +2479,10 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
 
       // Load game state
       LoadState(Model3);
+      if (rewindBuffer)
+        rewindBuffer->Invalidate();
+      bootCaptureFrames = 0;
+      s_pausedFrame.valid = false;
 
 #ifdef SUPERMODEL_DEBUGGER
       // If debugger was supplied, reset it after loading state
@@ -1208,6 +2496,40 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
         SetAudioEnabled(true);
       }
     }
+    else if (Inputs->uiRewind->Pressed())
+    {
+      if (!rewindBuffer)
+        puts("Rewinding is disabled. Use '-rewind=<seconds>' to enable it.");
+      else
+      {
+        if (!paused)
+        {
+          Model3->PauseThreads();
+          SetAudioEnabled(false);
+        }
+
+        // Go back to the newest captured state
+        if (rewindBuffer->Rewind(Model3))
+          printf("Rewound (%u seconds left).\n", rewindBuffer->GetNumStates());
+        else
+          puts("Nothing to rewind to.");
+        rewindFrames = 0;
+        bootCaptureFrames = 0;
+        s_pausedFrame.valid = false;
+
+#ifdef SUPERMODEL_DEBUGGER
+        // If debugger was supplied, reset it after loading state
+        if (Debugger != NULL)
+          Debugger->Reset();
+#endif // SUPERMODEL_DEBUGGER
+
+        if (!paused)
+        {
+          Model3->ResumeThreads();
+          SetAudioEnabled(true);
+        }
+      }
+    }
     else if (Inputs->uiMusicVolUp->Pressed())
     {
       // Increase music volume by 10%
@@ -1271,6 +2593,8 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
     else if (Inputs->uiDumpTimings->Pressed())
     {
       dumpTimings = !dumpTimings;
+      if (dumpTimings)
+        printf("Memory usage:\n%s", Util::DescribeMemoryUsage().c_str());
     }
 #endif
     else if (Inputs->uiSelectCrosshairs->Pressed() && gameHasLightguns)
@@ -1302,6 +2626,25 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       // Make a screenshot
       Screenshot();
     }
+    else if (Inputs->uiFrameStats->Pressed())
+    {
+      // Toggle the frame time graph
+      s_showFrameStats = !s_showFrameStats;
+    }
+    else if (Inputs->uiSavePowerPCTrace->Pressed() && ppcTrace)
+    {
+      // Save the most recently executed PowerPC instructions
+      Model3->PauseThreads();
+      SavePowerPCTrace();
+      Model3->ResumeThreads();
+    }
+#ifdef SUPERMODEL_TRACE
+    else if (Inputs->uiSaveTrace->Pressed())
+    {
+      // Save the recent history of trace zones
+      SaveTrace();
+    }
+#endif
 #ifdef SUPERMODEL_DEBUGGER
       else if (Debugger != NULL && Inputs->uiEnterDebugger->Pressed())
       {
@@ -1312,28 +2655,123 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
 #endif // SUPERMODEL_DEBUGGER
 
     // Refresh rate (frame limiting)
-    if (paused || s_runtime_config["Throttle"].ValueAs<bool>())
+    behindSchedule = false;
+    if (paused || (s_runtime_config["Throttle"].ValueAs<bool>() && !fastForward))
     {
+        uint64_t done = SDL_GetPerformanceCounter();
+        int64_t workTicks = int64_t(done - frameStartTime);
+        s_pacer.workTicks = std::max(s_pacer.workTicks - s_pacer.workTicks / 32, workTicks);
+        behindSchedule = nextTime != 0 && done > nextTime;
         SuperSleepUntil(nextTime);
-        nextTime = SDL_GetPerformanceCounter() + perfCountPerFrame;
+        uint64_t now = SDL_GetPerformanceCounter();
+
+        // With VRR, keep to a fixed schedule so the average rate is exact,
+        // and with automatic frameskip so that time lost on slow frames is
+        // made up by skipping, unless too far behind (e.g. after a pause or
+        // a hitch)
+        uint64_t maxLate = perfCountPerFrame * (autoFrameskip ? AUTO_FRAMESKIP_MAX : 1);
+        if ((s_vrr || autoFrameskip) && nextTime != 0 && now - nextTime < maxLate)
+          nextTime += perfCountPerFrame;
+        else
+          nextTime = now + perfCountPerFrame;
+
+#ifdef NET_BOARD
+        // Keep in step with the other cabinets when link play is running
+        if (CModel3 *M = dynamic_cast<CModel3 *>(Model3))
+        {
+          INetBoard *netBoard = M->GetNetBoard();
+          if (netBoard && netBoard->IsAttached())
+            nextTime += int64_t(netBoard->TakeClockAdjust()) * int64_t(s_perfCounterFrequency) / 1000000;
+        }
+#endif
     }
 
     // Measure frame rate
     uint64_t currentFPSTicks = SDL_GetPerformanceCounter();
-    if (s_runtime_config["ShowFrameRate"].ValueAs<bool>())
+    bool showFPS = s_runtime_config["ShowFrameRate"].ValueAs<bool>();
+    bool showRenderStats = s_runtime_config["ShowRenderStats"].ValueAs<bool>();
+    if (showFPS || showRenderStats)
     {
       fpsFramesElapsed += 1;
       uint64_t measurementTicks = currentFPSTicks - prevFPSTicks;
       if (measurementTicks >= s_perfCounterFrequency) // update FPS every 1 second (s_perfCounterFrequency is how many perf ticks in one second)
       {
         double fps = double(fpsFramesElapsed) / (double(measurementTicks) / double(s_perfCounterFrequency));
-        snprintf(titleStr, sizeof(titleStr), "%s - %1.3f FPS%s", baseTitleStr, fps, paused ? " (Paused)" : "");
+        char fpsStr[32] = "";
+        char statsStr[256] = "";
+        if (showFPS)
+          snprintf(fpsStr, sizeof(fpsStr), " - %1.3f FPS", fps);
+        if (showRenderStats)
+        {
+          // Counts of the last frame only, there's no on-screen text to draw them with
+          CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+          CModel3GraphicsState *G = dynamic_cast<CModel3GraphicsState *>(Model3);
+          FrameTimings timings = M ? M->GetTimings() : (G ? G->GetTimings() : FrameTimings());
+          const RenderStats &stats = timings.render3DStats;
+          snprintf(statsStr, sizeof(statsStr), " - %u vp, %u nodes, %u models (%u decoded), %u meshes, %u draws, %u uniforms, %uK verts, %uK texels, sync %uK",
+            stats.viewports, stats.nodes, stats.models, stats.modelCacheMisses, stats.meshes, stats.drawCalls, stats.uniformUpdates,
+            stats.vertsUploaded / 1024, stats.texelsUploaded / 1024, timings.syncSize / 1024);
+        }
+        snprintf(titleStr, sizeof(titleStr), "%s%s%s%s", baseTitleStr, fpsStr, statsStr, paused ? " (Paused)" : "");
         SDL_SetWindowTitle(s_window, titleStr);
         prevFPSTicks = currentFPSTicks;   // reset tick count
         fpsFramesElapsed = 0;             // reset frame count
       }
     }
 
+    // Only frames run at normal speed say anything about how the game plays
+    if (!paused && (benchmark || (!fastForward && frameTicks)))
+    {
+      CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+      CModel3GraphicsState *G = dynamic_cast<CModel3GraphicsState *>(Model3);
+      FrameTimings timings;
+      if (M)
+        timings = M->GetTimings();
+      else if (G)
+        timings = G->GetTimings();
+      if (!fastForward && frameTicks)
+        s_frameStats->AddFrame(UINT32(frameTicks * 1000000 / s_perfCounterFrequency), (M || G) ? &timings : nullptr);
+      if (benchmark && benchmark->AddFrame((M || G) ? &timings : nullptr))
+        quit = true;
+    }
+
+    // Report to the control endpoint
+    if (s_control)
+    {
+      CControlServer::Status status;
+      CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+      controlFrames += paused ? 0 : 1;
+      status.paused = paused;
+      status.frames = controlFrames;
+      status.audioUnderRuns = GetAudioUnderRuns();
+      if (M)
+      {
+        status.haveTimings = true;
+        status.timings = M->GetTimings();
+#ifdef NET_BOARD
+        INetBoard *netBoard = M->GetNetBoard();
+        if (netBoard && netBoard->IsAttached())
+          status.netBoard = netBoard->IsRunning() ? "running" : "stopped";
+#endif
+      }
+      bool counted = !paused && !fastForward && frameTicks;
+      s_control->Update(status, counted ? UINT32(frameTicks * 1000000 / s_perfCounterFrequency) : 0);
+    }
+
+    // Capture the graphics state at the end of each frame for -replay-gfx
+    if (!paused && recordedGfxFrames < recordGfxFrames)
+    {
+      CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+      if (M)
+      {
+        Model3->PauseThreads();
+        SaveGraphicsState(M, GetGraphicsStatePath(recordGfx, recordedGfxFrames));
+        Model3->ResumeThreads();
+      }
+      if (++recordedGfxFrames == recordGfxFrames)
+        printf("Recorded %u frames of graphics state to '%s.*'.\n", recordGfxFrames, recordGfx.c_str());
+    }
+
     if (dumpTimings && !paused)
     {
       CModel3 *M = dynamic_cast<CModel3 *>(Model3);
@@ -1344,6 +2782,17 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
 
   // Make sure all threads are paused before shutting down
   Model3->PauseThreads();
+  WaitForStateWriter();
+  WaitForNVRAMWriter();
+  if (benchmark)
+  {
+    benchmark->Report(Model3, CBenchmark::Hash(ReadFrameBuffer().get(), size_t(totalXRes) * totalYRes * 4));
+    if (s_runtime_config["BenchProfile"].ValueAs<bool>())
+      StoreProfile(*benchmark, Model3->GetGame());
+  }
+#ifdef SUPERMODEL_TRACE
+  SaveTrace();
+#endif
 
 #ifdef SUPERMODEL_DEBUGGER
   // If debugger was supplied, detach it from system and restore old logger
@@ -1354,23 +2803,48 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   }
 #endif // SUPERMODEL_DEBUGGER
 
-  // Save NVRAM
+  // Save NVRAM (except after a benchmark, so that every run starts out the same, or a graphics replay, which has none)
+#ifdef NET_BOARD
+  if (!peerNVRAM && !benchmark && !dynamic_cast<CModel3GraphicsState *>(Model3))
+#else
+  if (!benchmark && !dynamic_cast<CModel3GraphicsState *>(Model3))
+#endif
   SaveNVRAM(Model3);
 
   // Close audio
   CloseAudio();
 
   // Shut down renderers
+  delete s_capture;
+  s_capture = nullptr;
+  delete s_frameStats;
+  s_frameStats = nullptr;
+  delete s_control;
+  s_control = nullptr;
+  StopPresenter();
+  ReleasePausedFrame();
   delete Render2D;
   delete Render3D;
+  StopLoader();
   delete superAA;
 
   return 0;
 
   // Quit with an error
 QuitError:
+  WaitForStateWriter();
+  WaitForNVRAMWriter();
+  delete s_capture;
+  s_capture = nullptr;
+  delete s_frameStats;
+  s_frameStats = nullptr;
+  delete s_control;
+  s_control = nullptr;
+  StopPresenter();
+  ReleasePausedFrame();
   delete Render2D;
   delete Render3D;
+  StopLoader();
   delete superAA;
 
   return 1;
@@ -1453,6 +2927,26 @@ static void PrintGameList(const std::string &xml_file, const std::map<std::strin
   }
 }
 
+static void PrintPlayableGames(const std::string &directory, const std::map<std::string, std::string> &zip_by_game)
+{
+  if (zip_by_game.empty())
+  {
+    printf("No playable games found in %s.\n", directory.c_str());
+    return;
+  }
+  printf("Games playable from %s:\n", directory.c_str());
+  puts("");
+  puts("    ROM Set         Archive");
+  puts("    -------         -------");
+  for (auto &v: zip_by_game)
+  {
+    printf("    %s", v.first.c_str());
+    for (size_t i = v.first.length(); i < 9; i++)  // pad for alignment
+      printf(" ");
+    printf("       %s\n", v.second.c_str());
+  }
+}
+
 static void LogConfig(const Util::Config::Node &config)
 {
   InfoLog("Runtime configuration:");
@@ -1466,6 +2960,40 @@ static void LogConfig(const Util::Config::Node &config)
   InfoLog("");
 }
 
+/*
+ * Threads that can be pinned to cores and given a priority with the
+ * <Class>ThreadCores and <Class>ThreadPriority settings.
+ */
+static const struct
+{
+  const char *threadClass;
+  const char *threads[2];
+} s_threadClasses[] =
+{
+  { "Main",   { "Main", "Presenter" } },
+  { "PPC",    { "MainBoard", nullptr } },
+  { "Sound",  { "SoundBoardSync", "SoundBoardNoSync" } },
+  { "Drive",  { "DriveBoard", nullptr } },
+  { "Net",    { "NetBoard", nullptr } },
+  { "Input",  { "Joysticks", "Force feedback" } },
+  { "Audio",  { "Audio", nullptr } }
+};
+
+static void ConfigureThreads(const Util::Config::Node &config)
+{
+  for (auto &threadClass: s_threadClasses)
+  {
+    std::string cores = config[std::string(threadClass.threadClass) + "ThreadCores"].ValueAs<std::string>();
+    std::string priority = config[std::string(threadClass.threadClass) + "ThreadPriority"].ValueAs<std::string>();
+    for (const char *name: threadClass.threads)
+    {
+      if (name != nullptr)
+        CThread::SetScheduling(name, cores, priority);
+    }
+  }
+  CThread::ApplyScheduling("Main");
+}
+
 static Util::Config::Node DefaultConfig()
 {
   Util::Config::Node config("Global");
@@ -1474,8 +3002,38 @@ static Util::Config::Node DefaultConfig()
   // CModel3
   config.Set("MultiThreaded", true);
   config.Set("GPUMultiThreaded", true);
+  config.Set("LockFreeThreadSync", false);
+  config.Set("Deterministic", false);
+  config.Set("FineDirtyTracking", true);
+  config.Set("TileGenThreads", 4);
+  config.Set("TileGenPipeline", true);
+  config.Set("New3DThreads", 4);
+  config.Set("JobThreads", 0);
+  config.Set("SIMD", true);
+  config.Set("PowerPCDynarec", false);
+  config.Set("PowerPCIdleSkip", true);
+  config.Set("PowerPCFastFPU", false);
+  config.Set("PowerPCTrace", false);
+  config.Set("ROMCache", false);
+  config.Set("VerifyROMs", false);
+  config.Set("RewindBuffer", 0);
+  config.Set("RunAhead", 0);
+  config.Set("FastForward", 0);
+  config.Set("FastBoot", false);
+  config.Set("FastBootFrames", unsigned(2400));
+  config.Set("NVRAMCheckpoint", unsigned(5));
+  config.Set("RecordInputs", "");
+  config.Set("PlayInputs", "");
+  config.Set("BenchFrames", unsigned(0));
+  config.Set("BenchOutput", "");
+  config.Set("BenchProfile", false);
+  config.Set("Profile", true);
+  config.Set("RecordGfx", "");
+  config.Set("RecordGfxFrames", unsigned(60));
+  config.Set("ReplayGfx", "");
   // 2D and 3D graphics engines
   config.Set("MultiTexture", false);
+  config.Set("GPUTilemap", false);
   config.Set("VertexShader", "");
   config.Set("FragmentShader", "");
   config.Set("VertexShaderFog", "");
@@ -1493,6 +3051,7 @@ static Util::Config::Node DefaultConfig()
   config.Set("EmulateDSB", true);
   config.Set("SoundVolume", "100");
   config.Set("MusicVolume", "100");
+  config.Set("PreDecodeMPEG", false);
   // Other sound options
   config.Set("LegacySoundDSP", false); // New config option for games that do not play correctly with MAME's SCSP sound core.
   // CDriveBoard
@@ -1500,25 +3059,54 @@ static Util::Config::Node DefaultConfig()
   // Platform-specific/UI
   config.Set("New3DEngine", true);
   config.Set("QuadRendering", false);
+  config.Set("GLES", false);
+  config.Set("PackedVertices", false);
+  config.Set("QuadVertexPulling", false);
+  config.Set("RegenerateMips", false);
+  config.Set("New3DModelCache", false);
+  config.Set("ShaderCache", true);
+  config.Set("ShaderVariants", true);
+  config.Set("InstancedModels", false);
+  config.Set("ReuseScene", false);
+  config.Set("LoaderThread", false);
+  config.Set("SinglePassComposite", false);
   config.Set("XResolution", "496");
   config.Set("YResolution", "384");
   config.SetEmpty("WindowXPosition");
   config.SetEmpty("WindowYPosition");
   config.Set("FullScreen", false);
+  config.Set("Headless", false);
   config.Set("BorderlessWindow", false);
   config.Set("Supersampling", 1);
   config.Set("CRTcolors", int(0));
+  config.Set("ComputeResolve", false);
+  config.Set("DynamicResolution", false);
+  config.Set("MinSupersampling", 1);
+  config.Set("MultiSampling", 1);
+  config.Set("AsyncPresent", false);
+  config.Set("Capture", "");
   config.Set("UpscaleMode", 2);
   config.Set("WideScreen", false);
   config.Set("Stretch", false);
   config.Set("WideBackground", false);
   config.Set("VSync", true);
   config.Set("Throttle", true);
+  config.Set("AutoFrameskip", false);
+  config.Set("LateInputPoll", false);
+  config.Set("InputPollRate", unsigned(0));
   config.Set("RefreshRate", 60.0f);
+  config.Set("VRR", "off");
   config.Set("ShowFrameRate", false);
+  config.Set("ShowRenderStats", false);
+  config.Set("FrameStatsInterval", unsigned(0));
+  config.Set("ControlPort", unsigned(0));
   config.Set("Crosshairs", int(0));
   config.Set("CrosshairStyle", "vector");
   config.Set("FlipStereo", false);
+  config.Set("AudioRateControl", true);
+  config.Set("AudioFloatOutput", false);
+  config.Set("NativeAudio", true);
+  config.Set("AudioPeriod", 128);
 #ifdef SUPERMODEL_WIN32
   config.Set("InputSystem", "dinput");
   // DirectInput ForceFeedback
@@ -1545,6 +3133,17 @@ static Util::Config::Node DefaultConfig()
   config.Set("PortIn", unsigned(1970));
   config.Set("PortOut", unsigned(1971));
   config.Set("AddressOut", "127.0.0.1");
+  config.Set("NetTransport", "tcp");
+  config.Set("NetRedundancy", 2);
+  config.Set("NetFrameBudget", 10);
+  config.Set("NetFrameDelay", unsigned(0));
+  config.Set("NetCompression", false);
+  config.Set("NetplayPeer", "");
+  config.Set("NetplayPlayer", unsigned(1));
+  config.Set("NetplayPortIn", unsigned(1972));
+  config.Set("NetplayPortOut", unsigned(1972));
+  config.Set("NetplayInputDelay", unsigned(1));
+  config.Set("NetplayMaxRollback", unsigned(8));
 #endif
 #else
   config.Set("InputSystem", "sdl");
@@ -1557,6 +3156,12 @@ static Util::Config::Node DefaultConfig()
 #endif
   config.Set("Outputs", "none");
   config.Set("DumpTextures", false);
+  // Thread placement
+  for (auto &threadClass: s_threadClasses)
+  {
+    config.Set(std::string(threadClass.threadClass) + "ThreadCores", "");
+    config.Set(std::string(threadClass.threadClass) + "ThreadPriority", "");
+  }
   return config;
 }
 
@@ -1575,6 +3180,8 @@ static void Help(void)
   puts("General Options:");
   puts("  -?, -h, -help, --help   Print this help text");
   puts("  -print-games            List supported games and quit");
+  puts("  -scan-roms=<dir>        List games playable from the ROM sets in a directory");
+  puts("                          and quit");
   printf("  -game-xml-file=<file>   ROM set definition file [Default: %s]\n", s_gameXMLFilePath.c_str());
   printf("  -log-output=<outputs>   Log output destination(s) [Default: %s]\n", s_logFilePath.c_str());
   puts("  -log-level=<level>      Logging threshold [Default: info]");
@@ -1584,7 +3191,46 @@ static void Help(void)
   puts("  -no-threads             Disable multi-threading entirely");
   puts("  -gpu-multi-threaded     Run graphics rendering in separate thread [Default]");
   puts("  -no-gpu-thread          Run graphics rendering in main thread");
+  puts("  -lock-free-sync         Synchronize threads without locks each frame");
+  puts("  -deterministic          Exchange data between threads only between frames");
+  puts("  -no-fine-dirty-tracking Copy whole pages of changed 3D memory between threads");
+  puts("  -tilegen-threads=<n>    Threads used to draw tile layers [Default: 4]");
+  puts("  -no-tilegen-pipeline    Draw tile layers during the frame sync");
+  puts("  -new3d-threads=<n>      Threads used to decode 3D models [Default: 4]");
+  puts("  -job-threads=<n>        Worker threads shared by parallel jobs [Default: 0=auto]");
+  puts("  -no-simd                Use scalar code instead of SSE/AVX2/NEON kernels");
+  puts("  -ppc-dynarec            Use PowerPC dynamic recompiler (x86-64 only)");
+  puts("  -no-ppc-dynarec         Use PowerPC interpreter [Default]");
+  puts("  -ppc-idle-skip          Skip PowerPC idle loops [Default]");
+  puts("  -no-ppc-idle-skip       Always emulate PowerPC idle loops");
+  puts("  -ppc-fast-fpu           Skip FPSCR status updates until a game reads it");
+  puts("  -no-ppc-fast-fpu        Always maintain FPSCR status bits [Default]");
+  puts("  -ppc-trace              Keep a trace of recent PowerPC instructions");
+  puts("  -no-ppc-trace           Disable PowerPC instruction trace [Default]");
+  puts("  -rom-cache              Map processed ROM images from the cache directory");
+  puts("  -no-rom-cache           Rebuild ROM images from the ROM set [Default]");
+  puts("  -verify-roms            Check CRC32s of unpacked and uncompressed ROM files");
+  puts("  -no-verify-roms         Identify unpacked ROM files by name [Default]");
   puts("  -load-state=<file>      Load save state after starting");
+  puts("  -nvram-checkpoint=<s>   Save NVRAM this soon after it changes, 0 for on exit");
+  puts("                          only [Default: 5]");
+  puts("  -rewind=<seconds>       Keep states for rewinding with F8 [Default: 0]");
+  puts("  -fast-forward=<frames>  Skip ahead this many frames at start-up [Default: 0]");
+  puts("  -fast-boot              Skip the power-on self-test with a cached snapshot");
+  puts("  -no-fast-boot           Always run the power-on self-test [Default]");
+  puts("  -fast-boot-frames=<n>   Frames to run before taking the snapshot [Default: 2400]");
+  puts("  -run-ahead=<frames>     Show frames this far ahead to hide input lag [Default: 0]");
+  puts("  -record-inputs=<file>   Record game inputs of every frame to a file");
+  puts("  -play-inputs=<file>     Play back inputs recorded with -record-inputs");
+  puts("  -bench=<frames>         Run this many frames unthrottled and report timings");
+  puts("                          and hashes of the final state and frame");
+  puts("  -bench-output=<file>    Append -bench results to a file as a line of JSON");
+  puts("  -bench-profile          Store settings recommended by -bench for the game on");
+  puts("                          this host in Profiles.ini");
+  puts("  -no-profile             Ignore the game's settings in Profiles.ini");
+  puts("  -record-gfx=<file>      Save the graphics state of each frame as <file>.<n>");
+  puts("  -record-gfx-frames=<n>  Number of frames saved by -record-gfx [Default: 60]");
+  puts("  -replay-gfx=<file>      Render the states saved by -record-gfx over and over");
   puts("");
   puts("Video Options:");
   puts("  -res=<x>,<y>            Resolution [Default: 496,384]");
@@ -1593,22 +3239,61 @@ static void Help(void)
   puts("  -window                 Windowed mode [Default]");
   puts("  -borderless             Windowed mode with no border");
   puts("  -fullscreen             Full screen mode");
+  puts("  -headless               Render without showing a window or playing audio");
   puts("  -wide-screen            Expand 3D field of view to screen width");
   puts("  -wide-bg                When wide-screen mode is enabled, also expand the 2D");
   puts("                          background layer to screen width");
   puts("  -stretch                Fit viewport to resolution, ignoring aspect ratio");
   puts("  -upscalemode=<n>        2D layer upscaling filter mode (range 0-3)");
+  puts("  -gpu-tilemap            Draw 2D layers on the GPU from raw tile memory");
+  puts("  -no-gpu-tilemap         Draw 2D layers on the CPU [Default]");
   puts("  -crtcolors=<n>          CRT color emulation (range 0-5)");
+  puts("  -compute-resolve        Downsample supersampling with a compute shader");
+  puts("  -dynamic-res            Lower supersampling (down to -min-ss) when the GPU");
+  puts("                          cannot keep up with the refresh rate");
+  puts("  -min-ss=<n>             Lowest supersampling used by -dynamic-res [Default: 1]");
+  puts("  -msaa=<n>               Multisampling of the 3D layers (new engine) [Default: 1]");
+  puts("  -async-present          Display frames from a separate thread");
+  puts("  -capture=<file>         Record all frames to a .y4m file, or pipe them into");
+  puts("                          an encoder with -capture=\"|<command>\"");
   puts("  -no-throttle            Disable frame rate lock");
+  puts("  -auto-frameskip         Skip rendering frames when unable to keep full speed");
+  puts("  -late-input-poll        Delay input polling until just before each frame");
+  puts("                          is emulated, to reduce input latency");
   puts("  -vsync                  Lock to vertical refresh rate [Default]");
   puts("  -no-vsync               Do not lock to vertical refresh rate");
   puts("  -true-hz                Use true Model 3 refresh rate of 57.524 Hz");
+  puts("  -vrr=<mode>             Variable refresh rate presentation: off, on or auto");
+  puts("                          [Default: off]");
   puts("  -show-fps               Display frame rate in window title bar");
+  puts("  -show-render-stats      Display 3D renderer counts in window title bar");
+  puts("  -frame-stats=<s>        Log frame time percentiles every <s> seconds");
+  puts("  -control-port=<n>       Serve status and commands over HTTP on 127.0.0.1:<n>");
   puts("  -crosshairs=<n>         Crosshairs configuration for gun games:");
   puts("                          0=none [Default], 1=P1 only, 2=P2 only, 3=P1 & P2");
   puts("  -crosshair-style=<s>    Crosshair style: vector or bmp. [Default: vector]");
   puts("  -new3d                  New 3D engine by Ian Curtis [Default]");
   puts("  -quad-rendering         Enable proper quad rendering");
+  puts("  -packed-vertices        Use a compact vertex format (new engine)");
+  puts("  -quad-vertex-pulling    Draw quads without a geometry shader (new engine)");
+  puts("  -regenerate-mips        Fill in mipmaps for textures uploaded without (new engine)");
+  puts("  -model-cache            Keep decoded models on disk (new engine)");
+  puts("  -no-model-cache         Decode models every session [Default]");
+  puts("  -shader-cache           Keep linked shader programs on disk [Default]");
+  puts("  -no-shader-cache        Compile shaders every session");
+  puts("  -shader-variants        Specialize shaders for common states (new engine) [Default]");
+  puts("  -no-shader-variants     Draw everything with a single shader (new engine)");
+  puts("  -instanced-models       Draw repeated models with one call (new engine)");
+  puts("  -no-instanced-models    Draw each model separately [Default]");
+  puts("  -reuse-scene            Skip the scene traversal when 3D memory is unchanged (new engine)");
+  puts("  -no-reuse-scene         Traverse the scene every frame [Default]");
+  puts("  -single-pass-composite  Blend the 2D and 3D layers in one pass (new engine)");
+  puts("  -no-single-pass-composite");
+  puts("                          Blend each layer in a pass of its own [Default]");
+  puts("  -loader-thread          Link shader programs on a thread of their own (new engine)");
+  puts("  -no-loader-thread       Link shader programs while rendering [Default]");
+  puts("  -gles                   Render with OpenGL ES 3.2 (new engine, no quads)");
+  puts("  -no-gles                Render with desktop OpenGL [Default]");
   puts("  -legacy3d               Legacy 3D engine (faster but less accurate)");
   puts("  -multi-texture          Use 8 texture maps for decoding (legacy engine)");
   puts("  -no-multi-texture       Decode to single texture (legacy engine) [Default]");
@@ -1627,8 +3312,14 @@ static void Help(void)
   puts("  -balance=<bal>          Relative front/rear balance in % [Default: 0]");
   puts("  -channels=<c>           Number of sound channels to use on host [Default: 4]");
   puts("  -flip-stereo            Swap left and right audio channels");
+  puts("  -no-audio-rate-control  Do not adjust audio rate to keep buffer half full");
+  puts("  -audio-float            Output 32-bit float rather than 16-bit audio");
+  puts("  -no-native-audio        Use SDL audio rather than WASAPI, ALSA or Core Audio");
+  puts("  -audio-period=<n>       Native audio device period in samples [Default: 128]");
   puts("  -no-sound               Disable sound board emulation (sound effects)");
   puts("  -no-dsb                 Disable Digital Sound Board (MPEG music)");
+  puts("  -predecode-mpeg         Decode MPEG music ROM in the background when a game");
+  puts("                          is loaded, so that tracks start and loop instantly");
   puts("  -new-scsp               New SCSP engine based on MAME [Default]");
   puts("  -legacy-scsp            Legacy SCSP engine by ElSemi");
   puts("");
@@ -1638,15 +3329,21 @@ static void Help(void)
   puts("  -net                    Enable net board");
   puts("  -simulate-netboard      Simulate the net board [Default]");
   puts("  -emulate-netboard       Emulate the net board (requires -no-threads)");
+  puts("  -netplay=<address>      Rollback netplay with the machine at the given address");
+  puts("  -netplay-player=<n>     Player controlled in netplay (1 or 2) [Default: 1]");
   puts("");
 #endif
   puts("Input Options:");
   puts("  -force-feedback         Enable force feedback (DirectInput, XInput)");
   puts("  -config-inputs          Configure keyboards, mice, and game controllers");
-#ifdef SUPERMODEL_WIN32
+#if defined(SUPERMODEL_WIN32) || defined(__linux__)
   printf("  -input-system=<s>       Input system [Default: %s]\n", defaultConfig["InputSystem"].ValueAs<std::string>().c_str());
+#endif
+#ifdef SUPERMODEL_WIN32
   printf("  -outputs=<s>            Outputs [Default: %s]\n", defaultConfig["Outputs"].ValueAs<std::string>().c_str());
 #endif
+  puts("  -input-poll-rate=<hz>   Read SDL joysticks this many times a second on a");
+  puts("                          separate thread [Default: 0, once per frame]");
   puts("  -print-inputs           Prints current input configuration");
   puts("");
   puts("Debug Options:");
@@ -1670,6 +3367,7 @@ struct ParsedCommandLine
   bool error = false;
   bool print_help = false;
   bool print_games = false;
+  std::string scan_roms;
   bool print_gl_info = false;
   bool config_inputs = false;
   bool print_inputs = false;
@@ -1695,7 +3393,27 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
   { // -option=value
     { "-game-xml-file",         "GameXMLFile"             },
     { "-load-state",            "InitStateFile"           },
+    { "-rewind",                "RewindBuffer"            },
+    { "-run-ahead",             "RunAhead"                },
+    { "-fast-forward",          "FastForward"             },
+    { "-fast-boot-frames",      "FastBootFrames"          },
+    { "-nvram-checkpoint",      "NVRAMCheckpoint"         },
+    { "-record-inputs",         "RecordInputs"            },
+    { "-play-inputs",           "PlayInputs"              },
+    { "-bench",                 "BenchFrames"             },
+    { "-bench-output",          "BenchOutput"             },
+    { "-record-gfx",            "RecordGfx"               },
+    { "-record-gfx-frames",     "RecordGfxFrames"         },
+    { "-replay-gfx",            "ReplayGfx"               },
     { "-ppc-frequency",         "PowerPCFrequency"        },
+    { "-tilegen-threads",       "TileGenThreads"          },
+    { "-new3d-threads",         "New3DThreads"            },
+    { "-job-threads",           "JobThreads"              },
+    { "-min-ss",                "MinSupersampling"        },
+    { "-msaa",                  "MultiSampling"           },
+    { "-capture",               "Capture"                 },
+    { "-frame-stats",           "FrameStatsInterval"      },
+    { "-control-port",          "ControlPort"             },
     { "-crosshairs",            "Crosshairs"              },
     { "-crosshair-style",       "CrosshairStyle"          },
     { "-vert-shader",           "VertexShader"            },
@@ -1708,9 +3426,16 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
     { "-music-volume",          "MusicVolume"             },
     { "-balance",               "Balance"                 },
     { "-channels", 	            "NbSoundChannels"         },
+    { "-audio-period",          "AudioPeriod"             },
     { "-soundfreq",             "SoundFreq"               },
     { "-input-system",          "InputSystem"             },
+    { "-vrr",                   "VRR"                     },
+    { "-input-poll-rate",       "InputPollRate"           },
     { "-outputs",               "Outputs"                 },
+#ifdef NET_BOARD
+    { "-netplay",               "NetplayPeer"             },
+    { "-netplay-player",        "NetplayPlayer"           },
+#endif
     { "-log-output",            "LogOutput"               },
     { "-log-level",             "LogLevel"                }
   };
@@ -1720,8 +3445,36 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
     { "-no-threads",          { "MultiThreaded",    false } },
     { "-gpu-multi-threaded",  { "GPUMultiThreaded", true } },
     { "-no-gpu-thread",       { "GPUMultiThreaded", false } },
+    { "-lock-free-sync",      { "LockFreeThreadSync", true } },
+    { "-no-lock-free-sync",   { "LockFreeThreadSync", false } },
+    { "-deterministic",       { "Deterministic",    true } },
+    { "-no-deterministic",    { "Deterministic",    false } },
+    { "-fine-dirty-tracking", { "FineDirtyTracking", true } },
+    { "-no-fine-dirty-tracking", { "FineDirtyTracking", false } },
+    { "-tilegen-pipeline",    { "TileGenPipeline",  true } },
+    { "-simd",                { "SIMD",             true } },
+    { "-no-simd",             { "SIMD",             false } },
+    { "-no-tilegen-pipeline", { "TileGenPipeline",  false } },
+    { "-ppc-dynarec",         { "PowerPCDynarec",   true } },
+    { "-no-ppc-dynarec",      { "PowerPCDynarec",   false } },
+    { "-ppc-idle-skip",       { "PowerPCIdleSkip",  true } },
+    { "-no-ppc-idle-skip",    { "PowerPCIdleSkip",  false } },
+    { "-ppc-fast-fpu",        { "PowerPCFastFPU",   true } },
+    { "-no-ppc-fast-fpu",     { "PowerPCFastFPU",   false } },
+    { "-ppc-trace",           { "PowerPCTrace",     true } },
+    { "-no-ppc-trace",        { "PowerPCTrace",     false } },
+    { "-rom-cache",           { "ROMCache",         true } },
+    { "-no-rom-cache",        { "ROMCache",         false } },
+    { "-verify-roms",         { "VerifyROMs",       true } },
+    { "-no-verify-roms",      { "VerifyROMs",       false } },
+    { "-bench-profile",       { "BenchProfile",     true } },
+    { "-profile",             { "Profile",          true } },
+    { "-no-profile",          { "Profile",          false } },
+    { "-fast-boot",           { "FastBoot",         true } },
+    { "-no-fast-boot",        { "FastBoot",         false } },
     { "-window",              { "FullScreen",       false } },
     { "-fullscreen",          { "FullScreen",       true } },
+    { "-headless",            { "Headless",         true } },
     { "-borderless",          { "BorderlessWindow", true } },
     { "-no-wide-screen",      { "WideScreen",       false } },
     { "-wide-screen",         { "WideScreen",       true } },
@@ -1731,21 +3484,62 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
     { "-no-wide-bg",          { "WideBackground",   false } },
     { "-no-multi-texture",    { "MultiTexture",     false } },
     { "-multi-texture",       { "MultiTexture",     true } },
+    { "-gpu-tilemap",         { "GPUTilemap",       true } },
+    { "-no-gpu-tilemap",      { "GPUTilemap",       false } },
+    { "-compute-resolve",     { "ComputeResolve",   true } },
+    { "-no-compute-resolve",  { "ComputeResolve",   false } },
+    { "-dynamic-res",         { "DynamicResolution", true } },
+    { "-no-dynamic-res",      { "DynamicResolution", false } },
     { "-throttle",            { "Throttle",         true } },
     { "-no-throttle",         { "Throttle",         false } },
+    { "-auto-frameskip",      { "AutoFrameskip",    true } },
+    { "-no-auto-frameskip",   { "AutoFrameskip",    false } },
+    { "-late-input-poll",     { "LateInputPoll",    true } },
+    { "-no-late-input-poll",  { "LateInputPoll",    false } },
+    { "-async-present",       { "AsyncPresent",     true } },
+    { "-no-async-present",    { "AsyncPresent",     false } },
     { "-vsync",               { "VSync",            true } },
     { "-no-vsync",            { "VSync",            false } },
     { "-show-fps",            { "ShowFrameRate",    true } },
     { "-no-fps",              { "ShowFrameRate",    false } },
+    { "-show-render-stats",   { "ShowRenderStats",  true } },
+    { "-no-render-stats",     { "ShowRenderStats",  false } },
     { "-new3d",               { "New3DEngine",      true } },
     { "-quad-rendering",      { "QuadRendering",    true } },
+    { "-packed-vertices",     { "PackedVertices",   true } },
+    { "-quad-vertex-pulling", { "QuadVertexPulling", true } },
+    { "-regenerate-mips",     { "RegenerateMips",   true } },
+    { "-model-cache",         { "New3DModelCache",  true } },
+    { "-no-model-cache",      { "New3DModelCache",  false } },
+    { "-shader-cache",        { "ShaderCache",      true } },
+    { "-no-shader-cache",     { "ShaderCache",      false } },
+    { "-shader-variants",     { "ShaderVariants",   true } },
+    { "-no-shader-variants",  { "ShaderVariants",   false } },
+    { "-instanced-models",    { "InstancedModels",  true } },
+    { "-no-instanced-models", { "InstancedModels",  false } },
+    { "-reuse-scene",         { "ReuseScene",       true } },
+    { "-no-reuse-scene",      { "ReuseScene",       false } },
+    { "-single-pass-composite", { "SinglePassComposite", true } },
+    { "-no-single-pass-composite", { "SinglePassComposite", false } },
+    { "-loader-thread",       { "LoaderThread",     true } },
+    { "-no-loader-thread",    { "LoaderThread",     false } },
+    { "-gles",                { "GLES",             true } },
+    { "-no-gles",             { "GLES",             false } },
     { "-legacy3d",            { "New3DEngine",      false } },
     { "-no-flip-stereo",      { "FlipStereo",       false } },
     { "-flip-stereo",         { "FlipStereo",       true } },
+    { "-audio-rate-control",  { "AudioRateControl", true } },
+    { "-no-audio-rate-control", { "AudioRateControl", false } },
+    { "-audio-float",         { "AudioFloatOutput", true } },
+    { "-no-audio-float",      { "AudioFloatOutput", false } },
+    { "-native-audio",        { "NativeAudio", true } },
+    { "-no-native-audio",     { "NativeAudio", false } },
     { "-sound",               { "EmulateSound",     true } },
     { "-no-sound",            { "EmulateSound",     false } },
     { "-dsb",                 { "EmulateDSB",       true } },
     { "-no-dsb",              { "EmulateDSB",       false } },
+    { "-predecode-mpeg",      { "PreDecodeMPEG",    true } },
+    { "-no-predecode-mpeg",   { "PreDecodeMPEG",    false } },
     { "-legacy-scsp",         { "LegacySoundDSP",   true } },
     { "-new-scsp",            { "LegacySoundDSP",   false } },
 #ifdef NET_BOARD
@@ -1805,6 +3599,17 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
         cmd_line.print_help = true;
       else if (arg == "-print-games")
         cmd_line.print_games = true;
+      else if (arg == "-scan-roms" || arg.find("-scan-roms=") == 0)
+      {
+        std::vector<std::string> parts = Util::Format(arg).Split('=');
+        if (parts.size() != 2 || parts[1].empty())
+        {
+          ErrorLog("'-scan-roms' requires a directory.");
+          cmd_line.error = true;
+        }
+        else
+          cmd_line.scan_roms = parts[1];
+      }
       else if (arg == "-res" || arg.find("-res=") == 0)
       {
         std::vector<std::string> parts = Util::Format(arg).Split('=');
@@ -2013,7 +3818,7 @@ int main(int argc, char **argv)
 #ifdef DEBUG
   s_gfxStatePath.assign(cmd_line.gfx_state);
 #endif
-  bool print_games = cmd_line.print_games;
+  bool print_games = cmd_line.print_games || !cmd_line.scan_roms.empty();
   bool rom_specified = !cmd_line.rom_files.empty();
   if (!rom_specified && !print_games && !cmd_line.config_inputs && !cmd_line.print_inputs)
   {
@@ -2024,6 +3829,9 @@ int main(int argc, char **argv)
   // Load game and resolve run-time config
   Game game;
   ROMSet rom_set;
+  std::unique_ptr<GameLoader> loader;
+  Util::JobGroup romLoad;   // inflates the ROM set while the window and inputs are brought up
+  bool romLoadError = false;
   Util::Config::Node fileConfig("Global");
   {
     Util::Config::Node fileConfigWithDefaults("Global");
@@ -2032,18 +3840,55 @@ int main(int argc, char **argv)
     Util::Config::FromINIFile(&fileConfig, s_configFilePath);
     Util::Config::MergeINISections(&fileConfigWithDefaults, DefaultConfig(), fileConfig); // apply .ini file's global section over defaults
     Util::Config::MergeINISections(&config3, fileConfigWithDefaults, cmd_line.config);    // apply command line overrides
+    // Choose SIMD kernels before ROM loading binds the first ones
+    Util::EnableSIMD(config3["SIMD"].ValueAs<bool>());
+    InfoLog("SIMD instruction sets in use: %s", Util::DescribeCPUFeatures().c_str());
+    // Start the shared worker pool, which ROM loading already uses. Leave a core each to the main thread and,
+    // when multi-threaded, the PowerPC, sound and drive board threads
+    Util::Jobs::Start(config3["JobThreads"].ValueAs<unsigned>(), config3["MultiThreaded"].ValueAs<bool>() ? 4 : 1);
     if (rom_specified || print_games)
     {
       std::string xml_file = config3["GameXMLFile"].ValueAs<std::string>();
-      GameLoader loader(xml_file);
+      loader.reset(new GameLoader(xml_file, config3["VerifyROMs"].ValueAs<bool>()));
+      if (!cmd_line.scan_roms.empty())
+      {
+        PrintPlayableGames(cmd_line.scan_roms, loader->ScanROMDirectory(cmd_line.scan_roms));
+        return 0;
+      }
       if (print_games)
       {
-        PrintGameList(xml_file, loader.GetGames());
+        PrintGameList(xml_file, loader->GetGames());
         return 0;
       }
-      if (loader.Load(&game, &rom_set, *cmd_line.rom_files.begin()))
+      // The game is identified and its ROM set sized up front because the
+      // game-specific config depends on it. Inflating it is the slow part,
+      // which runs on the worker pool until Supermodel() needs the data.
+      // With the ROM image cache, it is only inflated if there is no valid
+      // image for it yet.
+      bool rom_cache = config3["ROMCache"].ValueAs<bool>();
+      rom_cache = rom_cache && config3["ReplayGfx"].ValueAs<std::string>().empty();  // graphics state replays copy VROM themselves
+#ifdef DEBUG
+      rom_cache = rom_cache && s_gfxStatePath.empty();  // graphics state analysis copies VROM itself
+#endif
+      if (loader->Load(&game, &rom_set, *cmd_line.rom_files.begin(), false))
         return 1;
-      Util::Config::MergeINISections(&config4, config3, fileConfig[game.name]);   // apply game-specific config
+      if (!rom_cache || !CModel3::IsROMImageCached(game, rom_set))
+      {
+        std::string zipfilename = *cmd_line.rom_files.begin();
+        romLoad.Run([&loader, &rom_set, &romLoadError, zipfilename]()
+        {
+          Game loaded_game;
+          rom_set = ROMSet();
+          romLoadError = loader->Load(&loaded_game, &rom_set, zipfilename);
+        });
+      }
+      // Settings the benchmark recommended for this host go over the global section, the game's own section still wins
+      Util::Config::Node profiled("Global");
+      Util::Config::Node profileConfig("Global");
+      if (config3["Profile"].ValueAs<bool>() && !config3["BenchProfile"].ValueAs<bool>() && std::filesystem::exists(s_profileFilePath))
+        Util::Config::FromINIFile(&profileConfig, s_profileFilePath);
+      Util::Config::MergeINISections(&profiled, config3, profileConfig[game.name]);
+      Util::Config::MergeINISections(&config4, profiled, fileConfig[game.name]);  // apply game-specific config
     }
     else
       config4 = config3;
@@ -2051,6 +3896,23 @@ int main(int argc, char **argv)
   }
   LogConfig(s_runtime_config);
 
+  // Headless instances render through SDL's display-less (EGL) video driver and
+  // discard their audio, unless another driver was explicitly requested
+  if (s_runtime_config["Headless"].ValueAs<bool>())
+  {
+    SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+    s_runtime_config.Get("FullScreen").SetValue(false);
+  }
+
+  // Only the new engine's triangle shaders are written to compile as GLSL ES
+  if (s_runtime_config["GLES"].ValueAs<bool>() && (!s_runtime_config["New3DEngine"].ValueAs<bool>() || s_runtime_config["QuadRendering"].ValueAs<bool>()))
+  {
+    ErrorLog("OpenGL ES rendering supports neither the legacy 3D engine nor quad rendering. Using the new 3D engine with triangles.");
+    s_runtime_config.Get("New3DEngine").SetValue(true);
+    s_runtime_config.Get("QuadRendering").SetValue(false);
+  }
+
   // Initialize SDL (individual subsystems get initialized later)
   if (SDL_Init(0) != 0)
   {
@@ -2061,6 +3923,9 @@ int main(int argc, char **argv)
   // Flag as DPI-aware, otherwise the window content might be scaled by some graphics drivers
   SDL_SetHint(SDL_HINT_WINDOWS_DPI_AWARENESS, "system");
 
+  // Must precede the creation of any emulation threads
+  ConfigureThreads(s_runtime_config);
+
   // Begin initializing various subsystems...
   int exitCode = 0;
   IEmulator *Model3 = nullptr;
@@ -2076,6 +3941,7 @@ int main(int argc, char **argv)
   CRTcolors = (CRTcolor)s_runtime_config["CRTcolors"].ValueAs<int>();
 
   // Create a window
+  EnableShaderCache(s_runtime_config["ShaderCache"].ValueAs<bool>());
   xRes = 496;
   yRes = 384;
   if (Result::OKAY != CreateGLScreen(s_runtime_config["New3DEngine"].ValueAs<bool>(), s_runtime_config["QuadRendering"].ValueAs<bool>(),"Supermodel", false, &xOffset, &yOffset, &xRes, &yRes, &totalXRes, &totalYRes, false, false))
@@ -2093,12 +3959,52 @@ int main(int argc, char **argv)
       goto Exit;
   }
 
-  // Create Model 3 emulator
+  // Run-ahead re-runs frames from a saved state, which only works if emulation is deterministic
+  if (s_runtime_config["RunAhead"].ValueAs<unsigned>() > 0 && s_runtime_config["MultiThreaded"].ValueAs<bool>() && !s_runtime_config["Deterministic"].ValueAs<bool>())
+  {
+    puts("Run-ahead requires single-threaded or deterministic emulation. Multi-threading disabled.");
+    s_runtime_config.Get("MultiThreaded").SetValue(false);
+  }
+
+#ifdef NET_BOARD
+  // Rollback netplay re-runs frames, which only works if emulation is deterministic
+  if (!s_runtime_config["NetplayPeer"].ValueAs<std::string>().empty() && s_runtime_config["MultiThreaded"].ValueAs<bool>() && !s_runtime_config["Deterministic"].ValueAs<bool>())
+  {
+    puts("Netplay requires single-threaded or deterministic emulation. Multi-threading disabled.");
+    s_runtime_config.Get("MultiThreaded").SetValue(false);
+  }
+#endif
+
+  // Benchmarks run flat out, and only reproduce the same state every time if emulation is deterministic
+  if (s_runtime_config["BenchFrames"].ValueAs<unsigned>() > 0)
+  {
+    s_runtime_config.Get("Throttle").SetValue(false);
+    s_runtime_config.Get("VSync").SetValue(false);
+    SDL_GL_SetSwapInterval(0);
+    if (s_runtime_config["MultiThreaded"].ValueAs<bool>() && !s_runtime_config["Deterministic"].ValueAs<bool>())
+      puts("Benchmarking with multi-threading enabled. The state hash may differ between runs.");
+  }
+
+  // Create Model 3 emulator, or replay captured graphics states in its place
+  if (!s_runtime_config["ReplayGfx"].ValueAs<std::string>().empty())
+  {
+    std::vector<std::string> gfxStates = FindGraphicsStates(s_runtime_config["ReplayGfx"].ValueAs<std::string>());
+    if (gfxStates.empty())
+    {
+      ErrorLog("No graphics states found at '%s'.", GetGraphicsStatePath(s_runtime_config["ReplayGfx"].ValueAs<std::string>(), 0).c_str());
+      exitCode = 1;
+      goto Exit;
+    }
+    Model3 = new CModel3GraphicsState(s_runtime_config, gfxStates, true);
+  }
+  else
+  {
 #ifdef DEBUG
-  Model3 = s_gfxStatePath.empty() ? static_cast<IEmulator *>(new CModel3(s_runtime_config)) : static_cast<IEmulator *>(new CModel3GraphicsState(s_runtime_config, s_gfxStatePath));
+    Model3 = s_gfxStatePath.empty() ? static_cast<IEmulator *>(new CModel3(s_runtime_config)) : static_cast<IEmulator *>(new CModel3GraphicsState(s_runtime_config, { s_gfxStatePath }, false));
 #else
-  Model3 = new CModel3(s_runtime_config);
+    Model3 = new CModel3(s_runtime_config);
 #endif
+  }
 
   // Create input system
   if (selectedInputSystem == "sdl")
@@ -2111,6 +4017,10 @@ int main(int argc, char **argv)
   else if (selectedInputSystem == "rawinput")
     InputSystem = new CDirectInputSystem(s_runtime_config, s_window, true, false);
 #endif // SUPERMODEL_WIN32
+#ifdef __linux__
+  else if (selectedInputSystem == "evdev")
+    InputSystem = new CEvdevInputSystem(s_runtime_config);
+#endif
   else
   {
     ErrorLog("Unknown input system: %s\n", selectedInputSystem.c_str());
@@ -2170,6 +4080,14 @@ int main(int argc, char **argv)
     goto Exit;
   }
 
+  // Everything from here on needs the ROM set in memory
+  romLoad.Wait();
+  if (romLoadError)
+  {
+    exitCode = 1;
+    goto Exit;
+  }
+
 #ifdef SUPERMODEL_DEBUGGER
   // Create Supermodel debugger unless debugging is disabled
   if (!cmd_line.disable_debugger)
@@ -2194,6 +4112,8 @@ Exit:
   delete s_crosshair;
   DestroyGLScreen();
   SDL_Quit();
+  romLoad.Wait();
+  Util::Jobs::Stop();
 
   if (exitCode)
     InfoLog("Program terminated due to an error.");
@@ -34,6 +34,7 @@
 #include "Supermodel.h"
 #include "Inputs/Input.h"
 
+#include <algorithm>
 #include <vector>
 using namespace std;
 
@@ -170,7 +171,6 @@ SDLKeyMapStruct CSDLInputSystem::s_keyMap[] =
 
 CSDLInputSystem::CSDLInputSystem(const Util::Config::Node& config)
   : CInputSystem("SDL"),
-    m_keyState(nullptr),
     m_mouseX(0),
     m_mouseY(0),
     m_mouseZ(0),
@@ -180,13 +180,23 @@ CSDLInputSystem::CSDLInputSystem(const Util::Config::Node& config)
     sdlConstForceMax(0),
     sdlSelfCenterMax(0),
     sdlFrictionMax(0),
-    sdlVibrateMax(0)
+    sdlVibrateMax(0),
+    m_joySampleLatest(1),
+    m_joySampleWriting(0),
+    m_joySampleReading(2),
+    m_joySampleSerial(0),
+    m_joyThreadStop(false),
+    m_joyThread(nullptr),
+    m_joyPollRate(0)
 {
+  memset(m_keyState, 0, sizeof(m_keyState));
   memset(&eff, 0, sizeof(SDL_HapticEffect));
 }
 
 CSDLInputSystem::~CSDLInputSystem()
 {
+  StopForceFeedbackThread();
+  StopJoystickThread();
   CloseJoysticks();
 }
 
@@ -415,11 +425,88 @@ bool CSDLInputSystem::InitializeSystem()
   }
   SDL_JoystickEventState(SDL_ENABLE);
 
+  // Start from the current key and mouse state; Poll() follows the events from
+  // here on
+  int numKeys = 0;
+  const Uint8 *keyState = SDL_GetKeyboardState(&numKeys);
+  memcpy(m_keyState, keyState, std::min(sizeof(m_keyState), size_t(numKeys)));
+  m_mouseButtons = Uint8(SDL_GetMouseState(&m_mouseX, &m_mouseY));
+
   // Open attached joysticks
   OpenJoysticks();
+
+  // Optionally take reading the joysticks (which can take over a millisecond
+  // with some wheels) off the emulation thread
+  unsigned pollRate = m_config["InputPollRate"].ValueAsDefault<unsigned>(0);
+  if (pollRate > 0 && !m_joysticks.empty())
+    StartJoystickThread(pollRate);
   return true;
 }
 
+void CSDLInputSystem::StartJoystickThread(unsigned rate)
+{
+  // Lay out all joysticks' controls in one sample
+  JoySample layout;
+  m_joySampleOffsets.clear();
+  for (SDL_Joystick *joystick : m_joysticks)
+  {
+    JoySampleOffsets offsets;
+    offsets.axes = layout.axes.size();
+    offsets.numAxes = size_t(std::max(0, SDL_JoystickNumAxes(joystick)));
+    offsets.hats = layout.hats.size();
+    offsets.numHats = size_t(std::max(0, SDL_JoystickNumHats(joystick)));
+    offsets.buttons = layout.buttons.size();
+    offsets.numButtons = size_t(std::max(0, SDL_JoystickNumButtons(joystick)));
+    layout.axes.resize(offsets.axes + offsets.numAxes);
+    layout.hats.resize(offsets.hats + offsets.numHats);
+    layout.buttons.resize(offsets.buttons + offsets.numButtons);
+    m_joySampleOffsets.push_back(offsets);
+  }
+
+  // SDL_PollEvent() must no longer update the joysticks itself
+  SDL_JoystickEventState(SDL_IGNORE);
+  SDL_JoystickUpdate();
+  SampleJoysticks(&layout);
+  for (JoySample &sample : m_joySamples)
+    sample = layout;
+
+  m_joyPollRate = rate;
+  m_joyThreadStop = false;
+  m_joyThread = CThread::CreateThread("Joysticks", JoystickThreadEntry, this);
+  if (nullptr == m_joyThread)
+  {
+    ErrorLog("Unable to create joystick thread, reading joysticks every frame instead: %s\n", CThread::GetLastError());
+    SDL_JoystickEventState(SDL_ENABLE);
+  }
+}
+
+void CSDLInputSystem::StopJoystickThread()
+{
+  if (m_joyThread)
+  {
+    m_joyThreadStop = true;
+    m_joyThread->Wait();
+    delete m_joyThread;
+    m_joyThread = nullptr;
+    SDL_JoystickEventState(SDL_ENABLE);
+  }
+}
+
+void CSDLInputSystem::SampleJoysticks(JoySample *sample)
+{
+  for (size_t joyNum = 0; joyNum < m_joysticks.size(); joyNum++)
+  {
+    SDL_Joystick *joystick = m_joysticks[joyNum];
+    const JoySampleOffsets &offsets = m_joySampleOffsets[joyNum];
+    for (size_t i = 0; i < offsets.numAxes; i++)
+      sample->axes[offsets.axes + i] = SDL_JoystickGetAxis(joystick, int(i));
+    for (size_t i = 0; i < offsets.numHats; i++)
+      sample->hats[offsets.hats + i] = SDL_JoystickGetHat(joystick, int(i));
+    for (size_t i = 0; i < offsets.numButtons; i++)
+      sample->buttons[offsets.buttons + i] = SDL_JoystickGetButton(joystick, int(i));
+  }
+}
+
 int CSDLInputSystem::GetKeyIndex(const char *keyName)
 {
   for (int i = 0; i < NUM_SDL_KEYS; i++)
@@ -479,6 +566,12 @@ bool CSDLInputSystem::IsMouseButPressed(int mseNum, int butNum) const
 int CSDLInputSystem::GetJoyAxisValue(int joyNum, int axisNum) const
 {
   // Get raw joystick axis value for given joystick from SDL (values range from -32768 to 32767)
+  if (m_joyThread)
+  {
+    const JoySampleOffsets *offsets;
+    const JoySample *sample = GetJoySample(joyNum, &offsets);
+    return size_t(axisNum) < offsets->numAxes ? sample->axes[offsets->axes + axisNum] : 0;
+  }
   SDL_Joystick *joystick = m_joysticks[joyNum];
   return SDL_JoystickGetAxis(joystick, axisNum);
 }
@@ -486,8 +579,15 @@ int CSDLInputSystem::GetJoyAxisValue(int joyNum, int axisNum) const
 bool CSDLInputSystem::IsJoyPOVInDir(int joyNum, int povNum, int povDir) const
 {
   // Get current joystick POV-hat value for given joystick and POV number from SDL and check if pointing in required direction
-  SDL_Joystick *joystick = m_joysticks[joyNum];
-  int hatVal = SDL_JoystickGetHat(joystick, povNum);
+  int hatVal;
+  if (m_joyThread)
+  {
+    const JoySampleOffsets *offsets;
+    const JoySample *sample = GetJoySample(joyNum, &offsets);
+    hatVal = size_t(povNum) < offsets->numHats ? sample->hats[offsets->hats + povNum] : SDL_HAT_CENTERED;
+  }
+  else
+    hatVal = SDL_JoystickGetHat(m_joysticks[joyNum], povNum);
   switch (povDir)
   {
     case POV_UP:    return !!(hatVal & SDL_HAT_UP);
@@ -502,6 +602,12 @@ bool CSDLInputSystem::IsJoyPOVInDir(int joyNum, int povNum, int povDir) const
 bool CSDLInputSystem::IsJoyButPressed(int joyNum, int butNum) const
 {
   // Get current joystick button state for given joystick and button number from SDL
+  if (m_joyThread)
+  {
+    const JoySampleOffsets *offsets;
+    const JoySample *sample = GetJoySample(joyNum, &offsets);
+    return size_t(butNum) < offsets->numButtons && sample->buttons[offsets->buttons + butNum];
+  }
   SDL_Joystick *joystick = m_joysticks[joyNum];
   return !!SDL_JoystickGetButton(joystick, butNum);
 }
@@ -587,12 +693,64 @@ const JoyDetails *CSDLInputSystem::GetJoyDetails(int joyNum)
   return &m_joyDetails[joyNum];
 }
 
+int CSDLInputSystem::JoystickThreadEntry(void *data)
+{
+  reinterpret_cast<CSDLInputSystem *>(data)->RunJoystickThread();
+  return 0;
+}
+
+void CSDLInputSystem::RunJoystickThread()
+{
+  UINT64 period = 1000000 / m_joyPollRate;
+  UINT64 nextTime = CThread::GetMicros();
+  JoySample previous = m_joySamples[m_joySampleWriting];
+  while (!m_joyThreadStop)
+  {
+    SDL_JoystickUpdate();
+    JoySample &sample = m_joySamples[m_joySampleWriting];
+    SampleJoysticks(&sample);
+
+    // Let Poll() see whether anything moved without comparing samples itself
+    if (sample.axes != previous.axes || sample.hats != previous.hats || sample.buttons != previous.buttons)
+    {
+      previous.serial++;
+      previous.axes = sample.axes;
+      previous.hats = sample.hats;
+      previous.buttons = sample.buttons;
+    }
+    sample.serial = previous.serial;
+
+    // Publish the sample, taking back whichever buffer it replaces
+    m_joySampleWriting = m_joySampleLatest.exchange(m_joySampleWriting | JOY_SAMPLE_FRESH) & ~JOY_SAMPLE_FRESH;
+
+    nextTime += period;
+    UINT64 now = CThread::GetMicros();
+    if (now < nextTime)
+      CThread::Sleep(UINT32((nextTime - now + 999) / 1000));
+    else
+      nextTime = now;   // fell behind; don't try to catch up
+  }
+}
+
+const CSDLInputSystem::JoySample *CSDLInputSystem::GetJoySample(int joyNum, const JoySampleOffsets **offsets) const
+{
+  *offsets = &m_joySampleOffsets[joyNum];
+  return &m_joySamples[m_joySampleReading];
+}
+
 bool CSDLInputSystem::Poll()
 {
   // Reset mouse wheel direction
-  m_mouseWheelDir = 0;
+  if (m_mouseWheelDir != 0)
+  {
+    m_mouseWheelDir = 0;
+    m_changeCount++;
+  }
 
-  // Poll for event from SDL
+  // Poll for event from SDL. Key and mouse state is updated from the events
+  // rather than fetched afterwards, so that it is known whether anything
+  // changed. Joystick state is kept by SDL itself (SDL_PollEvent() updates the
+  // joysticks implicitly unless the joystick thread does it).
   SDL_Event e;
   while (SDL_PollEvent(&e))
   {
@@ -602,29 +760,68 @@ bool CSDLInputSystem::Poll()
 	    break;
 		case SDL_QUIT:
 			return false;
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			if (e.key.keysym.scancode < SDL_NUM_SCANCODES)
+			{
+				Uint8 pressed = e.key.state == SDL_PRESSED;
+				m_changeCount += m_keyState[e.key.keysym.scancode] != pressed;
+				m_keyState[e.key.keysym.scancode] = pressed;
+			}
+			break;
+		case SDL_MOUSEMOTION:
+			m_mouseX = e.motion.x;
+			m_mouseY = e.motion.y;
+			m_changeCount++;
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+			if (e.button.state == SDL_PRESSED)
+				m_mouseButtons |= Uint8(SDL_BUTTON(e.button.button));
+			else
+				m_mouseButtons &= Uint8(~SDL_BUTTON(e.button.button));
+			m_changeCount++;
+			break;
 		case SDL_MOUSEWHEEL:
 			if (e.button.y > 0)
 			{
 				m_mouseZ += 5;
 				m_mouseWheelDir = 1;
+				m_changeCount++;
 			}
 			else if (e.button.y < 0)
 			{
 				m_mouseZ -= 5;
 				m_mouseWheelDir = -1;
+				m_changeCount++;
 			}
 			break;
+		case SDL_JOYAXISMOTION:
+		case SDL_JOYBALLMOTION:
+		case SDL_JOYHATMOTION:
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			m_changeCount++;
+			break;
 		}
   }
 
-  // Get key state from SDL
-  m_keyState = SDL_GetKeyboardState(nullptr);
-
-  // Get mouse state from SDL (except mouse wheel which was handled earlier)
-  m_mouseButtons = SDL_GetMouseState(&m_mouseX, &m_mouseY);
+  // Or pick up the latest sample from the joystick thread, if there is a new one
+  if (m_joyThread && (m_joySampleLatest.load() & JOY_SAMPLE_FRESH))
+  {
+    m_joySampleReading = m_joySampleLatest.exchange(m_joySampleReading) & ~JOY_SAMPLE_FRESH;
+    if (m_joySamples[m_joySampleReading].serial != m_joySampleSerial)
+    {
+      m_joySampleSerial = m_joySamples[m_joySampleReading].serial;
+      m_changeCount++;
+    }
+  }
+  return true;
+}
 
-  // Update joystick state (not required as called implicitly by SDL_PollEvent above)
-  //SDL_JoystickUpdate();
+bool CSDLInputSystem::GetChangeCount(unsigned *count) const
+{
+  *count = m_changeCount;
   return true;
 }
 
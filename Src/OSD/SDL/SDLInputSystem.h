@@ -32,7 +32,9 @@
 #include "Inputs/InputSource.h"
 #include "Inputs/InputSystem.h"
 #include "SDLIncludes.h"
+#include "OSD/Thread.h"
 
+#include <atomic>
 #include <vector>
 
 #define NUM_SDL_KEYS (sizeof(s_keyMap) / sizeof(SDLKeyMapStruct))
@@ -60,10 +62,9 @@ private:
 	// Vector of joystick details
 	std::vector<JoyDetails> m_joyDetails;
 
-	// Current key state obtained from SDL
-	const Uint8 *m_keyState;
-
-	// Current mouse state obtained from SDL
+	// Current key and mouse state, kept up to date from SDL events by Poll() so
+	// that nothing needs to be fetched from SDL every frame
+	Uint8 m_keyState[SDL_NUM_SCANCODES];
 	int m_mouseX;
 	int m_mouseY;
 	int m_mouseZ;
@@ -86,6 +87,33 @@ private:
 	};
 	std::vector<hapticInfo> m_SDLHapticDatas;
 
+	// Joystick state sampled at a fixed rate on a separate thread, when enabled.
+	// Samples are handed over through a triple buffer: the thread fills one,
+	// Poll() reads another and the third is the latest complete sample.
+	struct JoySample
+	{
+		std::vector<Sint16> axes;
+		std::vector<Uint8> hats;
+		std::vector<Uint8> buttons;
+		unsigned serial = 0;  // incremented by the thread whenever the controls move
+	};
+	struct JoySampleOffsets
+	{
+		size_t axes, numAxes;
+		size_t hats, numHats;
+		size_t buttons, numButtons;
+	};
+	static const unsigned JOY_SAMPLE_FRESH = 4;  // flags a sample not yet picked up by Poll()
+	std::vector<JoySampleOffsets> m_joySampleOffsets;
+	JoySample m_joySamples[3];
+	std::atomic<unsigned> m_joySampleLatest;
+	unsigned m_joySampleWriting;
+	unsigned m_joySampleReading;
+	unsigned m_joySampleSerial;  // of the sample last read
+	std::atomic<bool> m_joyThreadStop;
+	CThread *m_joyThread;
+	unsigned m_joyPollRate;
+
 	/*
 	 * Opens all attached joysticks.
 	 */
@@ -96,6 +124,21 @@ private:
 	 */
 	void CloseJoysticks();
 
+	/*
+	 * Starts and stops sampling the joysticks on a separate thread.
+	 */
+	void StartJoystickThread(unsigned rate);
+
+	void StopJoystickThread();
+
+	static int JoystickThreadEntry(void *data);
+
+	void RunJoystickThread();
+
+	void SampleJoysticks(JoySample *sample);
+
+	const JoySample *GetJoySample(int joyNum, const JoySampleOffsets **offsets) const;
+
 protected:
 	/*
 	 * Initializes the SDL input system.
@@ -164,6 +207,8 @@ public:
 
 	bool Poll();
 
+	bool GetChangeCount(unsigned *count) const;
+
 	void SetMouseVisibility(bool visible);
 };
 
@@ -30,6 +30,184 @@
 #include "Supermodel.h"
 #include "SDLIncludes.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#undef CreateSemaphore
+#undef CreateMutex
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+  struct Scheduling
+  {
+    std::string cores;
+    std::string priority;
+  };
+
+  struct StartInfo
+  {
+    std::string name;
+    ThreadStart start;
+    void *startParam;
+  };
+
+  std::mutex s_schedulingMutex;
+  std::map<std::string, Scheduling> s_scheduling;
+
+  int StartThread(void *param)
+  {
+    std::unique_ptr<StartInfo> info((StartInfo *) param);
+    CThread::ApplyScheduling(info->name);
+    return info->start(info->startParam);
+  }
+
+  // Relative performance of each logical processor (higher is faster), empty if unknown
+  std::vector<unsigned> GetCorePerformance()
+  {
+    std::vector<unsigned> performance;
+#if defined(_WIN32)
+    DWORD size = 0;
+    GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &size);
+    std::vector<BYTE> buffer(size);
+    auto info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX) buffer.data();
+    if (size == 0 || !GetLogicalProcessorInformationEx(RelationProcessorCore, info, &size))
+      return performance;
+    for (DWORD offset = 0; offset < size; offset += info->Size)
+    {
+      info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX) &buffer[offset];
+      if (info->Processor.GroupMask[0].Group != 0)  // affinity is only set within the first group
+        continue;
+      for (unsigned cpu = 0; cpu < sizeof(KAFFINITY) * 8; cpu++)
+      {
+        if ((info->Processor.GroupMask[0].Mask >> cpu) & 1)
+        {
+          if (performance.size() <= cpu)
+            performance.resize(cpu + 1, 0);
+          performance[cpu] = info->Processor.EfficiencyClass + 1;
+        }
+      }
+    }
+#elif defined(__linux__)
+    // ARM reports each core's capacity; elsewhere, the maximum frequency tells the classes apart
+    for (unsigned cpu = 0; cpu < (unsigned) SDL_GetCPUCount(); cpu++)
+    {
+      unsigned value = 0;
+      for (const char *file : { "cpu_capacity", "cpufreq/cpuinfo_max_freq" })
+      {
+        char path[96];
+        sprintf(path, "/sys/devices/system/cpu/cpu%u/%s", cpu, file);
+        FILE *fp = fopen(path, "r");
+        if (fp == nullptr)
+          continue;
+        bool ok = fscanf(fp, "%u", &value) == 1;
+        fclose(fp);
+        if (ok)
+          break;
+      }
+      if (value == 0)
+        return std::vector<unsigned>();
+      performance.push_back(value);
+    }
+#endif
+    return performance;
+  }
+
+  bool ParseCores(const std::string &spec, std::vector<unsigned> *cores)
+  {
+    if (spec == "performance" || spec == "efficiency")
+    {
+      std::vector<unsigned> performance = GetCorePerformance();
+      unsigned fastest = 0;
+      for (unsigned value : performance)
+        fastest = std::max(fastest, value);
+      for (unsigned cpu = 0; cpu < performance.size(); cpu++)
+      {
+        if (performance[cpu] != 0 && (performance[cpu] == fastest) == (spec == "performance"))
+          cores->push_back(cpu);
+      }
+      if (cores->empty())
+        ErrorLog("No %s cores found. Thread placement left to the operating system.\n", spec.c_str());
+      return !cores->empty();
+    }
+
+    const char *p = spec.c_str();
+    while (*p != '\0')
+    {
+      unsigned first, last, n = 0;
+      if (sscanf(p, "%u-%u%n", &first, &last, &n) != 2 || n == 0)
+      {
+        n = 0;
+        if (sscanf(p, "%u%n", &first, &n) != 1 || n == 0)
+        {
+          ErrorLog("Invalid core list: %s\n", spec.c_str());
+          return false;
+        }
+        last = first;
+      }
+      for (unsigned cpu = first; cpu <= last; cpu++)
+        cores->push_back(cpu);
+      p += n;
+      while (*p == ',' || *p == ' ')
+        p++;
+    }
+    return !cores->empty();
+  }
+
+  bool SetAffinity(const std::vector<unsigned> &cores)
+  {
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (unsigned cpu : cores)
+    {
+      if (cpu < sizeof(mask) * 8)
+        mask |= DWORD_PTR(1) << cpu;
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu : cores)
+    {
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) != 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;   // macOS only accepts affinity hints, which it ignores on Apple Silicon
+#endif
+  }
+
+  bool SetPriority(const std::string &priority)
+  {
+    SDL_ThreadPriority value;
+    if (priority == "low")
+      value = SDL_THREAD_PRIORITY_LOW;
+    else if (priority == "normal")
+      value = SDL_THREAD_PRIORITY_NORMAL;
+    else if (priority == "high")
+      value = SDL_THREAD_PRIORITY_HIGH;
+    else if (priority == "realtime")
+      value = SDL_THREAD_PRIORITY_TIME_CRITICAL;
+    else
+    {
+      ErrorLog("Invalid thread priority: %s\n", priority.c_str());
+      return false;
+    }
+    return SDL_SetThreadPriority(value) == 0;
+  }
+}
+
 void CThread::Sleep(UINT32 ms)
 {
 	SDL_Delay(ms);
@@ -40,14 +218,52 @@ UINT32 CThread::GetTicks()
 	return SDL_GetTicks();
 }
 
+UINT64 CThread::GetMicros()
+{
+	static const UINT64 frequency = SDL_GetPerformanceFrequency();
+	UINT64 counter = SDL_GetPerformanceCounter();
+	return (counter / frequency) * 1000000 + (counter % frequency) * 1000000 / frequency;	// split to avoid overflow
+}
+
 CThread *CThread::CreateThread(const std::string &name, ThreadStart start, void *startParam)
 {
-	SDL_Thread *impl = SDL_CreateThread(start, name.c_str(), startParam);
+	StartInfo *info = new StartInfo{ name, start, startParam };
+	SDL_Thread *impl = SDL_CreateThread(StartThread, name.c_str(), info);
 	if (impl == NULL)
+	{
+		delete info;
 		return NULL;
+	}
 	return new CThread(name, impl);
 }
 
+void CThread::SetScheduling(const std::string &name, const std::string &cores, const std::string &priority)
+{
+	std::lock_guard<std::mutex> lock(s_schedulingMutex);
+	if (cores.empty() && priority.empty())
+		s_scheduling.erase(name);
+	else
+		s_scheduling[name] = Scheduling{ cores, priority };
+}
+
+void CThread::ApplyScheduling(const std::string &name)
+{
+	Scheduling scheduling;
+	{
+		std::lock_guard<std::mutex> lock(s_schedulingMutex);
+		auto it = s_scheduling.find(name);
+		if (it == s_scheduling.end())
+			return;
+		scheduling = it->second;
+	}
+
+	std::vector<unsigned> cores;
+	if (!scheduling.cores.empty() && ParseCores(scheduling.cores, &cores) && !SetAffinity(cores))
+		ErrorLog("Unable to set the cores of the %s thread.\n", name.c_str());
+	if (!scheduling.priority.empty() && !SetPriority(scheduling.priority))
+		ErrorLog("Unable to set the priority of the %s thread: %s\n", name.c_str(), SDL_GetError());
+}
+
 CSemaphore *CThread::CreateSemaphore(UINT32 initVal)
 {
 	SDL_sem *impl = SDL_CreateSemaphore(initVal);
@@ -56,6 +272,14 @@ CSemaphore *CThread::CreateSemaphore(UINT32 initVal)
 	return new CSemaphore(impl);
 }
 
+CFastSemaphore *CThread::CreateFastSemaphore(UINT32 initVal)
+{
+	CSemaphore *sem = CreateSemaphore(0);
+	if (sem == NULL)
+		return NULL;
+	return new CFastSemaphore(sem, initVal);
+}
+
 CCondVar *CThread::CreateCondVar()
 {
 	SDL_cond *impl = SDL_CreateCond();
@@ -139,6 +363,44 @@ bool CSemaphore::Post()
 	return SDL_SemPost((SDL_sem*)m_impl) == 0;
 }
 
+CFastSemaphore::CFastSemaphore(CSemaphore *sem, UINT32 initVal)
+  : m_count((int)initVal),
+    m_sem(sem)
+{
+	//
+}
+
+CFastSemaphore::~CFastSemaphore()
+{
+	delete m_sem;
+}
+
+bool CFastSemaphore::Wait()
+{
+	// Spin (yielding after a while) in case the semaphore is about to be posted
+	for (int i = 0; i < 256; i++)
+	{
+		int count = m_count.load(std::memory_order_relaxed);
+		if (count > 0 && m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire))
+			return true;
+		if (i >= 64)
+			std::this_thread::yield();
+	}
+
+	// Take the count; if it was not positive, sleep until posted
+	if (m_count.fetch_sub(1, std::memory_order_acquire) > 0)
+		return true;
+	return m_sem->Wait();
+}
+
+bool CFastSemaphore::Post()
+{
+	// Only wake through the O/S semaphore if a thread is blocked on it
+	if (m_count.fetch_add(1, std::memory_order_release) < 0)
+		return m_sem->Post();
+	return true;
+}
+
 CCondVar::CCondVar(void *impl) : m_impl(impl)
 {
 	//
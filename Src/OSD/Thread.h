@@ -31,8 +31,10 @@
 #include "Types.h"
 
 #include <string>
+#include <atomic>
 
 class CSemaphore;
+class CFastSemaphore;
 class CMutex;
 class CCondVar;
 
@@ -65,6 +67,14 @@ public:
 	 * Gets number of millseconds since beginning of program.
 	 */
 	static UINT32 GetTicks();
+
+	/*
+	 * GetMicros
+	 *
+	 * Gets number of microseconds since an arbitrary point in time, from the
+	 * high resolution performance counter.
+	 */
+	static UINT64 GetMicros();
 	
 	/*
    * CreateThread
@@ -73,6 +83,27 @@ public:
 	 */
 	static CThread *CreateThread(const std::string &name, ThreadStart start, void *startParam);
 
+	/*
+	 * SetScheduling
+	 *
+	 * Sets the cores and priority that threads with the given name run with.
+	 * Applies to threads created afterwards. Cores are given as a list of
+	 * logical processor numbers and ranges (e.g., "0,2-3"), or "performance"
+	 * or "efficiency" on hybrid CPUs; empty leaves the choice to the O/S.
+	 * Priority is "low", "normal", "high" or "realtime"; empty leaves it
+	 * unchanged.
+	 */
+	static void SetScheduling(const std::string &name, const std::string &cores, const std::string &priority);
+
+	/*
+	 * ApplyScheduling
+	 *
+	 * Applies the scheduling set for the given name to the calling thread.
+	 * Threads created with CreateThread() do this automatically; it is needed
+	 * for the main thread and for threads owned by libraries (e.g., audio).
+	 */
+	static void ApplyScheduling(const std::string &name);
+
 	/* 
 	 * CreateSemaphore
 	 * 
@@ -80,6 +111,13 @@ public:
 	 */
 	static CSemaphore *CreateSemaphore(UINT32 initVal);
 
+	/* 
+	 * CreateFastSemaphore
+	 * 
+	 * Creates a new fast semaphore with the given initial starting value.
+	 */
+	static CFastSemaphore *CreateFastSemaphore(UINT32 initVal);
+
 	/* 
 	 * CreateCondVar
 	 *
@@ -167,6 +205,43 @@ public:
 	bool Post();
 };
 
+/*
+ * CFastSemaphore
+ *
+ * Semaphore whose count is maintained with atomic operations. Waiting threads
+ * spin briefly before blocking, and the underlying O/S semaphore is only used
+ * when a thread actually has to sleep, so a handoff between threads that are
+ * closely in step does not enter the kernel.
+ */
+class CFastSemaphore
+{
+friend class CThread;
+
+private:
+	std::atomic<int> m_count;	// negative when threads are blocked on m_sem
+	CSemaphore *m_sem;
+
+	CFastSemaphore(CSemaphore *sem, UINT32 initVal);
+
+public:
+	~CFastSemaphore();
+
+	/*
+	 * Wait
+	 *
+	 * Decrements this semaphore, suspending the calling thread if its value is
+	 * zero.
+	 */
+	bool Wait();
+
+	/*
+	 * Post
+	 *
+	 * Increments this semaphore, resuming a thread blocked on it (if any).
+	 */
+	bool Post();
+};
+
 /*
  * CCondVar
  *
@@ -0,0 +1,214 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * AlsaAudioOutput.cpp
+ *
+ * ALSA audio output backend. The "default" device is opened, so on PipeWire
+ * and PulseAudio systems this goes through their ALSA plugin. The device
+ * buffer is two periods long and a thread of its own sleeps in
+ * snd_pcm_wait() until a period has been played, then writes the next one.
+ * Requires SUPERMODEL_ALSA (ALSA_AUDIO=1 in the Makefile, the default), else
+ * there is no native backend and SDL audio is used.
+ */
+
+#include "OSD/AudioOutput.h"
+
+#if defined(__linux__) && defined(SUPERMODEL_ALSA)
+
+#include "Supermodel.h"
+#include "OSD/Thread.h"
+
+#include <alsa/asoundlib.h>
+#include <atomic>
+#include <vector>
+
+class CAlsaAudioOutput : public CAudioOutput
+{
+public:
+  CAlsaAudioOutput()
+    : m_pcm(nullptr),
+      m_thread(nullptr),
+      m_stop(false),
+      m_pull(nullptr),
+      m_bytesPerSample(0),
+      m_period(0)
+  {
+  }
+
+  ~CAlsaAudioOutput()
+  {
+    Close();
+  }
+
+  bool Open(unsigned sampleRate, unsigned channels, bool floatSamples, unsigned periodSamples, PullFPtr pull) override
+  {
+    int err = snd_pcm_open(&m_pcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0)
+    {
+      m_pcm = nullptr;
+      ErrorLog("Unable to open ALSA audio device: %s\n", snd_strerror(err));
+      return false;
+    }
+
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(m_pcm, hw);
+    unsigned rate = sampleRate;
+    snd_pcm_uframes_t period = periodSamples;
+    snd_pcm_uframes_t bufferSize = 2 * periodSamples;
+    if ((err = snd_pcm_hw_params_set_access(m_pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0 ||
+        (err = snd_pcm_hw_params_set_format(m_pcm, hw, floatSamples ? SND_PCM_FORMAT_FLOAT : SND_PCM_FORMAT_S16)) < 0 ||
+        (err = snd_pcm_hw_params_set_channels(m_pcm, hw, channels)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate_near(m_pcm, hw, &rate, nullptr)) < 0 ||
+        (err = snd_pcm_hw_params_set_period_size_near(m_pcm, hw, &period, nullptr)) < 0 ||
+        (err = snd_pcm_hw_params_set_buffer_size_near(m_pcm, hw, &bufferSize)) < 0 ||
+        (err = snd_pcm_hw_params(m_pcm, hw)) < 0)
+    {
+      ErrorLog("Unable to configure ALSA audio device: %s\n", snd_strerror(err));
+      Close();
+      return false;
+    }
+    if (rate != sampleRate)
+    {
+      ErrorLog("ALSA audio device does not support %u Hz.\n", sampleRate);
+      Close();
+      return false;
+    }
+    snd_pcm_hw_params_get_period_size(hw, &period, nullptr);
+    snd_pcm_hw_params_get_buffer_size(hw, &bufferSize);
+
+    // Begin playing once the whole buffer has been written and wake up for
+    // each period
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(m_pcm, sw);
+    snd_pcm_sw_params_set_start_threshold(m_pcm, sw, bufferSize);
+    snd_pcm_sw_params_set_avail_min(m_pcm, sw, period);
+    if ((err = snd_pcm_sw_params(m_pcm, sw)) < 0)
+    {
+      ErrorLog("Unable to configure ALSA audio device: %s\n", snd_strerror(err));
+      Close();
+      return false;
+    }
+
+    m_pull = pull;
+    m_bytesPerSample = channels * (floatSamples ? sizeof(float) : sizeof(INT16));
+    m_period = unsigned(period);
+    m_buffer.resize(m_period * m_bytesPerSample);
+    return true;
+  }
+
+  bool Start() override
+  {
+    m_stop = false;
+    m_thread = CThread::CreateThread("Audio", ThreadEntry, this);
+    if (nullptr == m_thread)
+    {
+      ErrorLog("Unable to create audio thread: %s\n", CThread::GetLastError());
+      return false;
+    }
+    return true;
+  }
+
+  void Close() override
+  {
+    if (m_thread)
+    {
+      m_stop = true;
+      m_thread->Wait();
+      delete m_thread;
+      m_thread = nullptr;
+    }
+    if (m_pcm)
+    {
+      snd_pcm_drop(m_pcm);
+      snd_pcm_close(m_pcm);
+      m_pcm = nullptr;
+    }
+  }
+
+  unsigned GetPeriod() const override
+  {
+    return m_period;
+  }
+
+  const char *GetName() const override
+  {
+    return "ALSA";
+  }
+
+private:
+  snd_pcm_t *m_pcm;
+  CThread *m_thread;
+  std::atomic<bool> m_stop;
+  PullFPtr m_pull;
+  unsigned m_bytesPerSample;
+  unsigned m_period;
+  std::vector<INT8> m_buffer;
+
+  static int ThreadEntry(void *data)
+  {
+    reinterpret_cast<CAlsaAudioOutput *>(data)->Run();
+    return 0;
+  }
+
+  void Run()
+  {
+    while (!m_stop)
+    {
+      snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcm);
+      if (avail < 0)
+      {
+        // Under-run or suspend: restart the stream, which refills it before playing
+        if (snd_pcm_recover(m_pcm, int(avail), 1) < 0)
+          break;
+        continue;
+      }
+
+      // Wake up regularly to check whether to stop
+      if (avail < snd_pcm_sframes_t(m_period))
+      {
+        snd_pcm_wait(m_pcm, 100);
+        continue;
+      }
+
+      m_pull(m_buffer.data(), m_period);
+      snd_pcm_sframes_t written = snd_pcm_writei(m_pcm, m_buffer.data(), m_period);
+      if (written < 0 && snd_pcm_recover(m_pcm, int(written), 1) < 0)
+        break;
+    }
+  }
+};
+
+CAudioOutput *CreateNativeAudioOutput()
+{
+  return new CAlsaAudioOutput();
+}
+
+#else
+
+CAudioOutput *CreateNativeAudioOutput()
+{
+  return nullptr;
+}
+
+#endif  // __linux__ && SUPERMODEL_ALSA
@@ -0,0 +1,966 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * EvdevInputSystem.cpp
+ *
+ * Implementation of the Linux event device input system.
+ */
+
+#include "EvdevInputSystem.h"
+#include "Supermodel.h"
+#include "Inputs/Input.h"
+#include "SDLIncludes.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#define NUM_EVDEV_KEYS (sizeof(s_keyMap) / sizeof(EvdevKeyMapStruct))
+
+// Kernel bit masks are arrays of longs
+#define BITS_PER_LONG       (sizeof(unsigned long) * 8)
+#define NUM_LONGS(bits)     (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+static bool TestBit(const unsigned long *bits, int bit)
+{
+  return !!(bits[bit / BITS_PER_LONG] & (1UL << (bit % BITS_PER_LONG)));
+}
+
+// Key names are the same as for the SDL input system
+EvdevKeyMapStruct CEvdevInputSystem::s_keyMap[] =
+{
+  // General keys
+  { "BACKSPACE",      KEY_BACKSPACE },
+  { "TAB",            KEY_TAB },
+  { "CLEAR",          KEY_CLEAR },
+  { "RETURN",         KEY_ENTER },
+  { "PAUSE",          KEY_PAUSE },
+  { "ESCAPE",         KEY_ESC },
+  { "SPACE",          KEY_SPACE },
+  { "QUOTE",          KEY_APOSTROPHE },
+  { "LEFTPAREN",      KEY_KPLEFTPAREN },
+  { "RIGHTPAREN",     KEY_KPRIGHTPAREN },
+  { "COMMA",          KEY_COMMA },
+  { "MINUS",          KEY_MINUS },
+  { "PERIOD",         KEY_DOT },
+  { "SLASH",          KEY_SLASH },
+  { "0",              KEY_0 },
+  { "1",              KEY_1 },
+  { "2",              KEY_2 },
+  { "3",              KEY_3 },
+  { "4",              KEY_4 },
+  { "5",              KEY_5 },
+  { "6",              KEY_6 },
+  { "7",              KEY_7 },
+  { "8",              KEY_8 },
+  { "9",              KEY_9 },
+  { "SEMICOLON",      KEY_SEMICOLON },
+  { "EQUALS",         KEY_EQUAL },
+  { "LEFTBRACKET",    KEY_LEFTBRACE },
+  { "BACKSLASH",      KEY_BACKSLASH },
+  { "RIGHTBRACKET",   KEY_RIGHTBRACE },
+  { "BACKQUOTE",      KEY_GRAVE },
+  { "A",              KEY_A },
+  { "B",              KEY_B },
+  { "C",              KEY_C },
+  { "D",              KEY_D },
+  { "E",              KEY_E },
+  { "F",              KEY_F },
+  { "G",              KEY_G },
+  { "H",              KEY_H },
+  { "I",              KEY_I },
+  { "J",              KEY_J },
+  { "K",              KEY_K },
+  { "L",              KEY_L },
+  { "M",              KEY_M },
+  { "N",              KEY_N },
+  { "O",              KEY_O },
+  { "P",              KEY_P },
+  { "Q",              KEY_Q },
+  { "R",              KEY_R },
+  { "S",              KEY_S },
+  { "T",              KEY_T },
+  { "U",              KEY_U },
+  { "V",              KEY_V },
+  { "W",              KEY_W },
+  { "X",              KEY_X },
+  { "Y",              KEY_Y },
+  { "Z",              KEY_Z },
+  { "DEL",            KEY_DELETE },
+
+  // Keypad
+  { "KEYPAD0",        KEY_KP0 },
+  { "KEYPAD1",        KEY_KP1 },
+  { "KEYPAD2",        KEY_KP2 },
+  { "KEYPAD3",        KEY_KP3 },
+  { "KEYPAD4",        KEY_KP4 },
+  { "KEYPAD5",        KEY_KP5 },
+  { "KEYPAD6",        KEY_KP6 },
+  { "KEYPAD7",        KEY_KP7 },
+  { "KEYPAD8",        KEY_KP8 },
+  { "KEYPAD9",        KEY_KP9 },
+  { "KEYPADPERIOD",   KEY_KPDOT },
+  { "KEYPADDIVIDE",   KEY_KPSLASH },
+  { "KEYPADMULTIPLY", KEY_KPASTERISK },
+  { "KEYPADMINUS",    KEY_KPMINUS },
+  { "KEYPADPLUS",     KEY_KPPLUS },
+  { "KEYPADENTER",    KEY_KPENTER },
+  { "KEYPADEQUALS",   KEY_KPEQUAL },
+
+  // Arrows + Home/End Pad
+  { "UP",             KEY_UP },
+  { "DOWN",           KEY_DOWN },
+  { "RIGHT",          KEY_RIGHT },
+  { "LEFT",           KEY_LEFT },
+  { "INSERT",         KEY_INSERT },
+  { "HOME",           KEY_HOME },
+  { "END",            KEY_END },
+  { "PGUP",           KEY_PAGEUP },
+  { "PGDN",           KEY_PAGEDOWN },
+
+  // Function Key
+  { "F1",             KEY_F1 },
+  { "F2",             KEY_F2 },
+  { "F3",             KEY_F3 },
+  { "F4",             KEY_F4 },
+  { "F5",             KEY_F5 },
+  { "F6",             KEY_F6 },
+  { "F7",             KEY_F7 },
+  { "F8",             KEY_F8 },
+  { "F9",             KEY_F9 },
+  { "F10",            KEY_F10 },
+  { "F11",            KEY_F11 },
+  { "F12",            KEY_F12 },
+  { "F13",            KEY_F13 },
+  { "F14",            KEY_F14 },
+  { "F15",            KEY_F15 },
+
+  // Modifier Keys
+  { "RIGHTSHIFT",     KEY_RIGHTSHIFT },
+  { "LEFTSHIFT",      KEY_LEFTSHIFT },
+  { "RIGHTCTRL",      KEY_RIGHTCTRL },
+  { "LEFTCTRL",       KEY_LEFTCTRL },
+  { "RIGHTALT",       KEY_RIGHTALT },
+  { "LEFTALT",        KEY_LEFTALT },
+  { "RIGHTMETA",      KEY_RIGHTMETA },
+  { "LEFTMETA",       KEY_LEFTMETA },
+  { "ALTGR",          KEY_RIGHTALT },   // AltGr is the right Alt key on Linux
+
+  // Other
+  { "HELP",           KEY_HELP },
+  { "SYSREQ",         KEY_SYSRQ },
+  { "MENU",           KEY_COMPOSE },
+  { "POWER",          KEY_POWER },
+  { "UNDO",           KEY_UNDO }
+};
+
+// Mouse buttons in Supermodel's order (left, middle, right, X1, X2)
+static const int s_mseButtonCodes[NUM_MOUSE_BUTTONS] = { BTN_LEFT, BTN_MIDDLE, BTN_RIGHT, BTN_SIDE, BTN_EXTRA };
+
+// Event codes read for each joystick axis, in order of preference (wheels and
+// pedals report their own codes)
+static const int s_joyAxisCodes[NUM_JOY_AXES][2] =
+{
+  { ABS_X,        ABS_WHEEL },  // AXIS_X
+  { ABS_Y,        -1 },         // AXIS_Y
+  { ABS_Z,        -1 },         // AXIS_Z
+  { ABS_RX,       -1 },         // AXIS_RX
+  { ABS_RY,       -1 },         // AXIS_RY
+  { ABS_RZ,       -1 },         // AXIS_RZ
+  { ABS_THROTTLE, ABS_GAS },    // AXIS_S1
+  { ABS_RUDDER,   ABS_BRAKE }   // AXIS_S2
+};
+
+static int ScaleJoyAxis(const input_absinfo &info, int value)
+{
+  if (info.maximum <= info.minimum)
+    return 0;
+  int scaled = int(int64_t(value - info.minimum) * 65535 / (info.maximum - info.minimum)) - 32768;
+  return CInputSource::Clamp(scaled, -32768, 32767);
+}
+
+CEvdevInputSystem::Device::Device()
+{
+  for (auto &word : keys)
+    word = 0;
+  memset(absAxis, -1, sizeof(absAxis));
+  memset(axisInfo, 0, sizeof(axisInfo));
+  for (int i = 0; i < NUM_JOY_AXES; i++)
+    axes[i] = 0;
+  for (int i = 0; i < NUM_JOY_POVS; i++)
+  {
+    hatX[i] = 0;
+    hatY[i] = 0;
+  }
+  relX = 0;
+  relY = 0;
+  wheel = 0;
+  for (int i = 0; i < NUM_FF_EFFECT_SLOTS; i++)
+  {
+    ffSupported[i] = false;
+    ffEffects[i] = -1;
+  }
+}
+
+CEvdevInputSystem::CEvdevInputSystem(const Util::Config::Node &config)
+  : CInputSystem("evdev"),
+    m_config(config),
+    m_eventCount(0),
+    m_readerStop(false),
+    m_readerThread(nullptr)
+{
+}
+
+CEvdevInputSystem::~CEvdevInputSystem()
+{
+  StopForceFeedbackThread();
+  if (m_readerThread)
+  {
+    m_readerStop = true;
+    m_readerThread->Wait();
+    delete m_readerThread;
+    m_readerThread = nullptr;
+  }
+  CloseDevices();
+}
+
+void CEvdevInputSystem::OpenDevices()
+{
+  // Event devices in the order the kernel numbered them
+  std::vector<int> eventNums;
+  DIR *dir = opendir("/dev/input");
+  if (dir == nullptr)
+    return;
+  while (dirent *entry = readdir(dir))
+  {
+    int eventNum;
+    if (sscanf(entry->d_name, "event%d", &eventNum) == 1)
+      eventNums.push_back(eventNum);
+  }
+  closedir(dir);
+  std::sort(eventNums.begin(), eventNums.end());
+
+  unsigned unreadable = 0;
+  for (int eventNum : eventNums)
+  {
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/input/event%d", eventNum);
+
+    // Write access is only needed for force feedback
+    bool writable = true;
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+      writable = false;
+      fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if (fd < 0)
+    {
+      unreadable++;
+      continue;
+    }
+
+    unsigned long evBits[NUM_LONGS(EV_CNT)] = {};
+    unsigned long keyBits[NUM_LONGS(KEY_CNT)] = {};
+    unsigned long absBits[NUM_LONGS(ABS_CNT)] = {};
+    unsigned long relBits[NUM_LONGS(REL_CNT)] = {};
+    unsigned long ffBits[NUM_LONGS(FF_CNT)] = {};
+    ioctl(fd, EVIOCGBIT(0, sizeof(evBits)), evBits);
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits);
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits);
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(relBits)), relBits);
+    ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBits)), ffBits);
+    bool hasKeys = TestBit(evBits, EV_KEY);
+    bool hasAbs = TestBit(evBits, EV_ABS);
+    bool hasRel = TestBit(evBits, EV_REL);
+
+    // Joysticks, gamepads and wheels have buttons of their own (touchpads and
+    // tablets, whose BTN_DIGI range is skipped, have none)
+    bool hasJoyButtons = false;
+    for (int code = BTN_JOYSTICK; code < KEY_CNT && !hasJoyButtons; code++)
+    {
+      if (code >= BTN_DIGI && code < BTN_WHEEL)
+        continue;
+      hasJoyButtons = hasKeys && TestBit(keyBits, code);
+    }
+    bool isTouch = hasKeys && (TestBit(keyBits, BTN_TOUCH) || TestBit(keyBits, BTN_TOOL_FINGER) || TestBit(keyBits, BTN_TOOL_PEN));
+    bool hasMouseButton = hasKeys && TestBit(keyBits, BTN_LEFT);
+    bool hasMainKeys = false;
+    for (int code = KEY_ESC; code <= KEY_KPDOT && !hasMainKeys; code++)
+      hasMainKeys = hasKeys && TestBit(keyBits, code);
+
+    auto device = std::make_unique<Device>();
+    if (hasAbs && hasJoyButtons && (TestBit(absBits, ABS_X) || TestBit(absBits, ABS_WHEEL)))
+      device->type = DeviceType::Joystick;
+    else if (hasAbs && hasMouseButton && !isTouch && TestBit(absBits, ABS_X) && TestBit(absBits, ABS_Y))
+      device->type = DeviceType::Mouse;   // light gun
+    else if (hasRel && hasMouseButton && TestBit(relBits, REL_X) && TestBit(relBits, REL_Y))
+      device->type = DeviceType::Mouse;
+    else if (hasMainKeys)
+      device->type = DeviceType::Keyboard;
+    else
+    {
+      close(fd);
+      continue;
+    }
+    device->fd = fd;
+    char name[MAX_NAME_LENGTH + 1] = {};
+    if (ioctl(fd, EVIOCGNAME(MAX_NAME_LENGTH), name) < 0)
+      strcpy(name, "Unknown Device");
+
+    if (device->type == DeviceType::Keyboard)
+    {
+      KeyDetails keyDetails;
+      strcpy(keyDetails.name, name);
+      m_keyDetails.push_back(keyDetails);
+      m_keyboards.push_back(device.get());
+    }
+    else if (device->type == DeviceType::Mouse)
+    {
+      MouseDetails mseDetails;
+      strcpy(mseDetails.name, name);
+      mseDetails.isAbsolute = !(hasRel && TestBit(relBits, REL_X));
+      if (mseDetails.isAbsolute)
+      {
+        // Raw position, scaled to the display by Poll()
+        device->absAxis[ABS_X] = AXIS_X;
+        device->absAxis[ABS_Y] = AXIS_Y;
+        ioctl(fd, EVIOCGABS(ABS_X), &device->axisInfo[AXIS_X]);
+        ioctl(fd, EVIOCGABS(ABS_Y), &device->axisInfo[AXIS_Y]);
+      }
+      m_mseDetails.push_back(mseDetails);
+      m_mseStates.push_back(MouseState());
+      m_mice.push_back(device.get());
+    }
+    else
+    {
+      JoyDetails joyDetails;
+      strcpy(joyDetails.name, name);
+      joyDetails.numAxes = 0;
+      for (int axisNum = 0; axisNum < NUM_JOY_AXES; axisNum++)
+      {
+        joyDetails.hasAxis[axisNum] = false;
+        for (int code : s_joyAxisCodes[axisNum])
+        {
+          if (code >= 0 && TestBit(absBits, code))
+          {
+            device->absAxis[code] = axisNum;
+            ioctl(fd, EVIOCGABS(code), &device->axisInfo[axisNum]);
+            joyDetails.hasAxis[axisNum] = true;
+            joyDetails.numAxes++;
+            break;
+          }
+        }
+        strcpy(joyDetails.axisName[axisNum], CInputSystem::GetDefaultAxisName(axisNum));
+      }
+      joyDetails.numPOVs = 0;
+      for (int povNum = 0; povNum < NUM_JOY_POVS; povNum++)
+      {
+        if (TestBit(absBits, ABS_HAT0X + 2 * povNum) || TestBit(absBits, ABS_HAT0Y + 2 * povNum))
+          joyDetails.numPOVs = povNum + 1;
+      }
+
+      // Buttons are numbered as SDL numbers them: joystick and gamepad buttons
+      // first, then any miscellaneous ones
+      for (int code = BTN_JOYSTICK; code < KEY_CNT; code++)
+      {
+        if (TestBit(keyBits, code))
+          device->buttonCodes.push_back(code);
+      }
+      for (int code = BTN_MISC; code < BTN_JOYSTICK; code++)
+      {
+        if (TestBit(keyBits, code))
+          device->buttonCodes.push_back(code);
+      }
+      if (device->buttonCodes.size() > NUM_JOY_BUTTONS)
+        device->buttonCodes.resize(NUM_JOY_BUTTONS);
+      joyDetails.numButtons = int(device->buttonCodes.size());
+
+      // Force feedback
+      if (writable && TestBit(evBits, EV_FF))
+      {
+        device->ffSupported[FFEffectConstant] = TestBit(ffBits, FF_CONSTANT);
+        device->ffSupported[FFEffectSpring] = TestBit(ffBits, FF_SPRING);
+        device->ffSupported[FFEffectFriction] = TestBit(ffBits, FF_FRICTION);
+        device->ffSupported[FFEffectVibrate] = TestBit(ffBits, FF_RUMBLE) || TestBit(ffBits, FF_PERIODIC);
+        device->ffRumble = TestBit(ffBits, FF_RUMBLE);
+      }
+      joyDetails.hasFFeedback = std::any_of(std::begin(device->ffSupported), std::end(device->ffSupported), [](bool supported) { return supported; });
+      for (int axisNum = 0; axisNum < NUM_JOY_AXES; axisNum++)
+        joyDetails.axisHasFF[axisNum] = joyDetails.hasFFeedback && joyDetails.hasAxis[axisNum];
+      if (joyDetails.hasFFeedback)
+      {
+        // Effects are applied as sent, at full strength and without the
+        // device's own centering spring
+        input_event ev = {};
+        ev.type = EV_FF;
+        if (TestBit(ffBits, FF_AUTOCENTER))
+        {
+          ev.code = FF_AUTOCENTER;
+          ev.value = 0;
+          (void) !write(fd, &ev, sizeof(ev));
+        }
+        if (TestBit(ffBits, FF_GAIN))
+        {
+          ev.code = FF_GAIN;
+          ev.value = 0xFFFF;
+          (void) !write(fd, &ev, sizeof(ev));
+        }
+      }
+      m_joyDetails.push_back(joyDetails);
+      m_joysticks.push_back(device.get());
+    }
+
+    strcpy(device->name, name);
+    ReadDeviceState(device.get());
+    m_devices.push_back(std::move(device));
+  }
+
+  DebugLog("evdev - found %u keyboards, %u mice and %u joysticks (%u devices unreadable)", unsigned(m_keyboards.size()), unsigned(m_mice.size()), unsigned(m_joysticks.size()), unreadable);
+  if (unreadable > 0 && m_keyboards.empty())
+    ErrorLog("Unable to open %u input devices in /dev/input. Reading them usually requires membership of the 'input' group.", unreadable);
+}
+
+void CEvdevInputSystem::CloseDevices()
+{
+  for (auto &device : m_devices)
+  {
+    for (int effectId : device->ffEffects)
+    {
+      if (effectId >= 0)
+        ioctl(device->fd, EVIOCRMFF, effectId);
+    }
+    close(device->fd);
+  }
+  m_devices.clear();
+  m_keyboards.clear();
+  m_mice.clear();
+  m_joysticks.clear();
+  m_keyDetails.clear();
+  m_mseDetails.clear();
+  m_joyDetails.clear();
+  m_mseStates.clear();
+}
+
+void CEvdevInputSystem::ReadDeviceState(Device *device)
+{
+  unsigned long keyBits[NUM_LONGS(KEY_CNT)] = {};
+  ioctl(device->fd, EVIOCGKEY(sizeof(keyBits)), keyBits);
+  for (size_t word = 0; word < (KEY_CNT + 63) / 64; word++)
+  {
+    uint64_t bits = 0;
+    for (int bit = 0; bit < 64 && word * 64 + bit < KEY_CNT; bit++)
+    {
+      if (TestBit(keyBits, int(word * 64 + bit)))
+        bits |= uint64_t(1) << bit;
+    }
+    device->keys[word].store(bits, std::memory_order_relaxed);
+  }
+
+  for (int code = 0; code < ABS_CNT; code++)
+  {
+    int axisNum = device->absAxis[code];
+    bool isHat = code >= ABS_HAT0X && code < ABS_HAT0X + 2 * NUM_JOY_POVS;
+    if (axisNum < 0 && !(isHat && device->type == DeviceType::Joystick))
+      continue;
+    input_absinfo info;
+    if (ioctl(device->fd, EVIOCGABS(code), &info) < 0)
+      continue;
+    input_event event = {};
+    event.type = EV_ABS;
+    event.code = code;
+    event.value = info.value;
+    ApplyEvent(device, event);
+  }
+}
+
+int CEvdevInputSystem::ReaderThreadEntry(void *data)
+{
+  reinterpret_cast<CEvdevInputSystem *>(data)->RunReaderThread();
+  return 0;
+}
+
+void CEvdevInputSystem::RunReaderThread()
+{
+  std::vector<pollfd> fds;
+  for (auto &device : m_devices)
+    fds.push_back({ device->fd, POLLIN, 0 });
+
+  while (!m_readerStop)
+  {
+    // Wake up regularly to check whether to stop
+    if (poll(fds.data(), fds.size(), 100) <= 0)
+      continue;
+
+    for (size_t i = 0; i < fds.size(); i++)
+    {
+      Device *device = m_devices[i].get();
+      bool lost = (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+      if (!lost && (fds[i].revents & POLLIN))
+      {
+        input_event events[64];
+        ssize_t bytes;
+        while ((bytes = read(fds[i].fd, events, sizeof(events))) > 0)
+        {
+          for (size_t e = 0; e < size_t(bytes) / sizeof(input_event); e++)
+            ApplyEvent(device, events[e]);
+        }
+        lost = bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR);
+      }
+      if (lost)
+      {
+        // Unplugged. Leave the device released and centered rather than stuck.
+        ErrorLog("Lost input device '%s'.", device->name);
+        fds[i].fd = -1;
+        for (auto &word : device->keys)
+          word.store(0, std::memory_order_relaxed);
+        for (int axisNum = 0; axisNum < NUM_JOY_AXES; axisNum++)
+          device->axes[axisNum].store(0, std::memory_order_relaxed);
+        for (int povNum = 0; povNum < NUM_JOY_POVS; povNum++)
+        {
+          device->hatX[povNum].store(0, std::memory_order_relaxed);
+          device->hatY[povNum].store(0, std::memory_order_relaxed);
+        }
+        m_eventCount.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+void CEvdevInputSystem::ApplyEvent(Device *device, const input_event &event)
+{
+  // After the kernel's buffer overflowed, events up to the next report are
+  // incomplete and the whole state has to be read back instead
+  if (device->dropped)
+  {
+    if (event.type == EV_SYN && event.code == SYN_REPORT)
+    {
+      device->dropped = false;
+      ReadDeviceState(device);
+      m_eventCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  bool changed = false;
+  switch (event.type)
+  {
+  default:
+    break;
+
+  case EV_SYN:
+    device->dropped = event.code == SYN_DROPPED;
+    break;
+
+  case EV_KEY:
+    if (event.code < KEY_CNT && event.value != 2)   // 2 is auto-repeat
+    {
+      uint64_t bit = uint64_t(1) << (event.code % 64);
+      std::atomic<uint64_t> &word = device->keys[event.code / 64];
+      uint64_t old = event.value ? word.fetch_or(bit, std::memory_order_relaxed) : word.fetch_and(~bit, std::memory_order_relaxed);
+      changed = !!(old & bit) != !!event.value;
+    }
+    break;
+
+  case EV_REL:
+    if (event.code == REL_X)
+      device->relX.fetch_add(event.value, std::memory_order_relaxed);
+    else if (event.code == REL_Y)
+      device->relY.fetch_add(event.value, std::memory_order_relaxed);
+    else if (event.code == REL_WHEEL)
+      device->wheel.fetch_add(event.value, std::memory_order_relaxed);
+    else
+      break;
+    changed = event.value != 0;
+    break;
+
+  case EV_ABS:
+    if (event.code >= ABS_HAT0X && event.code < ABS_HAT0X + 2 * NUM_JOY_POVS && device->type == DeviceType::Joystick)
+    {
+      int povNum = (event.code - ABS_HAT0X) / 2;
+      std::atomic<int> &hat = ((event.code - ABS_HAT0X) & 1) ? device->hatY[povNum] : device->hatX[povNum];
+      int dir = (event.value > 0) - (event.value < 0);
+      changed = hat.exchange(dir, std::memory_order_relaxed) != dir;
+    }
+    else if (event.code < ABS_CNT && device->absAxis[event.code] >= 0)
+    {
+      int axisNum = device->absAxis[event.code];
+      int value = device->type == DeviceType::Joystick ? ScaleJoyAxis(device->axisInfo[axisNum], event.value) : event.value;
+      changed = device->axes[axisNum].exchange(value, std::memory_order_relaxed) != value;
+    }
+    break;
+  }
+
+  if (changed)
+    m_eventCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool CEvdevInputSystem::IsCodeSet(const Device *device, int code) const
+{
+  return !!(device->keys[code / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (code % 64)));
+}
+
+bool CEvdevInputSystem::UploadAndPlay(Device *device, FFEffect slot, ff_effect *effect)
+{
+  // Uploading an effect again with its id updates it in place
+  effect->id = device->ffEffects[slot];
+  effect->replay.length = 0;  // until stopped
+  effect->replay.delay = 0;
+  if (ioctl(device->fd, EVIOCSFF, effect) < 0)
+    return false;
+  device->ffEffects[slot] = effect->id;
+
+  input_event play = {};
+  play.type = EV_FF;
+  play.code = effect->id;
+  play.value = 1;
+  return write(device->fd, &play, sizeof(play)) == sizeof(play);
+}
+
+void CEvdevInputSystem::StopEffect(Device *device, FFEffect slot)
+{
+  if (device->ffEffects[slot] < 0)
+    return;
+  input_event stop = {};
+  stop.type = EV_FF;
+  stop.code = device->ffEffects[slot];
+  stop.value = 0;
+  (void) !write(device->fd, &stop, sizeof(stop));
+}
+
+bool CEvdevInputSystem::InitializeSystem()
+{
+  OpenDevices();
+  if (m_devices.empty())
+  {
+    ErrorLog("No keyboards, mice or joysticks could be opened in /dev/input.\n");
+    return false;
+  }
+
+  m_readerStop = false;
+  m_readerThread = CThread::CreateThread("Input", ReaderThreadEntry, this);
+  if (nullptr == m_readerThread)
+  {
+    ErrorLog("Unable to create input thread: %s\n", CThread::GetLastError());
+    return false;
+  }
+  return true;
+}
+
+int CEvdevInputSystem::GetKeyIndex(const char *keyName)
+{
+  for (int i = 0; i < int(NUM_EVDEV_KEYS); i++)
+  {
+    if (stricmp(keyName, s_keyMap[i].keyName) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char *CEvdevInputSystem::GetKeyName(int keyIndex)
+{
+  if (keyIndex < 0 || keyIndex >= int(NUM_EVDEV_KEYS))
+    return nullptr;
+  return s_keyMap[keyIndex].keyName;
+}
+
+bool CEvdevInputSystem::IsKeyPressed(int kbdNum, int keyIndex) const
+{
+  return IsCodeSet(m_keyboards[kbdNum], s_keyMap[keyIndex].evdevKey);
+}
+
+int CEvdevInputSystem::GetMouseAxisValue(int mseNum, int axisNum) const
+{
+  const MouseState &state = mseNum == ANY_MOUSE ? m_anyMseState : m_mseStates[mseNum];
+  switch (axisNum)
+  {
+    case AXIS_X: return state.x;
+    case AXIS_Y: return state.y;
+    case AXIS_Z: return state.z;
+    default:     return 0;
+  }
+}
+
+int CEvdevInputSystem::GetMouseWheelDir(int mseNum) const
+{
+  return mseNum == ANY_MOUSE ? m_anyMseState.wheelDir : m_mseStates[mseNum].wheelDir;
+}
+
+bool CEvdevInputSystem::IsMouseButPressed(int mseNum, int butNum) const
+{
+  if (butNum < 0 || butNum >= NUM_MOUSE_BUTTONS)
+    return false;
+  if (mseNum != ANY_MOUSE)
+    return IsCodeSet(m_mice[mseNum], s_mseButtonCodes[butNum]);
+  for (const Device *device : m_mice)
+  {
+    if (IsCodeSet(device, s_mseButtonCodes[butNum]))
+      return true;
+  }
+  return false;
+}
+
+int CEvdevInputSystem::GetJoyAxisValue(int joyNum, int axisNum) const
+{
+  // Values range from -32768 to 32767, as with SDL
+  if (axisNum < 0 || axisNum >= NUM_JOY_AXES)
+    return 0;
+  return m_joysticks[joyNum]->axes[axisNum].load(std::memory_order_relaxed);
+}
+
+bool CEvdevInputSystem::IsJoyPOVInDir(int joyNum, int povNum, int povDir) const
+{
+  if (povNum < 0 || povNum >= NUM_JOY_POVS)
+    return false;
+  const Device *device = m_joysticks[joyNum];
+  switch (povDir)
+  {
+    case POV_UP:    return device->hatY[povNum].load(std::memory_order_relaxed) < 0;
+    case POV_DOWN:  return device->hatY[povNum].load(std::memory_order_relaxed) > 0;
+    case POV_LEFT:  return device->hatX[povNum].load(std::memory_order_relaxed) < 0;
+    case POV_RIGHT: return device->hatX[povNum].load(std::memory_order_relaxed) > 0;
+    default:        return false;
+  }
+}
+
+bool CEvdevInputSystem::IsJoyButPressed(int joyNum, int butNum) const
+{
+  const Device *device = m_joysticks[joyNum];
+  return butNum >= 0 && size_t(butNum) < device->buttonCodes.size() && IsCodeSet(device, device->buttonCodes[butNum]);
+}
+
+bool CEvdevInputSystem::ProcessForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd)
+{
+  // Strengths are limited by the same settings as for SDL, which drives the
+  // same kernel interface
+  Device *device = m_joysticks[joyNum];
+  if (!m_joyDetails[joyNum].hasFFeedback)
+    return false;
+
+  ff_effect effect;
+  memset(&effect, 0, sizeof(effect));
+  switch (ffCmd.id)
+  {
+    case FFStop:
+      for (int slot = 0; slot < NUM_FF_EFFECT_SLOTS; slot++)
+        StopEffect(device, FFEffect(slot));
+      return true;
+
+    case FFConstantForce:
+    {
+      unsigned constForceMax = m_config["SDLConstForceMax"].ValueAs<unsigned>();
+      if (constForceMax == 0 || !device->ffSupported[FFEffectConstant])
+        return false;
+      if (ffCmd.force == 0.0f)
+      {
+        StopEffect(device, FFEffectConstant);
+        return true;
+      }
+      // Same direction convention as the SDL input system: positive forces pull to the left
+      effect.type = FF_CONSTANT;
+      effect.direction = 0x4000;
+      effect.u.constant.level = int16_t(CInputSource::Clamp(int(-ffCmd.force * (constForceMax / 100.0f) * 0x7FFF), -0x7FFF, 0x7FFF));
+      return UploadAndPlay(device, FFEffectConstant, &effect);
+    }
+
+    case FFSelfCenter:
+    case FFFriction:
+    {
+      bool spring = ffCmd.id == FFSelfCenter;
+      unsigned forceMax = m_config[spring ? "SDLSelfCenterMax" : "SDLFrictionMax"].ValueAs<unsigned>();
+      FFEffect slot = spring ? FFEffectSpring : FFEffectFriction;
+      if (forceMax == 0 || !device->ffSupported[slot])
+        return false;
+      int16_t coeff = int16_t(CInputSource::Clamp(int(ffCmd.force * (forceMax / 100.0f) * 0x7FFF), 0, 0x7FFF));
+      effect.type = spring ? FF_SPRING : FF_FRICTION;
+      for (auto &condition : effect.u.condition)
+      {
+        condition.right_saturation = 0xFFFF;
+        condition.left_saturation = 0xFFFF;
+        condition.right_coeff = coeff;
+        condition.left_coeff = coeff;
+      }
+      return UploadAndPlay(device, slot, &effect);
+    }
+
+    case FFVibrate:
+    {
+      unsigned vibrateMax = m_config["SDLVibrateMax"].ValueAs<unsigned>();
+      if (vibrateMax == 0 || !device->ffSupported[FFEffectVibrate])
+        return false;
+      if (ffCmd.force == 0.0f)
+      {
+        StopEffect(device, FFEffectVibrate);
+        return true;
+      }
+      float strength = std::min(1.0f, ffCmd.force * (vibrateMax / 100.0f));
+      if (device->ffRumble)
+      {
+        effect.type = FF_RUMBLE;
+        effect.u.rumble.strong_magnitude = uint16_t(strength * 0xFFFF);
+        effect.u.rumble.weak_magnitude = uint16_t(strength * 0xFFFF);
+      }
+      else
+      {
+        effect.type = FF_PERIODIC;
+        effect.u.periodic.waveform = FF_SINE;
+        effect.u.periodic.period = 50;
+        effect.u.periodic.magnitude = int16_t(strength * 0x7FFF);
+      }
+      return UploadAndPlay(device, FFEffectVibrate, &effect);
+    }
+
+    default:
+      return false;
+  }
+}
+
+int CEvdevInputSystem::GetNumKeyboards() const
+{
+  return int(m_keyboards.size());
+}
+
+int CEvdevInputSystem::GetNumMice() const
+{
+  return int(m_mice.size());
+}
+
+int CEvdevInputSystem::GetNumJoysticks() const
+{
+  return int(m_joysticks.size());
+}
+
+const KeyDetails *CEvdevInputSystem::GetKeyDetails(int kbdNum)
+{
+  return &m_keyDetails[kbdNum];
+}
+
+const MouseDetails *CEvdevInputSystem::GetMouseDetails(int mseNum)
+{
+  return &m_mseDetails[mseNum];
+}
+
+const JoyDetails *CEvdevInputSystem::GetJoyDetails(int joyNum)
+{
+  return &m_joyDetails[joyNum];
+}
+
+bool CEvdevInputSystem::Poll()
+{
+  // The window's events still have to be handled, and closing it quits
+  SDL_Event e;
+  while (SDL_PollEvent(&e))
+  {
+    if (e.type == SDL_QUIT)
+      return false;
+  }
+
+  // Turn mouse motion into positions on the display, as the Raw Input system
+  // does on Windows. Relative mice start in the middle of the display and are
+  // clamped at its edges; absolute ones (light guns) span the display.
+  int minX = int(m_dispX), maxX = int(m_dispX + m_dispW);
+  int minY = int(m_dispY), maxY = int(m_dispY + m_dispH);
+  int anyWheelDelta = 0;
+  for (size_t mseNum = 0; mseNum < m_mice.size(); mseNum++)
+  {
+    const Device *device = m_mice[mseNum];
+    MouseState &state = m_mseStates[mseNum];
+    int x = state.x, y = state.y;
+    if (m_mseDetails[mseNum].isAbsolute)
+    {
+      const input_absinfo &infoX = device->axisInfo[AXIS_X];
+      const input_absinfo &infoY = device->axisInfo[AXIS_Y];
+      if (infoX.maximum > infoX.minimum && infoY.maximum > infoY.minimum)
+      {
+        x = CInputSource::Scale(device->axes[AXIS_X].load(std::memory_order_relaxed), infoX.minimum, infoX.maximum, minX, maxX);
+        y = CInputSource::Scale(device->axes[AXIS_Y].load(std::memory_order_relaxed), infoY.minimum, infoY.maximum, minY, maxY);
+      }
+    }
+    else
+    {
+      int relX = device->relX.load(std::memory_order_relaxed);
+      int relY = device->relY.load(std::memory_order_relaxed);
+      if (!state.placed && m_dispW > 0)
+      {
+        x = (minX + maxX) / 2;
+        y = (minY + maxY) / 2;
+        state.placed = true;
+      }
+      x = CInputSource::Clamp(x + relX - state.lastRelX, minX, maxX);
+      y = CInputSource::Clamp(y + relY - state.lastRelY, minY, maxY);
+
+      // All relative mice also move the combined mouse
+      if (!m_anyMseState.placed && m_dispW > 0)
+      {
+        m_anyMseState.x = (minX + maxX) / 2;
+        m_anyMseState.y = (minY + maxY) / 2;
+        m_anyMseState.placed = true;
+      }
+      m_anyMseState.x = CInputSource::Clamp(m_anyMseState.x + relX - state.lastRelX, minX, maxX);
+      m_anyMseState.y = CInputSource::Clamp(m_anyMseState.y + relY - state.lastRelY, minY, maxY);
+      state.lastRelX = relX;
+      state.lastRelY = relY;
+    }
+    if (x != state.x || y != state.y)
+    {
+      if (m_mseDetails[mseNum].isAbsolute)
+      {
+        m_anyMseState.x = x;
+        m_anyMseState.y = y;
+      }
+      state.x = x;
+      state.y = y;
+      m_changeCount++;
+    }
+
+    // Wheel clicks move the Z-axis by 5, clamped to -100..100
+    int wheel = device->wheel.load(std::memory_order_relaxed);
+    int wheelDelta = wheel - state.lastWheel;
+    state.lastWheel = wheel;
+    anyWheelDelta += wheelDelta;
+    state.z = CInputSource::Clamp(state.z + 5 * wheelDelta, -100, 100);
+    int wheelDir = (wheelDelta > 0) - (wheelDelta < 0);
+    if (wheelDir != state.wheelDir || wheelDelta != 0)
+      m_changeCount++;
+    state.wheelDir = wheelDir;
+  }
+  m_anyMseState.z = CInputSource::Clamp(m_anyMseState.z + 5 * anyWheelDelta, -100, 100);
+  m_anyMseState.wheelDir = (anyWheelDelta > 0) - (anyWheelDelta < 0);
+  return true;
+}
+
+bool CEvdevInputSystem::GetChangeCount(unsigned *count) const
+{
+  *count = m_changeCount + m_eventCount.load(std::memory_order_relaxed);
+  return true;
+}
+
+void CEvdevInputSystem::SetMouseVisibility(bool visible)
+{
+  SDL_ShowCursor(visible ? SDL_ENABLE : SDL_DISABLE);
+}
@@ -0,0 +1,215 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * EvdevInputSystem.h
+ *
+ * Input system that reads keyboards, mice, light guns and joysticks straight
+ * from the Linux event devices (/dev/input/event*), which requires read access
+ * to them (usually membership of the "input" group). A thread of its own
+ * waits on all devices and applies every event the moment it arrives, so that
+ * wheels and guns are read at their own report rate rather than once per
+ * frame. Each control's latest value is kept in an atomic that the emulation
+ * thread reads without taking a lock. As with Raw Input on Windows, every
+ * keyboard, mouse and gun is a device of its own.
+ */
+
+#ifndef INCLUDED_EVDEVINPUTSYSTEM_H
+#define INCLUDED_EVDEVINPUTSYSTEM_H
+
+#include "Types.h"
+#include "Inputs/InputSystem.h"
+#include "OSD/Thread.h"
+
+#include <linux/input.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct EvdevKeyMapStruct
+{
+  const char *keyName;
+  int evdevKey;
+};
+
+class CEvdevInputSystem : public CInputSystem
+{
+private:
+  enum class DeviceType
+  {
+    Keyboard,
+    Mouse,
+    Joystick
+  };
+
+  enum FFEffect
+  {
+    FFEffectConstant = 0,
+    FFEffectSpring,
+    FFEffectFriction,
+    FFEffectVibrate,
+    NUM_FF_EFFECT_SLOTS
+  };
+
+  // State written by the reader thread and read by everyone else
+  struct Device
+  {
+    int fd = -1;
+    DeviceType type = DeviceType::Keyboard;
+    char name[MAX_NAME_LENGTH + 1];
+    bool dropped = false;                           // events lost, skipping to the next report
+
+    std::atomic<uint64_t> keys[(KEY_CNT + 63) / 64];  // keys and buttons by event code
+
+    // Joystick axes (scaled to -32768..32767) and hats (-1, 0 or 1), or the
+    // raw X and Y position of an absolute mouse in axes[AXIS_X/Y]
+    signed char absAxis[ABS_CNT];                   // axis for each ABS_* code, or -1
+    input_absinfo axisInfo[NUM_JOY_AXES];
+    std::atomic<int> axes[NUM_JOY_AXES];
+    std::atomic<int> hatX[NUM_JOY_POVS];
+    std::atomic<int> hatY[NUM_JOY_POVS];
+    std::vector<int> buttonCodes;                   // event code of each joystick button
+
+    // Relative mouse motion and wheel clicks, summed since the device was opened
+    std::atomic<int> relX;
+    std::atomic<int> relY;
+    std::atomic<int> wheel;
+
+    bool ffSupported[NUM_FF_EFFECT_SLOTS];
+    bool ffRumble = false;                          // vibrates with FF_RUMBLE rather than FF_PERIODIC
+    int ffEffects[NUM_FF_EFFECT_SLOTS];             // uploaded effect ids, or -1
+
+    Device();
+  };
+
+  // Mouse positions, updated from the devices by Poll()
+  struct MouseState
+  {
+    int x = 0;
+    int y = 0;
+    int z = 0;
+    int wheelDir = 0;
+    int lastRelX = 0;
+    int lastRelY = 0;
+    int lastWheel = 0;
+    bool placed = false;                            // relative mice start in the middle of the display
+  };
+
+  const Util::Config::Node &m_config;
+
+  // Lookup table to map key names to event codes
+  static EvdevKeyMapStruct s_keyMap[];
+
+  std::vector<std::unique_ptr<Device>> m_devices;
+  std::vector<Device *> m_keyboards;
+  std::vector<Device *> m_mice;
+  std::vector<Device *> m_joysticks;
+  std::vector<KeyDetails> m_keyDetails;
+  std::vector<MouseDetails> m_mseDetails;
+  std::vector<JoyDetails> m_joyDetails;
+  std::vector<MouseState> m_mseStates;
+  MouseState m_anyMseState;                         // all mice combined
+
+  // Incremented by the reader thread whenever a control changes
+  std::atomic<unsigned> m_eventCount;
+
+  std::atomic<bool> m_readerStop;
+  CThread *m_readerThread;
+
+  /*
+   * Opens all event devices that are keyboards, mice or joysticks.
+   */
+  void OpenDevices();
+
+  void CloseDevices();
+
+  /*
+   * Reads the complete current state of a device, e.g. after the kernel
+   * dropped events.
+   */
+  void ReadDeviceState(Device *device);
+
+  static int ReaderThreadEntry(void *data);
+
+  void RunReaderThread();
+
+  void ApplyEvent(Device *device, const input_event &event);
+
+  bool IsCodeSet(const Device *device, int code) const;
+
+  bool UploadAndPlay(Device *device, FFEffect slot, ff_effect *effect);
+
+  void StopEffect(Device *device, FFEffect slot);
+
+protected:
+  /*
+   * Initializes the evdev input system.
+   */
+  bool InitializeSystem();
+
+  int GetKeyIndex(const char *keyName);
+
+  const char *GetKeyName(int keyIndex);
+
+  bool IsKeyPressed(int kbdNum, int keyIndex) const;
+
+  int GetMouseAxisValue(int mseNum, int axisNum) const;
+
+  int GetMouseWheelDir(int mseNum) const;
+
+  bool IsMouseButPressed(int mseNum, int butNum) const;
+
+  int GetJoyAxisValue(int joyNum, int axisNum) const;
+
+  bool IsJoyPOVInDir(int joyNum, int povNum, int povDir) const;
+
+  bool IsJoyButPressed(int joyNum, int butNum) const;
+
+  bool ProcessForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd);
+
+public:
+  /*
+   * Constructs an evdev input system.
+   */
+  CEvdevInputSystem(const Util::Config::Node &config);
+
+  ~CEvdevInputSystem();
+
+  int GetNumKeyboards() const;
+
+  int GetNumMice() const;
+
+  int GetNumJoysticks() const;
+
+  const KeyDetails *GetKeyDetails(int kbdNum);
+
+  const MouseDetails *GetMouseDetails(int mseNum);
+
+  const JoyDetails *GetJoyDetails(int joyNum);
+
+  bool Poll();
+
+  bool GetChangeCount(unsigned *count) const;
+
+  void SetMouseVisibility(bool visible);
+};
+
+#endif  // INCLUDED_EVDEVINPUTSYSTEM_H
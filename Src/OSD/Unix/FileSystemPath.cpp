@@ -76,6 +76,9 @@ namespace FileSystemPath
         case Assets:
             strPathType = "Assets/";
             break;
+        case Cache:
+            strPathType = "Cache";
+            break;
         }
 
         // Get user's HOME directory
@@ -162,4 +165,10 @@ namespace FileSystemPath
         return finalPath;
 
     }
+
+    // Name, unique to this process, under which to write a file before renaming it to filePath
+    std::string GetTempFilePath(const std::string &filePath)
+    {
+        return Util::Format() << filePath << "." << getpid() << ".tmp";
+    }
 }
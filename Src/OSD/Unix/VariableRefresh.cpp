@@ -0,0 +1,124 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "VariableRefresh.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<drm/drm_mode.h>)
+#define VRR_DRM_UAPI
+#include <drm/drm.h>
+#include <drm/drm_mode.h>
+#elif __has_include(<libdrm/drm_mode.h>)
+#define VRR_DRM_UAPI
+#include <libdrm/drm.h>
+#include <libdrm/drm_mode.h>
+#endif
+#endif
+
+#ifdef VRR_DRM_UAPI
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace VariableRefresh
+{
+#ifdef VRR_DRM_UAPI
+    // Reads the properties of a DRM object: ids into props, values into values
+    static bool GetProperties(int fd, uint32_t objId, uint32_t objType, std::vector<uint32_t> &props, std::vector<uint64_t> &values)
+    {
+        drm_mode_obj_get_properties request = {};
+        request.obj_id = objId;
+        request.obj_type = objType;
+        if (ioctl(fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &request) != 0)
+            return false;
+        props.resize(request.count_props);
+        values.resize(request.count_props);
+        request.props_ptr = uint64_t(uintptr_t(props.data()));
+        request.prop_values_ptr = uint64_t(uintptr_t(values.data()));
+        if (ioctl(fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &request) != 0)
+            return false;
+        props.resize(request.count_props);
+        values.resize(request.count_props);
+        return true;
+    }
+
+    // Looks for a connector whose immutable "vrr_capable" property the kernel
+    // has set from the display's EDID and the GPU's capabilities. Reading
+    // object properties doesn't need DRM master and, unlike querying the
+    // connectors, doesn't make the driver probe the displays again.
+    static bool HasCapableConnector(int fd)
+    {
+        drm_mode_card_res res = {};
+        if (ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res) != 0 || res.count_connectors == 0)
+            return false;
+        std::vector<uint32_t> connectors(res.count_connectors);
+        drm_mode_card_res ids = {};
+        ids.connector_id_ptr = uint64_t(uintptr_t(connectors.data()));
+        ids.count_connectors = res.count_connectors;
+        if (ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &ids) != 0)
+            return false;
+        connectors.resize(std::min(ids.count_connectors, res.count_connectors));
+
+        std::vector<uint32_t> props;
+        std::vector<uint64_t> values;
+        for (uint32_t connector : connectors)
+        {
+            if (!GetProperties(fd, connector, DRM_MODE_OBJECT_CONNECTOR, props, values))
+                continue;
+            for (size_t i = 0; i < props.size(); i++)
+            {
+                if (values[i] == 0)
+                    continue;
+                drm_mode_get_property prop = {};
+                prop.prop_id = props[i];
+                if (ioctl(fd, DRM_IOCTL_MODE_GETPROPERTY, &prop) == 0 && strcmp(prop.name, "vrr_capable") == 0)
+                    return true;
+            }
+        }
+        return false;
+    }
+#endif
+
+    bool IsCapable()
+    {
+#ifdef VRR_DRM_UAPI
+        for (int card = 0; card < 8; card++)
+        {
+            char path[32];
+            snprintf(path, sizeof(path), "/dev/dri/card%d", card);
+            int fd = open(path, O_RDWR | O_CLOEXEC);
+            if (fd < 0)
+                continue;
+            bool capable = HasCapableConnector(fd);
+            close(fd);
+            if (capable)
+                return true;
+        }
+#endif
+        return false;
+    }
+}
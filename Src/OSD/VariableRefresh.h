@@ -0,0 +1,37 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * VariableRefresh.h
+ *
+ * Header file for OS-dependent detection of variable refresh rate (G-Sync,
+ * FreeSync, HDMI VRR) displays.
+ */
+
+#ifndef INCLUDED_VARIABLEREFRESH_H
+#define INCLUDED_VARIABLEREFRESH_H
+
+namespace VariableRefresh
+{
+    bool IsCapable(); // True if a connected display looks able to refresh whenever a frame is presented
+}
+
+#endif // INCLUDED_VARIABLEREFRESH_H
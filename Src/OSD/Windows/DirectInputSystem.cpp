@@ -35,6 +35,7 @@
 
 #include <wbemidl.h>
 #include <oleauto.h>
+#include <dbt.h>
 
 #include <SDL.h>
 #include <SDL_syswm.h>
@@ -47,6 +48,10 @@
 static std::array<const char *, 3> s_xinput_dlls = { TEXT("xinput1_4.dll"), TEXT("xinput1_3.dll"), TEXT("xinput9_1_0.dll") };
 static std::array<const char *, 3> s_xinput_dlls_a = { "xinput1_4.dll", "xinput1_3.dll", "xinput9_1_0.dll" };
 
+// How often the input thread polls joysticks, and probes XInput slots found empty
+static const DWORD s_joyPollIntervalMs = 2;
+static const UINT32 s_xiProbeIntervalMs = 1000;
+
 // TODO - need to double check these all correct and see if can fill in any missing codes (although most just don't exist)
 DIKeyMapStruct CDirectInputSystem::s_keyMap[] = 
 {
@@ -431,7 +436,8 @@ CDirectInputSystem::CDirectInputSystem(const Util::Config::Node &config, SDL_Win
 	m_useRawInput(useRawInput), m_useXInput(useXInput), m_enableFFeedback(true),
 	m_hwnd(NULL), m_screenW(0), m_screenH(0), m_initializedCOM(false), m_activated(false), m_window(window),
 	m_getRIDevListPtr(NULL), m_getRIDevInfoPtr(NULL), m_regRIDevsPtr(NULL), m_getRIDataPtr(NULL),
-	m_xiGetCapabilitiesPtr(NULL), m_xiGetStatePtr(NULL), m_xiSetStatePtr(NULL), m_di8(NULL), m_di8Keyboard(NULL), m_di8Mouse(NULL)
+	m_xiGetCapabilitiesPtr(NULL), m_xiGetStatePtr(NULL), m_xiSetStatePtr(NULL), m_di8(NULL), m_di8Keyboard(NULL), m_di8Mouse(NULL),
+	m_joyThread(NULL), m_joyMutex(NULL), m_joyThreadStop(false), m_devicesChanged(false)
 {
 	// Reset initial states
 	memset(&m_combRawMseState, 0, sizeof(m_combRawMseState));
@@ -441,6 +447,10 @@ CDirectInputSystem::CDirectInputSystem(const Util::Config::Node &config, SDL_Win
 
 CDirectInputSystem::~CDirectInputSystem()
 {
+	StopForceFeedbackThread();
+	StopJoystickThread();
+	delete m_joyMutex;
+	m_joyMutex = NULL;
 	CloseKeyboardsAndMice();
 	CloseJoysticks();
 
@@ -1278,11 +1288,15 @@ void CDirectInputSystem::OpenJoysticks()
 		
 		m_joyDetails.push_back(joyDetails);
 		m_diJoyStates.push_back(joyState);
+		m_xiNextProbe.push_back(0);
 	}
 }
 
 void CDirectInputSystem::ActivateJoysticks()
 {
+	// The input thread must not poll joysticks while they are reacquired
+	StopJoystickThread();
+
 	// Set DirectInput cooperative level of joysticks
 	unsigned joyNum = 0;
 	for (std::vector<DIJoyInfo>::iterator it = m_diJoyInfos.begin(); it != m_diJoyInfos.end(); ++it)
@@ -1299,26 +1313,41 @@ void CDirectInputSystem::ActivateJoysticks()
 		}
 		joyNum++;
 	}
+
+	StartJoystickThread();
 }
 
-void CDirectInputSystem::PollJoysticks()
+void CDirectInputSystem::PollJoysticks(std::vector<DIJOYSTATE2> &joyStates)
 {
+	UINT32 now = CThread::GetTicks();
+	bool devicesChanged = m_devicesChanged.exchange(false);
+
 	// Get current joystick states from XInput and DirectInput
 	int i = 0;
 	for (std::vector<DIJoyInfo>::iterator it = m_diJoyInfos.begin(); it != m_diJoyInfos.end(); ++it)
 	{
-		LPDIJOYSTATE2 pJoyState = &m_diJoyStates[i++];
+		UINT32 &nextProbe = m_xiNextProbe[i];
+		LPDIJOYSTATE2 pJoyState = &joyStates[i++];
 
 		HRESULT hr;
 		if (it->isXInput)
 		{
+			// Querying an empty slot takes a long time, so once found empty it is only tried again now and then (or as
+			// soon as a device arrives)
+			if (nextProbe != 0 && !devicesChanged && INT32(now - nextProbe) < 0)
+				continue;
+
 			// Use XInput to query joystick
 			XINPUT_STATE xState{};
-			if (FAILED(hr = m_xiGetStatePtr(it->xInputNum, &xState)))
+			if (m_xiGetStatePtr(it->xInputNum, &xState) != ERROR_SUCCESS)
 			{
 				memset(pJoyState, 0, sizeof(DIJOYSTATE2));
+				for (int povNum = 0; povNum < 4; povNum++)
+					pJoyState->rgdwPOV[povNum] = -1;
+				nextProbe = (now + s_xiProbeIntervalMs) | 1;
 				continue;
 			}
+			nextProbe = 0;
 
 			// Map XInput state onto joystick's DirectInput state object
 			XINPUT_GAMEPAD gamepad = xState.Gamepad;
@@ -1410,9 +1439,95 @@ void CDirectInputSystem::CloseJoysticks()
 	m_joyDetails.clear();
 	m_diJoyInfos.clear();
 	m_diJoyStates.clear();
+	m_xiNextProbe.clear();
 	m_di8Joysticks.clear();
 }
 
+void CDirectInputSystem::StartJoystickThread()
+{
+	if (m_joyThread || m_diJoyInfos.empty())
+		return;
+
+	if (!m_joyMutex)
+		m_joyMutex = CThread::CreateMutex();
+	m_polledJoyStates = m_diJoyStates;
+	m_joyThreadStop = false;
+	if (m_joyMutex)
+		m_joyThread = CThread::CreateThread("Input", JoystickThreadEntry, this);
+	if (!m_joyThread)
+		ErrorLog("Unable to create input thread (%s). Joysticks will be polled every frame instead.\n", CThread::GetLastError());
+}
+
+void CDirectInputSystem::StopJoystickThread()
+{
+	if (!m_joyThread)
+		return;
+
+	m_joyThreadStop = true;
+	m_joyThread->Wait();
+	delete m_joyThread;
+	m_joyThread = NULL;
+}
+
+int CDirectInputSystem::JoystickThreadEntry(void *data)
+{
+	reinterpret_cast<CDirectInputSystem *>(data)->RunJoystickThread();
+	return 0;
+}
+
+void CDirectInputSystem::RunJoystickThread()
+{
+	// A message-only window of the thread's own is told about devices arriving. Registering the class again when the
+	// thread is restarted fails harmlessly.
+	WNDCLASSEX wc{};
+	wc.cbSize = sizeof(wc);
+	wc.lpfnWndProc = DeviceNotifyProc;
+	wc.hInstance = GetModuleHandle(NULL);
+	wc.lpszClassName = TEXT("SupermodelDeviceNotify");
+	RegisterClassEx(&wc);
+	HWND hwnd = CreateWindowEx(0, wc.lpszClassName, NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, wc.hInstance, NULL);
+	HDEVNOTIFY notify = NULL;
+	if (hwnd)
+	{
+		SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)this);
+		DEV_BROADCAST_DEVICEINTERFACE filter{};
+		filter.dbcc_size = sizeof(filter);
+		filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+		notify = RegisterDeviceNotification(hwnd, &filter, DEVICE_NOTIFY_WINDOW_HANDLE | DEVICE_NOTIFY_ALL_INTERFACE_CLASSES);
+	}
+
+	std::vector<DIJOYSTATE2> joyStates = m_polledJoyStates;
+	while (!m_joyThreadStop)
+	{
+		PollJoysticks(joyStates);
+		m_joyMutex->Lock();
+		m_polledJoyStates = joyStates;
+		m_joyMutex->Unlock();
+
+		// Sleep until the next poll, handling device notifications as they come in
+		MsgWaitForMultipleObjects(0, NULL, FALSE, s_joyPollIntervalMs, QS_ALLINPUT);
+		MSG msg;
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+			DispatchMessage(&msg);
+	}
+
+	if (notify)
+		UnregisterDeviceNotification(notify);
+	if (hwnd)
+		DestroyWindow(hwnd);
+}
+
+LRESULT CALLBACK CDirectInputSystem::DeviceNotifyProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+	if (msg == WM_DEVICECHANGE && wParam == DBT_DEVICEARRIVAL)
+	{
+		CDirectInputSystem *self = reinterpret_cast<CDirectInputSystem *>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+		if (self)
+			self->m_devicesChanged = true;
+	}
+	return DefWindowProc(hwnd, msg, wParam, lParam);
+}
+
 HRESULT CDirectInputSystem::CreateJoystickEffect(LPDIRECTINPUTDEVICE8 joystick, int axisNum, ForceFeedbackCmd ffCmd, LPDIRECTINPUTEFFECT *pEffect)
 {
 	// Map axis number to DI object offset
@@ -2110,9 +2225,16 @@ bool CDirectInputSystem::Poll()
 			return false;	
 	}
 
-	// Poll keyboards, mice and joysticks
+	// Poll keyboards and mice, and pick up the joystick states last polled by the input thread
 	PollKeyboardsAndMice();
-	PollJoysticks();
+	if (m_joyThread)
+	{
+		m_joyMutex->Lock();
+		m_diJoyStates = m_polledJoyStates;
+		m_joyMutex->Unlock();
+	}
+	else
+		PollJoysticks(m_diJoyStates);
 
 	return true;
 }
@@ -32,8 +32,10 @@
 #include "Inputs/Input.h"
 #include "Inputs/InputSource.h"
 #include "Inputs/InputSystem.h"
+#include "OSD/Thread.h"
 
 #include <SDL.h>
+#include <atomic>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -166,6 +168,17 @@ private:
 	std::vector<DIJoyInfo> m_diJoyInfos;
 	std::vector<DIJOYSTATE2> m_diJoyStates;
 
+	// Joysticks are polled on a thread of their own, which publishes their states for Poll() to pick up, so that slow
+	// drivers (XInputGetState on an empty slot in particular) don't hold up the emulation
+	CThread *m_joyThread;
+	CMutex *m_joyMutex;
+	std::atomic<bool> m_joyThreadStop;
+	std::vector<DIJOYSTATE2> m_polledJoyStates;		// guarded by m_joyMutex
+
+	// Disconnected XInput slots are only probed again once their time (in ticks) comes, or when a device arrives
+	std::vector<UINT32> m_xiNextProbe;
+	std::atomic<bool> m_devicesChanged;
+
 	bool GetRegString(HKEY regKey, const char *regPath, std::string &str);
 
 	bool GetRegDeviceName(const char *rawDevName, char *name);
@@ -186,7 +199,17 @@ private:
 
 	void ActivateJoysticks();
 
-	void PollJoysticks();
+	void PollJoysticks(std::vector<DIJOYSTATE2> &joyStates);
+
+	void StartJoystickThread();
+
+	void StopJoystickThread();
+
+	static int JoystickThreadEntry(void *data);
+
+	void RunJoystickThread();
+
+	static LRESULT CALLBACK DeviceNotifyProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 	void CloseJoysticks();
 
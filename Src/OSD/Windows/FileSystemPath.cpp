@@ -21,6 +21,7 @@
 
 #include "FileSystemPath.h"
 #include <string>
+#include <process.h>  // _getpid()
 
 namespace FileSystemPath
 {
@@ -43,8 +44,16 @@ namespace FileSystemPath
             return "";
         case Assets:
             return "Assets/";
+        case Cache:
+            return "Cache/";
         }
 
         return "";
     }
+
+    // Name, unique to this process, under which to write a file before renaming it to filePath
+    std::string GetTempFilePath(const std::string &filePath)
+    {
+        return filePath + "." + std::to_string(_getpid()) + ".tmp";
+    }
 }
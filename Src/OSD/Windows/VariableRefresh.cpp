@@ -0,0 +1,51 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "VariableRefresh.h"
+#include <windows.h>
+#include <dxgi1_5.h>
+
+namespace VariableRefresh
+{
+    // Tearing (unsynchronized) presentation is what DXGI reports for variable
+    // refresh rate displays; it is only supported when the display and driver
+    // allow it. DXGI is loaded at run time so that it needn't be linked.
+    bool IsCapable()
+    {
+        HMODULE dxgi = LoadLibraryA("dxgi.dll");
+        if (dxgi == NULL)
+            return false;
+
+        typedef HRESULT (WINAPI *CreateFactoryFn)(REFIID riid, void **factory);
+        CreateFactoryFn createFactory = (CreateFactoryFn)GetProcAddress(dxgi, "CreateDXGIFactory1");
+        BOOL allowTearing = FALSE;
+        IDXGIFactory5 *factory = NULL;
+        if (createFactory && SUCCEEDED(createFactory(__uuidof(IDXGIFactory5), (void **)&factory)))
+        {
+            if (FAILED(factory->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))))
+                allowTearing = FALSE;
+            factory->Release();
+        }
+
+        FreeLibrary(dxgi);
+        return allowTearing != FALSE;
+    }
+}
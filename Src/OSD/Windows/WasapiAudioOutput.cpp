@@ -0,0 +1,272 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2003-2024 The Supermodel Team
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * WasapiAudioOutput.cpp
+ *
+ * WASAPI audio output backend. The default render endpoint is opened in
+ * exclusive, event-driven mode, which bypasses the Windows mixer: the device
+ * signals an event each time it has played a period and the audio thread
+ * refills the whole buffer, which is a single period long. Fails (and SDL
+ * audio is used) if another application holds the device exclusively or the
+ * device can't play the format as is.
+ */
+
+#include "OSD/AudioOutput.h"
+#include "OSD/Thread.h"
+#include "Supermodel.h"
+
+#include <windows.h>
+#include <mmreg.h>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+#include <atomic>
+
+// KSDATAFORMAT_SUBTYPE_PCM and KSDATAFORMAT_SUBTYPE_IEEE_FLOAT, defined here to avoid linking ksuser
+static const GUID s_subTypePCM = { 0x00000001, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
+static const GUID s_subTypeFloat = { 0x00000003, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
+
+template <class T>
+static void SafeRelease(T *&p)
+{
+	if (p)
+	{
+		p->Release();
+		p = NULL;
+	}
+}
+
+class CWasapiAudioOutput : public CAudioOutput
+{
+public:
+	CWasapiAudioOutput()
+		: m_comInitialized(false), m_device(NULL), m_client(NULL), m_renderClient(NULL), m_event(NULL),
+		  m_thread(NULL), m_stop(false), m_pull(NULL), m_period(0)
+	{
+	}
+
+	~CWasapiAudioOutput()
+	{
+		Close();
+	}
+
+	bool Open(unsigned sampleRate, unsigned channels, bool floatSamples, unsigned periodSamples, PullFPtr pull) override
+	{
+		// COM may already be initialized on this thread in another mode, which is fine
+		HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+		m_comInitialized = SUCCEEDED(hr);
+
+		IMMDeviceEnumerator *enumerator = NULL;
+		hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void **)&enumerator);
+		if (SUCCEEDED(hr))
+		{
+			hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &m_device);
+			enumerator->Release();
+		}
+		if (FAILED(hr))
+		{
+			ErrorLog("Unable to find WASAPI audio device (error 0x%08X).\n", (unsigned)hr);
+			Close();
+			return false;
+		}
+
+		WAVEFORMATEXTENSIBLE format = {};
+		format.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+		format.Format.nChannels = WORD(channels);
+		format.Format.nSamplesPerSec = sampleRate;
+		format.Format.wBitsPerSample = floatSamples ? 32 : 16;
+		format.Format.nBlockAlign = WORD(channels * format.Format.wBitsPerSample / 8);
+		format.Format.nAvgBytesPerSec = sampleRate * format.Format.nBlockAlign;
+		format.Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+		format.Samples.wValidBitsPerSample = format.Format.wBitsPerSample;
+		format.SubFormat = floatSamples ? s_subTypeFloat : s_subTypePCM;
+		switch (channels)
+		{
+		case 1:
+			format.dwChannelMask = SPEAKER_FRONT_CENTER;
+			break;
+		case 2:
+			format.dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+			break;
+		default:
+			format.dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+			break;
+		}
+
+		// Exclusive mode streams must use a period no shorter than the device minimum
+		REFERENCE_TIME defaultPeriod = 0;
+		REFERENCE_TIME minPeriod = 0;
+		REFERENCE_TIME period = REFERENCE_TIME(10000000.0 * periodSamples / sampleRate + 0.5);
+		hr = m_device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL, (void **)&m_client);
+		if (SUCCEEDED(hr))
+			hr = m_client->IsFormatSupported(AUDCLNT_SHAREMODE_EXCLUSIVE, &format.Format, NULL);
+		if (hr == S_OK)
+			hr = m_client->GetDevicePeriod(&defaultPeriod, &minPeriod);
+		if (hr != S_OK)
+		{
+			ErrorLog("WASAPI audio device does not support %u-channel %u Hz audio in exclusive mode (error 0x%08X).\n", channels, sampleRate, (unsigned)hr);
+			Close();
+			return false;
+		}
+		if (period < minPeriod)
+			period = minPeriod;
+
+		hr = m_client->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, period, period, &format.Format, NULL);
+		if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED)
+		{
+			// Round up to the size the device wants and create a new client with it
+			UINT32 alignedFrames = 0;
+			m_client->GetBufferSize(&alignedFrames);
+			SafeRelease(m_client);
+			period = REFERENCE_TIME(10000000.0 * alignedFrames / sampleRate + 0.5);
+			hr = m_device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL, (void **)&m_client);
+			if (SUCCEEDED(hr))
+				hr = m_client->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, period, period, &format.Format, NULL);
+		}
+
+		UINT32 bufferFrames = 0;
+		m_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (SUCCEEDED(hr))
+			hr = m_event ? m_client->SetEventHandle(m_event) : E_FAIL;
+		if (SUCCEEDED(hr))
+			hr = m_client->GetBufferSize(&bufferFrames);
+		if (SUCCEEDED(hr))
+			hr = m_client->GetService(__uuidof(IAudioRenderClient), (void **)&m_renderClient);
+		if (FAILED(hr))
+		{
+			ErrorLog("Unable to open WASAPI audio device in exclusive mode (error 0x%08X).\n", (unsigned)hr);
+			Close();
+			return false;
+		}
+
+		m_pull = pull;
+		m_period = bufferFrames;
+		return true;
+	}
+
+	bool Start() override
+	{
+		// Fill the buffer before starting so that the first period isn't silence
+		BYTE *data = NULL;
+		if (SUCCEEDED(m_renderClient->GetBuffer(m_period, &data)))
+		{
+			m_pull(data, m_period);
+			m_renderClient->ReleaseBuffer(m_period, 0);
+		}
+
+		m_stop = false;
+		m_thread = CThread::CreateThread("Audio", ThreadEntry, this);
+		if (NULL == m_thread)
+		{
+			ErrorLog("Unable to create audio thread: %s\n", CThread::GetLastError());
+			return false;
+		}
+
+		HRESULT hr = m_client->Start();
+		if (FAILED(hr))
+		{
+			ErrorLog("Unable to start WASAPI audio playback (error 0x%08X).\n", (unsigned)hr);
+			return false;
+		}
+		return true;
+	}
+
+	void Close() override
+	{
+		if (m_thread)
+		{
+			m_stop = true;
+			SetEvent(m_event);
+			m_thread->Wait();
+			delete m_thread;
+			m_thread = NULL;
+		}
+		if (m_client)
+			m_client->Stop();
+		SafeRelease(m_renderClient);
+		SafeRelease(m_client);
+		SafeRelease(m_device);
+		if (m_event)
+		{
+			CloseHandle(m_event);
+			m_event = NULL;
+		}
+		if (m_comInitialized)
+		{
+			CoUninitialize();
+			m_comInitialized = false;
+		}
+	}
+
+	unsigned GetPeriod() const override
+	{
+		return m_period;
+	}
+
+	const char *GetName() const override
+	{
+		return "WASAPI";
+	}
+
+private:
+	bool				m_comInitialized;
+	IMMDevice			*m_device;
+	IAudioClient		*m_client;
+	IAudioRenderClient	*m_renderClient;
+	HANDLE				m_event;
+	CThread				*m_thread;
+	std::atomic<bool>	m_stop;
+	PullFPtr			m_pull;
+	unsigned			m_period;
+
+	static int ThreadEntry(void *data)
+	{
+		reinterpret_cast<CWasapiAudioOutput *>(data)->Run();
+		return 0;
+	}
+
+	void Run()
+	{
+		bool comInitialized = SUCCEEDED(CoInitializeEx(NULL, COINIT_MULTITHREADED));
+
+		while (!m_stop)
+		{
+			// Wake up regularly to check whether to stop
+			if (WaitForSingleObject(m_event, 100) != WAIT_OBJECT_0 || m_stop)
+				continue;
+
+			// In exclusive mode, each event asks for the whole buffer
+			BYTE *data = NULL;
+			if (FAILED(m_renderClient->GetBuffer(m_period, &data)))
+				continue;
+			m_pull(data, m_period);
+			m_renderClient->ReleaseBuffer(m_period, 0);
+		}
+
+		if (comInitialized)
+			CoUninitialize();
+	}
+};
+
+CAudioOutput *CreateNativeAudioOutput()
+{
+	return new CWasapiAudioOutput();
+}
@@ -47,7 +47,7 @@
 
 bool CWinOutputs::s_createdClass = false;
 
-CWinOutputs::CWinOutputs() : m_hwnd(NULL)
+CWinOutputs::CWinOutputs() : m_hwnd(NULL), m_sharedMapping(NULL), m_shared(NULL)
 {
 	//
 }
@@ -58,6 +58,11 @@ CWinOutputs::~CWinOutputs()
 	if (m_hwnd)
 		PostMessage(HWND_BROADCAST, m_onStop, (WPARAM)m_hwnd, 0);
 	DeleteWindowClass();
+
+	if (m_shared)
+		UnmapViewOfFile(m_shared);
+	if (m_sharedMapping)
+		CloseHandle(m_sharedMapping);
 }
 
 bool CWinOutputs::Initialize()
@@ -96,11 +101,44 @@ bool CWinOutputs::Initialize()
 
 	// Set pointer to this object
 	SetWindowLongPtr(m_hwnd, GWLP_USERDATA, (LONG_PTR)this);
+
+	// Shared memory is only a convenience for clients, so carry on without it
+	CreateSharedOutputs();
+	return true;
+}
+
+bool CWinOutputs::CreateSharedOutputs()
+{
+	m_sharedMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SharedOutputs), SHARED_OUTPUTS_NAME);
+	if (!m_sharedMapping)
+	{
+		ErrorLog("Unable to create shared memory for Windows outputs");
+		return false;
+	}
+	m_shared = (SharedOutputs*)MapViewOfFile(m_sharedMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedOutputs));
+	if (!m_shared)
+	{
+		ErrorLog("Unable to map shared memory for Windows outputs");
+		CloseHandle(m_sharedMapping);
+		m_sharedMapping = NULL;
+		return false;
+	}
+	memset(m_shared, 0, sizeof(SharedOutputs));
+	m_shared->version = SHARED_OUTPUTS_VERSION;
+	m_shared->numOutputs = NUM_OUTPUTS;
 	return true;
 }
 
 void CWinOutputs::Attached()
 {
+	// Publish the game name
+	if (m_shared)
+	{
+		InterlockedIncrement(&m_shared->sequence);
+		strncpy(m_shared->game, GetGame().name.c_str(), sizeof(m_shared->game) - 1);
+		InterlockedIncrement(&m_shared->sequence);
+	}
+
 	// Broadcast a startup message
 	PostMessage(HWND_BROADCAST, m_onStart, (WPARAM)m_hwnd, 0);
 }
@@ -113,6 +151,14 @@ void CWinOutputs::SendOutput(EOutputs output, UINT8 prevValue, UINT8 value)
 	LPARAM param = (LPARAM)output + 1;
 	for (vector<RegisteredClient>::iterator it = m_clients.begin(), end = m_clients.end(); it != end; ++it)
 		PostMessage(it->hwnd, m_updateState, param, value);
+
+	// Mirror value in shared memory
+	if (m_shared)
+	{
+		InterlockedIncrement(&m_shared->sequence);
+		m_shared->values[output] = value;
+		InterlockedIncrement(&m_shared->sequence);
+	}
 }
 
 LRESULT CALLBACK CWinOutputs::OutputWindowProcCallback(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
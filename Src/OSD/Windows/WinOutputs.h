@@ -50,6 +50,21 @@ struct CopyDataIdString
 	char string[1];	// String containing data
 };
 
+#define SHARED_OUTPUTS_NAME		TEXT("SupermodelOutputs")
+#define SHARED_OUTPUTS_VERSION	1
+
+// Layout of the shared memory block that external programs (eg cabinet hardware controllers) can map by name to read
+// the outputs directly, without registering as a client.  The sequence number is odd while the values are being
+// updated, so a reader should retry if it is odd or changes while reading.
+struct SharedOutputs
+{
+	UINT32 version;				// SHARED_OUTPUTS_VERSION
+	UINT32 numOutputs;			// Number of entries in values
+	volatile LONG sequence;		// Incremented before and after each update
+	char game[32];				// Name of the running game
+	UINT8 values[NUM_OUTPUTS];	// Current value of each output, in EOutputs order
+};
+
 class CWinOutputs : public COutputs
 {
 public:
@@ -106,6 +121,9 @@ private:
 	
 	HWND m_hwnd;
 
+	HANDLE m_sharedMapping;
+	SharedOutputs *m_shared;
+
 	UINT m_onStart;
 	UINT m_onStop;
 	UINT m_updateState;
@@ -115,6 +133,13 @@ private:
 
 	vector<RegisteredClient> m_clients;
 
+	/*
+	 * CreateSharedOutputs():
+	 *
+	 * Creates the shared memory block that mirrors the outputs.
+	 */
+	bool CreateSharedOutputs();
+
 	/*
 	 * AllocateMessageId(regId, str):
 	 *
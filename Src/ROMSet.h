@@ -23,7 +23,7 @@ struct ROM
     {}
   };
   
-  std::shared_ptr<uint8_t> data;
+  std::shared_ptr<uint8_t> data;   // may be null if only the size was loaded
   std::vector<BigEndianPatch> patches;
   size_t size = 0;
   
@@ -33,6 +33,7 @@ struct ROM
 struct ROMSet
 {
   std::map<std::string, ROM> rom_by_region;
+  std::string cache_key;  // uniquely describes the loaded contents (file CRCs, layouts, and patches)
   
   ROM get_rom(const std::string &region) const;
 };
@@ -23,25 +23,55 @@
 #include "Pkgs/minimp3.h"
 #include "MpegAudio.h"
 #include "Util/ConfigBuilders.h"
+#include "Util/JobSystem.h"
 #include "OSD/Logger.h"
+#include "OSD/Thread.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstring>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <filesystem>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>	// CreateFileMapping()
+#else
+#include <fcntl.h>
+#include <sys/mman.h>	// mmap()
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 /***************************************************************************************************
  Custom MPEG Tracks
 ***************************************************************************************************/
 
+// Offsets of every MPEG frame in a file, built the first time it is needed for seeking
+struct FrameIndex
+{
+  bool built = false;
+  std::vector<uint32_t> offsets;
+};
+
 struct CustomTrack
 {
   std::shared_ptr<uint8_t[]> mpeg_data;
   size_t mpeg_data_size;
   uint32_t mpeg_rom_start_offset;
   size_t file_start_offset;
+  std::shared_ptr<FrameIndex> frame_index;
 
   CustomTrack()
     : mpeg_data(nullptr),
@@ -51,38 +81,95 @@ struct CustomTrack
   {
   }
 
-  CustomTrack(const std::shared_ptr<uint8_t[]> &mpeg_data, size_t mpeg_data_size, uint32_t mpeg_rom_start_offset, size_t file_start_offset)
+  CustomTrack(const std::shared_ptr<uint8_t[]> &mpeg_data, size_t mpeg_data_size, uint32_t mpeg_rom_start_offset, size_t file_start_offset, const std::shared_ptr<FrameIndex> &frame_index)
     : mpeg_data(mpeg_data),
       mpeg_data_size(mpeg_data_size),
       mpeg_rom_start_offset(mpeg_rom_start_offset),
-      file_start_offset(file_start_offset)
+      file_start_offset(file_start_offset),
+      frame_index(frame_index)
   {
   }
 };
 
 struct FileContents
 {
-  std::shared_ptr<uint8_t[]> bytes;
+  std::shared_ptr<uint8_t[]> bytes;   // read-only mapping of the file, unmapped when last reference goes
   size_t size = 0;
+  std::shared_ptr<FrameIndex> frame_index;
 };
 
 static std::map<uint32_t, CustomTrack> s_custom_tracks_by_mpeg_rom_address;
 
-static FileContents LoadFile(const std::string &filepath)
+// Maps a file into memory rather than reading it, so that only the parts of a track actually
+// played are ever paged in
+static FileContents MapFile(const std::string &filepath)
 {
-  FILE *fp = fopen(filepath.c_str(), "rb");
-  if (!fp)
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
   {
     ErrorLog("Unable to load music track from disk: %s.", filepath.c_str());
     return { nullptr, 0 };
   }
-  fseek(fp, 0, SEEK_END);
-  long file_size = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  std::shared_ptr<uint8_t[]> mpeg_data(new uint8_t[file_size], std::default_delete<uint8_t[]>());
-  fread(mpeg_data.get(), sizeof(uint8_t), file_size, fp);
-  fclose(fp);
-  return { mpeg_data, size_t(file_size) };
+  LARGE_INTEGER file_size;
+  HANDLE mapping = nullptr;
+  void *view = nullptr;
+  if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping)
+  {
+    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // view keeps the mapping alive
+  }
+  CloseHandle(file);
+  if (!view)
+  {
+    ErrorLog("Unable to map music track: %s.", filepath.c_str());
+    return { nullptr, 0 };
+  }
+  size_t size = size_t(file_size.QuadPart);
+  std::shared_ptr<uint8_t[]> bytes((uint8_t *) view, [](uint8_t *p) { UnmapViewOfFile(p); });
+#else
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    ErrorLog("Unable to load music track from disk: %s.", filepath.c_str());
+    return { nullptr, 0 };
+  }
+  struct stat st;
+  void *view = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // mapping remains valid
+  if (view == MAP_FAILED)
+  {
+    ErrorLog("Unable to map music track: %s.", filepath.c_str());
+    return { nullptr, 0 };
+  }
+  size_t size = size_t(st.st_size);
+  std::shared_ptr<uint8_t[]> bytes((uint8_t *) view, [size](uint8_t *p) { munmap(p, size); });
+#endif
+  return { bytes, size, std::make_shared<FrameIndex>() };
+}
+
+// Scans frame headers only (no decoding)
+static void BuildFrameIndex(FrameIndex *index, const uint8_t *data, size_t size)
+{
+  mp3dec_t mp3d;
+  mp3dec_frame_info_t info;
+  mp3dec_init(&mp3d);
+  size_t pos = 0;
+  while (pos + HDR_SIZE < size)
+  {
+    int bytes = int(std::min<size_t>(size - pos, 16 * 1024));
+    mp3dec_decode_frame(&mp3d, data + pos, bytes, nullptr, &info);
+    if (info.frame_bytes == 0)
+      break;
+    if (info.frame_bytes > info.frame_offset)
+      index->offsets.push_back(uint32_t(pos + info.frame_offset));
+    pos += info.frame_bytes;
+  }
+  index->built = true;
 }
 
 void MpegDec::LoadCustomTracks(const std::string &music_filepath, const Game &game)
@@ -179,7 +266,7 @@ void MpegDec::LoadCustomTracks(const std::string &music_filepath, const Game &ga
 
         if (file_contents_by_filepath.count(filepath) == 0)
         {
-          FileContents contents = LoadFile(filepath);
+          FileContents contents = MapFile(filepath);
           if (contents.bytes == nullptr)
           {
             continue;
@@ -190,15 +277,242 @@ void MpegDec::LoadCustomTracks(const std::string &music_filepath, const Game &ga
         }
 
         FileContents contents = file_contents_by_filepath[filepath];
-        s_custom_tracks_by_mpeg_rom_address[mpeg_rom_start_offset] = CustomTrack(contents.bytes, contents.size, mpeg_rom_start_offset, file_start_offset);
+        s_custom_tracks_by_mpeg_rom_address[mpeg_rom_start_offset] = CustomTrack(contents.bytes, contents.size, mpeg_rom_start_offset, file_start_offset, contents.frame_index);
       }
     }
   }
 }
 
 
+/***************************************************************************************************
+ MPEG ROM Pre-Decode Cache
+
+ Optionally, the MPEG ROM is decoded to PCM on the job system when a game is loaded, so that track
+ starts and loops no longer redo frame decodes and playback mostly just copies samples. The ROM is
+ scanned for streams of MPEG layer II frames, which are split into blocks decoded in parallel, the
+ first few seconds of every stream ahead of the rest in case the memory budget runs out.
+
+ Layer II has no bit reservoir, and each frame replaces the whole history of the synthesis filter,
+ so a frame decodes the same way whenever the frame before it has just been decoded. Each block
+ therefore also decodes the frame preceding it, and playback only uses a cached frame when it
+ follows on from the frame played before it. Output is the same with or without the cache.
+***************************************************************************************************/
+
+static constexpr size_t CACHE_HEAD_FRAMES = 64;			// start of each stream (~2 s at 32 KHz), decoded first
+static constexpr size_t CACHE_BLOCK_FRAMES = 256;		// frames per job for the rest
+static constexpr size_t CACHE_BUDGET = 256 * 0x100000;	// bytes of PCM
+
+struct CachedFrame
+{
+	const int16_t*	pcm;		// interleaved if stereo
+	uint32_t		prev;		// ROM offset of the frame that must be decoded just before this one
+	uint16_t		bytes;
+	uint8_t			channels;
+};
+
+struct PreDecodeCache
+{
+	std::mutex									lock;
+	const uint8_t*								rom = nullptr;
+	size_t										romSize = 0;
+	std::unordered_map<uint32_t, CachedFrame>	frames;		// by ROM offset
+	std::vector<std::vector<int16_t>>			blocks;		// PCM storage
+	std::atomic<bool>							cancel{ false };
+	std::unique_ptr<Util::JobGroup>				jobs;
+};
+
+static PreDecodeCache s_cache;
+
+static bool IsCacheableFrame(const uint8_t *h)
+{
+	return hdr_valid(h) && HDR_GET_LAYER(h) == 2 && !HDR_IS_FREE_FORMAT(h);
+}
+
+static int FrameBytes(const uint8_t *h)
+{
+	return hdr_frame_bytes(h, 0) + hdr_padding(h);
+}
+
+// Finds every run of at least two consecutive layer II frames and returns their offsets
+static std::vector<std::vector<uint32_t>> FindStreams(const uint8_t *rom, size_t size)
+{
+	std::vector<std::vector<uint32_t>> streams;
+	size_t pos = 0;
+	while (pos + HDR_SIZE <= size && !s_cache.cancel.load(std::memory_order_relaxed))
+	{
+		std::vector<uint32_t> frames;
+		size_t next = pos;
+		while (next + HDR_SIZE <= size && IsCacheableFrame(rom + next) && (frames.empty() || hdr_compare(rom + frames.back(), rom + next)))
+		{
+			size_t bytes = size_t(FrameBytes(rom + next));
+			if (next + bytes > size)
+				break;
+			frames.push_back(uint32_t(next));
+			next += bytes;
+		}
+		if (frames.size() >= 2)
+		{
+			streams.push_back(std::move(frames));
+			pos = next;
+		}
+		else
+			pos++;
+	}
+	return streams;
+}
+
+static void DecodeBlock(const std::vector<uint32_t> &stream, size_t first, size_t last)
+{
+	struct Entry
+	{
+		uint32_t	offset;
+		size_t		sample;
+		CachedFrame	frame;
+	};
+
+	mp3dec_t mp3d;
+	mp3dec_frame_info_t info;
+	short pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+	std::vector<int16_t> samples;
+	std::vector<Entry> entries;
+
+	bool warmUp = true;
+	for (size_t i = first ? first - 1 : 0; i < last; i++)
+	{
+		if (s_cache.cancel.load(std::memory_order_relaxed))
+			return;
+
+		// A frame that only sets up the synthesis filter (at the start, or after a frame that
+		// failed to decode) starts from its own header, skipping minimp3's search for several
+		// matching frames in a row
+		const uint8_t *frame = s_cache.rom + stream[i];
+		int bytes = FrameBytes(frame);
+		bool stored = !warmUp && i >= first;
+		if (warmUp)
+		{
+			mp3dec_init(&mp3d);
+			memcpy(mp3d.header, frame, HDR_SIZE);
+		}
+
+		// Given exactly one frame, minimp3 decodes it just as it would mid-stream
+		int numSamples = mp3dec_decode_frame(&mp3d, frame, bytes, pcm, &info);
+		warmUp = numSamples == 0 || info.frame_bytes != bytes;
+		if (stored && !warmUp)
+		{
+			entries.push_back({ stream[i], samples.size(), { nullptr, stream[i - 1], uint16_t(bytes), uint8_t(info.channels) } });
+			samples.insert(samples.end(), pcm, pcm + numSamples * info.channels);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(s_cache.lock);
+	for (Entry &entry : entries)
+	{
+		entry.frame.pcm = samples.data() + entry.sample;
+		s_cache.frames[entry.offset] = entry.frame;
+	}
+	s_cache.blocks.push_back(std::move(samples));
+}
+
+static void PreDecodeROM()
+{
+	struct Block
+	{
+		size_t	stream;
+		size_t	first;
+		size_t	last;
+	};
+
+	auto streams = std::make_shared<std::vector<std::vector<uint32_t>>>(FindStreams(s_cache.rom, s_cache.romSize));
+
+	// Beginnings of streams first, then everything else
+	std::vector<Block> blocks;
+	for (size_t s = 0; s < streams->size(); s++)
+		blocks.push_back({ s, 0, std::min(CACHE_HEAD_FRAMES, (*streams)[s].size()) });
+	for (size_t s = 0; s < streams->size(); s++)
+	{
+		for (size_t first = CACHE_HEAD_FRAMES; first < (*streams)[s].size(); first += CACHE_BLOCK_FRAMES)
+			blocks.push_back({ s, first, std::min(first + CACHE_BLOCK_FRAMES, (*streams)[s].size()) });
+	}
+
+	size_t budget = CACHE_BUDGET;
+	size_t numFrames = 0;
+	for (const Block &block : blocks)
+	{
+		size_t bytes = 0;
+		for (size_t i = block.first; i < block.last; i++)
+		{
+			const uint8_t *h = s_cache.rom + (*streams)[block.stream][i];
+			bytes += hdr_frame_samples(h) * (HDR_IS_MONO(h) ? 1 : 2) * sizeof(int16_t);
+		}
+		if (bytes > budget)
+			break;
+		budget -= bytes;
+		numFrames += block.last - block.first;
+		s_cache.jobs->Run([streams, block]() { DecodeBlock((*streams)[block.stream], block.first, block.last); });
+	}
+
+	InfoLog("Pre-decoding %u MPEG frames from %u streams (%1.1f MB).", unsigned(numFrames), unsigned(streams->size()), double(CACHE_BUDGET - budget) / 0x100000);
+}
+
+void MpegDec::StartPreDecode(const uint8_t *rom, size_t size)
+{
+	StopPreDecode();
+	if (Util::Jobs::NumWorkers() == 0)
+	{
+		InfoLog("MPEG pre-decoding requires job threads. Decoding during playback instead.");
+		return;
+	}
+
+	s_cache.rom = rom;
+	s_cache.romSize = size;
+	s_cache.cancel = false;
+	s_cache.jobs = std::make_unique<Util::JobGroup>();
+	s_cache.jobs->Run(PreDecodeROM);
+}
+
+void MpegDec::StopPreDecode()
+{
+	if (!s_cache.jobs)
+		return;
+	s_cache.cancel = true;
+	s_cache.jobs->Wait();
+	s_cache.jobs.reset();
+
+	std::lock_guard<std::mutex> lock(s_cache.lock);
+	s_cache.frames.clear();
+	s_cache.blocks.clear();
+	s_cache.rom = nullptr;
+	s_cache.romSize = 0;
+}
+
+// Looks up a frame that was decoded right after the given one
+static bool FindCachedFrame(const uint8_t *frame, const uint8_t *prev, CachedFrame *cached)
+{
+	std::lock_guard<std::mutex> lock(s_cache.lock);
+	if (frame < s_cache.rom || frame >= s_cache.rom + s_cache.romSize)
+		return false;
+	auto it = s_cache.frames.find(uint32_t(frame - s_cache.rom));
+	if (it == s_cache.frames.end() || s_cache.rom + it->second.prev != prev)
+		return false;
+	*cached = it->second;
+	return true;
+}
+
+
 /***************************************************************************************************
  MPEG Music Playback
+
+ Decoding runs ahead of playback: decoded PCM is queued in a ring together with a tag giving the
+ stream position it was decoded at, so that GetPosition() still reports the position of the audio
+ actually being played. A worker thread (when started) keeps the ring topped up to a few hundred
+ milliseconds so that MPEG frame decodes no longer land on the sound board thread. DecodeAudio()
+ decodes inline whenever the ring runs short (e.g., right after a new track is started, or with
+ no worker), so output is identical with or without the worker.
+
+ Everything below is guarded by s_lock. Commands that move the decoder (SetMemory, SetPosition,
+ Stop) discard the queued PCM. UpdateMemory only changes the loop region, so queued PCM remains
+ valid unless it was decoded past a loop point or end of stream using the old region, in which
+ case everything after the frame being played is dropped and decoding resumes from there.
 ***************************************************************************************************/
 
 struct Decoder
@@ -209,18 +523,245 @@ struct Decoder
 	int					size, pos;
 	bool				loop;
 	bool				stopped;
-	int					numSamples;
-	int					pcmPos;
+	bool				ended;	// reached end of a non-looping stream
 	short				pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+	const uint8_t*		lastFrame;	// start of the frame decoded last, if it decoded
+	const uint8_t*		stale;		// frame played from the cache that the decoder has not seen
+	int					staleBytes;
 
 	std::shared_ptr<uint8_t[]>  custom_mpeg_data;
+	std::shared_ptr<FrameIndex> custom_frame_index;
 };
 
 static Decoder dec{};
 
+static constexpr uint32_t RING_SIZE = 16384;		// stereo samples (power of 2)
+static constexpr uint32_t RING_TARGET = 12288;		// decode ahead to this fill level (~380 ms at 32 KHz)
+
+static constexpr uint32_t FRAME_RING_SIZE = 128;	// MPEG frames (power of 2, > RING_SIZE / 384 samples per frame)
+
+struct FrameInfo
+{
+	const uint8_t*	tag;		// decoder position after this frame (i.e., what GetPosition() reports while it plays)
+	bool			ended;		// decoding this frame reached the end of a non-looping stream
+};
+
+struct PcmRing
+{
+	int16_t			left[RING_SIZE];
+	int16_t			right[RING_SIZE];
+	uint32_t		frameOf[RING_SIZE];	// serial number of the frame each sample came from
+	FrameInfo		frames[FRAME_RING_SIZE];
+	uint32_t		frameCount;
+	uint32_t		readCount;
+	uint32_t		writeCount;
+	uint32_t		wrapCount;			// write count at the most recent loop-back or end of stream
+	bool			wrapPending;		// true if wrapCount is still ahead of playback
+	bool			played;				// true if a sample has been played since the last flush
+	const uint8_t*	playedTag;			// position reported for the last sample played
+};
+
+static PcmRing s_ring;
+
+static CMutex*		s_lock = nullptr;
+static CCondVar*	s_wake = nullptr;
+static CThread*		s_thread = nullptr;
+static bool			s_quit = false;
+
+static inline void Lock()
+{
+	if (s_lock)
+		s_lock->Lock();
+}
+
+static inline void Unlock()
+{
+	if (s_lock)
+		s_lock->Unlock();
+}
+
+static void WakeWorker()
+{
+	if (s_wake)
+		s_wake->Signal();
+}
+
+static void FlushRing(const uint8_t *playedTag)
+{
+	s_ring.readCount = s_ring.writeCount = 0;
+	s_ring.wrapPending = false;
+	s_ring.played = false;
+	s_ring.playedTag = playedTag;
+}
+
+static bool EndOfBuffer()
+{
+	return dec.pos >= dec.size - HDR_SIZE;
+}
+
+static bool CanDecode()
+{
+	return !dec.stopped && !dec.ended && dec.buffer != nullptr;
+}
+
+// Takes the next frame from the pre-decode cache if that gives exactly what decoding it would: it
+// must follow on from the frame decoded last, and minimp3 must accept it without resynchronizing.
+static bool DecodeCachedFrame(const short **pcm, int *numSamples)
+{
+	const uint8_t *frame = dec.buffer + dec.pos;
+	int bytes = dec.size - dec.pos;
+	CachedFrame cached;
+	if (!dec.lastFrame || dec.custom_mpeg_data || bytes <= HDR_SIZE || dec.mp3d.header[0] != 0xff || !hdr_compare(dec.mp3d.header, frame))
+		return false;
+	if (!FindCachedFrame(frame, dec.lastFrame, &cached))
+		return false;
+	if (cached.bytes != bytes && (cached.bytes + HDR_SIZE > bytes || !hdr_compare(frame, frame + cached.bytes)))
+		return false;
+
+	memcpy(dec.mp3d.header, frame, HDR_SIZE);
+	dec.info.frame_bytes = cached.bytes;
+	dec.info.frame_offset = 0;
+	dec.info.channels = cached.channels;
+	dec.stale = frame;
+	dec.staleBytes = cached.bytes;
+	*pcm = cached.pcm;
+	*numSamples = hdr_frame_samples(frame);
+	return true;
+}
+
+// Brings the synthesis filter up to date after frames were taken from the cache
+static void RestoreDecoderState()
+{
+	if (!dec.stale)
+		return;
+	mp3dec_decode_frame(&dec.mp3d, dec.stale, dec.staleBytes, dec.pcm, &dec.info);
+	dec.stale = nullptr;
+}
+
+// Decodes the next MPEG frame into the ring. Caller must ensure a frame's worth of space.
+static void DecodeFrame()
+{
+	const short *pcm = dec.pcm;
+	int numSamples;
+	if (!DecodeCachedFrame(&pcm, &numSamples))
+	{
+		RestoreDecoderState();
+		numSamples = mp3dec_decode_frame(
+			&dec.mp3d,
+			dec.buffer + dec.pos,
+			dec.size - dec.pos,
+			dec.pcm,
+			&dec.info);
+	}
+
+	dec.lastFrame = numSamples ? dec.buffer + dec.pos + dec.info.frame_offset : nullptr;
+	dec.pos += dec.info.frame_bytes;
+
+	// check end of buffer handling (nothing left to decode if no frame was found)
+	bool wrapped = false;
+	if (dec.info.frame_bytes == 0) {
+		dec.ended = true;
+		wrapped = true;
+	}
+	else if (EndOfBuffer()) {
+		if (dec.loop) {
+			dec.pos = 0;
+		}
+		else {
+			dec.ended = true;
+		}
+		wrapped = true;
+	}
+
+	uint32_t frame = s_ring.frameCount++;
+	s_ring.frames[frame & (FRAME_RING_SIZE - 1)] = { dec.buffer + dec.pos, dec.ended };
+
+	int numChans = dec.info.channels;
+	for (int i = 0; i < numSamples * numChans; i += numChans)
+	{
+		uint32_t idx = s_ring.writeCount++ & (RING_SIZE - 1);
+		s_ring.left[idx] = pcm[i];
+		s_ring.right[idx] = pcm[i + numChans - 1];
+		s_ring.frameOf[idx] = frame;
+	}
+
+	if (wrapped) {
+		s_ring.wrapCount = s_ring.writeCount;
+		s_ring.wrapPending = true;
+	}
+}
+
+static inline uint32_t RingFill()
+{
+	return s_ring.writeCount - s_ring.readCount;
+}
+
+static int DecodeWorker(void *)
+{
+	s_lock->Lock();
+	while (!s_quit)
+	{
+		if (CanDecode() && RingFill() < RING_TARGET)
+		{
+			DecodeFrame();
+
+			// Let playback in between frames
+			s_lock->Unlock();
+			s_lock->Lock();
+		}
+		else
+			s_wake->Wait(s_lock);
+	}
+	s_lock->Unlock();
+	return 0;
+}
+
+void MpegDec::StartDecodeThread()
+{
+	if (s_thread)
+		return;
+	s_lock = CThread::CreateMutex();
+	s_wake = CThread::CreateCondVar();
+	if (s_lock && s_wake)
+	{
+		s_quit = false;
+		s_thread = CThread::CreateThread("MPEG", DecodeWorker, nullptr);
+	}
+	if (!s_thread)
+	{
+		ErrorLog("Unable to start MPEG decode thread: %s. Decoding on sound board thread instead.", CThread::GetLastError());
+		delete s_wake;
+		delete s_lock;
+		s_wake = nullptr;
+		s_lock = nullptr;
+	}
+}
+
+void MpegDec::StopDecodeThread()
+{
+	if (!s_thread)
+		return;
+	s_lock->Lock();
+	s_quit = true;
+	s_wake->Signal();
+	s_lock->Unlock();
+	s_thread->Wait();
+
+	delete s_thread;
+	delete s_wake;
+	delete s_lock;
+	s_thread = nullptr;
+	s_wake = nullptr;
+	s_lock = nullptr;
+}
+
 void MpegDec::SetMemory(const uint8_t *data, int offset, int length, bool loop)
 {
+  Lock();
+
   mp3dec_init(&dec.mp3d);
+  dec.lastFrame = nullptr;
+  dec.stale     = nullptr;
 
   auto it = s_custom_tracks_by_mpeg_rom_address.find(offset);
   if (it == s_custom_tracks_by_mpeg_rom_address.end()) {
@@ -228,6 +769,7 @@ void MpegDec::SetMemory(const uint8_t *data, int offset, int length, bool loop)
     dec.buffer            = data + offset;
     dec.size              = length;
     dec.custom_mpeg_data  = nullptr;
+    dec.custom_frame_index = nullptr;
   }
   else {
     // Custom track available
@@ -243,13 +785,17 @@ void MpegDec::SetMemory(const uint8_t *data, int offset, int length, bool loop)
     dec.buffer            = track.mpeg_data.get() + offset_in_file;
     dec.size              = track.mpeg_data_size - offset_in_file;
     dec.custom_mpeg_data  = track.mpeg_data;
+    dec.custom_frame_index = track.frame_index;
   }
 
   dec.pos         = 0;
-  dec.numSamples  = 0;
-  dec.pcmPos      = 0;
   dec.loop        = loop;
   dec.stopped     = false;
+  dec.ended       = false;
+
+  FlushRing(dec.buffer);
+  WakeWorker();
+  Unlock();
 
 	// Uncomment this line to print out track offsets in the MPEG ROM
 	//printf("MPEG: Set memory: %08x\n", offset);
@@ -257,6 +803,8 @@ void MpegDec::SetMemory(const uint8_t *data, int offset, int length, bool loop)
 
 void MpegDec::UpdateMemory(const uint8_t* data, int offset, int length, bool loop)
 {
+  Lock();
+
   auto it = s_custom_tracks_by_mpeg_rom_address.find(offset);
   if (it == s_custom_tracks_by_mpeg_rom_address.end()) {
     // MPEG ROM
@@ -301,52 +849,96 @@ void MpegDec::UpdateMemory(const uint8_t* data, int offset, int length, bool loo
 
 	dec.loop	= loop;
 
+	// If decoding has already run past a loop point or end of stream using the old region, the
+	// queued audio beyond the frame being played is wrong. Drop it and resume decoding from the
+	// state the decoder was in after that frame, just as if decoding had not run ahead.
+	if (s_ring.wrapPending)
+	{
+		uint32_t keepEnd = s_ring.readCount;
+		const uint8_t *tag = s_ring.playedTag;
+		bool ended = false;
+		if (s_ring.played)
+		{
+			uint32_t frame = s_ring.frameOf[(s_ring.readCount - 1) & (RING_SIZE - 1)];
+			while (keepEnd != s_ring.writeCount && s_ring.frameOf[keepEnd & (RING_SIZE - 1)] == frame)
+				keepEnd++;
+			tag = s_ring.frames[frame & (FRAME_RING_SIZE - 1)].tag;
+			ended = s_ring.frames[frame & (FRAME_RING_SIZE - 1)].ended;
+		}
+		if ((int32_t)(s_ring.wrapCount - keepEnd) > 0)
+		{
+			dec.pos = (int)(tag - dec.buffer);
+			dec.ended = ended;
+			s_ring.writeCount = keepEnd;
+			s_ring.wrapPending = false;
+		}
+	}
+	WakeWorker();
+	Unlock();
+
 	// Uncomment this line to print out track offsets in the MPEG ROM
 	//printf("MPEG: Update memory: %08x\n", offset);
 }
 
 int MpegDec::GetPosition()
 {
-	return (int)dec.pos;
-}
-
-void MpegDec::SetPosition(int pos)
-{
-	dec.pos = pos;
-}
-
-static void FlushBuffer(int16_t*& left, int16_t*& right, int& numStereoSamples)
-{
-	int numChans = dec.info.channels;
-
-	int &i = dec.pcmPos;
-
-	for (; i < (dec.numSamples * numChans) && numStereoSamples; i += numChans) {
-		*left++ = dec.pcm[i];
-		*right++ = dec.pcm[i + numChans - 1];
-		numStereoSamples--;
-	}
+	Lock();
+	int pos = dec.buffer ? (int)(s_ring.playedTag - dec.buffer) : dec.pos;
+	Unlock();
+	return pos;
 }
 
-// might need to copy some silence to end the buffer if we aren't looping
-static void EndWithSilence(int16_t*& left, int16_t*& right, int& numStereoSamples)
+// Custom tracks are normally MP3, whose frames may borrow data from preceding ones (the bit
+// reservoir). After a seek, decode a couple of frames before the target so the first frame played
+// is complete.
+static void PrimeDecoder(int pos)
 {
-	while (numStereoSamples)
+	if (!dec.custom_frame_index || !dec.buffer)
+		return;
+
+	FrameIndex &index = *dec.custom_frame_index;
+	const uint8_t *base = dec.custom_mpeg_data.get();
+	if (!index.built)
+		BuildFrameIndex(&index, base, size_t(dec.buffer + dec.size - base));
+
+	uint32_t target = uint32_t(dec.buffer + pos - base);
+	uint32_t start = uint32_t(dec.buffer - base);
+	auto it = std::lower_bound(index.offsets.begin(), index.offsets.end(), target);
+	if (it == index.offsets.end() || *it != target)
+		return;	// not a frame boundary, decode from there as is
+	auto first = std::lower_bound(index.offsets.begin(), index.offsets.end(), start);
+	auto prime = it - std::min<ptrdiff_t>(2, it - first);
+
+	mp3dec_init(&dec.mp3d);
+	dec.pos = int(*prime - start);
+	while (dec.pos < pos)
 	{
-		*left++ = 0;
-		*right++ = 0;
-		numStereoSamples--;
+		mp3dec_decode_frame(&dec.mp3d, dec.buffer + dec.pos, dec.size - dec.pos, dec.pcm, &dec.info);
+		if (dec.info.frame_bytes == 0)
+			break;
+		dec.pos += dec.info.frame_bytes;
 	}
+	dec.pos = pos;
 }
 
-static bool EndOfBuffer()
+void MpegDec::SetPosition(int pos)
 {
-	return dec.pos >= dec.size - HDR_SIZE;
+	Lock();
+	dec.pos = pos;
+	dec.ended = false;
+	dec.lastFrame = nullptr;
+	PrimeDecoder(pos);
+	FlushRing(dec.buffer + pos);
+	WakeWorker();
+	Unlock();
 }
 
 void MpegDec::Stop()
 {
+	Lock();
 	dec.stopped = true;
+	FlushRing(s_ring.playedTag);
+	Unlock();
 }
 
 bool MpegDec::IsLoaded()
@@ -356,38 +948,44 @@ bool MpegDec::IsLoaded()
 
 void MpegDec::DecodeAudio(int16_t* left, int16_t* right, int numStereoSamples)
 {
+	Lock();
+
 	// if we are stopped return silence
 	if (dec.stopped || !dec.buffer) {
-		EndWithSilence(left, right, numStereoSamples);
+		memset(left, 0, numStereoSamples * sizeof(int16_t));
+		memset(right, 0, numStereoSamples * sizeof(int16_t));
+		Unlock();
+		return;
 	}
 
-	// copy any left over samples first
-	FlushBuffer(left, right, numStereoSamples);
-
-	while (numStereoSamples) {
+	// Top up inline if the worker has not kept up (or is not running). The limit guards against
+	// looping over a region that contains no audio frames.
+	for (int frames = 0; RingFill() < (uint32_t)numStereoSamples && CanDecode() && frames < 64; frames++)
+		DecodeFrame();
 
-		dec.numSamples = mp3dec_decode_frame(
-			&dec.mp3d,
-			dec.buffer + dec.pos,
-			dec.size - dec.pos,
-			dec.pcm,
-			&dec.info);
-
-		dec.pos += dec.info.frame_bytes;
-		dec.pcmPos = 0;	// reset pos
-
-		FlushBuffer(left, right, numStereoSamples);
-
-		// check end of buffer handling
-		if (EndOfBuffer()) {
-			if (dec.loop) {
-				dec.pos = 0;
-			}
-			else {
-				EndWithSilence(left, right, numStereoSamples);
-			}
-		}
+	int available = (int)std::min(RingFill(), (uint32_t)numStereoSamples);
+	for (int i = 0; i < available; i++)
+	{
+		uint32_t idx = s_ring.readCount++ & (RING_SIZE - 1);
+		*left++ = s_ring.left[idx];
+		*right++ = s_ring.right[idx];
+	}
+	if (available > 0)
+	{
+		uint32_t frame = s_ring.frameOf[(s_ring.readCount - 1) & (RING_SIZE - 1)];
+		s_ring.playedTag = s_ring.frames[frame & (FRAME_RING_SIZE - 1)].tag;
+		s_ring.played = true;
+	}
+	if ((int32_t)(s_ring.readCount - s_ring.wrapCount) >= 0)
+		s_ring.wrapPending = false;
 
+	// might need to copy some silence to end the buffer if we aren't looping
+	for (int i = available; i < numStereoSamples; i++)
+	{
+		*left++ = 0;
+		*right++ = 0;
 	}
 
+	WakeWorker();
+	Unlock();
 }
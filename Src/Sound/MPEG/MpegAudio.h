@@ -15,6 +15,10 @@ namespace MpegDec
 	void	DecodeAudio(int16_t* left, int16_t* right, int numStereoSamples);
 	void	Stop();
 	bool	IsLoaded();
+	void	StartDecodeThread();
+	void	StopDecodeThread();
+	void	StartPreDecode(const uint8_t *rom, size_t size);
+	void	StopPreDecode();
 }
 
 #endif
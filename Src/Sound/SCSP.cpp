@@ -68,6 +68,9 @@ Anyways credit to R. Belmont and ElSemi for the code, and for being awesome emul
 #include "Supermodel.h"
 #include "SCSPDSP.h"
 #include "OSD/Thread.h"
+#include "Util/Trace.h"
+#include "Util/CPUFeatures.h"
+#include "Util/JobSystem.h"
 
 
 #include <cstdio>
@@ -75,14 +78,35 @@ Anyways credit to R. Belmont and ElSemi for the code, and for being awesome emul
 #include <cstring>
 #include <cmath>
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SCSP_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SCSP_TARGET(isa)
+#else
+#define SCSP_TARGET(isa)	__attribute__((target(isa)))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define SCSP_NEON_SIMD
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>	// _BitScanForward()
+#endif
 
-static const Util::Config::Node *s_config = 0;
+
+static Util::Config::Binding<float> s_balance;
 static bool s_multiThreaded = false;
 bool legacySound; // For LegacySound (SCSP DSP) config option.
 
 #define USEDSP
 //#define RB_VOLUME
 
+// Mixes each slot with per-sample table lookups instead of the gains cached on
+// register writes. Slower, kept as a reference to check the mixer against.
+//#define SCSP_REFERENCE_MIXER
+
 #define MAX_SCSP	2
 
 //#define CORRECT_FOR_18BIT_DAC
@@ -124,6 +148,8 @@ static constexpr double srate=44100;
 static CMutex *MIDILock;	// for safe access to the MIDI FIFOs
 static int (*Run68kCB)(int cycles);
 static void (*Int68kCB)(int irq);
+static int (*Cycles68kCB)(void);
+static void (*Stop68kCB)(void);
 static DWORD IrqTimA;
 static DWORD IrqTimBC;
 static DWORD IrqMidi;
@@ -266,6 +292,7 @@ struct _SLOT
 	DWORD nxt_addr;	//current play address (24.8)
 	DWORD step;		//pitch step (24.8)
 	BYTE Back;
+	BYTE PCM8;		//sample format, latched from PCM8B when the slot starts
 	_EG EG;			//Envelope
 	_LFO PLFO;		//Phase LFO
 	_LFO ALFO;		//Amplitude LFO
@@ -322,9 +349,86 @@ struct _SCSP
 #endif
 
 	int ARTABLE[64], DRTABLE[64];
+
+	// Slot mixing gains, decoded from TL, IMXL, DIPAN and DISDL when they are
+	// written, and the slot outputs of the current sample (0 when inactive)
+	alignas(16) INT32 SendGain[32];		// to the DSP input
+	alignas(16) INT32 LeftGain[32];		// direct output
+	alignas(16) INT32 RightGain[32];
+	alignas(16) INT32 MixSample[32];
 } SCSPs[MAX_SCSP],*SCSP=SCSPs;
 
-static signed short *RBUFDST;	//this points to where the sample will be stored in the RingBuf
+static thread_local signed short *RBUFDST;	//this points to where the sample will be stored in the RingBuf (per thread, as the SCSPs may be generated in parallel)
+
+/*
+ * Slot mixer: sums the direct outputs of all 32 slots of one SCSP. Inactive
+ * slots have a sample of 0 and contribute nothing.
+ */
+static void MixSlotsGeneric(const INT32 *sample, const INT32 *left, const INT32 *right, int &mixl, int &mixr)
+{
+	int l = 0, r = 0;
+	for (int i = 0; i < 32; ++i)
+	{
+		l += (sample[i] * left[i]) >> SHIFT;
+		r += (sample[i] * right[i]) >> SHIFT;
+	}
+	mixl += l;
+	mixr += r;
+}
+
+#if defined(SCSP_X86_SIMD)
+
+SCSP_TARGET("sse4.1")
+static void MixSlotsSSE41(const INT32 *sample, const INT32 *left, const INT32 *right, int &mixl, int &mixr)
+{
+	__m128i l = _mm_setzero_si128();
+	__m128i r = _mm_setzero_si128();
+	for (int i = 0; i < 32; i += 4)
+	{
+		__m128i s = _mm_load_si128((const __m128i *) (sample + i));
+		l = _mm_add_epi32(l, _mm_srai_epi32(_mm_mullo_epi32(s, _mm_load_si128((const __m128i *) (left + i))), SHIFT));
+		r = _mm_add_epi32(r, _mm_srai_epi32(_mm_mullo_epi32(s, _mm_load_si128((const __m128i *) (right + i))), SHIFT));
+	}
+	l = _mm_add_epi32(l, _mm_shuffle_epi32(l, _MM_SHUFFLE(1, 0, 3, 2)));
+	l = _mm_add_epi32(l, _mm_shuffle_epi32(l, _MM_SHUFFLE(2, 3, 0, 1)));
+	r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(1, 0, 3, 2)));
+	r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(2, 3, 0, 1)));
+	mixl += _mm_cvtsi128_si32(l);
+	mixr += _mm_cvtsi128_si32(r);
+}
+
+#elif defined(SCSP_NEON_SIMD)
+
+static void MixSlotsNEON(const INT32 *sample, const INT32 *left, const INT32 *right, int &mixl, int &mixr)
+{
+	int32x4_t l = vdupq_n_s32(0);
+	int32x4_t r = vdupq_n_s32(0);
+	for (int i = 0; i < 32; i += 4)
+	{
+		int32x4_t s = vld1q_s32(sample + i);
+		l = vaddq_s32(l, vshrq_n_s32(vmulq_s32(s, vld1q_s32(left + i)), SHIFT));
+		r = vaddq_s32(r, vshrq_n_s32(vmulq_s32(s, vld1q_s32(right + i)), SHIFT));
+	}
+	int32x2_t l2 = vadd_s32(vget_low_s32(l), vget_high_s32(l));
+	int32x2_t r2 = vadd_s32(vget_low_s32(r), vget_high_s32(r));
+	mixl += vget_lane_s32(vpadd_s32(l2, l2), 0);
+	mixr += vget_lane_s32(vpadd_s32(r2, r2), 0);
+}
+
+#endif
+
+static void (*MixSlots)(const INT32 *sample, const INT32 *left, const INT32 *right, int &mixl, int &mixr) = MixSlotsGeneric;
+
+static void SCSP_UpdateSlotMix(_SCSP *scsp, int s)
+{
+	const _SLOT *slot = scsp->Slots + s;
+	UINT16 Enc = ((TL(slot)) << 0x0) | ((IMXL(slot)) << 0xd);
+	scsp->SendGain[s] = LPANTABLE[Enc];
+	Enc = ((TL(slot)) << 0x0) | ((DIPAN(slot)) << 0x8) | ((DISDL(slot)) << 0xd);
+	scsp->LeftGain[s] = LPANTABLE[Enc];
+	scsp->RightGain[s] = RPANTABLE[Enc];
+}
+
 
 
 unsigned char DecodeSCI(unsigned char irq)
@@ -562,7 +666,8 @@ void SCSP_StartSlot(_SLOT *slot)
 	slot->Back = 0;
 	slot->nxt_addr = 1 << SHIFT;
 	slot->cur_addr = 0;
-	start_offset = PCM8B(slot) ? SA(slot) : SA(slot) & 0x7FFFE;
+	slot->PCM8 = PCM8B(slot) ? 1 : 0;
+	start_offset = slot->PCM8 ? SA(slot) : SA(slot) & 0x7FFFE;
 	slot->step = SCSP_Step(slot);
 	slot->base = SCSP->SCSPRAM + start_offset;
 	Compute_EG(slot);
@@ -600,7 +705,7 @@ void SCSP_StopSlot(_SLOT *slot,int keyoff)
 
 Result SCSP_Init(const Util::Config::Node &config, int n)
 {
-	s_config = &config;
+	s_balance.Bind(config, "Balance", 0.0f);
 	s_multiThreaded = config["MultiThreaded"].ValueAs<bool>();
 	legacySound = config["LegacySoundDSP"].ValueAs<bool>();
 
@@ -756,6 +861,14 @@ Result SCSP_Init(const Util::Config::Node &config, int n)
 
 	LFO_Init();
 
+#if defined(SCSP_X86_SIMD)
+	if (Util::GetCPUFeatures().sse41)
+		MixSlots = MixSlotsSSE41;
+#elif defined(SCSP_NEON_SIMD)
+	if (Util::GetCPUFeatures().neon)
+		MixSlots = MixSlotsNEON;
+#endif
+
 	SCSPs->data[0x20 / 2] = 0;
 	TimCnt[0] = 0xffff;
 	TimCnt[1] = 0xffff;
@@ -819,6 +932,14 @@ void SCSP_UpdateSlotReg(int s,int r)
 	case 0x13:
 		Compute_LFO(slot);
 		break;
+	case 0xC:	// TL
+	case 0xD:
+	case 0x14:	// IMXL
+	case 0x15:
+	case 0x16:	// DISDL, DIPAN
+	case 0x17:
+		SCSP_UpdateSlotMix(SCSP, s);
+		break;
 	}
 }
 
@@ -1038,7 +1159,10 @@ void SCSP_w8(unsigned int addr,unsigned char val)
 			else if (addr < 0x7C0)
 				((unsigned char *)SCSP->DSP.MADRS)[(addr - 0x780) ^ 1] = val;
 			else if (addr >= 0x800 && addr < 0xC00)
+			{
 				((unsigned char *)SCSP->DSP.MPRO)[(addr - 0x800) ^ 1] = val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a = 1;
 			if (addr == 0xBF0)
@@ -1058,7 +1182,10 @@ void SCSP_w8(unsigned int addr,unsigned char val)
 			else if (addr < 0x800)
 				((unsigned char *)SCSP->DSP.MADRS)[(addr - 0x7c0) ^ 1] = val;
 			else if (addr < 0xC00)
+			{
 				((unsigned char *)SCSP->DSP.MPRO)[(addr - 0x800) ^ 1] = val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a = 1;
 			if (addr == 0xBF0)
@@ -1105,7 +1232,10 @@ void SCSP_w16(unsigned int addr,unsigned short val)
 			else if (addr < 0x800)
 				*(unsigned short *) &(SCSP->DSP.MADRS[(addr - 0x780) / 2]) = val;
 			else if (addr < 0xC00)
+			{
 				*(unsigned short *) &(SCSP->DSP.MPRO[(addr - 0x800) / 2]) = val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a = 1;
 			if (addr == 0xBF0)
@@ -1125,6 +1255,7 @@ void SCSP_w16(unsigned int addr,unsigned short val)
 			else if (addr < 0xC00)
 			{
 				*((UINT16 *)(SCSP->DSP.MPRO + (addr - 0x800) / 2)) = val;
+				SCSP->DSP.ProgramDirty = true;
 			}
 			else
 				int a = 1;
@@ -1173,7 +1304,10 @@ void SCSP_w32(unsigned int addr,unsigned int val)
 			else if (addr < 0x800) // MADRS is mirrored twice
 				*(unsigned int *) &(SCSP->DSP.MADRS[(addr-0x7c0)/2]) = val;
 			else if(addr<0xC00)
+			{
 				*(unsigned int *) &(SCSP->DSP.MPRO[(addr-0x800)/2])=val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a=1;
 			if(addr==0xBF0)
@@ -1322,7 +1456,11 @@ void SCSP_TimersAddTicks(int ticks)
 }
 
 
-signed int inline SCSP_UpdateSlot(_SLOT *slot)
+// Sample RAM holds 16-bit words in host order, so 16-bit samples are loaded as they are and 8-bit ones
+// are found by swapping the bytes of each word. The format is a template parameter so that the loop
+// over a slot's samples has no branches on it
+template <bool PCM8>
+static inline signed int SCSP_UpdateSlotFormat(_SLOT *slot)
 {
 	signed int sample;
 	int step = slot->step;
@@ -1340,7 +1478,7 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 		step >>= (SHIFT);
 	}
 
-	if (PCM8B(slot)) {
+	if (PCM8) {
 		addr1 = slot->cur_addr >> SHIFT;
 		addr2 = slot->nxt_addr >> SHIFT;
 	}
@@ -1356,9 +1494,9 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 		smp <<= 0xA; // associate cycle with 1024
 		// Here down below, a sample range of 24 is needed for VF3 to sound correct.
 		smp >>= 0x18 - MDL(slot); // ex. for MDL=0xF, sample range corresponds to +/- 64 pi (32=2^5 cycles) so shift by 11 (16-5 == 0x1A-0xF)
-		if (!PCM8B(slot)) smp <<= 1;
+		if (!PCM8) smp <<= 1;
 		addr1 += smp; addr2 += smp;
-		if (!PCM8B(slot))
+		if (!PCM8)
 		{
 			addr1 &= 0x7fffe; addr2 &= 0x7fffe;
 		}
@@ -1368,7 +1506,7 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 		}
 	}
 	//if (SSCTL(slot) == 0) {
-		if (PCM8B(slot))	//8 bit signed
+		if (PCM8)	//8 bit signed
 		{
 			signed char p1 = *(signed char *) &(slot->base[addr1 ^ 1]);
 			signed char p2 = *(signed char *) &(slot->base[addr2 ^ 1]);
@@ -1504,220 +1642,455 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 	return sample;
 }
 
+signed int inline SCSP_UpdateSlot(_SLOT *slot)
+{
+	return slot->PCM8 ? SCSP_UpdateSlotFormat<true>(slot) : SCSP_UpdateSlotFormat<false>(slot);
+}
+
 
 void SCSP_CpuRunScanline()
 {
 
 }
 
-void SCSP_DoMasterSamples(int nsamples)
-{
-	constexpr int slice = 11289600 / 44100;	// 68K clocked at 11.2896MHz (45.1584MHz OSC / 4), which is 256 cycles/sample
-	static int lastdiff = 0;
+/*
+ * Sound Board Scheduler
+ *
+ * Rather than stepping the 68K one sample (256 cycles) at a time, it is run
+ * in batches that extend up to the next scheduled event: a timer overflow,
+ * the end of the frame, or SCHED_MAX_BATCH samples (so that MIDI data arriving
+ * from another thread is still noticed promptly). Sample generation lags
+ * behind the 68K inside a batch and is caught up by SCSP_Sync() whenever the
+ * 68K accesses the SCSP registers or acknowledges an interrupt. Those accesses
+ * also end the batch, so that pending IRQs are re-evaluated at exactly the
+ * sample boundary where the per-sample loop used to check them.
+ *
+ * The per-sample ordering is therefore unchanged: sample i is generated and
+ * the timers ticked, IRQs are checked, then the 68K runs slice i. Writes to
+ * sound RAM are not synchronized; a slot streaming from RAM the 68K is writing
+ * may pick up those writes up to one batch early.
+ */
 
-	/*
-	 * Compute relative master/slave SCSP balance (note: master is often used
-	 * for the front speakers). Equal balance is a 1.0 scale factor for both.
-	 * When one SCSP is fully attenuated, the other's samples will be multiplied
-	 * by 2.
-	 */
-	float balance = std::max(-100.f,std::min(100.f,s_config->Get("Balance").ValueAs<float>()));
-	balance *= 0.01f;
-	float masterBalance = 1.0f + balance;
-	float slaveBalance = 1.0f - balance;
+static constexpr int SCHED_SLICE = 11289600 / 44100;	// 68K clocked at 11.2896MHz (45.1584MHz OSC / 4), which is 256 cycles/sample
+static constexpr int SCHED_MAX_BATCH = 32;				// samples
+static constexpr int SCHED_MIN_PARALLEL_BATCH = 8;		// shortest run worth splitting between the SCSPs
 
-	float* buffl = bufferfl;
-	float* buffr = bufferfr;
-	float* bufrl = bufferrl;
-	float* bufrr = bufferrr;
+static struct
+{
+	bool	active;			// 68K is running a batch
+	int		base;			// first slice (sample index) of the batch
+	int		offset;			// cycles of the first slice consumed before the batch began
+	int		length;			// batch length in slices
+	int		stopSlice;		// slice (relative to base) in which the batch was ended early, or -1
+	int		generated;		// samples generated and timer ticks applied so far this frame
+	float	masterBalance;
+	float	slaveBalance;
+	float	*buffl, *buffr, *bufrl, *bufrr;
+} s_sched;
 
-	/*
-	 * Generate samples
-	 */
-	for (INT32 s = 0; s < nsamples; ++s)
-	{
-		signed int smpfl = 0, smpfr = 0;
-		signed int smprl = 0, smprr = 0;
+/*
+ * Slot Update
+ *
+ * Only playing slots are visited, so slots that have finished releasing (or
+ * reached the end of a sample that does not loop) drop out of the sample loop
+ * entirely. Slots cannot start between register writes, which generation is
+ * caught up with first, so the playing slots found before a run of samples
+ * stay the only candidates throughout it.
+ *
+ * Each sample, slots normally run in turn, 0 to 31, and each writes its output
+ * into the ring buffer that slots using FM modulation read back. When none of
+ * the playing slots uses FM, nothing reads the ring buffer while samples are
+ * generated, so a whole run is instead generated a slot at a time in tight
+ * loops and then mixed sample by sample. The output is the same either way.
+ */
 
-		for (INT32 sl = 0; sl < 32; ++sl)
-		{
-#if FM_DELAY
-			RBUFDST = SCSPs[0].DELAYBUF + SCSPs[0].DELAYPTR;
+static INT32 s_slotBlock[MAX_SCSP][32][SCHED_MAX_BATCH];	// slot outputs of the run being generated
+
+static inline int SCSP_LowestSlot(UINT32 mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return int(index);
 #else
-			RBUFDST = SCSPs[0].RINGBUF + SCSPs[0].BUFPTR;
+	return __builtin_ctz(mask);
 #endif
-			if (SCSPs[0].Slots[sl].active)
-			{
-				_SLOT *slot = SCSPs[0].Slots + sl;
-				UINT16 Enc;
+}
 
-				signed int sample = (int)(masterBalance*(float)SCSP_UpdateSlot(slot));
+static UINT32 SCSP_ActiveSlots(const _SCSP *chip)
+{
+	UINT32 mask = 0;
+	for (int sl = 0; sl < 32; ++sl)
+		mask |= UINT32(chip->Slots[sl].active != 0) << sl;
+	return mask;
+}
 
-				Enc = ((TL(slot)) << 0x0) | ((IMXL(slot)) << 0xd);
-				SCSPDSP_SetSample(&SCSPs[0].DSP, (sample*LPANTABLE[Enc]) >> (SHIFT - 2), ISEL(slot), IMXL(slot));
-				Enc = ((TL(slot)) << 0x0) | ((DIPAN(slot)) << 0x8) | ((DISDL(slot)) << 0xd);
+// Passes a slot's output for the current sample on to the DSP and the direct mix
+static inline void SCSP_EmitSlot(_SCSP *chip, int sl, signed int sample, signed int &smpl, signed int &smpr)
+{
+	_SLOT *slot = chip->Slots + sl;
+#ifdef SCSP_REFERENCE_MIXER
+	UINT16 Enc = ((TL(slot)) << 0x0) | ((IMXL(slot)) << 0xd);
+	SCSPDSP_SetSample(&chip->DSP, (sample*LPANTABLE[Enc]) >> (SHIFT - 2), ISEL(slot), IMXL(slot));
+	Enc = ((TL(slot)) << 0x0) | ((DIPAN(slot)) << 0x8) | ((DISDL(slot)) << 0xd);
 #ifdef RB_VOLUME
-				smpfl += (sample * volume[TL(slot) + pan_left[DIPAN(slot)]]) >> 17;
-				smpfr += (sample * volume[TL(slot) + pan_right[DIPAN(slot)]]) >> 17;
+	smpl += (sample * volume[TL(slot) + pan_left[DIPAN(slot)]]) >> 17;
+	smpr += (sample * volume[TL(slot) + pan_right[DIPAN(slot)]]) >> 17;
 #else
-				{
-					smpfl += (sample*LPANTABLE[Enc]) >> SHIFT;
-					smpfr += (sample*RPANTABLE[Enc]) >> SHIFT;
-				}
+	smpl += (sample*LPANTABLE[Enc]) >> SHIFT;
+	smpr += (sample*RPANTABLE[Enc]) >> SHIFT;
 #endif
-			}
-#if FM_DELAY
-			SCSPs[0].RINGBUF[(SCSPs[0].BUFPTR + 64 - (FM_DELAY - 1)) & 63] = SCSPs[0].DELAYBUF[(SCSPs[0].DELAYPTR + FM_DELAY - (FM_DELAY - 1)) % FM_DELAY];
+#else
+	chip->MixSample[sl] = sample;
+	SCSPDSP_SetSample(&chip->DSP, (sample*chip->SendGain[sl]) >> (SHIFT - 2), ISEL(slot), IMXL(slot));
 #endif
-			++SCSPs[0].BUFPTR;
-			SCSPs[0].BUFPTR &= 63;
+}
+
+// Runs the playing slots of both SCSPs for one sample, interleaved as the hardware does
+static void SCSP_UpdateSlots(signed int &smpfl, signed int &smpfr, signed int &smprl, signed int &smprr)
+{
+	const float masterBalance = s_sched.masterBalance;
+	const float slaveBalance = s_sched.slaveBalance;
+
+#ifndef SCSP_REFERENCE_MIXER
+	memset(SCSPs[0].MixSample, 0, sizeof(SCSPs[0].MixSample));
+	memset(SCSPs[1].MixSample, 0, sizeof(SCSPs[1].MixSample));
+#endif
+
+	const int start0 = SCSPs[0].BUFPTR;
+	const int start1 = SCSPs[1].BUFPTR;
 #if FM_DELAY
-			++SCSPs[0].DELAYPTR;
-			if (SCSPs[0].DELAYPTR > FM_DELAY - 1) SCSPs[0].DELAYPTR = 0;
+	UINT32 pending = 0xFFFFFFFF;	// delay buffers advance for every slot
+#else
+	UINT32 pending = SCSP_ActiveSlots(&SCSPs[0]) | SCSP_ActiveSlots(&SCSPs[1]);
 #endif
-			if (HasSlaveSCSP)
+	for (; pending; pending &= pending - 1)
+	{
+		INT32 sl = SCSP_LowestSlot(pending);
+		SCSPs[0].BUFPTR = (start0 + sl) & 63;
+		SCSPs[1].BUFPTR = (start1 + sl) & 63;
 #if FM_DELAY
-				RBUFDST = SCSPs[1].DELAYBUF + SCSPs[1].DELAYPTR;
+		RBUFDST = SCSPs[0].DELAYBUF + SCSPs[0].DELAYPTR;
 #else
-				RBUFDST = SCSPs[1].RINGBUF + SCSPs[1].BUFPTR;
+		RBUFDST = SCSPs[0].RINGBUF + SCSPs[0].BUFPTR;
 #endif
-			{
-				if (SCSPs[1].Slots[sl].active)
-				{
-					_SLOT *slot = SCSPs[1].Slots + sl;
-					UINT16 Enc;
-
-					signed int sample = (int)(slaveBalance*(float)SCSP_UpdateSlot(slot));
+		if (SCSPs[0].Slots[sl].active)
+			SCSP_EmitSlot(&SCSPs[0], sl, (int)(masterBalance*(float)SCSP_UpdateSlot(SCSPs[0].Slots + sl)), smpfl, smpfr);
+#if FM_DELAY
+		SCSPs[0].RINGBUF[(SCSPs[0].BUFPTR + 64 - (FM_DELAY - 1)) & 63] = SCSPs[0].DELAYBUF[(SCSPs[0].DELAYPTR + FM_DELAY - (FM_DELAY - 1)) % FM_DELAY];
+		++SCSPs[0].DELAYPTR;
+		if (SCSPs[0].DELAYPTR > FM_DELAY - 1) SCSPs[0].DELAYPTR = 0;
+#endif
+		++SCSPs[0].BUFPTR;
+		SCSPs[0].BUFPTR &= 63;
 
-					Enc = ((TL(slot)) << 0x0) | ((IMXL(slot)) << 0xd);
-					SCSPDSP_SetSample(&SCSPs[1].DSP, (sample*LPANTABLE[Enc]) >> (SHIFT - 2), ISEL(slot), IMXL(slot));
-					Enc = ((TL(slot)) << 0x0) | ((DIPAN(slot)) << 0x8) | ((DISDL(slot)) << 0xd);
-					{
-#ifdef RB_VOLUME
-						smprl += (sample * volume[TL(slot) + pan_left[DIPAN(slot)]]) >> 17;
-						smprr += (sample * volume[TL(slot) + pan_right[DIPAN(slot)]]) >> 17;
+		// Without a slave SCSP, its slots write to the master's ring buffer
+		if (HasSlaveSCSP)
+#if FM_DELAY
+			RBUFDST = SCSPs[1].DELAYBUF + SCSPs[1].DELAYPTR;
 #else
-						smprl += (sample*LPANTABLE[Enc]) >> SHIFT;
-						smprr += (sample*RPANTABLE[Enc]) >> SHIFT;
-					}
+			RBUFDST = SCSPs[1].RINGBUF + SCSPs[1].BUFPTR;
 #endif
-				}
+		if (SCSPs[1].Slots[sl].active)
+			SCSP_EmitSlot(&SCSPs[1], sl, (int)(slaveBalance*(float)SCSP_UpdateSlot(SCSPs[1].Slots + sl)), smprl, smprr);
 #if FM_DELAY
-				SCSPs[1].RINGBUF[(SCSPs[1].BUFPTR + 64 - (FM_DELAY - 1)) & 63] = SCSPs[1].DELAYBUF[(SCSPs[1].DELAYPTR + FM_DELAY - (FM_DELAY - 1)) % FM_DELAY];
+		SCSPs[1].RINGBUF[(SCSPs[1].BUFPTR + 64 - (FM_DELAY - 1)) & 63] = SCSPs[1].DELAYBUF[(SCSPs[1].DELAYPTR + FM_DELAY - (FM_DELAY - 1)) % FM_DELAY];
+		++SCSPs[1].DELAYPTR;
+		if (SCSPs[1].DELAYPTR > FM_DELAY - 1) SCSPs[1].DELAYPTR = 0;
 #endif
-				++SCSPs[1].BUFPTR;
-				SCSPs[1].BUFPTR &= 63;
-#if FM_DELAY
-				++SCSPs[1].DELAYPTR;
-				if (SCSPs[1].DELAYPTR > FM_DELAY - 1) SCSPs[1].DELAYPTR = 0;
+		++SCSPs[1].BUFPTR;
+		SCSPs[1].BUFPTR &= 63;
+	}
+
+	SCSPs[0].BUFPTR = (start0 + 32) & 63;
+	SCSPs[1].BUFPTR = (start1 + 32) & 63;
+}
+
+// True if the playing slots can run a slot at a time: none reads the ring buffer, and each SCSP's
+// slots write only to their own
+static bool SCSP_CanUpdateSlotBlocks(UINT32 active0, UINT32 active1)
+{
+	if (FM_DELAY || (!HasSlaveSCSP && active1))
+		return false;
+	for (int c = 0; c < MAX_SCSP; ++c)
+	{
+		for (UINT32 pending = c ? active1 : active0; pending; pending &= pending - 1)
+		{
+			_SLOT *slot = SCSPs[c].Slots + SCSP_LowestSlot(pending);
+			if (MDL(slot) != 0 || MDXSL(slot) != 0 || MDYSL(slot) != 0)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Generates up to count samples of one slot in the given format, returns the number produced before it stopped
+template <bool PCM8>
+static int SCSP_UpdateSlotRun(_SCSP *chip, INT32 sl, int start, float balance, int count, INT32 *out)
+{
+	_SLOT *slot = chip->Slots + sl;
+	int i = 0;
+	for (; i < count && slot->active; ++i)
+	{
+		RBUFDST = chip->RINGBUF + ((start + 32 * i + sl) & 63);
+		out[i] = (int)(balance*(float)SCSP_UpdateSlotFormat<PCM8>(slot));
+	}
+	return i;
+}
+
+// Generates the next count samples of each playing slot of one SCSP into s_slotBlock, and the
+// number each slot produced before it stopped into produced[]
+static void SCSP_UpdateSlotBlock(int c, UINT32 active, float balance, int count, int *produced)
+{
+	_SCSP *chip = SCSPs + c;
+	const int start = chip->BUFPTR;
+	for (; active; active &= active - 1)
+	{
+		INT32 sl = SCSP_LowestSlot(active);
+		INT32 *out = s_slotBlock[c][sl];
+		if (chip->Slots[sl].PCM8)
+			produced[sl] = SCSP_UpdateSlotRun<true>(chip, sl, start, balance, count, out);
+		else
+			produced[sl] = SCSP_UpdateSlotRun<false>(chip, sl, start, balance, count, out);
+	}
+	chip->BUFPTR = (start + 32 * count) & 63;
+}
+
+// Mixes one SCSP's slot outputs of the current sample with its DSP outputs and writes the result to
+// its speakers: the master's to the front, the slave's to the rear
+static void SCSP_MixChipOutput(int c, signed int smpl, signed int smpr)
+{
+	_SCSP *chip = SCSPs + c;
+	const float balance = c ? s_sched.slaveBalance : s_sched.masterBalance;
+	float *&bufl = c ? s_sched.bufrl : s_sched.buffl;
+	float *&bufr = c ? s_sched.bufrr : s_sched.buffr;
+
+#ifndef SCSP_REFERENCE_MIXER
+	MixSlots(chip->MixSample, chip->LeftGain, chip->RightGain, smpl, smpr);
 #endif
-			}
 
+	// Without a slave SCSP, the rear channels are written as they are
+	if (c && !HasSlaveSCSP)
+	{
+		*bufl++ = (float)smpl;
+		*bufr++ = (float)smpr;
+		return;
 	}
 
-		SCSPDSP_Step(&SCSPs[0].DSP);
-		if (HasSlaveSCSP)
-			SCSPDSP_Step(&SCSPs[1].DSP);
+	SCSPDSP_Step(&chip->DSP);
 
-		//		smpl=0;
-		//		smpr=0;
-		for (INT32 i = 0; i < 16; ++i)
+	//		smpl=0;
+	//		smpr=0;
+	for (INT32 i = 0; i < 16; ++i)
+	{
+		_SLOT *slot = chip->Slots + i;
+		if (EFSDL(slot))
 		{
-			_SLOT *slot = SCSPs[0].Slots + i;
-			if (legacySound == true) {
-				if (EFSDL(slot))
-				{
-					// For legacy option, 14 is the most reasonable value I can set at the moment for the EFSDL slot. - Paul
-					UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << 0xe);
-					smpfl += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-					smpfr += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-				}
-				if (HasSlaveSCSP)
-				{
-					_SLOT *slot1 = SCSPs[1].Slots + i;
-					if (EFSDL(slot1))
-					{
-						UINT16 Enc = ((EFPAN(slot1)) << 0x8) | ((EFSDL(slot1)) << 0xe);
-						smprl += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-						smprr += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-					}
-				}
-			}
-			else {
-				if (EFSDL(slot))
-				{
-					UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << 0xd);
-					smpfl += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-					smpfr += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-				}
-				if (HasSlaveSCSP)
-				{
-					_SLOT *slot1 = SCSPs[1].Slots + i;
-					if (EFSDL(slot1))
-					{
-						UINT16 Enc = ((EFPAN(slot1)) << 0x8) | ((EFSDL(slot1)) << 0xd);
-						smprl += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-						smprr += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-					}
-				}
-			}
+			// For legacy option, 14 is the most reasonable value I can set at the moment for the EFSDL slot. - Paul
+			UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << (legacySound ? 0xe : 0xd));
+			smpl += (int)(balance*(float)(((chip->DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
+			smpr += (int)(balance*(float)(((chip->DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
 		}
+	}
 
-		if (DAC18B((&SCSP[0])))
-		{
-			smpfl = ICLIP18(smpfl);
-			smpfr = ICLIP18(smpfr);
+	// The master's DAC mode is read through the SCSP last addressed by the 68K
+	if (DAC18B((c ? chip : SCSP)))
+	{
+		smpl = ICLIP18(smpl);
+		smpr = ICLIP18(smpr);
 
 #ifdef CORRECT_FOR_18BIT_DAC
-			*buffl++ = (float)smpfl * 0.25f;
-			*buffr++ = (float)smpfr * 0.25f;
+		*bufl++ = (float)smpl * 0.25f;
+		*bufr++ = (float)smpr * 0.25f;
 #else
-			*buffl++ = (float)smpfl;
-			*buffr++ = (float)smpfr;
+		*bufl++ = (float)smpl;
+		*bufr++ = (float)smpr;
 #endif
+	}
+	else
+	{
+		smpl = ICLIP16(smpl >> 2);
+		smpr = ICLIP16(smpr >> 2);
+
+		*bufl++ = (float)smpl;
+		*bufr++ = (float)smpr;
+	}
+}
+
+static void SCSP_GenerateSample()
+{
+	signed int smpfl = 0, smpfr = 0;
+	signed int smprl = 0, smprr = 0;
+	SCSP_UpdateSlots(smpfl, smpfr, smprl, smprr);
+	SCSP_MixChipOutput(0, smpfl, smpfr);
+	SCSP_MixChipOutput(1, smprl, smprr);
+}
+
+// Generates a run of one SCSP's samples with its slots updated one at a time
+static void SCSP_GenerateChipBlock(int c, int count, UINT32 active)
+{
+	_SCSP *chip = SCSPs + c;
+	int produced[32];
+	SCSP_UpdateSlotBlock(c, active, c ? s_sched.slaveBalance : s_sched.masterBalance, count, produced);
+
+	for (int i = 0; i < count; ++i)
+	{
+		signed int smpl = 0, smpr = 0;
+#ifndef SCSP_REFERENCE_MIXER
+		memset(chip->MixSample, 0, sizeof(chip->MixSample));
+#endif
+		for (UINT32 pending = active; pending; pending &= pending - 1)
+		{
+			INT32 sl = SCSP_LowestSlot(pending);
+			if (i < produced[sl])
+				SCSP_EmitSlot(chip, sl, s_slotBlock[c][sl][i], smpl, smpr);
 		}
+		SCSP_MixChipOutput(c, smpl, smpr);
+	}
+}
+
+// Generates a run of samples with the slots updated one at a time. Nothing is shared between the
+// two SCSPs then, so with a slave SCSP its run is generated on the job pool alongside the master's.
+static void SCSP_GenerateSlotBlocks(int count, UINT32 active0, UINT32 active1)
+{
+	if (HasSlaveSCSP && count >= SCHED_MIN_PARALLEL_BATCH && Util::Jobs::NumWorkers() > 0)
+	{
+		Util::JobGroup group;
+		group.Run([count, active1]() { SCSP_GenerateChipBlock(1, count, active1); });
+		SCSP_GenerateChipBlock(0, count, active0);
+		group.Wait();
+	}
+	else
+	{
+		SCSP_GenerateChipBlock(0, count, active0);
+		SCSP_GenerateChipBlock(1, count, active1);
+	}
+
+	// Timers don't affect generation, so they can be ticked for the whole run afterwards
+	for (int i = 0; i < count; ++i)
+		SCSP_TimersAddTicks(1);
+	s_sched.generated += count;
+}
+
+// Generates samples (and ticks the timers) up to, but not including, sample upTo
+static void SCSP_GenerateSamples(int upTo)
+{
+	while (s_sched.generated < upTo)
+	{
+		int count = std::min(upTo - s_sched.generated, SCHED_MAX_BATCH);
+		UINT32 active0 = SCSP_ActiveSlots(&SCSPs[0]);
+		UINT32 active1 = SCSP_ActiveSlots(&SCSPs[1]);
+		if (count > 1 && SCSP_CanUpdateSlotBlocks(active0, active1))
+			SCSP_GenerateSlotBlocks(count, active0, active1);
 		else
 		{
-			smpfl = ICLIP16(smpfl >> 2);
-			smpfr = ICLIP16(smpfr >> 2);
+			SCSP_GenerateSample();
+			SCSP_TimersAddTicks(1);
+			++s_sched.generated;
+		}
+	}
+}
 
-			*buffl++ = (float)smpfl;
-			*buffr++ = (float)smpfr;
+// Number of samples until the next timer overflow (capped to the maximum batch length)
+static int SCSP_TimerEventDistance()
+{
+	int distance = SCHED_MAX_BATCH;
+	for (int t = 0; t < 3; ++t)
+	{
+		if (TimCnt[t] <= 0xff00)
+		{
+			int step = 1 << (8 - ((SCSPs->data[(0x18 + 2 * t) / 2] >> 8) & 0x7));
+			distance = std::min(distance, (0xFF00 - TimCnt[t]) / step + 1);
 		}
+	}
+	return distance;
+}
 
-		if (HasSlaveSCSP)
+void SCSP_Sync()
+{
+	if (!s_sched.active)
+		return;
+
+	// Catch up to the slice the 68K is currently executing and end the batch
+	int slice = std::min((Cycles68kCB() + s_sched.offset) / SCHED_SLICE, s_sched.length - 1);
+	SCSP_GenerateSamples(s_sched.base + slice + 1);
+	if (s_sched.stopSlice < 0)
+	{
+		s_sched.stopSlice = slice;
+		Stop68kCB();
+	}
+}
+
+void SCSP_DoMasterSamples(int nsamples)
+{
+	TRACE_ZONE("SCSP");
+	static int lastdiff = 0;
+
+	/*
+	 * Compute relative master/slave SCSP balance (note: master is often used
+	 * for the front speakers). Equal balance is a 1.0 scale factor for both.
+	 * When one SCSP is fully attenuated, the other's samples will be multiplied
+	 * by 2.
+	 */
+	float balance = std::max(-100.f,std::min(100.f,s_balance.Get()));
+	balance *= 0.01f;
+	s_sched.masterBalance = 1.0f + balance;
+	s_sched.slaveBalance = 1.0f - balance;
+
+	s_sched.buffl = bufferfl;
+	s_sched.buffr = bufferfr;
+	s_sched.bufrl = bufferrl;
+	s_sched.bufrr = bufferrr;
+	s_sched.generated = 0;
+
+	/*
+	 * Generate samples and run the 68K between events
+	 */
+	int next = 0;			// next slice to run
+	bool midSlice = false;	// batch was ended partway through slice 'next'
+	while (true)
+	{
+		if (!midSlice)
 		{
-			if (DAC18B((&SCSPs[1])))
-			{
-				smprl = ICLIP18(smprl);
-				smprr = ICLIP18(smprr);
+			if (s_sched.generated >= nsamples)
+				break;
+			SCSP_GenerateSamples(s_sched.generated + 1);
+			CheckPendingIRQ();
+			next = s_sched.generated - 1;
+		}
 
-#ifdef CORRECT_FOR_18BIT_DAC
-				*bufrl++ = (float)smprl * 0.25f;
-				*bufrr++ = (float)smprr * 0.25f;
-#else
-				*bufrl++ = (float)smprl;
-				*bufrr++ = (float)smprr;
-#endif
-			}
-			else
-			{
-				smprl = ICLIP16(smprl >> 2);
-				smprr = ICLIP16(smprr >> 2);
+		s_sched.base = next;
+		s_sched.offset = lastdiff;
+		s_sched.length = std::min(nsamples - next, SCSP_TimerEventDistance());
+		s_sched.stopSlice = -1;
+		s_sched.active = true;
+		int budget = s_sched.length * SCHED_SLICE - lastdiff;
+		int done = budget + Run68kCB(budget);
+		s_sched.active = false;
 
-				*bufrl++ = (float)smprl;
-				*bufrr++ = (float)smprr;
-			}
+		if (s_sched.stopSlice < 0)
+		{
+			// Ran the whole batch; samples inside it could not have raised IRQs
+			lastdiff = done - budget;
+			SCSP_GenerateSamples(next + s_sched.length);
+			midSlice = false;
 		}
 		else
 		{
-			*bufrl++ = (float)smprl;
-			*bufrr++ = (float)smprr;
+			// Ended early: either the stopping instruction crossed into the next slice or the rest of this one still has to run
+			int sliceEnd = (s_sched.stopSlice + 1) * SCHED_SLICE - s_sched.offset;
+			if (done >= sliceEnd)
+			{
+				lastdiff = done - sliceEnd;
+				midSlice = false;
+			}
+			else
+			{
+				lastdiff = done + s_sched.offset - s_sched.stopSlice * SCHED_SLICE;
+				next += s_sched.stopSlice;
+				midSlice = true;
+			}
 		}
-
-		SCSP_TimersAddTicks(1);
-		CheckPendingIRQ();
-		lastdiff = Run68kCB(slice - lastdiff);
 	}
 }
 
@@ -1726,10 +2099,12 @@ void SCSP_Update()
 	SCSP_DoMasterSamples(length);
 }
 
-void SCSP_SetCB(int (*Run68k)(int cycles),void (*Int68k)(int irq))
+void SCSP_SetCB(int (*Run68k)(int cycles),void (*Int68k)(int irq),int (*Cycles68k)(void),void (*Stop68k)(void))
 {
 	Int68kCB=Int68k;
 	Run68kCB=Run68k;
+	Cycles68kCB=Cycles68k;
+	Stop68kCB=Stop68k;
 }
 
 void SCSP_MidiIn(BYTE val)
@@ -1855,72 +2230,84 @@ void SCSP_RTECheck()
 
 void SCSP_Master_w8(unsigned int addr,unsigned char val)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+0;
 	SCSP_w8(addr,val);
 }
 
 void SCSP_Master_w16(unsigned int addr,unsigned short val)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+0;
 	SCSP_w16(addr,val);
 }
 
 void SCSP_Master_w32(unsigned int addr,unsigned int val)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+0;
 	SCSP_w32(addr,val);
 }
 
 void SCSP_Slave_w8(unsigned int addr,unsigned char val)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+1;
 	SCSP_w8(addr,val);
 }
 
 void SCSP_Slave_w16(unsigned int addr,unsigned short val)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+1;
 	SCSP_w16(addr,val);
 }
 
 void SCSP_Slave_w32(unsigned int addr,unsigned int val)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+1;
 	SCSP_w32(addr,val);
 }
 
 unsigned char SCSP_Master_r8(unsigned int addr)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+0;
 	return SCSP_r8(addr);
 }
 
 unsigned short SCSP_Master_r16(unsigned int addr)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+0;
 	return SCSP_r16(addr);
 }
 
 unsigned int SCSP_Master_r32(unsigned int addr)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+0;
 	return SCSP_r32(addr);
 }
 
 unsigned char SCSP_Slave_r8(unsigned int addr)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+1;
 	return SCSP_r8(addr);
 }
 
 unsigned short SCSP_Slave_r16(unsigned int addr)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+1;
 	return SCSP_r16(addr);
 }
 
 unsigned int SCSP_Slave_r32(unsigned int addr)
 {
+	SCSP_Sync();
 	SCSP=SCSPs+1;
 	return SCSP_r32(addr);
 }
@@ -2079,6 +2466,7 @@ void SCSP_LoadState(CBlockFile *StateFile)
 			StateFile->Read(&(SCSPs[i].Slots[j].nxt_addr), sizeof(SCSPs[i].Slots[j].nxt_addr));
 			StateFile->Read(&(SCSPs[i].Slots[j].step), sizeof(SCSPs[i].Slots[j].step));
 			StateFile->Read(&(SCSPs[i].Slots[j].Back), sizeof(SCSPs[i].Slots[j].Back));
+			SCSPs[i].Slots[j].PCM8 = PCM8B((&SCSPs[i].Slots[j])) ? 1 : 0;	// not saved, taken from the register
 			StateFile->Read(&(SCSPs[i].Slots[j].slot), sizeof(SCSPs[i].Slots[j].slot));
 			StateFile->Read(&(SCSPs[i].Slots[j].Prev), sizeof(SCSPs[i].Slots[j].Prev));
 
@@ -2103,8 +2491,9 @@ void SCSP_LoadState(CBlockFile *StateFile)
 			StateFile->Read(&(SCSPs[i].Slots[j].ALFO.phase), sizeof(SCSPs[i].Slots[j].ALFO.phase));
 			StateFile->Read(&(SCSPs[i].Slots[j].ALFO.phase_step), sizeof(SCSPs[i].Slots[j].ALFO.phase_step));
 
-			// Recompute LFOs
+			// Recompute LFOs and mixing gains
 			Compute_LFO(&(SCSPs[i].Slots[j]));
+			SCSP_UpdateSlotMix(SCSPs + i, j);
 		}
 
 		// DSP
@@ -2121,6 +2510,7 @@ void SCSP_LoadState(CBlockFile *StateFile)
 		StateFile->Read(SCSPs[i].DSP.EFREG, sizeof(SCSPs[i].DSP.EFREG));
 		StateFile->Read(&(SCSPs[i].DSP.Stopped), sizeof(SCSPs[i].DSP.Stopped));
 		StateFile->Read(&(SCSPs[i].DSP.LastStep), sizeof(SCSPs[i].DSP.LastStep));
+		SCSPs[i].DSP.ProgramDirty = true;
 	}
 }
 
@@ -39,8 +39,18 @@ UINT8 SCSP_r8(UINT32 addr);
 UINT16 SCSP_r16(UINT32 addr);
 UINT32 SCSP_r32(UINT32 addr);
 
-void SCSP_SetCB(int (*Run68k)(int cycles),void (*Int68k)(int irq));
+void SCSP_SetCB(int (*Run68k)(int cycles),void (*Int68k)(int irq),int (*Cycles68k)(void),void (*Stop68k)(void));
 void SCSP_Update();
+
+/*
+ * SCSP_Sync():
+ *
+ * Called from within 68K execution before an SCSP register access or an
+ * interrupt acknowledge. Generates any samples the 68K has run ahead of and
+ * ends the current batch so that IRQs are re-evaluated on the next sample.
+ * Does nothing outside of SCSP_Update().
+ */
+void SCSP_Sync();
 void SCSP_MidiIn(UINT8);
 void SCSP_MidiOutW(UINT8);
 UINT8 SCSP_MidiOutFill();
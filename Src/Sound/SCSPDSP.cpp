@@ -205,6 +205,73 @@ void SCSPDSP_Init(_SCSPDSP *DSP)
 	DSP->Stopped = true;
 }
 //#ifndef DYNDSP
+/*
+ * Decodes steps 0..LastStep-1 of MPRO into DSP->Program. Steps that neither
+ * write any state nor produce an ACC that the next kept step reads can't
+ * affect the output and are pruned. Memory accesses only happen on odd steps,
+ * so MRD/MWT on even steps are dropped here.
+ */
+void SCSPDSP_Decode(_SCSPDSP *DSP)
+{
+	_SCSPDSPOp ops[128];
+	bool keep[128];
+	bool nextReadsACC = false;
+
+	for (int step = DSP->LastStep - 1; step >= 0; --step)
+	{
+		UINT16 *IPtr = DSP->MPRO + step * 4;
+		_SCSPDSPOp &op = ops[step];
+
+		op.TRA = (IPtr[0] >> 8) & 0x7F;
+		op.TWT = (IPtr[0] >> 7) & 0x01;
+		op.TWA = (IPtr[0] >> 0) & 0x7F;
+
+		op.XSEL = (IPtr[1] >> 15) & 0x01;
+		op.YSEL = (IPtr[1] >> 13) & 0x03;
+		op.IRA = (IPtr[1] >> 6) & 0x3F;
+		op.IWT = (IPtr[1] >> 5) & 0x01;
+		op.IWA = (IPtr[1] >> 0) & 0x1F;
+
+		op.TABLE = (IPtr[2] >> 15) & 0x01;
+		op.MWT = ((IPtr[2] >> 14) & 0x01) && (step & 1);
+		op.MRD = ((IPtr[2] >> 13) & 0x01) && (step & 1);
+		op.EWT = (IPtr[2] >> 12) & 0x01;
+		op.EWA = (IPtr[2] >> 8) & 0x0F;
+		op.ADRL = (IPtr[2] >> 7) & 0x01;
+		op.FRCL = (IPtr[2] >> 6) & 0x01;
+		op.SHIFT = (IPtr[2] >> 4) & 0x03;
+		op.YRL = (IPtr[2] >> 3) & 0x01;
+		op.NEGB = (IPtr[2] >> 2) & 0x01;
+		op.ZERO = (IPtr[2] >> 1) & 0x01;
+		op.BSEL = (IPtr[2] >> 0) & 0x01;
+
+		op.NOFL = (IPtr[3] >> 15) & 0x01;
+		op.COEF = (IPtr[3] >> 9) & 0x3f;
+
+		op.MASA = (IPtr[3] >> 2) & 0x1f;
+		op.ADREB = (IPtr[3] >> 1) & 0x01;
+		op.NXADR = (IPtr[3] >> 0) & 0x01;
+
+		// an invalid IRA ends the program early, keep it
+		bool writes = op.TWT || op.IWT || op.MWT || op.MRD || op.EWT || op.ADRL || op.FRCL || op.YRL || op.IRA > 0x31;
+		keep[step] = writes || nextReadsACC;
+		if (keep[step])
+		{
+			// SHIFTED is derived from the previous step's ACC
+			bool usesSHIFTED = op.TWT || op.FRCL || op.MWT || op.EWT || (op.ADRL && op.SHIFT == 3);
+			nextReadsACC = usesSHIFTED || (!op.ZERO && op.BSEL);
+		}
+	}
+
+	DSP->ProgramLength = 0;
+	for (int step = 0; step < DSP->LastStep; ++step)
+	{
+		if (keep[step])
+			DSP->Program[DSP->ProgramLength++] = ops[step];
+	}
+	DSP->ProgramDirty = false;
+}
+
 void SCSPDSP_Step(_SCSPDSP *DSP)
 {
 	INT32 ACC = 0;    //26 bit
@@ -218,129 +285,85 @@ void SCSPDSP_Step(_SCSPDSP *DSP)
 	INT32 Y_REG = 0;      //24 bit
 	UINT32 ADDR = 0;
 	UINT32 ADRS_REG = 0;  //13 bit
-	int step;
 
 	if (DSP->Stopped)
 		return;
 
+	if (DSP->ProgramDirty)
+		SCSPDSP_Decode(DSP);
+
 	memset(DSP->EFREG, 0, 2 * 16);
-	for (step = 0; step </*128*/DSP->LastStep; ++step)
+	const _SCSPDSPOp *end = DSP->Program + DSP->ProgramLength;
+	for (const _SCSPDSPOp *op = DSP->Program; op != end; ++op)
 	{
-		UINT16 *IPtr = DSP->MPRO + step * 4;
-
-		//		if(IPtr[0]==0 && IPtr[1]==0 && IPtr[2]==0 && IPtr[3]==0)
-		//			break;
-
-		UINT32 TRA = (IPtr[0] >> 8) & 0x7F;
-		UINT32 TWT = (IPtr[0] >> 7) & 0x01;
-		UINT32 TWA = (IPtr[0] >> 0) & 0x7F;
-
-		UINT32 XSEL = (IPtr[1] >> 15) & 0x01;
-		UINT32 YSEL = (IPtr[1] >> 13) & 0x03;
-		UINT32 IRA = (IPtr[1] >> 6) & 0x3F;
-		UINT32 IWT = (IPtr[1] >> 5) & 0x01;
-		UINT32 IWA = (IPtr[1] >> 0) & 0x1F;
-
-		UINT32 TABLE = (IPtr[2] >> 15) & 0x01;
-		UINT32 MWT = (IPtr[2] >> 14) & 0x01;
-		UINT32 MRD = (IPtr[2] >> 13) & 0x01;
-		UINT32 EWT = (IPtr[2] >> 12) & 0x01;
-		UINT32 EWA = (IPtr[2] >> 8) & 0x0F;
-		UINT32 ADRL = (IPtr[2] >> 7) & 0x01;
-		UINT32 FRCL = (IPtr[2] >> 6) & 0x01;
-		UINT32 SHIFT = (IPtr[2] >> 4) & 0x03;
-		UINT32 YRL = (IPtr[2] >> 3) & 0x01;
-		UINT32 NEGB = (IPtr[2] >> 2) & 0x01;
-		UINT32 ZERO = (IPtr[2] >> 1) & 0x01;
-		UINT32 BSEL = (IPtr[2] >> 0) & 0x01;
-
-		UINT32 NOFL = (IPtr[3] >> 15) & 0x01;	//????
-		UINT32 COEF = (IPtr[3] >> 9) & 0x3f;
-
-		UINT32 MASA = (IPtr[3] >> 2) & 0x1f;	//???
-		UINT32 ADREB = (IPtr[3] >> 1) & 0x01;
-		UINT32 NXADR = (IPtr[3] >> 0) & 0x01;
-
 		INT64 v;
 
 		//operations are done at 24 bit precision
-#if 0
-		if (MASA)
-			int a = 1;
-		if (NOFL)
-			int a = 1;
-#endif
 		//INPUTS RW
 // colmns97 hits this
 //		assert(IRA<0x32);
-		if (IRA <= 0x1f)
-			INPUTS = DSP->MEMS[IRA];
-		else if (IRA <= 0x2F)
-			INPUTS = DSP->MIXS[IRA - 0x20] << 4;  //MIXS is 20 bit
-		else if (IRA <= 0x31)
-			INPUTS = DSP->EXTS[IRA - 0x30] << 8;  //EXTS is 16 bit
+		if (op->IRA <= 0x1f)
+			INPUTS = DSP->MEMS[op->IRA];
+		else if (op->IRA <= 0x2F)
+			INPUTS = DSP->MIXS[op->IRA - 0x20] << 4;  //MIXS is 20 bit
+		else if (op->IRA <= 0x31)
+			INPUTS = DSP->EXTS[op->IRA - 0x30] << 8;  //EXTS is 16 bit
 		else
 			return;
 
 		INPUTS <<= 8;
 		INPUTS >>= 8;
-		//if(INPUTS&0x00800000)
-		//	INPUTS|=0xFF000000;
 
-		if (IWT)
+		if (op->IWT)
 		{
-			DSP->MEMS[IWA] = MEMVAL;  //MEMVAL was selected in previous MRD
-			if (IRA == IWA)
+			DSP->MEMS[op->IWA] = MEMVAL;  //MEMVAL was selected in previous MRD
+			if (op->IRA == op->IWA)
 				INPUTS = MEMVAL;
 		}
 
 		//Operand sel
 		//B
-		if (!ZERO)
+		if (!op->ZERO)
 		{
-			if (BSEL)
+			if (op->BSEL)
 				B = ACC;
 			else
 			{
-				B = DSP->TEMP[(TRA + DSP->DEC) & 0x7F];
+				B = DSP->TEMP[(op->TRA + DSP->DEC) & 0x7F];
 				B <<= 8;
 				B >>= 8;
-				//if(B&0x00800000)
-				//	B|=0xFF000000;  //Sign extend
 			}
-			if (NEGB)
+			if (op->NEGB)
 				B = 0 - B;
 		}
 		else
 			B = 0;
 
 		//X
-		if (XSEL)
+		if (op->XSEL)
 			X = INPUTS;
 		else
 		{
-			X = DSP->TEMP[(TRA + DSP->DEC) & 0x7F];
+			X = DSP->TEMP[(op->TRA + DSP->DEC) & 0x7F];
 			X <<= 8;
 			X >>= 8;
-			//if(X&0x00800000)
-			//	X|=0xFF000000;
 		}
 
 		//Y
-		if (YSEL == 0)
+		if (op->YSEL == 0)
 			Y = FRC_REG;
-		else if (YSEL == 1)
-			Y = DSP->COEF[COEF] >> 3;   //COEF is 16 bits
-		else if (YSEL == 2)
+		else if (op->YSEL == 1)
+			Y = DSP->COEF[op->COEF] >> 3;   //COEF is 16 bits
+		else if (op->YSEL == 2)
 			Y = (Y_REG >> 11) & 0x1FFF;
-		else if (YSEL == 3)
+		else
 			Y = (Y_REG >> 4) & 0x0FFF;
 
-		if (YRL)
+		if (op->YRL)
 			Y_REG = INPUTS;
 
 		//Shifter
-		if (SHIFT == 0)
+		if (op->SHIFT == 0)
 		{
 			SHIFTED = ACC;
 			if (SHIFTED > 0x007FFFFF)
@@ -348,7 +371,7 @@ void SCSPDSP_Step(_SCSPDSP *DSP)
 			if (SHIFTED < (-0x00800000))
 				SHIFTED = -0x00800000;
 		}
-		else if (SHIFT == 1)
+		else if (op->SHIFT == 1)
 		{
 			SHIFTED = ACC * 2;
 			if (SHIFTED > 0x007FFFFF)
@@ -356,90 +379,78 @@ void SCSPDSP_Step(_SCSPDSP *DSP)
 			if (SHIFTED < (-0x00800000))
 				SHIFTED = -0x00800000;
 		}
-		else if (SHIFT == 2)
+		else if (op->SHIFT == 2)
 		{
 			SHIFTED = ACC * 2;
 			SHIFTED <<= 8;
 			SHIFTED >>= 8;
-			//SHIFTED&=0x00FFFFFF;
-			//if(SHIFTED&0x00800000)
-			//	SHIFTED|=0xFF000000;
 		}
-		else if (SHIFT == 3)
+		else
 		{
 			SHIFTED = ACC;
 			SHIFTED <<= 8;
 			SHIFTED >>= 8;
-			//SHIFTED&=0x00FFFFFF;
-			//if(SHIFTED&0x00800000)
-			//	SHIFTED|=0xFF000000;
 		}
 
 		//ACCUM
 		Y <<= 19;
 		Y >>= 19;
-		//if(Y&0x1000)
-		//	Y|=0xFFFFF000;
 
 		v = (((INT64)X*(INT64)Y) >> 12);
 		ACC = (int)v + B;
 
-		if (TWT)
-			DSP->TEMP[(TWA + DSP->DEC) & 0x7F] = SHIFTED;
+		if (op->TWT)
+			DSP->TEMP[(op->TWA + DSP->DEC) & 0x7F] = SHIFTED;
 
-		if (FRCL)
+		if (op->FRCL)
 		{
-			if (SHIFT == 3)
+			if (op->SHIFT == 3)
 				FRC_REG = SHIFTED & 0x0FFF;
 			else
 				FRC_REG = (SHIFTED >> 11) & 0x1FFF;
 		}
 
-		if (MRD || MWT)
-			//if(0)
+		if (op->MRD || op->MWT)		//only set on odd steps, memory is only accessed then (DoA inserts NOPs on even)
 		{
-			ADDR = DSP->MADRS[MASA];
-			if (!TABLE)
+			ADDR = DSP->MADRS[op->MASA];
+			if (!op->TABLE)
 				ADDR += DSP->DEC;
-			if (ADREB)
+			if (op->ADREB)
 				ADDR += ADRS_REG & 0x0FFF;
-			if (NXADR)
+			if (op->NXADR)
 				ADDR++;
-			if (!TABLE)
+			if (!op->TABLE)
 				ADDR &= DSP->RBL - 1;
 			else
 				ADDR &= 0xFFFF;
-			//ADDR<<=1;
-			//ADDR+=DSP->RBP<<13;
-			//MEMVAL=DSP->SCSPRAM[ADDR>>1];
 			ADDR += DSP->RBP << 12;
 			if (ADDR > 0x7ffff) ADDR = 0; //!! MAME has ADDR <<= 1 in here, but this seems to be wrong?
-			if (MRD && (step & 1)) //memory only allowed on odd? DoA inserts NOPs on even
+			if (op->MRD)
 			{
-				if (NOFL)
+				if (op->NOFL)
 					MEMVAL = DSP->SCSPRAM[ADDR] << 8;
 				else
 					MEMVAL = UNPACK(DSP->SCSPRAM[ADDR]);
 			}
-			if (MWT && (step & 1))
+			if (op->MWT)
 			{
-				if (NOFL)
+				if (op->NOFL)
 					DSP->SCSPRAM[ADDR] = SHIFTED >> 8;
 				else
 					DSP->SCSPRAM[ADDR] = PACK(SHIFTED);
 			}
 		}
 
-		if (ADRL)
+		if (op->ADRL)
 		{
-			if (SHIFT == 3)
+			if (op->SHIFT == 3)
 				ADRS_REG = (SHIFTED >> 12) & 0xFFF;
 			else
 				ADRS_REG = (INPUTS >> 16);
 		}
 
-		if (EWT)
-			DSP->EFREG[EWA] += SHIFTED >> 8;
+		if (op->EWT)
+			DSP->EFREG[op->EWA] += SHIFTED >> 8;
 
 	}
 	--DSP->DEC;
@@ -466,6 +477,7 @@ void SCSPDSP_Start(_SCSPDSP *DSP)
 			break;
 	}
 	DSP->LastStep = i + 1;
+	DSP->ProgramDirty = true;
 
 /*
 	int test=0;
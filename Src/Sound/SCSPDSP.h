@@ -33,6 +33,19 @@
 
 //#define DYNDSP
 
+//A micro-instruction with its MPRO fields decoded once (by SCSPDSP_Decode)
+struct _SCSPDSPOp
+{
+	UINT8 TRA, TWA;		//TEMP read/write addresses
+	UINT8 IRA, IWA;		//INPUTS read address, MEMS write address
+	UINT8 EWA;			//EFREG write address
+	UINT8 COEF;
+	UINT8 MASA;
+	UINT8 YSEL;
+	UINT8 SHIFT;
+	bool TWT, XSEL, IWT, TABLE, MWT, MRD, EWT, ADRL, FRCL, YRL, NEGB, ZERO, BSEL, NOFL, ADREB, NXADR;
+};
+
 //the DSP Context
 struct _SCSPDSP
 {
@@ -60,6 +73,11 @@ struct _SCSPDSP
 	
 	bool Stopped;
 	int LastStep;
+
+//decoded program, rebuilt from MPRO before the next step when ProgramDirty is set
+	_SCSPDSPOp Program[128];
+	int ProgramLength;
+	bool ProgramDirty;
 #ifdef DYNDSP
 	INT32 ACC;	//26 bit
 	INT32 SHIFTED;	//24 bit
@@ -81,5 +99,6 @@ void SCSPDSP_Init(_SCSPDSP *DSP);
 void SCSPDSP_SetSample(_SCSPDSP *DSP,INT32 sample,int SEL,int MXL);
 void SCSPDSP_Step(_SCSPDSP *DSP);
 void SCSPDSP_Start(_SCSPDSP *DSP);
+void SCSPDSP_Decode(_SCSPDSP *DSP);
 
 #endif	// INCLUDED_SCSPDSP_H
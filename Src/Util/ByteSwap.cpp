@@ -1,50 +1,265 @@
 #include "Util/ByteSwap.h"
+#include "Util/CPUFeatures.h"
+#include <cstring>
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BYTESWAP_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define BYTESWAP_TARGET(isa)
+#else
+#define BYTESWAP_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define BYTESWAP_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
 namespace Util
 {
-  void FlipEndian16(uint8_t * const buffer, const size_t size)
+  static inline uint16_t Swap16(uint16_t x)
   {
 #ifdef _MSC_VER
-    uint16_t * const buffer16 = (uint16_t*)buffer;
-    for (size_t i = 0; i < size/2; i++)
-      buffer16[i] = _byteswap_ushort(buffer16[i]);
+    return _byteswap_ushort(x);
 #elif defined(__GNUC__)
-    uint16_t * const buffer16 = (uint16_t*)buffer;
-    for (size_t i = 0; i < size/2; i++)
-      buffer16[i] = __builtin_bswap16(buffer16[i]);
+    return __builtin_bswap16(x);
 #else
-    for (size_t i = 0; i < (size & ~1); i += 2)
-    {
-      uint8_t tmp = buffer[i + 0];
-      buffer[i + 0] = buffer[i + 1];
-      buffer[i + 1] = tmp;
-    }
+    return uint16_t((x >> 8) | (x << 8));
 #endif
   }
 
-  void FlipEndian32(uint8_t * const buffer, const size_t size)
+  static inline uint32_t Swap32(uint32_t x)
   {
 #ifdef _MSC_VER
-    uint32_t * const buffer32 = (uint32_t*)buffer;
-    for (size_t i = 0; i < size/4; i++)
-      buffer32[i] = _byteswap_ulong(buffer32[i]);
+    return _byteswap_ulong(x);
 #elif defined(__GNUC__)
-    uint32_t * const buffer32 = (uint32_t*)buffer;
-    for (size_t i = 0; i < size/4; i++)
-      buffer32[i] = __builtin_bswap32(buffer32[i]);
+    return __builtin_bswap32(x);
 #else
-    for (size_t i = 0; i < (size & ~3); i += 4)
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+#endif
+  }
+
+  void FlipEndian16Scalar(uint8_t * const buffer, const size_t size)
+  {
+    for (size_t i = 0; i < (size & ~size_t(1)); i += 2)
+    {
+      uint16_t word;
+      memcpy(&word, buffer + i, sizeof(word));
+      word = Swap16(word);
+      memcpy(buffer + i, &word, sizeof(word));
+    }
+  }
+
+  void FlipEndian32Scalar(uint8_t * const buffer, const size_t size)
+  {
+    for (size_t i = 0; i < (size & ~size_t(3)); i += 4)
+    {
+      uint32_t word;
+      memcpy(&word, buffer + i, sizeof(word));
+      word = Swap32(word);
+      memcpy(buffer + i, &word, sizeof(word));
+    }
+  }
+
+#if defined(BYTESWAP_X86_SIMD)
+
+  // pshufb masks reversing the bytes of each 16- or 32-bit word in a lane
+  #define SWAP16_MASK 14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1
+  #define SWAP32_MASK 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+
+  BYTESWAP_TARGET("ssse3")
+  static size_t FlipSSSE3(uint8_t *buffer, size_t size, __m128i mask)
+  {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) (buffer + i));
+      _mm_storeu_si128((__m128i *) (buffer + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+  }
+
+  BYTESWAP_TARGET("avx2")
+  static size_t FlipAVX2(uint8_t *buffer, size_t size, __m256i mask)
+  {
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+      __m256i v0 = _mm256_loadu_si256((const __m256i *) (buffer + i));
+      __m256i v1 = _mm256_loadu_si256((const __m256i *) (buffer + i + 32));
+      _mm256_storeu_si256((__m256i *) (buffer + i), _mm256_shuffle_epi8(v0, mask));
+      _mm256_storeu_si256((__m256i *) (buffer + i + 32), _mm256_shuffle_epi8(v1, mask));
+    }
+    return i;
+  }
+
+  BYTESWAP_TARGET("ssse3")
+  void FlipEndian16SSSE3(uint8_t * const buffer, const size_t size)
+  {
+    size_t done = FlipSSSE3(buffer, size, _mm_set_epi8(SWAP16_MASK));
+    FlipEndian16Scalar(buffer + done, size - done);
+  }
+
+  BYTESWAP_TARGET("ssse3")
+  void FlipEndian32SSSE3(uint8_t * const buffer, const size_t size)
+  {
+    size_t done = FlipSSSE3(buffer, size, _mm_set_epi8(SWAP32_MASK));
+    FlipEndian32Scalar(buffer + done, size - done);
+  }
+
+  BYTESWAP_TARGET("avx2")
+  void FlipEndian16AVX2(uint8_t * const buffer, const size_t size)
+  {
+    size_t done = FlipAVX2(buffer, size, _mm256_set_epi8(SWAP16_MASK, SWAP16_MASK));
+    FlipEndian16SSSE3(buffer + done, size - done);
+  }
+
+  BYTESWAP_TARGET("avx2")
+  void FlipEndian32AVX2(uint8_t * const buffer, const size_t size)
+  {
+    size_t done = FlipAVX2(buffer, size, _mm256_set_epi8(SWAP32_MASK, SWAP32_MASK));
+    FlipEndian32SSSE3(buffer + done, size - done);
+  }
+
+  typedef void (*FlipEndianFunc)(uint8_t *, size_t);
+
+  static FlipEndianFunc s_flipEndian16 = nullptr;
+  static FlipEndianFunc s_flipEndian32 = nullptr;
+
+  static void SelectKernels()
+  {
+    bool ssse3 = GetCPUFeatures().ssse3;
+    bool avx2 = GetCPUFeatures().avx2;
+    s_flipEndian16 = avx2 ? FlipEndian16AVX2 : (ssse3 ? FlipEndian16SSSE3 : FlipEndian16Scalar);
+    s_flipEndian32 = avx2 ? FlipEndian32AVX2 : (ssse3 ? FlipEndian32SSSE3 : FlipEndian32Scalar);
+  }
+
+  void FlipEndian16(uint8_t * const buffer, const size_t size)
+  {
+    if (!s_flipEndian16)
+      SelectKernels();
+    s_flipEndian16(buffer, size);
+  }
+
+  void FlipEndian32(uint8_t * const buffer, const size_t size)
+  {
+    if (!s_flipEndian32)
+      SelectKernels();
+    s_flipEndian32(buffer, size);
+  }
+
+#elif defined(BYTESWAP_NEON_SIMD)
+
+  void FlipEndian16NEON(uint8_t * const buffer, const size_t size)
+  {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
     {
-      uint8_t tmp1 = buffer[i+0];
-      uint8_t tmp2 = buffer[i+1];
-      buffer[i+0] = buffer[i+3];
-      buffer[i+1] = buffer[i+2];
-      buffer[i+2] = tmp2;
-      buffer[i+3] = tmp1;
+      uint8x16_t v0 = vld1q_u8(buffer + i);
+      uint8x16_t v1 = vld1q_u8(buffer + i + 16);
+      vst1q_u8(buffer + i, vrev16q_u8(v0));
+      vst1q_u8(buffer + i + 16, vrev16q_u8(v1));
     }
+    FlipEndian16Scalar(buffer + i, size - i);
+  }
+
+  void FlipEndian32NEON(uint8_t * const buffer, const size_t size)
+  {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+      uint8x16_t v0 = vld1q_u8(buffer + i);
+      uint8x16_t v1 = vld1q_u8(buffer + i + 16);
+      vst1q_u8(buffer + i, vrev32q_u8(v0));
+      vst1q_u8(buffer + i + 16, vrev32q_u8(v1));
+    }
+    FlipEndian32Scalar(buffer + i, size - i);
+  }
+
+  void FlipEndian16(uint8_t * const buffer, const size_t size)
+  {
+    if (GetCPUFeatures().neon)
+      FlipEndian16NEON(buffer, size);
+    else
+      FlipEndian16Scalar(buffer, size);
+  }
+
+  void FlipEndian32(uint8_t * const buffer, const size_t size)
+  {
+    if (GetCPUFeatures().neon)
+      FlipEndian32NEON(buffer, size);
+    else
+      FlipEndian32Scalar(buffer, size);
+  }
+
+#else
+
+  void FlipEndian16(uint8_t * const buffer, const size_t size)
+  {
+    FlipEndian16Scalar(buffer, size);
+  }
+
+  void FlipEndian32(uint8_t * const buffer, const size_t size)
+  {
+    FlipEndian32Scalar(buffer, size);
+  }
+
 #endif
+
+  // Exchanges the two bytes of every 16-bit word packed in an integer
+  template <typename T>
+  static inline T SwapHalfwords(T x)
+  {
+    const T lo = T(0x00ff00ff00ff00ffull);
+    return T(((x >> 8) & lo) | ((x & lo) << 8));
+  }
+
+  // Each chunk is moved with a single load and store of its width
+  template <typename T>
+  static void InterleaveChunks(uint8_t *dest, size_t stride, const uint8_t *src, size_t num_chunks, bool swap16)
+  {
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+      T chunk;
+      memcpy(&chunk, src, sizeof(T));
+      if (swap16)
+        chunk = SwapHalfwords(chunk);
+      memcpy(dest, &chunk, sizeof(T));
+      src += sizeof(T);
+      dest += stride;
+    }
+  }
+
+  void Interleave(uint8_t *dest, size_t stride, const uint8_t *src, size_t size, size_t chunk_size, bool swap16)
+  {
+    size_t num_chunks = size / chunk_size;
+    switch (chunk_size)
+    {
+    case 1:
+      InterleaveChunks<uint8_t>(dest, stride, src, num_chunks, false);
+      break;
+    case 2:
+      InterleaveChunks<uint16_t>(dest, stride, src, num_chunks, swap16);
+      break;
+    case 4:
+      InterleaveChunks<uint32_t>(dest, stride, src, num_chunks, swap16);
+      break;
+    case 8:
+      InterleaveChunks<uint64_t>(dest, stride, src, num_chunks, swap16);
+      break;
+    default:
+      for (size_t i = 0; i < num_chunks; i++)
+      {
+        memcpy(dest, src, chunk_size);
+        if (swap16)
+          FlipEndian16(dest, chunk_size);
+        src += chunk_size;
+        dest += stride;
+      }
+      break;
+    }
   }
 } // Util
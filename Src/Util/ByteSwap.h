@@ -6,8 +6,25 @@
 
 namespace Util
 {
+  // Reverse the bytes of every 16- or 32-bit word in place, using the widest
+  // SIMD kernels the CPU supports
   void FlipEndian16(uint8_t *buffer, size_t size);
   void FlipEndian32(uint8_t *buffer, size_t size);
+
+  // Reference versions of the above, one word per iteration
+  void FlipEndian16Scalar(uint8_t *buffer, size_t size);
+  void FlipEndian32Scalar(uint8_t *buffer, size_t size);
+
+  /*
+   * Interleave(dest, stride, src, size, chunk_size, swap16):
+   *
+   * Copies size bytes from src to dest as chunk_size-byte chunks placed
+   * stride bytes apart, the way each ROM file of an interleaved region is
+   * laid out. If swap16 is true (chunk_size must then be even), the bytes of
+   * every 16-bit word are exchanged on the way. Only the chunks themselves
+   * are written, so several files may be interleaved into one region at once.
+   */
+  void Interleave(uint8_t *dest, size_t stride, const uint8_t *src, size_t size, size_t chunk_size, bool swap16);
 } // Util
 
 #endif  // INCLUDED_BYTESWAP_H
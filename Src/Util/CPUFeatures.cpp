@@ -0,0 +1,82 @@
+#include "Util/CPUFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPUFEATURES_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>  // _xgetbv()
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define CPUFEATURES_NEON
+#endif
+
+namespace Util
+{
+  static bool s_simdEnabled = true;
+
+  static CPUFeatures Detect()
+  {
+    CPUFeatures features = CPUFeatures();
+#if defined(CPUFEATURES_X86)
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    features.ssse3 = (info[2] & (1 << 9)) != 0;
+    features.sse41 = (info[2] & (1 << 19)) != 0;
+    features.pclmul = (info[2] & (1 << 1)) != 0;
+    bool osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+    if (osAVX && maxLeaf >= 7)
+    {
+      __cpuidex(info, 7, 0);
+      features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.ssse3 = __builtin_cpu_supports("ssse3");
+    features.sse41 = __builtin_cpu_supports("sse4.1");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.pclmul = __builtin_cpu_supports("pclmul");
+#endif
+#elif defined(CPUFEATURES_NEON)
+    // Part of the baseline wherever this is compiled in
+    features.neon = true;
+#ifdef __ARM_FEATURE_CRC32
+    // Only used when the compiler targets it
+    features.crc32 = true;
+#endif
+#endif
+    return features;
+  }
+
+  const CPUFeatures &GetCPUFeatures()
+  {
+    // Kernels may be bound on worker threads, so detection relies on the
+    // thread-safe initialization of local statics
+    static const CPUFeatures detected = Detect();
+    static const CPUFeatures none = CPUFeatures();
+    return s_simdEnabled ? detected : none;
+  }
+
+  void EnableSIMD(bool enable)
+  {
+    s_simdEnabled = enable;
+  }
+
+  std::string DescribeCPUFeatures()
+  {
+    const CPUFeatures &features = GetCPUFeatures();
+    std::string description;
+    if (features.sse2)  description += " SSE2";
+    if (features.ssse3) description += " SSSE3";
+    if (features.sse41) description += " SSE4.1";
+    if (features.avx2)  description += " AVX2";
+    if (features.pclmul) description += " PCLMUL";
+    if (features.neon)  description += " NEON";
+    if (features.crc32) description += " CRC32";
+    return description.empty() ? std::string("none") : description.substr(1);
+  }
+} // Util
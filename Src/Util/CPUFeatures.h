@@ -0,0 +1,48 @@
+#ifndef INCLUDED_UTIL_CPUFEATURES_H
+#define INCLUDED_UTIL_CPUFEATURES_H
+
+/*
+ * Runtime detection of the instruction sets that SIMD kernels are written
+ * for. Each kernel variant is compiled with its own target attribute, and
+ * modules bind function pointers to the best variant the CPU supports when
+ * they are built, so that a single binary runs well on every machine of the
+ * architecture. SIMD can be disabled (-no-simd) to force the scalar kernels
+ * everywhere, e.g. to rule them out when chasing a bug.
+ */
+
+#include <string>
+
+namespace Util
+{
+  struct CPUFeatures
+  {
+    bool sse2;
+    bool ssse3;
+    bool sse41;
+    bool avx2;
+    bool pclmul;  // carry-less multiply, for CRC32
+    bool neon;
+    bool crc32;   // ARMv8 CRC32 instructions
+  };
+
+  /*
+   * GetCPUFeatures():
+   *
+   * Returns the instruction sets SIMD kernels may use. The CPU is queried on
+   * the first call. All are reported missing if SIMD has been disabled.
+   */
+  const CPUFeatures &GetCPUFeatures();
+
+  /*
+   * EnableSIMD(enable):
+   *
+   * Allows or forbids SIMD kernels. Only affects kernels bound afterwards, so
+   * it must be called at startup before anything is loaded or constructed.
+   */
+  void EnableSIMD(bool enable);
+
+  // Lists the instruction sets in use, for the log
+  std::string DescribeCPUFeatures();
+} // Util
+
+#endif  // INCLUDED_UTIL_CPUFEATURES_H
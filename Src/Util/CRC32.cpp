@@ -0,0 +1,170 @@
+#include "Util/CRC32.h"
+#include "Util/CPUFeatures.h"
+#include <algorithm>
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CRC32_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define CRC32_TARGET(isa)
+#else
+#define CRC32_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC32_ARM_CRC
+#include <arm_acle.h>
+#include <cstring>
+#endif
+
+namespace Util
+{
+  uint32_t CRC32Scalar(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    uLong result = crc;
+    for (size_t pos = 0; pos < size; )
+    {
+      size_t len = std::min<size_t>(size - pos, 1u << 30);
+      result = crc32(result, data + pos, uInt(len));
+      pos += len;
+    }
+    return uint32_t(result);
+  }
+
+#if defined(CRC32_X86_SIMD)
+
+  // Folds x into the 16 bytes that follow it
+  CRC32_TARGET("pclmul,sse4.1")
+  static inline __m128i Fold16(__m128i x, __m128i next, __m128i k)
+  {
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(hi, next), lo);
+  }
+
+  /*
+   * Folds 64 bytes at a time with carry-less multiplication, as in Intel's
+   * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+   * Instruction", then Barrett-reduces to 32 bits. Works on the inverted CRC
+   * (as the CRC registers in that paper do), and size must be a multiple of
+   * 16 and at least 64.
+   */
+  CRC32_TARGET("pclmul,sse4.1")
+  static uint32_t FoldPCLMUL(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    // Constants for the bit-reflected polynomial 0xedb88320
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+    data += 64;
+    size -= 64;
+
+    // Four independent lanes of 16 bytes each
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+    for (; size >= 64; data += 64, size -= 64)
+    {
+      __m128i y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+      __m128i y2 = _mm_clmulepi64_si128(x2, k, 0x00);
+      __m128i y3 = _mm_clmulepi64_si128(x3, k, 0x00);
+      __m128i y4 = _mm_clmulepi64_si128(x4, k, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, y2), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, y3), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, y4), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30)));
+    }
+
+    // Fold the lanes into one, then any remaining 16-byte blocks into that
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+    x1 = Fold16(x1, x2, k);
+    x1 = Fold16(x1, x3, k);
+    x1 = Fold16(x1, x4, k);
+    for (; size >= 16; data += 16, size -= 16)
+      x1 = Fold16(x1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)), k);
+
+    // 128 bits down to 64
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return uint32_t(_mm_extract_epi32(x1, 1));
+  }
+
+  static uint32_t CRC32PCLMUL(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    if (size < 64)
+      return CRC32Scalar(crc, data, size);
+    size_t folded = size & ~size_t(15);
+    crc = ~FoldPCLMUL(~crc, data, folded);
+    return CRC32Scalar(crc, data + folded, size - folded);
+  }
+
+  typedef uint32_t (*CRC32Func)(uint32_t, const uint8_t *, size_t);
+
+  static CRC32Func SelectKernel()
+  {
+    const CPUFeatures &features = GetCPUFeatures();
+    return features.pclmul && features.sse41 ? CRC32PCLMUL : CRC32Scalar;
+  }
+
+  uint32_t CRC32(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    // First called from several loader workers at once, so bound through
+    // the thread-safe initialization of a local static
+    static const CRC32Func kernel = SelectKernel();
+    return kernel(crc, data, size);
+  }
+
+#elif defined(CRC32_ARM_CRC)
+
+  static uint32_t CRC32ARM(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    crc = ~crc;
+    for (; size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0; size--)
+      crc = __crc32b(crc, *data++);
+    for (; size >= 8; data += 8, size -= 8)
+    {
+      uint64_t word;
+      memcpy(&word, data, sizeof(word));
+      crc = __crc32d(crc, word);
+    }
+    for (; size > 0; size--)
+      crc = __crc32b(crc, *data++);
+    return ~crc;
+  }
+
+  uint32_t CRC32(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    if (GetCPUFeatures().crc32)
+      return CRC32ARM(crc, data, size);
+    return CRC32Scalar(crc, data, size);
+  }
+
+#else
+
+  uint32_t CRC32(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    return CRC32Scalar(crc, data, size);
+  }
+
+#endif
+} // Util
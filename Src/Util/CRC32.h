@@ -0,0 +1,23 @@
+#ifndef INCLUDED_UTIL_CRC32_H
+#define INCLUDED_UTIL_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Util
+{
+  /*
+   * CRC32(crc, data, size):
+   *
+   * Continues the CRC32 (the polynomial used by zip and zlib) of a buffer
+   * with size more bytes. Start with crc = 0. Uses carry-less multiplication
+   * or the ARMv8 CRC32 instructions where the CPU has them, and zlib
+   * otherwise, so the result is the same as zlib's crc32() everywhere.
+   */
+  uint32_t CRC32(uint32_t crc, const uint8_t *data, size_t size);
+
+  // Reference version of the above
+  uint32_t CRC32Scalar(uint32_t crc, const uint8_t *data, size_t size);
+} // Util
+
+#endif  // INCLUDED_UTIL_CRC32_H
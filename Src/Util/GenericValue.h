@@ -2,11 +2,8 @@
  * TODO:
  * -----
  * - ParseInteger() should be optimized. It is frequently used throughout the
- *   code base at run-time.
- * - Possible optimization: cache last ValueAs<T> conversion. Return this when
- *   available and when value is Set(), mark dirty. This may require memory
- *   allocation or, alternatively, we could do this only for data types of size
- *   <= 8.
+ *   code base at run-time (though ValueAs<T> now caches conversions to small
+ *   scalars, so each value is only parsed once).
  */
 
 #ifndef INCLUDED_UTIL_GENERICVALUE_H
@@ -18,7 +15,10 @@
 #include <sstream>
 #include <stdexcept>
 #include <memory>
+#include <atomic>
 #include <cctype>
+#include <cstdint>
+#include <cstring>
 
 namespace Util
 {
@@ -99,6 +99,21 @@ namespace Util
       ss >> tmp;
       return tmp;
     }    
+
+    // Types whose last conversion GenericValue caches: scalars of up to 32
+    // bits, each with a non-zero tag (zero marks the cache as empty)
+    template <typename T>
+    struct ConversionCacheTag
+    {
+      static const uint32_t value = 0;
+    };
+
+    template <> struct ConversionCacheTag<bool>           { static const uint32_t value = 1; };
+    template <> struct ConversionCacheTag<int16_t>        { static const uint32_t value = 2; };
+    template <> struct ConversionCacheTag<uint16_t>       { static const uint32_t value = 3; };
+    template <> struct ConversionCacheTag<int32_t>        { static const uint32_t value = 4; };
+    template <> struct ConversionCacheTag<uint32_t>       { static const uint32_t value = 5; };
+    template <> struct ConversionCacheTag<float>          { static const uint32_t value = 6; };
   }
 
   class GenericValue
@@ -106,9 +121,28 @@ namespace Util
   private:
     std::type_index m_type;
 
+    // Last ValueAs<T> conversion to a small scalar: tag in the upper half,
+    // value bits in the lower. One word, so concurrent readers always see a
+    // tag and value that belong together.
+    mutable std::atomic<uint64_t> m_conversion;
+
     virtual void *GetData() = 0;
     virtual const void *GetData() const = 0;
 
+    template <typename T>
+    T Convert() const
+    {
+      if (m_type == std::type_index(typeid(std::string)) && detail::IntegerEncodableAsHex<T>::value)
+        return detail::ParseInteger<T>(Value<std::string>()); // special case string -> integer conversion
+      if (m_type == std::type_index(typeid(std::string)) && std::type_index(typeid(T)) == std::type_index(typeid(bool)))
+        return detail::ParseBool<T>(Value<std::string>());    // special case string -> bool conversion
+      std::stringstream ss;
+      Serialize(&ss);
+      T tmp;
+      ss >> tmp;
+      return tmp;
+    }
+
   public:
     template <typename T>
     inline bool Is() const
@@ -129,15 +163,25 @@ namespace Util
     {
       if (m_type == std::type_index(typeid(T)))
         return *reinterpret_cast<const T *>(GetData());
-      if (m_type == std::type_index(typeid(std::string)) && detail::IntegerEncodableAsHex<T>::value)
-        return detail::ParseInteger<T>(Value<std::string>()); // special case string -> integer conversion
-      if (m_type == std::type_index(typeid(std::string)) && std::type_index(typeid(T)) == std::type_index(typeid(bool)))
-        return detail::ParseBool<T>(Value<std::string>());    // special case string -> bool conversion
-      std::stringstream ss;
-      Serialize(&ss);
-      T tmp;
-      ss >> tmp;
-      return tmp;
+      constexpr uint32_t tag = detail::ConversionCacheTag<T>::value;
+      if constexpr (tag != 0)
+      {
+        uint64_t cached = m_conversion.load(std::memory_order_relaxed);
+        uint32_t bits = uint32_t(cached);
+        T tmp;
+        if (uint32_t(cached >> 32) == tag)
+        {
+          std::memcpy(&tmp, &bits, sizeof(T));
+          return tmp;
+        }
+        tmp = Convert<T>();
+        bits = 0;
+        std::memcpy(&bits, &tmp, sizeof(T));
+        m_conversion.store((uint64_t(tag) << 32) | bits, std::memory_order_relaxed);
+        return tmp;
+      }
+      else
+        return Convert<T>();
     }
 
     template <typename T>
@@ -146,6 +190,7 @@ namespace Util
       if (!Is<T>())
         throw std::logic_error(Util::Format() << "GenericValue::Set(): cannot set value as " << std::type_index(typeid(T)).name() <<" because it is stored as " << m_type.name());
       *reinterpret_cast<T *>(GetData()) = value;
+      m_conversion.store(0, std::memory_order_relaxed);
     }
 
     void Set(const char *value)
@@ -157,7 +202,8 @@ namespace Util
     virtual std::shared_ptr<GenericValue> MakeCopy() const = 0;
       
     GenericValue(std::type_index type)
-      : m_type(type)
+      : m_type(type),
+        m_conversion(0)
     {}
 
     virtual ~GenericValue()
@@ -0,0 +1,137 @@
+#include "Util/HugePages.h"
+#include "OSD/Logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>  // VirtualAlloc()
+#else
+#include <sys/mman.h> // mmap(), madvise()
+#include <unistd.h>
+#endif
+
+namespace Util
+{
+  static size_t RoundUp(size_t n, size_t alignment)
+  {
+    return ((n + alignment - 1) / alignment) * alignment;
+  }
+
+  static float MB(size_t size)
+  {
+    return float(size) / float(0x100000);
+  }
+
+#ifdef _WIN32
+  // Large pages can only be allocated once the process has enabled SeLockMemoryPrivilege
+  static bool EnableLockMemoryPrivilege()
+  {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+      return false;
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                   AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+                   GetLastError() == ERROR_SUCCESS; // not ERROR_NOT_ALL_ASSIGNED
+    CloseHandle(token);
+    return enabled;
+  }
+
+  uint8_t *AllocateHugePages(size_t size, const char *name)
+  {
+    SIZE_T largePageSize = GetLargePageMinimum();
+    if (largePageSize != 0 && EnableLockMemoryPrivilege())
+    {
+      void *pool = VirtualAlloc(NULL, RoundUp(size, largePageSize), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+      if (pool != NULL)
+      {
+        InfoLog("Allocated %1.1f MB for %s in %u KB large pages.", MB(size), name, unsigned(largePageSize / 1024));
+        return (uint8_t *) pool;
+      }
+    }
+
+    void *pool = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (pool != NULL)
+      InfoLog("Allocated %1.1f MB for %s in ordinary pages (large pages need the \"Lock pages in memory\" privilege).", MB(size), name);
+    return (uint8_t *) pool;
+  }
+
+  void FreeHugePages(uint8_t *pool, size_t size)
+  {
+    (void) size;
+    if (pool != NULL)
+      VirtualFree(pool, 0, MEM_RELEASE);
+  }
+#else
+  static const char s_thpPath[] = "/sys/kernel/mm/transparent_hugepage/";
+
+  static size_t HugePageSize()
+  {
+    size_t size = 0;
+    std::string path = std::string(s_thpPath) + "hpage_pmd_size";
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp != NULL)
+    {
+      unsigned long long n;
+      if (fscanf(fp, "%llu", &n) == 1)
+        size = size_t(n);
+      fclose(fp);
+    }
+    return size != 0 ? size : 0x200000;
+  }
+
+  // MADV_HUGEPAGE is accepted but does nothing if transparent huge pages are disabled outright
+  static bool TransparentHugePagesEnabled()
+  {
+    char mode[128] = {};
+    std::string path = std::string(s_thpPath) + "enabled";
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp == NULL)
+      return false;
+    bool read = fgets(mode, sizeof(mode), fp) != NULL;
+    fclose(fp);
+    return read && strstr(mode, "[never]") == NULL;
+  }
+
+  uint8_t *AllocateHugePages(size_t size, const char *name)
+  {
+    // Anonymous mappings are already zeroed. Over-allocate so that the pool
+    // can start on a huge page boundary, then give back the ends.
+    size_t alignment = HugePageSize();
+    size = RoundUp(size, size_t(sysconf(_SC_PAGESIZE)));
+    size_t mapSize = size + alignment;
+    void *ptr = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (ptr == MAP_FAILED)
+      return NULL;
+    uint8_t *base = (uint8_t *) ptr;
+    uint8_t *pool = (uint8_t *) RoundUp(uintptr_t(base), alignment);
+    if (pool > base)
+      munmap(base, pool - base);
+    munmap(pool + size, (base + mapSize) - (pool + size));
+
+#ifdef MADV_HUGEPAGE
+    if (TransparentHugePagesEnabled() && madvise(pool, size, MADV_HUGEPAGE) == 0)
+    {
+      InfoLog("Allocated %1.1f MB for %s in transparent huge pages (%u KB).", MB(size), name, unsigned(alignment / 1024));
+      return pool;
+    }
+    InfoLog("Allocated %1.1f MB for %s in ordinary pages (transparent huge pages are disabled).", MB(size), name);
+#else
+    InfoLog("Allocated %1.1f MB for %s in ordinary pages.", MB(size), name);
+#endif
+    return pool;
+  }
+
+  void FreeHugePages(uint8_t *pool, size_t size)
+  {
+    if (pool != NULL)
+      munmap(pool, size);
+  }
+#endif
+} // Util
@@ -0,0 +1,34 @@
+#ifndef INCLUDED_UTIL_HUGEPAGES_H
+#define INCLUDED_UTIL_HUGEPAGES_H
+
+/*
+ * Allocation of the large, long-lived memory pools that emulated memory is
+ * carved out of. These are accessed randomly all over, so they are backed by
+ * huge pages where the OS allows it to cut down on TLB misses: transparent
+ * huge pages on Linux, large pages on Windows (which need the "Lock pages in
+ * memory" privilege). Anywhere else, or if that fails, ordinary pages are
+ * used.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Util
+{
+  /*
+   * AllocateHugePages(size, name):
+   *
+   * Allocates a zero-filled pool aligned to the huge page size, and logs
+   * which kind of pages were obtained for it under the given name. Other
+   * mappings (e.g. of files) may later be placed over parts of it.
+   *
+   * Returns:
+   *    Pointer to the pool or NULL if out of memory.
+   */
+  uint8_t *AllocateHugePages(size_t size, const char *name);
+
+  // Frees a pool from AllocateHugePages() of the same size. NULL is ignored.
+  void FreeHugePages(uint8_t *pool, size_t size);
+} // Util
+
+#endif  // INCLUDED_UTIL_HUGEPAGES_H
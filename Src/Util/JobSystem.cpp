@@ -0,0 +1,220 @@
+#include "Util/JobSystem.h"
+#include "Util/Trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Util
+{
+  struct JobAccess
+  {
+    static void Finish(JobGroup *group);
+  };
+
+  namespace Jobs
+  {
+    struct Job
+    {
+      std::function<void()> fn;
+      JobGroup *group;
+    };
+
+    struct Queue
+    {
+      std::mutex mutex;
+      std::deque<Job> jobs;
+    };
+
+    // The pool is only resized by Start() and Stop(), while no jobs are in flight
+    static Queue s_shared;                                  // jobs from threads outside the pool
+    static std::vector<std::unique_ptr<Queue>> s_queues;   // one per worker
+    static std::vector<std::thread> s_workers;
+    static std::atomic<int> s_queued(0);                    // counted before a job is queued, so never less than the jobs queued
+    static std::atomic<bool> s_stop(false);
+    static std::mutex s_sleepMutex;
+    static std::condition_variable s_workQueued;
+    static std::condition_variable s_jobDone;
+    static thread_local Queue *t_queue = nullptr;
+    static thread_local size_t t_index = 0;
+
+    static bool Take(Queue &queue, bool newest, Job *job)
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.jobs.empty())
+        return false;
+      if (newest)
+      {
+        *job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+      }
+      else
+      {
+        *job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+      }
+      s_queued.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    static void Push(Job job)
+    {
+      Queue &queue = (t_queue != nullptr) ? *t_queue : s_shared;
+      s_queued.fetch_add(1, std::memory_order_relaxed);
+      {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+      }
+      {
+        std::lock_guard<std::mutex> lock(s_sleepMutex);
+      }
+      s_workQueued.notify_one();
+    }
+
+    // Runs one queued job: the calling worker's newest, else the oldest shared or stolen one
+    static bool RunOne()
+    {
+      if (s_queued.load(std::memory_order_relaxed) <= 0)
+        return false;
+
+      Job job;
+      bool found = (t_queue != nullptr && Take(*t_queue, true, &job)) || Take(s_shared, false, &job);
+      for (size_t i = 0; !found && i < s_queues.size(); i++)
+      {
+        Queue &victim = *s_queues[(t_index + 1 + i) % s_queues.size()];
+        if (&victim != t_queue)
+          found = Take(victim, false, &job);
+      }
+      if (!found)
+        return false;
+
+      job.fn();
+      JobAccess::Finish(job.group);
+      return true;
+    }
+
+    static void RunWorker(size_t index)
+    {
+      TRACE_THREAD("Jobs");
+      t_queue = s_queues[index].get();
+      t_index = index;
+
+      while (!s_stop.load(std::memory_order_acquire))
+      {
+        if (RunOne())
+          continue;
+        std::unique_lock<std::mutex> lock(s_sleepMutex);
+        s_workQueued.wait(lock, [] { return s_stop.load(std::memory_order_acquire) || s_queued.load(std::memory_order_relaxed) > 0; });
+      }
+    }
+
+    void Start(unsigned numWorkers, unsigned reservedThreads)
+    {
+      if (!s_workers.empty())
+        return;
+
+      if (numWorkers == 0)
+      {
+        unsigned cores = std::thread::hardware_concurrency();
+        numWorkers = (cores > reservedThreads) ? cores - reservedThreads : 0;
+      }
+
+      s_stop = false;
+      for (unsigned i = 0; i < numWorkers; i++)
+        s_queues.emplace_back(new Queue());
+      for (unsigned i = 0; i < numWorkers; i++)
+        s_workers.emplace_back(RunWorker, size_t(i));
+    }
+
+    void Stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(s_sleepMutex);
+        s_stop = true;
+      }
+      s_workQueued.notify_all();
+      for (auto &worker: s_workers)
+        worker.join();
+      s_workers.clear();
+
+      // Anything left over is run by whoever waits for it
+      std::lock_guard<std::mutex> lock(s_shared.mutex);
+      for (auto &queue: s_queues)
+      {
+        for (auto &job: queue->jobs)
+          s_shared.jobs.push_back(std::move(job));
+      }
+      s_queues.clear();
+    }
+
+    // Joins the workers if the program exits without calling Stop(). Defined after the pool so that it is destroyed first.
+    static struct StopAtExit
+    {
+      ~StopAtExit()
+      {
+        Stop();
+      }
+    } s_stopAtExit;
+
+    unsigned NumWorkers()
+    {
+      return unsigned(s_workers.size());
+    }
+  } // Jobs
+
+  void JobAccess::Finish(JobGroup *group)
+  {
+    // The group may be destroyed as soon as its count drops to zero, so it must not be touched after
+    if (group->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      std::lock_guard<std::mutex> lock(Jobs::s_sleepMutex);
+      Jobs::s_jobDone.notify_all();
+    }
+  }
+
+  void JobGroup::Run(std::function<void()> job)
+  {
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    Jobs::Push(Jobs::Job{ std::move(job), this });
+  }
+
+  void JobGroup::Wait()
+  {
+    while (!Done())
+    {
+      // Help out rather than block, which also keeps nested groups from deadlocking
+      if (Jobs::RunOne())
+        continue;
+      std::unique_lock<std::mutex> lock(Jobs::s_sleepMutex);
+      Jobs::s_jobDone.wait(lock, [this] { return Done() || Jobs::s_queued.load(std::memory_order_relaxed) > 0; });
+    }
+  }
+
+  void ParallelFor(size_t begin, size_t end, size_t numChunks, const std::function<void(size_t, size_t)> &body)
+  {
+    if (end <= begin)
+      return;
+
+    size_t count = end - begin;
+    numChunks = std::min(numChunks, count);
+    if (numChunks <= 1)
+    {
+      body(begin, end);
+      return;
+    }
+
+    JobGroup group;
+    for (size_t i = 1; i < numChunks; i++)
+    {
+      size_t first = begin + (i * count) / numChunks;
+      size_t last = begin + ((i + 1) * count) / numChunks;
+      group.Run([&body, first, last] { body(first, last); });
+    }
+    body(begin, begin + count / numChunks);
+    group.Wait();
+  }
+} // Util
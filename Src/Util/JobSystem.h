@@ -0,0 +1,79 @@
+#ifndef INCLUDED_UTIL_JOBSYSTEM_H
+#define INCLUDED_UTIL_JOBSYSTEM_H
+
+/*
+ * Work-stealing job system shared by every subsystem that splits work across
+ * cores, so that they don't each keep their own threads.
+ *
+ * Jobs are submitted to a JobGroup and run on a single pool of workers. Each
+ * worker queues the jobs it submits itself and takes them newest first; jobs
+ * from other threads go to a shared queue. An idle worker takes from the
+ * shared queue, then steals the oldest job of another worker. A thread
+ * waiting on a group runs queued jobs instead of blocking, so groups can be
+ * nested (fork/join) and, with no workers at all, everything simply runs on
+ * the waiting thread.
+ */
+
+#include <atomic>
+#include <functional>
+
+namespace Util
+{
+  namespace Jobs
+  {
+    /*
+     * Start(numWorkers, reservedThreads):
+     *
+     * Starts the worker pool. If numWorkers is 0, one worker is created per
+     * logical processor not already taken by reservedThreads (the threads
+     * that run continuously elsewhere, including the calling one). Does
+     * nothing if the pool is running.
+     */
+    void Start(unsigned numWorkers, unsigned reservedThreads);
+
+    // Stops the pool. Jobs still queued run on whichever thread waits for them.
+    void Stop();
+
+    // Number of workers, so that callers can decide how finely to split work
+    unsigned NumWorkers();
+  } // Jobs
+
+  class JobGroup
+  {
+  public:
+    JobGroup() = default;
+    JobGroup(const JobGroup &) = delete;
+    JobGroup &operator=(const JobGroup &) = delete;
+
+    ~JobGroup()
+    {
+      Wait();
+    }
+
+    // Queues a job. Returns immediately.
+    void Run(std::function<void()> job);
+
+    // Returns once every job run in this group, including nested ones, is done
+    void Wait();
+
+    bool Done() const
+    {
+      return m_pending.load(std::memory_order_acquire) == 0;
+    }
+
+  private:
+    friend struct JobAccess;
+    std::atomic<unsigned> m_pending{ 0 };
+  };
+
+  /*
+   * ParallelFor(begin, end, numChunks, body):
+   *
+   * Splits [begin, end) into numChunks contiguous ranges of near equal size
+   * and calls body(first, last) for each, in parallel. The calling thread
+   * takes the first range and returns once all are done.
+   */
+  void ParallelFor(size_t begin, size_t end, size_t numChunks, const std::function<void(size_t, size_t)> &body);
+} // Util
+
+#endif  // INCLUDED_UTIL_JOBSYSTEM_H
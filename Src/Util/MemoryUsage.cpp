@@ -0,0 +1,63 @@
+#include "Util/MemoryUsage.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace Util
+{
+  // Accounts are few and long-lived, so a list under a lock will do
+  static std::mutex s_mutex;
+  static std::vector<const MemoryAccount *> s_accounts;
+
+  MemoryAccount::MemoryAccount(const char *name)
+    : m_name(name),
+      m_cpuBytes(0),
+      m_gpuBytes(0)
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_accounts.push_back(this);
+  }
+
+  MemoryAccount::~MemoryAccount()
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_accounts.erase(std::find(s_accounts.begin(), s_accounts.end(), this));
+  }
+
+  std::vector<MemoryUsage> GetMemoryUsage()
+  {
+    std::vector<MemoryUsage> usage;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (const MemoryAccount *account: s_accounts)
+    {
+      auto it = std::find_if(usage.begin(), usage.end(), [account](const MemoryUsage &u) { return !strcmp(u.name, account->GetName()); });
+      if (it == usage.end())
+        usage.push_back({ account->GetName(), account->GetCPU(), account->GetGPU() });
+      else
+      {
+        it->cpuBytes += account->GetCPU();
+        it->gpuBytes += account->GetGPU();
+      }
+    }
+    return usage;
+  }
+
+  std::string DescribeMemoryUsage()
+  {
+    std::string description;
+    char line[128];
+    size_t cpuTotal = 0;
+    size_t gpuTotal = 0;
+    for (const MemoryUsage &u: GetMemoryUsage())
+    {
+      snprintf(line, sizeof(line), "  %-24s CPU:%8.1f MB  GPU:%8.1f MB\n", u.name, u.cpuBytes / 1048576.0, u.gpuBytes / 1048576.0);
+      description += line;
+      cpuTotal += u.cpuBytes;
+      gpuTotal += u.gpuBytes;
+    }
+    snprintf(line, sizeof(line), "  %-24s CPU:%8.1f MB  GPU:%8.1f MB\n", "Total", cpuTotal / 1048576.0, gpuTotal / 1048576.0);
+    return description + line;
+  }
+} // Util
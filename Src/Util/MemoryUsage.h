@@ -0,0 +1,82 @@
+#ifndef INCLUDED_UTIL_MEMORYUSAGE_H
+#define INCLUDED_UTIL_MEMORYUSAGE_H
+
+/*
+ * Accounting of where memory goes, so that the footprint of an instance can
+ * be seen and growth over a long session spotted. Each subsystem keeps a
+ * MemoryAccount for its large allocations, in system memory (CPU) and in
+ * graphics memory (GPU), and sets its sizes whenever they change. Accounts
+ * may be updated and read from any thread. Sizes of GPU objects are what was
+ * asked for; drivers may pad them.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Util
+{
+  class MemoryAccount
+  {
+  public:
+    // The name must outlive the account (e.g. a string literal). Accounts
+    // with the same name are reported together.
+    explicit MemoryAccount(const char *name);
+    ~MemoryAccount();
+
+    MemoryAccount(const MemoryAccount &) = delete;
+    MemoryAccount &operator=(const MemoryAccount &) = delete;
+
+    void SetCPU(size_t bytes)
+    {
+      m_cpuBytes = bytes;
+    }
+
+    void SetGPU(size_t bytes)
+    {
+      m_gpuBytes = bytes;
+    }
+
+    const char *GetName() const
+    {
+      return m_name;
+    }
+
+    size_t GetCPU() const
+    {
+      return m_cpuBytes;
+    }
+
+    size_t GetGPU() const
+    {
+      return m_gpuBytes;
+    }
+
+  private:
+    const char *m_name;
+    std::atomic<size_t> m_cpuBytes;
+    std::atomic<size_t> m_gpuBytes;
+  };
+
+  struct MemoryUsage
+  {
+    const char *name;
+    size_t cpuBytes;
+    size_t gpuBytes;
+  };
+
+  /*
+   * GetMemoryUsage():
+   *
+   * Returns:
+   *    The sizes of all live accounts, summed by name, in the order the names
+   *    were first seen.
+   */
+  std::vector<MemoryUsage> GetMemoryUsage();
+
+  // One line per account plus the totals, in MB, for the console
+  std::string DescribeMemoryUsage();
+} // Util
+
+#endif  // INCLUDED_UTIL_MEMORYUSAGE_H
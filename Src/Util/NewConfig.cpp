@@ -137,12 +137,36 @@
  * Section3. It will be set to "bar" in Section4, Section5, and the "Global"
  * section because of the unnamed element.
  *
+ * Cached Bindings
+ * ---------------
+ *
+ * Lookups walk the tree by string and values are converted on every access,
+ * which is too slow for code that runs every frame or every sample. Such code
+ * should bind a Binding<T> once, typically in its constructor or Init(), and
+ * read it with Get():
+ *
+ *    Util::Config::Binding<int> volume(config, "SoundVolume", 100);
+ *    ...
+ *    float vol = volume.Get() * (1.0f / 100.0f);
+ *
+ * Every modification of any node (SetValue(), Clear(), Add(), assignment)
+ * advances a global generation counter. A binding re-resolves its key only
+ * when the counter differs from the one it last saw. The bound parent node
+ * must outlive the binding.
+ *
+ * Lookups by string walk the path in place and the child maps are searched
+ * without building a std::string per key, so they don't allocate. A KeyPath
+ * holds a path already split up, for lookups repeated often enough that
+ * finding the separators matters:
+ *
+ *    static const Util::Config::KeyPath s_frequency("PowerPCFrequency");
+ *    config[s_frequency].ValueAsDefault<unsigned>(0);
+ *
+ * A value converted with ValueAs<T>() keeps the result when T is a small
+ * scalar, so repeating the conversion doesn't parse the string again.
+ *
  * TODO
  * ----
- * - TryGet() can be made quicker by attempting a direct lookup first. We never
- *   add keys with '/' in them (they are split up into nested nodes). Most
- *   lookups are likely to be leaf level, so a direct lookup should be possible
- *   first and, if it fails, the key can be retried as a nested path.
  * - Define our own exceptions?
  */
 
@@ -161,33 +185,69 @@ namespace Util
         throw std::logic_error(Util::Format() << "Node \"" << m_key << "\" has no value" );
     }
 
-    const Node &Node::MissingNode(const std::string &key) const
+    std::atomic<unsigned> Node::s_generation(0);
+
+    const Node &Node::MissingNode(std::string_view key) const
     {
       auto it = m_missing_nodes.find(key);
       if (it == m_missing_nodes.end())
       {
-        auto result = m_missing_nodes.emplace(key, key);
+        auto result = m_missing_nodes.emplace(std::string(key), std::string(key));
         result.first->second.m_missing = true; // mark this node as missing
         return result.first->second;
       }
       return it->second;
     }
 
-    const Node &Node::operator[](const std::string &path) const
+    // Calls fn(key, last) for each '/'-separated key of path in turn, stopping
+    // early if it returns false. Empty keys are passed on, as Format::Split()
+    // would return them.
+    template <typename Fn>
+    static inline void ForEachKey(std::string_view path, Fn fn)
+    {
+      size_t start = 0;
+      while (true)
+      {
+        size_t end = path.find('/', start);
+        bool last = end == std::string_view::npos;
+        if (!fn(path.substr(start, last ? std::string_view::npos : end - start), last) || last)
+          return;
+        start = end + 1;
+      }
+    }
+
+    const Node &Node::operator[](std::string_view path) const
     {
       const Node *e = this;
-      std::vector<std::string> keys = Util::Format(path).Split('/');
-      for (auto &key: keys)
+      const Node *missing = nullptr;
+      ForEachKey(path, [&](std::string_view key, bool)
       {
         auto it = e->m_children.find(key);
         if (it == e->m_children.end())
-          return e->MissingNode(key);
+        {
+          missing = &e->MissingNode(key);
+          return false;
+        }
+        e = it->second.get();
+        return true;
+      });
+      return missing ? *missing : *e;
+    }
+
+    const Node &Node::operator[](const KeyPath &key) const
+    {
+      const Node *e = this;
+      for (auto &k: key.Keys())
+      {
+        auto it = e->m_children.find(k);
+        if (it == e->m_children.end())
+          return e->MissingNode(k);
         e = it->second.get();
       }
       return *e;
     }
 
-    Node &Node::Get(const std::string &path)
+    Node &Node::Get(std::string_view path)
     {
       Node *node = TryGet(path);
       if (!node)
@@ -195,7 +255,7 @@ namespace Util
       return *node;
     }
 
-    const Node &Node::Get(const std::string &path) const
+    const Node &Node::Get(std::string_view path) const
     {
       const Node *node = TryGet(path);
       if (!node)
@@ -203,27 +263,29 @@ namespace Util
       return *node;
     }
 
-    Node *Node::TryGet(const std::string &path)
+    Node *Node::TryGet(std::string_view path)
     {
-      Node *e = this;
-      std::vector<std::string> keys = Util::Format(path).Split('/');
-      for (auto &key: keys)
+      return const_cast<Node *>(static_cast<const Node *>(this)->TryGet(path));
+    }
+
+    const Node *Node::TryGet(std::string_view path) const
+    {
+      const Node *e = this;
+      ForEachKey(path, [&](std::string_view key, bool)
       {
         auto it = e->m_children.find(key);
-        if (it == e->m_children.end())
-          return nullptr;
-        e = it->second.get();
-      }
+        e = it == e->m_children.end() ? nullptr : it->second.get();
+        return e != nullptr;
+      });
       return e;
     }
 
-    const Node *Node::TryGet(const std::string &path) const
+    const Node *Node::TryGet(const KeyPath &key) const
     {
       const Node *e = this;
-      std::vector<std::string> keys = Util::Format(path).Split('/');
-      for (auto &key: keys)
+      for (auto &k: key.Keys())
       {
-        auto it = e->m_children.find(key);
+        auto it = e->m_children.find(k);
         if (it == e->m_children.end())
           return nullptr;
         e = it->second.get();
@@ -295,6 +357,7 @@ namespace Util
         parent.m_last_child = node;
       }
       parent.m_children[node->m_key] = node;
+      Touch();
     }
 
     void Node::DeepCopy(const Node &that)
@@ -310,6 +373,7 @@ namespace Util
         ptr_t copied_child = std::make_shared<Node>(*child);
         AddChild(*this, copied_child);
       }
+      Touch();
     }
 
     void Node::Swap(Node &rhs)
@@ -320,6 +384,7 @@ namespace Util
       m_children.swap(rhs.m_children);
      const_cast<std::string *>(&m_key)->swap(*const_cast<std::string *>(&rhs.m_key));
       m_value.swap(rhs.m_value);
+      Touch();
     }
 
     Node &Node::operator=(const Node &rhs)
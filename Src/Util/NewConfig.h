@@ -3,14 +3,46 @@
 
 #include "Util/GenericValue.h"
 #include <map>
+#include <atomic>
 #include <memory>
 #include <exception>
 #include <iterator>
+#include <string_view>
+#include <vector>
 
 namespace Util
 {
   namespace Config
   {
+    // A path split into its keys once, for lookups in code that runs often.
+    // Looking up a KeyPath neither parses the path nor allocates.
+    class KeyPath
+    {
+    private:
+      std::string m_path;
+      std::vector<std::string> m_keys;
+
+    public:
+      const inline std::string &Path() const
+      {
+        return m_path;
+      }
+
+      const inline std::vector<std::string> &Keys() const
+      {
+        return m_keys;
+      }
+
+      explicit KeyPath(const std::string &path)
+        : m_path(path),
+          m_keys(Util::Format(path).Split('/'))
+      {}
+
+      explicit KeyPath(const char *path)
+        : KeyPath(std::string(path))
+      {}
+    };
+
     class Node
     {
     private:
@@ -21,9 +53,15 @@ namespace Util
       ptr_t m_next_sibling;
       ptr_t m_first_child;
       ptr_t m_last_child;
-      std::map<std::string, ptr_t> m_children;
-      mutable std::map<std::string, Node> m_missing_nodes;  // missing nodes from failed queries (must also be empty)
+      std::map<std::string, ptr_t, std::less<>> m_children;   // transparent, so lookups by std::string_view don't build a string
+      mutable std::map<std::string, Node, std::less<>> m_missing_nodes;  // missing nodes from failed queries (must also be empty)
       bool m_missing = false;
+      static std::atomic<unsigned> s_generation;  // bumped on every modification of any tree
+
+      static inline void Touch()
+      {
+        s_generation.fetch_add(1, std::memory_order_relaxed);
+      }
 
       void Destroy()
       {
@@ -35,7 +73,7 @@ namespace Util
       }
 
       void CheckEmptyOrMissing() const;
-      const Node &MissingNode(const std::string &key) const;
+      const Node &MissingNode(std::string_view key) const;
       Node &AddEmpty(const std::string &path);
       void AddChild(Node &parent, ptr_t &node);
       void DeepCopy(const Node &that);
@@ -172,11 +210,13 @@ namespace Util
       inline void Clear()
       {
         m_value = nullptr;
+        Touch();
       }
 
       inline void SetValue(const std::shared_ptr<GenericValue> &value)
       {
         m_value = value;
+        Touch();
       }
 
       template <typename T>
@@ -211,6 +251,7 @@ namespace Util
             m_value->Set(value);
           else
             m_value = std::make_shared<ValueInstance<T>>(value);
+          Touch();
         }
         else
           throw std::range_error(Util::Format() << "Node \"" << m_key << "\" does not exist");
@@ -288,15 +329,24 @@ namespace Util
 
       // Always succeeds -- failed lookups permanently create an empty node.
       // Use with caution. Intended for hard-coded lookups.
-      const Node &operator[](const std::string &path) const;
+      const Node &operator[](std::string_view path) const;
+      const Node &operator[](const KeyPath &key) const;
 
       // These throw if the node is missing
-      Node &Get(const std::string &path);
-      const Node &Get(const std::string &path) const;
+      Node &Get(std::string_view path);
+      const Node &Get(std::string_view path) const;
 
-      // This returns nullptr if node is missing
-      Node *TryGet(const std::string &path);
-      const Node *TryGet(const std::string &path) const;
+      // This returns nullptr if node is missing. Neither allocates.
+      Node *TryGet(std::string_view path);
+      const Node *TryGet(std::string_view path) const;
+      const Node *TryGet(const KeyPath &key) const;
+
+      // Changes whenever any node is modified. Used by Binding to detect that
+      // a cached value must be refreshed.
+      static inline unsigned Generation()
+      {
+        return s_generation.load(std::memory_order_relaxed);
+      }
 
       void Serialize(std::ostream *os, size_t indent_level = 0) const;
       std::string ToString(size_t indent_level = 0) const;
@@ -309,6 +359,59 @@ namespace Util
       ~Node();
     };
 
+    // Typed, cached handle to a single setting for use in emulation hot paths.
+    // The key is looked up and converted once when bound and then only again
+    // after the config has been modified, so reading it costs a compare.
+    template <typename T>
+    class Binding
+    {
+    private:
+      const Node *m_parent = nullptr;
+      KeyPath m_key = KeyPath(std::string());
+      T m_default;
+      mutable T m_value;
+      mutable unsigned m_generation = 0;
+
+      void Refresh(unsigned generation) const
+      {
+        const Node *node = m_parent ? m_parent->TryGet(m_key) : nullptr;
+        m_value = (node && node->Exists()) ? node->ValueAs<T>() : m_default;
+        m_generation = generation;
+      }
+
+    public:
+      inline const T &Get() const
+      {
+        unsigned generation = Node::Generation();
+        if (generation != m_generation)
+          Refresh(generation);
+        return m_value;
+      }
+
+      inline const T &operator*() const
+      {
+        return Get();
+      }
+
+      void Bind(const Node &parent, const std::string &key, const T &default_value = T())
+      {
+        m_parent = &parent;
+        m_key = KeyPath(key);
+        m_default = default_value;
+        Refresh(Node::Generation());
+      }
+
+      Binding()
+        : m_default(T()),
+          m_value(T())
+      {}
+
+      Binding(const Node &parent, const std::string &key, const T &default_value = T())
+      {
+        Bind(parent, key, default_value);
+      }
+    };
+
     void PrintConfigTree(const Node &config, int indent_level = 0, int tab_stops = 2);
   } // Config
 } // Util
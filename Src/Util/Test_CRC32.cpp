@@ -0,0 +1,79 @@
+/*
+ * Test_CRC32.cpp
+ *
+ * Checks the accelerated CRC32 against zlib's and times them. Build
+ * standalone, e.g.:
+ *
+ *  g++ -std=c++17 -O2 -ISrc Src/Util/Test_CRC32.cpp Src/Util/CRC32.cpp Src/Util/CPUFeatures.cpp -lz
+ */
+
+#include "Util/CRC32.h"
+#include "Util/CPUFeatures.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+// Prints the best time of several runs in milliseconds, and the throughput in MB/s
+static void Benchmark(const std::string &name, size_t bytes, const std::function<void()> &f)
+{
+  double best = 1e30;
+  for (int run = 0; run < 10; run++)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  std::cout << name << ": " << best << " ms (" << (double(bytes) / (1024.0 * 1024.0)) / (best / 1000.0) << " MB/s)" << std::endl;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  std::cout << "Instruction sets: " << Util::DescribeCPUFeatures() << std::endl << std::endl;
+
+  std::mt19937 rng(1);
+  const size_t size = 64 * 1024 * 1024;
+  std::vector<uint8_t> data(size);
+  for (auto &b: data)
+    b = uint8_t(rng());
+
+  // Sizes around the 16- and 64-byte folding boundaries, at odd offsets
+  for (size_t offset: { 0, 1, 7 })
+  {
+    for (size_t len: { size_t(0), size_t(15), size_t(63), size_t(64), size_t(65), size_t(127), size_t(128), size_t(4096 + 6), size_t(1 << 20) })
+    {
+      bool ok = Util::CRC32(0, data.data() + offset, len) == Util::CRC32Scalar(0, data.data() + offset, len);
+      test_results.push_back({ "CRC32 len=" + std::to_string(len) + " offset=" + std::to_string(offset), ok });
+    }
+  }
+
+  // Continuing a CRC across pieces, as when inflating a block at a time
+  uint32_t pieces = 0;
+  for (size_t pos = 0, len = 1; pos < (1 << 20); pos += len, len = len * 3 + 1)
+    pieces = Util::CRC32(pieces, data.data() + pos, std::min<size_t>(len, (1 << 20) - pos));
+  test_results.push_back({ "CRC32 in pieces", pieces == Util::CRC32Scalar(0, data.data(), 1 << 20) });
+
+  // Known value
+  const char *check = "123456789";
+  test_results.push_back({ "CRC32 check value", Util::CRC32(0, reinterpret_cast<const uint8_t *>(check), 9) == 0xcbf43926 });
+
+  PrintTestResults(test_results);
+
+  std::cout << std::endl << "BENCHMARKS (" << size / (1024 * 1024) << " MB)" << std::endl;
+  std::cout << "----------" << std::endl;
+  Benchmark("CRC32Scalar", size, [&]() { Util::CRC32Scalar(0, data.data(), size); });
+  Benchmark("CRC32", size, [&]() { Util::CRC32(0, data.data(), size); });
+
+  return 0;
+}
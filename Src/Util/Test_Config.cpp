@@ -202,6 +202,36 @@ int main()
     test_results.push_back({ "Duplicate leaf nodes", config.ToString() == expected_config });
   }
 
+  // Lookups through a pre-split KeyPath and through a std::string_view
+  {
+    Util::Config::Node config("global");
+    config.Add("foo/bar/baz", "bart");
+    config.Add("empty");
+    static const Util::Config::KeyPath baz("foo/bar/baz");
+    static const Util::Config::KeyPath missing("foo/qux");
+    std::string path = "foo/bar/baz/and/more";
+    std::string_view prefix(path.data(), 11);
+    test_results.push_back({ "KeyPath lookup", config[baz].Value<std::string>() == "bart" && config.TryGet(baz) == config.TryGet("foo/bar/baz") });
+    test_results.push_back({ "KeyPath missing", config.TryGet(missing) == nullptr && config[missing].ValueAsDefault<int>(7) == 7 });
+    test_results.push_back({ "string_view lookup", config[prefix].Value<std::string>() == "bart" });
+    test_results.push_back({ "Empty key lookup", config.TryGet("") == nullptr && config.TryGet("foo/") == nullptr && config.TryGet("empty") != nullptr });
+  }
+
+  // Conversions are cached until the value is set again
+  {
+    Util::Config::Node config("global");
+    config.Add("freq", std::string("0x20"));
+    config.Add("flag", std::string("on"));
+    bool first = config["freq"].ValueAs<unsigned>() == 0x20 && config["freq"].ValueAs<unsigned>() == 0x20;
+    bool other_type = config["freq"].ValueAs<int>() == 0x20 && config["freq"].ValueAs<unsigned>() == 0x20;
+    config.Get("freq").SetValue(std::string("66"));
+    bool after_set = config["freq"].ValueAs<unsigned>() == 66 && config["freq"].ValueAs<float>() == 66.0f && config["freq"].ValueAs<unsigned>() == 66;
+    bool flag = config["flag"].ValueAs<bool>() && config["flag"].ValueAs<bool>();
+    config.Get("flag").SetValue(std::string("off"));
+    flag &= !config["flag"].ValueAs<bool>();
+    test_results.push_back({ "Cached conversion", first && other_type && after_set && flag });
+  }
+
   PrintTestResults(test_results);
   return 0;
 }
@@ -0,0 +1,106 @@
+/*
+ * Test_JobSystem.cpp
+ *
+ * Checks that the job system runs every job exactly once, with and without
+ * workers and when groups are nested. Build standalone, e.g.:
+ *
+ *  g++ -std=c++17 -O2 -pthread -ISrc Src/Util/Test_JobSystem.cpp Src/Util/JobSystem.cpp
+ */
+
+#include "Util/JobSystem.h"
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+// Every element is visited once, whatever the split
+static bool TestParallelFor(size_t count, size_t numChunks)
+{
+  std::vector<std::atomic<int>> visits(count);
+  for (auto &v: visits)
+    v = 0;
+  Util::ParallelFor(0, count, numChunks, [&](size_t first, size_t last)
+  {
+    for (size_t i = first; i < last; i++)
+      visits[i]++;
+  });
+  for (auto &v: visits)
+  {
+    if (v != 1)
+      return false;
+  }
+  return true;
+}
+
+// Jobs that fork their own groups and wait on them
+static bool TestNested(unsigned depth, unsigned fanOut)
+{
+  std::atomic<unsigned> leaves(0);
+  std::function<void(unsigned)> fork = [&](unsigned level)
+  {
+    if (level == depth)
+    {
+      leaves++;
+      return;
+    }
+    Util::JobGroup group;
+    for (unsigned i = 0; i < fanOut; i++)
+      group.Run([&fork, level] { fork(level + 1); });
+    group.Wait();
+  };
+  fork(0);
+
+  unsigned expected = 1;
+  for (unsigned i = 0; i < depth; i++)
+    expected *= fanOut;
+  return leaves == expected;
+}
+
+// Many small jobs in one group, queued from outside the pool
+static bool TestMany(unsigned count)
+{
+  std::atomic<unsigned> done(0);
+  Util::JobGroup group;
+  for (unsigned i = 0; i < count; i++)
+    group.Run([&done] { done++; });
+  group.Wait();
+  return done == count && group.Done();
+}
+
+static void RunTests(const std::string &config, std::vector<std::pair<std::string, bool>> *results)
+{
+  results->push_back({ config + " ParallelFor 0", TestParallelFor(0, 4) });
+  results->push_back({ config + " ParallelFor 1", TestParallelFor(1, 4) });
+  results->push_back({ config + " ParallelFor 384/1", TestParallelFor(384, 1) });
+  results->push_back({ config + " ParallelFor 384/7", TestParallelFor(384, 7) });
+  results->push_back({ config + " ParallelFor 100000/64", TestParallelFor(100000, 64) });
+  results->push_back({ config + " Nested 4x4", TestNested(4, 4) });
+  results->push_back({ config + " Many 10000", TestMany(10000) });
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+
+  // Without a pool, everything runs on the waiting thread
+  RunTests("No workers:", &test_results);
+
+  for (unsigned workers: { 1, 3, 8 })
+  {
+    Util::Jobs::Start(workers, 0);
+    RunTests(std::to_string(workers) + " workers:", &test_results);
+    test_results.push_back({ std::to_string(workers) + " workers: NumWorkers", Util::Jobs::NumWorkers() == workers });
+    Util::Jobs::Stop();
+  }
+
+  PrintTestResults(test_results);
+  return 0;
+}
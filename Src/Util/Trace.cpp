@@ -0,0 +1,137 @@
+#include "Util/Trace.h"
+
+#ifdef SUPERMODEL_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Util
+{
+  namespace Trace
+  {
+    static const uint32_t NUM_EVENTS = 1 << 16;   // per thread, must be a power of 2
+    static const uint32_t SAVE_MARGIN = 1 << 10;  // oldest events skipped when saving, as they may be overwritten meanwhile
+
+    struct Event
+    {
+      const char *name;
+      uint64_t start;
+      uint64_t end;     // value, if a counter
+      bool counter;
+    };
+
+    struct ThreadBuffer
+    {
+      unsigned id;
+      std::atomic<const char *> name;
+      std::atomic<uint32_t> count;  // total events recorded, the latest NUM_EVENTS of which are kept
+      Event events[NUM_EVENTS];
+    };
+
+    static std::mutex s_mutex;
+    static std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;  // never freed, as zones may still be recorded at exit
+
+    static ThreadBuffer *GetThreadBuffer()
+    {
+      thread_local ThreadBuffer *buffer = nullptr;
+      if (buffer == nullptr)
+      {
+        std::unique_ptr<ThreadBuffer> newBuffer(new ThreadBuffer());
+        newBuffer->name = nullptr;
+        newBuffer->count = 0;
+        std::lock_guard<std::mutex> lock(s_mutex);
+        newBuffer->id = unsigned(s_buffers.size() + 1);
+        buffer = newBuffer.get();
+        s_buffers.push_back(std::move(newBuffer));
+      }
+      return buffer;
+    }
+
+    uint64_t Now()
+    {
+      return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void Record(const char *name, uint64_t start, uint64_t end)
+    {
+      ThreadBuffer *buffer = GetThreadBuffer();
+      uint32_t count = buffer->count.load(std::memory_order_relaxed);
+      buffer->events[count & (NUM_EVENTS - 1)] = { name, start, end, false };
+      buffer->count.store(count + 1, std::memory_order_release);
+    }
+
+    void Counter(const char *name, uint64_t value)
+    {
+      ThreadBuffer *buffer = GetThreadBuffer();
+      uint32_t count = buffer->count.load(std::memory_order_relaxed);
+      buffer->events[count & (NUM_EVENTS - 1)] = { name, Now(), value, true };
+      buffer->count.store(count + 1, std::memory_order_release);
+    }
+
+    void SetThreadName(const char *name)
+    {
+      GetThreadBuffer()->name = name;
+    }
+
+    bool Save(const std::string &file)
+    {
+      FILE *fp = fopen(file.c_str(), "w");
+      if (fp == nullptr)
+        return false;
+
+      std::vector<ThreadBuffer *> buffers;
+      {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (auto &buffer: s_buffers)
+          buffers.push_back(buffer.get());
+      }
+
+      // Timestamps are relative to the earliest event saved
+      uint64_t origin = UINT64_MAX;
+      for (ThreadBuffer *buffer: buffers)
+      {
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        uint32_t first = count > NUM_EVENTS - SAVE_MARGIN ? count - (NUM_EVENTS - SAVE_MARGIN) : 0;
+        if (first < count && buffer->events[first & (NUM_EVENTS - 1)].start < origin)
+          origin = buffer->events[first & (NUM_EVENTS - 1)].start;
+      }
+
+      fputs("{\"traceEvents\":[\n", fp);
+      bool firstEvent = true;
+      for (ThreadBuffer *buffer: buffers)
+      {
+        const char *name = buffer->name;
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", firstEvent ? "" : ",\n", buffer->id, name ? name : "Unnamed");
+        firstEvent = false;
+
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        uint32_t first = count > NUM_EVENTS - SAVE_MARGIN ? count - (NUM_EVENTS - SAVE_MARGIN) : 0;
+        for (uint32_t i = first; i != count; i++)
+        {
+          const Event &event = buffer->events[i & (NUM_EVENTS - 1)];
+          if (event.start < origin)
+            continue;
+          if (event.counter)
+          {
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+              event.name, buffer->id, double(event.start - origin) / 1000.0, (unsigned long long) event.end);
+            continue;
+          }
+          fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            event.name, buffer->id, double(event.start - origin) / 1000.0, double(event.end - event.start) / 1000.0);
+        }
+      }
+      fputs("\n]}\n", fp);
+
+      bool ok = !ferror(fp);
+      fclose(fp);
+      return ok;
+    }
+  } // Trace
+} // Util
+
+#endif  // SUPERMODEL_TRACE
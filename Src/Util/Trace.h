@@ -0,0 +1,79 @@
+#ifndef INCLUDED_UTIL_TRACE_H
+#define INCLUDED_UTIL_TRACE_H
+
+/*
+ * Hot-path tracing, compiled in only when SUPERMODEL_TRACE is defined
+ * (ENABLE_TRACE=1 in the Makefiles) and otherwise free.
+ *
+ * TRACE_ZONE(name) records the time from where it appears to the end of the
+ * enclosing scope. TRACE_THREAD(name) names the calling thread in the trace.
+ * TRACE_COUNTER(name, value) records the value of a counter at this point,
+ * which the trace viewer plots over time. Names must be string literals (or
+ * otherwise outlive the trace). Each thread keeps its most recent zones in
+ * its own ring buffer, and Util::Trace::Save() writes them out in Chrome's
+ * trace event format, which chrome://tracing and Perfetto can open.
+ */
+
+#ifdef SUPERMODEL_TRACE
+
+#include <cstdint>
+#include <string>
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b)  TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name)    Util::Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_THREAD(name)  Util::Trace::SetThreadName(name)
+#define TRACE_COUNTER(name, value)  Util::Trace::Counter(name, value)
+
+namespace Util
+{
+  namespace Trace
+  {
+    // Nanoseconds since an arbitrary point in time
+    uint64_t Now();
+
+    void Record(const char *name, uint64_t start, uint64_t end);
+
+    void Counter(const char *name, uint64_t value);
+
+    void SetThreadName(const char *name);
+
+    /*
+     * Save(file):
+     *
+     * Writes the zones currently held by all threads to the given file as
+     * Chrome trace JSON. Threads may keep tracing while this runs. Returns
+     * false if the file could not be written.
+     */
+    bool Save(const std::string &file);
+
+    class Zone
+    {
+    public:
+      explicit Zone(const char *name)
+        : m_name(name),
+          m_start(Now())
+      {
+      }
+
+      ~Zone()
+      {
+        Record(m_name, m_start, Now());
+      }
+
+    private:
+      const char *m_name;
+      uint64_t m_start;
+    };
+  } // Trace
+} // Util
+
+#else
+
+#define TRACE_ZONE(name)    ((void) 0)
+#define TRACE_THREAD(name)  ((void) 0)
+#define TRACE_COUNTER(name, value)  ((void) 0)
+
+#endif  // SUPERMODEL_TRACE
+
+#endif  // INCLUDED_UTIL_TRACE_H